@@ -364,6 +364,20 @@ public:
         return;
     };
 
+    // NOTE: Same as RemoveAllElements but the buffer is kept for reuse unless it grew beyond "nMaxSizeToKeep" items.
+    VOID RemoveAllElementsKeepingBuffer(_In_ SIZE_T nMaxSizeToKeep)
+    {
+        if (nSize > nMaxSizeToKeep)
+        {
+            RemoveAllElements();
+        }
+        else
+        {
+            SetCount(0);
+        }
+        return;
+    };
+
     virtual TType *ReserveBlock(_In_ SIZE_T nItemsCount, _In_ SIZE_T nIndex = (SIZE_T)-1)
     {
         if (SetSize(nCount + nItemsCount) == FALSE)
@@ -0,0 +1,139 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_ASYNCLOGGER_H
+#define _MX_ASYNCLOGGER_H
+
+#include "Loggable.h"
+#include "Threads.h"
+#include "WaitableObjects.h"
+
+ //-----------------------------------------------------------
+
+#define MX_ASYNCLOGGER_SHARDS_COUNT 16
+
+//-----------------------------------------------------------
+
+ // NOTE: Messages are formatted by the calling thread straight into a ring buffer and delivered to the sink by a
+ //       background thread that wakes up periodically or when a ring gets half full. Each thread is bound to one
+ //       ring on its first message, rings are handed out round-robin so, unless there are more logging threads than
+ //       rings, a thread never competes with another for its ring. The drain thread never takes a lock.
+ //
+ //       Messages of the same thread are delivered in order. Messages of different threads may be reordered by up
+ //       to one drain interval. If a ring is full, the caller waits for the drain thread instead of dropping data.
+
+namespace MX {
+
+class CAsyncLogger : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    typedef struct tagSTATS
+    {
+        ULONGLONG nMessages;
+        ULONGLONG nBatches;
+        ULONGLONG nBytesWritten;
+        ULONGLONG nProducerWaits;
+        ULONGLONG nWriteErrors;
+        ULONGLONG nBytesDropped;
+    } STATS, *LPSTATS;
+
+public:
+    CAsyncLogger();
+    ~CAsyncLogger();
+
+    // NOTE: Lines are appended to the file as UTF-8 prefixed with the local time and the thread id.
+    //       If ring size is zero, 64KB per ring are used. The logger can be started again after Stop but the rings
+    //       are kept, so only the ring size of the first call is honored. A failed write drops its batch and is
+    //       counted in the stats.
+    HRESULT Start(_In_z_ LPCWSTR szFileNameW, _In_opt_ SIZE_T nRingSize = 0);
+    // NOTE: The callback is called from the drain thread, one message at a time.
+    HRESULT Start(_In_ CLoggable::OnLogCallback cCallback, _In_opt_ SIZE_T nRingSize = 0);
+
+    // NOTE: Pending messages are delivered before returning. Messages written after this call are rejected.
+    VOID Stop();
+
+    // NOTE: Can be bound as a CLoggable::OnLogCallback. Text is truncated to MX_LOGGABLE_MAX_TEXT_LENGTH characters.
+    HRESULT Write(_In_z_ LPCWSTR szTextW);
+    HRESULT WriteV(_In_ BOOL bAddError, _In_ HRESULT hResError, _In_z_ LPCWSTR szFormatW, _In_ va_list argptr);
+
+    // NOTE: Waits until all messages written before the call are delivered to the sink.
+    VOID Flush();
+
+    VOID GetStats(_Out_ LPSTATS lpStats);
+
+private:
+    typedef struct tagRECORD
+    {
+        DWORD dwSize;
+        DWORD dwThreadId; // zero marks a padding record
+        ULONGLONG nTime;
+    } RECORD, *LPRECORD;
+
+    typedef struct tagRING
+    {
+        LPBYTE lpBuffer;
+        SIZE_T volatile nHead;
+        SIZE_T volatile nTail;
+        LONG volatile nMutex;
+        BYTE aPadding[64 - sizeof(LPBYTE) - 2 * sizeof(SIZE_T) - sizeof(LONG)];
+    } RING, *LPRING;
+
+private:
+    HRESULT Initialize(_In_ SIZE_T nRingSize);
+
+    LPRING GetThreadRing();
+    LPRECORD ReserveRecord(_In_ LPRING lpRing);
+    VOID CommitRecord(_In_ LPRING lpRing, _In_ LPRECORD lpRecord, _In_ SIZE_T nTextLen);
+
+    VOID ThreadProc();
+    VOID DrainRings();
+    VOID DeliverRecord(_In_ LPRECORD lpRecord);
+    VOID FlushBatch();
+
+private:
+    typedef TClassWorkerThread<CAsyncLogger> CDrainThread;
+
+    LPRING lpRings{ NULL };
+    SIZE_T nRingSize{ 0 };
+    LONG volatile nRunning{ 0 };
+    LONG volatile nWakeRequested{ 0 };
+    CDrainThread cDrainThread;
+    CWindowsEvent cWakeEvent;
+
+    CLoggable::OnLogCallback cCallback;
+    CWindowsHandle cFile;
+    LPBYTE lpBatch{ NULL };
+    SIZE_T nBatchLen{ 0 };
+
+    struct
+    {
+        LONGLONG volatile nMessages{ 0 };
+        LONGLONG volatile nBatches{ 0 };
+        LONGLONG volatile nBytesWritten{ 0 };
+        LONGLONG volatile nProducerWaits{ 0 };
+        LONGLONG volatile nWriteErrors{ 0 };
+        LONGLONG volatile nBytesDropped{ 0 };
+    } sStats;
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_ASYNCLOGGER_H
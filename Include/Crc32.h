@@ -0,0 +1,45 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_CRC32_H
+#define _MX_CRC32_H
+
+#include "Defines.h"
+
+ //-----------------------------------------------------------
+
+ // NOTE: Values are compatible with zlib's crc32 and crc32_combine. Start with zero and pass the previous result to
+ //       continue a stream. CRC32C uses the Castagnoli polynomial (iSCSI, SCTP, ext4).
+ //
+ //       On x86/x64, large buffers are folded with PCLMULQDQ and CRC32C uses the SSE4.2 crc32 instruction. Other
+ //       processors use a slicing-by-8 table implementation.
+
+namespace MX {
+
+ULONG Crc32(_In_ ULONG nCrc, _In_reads_bytes_(nLength) LPCVOID lpData, _In_ SIZE_T nLength);
+ULONG Crc32Combine(_In_ ULONG nCrc1, _In_ ULONG nCrc2, _In_ ULONGLONG nLength2);
+
+ULONG Crc32C(_In_ ULONG nCrc, _In_reads_bytes_(nLength) LPCVOID lpData, _In_ SIZE_T nLength);
+ULONG Crc32CCombine(_In_ ULONG nCrc1, _In_ ULONG nCrc2, _In_ ULONGLONG nLength2);
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_CRC32_H
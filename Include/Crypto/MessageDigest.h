@@ -31,7 +31,7 @@ class CMessageDigest : public virtual CBaseMemObj, public CNonCopyableObj
 public:
     enum class eAlgorithm
     {
-        Invalid = 1,
+        Invalid = -1,
         CRC32 = 0,
         MD5,
         MD4,
@@ -47,7 +47,8 @@ public:
         SHA3_384,
         SHA3_512,
         Blake2s_256,
-        Blake2b_512
+        Blake2b_512,
+        CRC32C
     };
 
 public:
@@ -73,6 +74,19 @@ public:
     // NOTE: Returns -1 if unsupported
     static MX::CMessageDigest::eAlgorithm GetAlgorithm(_In_z_ LPCSTR szAlgorithmA);
 
+    // NOTE: Returns 0 if unsupported
+    static SIZE_T GetDigestSize(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm);
+
+    // NOTE: One-shot helpers for small inputs. They use process-wide cached algorithm handles and pooled contexts so
+    //       no allocation nor algorithm lookup is done once warmed up. Returns MX_E_BufferOverflow if the output buffer
+    //       is smaller than the digest size.
+    static HRESULT Hash(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCVOID lpData, _In_ SIZE_T nDataLength,
+                        _Out_writes_bytes_(nOutputSize) LPVOID lpOutput, _In_ SIZE_T nOutputSize,
+                        _Out_opt_ SIZE_T *lpnResultSize = NULL);
+    static HRESULT Hmac(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCVOID lpKey, _In_ SIZE_T nKeyLen,
+                        _In_ LPCVOID lpData, _In_ SIZE_T nDataLength, _Out_writes_bytes_(nOutputSize) LPVOID lpOutput,
+                        _In_ SIZE_T nOutputSize, _Out_opt_ SIZE_T *lpnResultSize = NULL);
+
 private:
     VOID CleanUp(_In_ BOOL bZeroData);
 
@@ -66,7 +66,8 @@ public:
         AES_256_OFB,
         AES_256_CFB1,
         AES_256_CFB8,
-        AES_256_CFB128
+        AES_256_CFB128,
+        ChaCha20_Poly1305
     };
 
 public:
@@ -91,6 +92,19 @@ public:
     SIZE_T GetAvailableDecryptedData() const;
     SIZE_T GetDecryptedData(_Out_writes_(nDestSize) LPVOID lpDest, _In_ SIZE_T nDestSize);
 
+    // NOTE: One-shot authenticated encryption for AEAD algorithms (AES-GCM and ChaCha20-Poly1305). The key schedule
+    //       is computed once by SetAeadKey and reused by every message until the key or the algorithm changes.
+    //       Output may be the same buffer as the input for in-place operation. AeadDecrypt returns MX_E_InvalidData
+    //       and wipes the output if the tag does not match or decryption fails. The expanded key lives in contexts
+    //       owned by the object, so AEAD calls on the same object are not thread safe. Use one object per thread.
+    HRESULT SetAeadKey(_In_ LPCVOID lpKey, _In_ SIZE_T nKeyLen);
+    HRESULT AeadEncrypt(_In_ LPCVOID lpNonce, _In_ SIZE_T nNonceLen, _In_opt_ LPCVOID lpAad, _In_ SIZE_T nAadLen,
+                        _In_ LPCVOID lpPlainText, _In_ SIZE_T nLength, _Out_writes_bytes_(nLength) LPVOID lpCipherText,
+                        _Out_writes_bytes_(nTagLen) LPVOID lpTag, _In_opt_ SIZE_T nTagLen = 16);
+    HRESULT AeadDecrypt(_In_ LPCVOID lpNonce, _In_ SIZE_T nNonceLen, _In_opt_ LPCVOID lpAad, _In_ SIZE_T nAadLen,
+                        _In_ LPCVOID lpCipherText, _In_ SIZE_T nLength, _Out_writes_bytes_(nLength) LPVOID lpPlainText,
+                        _In_reads_bytes_(nTagLen) LPCVOID lpTag, _In_opt_ SIZE_T nTagLen = 16);
+
 private:
     HRESULT InternalInitialize();
 
@@ -23,16 +23,58 @@
 #include "HttpBodyParserBase.h"
 #include "..\WaitableObjects.h"
 #include "..\Strings\Strings.h"
+#include "..\ArrayList.h"
 #include "..\RapidJSON\rapidjson-all.h"
 
  //-----------------------------------------------------------
 
 namespace MX {
 
+// NOTE: The body is parsed as it arrives by rapidjson's iterative reader. Only complete tokens are handed to the
+//       reader, so a token split across packets is kept until the rest of it arrives. By default, a DOM document is
+//       built directly from the reader events so the raw body is never kept in memory. If an event callback is
+//       provided, events are only forwarded to it and no document is created.
 class CHttpBodyParserJSON : public MX::CHttpBodyParserBase
 {
 public:
-    CHttpBodyParserJSON();
+    enum class eEventType
+    {
+        Null,
+        Boolean,
+        Integer,
+        UnsignedInteger,
+        Double,
+        String,
+        Key,
+        StartObject,
+        EndObject,
+        StartArray,
+        EndArray
+    };
+
+    typedef struct tagEVENT
+    {
+        eEventType nType;
+        union
+        {
+            BOOL bValue;
+            LONGLONG llValue;
+            ULONGLONG ullValue;
+            double nDblValue;
+            struct
+            {
+                LPCSTR szValueA; // UTF-8, only valid during the callback
+                SIZE_T nLength;
+            } sString;
+            ULONG nItemsCount; // EndObject/EndArray
+        };
+    } EVENT, *LPEVENT;
+
+    typedef Callback<HRESULT(_In_ const EVENT &sEvent, _In_opt_ LPVOID lpUserParam)> OnEventCallback;
+
+public:
+    CHttpBodyParserJSON(_In_opt_ OnEventCallback cEventCallback = NullCallback(), _In_opt_ LPVOID lpUserParam = NULL,
+                        _In_ ULONGLONG ullMaxBodySize = 33554432ui64, _In_ DWORD dwMaxDepth = 128);
     ~CHttpBodyParserJSON();
 
     LPCSTR GetType() const
@@ -62,10 +104,39 @@ private:
         Error
     };
 
+    class CReaderHandler;
+    class CDocumentFinalizer;
+
 private:
+    HRESULT ParseData(_In_ LPCSTR szDataA, _In_ SIZE_T nDataSize);
+    HRESULT EndOfData();
+
+    SIZE_T ScanTokens(_In_ LPCSTR szDataA, _In_ SIZE_T nDataSize, _In_ SIZE_T nOffset);
+    HRESULT FeedReader(_In_ LPCSTR szDataA, _In_ SIZE_T nDataSize);
+
+    HRESULT EmitEvent(_In_ const EVENT &sEvent);
+
+private:
+    OnEventCallback cEventCallback;
+    LPVOID lpUserParam;
+    ULONGLONG ullMaxBodySize;
+    DWORD dwMaxDepth;
+
     eState nState;
-    CSecureStringA cStrTempA;
+    ULONGLONG ullBodySize{ 0 };
     rapidjson::Document d;
+    rapidjson::Reader cReader;
+    DWORD dwDepth{ 0 };
+    HRESULT hrHandlerError{ S_OK };
+
+    struct
+    {
+        CSecureStringA cStrPendingA; // tail that may end inside a token
+        BOOL bInString{ FALSE };
+        BOOL bEscape{ FALSE };
+        BOOL bPrevIsTerminal{ TRUE };
+        CHAR chLastSignificant{ 0 };
+    } sScanner;
 };
 
 } // namespace MX
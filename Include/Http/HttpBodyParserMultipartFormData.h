@@ -49,6 +49,10 @@ protected:
 
     HRESULT ParseHeader(_Inout_ CStringA &cStrLineA);
     HRESULT AccumulateData(_In_ CHAR chA);
+    HRESULT AccumulateData(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen);
+    HRESULT WriteToFile(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen);
+
+    SIZE_T GetDataBlockLength(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen);
 
 private:
     enum class eState
@@ -84,6 +88,8 @@ private:
     DWORD dwMaxFilesCount{ 0 };
 
     CStringA cStrBoundaryA;
+    CStringA cStrDelimiterA;
+    SIZE_T aDelimiterSkipTable[256]{};
 
     struct
     {
@@ -0,0 +1,96 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_HTTPBODYPARSERSTREAM_H
+#define _MX_HTTPBODYPARSERSTREAM_H
+
+#include "HttpBodyParserBase.h"
+#include "HttpClient.h"
+#include "..\Streams.h"
+
+ //-----------------------------------------------------------
+
+namespace MX {
+
+// NOTE: Hands the request body to the caller as it arrives instead of buffering it in memory or in a temporary
+//       file. The callback runs in the connection's worker thread with the request locked and receives a NULL
+//       pointer once the body ends. Use CClientRequest::PauseRequestBody/ResumeRequestBody to throttle the client
+//       when the consumer cannot keep up.
+//
+//       With a CHttpClient, the body is forwarded as the client's dynamic post data. Call EnableDynamicPostData and
+//       add the "Content-Length" header to the client before opening it. Data that arrives while the client is still
+//       sending its request headers is queued by the client, and the end of the body calls SignalEndOfPostData.
+class CHttpBodyParserStream : public CHttpBodyParserBase, public CNonCopyableObj
+{
+public:
+    typedef Callback<HRESULT(_In_opt_ LPCVOID lpData, _In_ SIZE_T nDataSize, _In_opt_ LPVOID lpUserParam)> OnDataCallback;
+
+public:
+    CHttpBodyParserStream(_In_ OnDataCallback cDataCallback, _In_opt_ LPVOID lpUserParam,
+                          _In_ ULONGLONG ullMaxBodySize = 10ui64 * 1048576ui64);
+    CHttpBodyParserStream(_In_ CStream *lpStream, _In_ ULONGLONG ullMaxBodySize = 10ui64 * 1048576ui64);
+    CHttpBodyParserStream(_In_ CHttpClient *lpHttpClient, _In_ ULONGLONG ullMaxBodySize = 10ui64 * 1048576ui64);
+    ~CHttpBodyParserStream();
+
+    LPCSTR GetType() const
+    {
+        return "stream";
+    };
+
+    ULONGLONG GetSize() const
+    {
+        return nSize;
+    };
+
+    CStream *GetStream() const;
+    CHttpClient *GetHttpClient() const;
+
+protected:
+    HRESULT Initialize(_In_ Internals::CHttpParser &cHttpParser);
+    HRESULT Parse(_In_opt_ LPCVOID lpData, _In_opt_ SIZE_T nDataSize);
+
+private:
+    HRESULT WriteToStream(_In_ LPCVOID lpData, _In_ SIZE_T nDataSize);
+
+private:
+    enum class eState
+    {
+        Reading,
+        Done,
+        Error
+    };
+
+    OnDataCallback cDataCallback;
+    LPVOID lpUserParam;
+    TAutoRefCounted<CStream> cStream;
+    TAutoRefCounted<CHttpClient> cHttpClient;
+    ULONGLONG ullMaxBodySize;
+
+    struct
+    {
+        eState nState;
+    } sParser;
+    ULONGLONG nSize;
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_HTTPBODYPARSERSTREAM_H
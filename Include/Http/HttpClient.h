@@ -305,6 +305,7 @@ private:
         LPSTR szNameA{ NULL }, szValueA{ NULL };
         SIZE_T nValueLen{ 0 };
         TAutoRefCounted<CStream> cStream;
+        BOOL bAppendable{ FALSE };
     };
 
 private:
@@ -31,6 +31,7 @@
 #include "HttpCookie.h"
 #include "HttpHeaderBase.h"
 #include "Url.h"
+#include "UrlView.h"
 #include <intsafe.h>
 
  //-----------------------------------------------------------
@@ -118,7 +119,10 @@ public:
     int GetRequestVersionMajor() const;
     int GetRequestVersionMinor() const;
     LPCSTR GetRequestMethod() const;
+    // NOTE: The CUrl is built from the request target (and the Host header) on first use. It is left empty
+    //       if the target cannot be converted. Use the view to inspect the raw target without building it.
     CUrl *GetRequestUri() const;
+    const CUrlView &GetRequestUrlView() const;
     MX::Http::eBrowser GetRequestBrowser() const;
 
     BOOL IsKeepAliveRequest() const;
@@ -126,10 +130,16 @@ public:
     LONG GetResponseStatus() const;
     LPCSTR GetResponseReasonA() const;
 
+    // NOTE: Response cookies when acting as a client.
     CHttpCookieArray &Cookies() const
     {
         return const_cast<CHttpParser *>(this)->cCookies;
     };
+    // NOTE: Request cookies when acting as a server.
+    CHttpCookieJar &RequestCookies() const
+    {
+        return const_cast<CHttpParser *>(this)->cRequestCookies;
+    };
     CHttpHeaderArray &Headers() const
     {
         return const_cast<CHttpParser *>(this)->cHeaders;
@@ -139,6 +149,7 @@ private:
     HRESULT ParseRequestLine(_In_z_ LPCSTR szLineA);
     HRESULT ParseStatusLine(_In_z_ LPCSTR szLineA);
     HRESULT ParseHeader(_In_ CStringA &cStrLineA);
+    HRESULT BuildRequestUri();
 
     HRESULT ProcessContent(_In_ LPCVOID lpContent, _In_ SIZE_T nContentSize);
     HRESULT FlushContent();
@@ -155,7 +166,10 @@ private:
     {
         ULONG nHttpProtocol{ 0 };
         LPCSTR szMethodA{ NULL };
+        CStringA cStrRawUrlA;
+        CUrlView cUrlView;
         CUrl cUrl;
+        BOOL bUrlBuilt{ FALSE };
         MX::Http::eBrowser nBrowser{ Http::eBrowser::Other };
     } sRequest;
     struct
@@ -165,6 +179,7 @@ private:
     } sResponse;
     LONG nHeaderFlags{ 0 };
     CHttpCookieArray cCookies;
+    CHttpCookieJar cRequestCookies;
     CHttpHeaderArray cHeaders;
     struct
     {
@@ -142,6 +142,62 @@ public:
     HRESULT RemoveExpiredAndInvalid(_In_opt_ const CDateTime *lpDate = NULL);
 };
 
+//-----------------------------------------------------------
+
+// NOTE: Holds the cookies sent by a client. Headers are copied once into a raw buffer and names/values are kept
+//       as slices of it so a request does not pay for one CHttpCookie per cookie. A CHttpCookie is only created
+//       when someone asks for it. Like CHttpCookieArray::Merge, the first cookie with a given name wins.
+class CHttpCookieJar : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CHttpCookieJar();
+    ~CHttpCookieJar();
+
+    VOID Reset();
+
+    // NOTE: Cookies are appended to the existing ones. On failure, the jar is left untouched.
+    HRESULT ParseFromRequestHeader(_In_ LPCSTR szSrcA, _In_opt_ SIZE_T nSrcLen = (SIZE_T)-1);
+
+    SIZE_T GetCount() const
+    {
+        return aEntriesList.GetCount();
+    };
+
+    // NOTE: Returns NULL if the index is out of range.
+    LPCSTR GetName(_In_ SIZE_T nIndex) const;
+    LPCSTR GetValue(_In_ SIZE_T nIndex) const;
+
+    // NOTE: Returns -1 if not found
+    SIZE_T Find(_In_z_ LPCSTR szNameA) const;
+    // NOTE: Returns -1 if not found
+    SIZE_T Find(_In_z_ LPCWSTR szNameW) const;
+
+    // NOTE: The returned cookie is owned by the jar. Call AddRef if you need to keep it.
+    HRESULT GetCookie(_In_ SIZE_T nIndex, _Deref_out_ CHttpCookie **lplpCookie);
+
+    HRESULT ToArray(_Inout_ CHttpCookieArray &cDestArray);
+
+private:
+    typedef struct tagENTRY
+    {
+        ULONG nNameOffset;
+        ULONG nNameLen;
+        ULONG nValueOffset;
+        ULONG nValueLen;
+        ULONG nHash;
+        ULONG nNextInBucket;
+        CHttpCookie *lpCookie;
+    } ENTRY, *LPENTRY;
+
+    SIZE_T FindEntry(_In_ LPCSTR szNameA, _In_ SIZE_T nNameLen, _In_ ULONG nHash) const;
+    VOID RemoveEntriesFrom(_In_ SIZE_T nIndex);
+
+private:
+    CStringA cStrBufferA;
+    TArrayList4Structs<ENTRY, 16> aEntriesList;
+    ULONG aBuckets[32];
+};
+
 } // namespace MX
 
 //-----------------------------------------------------------
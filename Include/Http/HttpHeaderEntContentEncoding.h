@@ -34,7 +34,8 @@ public:
         Unsupported = -1,
         Identity = 0,
         GZip,
-        Deflate
+        Deflate,
+        Brotli
     };
 
     CHttpHeaderEntContentEncoding();
@@ -39,6 +39,10 @@ public:
     HRESULT Build(_Inout_ CStringA &cStrDestA, _In_ Http::eBrowser nBrowser);
 
     HRESULT SetRange(_In_ ULONGLONG nByteStart, _In_ ULONGLONG nByteEnd, _In_ ULONGLONG nTotalBytes);
+
+    // NOTE: Builds "bytes */total" as required by 416 responses.
+    HRESULT SetUnsatisfiedRange(_In_ ULONGLONG nTotalBytes);
+
     ULONGLONG GetRangeStart() const;
     ULONGLONG GetRangeEnd() const;
     ULONGLONG GetRangeTotal() const;
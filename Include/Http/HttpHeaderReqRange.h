@@ -41,15 +41,24 @@ public:
 
     HRESULT AddRangeSet(_In_ ULONGLONG nByteStart, _In_ ULONGLONG nByteEnd);
 
+    HRESULT AddSuffixRangeSet(_In_ ULONGLONG nSuffixLength);
+
     SIZE_T GetRangeSetsCount() const;
     ULONGLONG GetRangeSetStart(_In_ SIZE_T nIndex) const;
     ULONGLONG GetRangeSetEnd(_In_ SIZE_T nIndex) const;
+    BOOL IsSuffixRangeSet(_In_ SIZE_T nIndex) const;
+
+    // NOTE: Converts the range set into absolute offsets for an entity of the given size. Returns FALSE if the
+    //       range set is not satisfiable.
+    BOOL GetRangeSetBounds(_In_ SIZE_T nIndex, _In_ ULONGLONG nTotalSize, _Out_ PULONGLONG lpnByteStart,
+                           _Out_ PULONGLONG lpnByteEnd) const;
 
 private:
     typedef struct
     {
         ULONGLONG nByteStart;
         ULONGLONG nByteEnd;
+        BOOL bIsSuffix;
     } RANGESET;
 
     TArrayList4Structs<RANGESET> cRangeSetsList;
@@ -0,0 +1,152 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_HTTPREQUESTLIMITER_H
+#define _MX_HTTPREQUESTLIMITER_H
+
+#include "..\Defines.h"
+#include "..\WaitableObjects.h"
+#include "..\RedBlackTree.h"
+#if (!defined(_WS2DEF_)) && (!defined(_WINSOCKAPI_))
+#include <WS2tcpip.h>
+#endif //!_WS2DEF_ && !_WINSOCKAPI_
+
+ //-----------------------------------------------------------
+
+#define MX_HTTP_REQUEST_LIMITER_SHARDS_COUNT 64
+
+//-----------------------------------------------------------
+
+ // NOTE: Connections and requests are accounted per IP address and per subnet. Each address bucket lives in one
+ //       of several independently locked shards selected by a hash of the address so concurrent accepts from
+ //       different clients rarely touch the same lock.
+ //
+ //       Request rates use a lock-free token bucket (GCRA) per address. Buckets whose connections are all closed
+ //       and whose tokens are fully refilled are lazily removed when new buckets are added to the same shard.
+
+namespace MX {
+
+class CHttpRequestLimiter : public virtual CBaseMemObj, public CNonCopyableObj
+{
+private:
+    class CBucket;
+
+public:
+    typedef struct tagCONNECTION
+    {
+        CBucket *lpIpBucket;
+        CBucket *lpSubnetBucket;
+    } CONNECTION, *LPCONNECTION;
+
+    typedef struct tagSTATS
+    {
+        ULONGLONG nIpBuckets;
+        ULONGLONG nSubnetBuckets;
+        ULONGLONG nConnectionsRejectedByIp;
+        ULONGLONG nConnectionsRejectedBySubnet;
+        ULONGLONG nRequestsRejectedByServer;
+        ULONGLONG nRequestsRejectedByIp;
+        ULONGLONG nRequestsRejectedBySubnet;
+        ULONGLONG nExpiredBuckets;
+    } STATS, *LPSTATS;
+
+public:
+    CHttpRequestLimiter();
+    ~CHttpRequestLimiter();
+
+    // NOTE: Limits must be set before the limiter is used. A value of zero means no limit.
+    VOID SetMaxConnectionsPerIp(_In_ DWORD dwLimit);
+    VOID SetMaxConnectionsPerSubnet(_In_ DWORD dwLimit);
+    VOID SetSubnetPrefixLength(_In_ DWORD dwIPv4Bits, _In_ DWORD dwIPv6Bits);
+
+    // NOTE: If burst size is zero, up to one second worth of requests are allowed in a burst.
+    VOID SetMaxRequestsPerSecond(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize);
+    VOID SetMaxRequestsPerSecondPerIp(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize);
+    VOID SetMaxRequestsPerSecondPerSubnet(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize);
+
+    BOOL IsTrackingAddresses() const;
+
+    // NOTE: Returns E_ACCESSDENIED if the connection must be rejected. In that case, the connection is not tracked.
+    HRESULT AddConnection(_In_ PSOCKADDR_INET lpAddr, _Out_ LPCONNECTION lpConn);
+    VOID RemoveConnection(_Inout_ LPCONNECTION lpConn);
+
+    // NOTE: Returns FALSE if the request exceeds the server-wide or the connection's address rate limits.
+    BOOL AllowRequest(_In_opt_ LPCONNECTION lpConn);
+
+    VOID GetStats(_Out_ LPSTATS lpStats);
+
+private:
+    typedef struct tagRATE
+    {
+        LONGLONG llIntervalUs;
+        LONGLONG llToleranceUs;
+    } RATE, *LPRATE;
+
+    typedef struct tagKEY
+    {
+        BYTE aAddress[16];
+        BYTE nFamily;
+        BYTE nPrefixLength;
+        BYTE bIsSubnet;
+    } KEY, *LPKEY;
+
+    typedef struct tagSHARD
+    {
+        RWLOCK sRwMutex;
+        CRedBlackTree cTree;
+        LONGLONG llLastSweepUs;
+    } SHARD, *LPSHARD;
+
+private:
+    CBucket *AcquireBucket(_In_ LPKEY lpKey, _In_ DWORD dwMaxConnections, _Out_ HRESULT &hRes);
+    VOID SweepShard(_In_ LPSHARD lpShard, _In_ LONGLONG llNowUs);
+
+    BOOL ConsumeToken(_Inout_ LONGLONG volatile *lpllTat, _In_ LPRATE lpRate, _In_ LONGLONG llNowUs);
+
+    LONGLONG GetTimeUs() const;
+
+    static VOID SetRate(_Out_ LPRATE lpRate, _In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize);
+    static VOID BuildKey(_Out_ LPKEY lpKey, _In_ PSOCKADDR_INET lpAddr, _In_ BOOL bIsSubnet, _In_ DWORD dwIPv4Bits,
+                         _In_ DWORD dwIPv6Bits);
+
+private:
+    ULARGE_INTEGER uliStart{}, uliFrequency{};
+    DWORD dwMaxConnectionsPerIp{ 0 }, dwMaxConnectionsPerSubnet{ 0 };
+    DWORD dwIPv4SubnetBits{ 24 }, dwIPv6SubnetBits{ 64 };
+    RATE sServerRate{}, sIpRate{}, sSubnetRate{};
+    LONGLONG volatile llServerTat{ 0 };
+    SHARD aShards[MX_HTTP_REQUEST_LIMITER_SHARDS_COUNT];
+    struct
+    {
+        LONGLONG volatile nIpBuckets{ 0 };
+        LONGLONG volatile nSubnetBuckets{ 0 };
+        LONGLONG volatile nConnectionsRejectedByIp{ 0 };
+        LONGLONG volatile nConnectionsRejectedBySubnet{ 0 };
+        LONGLONG volatile nRequestsRejectedByServer{ 0 };
+        LONGLONG volatile nRequestsRejectedByIp{ 0 };
+        LONGLONG volatile nRequestsRejectedBySubnet{ 0 };
+        LONGLONG volatile nExpiredBuckets{ 0 };
+    } sStats;
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_HTTPREQUESTLIMITER_H
@@ -27,6 +27,7 @@
 #include "HttpCommon.h"
 #include "HttpCookie.h"
 #include "HttpBodyParserBase.h"
+#include "HttpRequestLimiter.h"
 #include "WebSockets.h"
 
  //-----------------------------------------------------------
@@ -70,6 +71,8 @@ public:
     ~CHttpServer();
 
     VOID SetOption_MaxConnectionsPerIp(_In_ DWORD dwLimit);
+    VOID SetOption_MaxConnectionsPerSubnet(_In_ DWORD dwLimit);
+    VOID SetOption_SubnetPrefixLength(_In_ DWORD dwIPv4Bits, _In_ DWORD dwIPv6Bits);
     VOID SetOption_RequestHeaderTimeout(_In_ DWORD dwTimeoutMs);
     VOID SetOption_GracefulTerminationTimeout(_In_ DWORD dwTimeoutMs);
     VOID SetOption_KeepAliveTimeout(_In_ DWORD dwTimeoutMs);
@@ -84,6 +87,13 @@ public:
     VOID SetOption_MaxBodySize(_In_ ULONGLONG ullSize);
     VOID SetOption_MaxIncomingBytesWhileSending(_In_ DWORD dwMaxIncomingBytesWhileSending);
     VOID SetOption_MaxRequestsPerSecond(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize);
+    VOID SetOption_MaxRequestsPerSecondPerIp(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize);
+    VOID SetOption_MaxRequestsPerSecondPerSubnet(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize);
+
+    // NOTE: Closed connections keep their request object, with its buffers, for the next accepted connection.
+    //       Only objects created by the server itself are recycled, not the ones returned by the new request
+    //       object callback. Zero disables recycling.
+    VOID SetOption_MaxRecycledRequests(_In_ DWORD dwCount);
 
     VOID SetQuerySslCertificatesCallback(_In_ OnQuerySslCertificatesCallback cQuerySslCertificatesCallback);
     VOID SetNewRequestObjectCallback(_In_ OnNewRequestObjectCallback cNewRequestObjectCallback);
@@ -100,6 +110,8 @@ public:
                            _In_opt_ CSockets::CListenerOptions *lpOptions = NULL);
     VOID StopListening();
 
+    VOID GetRequestLimiterStats(_Out_ CHttpRequestLimiter::LPSTATS lpStats);
+
 public:
     class CClientRequest : public CIpc::CUserData
     {
@@ -117,9 +129,14 @@ public:
         HANDLE GetAbortEvent() const;
 
         HRESULT EnableDirectResponse();
+        // NOTE: Sends the response body while it is being produced instead of queuing it until the request ends. The
+        //       headers go out with the first data, the body is sent with "Transfer-Encoding: chunked" (HTTP/1.0
+        //       clients get it unframed and the connection is closed) and terminated when the request ends.
+        HRESULT EnableChunkedResponse();
 
         LPCSTR GetMethod() const;
         CUrl *GetUrl() const;
+        const CUrlView &GetUrlView() const;
 
         CHttpServer *GetHttpServer() const
         {
@@ -128,6 +145,11 @@ public:
 
         CHttpBodyParserBase *GetRequestBodyParser() const;
 
+        // NOTE: Flow control for streamed request bodies. While paused, the received data is not parsed and the
+        //       socket stops reading so the client is throttled by TCP. Only valid while the body is being received.
+        HRESULT PauseRequestBody();
+        HRESULT ResumeRequestBody();
+
         SIZE_T GetRequestHeadersCount() const;
         CHttpHeaderBase *GetRequestHeader(_In_ SIZE_T nIndex) const;
         CHttpHeaderBase *GetRequestHeaderByName(_In_z_ LPCSTR szNameA) const;
@@ -140,6 +162,11 @@ public:
         CHttpCookie *GetRequestCookie(_In_ SIZE_T nIndex) const;
         CHttpCookie *GetRequestCookieByName(_In_z_ LPCSTR szNameA) const;
         CHttpCookie *GetRequestCookieByName(_In_z_ LPCWSTR szNameW) const;
+        // NOTE: Raw name/value of a request cookie, valid until the request ends. They do not create a
+        //       CHttpCookie so prefer them when the cookie is only read.
+        LPCSTR GetRequestCookieName(_In_ SIZE_T nIndex) const;
+        LPCSTR GetRequestCookieValue(_In_ SIZE_T nIndex) const;
+        LPCSTR GetRequestCookieValueByName(_In_z_ LPCSTR szNameA) const;
 
         HRESULT ResetResponse();
 
@@ -195,6 +222,22 @@ public:
         HRESULT SendFile(_In_z_ LPCWSTR szFileNameW);
         HRESULT SendStream(_In_ CStream *lpStream);
 
+        // NOTE: Only for direct responses. Sends the headers if not done yet and, if more than "nMaxPendingBytes" were
+        //       sent since the last flush, blocks until the connection wrote everything queued so far. Call it from the
+        //       producer to limit the memory held by a slow client.
+        HRESULT FlushResponse(_In_opt_ SIZE_T nMaxPendingBytes = 0);
+
+        // NOTE: Sends the byte ranges requested in "lpRangeHeader" (or in the request's "Range" header if NULL) with a
+        //       206 status, as "multipart/byteranges" when more than one range remains after coalescing. "If-Range" is
+        //       checked against the "ETag" and "Last-Modified" response headers so set them before calling. Falls back
+        //       to the whole entity when there is no usable range and answers 416 when none can be satisfied.
+        HRESULT SendFileRange(_In_z_ LPCWSTR szFileNameW, _In_opt_ CHttpHeaderReqRange *lpRangeHeader = NULL);
+        HRESULT SendStreamRange(_In_ CStream *lpStream, _In_opt_ CHttpHeaderReqRange *lpRangeHeader = NULL);
+
+        // NOTE: Returns TRUE if the request has no "If-Range" header or if it matches the "ETag" or "Last-Modified"
+        //       response headers already added. Use it before honoring a "Range" header in a custom handler.
+        BOOL IsIfRangeSatisfied() const;
+
         HRESULT SetMimeTypeFromFileName(_In_opt_z_ LPCWSTR szFileNameW = NULL);
         HRESULT SetFileName(_In_opt_z_ LPCWSTR szFileNameW = NULL, _In_opt_ BOOL bInline = FALSE);
 
@@ -207,6 +250,9 @@ public:
         HANDLE GetUnderlyingSocketHandle() const;
         CSockets *GetUnderlyingSocketManager() const;
 
+        // NOTE: Address of the client when the connection was accepted. Returns MX_E_NotFound if it is unknown.
+        HRESULT GetPeerAddress(_Out_ PSOCKADDR_INET lpAddr) const;
+
         virtual HRESULT OnSetup()
         {
             return S_OK;
@@ -262,6 +308,7 @@ public:
         HRESULT Initialize(_In_ CHttpServer *lpHttpServer, _In_ CSockets *lpSocketMgr, _In_ HANDLE hConn, _In_ DWORD dwMaxHeaderSize);
 
         HRESULT ResetForNewRequest();
+        VOID ResetForReuse();
 
         HRESULT SetState(_In_ eState nNewState);
 
@@ -270,8 +317,14 @@ public:
         BOOL HasHeadersBeenSent() const;
 
         HRESULT SendHeaders();
+        HRESULT AppendToHeaders(_In_ LPCSTR szStrA, _In_opt_ SIZE_T nStrLen = (SIZE_T)-1);
         HRESULT SendQueuedStreams();
 
+        HRESULT StartStreamedResponse();
+        HRESULT SendChunk(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen);
+        HRESULT SendChunkHeader(_In_ ULONGLONG nChunkLen);
+        HRESULT EndChunkedResponse();
+
         VOID MarkLinkAsClosed();
         BOOL IsLinkClosed() const;
 
@@ -290,6 +343,7 @@ public:
         CSockets *lpSocketMgr{ NULL };
         HANDLE hConn{ NULL };
         SOCKADDR_INET sPeerAddr{ 0 };
+        CHttpRequestLimiter::CONNECTION sLimiterConn{};
         eState nState{ eState::Inactive };
         LONG volatile nFlags{ 0 };
         HRESULT hrErrorCode = { S_OK };
@@ -307,11 +361,21 @@ public:
             CHttpCookieArray cCookies;
             TArrayListWithRelease<CStream *> aStreamsList;
             BOOL bLastStreamIsData{ FALSE };
+            BOOL bHasExternalStreams{ FALSE };
             LPCSTR szMimeTypeHintA{ NULL };
             CStringW cStrFileNameW;
             BOOL bIsInline{ FALSE };
             BOOL bDirect{ FALSE }, bPreserveWebSocketHeaders{ FALSE };
+            BOOL bStreamed{ FALSE }, bChunked{ FALSE }, bChunkOpen{ FALSE };
+            ULONGLONG ullUnflushedBytes{ 0 };
         } sResponse;
+        CWindowsEvent cOutputDrainedEv;
+        struct
+        {
+            LPBYTE lpBuffer{ NULL };
+            SIZE_T nSize{ 0 }, nLen{ 0 };
+        } sHeaderBuffer;
+        BOOL bRecyclable{ FALSE };
     };
 
 private:
@@ -337,7 +401,12 @@ private:
     HRESULT OnSocketConnect(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ CIpc::CUserData *lpUserData);
     HRESULT OnSocketDataReceived(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ CIpc::CUserData *lpUserData);
 
-    BOOL CheckRateLimit();
+    BOOL CheckRateLimit(_In_ CClientRequest *lpRequest);
+
+    CClientRequest *GetRecycledRequest();
+    // NOTE: Must be called with the requests list lock held. Returns FALSE if the pool is full and the caller
+    //       still owns the reference.
+    BOOL RecycleRequest(_In_ CClientRequest *lpRequest);
 
     VOID TerminateRequest(_In_ CClientRequest *lpRequest, _In_ HRESULT hrErrorCode);
     VOID OnRequestError(_In_ CClientRequest *lpRequest, _In_ HRESULT hrErrorCode, _Inout_ CClientRequest::eTimeoutTimer &nTimersToStart);
@@ -348,6 +417,7 @@ private:
     static LPCSTR GetStatusCodeMessage(_In_ LONG nStatusCode);
 
     VOID OnAfterSendResponse(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ LPVOID lpCookie, _In_ CIpc::CUserData *lpUserData);
+    VOID OnResponseOutputDrained(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ LPVOID lpCookie, _In_ CIpc::CUserData *lpUserData);
 
     BOOL IsWebSocket(_In_ CClientRequest *lpRequest);
     HRESULT ValidateWebSocket(_In_ CClientRequest *lpRequest, _Inout_ WEBSOCKET_REQUEST_DATA &sData);
@@ -358,41 +428,9 @@ private:
 
     HRESULT OnDownloadStarted(_Out_ LPHANDLE lphFile, _In_z_ LPCWSTR szFileNameW, _In_ LPVOID lpUserParam);
 
-private:
-    class CRequestLimiter : public virtual CBaseMemObj
-    {
-    public:
-        CRequestLimiter(_In_ PSOCKADDR_INET lpAddr) : CBaseMemObj()
-        {
-            return;
-        };
-
-        static int InsertCompareFunc(_In_ LPVOID lpContext, _In_ CRedBlackTreeNode *lpNode1, _In_ CRedBlackTreeNode *lpNode2)
-        {
-            CRequestLimiter *lpLimiter1 = CONTAINING_RECORD(lpNode1, CRequestLimiter, cTreeNode);
-            CRequestLimiter *lpLimiter2 = CONTAINING_RECORD(lpNode2, CRequestLimiter, cTreeNode);
-            return ::MxMemCompare(&(lpLimiter1->sAddr), &(lpLimiter2->sAddr), sizeof(SOCKADDR_INET));
-        };
-
-        static int SearchCompareFunc(_In_ LPVOID lpContext, _In_ PSOCKADDR_INET key, _In_ CRedBlackTreeNode *lpNode)
-        {
-            CRequestLimiter *lpLimiter = CONTAINING_RECORD(lpNode, CRequestLimiter, cTreeNode);
-
-            return ::MxMemCompare(key, &(lpLimiter->sAddr), sizeof(SOCKADDR_INET));
-        };
-
-    private:
-        friend class CHttpServer;
-
-        SOCKADDR_INET sAddr{};
-        LONG volatile nCount{ 1 };
-        CRedBlackTreeNode cTreeNode;
-    };
-
 private:
     CCriticalSection cs;
     CSockets &cSocketMgr;
-    DWORD dwMaxConnectionsPerIp{ 0xFFFFFFFFUL };
     DWORD dwRequestHeaderTimeoutMs{ 30000 }, dwGracefulTerminationTimeoutMs{ 30000 }, dwKeepAliveTimeoutMs{ 60000 };
     float nRequestBodyMinimumThroughputInKbps{ 0.25f }, nResponseMinimumThroughputInKbps{ 0.25f };
     DWORD dwRequestBodySecondsOfLowThroughput{ 10 }, dwResponseSecondsOfLowThroughput{ 10 };
@@ -404,18 +442,8 @@ private:
     DWORD dwMaxBodySizeInMemory{ 32768 };
     ULONGLONG ullMaxBodySize{ 10485760ui64 };
     DWORD dwMaxIncomingBytesWhileSending{ 52428800 };
-    DWORD dwMaxRequestsPerSecond{ 0 };
-    DWORD dwMaxRequestsBurstSize{ 0 };
-    struct
-    {
-        LONG volatile nMutex{ MX_RUNDOWNPROT_INIT };
-        CTimer cTimer;
-        union
-        {
-            DWORD dwRequestCounter{ 0 };
-            DWORD dwCurrentExcess;
-        };
-    } sLimiter;
+    DWORD dwMaxRecycledRequests{ 256 };
+    CHttpRequestLimiter cRequestLimiter;
 
     LONG volatile nDownloadNameGeneratorCounter{ 0 };
     LONG volatile nRundownLock{ MX_RUNDOWNPROT_INIT };
@@ -431,13 +459,12 @@ private:
     OnCustomErrorPageCallback cCustomErrorPageCallback;
     RWLOCK sRequestsListRwMutex{};
     CLnkLst cRequestsList;
-    CWindowsEvent cShutdownEv;
-
     struct
     {
-        RWLOCK sRwMutex{};
-        CRedBlackTree cTree;
-    } sRequestLimiter;
+        LONG volatile nMutex{ MX_FASTLOCK_INIT };
+        CLnkLst cList;
+    } sRecycledRequests;
+    CWindowsEvent cShutdownEv;
 };
 
 inline CHttpServer::CClientRequest::eTimeoutTimer operator|(CHttpServer::CClientRequest::eTimeoutTimer lhs,
@@ -0,0 +1,159 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_HTTPSTATICFILECACHE_H
+#define _MX_HTTPSTATICFILECACHE_H
+
+#include "HttpServer.h"
+#include "..\LinkedList.h"
+#include "..\FnvHash.h"
+
+ //-----------------------------------------------------------
+
+#define MX_HTTP_STATIC_FILE_CACHE_SHARDS_COUNT 16
+#define MX_HTTP_STATIC_FILE_CACHE_BUCKETS_COUNT 256
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+// NOTE: Files are looked up relative to the root folder and kept in memory in several independently locked
+//       shards, each one with its own LRU list. A directory change notification on the root folder marks every
+//       entry as stale and stale entries are revalidated against the file's size and last write time on next use.
+//       When the notification cannot be set up (for e.g. on some network shares), entries are revalidated by
+//       polling once the revalidation interval elapses.
+//
+//       Sibling "<file>.br" and "<file>.gz" files are served instead of the original one when the client
+//       accepts that encoding. ETags are strong and computed from the content of the served representation.
+class CHttpStaticFileCache : public virtual CBaseMemObj, public CNonCopyableObj
+{
+private:
+    class CCachedFile;
+
+public:
+    typedef struct tagSTATS
+    {
+        ULONGLONG nEntries;
+        ULONGLONG nCachedBytes;
+        ULONGLONG nHits;
+        ULONGLONG nMisses;
+        ULONGLONG nUncacheable;
+        ULONGLONG nEvictions;
+        ULONGLONG nRevalidations;
+        ULONGLONG nNotModified;
+        ULONGLONG nPartialContent;
+    } STATS, *LPSTATS;
+
+public:
+    CHttpStaticFileCache();
+    ~CHttpStaticFileCache();
+
+    HRESULT Initialize(_In_z_ LPCWSTR szRootFolderW);
+
+    // NOTE: Options must be set before the cache is used. Files larger than the maximum cached file size are
+    //       streamed from disk on every request. The revalidation interval is only used when change notifications
+    //       are not available and a value of zero disables polling.
+    VOID SetMaxCacheSize(_In_ SIZE_T nMaxBytes);
+    VOID SetMaxCachedFileSize(_In_ SIZE_T nMaxBytes);
+    VOID SetRevalidateInterval(_In_ DWORD dwMilliseconds);
+    VOID SetMaxAge(_In_ DWORD dwSeconds);
+    VOID SetDefaultDocument(_In_opt_z_ LPCWSTR szFileNameW);
+    VOID EnablePrecompressed(_In_ BOOL bEnable);
+
+    // NOTE: Builds the response for a GET or HEAD request including 304, 206 and 416 answers. Returns
+    //       MX_E_NotFound without touching the response if the file does not exist so the caller can fall back
+    //       and MX_E_Unsupported for other methods.
+    HRESULT Serve(_In_ CHttpServer::CClientRequest *lpRequest);
+    HRESULT Serve(_In_ CHttpServer::CClientRequest *lpRequest, _In_z_ LPCWSTR szPathW);
+
+    VOID Flush();
+
+    VOID GetStats(_Out_ LPSTATS lpStats);
+
+private:
+    typedef enum
+    {
+        VariantIdentity = 0,
+        VariantBrotli,
+        VariantGZip,
+        VariantsCount
+    } eVariant;
+
+    typedef struct tagFILE_INFO
+    {
+        ULONGLONG nSize;
+        FILETIME ftLastWrite;
+    } FILE_INFO, *LPFILE_INFO;
+
+    typedef struct tagSHARD
+    {
+        LONG volatile nMutex;
+        CCachedFile *aBuckets[MX_HTTP_STATIC_FILE_CACHE_BUCKETS_COUNT];
+        CLnkLst cLruList;
+        SIZE_T nBytes;
+    } SHARD, *LPSHARD;
+
+private:
+    HRESULT BuildFileName(_In_z_ LPCWSTR szPathW, _Inout_ CStringW &cStrRelativeW, _Inout_ CStringW &cStrFullPathW);
+    VOID CheckChangeNotification();
+
+    CCachedFile *Lookup(_In_ Fnv64_t nHash, _In_ CStringW &cStrRelativeW);
+    VOID Insert(_In_ CCachedFile *lpFile);
+    VOID Remove(_In_ CCachedFile *lpFile);
+    VOID Unlink(_In_ LPSHARD lpShard, _In_ CCachedFile *lpFile);
+    VOID FlushShard(_In_ LPSHARD lpShard);
+
+    HRESULT LoadFile(_In_ Fnv64_t nHash, _In_ CStringW &cStrRelativeW, _In_ CStringW &cStrFullPathW,
+                     _In_ LPFILE_INFO lpInfo, _Deref_out_ CCachedFile **lplpFile);
+    BOOL Revalidate(_In_ CCachedFile *lpFile);
+
+    HRESULT SendFile(_In_ CHttpServer::CClientRequest *lpRequest, _In_ CCachedFile *lpFile);
+
+    static HRESULT GetFileInfo(_In_z_ LPCWSTR szFileNameW, _Out_ LPFILE_INFO lpInfo);
+    static HRESULT GetVariantFileName(_In_ CStringW &cStrFullPathW, _In_ eVariant nVariant, _Inout_ CStringW &cStrFileNameW);
+
+private:
+    CStringW cStrRootFolderW;
+    CStringW cStrDefaultDocumentW;
+    HANDLE hChangeNotification{ NULL };
+    LONG volatile nGeneration{ 0 };
+    SIZE_T nMaxCacheSize{ 32 * 1048576 }, nMaxCachedFileSize{ 1048576 };
+    DWORD dwRevalidateIntervalMs{ 2000 };
+    DWORD dwMaxAge{ 0 };
+    BOOL bPrecompressed{ TRUE };
+    SHARD aShards[MX_HTTP_STATIC_FILE_CACHE_SHARDS_COUNT];
+    struct
+    {
+        LONGLONG volatile nEntries{ 0 };
+        LONGLONG volatile nCachedBytes{ 0 };
+        LONGLONG volatile nHits{ 0 };
+        LONGLONG volatile nMisses{ 0 };
+        LONGLONG volatile nUncacheable{ 0 };
+        LONGLONG volatile nEvictions{ 0 };
+        LONGLONG volatile nRevalidations{ 0 };
+        LONGLONG volatile nNotModified{ 0 };
+        LONGLONG volatile nPartialContent{ 0 };
+    } sStats;
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_HTTPSTATICFILECACHE_H
@@ -123,6 +123,10 @@ public:
     static SIZE_T GetEncodedLength(_In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen = (SIZE_T)-1, _In_opt_z_ LPCSTR szAllowedCharsA = NULL);
     static HRESULT Decode(_Inout_ CStringA &cStrDestA, _In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen = (SIZE_T)-1,
                           _In_opt_ BOOL bAppend = FALSE);
+    // NOTE: Decodes into a caller supplied buffer without allocating. The decoded data is never longer than the
+    //       source so a buffer of nUrlLen bytes is always enough.
+    static HRESULT Decode(_Out_writes_to_(nDestSize, *lpnDecodedLen) LPSTR szDestA, _In_ SIZE_T nDestSize,
+                          _In_ LPCSTR szUrlA, _In_ SIZE_T nUrlLen, _Out_ SIZE_T *lpnDecodedLen);
     static SIZE_T GetDecodedLength(_In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen = (SIZE_T)-1);
 
     static BOOL IsValidHostAddress(_In_z_ LPCSTR szHostA, _In_opt_ SIZE_T nHostLen = (SIZE_T)-1);
@@ -0,0 +1,85 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_URLVIEW_H
+#define _MX_URLVIEW_H
+
+#include "Url.h"
+
+ //-----------------------------------------------------------
+
+ // NOTE: CUrlView splits a URL in a single pass without copying or allocating. Components are kept as slices
+ //       of the source buffer, still percent-encoded, so the buffer must outlive the view. Decoding is done on
+ //       demand and a full CUrl (with normalized path, IDNA host, etc.) can be built from the view when needed.
+
+namespace MX {
+
+class CUrlView : public virtual CBaseMemObj
+{
+public:
+    typedef struct tagSLICE
+    {
+        LPCSTR szStrA;
+        SIZE_T nLength;
+    } SLICE, *LPSLICE;
+
+public:
+    CUrlView();
+
+    VOID Reset();
+
+    // NOTE: Rejects control and non-ASCII characters, invalid ports and the same escaped sequences CUrl::SetPath
+    //       does not allow in a path (%00, %2F, %5C and their %u forms).
+    HRESULT Parse(_In_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen = (SIZE_T)-1);
+
+    // NOTE: Checks, without allocating, what CUrl rejects on top of Parse when it is built from the view: invalid
+    //       hosts, escaped data that is not valid UTF-8, unnamed query items and paths that climb above the root.
+    HRESULT Validate() const;
+
+    BOOL IsEmpty() const;
+
+    const SLICE &GetUrl() const;
+    const SLICE &GetScheme() const;
+    const SLICE &GetUserInfo() const;
+    const SLICE &GetHost() const;
+    int GetPort() const;
+    const SLICE &GetPath() const;
+    const SLICE &GetQuery() const;
+    const SLICE &GetFragment() const;
+
+    // NOTE: Set nCursor to zero to start. Returned names and values are still encoded.
+    BOOL GetNextQueryString(_Inout_ SIZE_T &nCursor, _Out_ LPSLICE lpName, _Out_ LPSLICE lpValue) const;
+    // NOTE: Names are decoded and compared case-insensitively.
+    BOOL FindQueryString(_In_z_ LPCSTR szNameA, _Out_ LPSLICE lpValue) const;
+
+    HRESULT DecodePath(_Inout_ CStringA &cStrDestA) const;
+    HRESULT DecodePath(_Inout_ CStringW &cStrDestW) const;
+
+    HRESULT ToUrl(_Inout_ CUrl &cUrl) const;
+
+private:
+    SLICE sUrl, sScheme, sUserInfo, sHost, sPath, sQuery, sFragment;
+    int nPort;
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_URLVIEW_H
@@ -68,6 +68,23 @@ public:
 
     CPropertyBag *GetBag() const;
 
+    // NOTE: Names of the properties set or deleted since the session was loaded or last saved. If MustSaveAll
+    //       returns TRUE, the session is new or its id changed and the whole bag must be saved.
+    BOOL MustSaveAll() const
+    {
+        return bSaveAll;
+    };
+
+    SIZE_T GetChangedPropertiesCount() const
+    {
+        return aChangedNamesList.GetCount();
+    };
+
+    LPCSTR *GetChangedProperties() const
+    {
+        return (LPCSTR *)(aChangedNamesList.GetBuffer());
+    };
+
     MX_JS_DECLARE_WITH_PROXY(CJsHttpServerSessionPlugin, "Session")
 
         MX_JS_BEGIN_MAP(CJsHttpServerSessionPlugin)
@@ -85,6 +102,19 @@ private:
 
     HRESULT CreateRequestCookie();
 
+    VOID MarkChanged(_In_z_ LPCSTR szPropNameA);
+    VOID ResetChanges(_In_ BOOL bSaveAll);
+
+    static int ChangedNameCompareFunc(_In_ LPVOID lpContext, _In_ LPSTR *lpszName1A, _In_ LPSTR *lpszName2A)
+    {
+        return StrCompareA(*lpszName1A, *lpszName2A, TRUE);
+    };
+
+    static int ChangedNameSearchFunc(_In_ LPVOID lpContext, _In_ LPCSTR szNameA, _In_ LPSTR *lpszNameA)
+    {
+        return StrCompareA(szNameA, *lpszNameA, TRUE);
+    };
+
     DukTape::duk_ret_t _Save(_In_ DukTape::duk_context *lpCtx);
     DukTape::duk_ret_t _Destroy(_In_ DukTape::duk_context *lpCtx);
     DukTape::duk_ret_t RegenerateId(_In_ DukTape::duk_context *lpCtx);
@@ -114,6 +144,8 @@ private:
     BOOL bIsSecure, bIsHttpOnly;
     CHttpCookie::eSameSite nSameSite;
     BOOL bDirty;
+    BOOL bSaveAll;
+    TArrayListWithFree<LPSTR> aChangedNamesList;
 };
 
 } // namespace MX
@@ -0,0 +1,174 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_JS_HTTP_SERVER_SESSION_STORE_H
+#define _MX_JS_HTTP_SERVER_SESSION_STORE_H
+
+#include "JsHttpServerSessionPlugin.h"
+#include "..\..\RedBlackTree.h"
+#include "..\..\WaitableObjects.h"
+#include "..\..\Threads.h"
+
+ //-----------------------------------------------------------
+
+#define MX_JS_HTTP_SERVER_SESSION_STORE_SHARDS_COUNT 64
+
+//-----------------------------------------------------------
+
+ // NOTE: In-memory store for CJsHttpServerSessionPlugin. Sessions live in independently locked shards selected by
+ //       a hash of the session id and expire when they are not loaded nor saved within the time to live. Expired
+ //       sessions are lazily removed when new sessions are added to the same shard.
+ //
+ //       On save, only the properties the plugin reports as changed are copied. If a journal file is used, each
+ //       change is appended to it by a background thread. On initialization, and whenever the appended changes
+ //       make it grow past the compaction size, the journal is rewritten with the live sessions only. Loads refresh
+ //       the expiration time in memory but are not journaled.
+
+namespace MX {
+
+class CJsHttpServerSessionStore : public virtual CBaseMemObj, public CNonCopyableObj
+{
+private:
+    class CSession;
+
+public:
+    typedef struct tagSTATS
+    {
+        ULONGLONG nSessions;
+        ULONGLONG nLoads;
+        ULONGLONG nLoadMisses;
+        ULONGLONG nSaves;
+        ULONGLONG nPropertiesSaved;
+        ULONGLONG nDeletes;
+        ULONGLONG nExpiredSessions;
+        ULONGLONG nJournalBytes;
+        ULONGLONG nJournalCompactions;
+        ULONGLONG nJournalWriteErrors;
+    } STATS, *LPSTATS;
+
+public:
+    CJsHttpServerSessionStore();
+    ~CJsHttpServerSessionStore();
+
+    // NOTE: If time to live is zero, sessions never expire. If compaction size is zero, a default of 16MB is used.
+    //       The journal is not rewritten before it doubles the size of the last snapshot.
+    HRESULT Initialize(_In_ DWORD dwTimeToLiveSecs, _In_opt_z_ LPCWSTR szJournalFileNameW = NULL,
+                       _In_opt_ ULONGLONG nJournalCompactionSize = 0);
+
+    // NOTE: Bind it as the plugin's persistance callback. Can be called simultaneously from different threads.
+    HRESULT OnPersistance(_In_ CJsHttpServerSessionPlugin *lpPlugin,
+                          _In_ CJsHttpServerSessionPlugin::ePersistanceOption nPersistanceOption);
+
+    HRESULT Load(_In_z_ LPCSTR szSessionIdA, _Inout_ CPropertyBag &cBag);
+    // NOTE: If no list of changed properties is given or the session does not exist, the whole bag is stored.
+    HRESULT Save(_In_z_ LPCSTR szSessionIdA, _In_ CPropertyBag &cBag, _In_opt_ LPCSTR *lpszChangedNamesA = NULL,
+                 _In_opt_ SIZE_T nChangedNamesCount = 0);
+    HRESULT Delete(_In_z_ LPCSTR szSessionIdA);
+
+    // NOTE: Waits until all the changes made before the call are written to the journal. Returns the first error
+    //       the journal writer hit since initialization. After an error, changes are dropped until the journal is
+    //       rewritten from the sessions in memory, which is retried on every write cycle.
+    HRESULT FlushJournal();
+
+    VOID GetStats(_Out_ LPSTATS lpStats);
+
+private:
+    typedef struct tagSHARD
+    {
+        RWLOCK sRwMutex;
+        CRedBlackTree cTree;
+        LONGLONG llLastSweepMs;
+    } SHARD, *LPSHARD;
+
+    typedef struct tagBUFFER
+    {
+        LPBYTE lpData;
+        SIZE_T nLen;
+        SIZE_T nSize;
+    } BUFFER, *LPBUFFER;
+
+private:
+    LPSHARD GetShard(_In_ LPBYTE lpId);
+    VOID SweepShard(_In_ LPSHARD lpShard, _In_ LONGLONG llNowMs);
+    VOID RemoveAllSessions();
+
+    HRESULT ApplyProperty(_In_ CSession *lpSession, _In_ CPropertyBag &cSrcBag, _In_z_ LPCSTR szNameA);
+
+    HRESULT OpenJournal(_In_z_ LPCWSTR szFileNameW);
+    HRESULT ReplayJournal(_In_ LPBYTE lpData, _In_ SIZE_T nDataLen);
+    HRESULT WriteJournalSnapshot(_In_z_ LPCWSTR szFileNameW, _Out_ ULONGLONG *lpnSize);
+    HRESULT OpenJournalForAppend();
+    HRESULT CompactJournal();
+
+    HRESULT QueueJournalRecord(_In_ BYTE nOp, _In_ CSession *lpSession, _In_opt_z_ LPCSTR szNameA = NULL);
+    static HRESULT AppendJournalRecord(_Inout_ LPBUFFER lpBuffer, _In_ BYTE nOp, _In_ CSession *lpSession,
+                                       _In_opt_z_ LPCSTR szNameA = NULL);
+
+    VOID JournalThreadProc();
+    VOID WriteJournal();
+
+    LONGLONG GetExpirationTimeMs(_In_ LONGLONG llNowMs) const;
+
+    static BOOL ParseSessionId(_In_z_ LPCSTR szSessionIdA, _Out_writes_(32) LPBYTE lpId);
+    static HRESULT CopyProperty(_Inout_ CPropertyBag &cDestBag, _In_ CPropertyBag &cSrcBag, _In_z_ LPCSTR szNameA);
+    static BOOL GrowBuffer(_Inout_ LPBUFFER lpBuffer, _In_ SIZE_T nExtraLen);
+    static LONGLONG GetTimeMs();
+
+private:
+    typedef TClassWorkerThread<CJsHttpServerSessionStore> CJournalThread;
+
+    LONGLONG llTimeToLiveMs{ 0 };
+    SHARD aShards[MX_JS_HTTP_SERVER_SESSION_STORE_SHARDS_COUNT];
+
+    BOOL bUseJournal{ FALSE };
+    CStringW cStrJournalFileNameW;
+    CWindowsHandle cJournalFile;
+    CJournalThread cJournalThread;
+    CWindowsEvent cJournalEvent;
+    LONG volatile nJournalMutex{ 0 };
+    BUFFER sJournalBuffer{}, sWriteBuffer{};
+    LONGLONG volatile nJournalQueuedBytes{ 0 };
+    LONGLONG volatile nJournalProcessedBytes{ 0 };
+    LONGLONG volatile nJournalWrittenBytes{ 0 };
+    LONG volatile hrJournalError{ S_OK };
+    // only used by the journal thread
+    ULONGLONG nJournalFileSize{ 0 };
+    ULONGLONG nJournalSnapshotSize{ 0 };
+    ULONGLONG nJournalCompactionSize{ 0 };
+    BOOL bJournalDamaged{ FALSE };
+
+    struct
+    {
+        LONGLONG volatile nSessions{ 0 };
+        LONGLONG volatile nLoads{ 0 };
+        LONGLONG volatile nLoadMisses{ 0 };
+        LONGLONG volatile nSaves{ 0 };
+        LONGLONG volatile nPropertiesSaved{ 0 };
+        LONGLONG volatile nDeletes{ 0 };
+        LONGLONG volatile nExpiredSessions{ 0 };
+        LONGLONG volatile nJournalCompactions{ 0 };
+        LONGLONG volatile nJournalWriteErrors{ 0 };
+    } sStats;
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_JS_HTTP_SERVER_SESSION_STORE_H
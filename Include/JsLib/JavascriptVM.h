@@ -360,6 +360,8 @@ public:
 
     typedef VOID(*lpfnThrowExceptionCallback)(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nExceptionObjectIndex);
 
+    typedef Callback<HRESULT(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam)> OnJsonOutputCallback;
+
 public:
     CJavascriptVM();
     ~CJavascriptVM();
@@ -508,6 +510,31 @@ public:
     static HRESULT AddBigIntegerSupport(_In_ DukTape::duk_context *lpCtx);
     HRESULT AddBigIntegerSupport();
 
+    // NOTE: Native JSON encoding follows JSON.stringify rules: toJSON() is honored, undefined values, functions and
+    //       symbols are skipped (or become null inside arrays), non-finite numbers become null and cyclic structures
+    //       throw a TypeError. Non-BMP characters are written as plain UTF-8. Returns FALSE if the value itself cannot
+    //       be represented, in which case no output is produced.
+    //       When an output callback is used, data is delivered in chunks as the value is being encoded.
+    // IMPORTANT: Unsafe execution. May throw exception.
+    static BOOL EncodeJson(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nObjIdx, _Inout_ CStringA &cStrJsonA,
+                           _In_opt_ BOOL bAppend = FALSE, _In_opt_z_ LPCSTR szIndentA = NULL);
+    BOOL EncodeJson(_In_ DukTape::duk_idx_t nObjIdx, _Inout_ CStringA &cStrJsonA, _In_opt_ BOOL bAppend = FALSE,
+                    _In_opt_z_ LPCSTR szIndentA = NULL);
+    static BOOL EncodeJson(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nObjIdx, _In_ OnJsonOutputCallback cOutputCallback,
+                           _In_opt_ LPVOID lpUserParam = NULL, _In_opt_z_ LPCSTR szIndentA = NULL);
+    BOOL EncodeJson(_In_ DukTape::duk_idx_t nObjIdx, _In_ OnJsonOutputCallback cOutputCallback, _In_opt_ LPVOID lpUserParam = NULL,
+                    _In_opt_z_ LPCSTR szIndentA = NULL);
+
+    // NOTE: Parses the JSON text like JSON.parse does and pushes the resulting value onto the stack.
+    // IMPORTANT: Unsafe execution. Throws a SyntaxError if the text is not valid JSON.
+    static VOID DecodeJson(_In_ DukTape::duk_context *lpCtx, _In_reads_(nJsonLen) LPCSTR szJsonA, _In_ SIZE_T nJsonLen);
+    VOID DecodeJson(_In_reads_(nJsonLen) LPCSTR szJsonA, _In_ SIZE_T nJsonLen);
+
+    // NOTE: Adds a global 'NativeJSON' object with 'stringify' and 'parse' methods backed by the native encoder and
+    //       decoder. Calls using a replacer or a reviver function are forwarded to the built-in JSON object.
+    static HRESULT AddNativeJsonSupport(_In_ DukTape::duk_context *lpCtx);
+    HRESULT AddNativeJsonSupport();
+
 private:
     // static DukTape::duk_ret_t OnModSearch(_In_ DukTape::duk_context *lpCtx);
     static DukTape::duk_ret_t OnNodeJsResolveModule(_In_ DukTape::duk_context *lpCtx);
@@ -518,6 +545,8 @@ private:
     static DukTape::duk_ret_t _ProxyDeletePropHelper(_In_ DukTape::duk_context *lpCtx);
     static DukTape::duk_ret_t _ProxyOwnKeysHelper(_In_ DukTape::duk_context *lpCtx);
     static DukTape::duk_ret_t _RunNativeProtectedHelper(_In_ DukTape::duk_context *lpCtx, _In_ void *udata);
+    static DukTape::duk_ret_t OnNativeJsonStringify(_In_ DukTape::duk_context *lpCtx);
+    static DukTape::duk_ret_t OnNativeJsonParse(_In_ DukTape::duk_context *lpCtx);
 
     static BOOL HandleException(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nStackIndex, _In_opt_ BOOL bCatchUnhandled);
 
@@ -28,10 +28,26 @@ namespace MX {
 
 class CJsonWebTokenPlugin : public CJsObjectBase, public CNonCopyableObj
 {
+public:
+    typedef struct tagVERIFY_CACHE_STATS
+    {
+        ULONGLONG nEntries;
+        ULONGLONG nHits;
+        ULONGLONG nMisses;
+        ULONGLONG nEvictions;
+    } VERIFY_CACHE_STATS, *LPVERIFY_CACHE_STATS;
+
 public:
     CJsonWebTokenPlugin();
     ~CJsonWebTokenPlugin();
 
+    // NOTE: Tokens with a valid signature are kept in a process-wide LRU cache keyed by the token and the secret so
+    //       repeated verifications skip the signature check and the decoding. Claims and timestamps are validated on
+    //       every call. A size of zero disables the cache.
+    static VOID SetVerifyCacheSize(_In_ SIZE_T nMaxEntries);
+    static VOID FlushVerifyCache();
+    static VOID GetVerifyCacheStats(_Out_ LPVERIFY_CACHE_STATS lpStats);
+
     MX_JS_DECLARE_CREATABLE(CJsonWebTokenPlugin, "JWT")
 
         MX_JS_BEGIN_MAP(CJsonWebTokenPlugin)
@@ -0,0 +1,444 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_LOCKFREEQUEUE_H
+#define _MX_LOCKFREEQUEUE_H
+
+#include "Defines.h"
+#include "AtomicOps.h"
+#include <intrin.h>
+
+#if defined(_M_X64)
+#pragma intrinsic(_InterlockedCompareExchange128)
+#endif //_M_X64
+
+ //-----------------------------------------------------------
+
+// NOTE: These containers rely on MSVC's volatile semantics on x86/x64 (/volatile:ms, the default): a volatile read
+//       has acquire semantics and a volatile write has release semantics, so only the operations that must be atomic
+//       use interlocked intrinsics.
+
+#define MX_LOCKFREE_CACHELINE_SIZE 64
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+class CLockFreeNode
+{
+public:
+    CLockFreeNode()
+    {
+        lpNext = NULL;
+        return;
+    };
+
+    _inline CLockFreeNode *GetNext()
+    {
+        return lpNext;
+    };
+
+private:
+    friend class CLockFreeMpscQueue;
+    friend class CLockFreeStack;
+
+    CLockFreeNode *volatile lpNext;
+};
+
+//-----------------------------------------------------------
+
+// NOTE: Intrusive unbounded queue with many producers and a single consumer. Push never blocks nor fails. Pop must be
+//       called from one thread at a time and may return NULL while a producer is between its two steps of Push, so
+//       consumers should be woken up by other means (an event or a completion port) and retry later.
+class CLockFreeMpscQueue : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CLockFreeMpscQueue() : CBaseMemObj(), CNonCopyableObj()
+    {
+        lpHead = lpTail = &cStub;
+        return;
+    };
+
+    _inline VOID Push(_In_ CLockFreeNode *lpNode)
+    {
+        CLockFreeNode *lpPrev;
+
+        MX_ASSERT(lpNode != NULL);
+        lpNode->lpNext = NULL;
+        lpPrev = (CLockFreeNode *)__InterlockedExchangePointer(&lpHead, lpNode);
+        lpPrev->lpNext = lpNode;
+        return;
+    };
+
+    _inline CLockFreeNode *Pop()
+    {
+        CLockFreeNode *lpNode, *lpNext;
+
+        lpNode = lpTail;
+        lpNext = lpNode->lpNext;
+        if (lpNode == &cStub)
+        {
+            if (lpNext == NULL)
+            {
+                return NULL; // empty
+            }
+            lpTail = lpNode = lpNext;
+            lpNext = lpNext->lpNext;
+        }
+        if (lpNext != NULL)
+        {
+            lpTail = lpNext;
+            lpNode->lpNext = NULL;
+            return lpNode;
+        }
+        if (lpNode != lpHead)
+        {
+            return NULL; // a producer is linking a new node
+        }
+
+        // the last node cannot be removed without leaving the queue with no nodes so put the stub behind it
+        Push(&cStub);
+        lpNext = lpNode->lpNext;
+        if (lpNext != NULL)
+        {
+            lpTail = lpNext;
+            lpNode->lpNext = NULL;
+            return lpNode;
+        }
+        return NULL;
+    };
+
+    // NOTE: Only meaningful in the consumer thread.
+    _inline BOOL IsEmpty()
+    {
+        return (lpTail == &cStub && cStub.lpNext == NULL) ? TRUE : FALSE;
+    };
+
+private:
+    CLockFreeNode *volatile lpHead;
+    BYTE aPadding1[MX_LOCKFREE_CACHELINE_SIZE - sizeof(LPVOID)];
+    CLockFreeNode *lpTail;
+    CLockFreeNode cStub;
+};
+
+//-----------------------------------------------------------
+
+// NOTE: Intrusive stack usable as a free list by many threads. The head carries a counter changed on each update so a
+//       node popped and pushed back between the read of the head and the compare-exchange is detected (the ABA
+//       problem). Pop reads the next pointer of a node that another thread may have just popped, so nodes must remain
+//       valid memory while the stack is in use. This is the case for free lists, which own their nodes until they are
+//       destroyed, but not for lists whose nodes are deleted right after being popped.
+class CLockFreeStack : public virtual CBaseMemObj, public CNonCopyableObj
+{
+private:
+#if defined(_M_X64)
+    typedef struct tagTAGGED_HEAD
+    {
+        CLockFreeNode *lpTop;
+        ULONGLONG nTag;
+    } TAGGED_HEAD;
+#else  //_M_X64
+    typedef union tagTAGGED_HEAD
+    {
+        struct
+        {
+            CLockFreeNode *lpTop;
+            ULONG nTag;
+        };
+        __int64 nValue;
+    } TAGGED_HEAD;
+#endif //_M_X64
+
+public:
+    CLockFreeStack() : CBaseMemObj(), CNonCopyableObj()
+    {
+        // the compare-exchange requires the head to be aligned to its size, whatever the alignment of the object is
+        lpHead = (TAGGED_HEAD *)(((ULONG_PTR)aHeadBuffer + sizeof(TAGGED_HEAD) - 1) &
+                                 (~((ULONG_PTR)sizeof(TAGGED_HEAD) - 1)));
+        lpHead->lpTop = NULL;
+        lpHead->nTag = 0;
+        nCount = 0;
+        return;
+    };
+
+    _inline VOID Push(_In_ CLockFreeNode *lpNode)
+    {
+        TAGGED_HEAD sOld, sNew;
+
+        MX_ASSERT(lpNode != NULL);
+        ReadHead(sOld);
+        do
+        {
+            lpNode->lpNext = sOld.lpTop;
+            sNew.lpTop = lpNode;
+            sNew.nTag = sOld.nTag + 1;
+        }
+        while (CompareExchangeHead(sNew, sOld) == FALSE);
+        _InterlockedIncrement(&nCount);
+        return;
+    };
+
+    _inline CLockFreeNode *Pop()
+    {
+        TAGGED_HEAD sOld, sNew;
+
+        ReadHead(sOld);
+        do
+        {
+            if (sOld.lpTop == NULL)
+            {
+                return NULL;
+            }
+            sNew.lpTop = sOld.lpTop->lpNext;
+            sNew.nTag = sOld.nTag + 1;
+        }
+        while (CompareExchangeHead(sNew, sOld) == FALSE);
+        _InterlockedDecrement(&nCount);
+        sOld.lpTop->lpNext = NULL;
+        return sOld.lpTop;
+    };
+
+    // NOTE: Detaches all the nodes at once. They remain linked through GetNext.
+    _inline CLockFreeNode *PopAll()
+    {
+        TAGGED_HEAD sOld, sNew;
+        LONG nPopped;
+
+        ReadHead(sOld);
+        do
+        {
+            if (sOld.lpTop == NULL)
+            {
+                return NULL;
+            }
+            sNew.lpTop = NULL;
+            sNew.nTag = sOld.nTag + 1;
+        }
+        while (CompareExchangeHead(sNew, sOld) == FALSE);
+        nPopped = 0;
+        for (CLockFreeNode *lpNode = sOld.lpTop; lpNode != NULL; lpNode = lpNode->lpNext)
+        {
+            nPopped++;
+        }
+        _InterlockedExchangeAdd(&nCount, -nPopped);
+        return sOld.lpTop;
+    };
+
+    _inline SIZE_T GetCount() const
+    {
+        LONG nValue = nCount;
+
+        return (nValue > 0) ? (SIZE_T)nValue : 0;
+    };
+
+private:
+    _inline VOID ReadHead(_Out_ TAGGED_HEAD &sHead)
+    {
+#if defined(_M_X64)
+        // a torn read is harmless, the compare-exchange below fails and returns the current value
+        sHead.nTag = ((TAGGED_HEAD volatile *)lpHead)->nTag;
+        sHead.lpTop = ((TAGGED_HEAD volatile *)lpHead)->lpTop;
+#else  //_M_X64
+        sHead.nValue = _InterlockedCompareExchange64(&(lpHead->nValue), 0, 0);
+#endif //_M_X64
+        return;
+    };
+
+    // NOTE: On failure, sComparand receives the current head.
+    _inline BOOL CompareExchangeHead(_In_ TAGGED_HEAD &sNew, _Inout_ TAGGED_HEAD &sComparand)
+    {
+#if defined(_M_X64)
+        return (_InterlockedCompareExchange128((__int64 volatile *)lpHead, (__int64)(sNew.nTag), (__int64)(sNew.lpTop),
+                                               (__int64 *)&sComparand) != 0) ? TRUE : FALSE;
+#else  //_M_X64
+        __int64 nPrevValue = sComparand.nValue;
+
+        sComparand.nValue = _InterlockedCompareExchange64(&(lpHead->nValue), sNew.nValue, nPrevValue);
+        return (sComparand.nValue == nPrevValue) ? TRUE : FALSE;
+#endif //_M_X64
+    };
+
+private:
+    BYTE aHeadBuffer[2 * sizeof(TAGGED_HEAD)];
+    TAGGED_HEAD *lpHead;
+    LONG volatile nCount;
+};
+
+//-----------------------------------------------------------
+
+// NOTE: Bounded array-based queue with many producers and many consumers. Each cell carries a sequence number that
+//       tells whether it is ready to be written or read for a given lap, so producers and consumers only contend on
+//       their own position counter. TType must be trivially copyable (usually a pointer). Push fails when the queue is
+//       full and Pop when it is empty; neither blocks.
+template <typename TType>
+class TLockFreeMpmcQueue : public virtual CBaseMemObj, public CNonCopyableObj
+{
+private:
+    typedef struct tagCELL
+    {
+        SIZE_T volatile nSequence;
+        TType Value;
+    } CELL;
+
+public:
+    TLockFreeMpmcQueue() : CBaseMemObj(), CNonCopyableObj()
+    {
+        lpCells = NULL;
+        nMask = 0;
+        nEnqueuePos = nDequeuePos = 0;
+        return;
+    };
+
+    ~TLockFreeMpmcQueue()
+    {
+        MX_FREE(lpCells);
+        return;
+    };
+
+    // NOTE: The capacity is rounded up to a power of two.
+    HRESULT Initialize(_In_ SIZE_T nCapacity)
+    {
+        SIZE_T nSize;
+
+        if (lpCells != NULL)
+        {
+            return MX_E_AlreadyInitialized;
+        }
+        if (nCapacity < 2 || nCapacity > ((SIZE_T)-1) / (2 * sizeof(CELL)))
+        {
+            return E_INVALIDARG;
+        }
+        nSize = 2;
+        while (nSize < nCapacity)
+        {
+            nSize <<= 1;
+        }
+
+        lpCells = (CELL *)MX_MALLOC(nSize * sizeof(CELL));
+        if (lpCells == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        for (SIZE_T i = 0; i < nSize; i++)
+        {
+            lpCells[i].nSequence = i;
+        }
+        nMask = nSize - 1;
+        nEnqueuePos = nDequeuePos = 0;
+
+        // done
+        return S_OK;
+    };
+
+    _inline BOOL Push(_In_ TType Value)
+    {
+        CELL *lpCell;
+        SIZE_T nPos, nPrevPos, nSeq;
+
+        MX_ASSERT(lpCells != NULL);
+        nPos = nEnqueuePos;
+        for (;;)
+        {
+            lpCell = &lpCells[nPos & nMask];
+            nSeq = lpCell->nSequence;
+            if (nSeq == nPos)
+            {
+                nPrevPos = __InterlockedCompareExchangeSizeT(&nEnqueuePos, nPos + 1, nPos);
+                if (nPrevPos == nPos)
+                {
+                    break;
+                }
+                nPos = nPrevPos;
+            }
+            else if ((SSIZE_T)(nSeq - nPos) < 0)
+            {
+                return FALSE; // full
+            }
+            else
+            {
+                nPos = nEnqueuePos;
+            }
+        }
+        lpCell->Value = Value;
+        lpCell->nSequence = nPos + 1;
+        return TRUE;
+    };
+
+    _inline BOOL Pop(_Out_ TType &Value)
+    {
+        CELL *lpCell;
+        SIZE_T nPos, nPrevPos, nSeq;
+
+        MX_ASSERT(lpCells != NULL);
+        nPos = nDequeuePos;
+        for (;;)
+        {
+            lpCell = &lpCells[nPos & nMask];
+            nSeq = lpCell->nSequence;
+            if (nSeq == nPos + 1)
+            {
+                nPrevPos = __InterlockedCompareExchangeSizeT(&nDequeuePos, nPos + 1, nPos);
+                if (nPrevPos == nPos)
+                {
+                    break;
+                }
+                nPos = nPrevPos;
+            }
+            else if ((SSIZE_T)(nSeq - (nPos + 1)) < 0)
+            {
+                return FALSE; // empty
+            }
+            else
+            {
+                nPos = nDequeuePos;
+            }
+        }
+        Value = lpCell->Value;
+        lpCell->nSequence = nPos + nMask + 1;
+        return TRUE;
+    };
+
+    _inline SIZE_T GetCapacity() const
+    {
+        return (lpCells != NULL) ? (nMask + 1) : 0;
+    };
+
+    // NOTE: Approximate while other threads are pushing or popping.
+    _inline SIZE_T GetCount() const
+    {
+        SIZE_T nEnq = nEnqueuePos, nDeq = nDequeuePos;
+
+        return (nEnq > nDeq) ? (nEnq - nDeq) : 0;
+    };
+
+private:
+    CELL *lpCells;
+    SIZE_T nMask;
+    BYTE aPadding1[MX_LOCKFREE_CACHELINE_SIZE - sizeof(LPVOID)];
+    SIZE_T volatile nEnqueuePos;
+    BYTE aPadding2[MX_LOCKFREE_CACHELINE_SIZE - sizeof(SIZE_T)];
+    SIZE_T volatile nDequeuePos;
+    BYTE aPadding3[MX_LOCKFREE_CACHELINE_SIZE - sizeof(SIZE_T)];
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_LOCKFREEQUEUE_H
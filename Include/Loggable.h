@@ -24,8 +24,16 @@
 
  //-----------------------------------------------------------
 
+#define MX_LOGGABLE_MAX_TEXT_LENGTH 4095
+
+//-----------------------------------------------------------
+
 namespace MX {
 
+class CAsyncLogger;
+
+//-----------------------------------------------------------
+
 class CLoggable : public virtual CBaseMemObj
 {
 public:
@@ -41,11 +49,17 @@ public:
     VOID SetLogLevel(_In_ DWORD dwLevel);
     VOID SetLogCallback(_In_ OnLogCallback cCallback);
 
+    // NOTE: When set on the root, messages are queued to the asynchronous logger instead of being formatted and
+    //       passed to the callback on the calling thread.
+    VOID SetAsyncLogger(_In_opt_ CAsyncLogger *lpAsyncLogger);
+
     __inline BOOL ShouldLog(_In_ DWORD dwRequiredLevel) const
     {
         return (GetRoot()->dwLevel >= dwRequiredLevel) ? TRUE : FALSE;
     };
 
+    // NOTE: Messages are formatted in a single pass and truncated to MX_LOGGABLE_MAX_TEXT_LENGTH characters,
+    //       including the "Error 0x...: " prefix, both when passed to the callback and when queued.
     HRESULT Log(_Printf_format_string_ LPCWSTR szFormatW, ...);
     HRESULT LogIfError(_In_ HRESULT hResError, _Printf_format_string_ LPCWSTR szFormatW, ...);
     HRESULT LogAlways(_In_ HRESULT hResError, _Printf_format_string_ LPCWSTR szFormatW, ...);
@@ -59,6 +73,12 @@ private:
     CLoggable *lpParentLog;
     DWORD dwLevel;
     OnLogCallback cCallback;
+    CAsyncLogger *lpAsyncLogger;
+
+    // NOTE: The root is cached and revalidated against a global counter bumped on every parent change so the chain
+    //       is not walked on each message. As before, parents must not change while the chain is logging.
+    mutable CLoggable *lpCachedRoot;
+    mutable LONG nCachedRootGeneration;
 };
 
 } // namespace MX
@@ -26,6 +26,17 @@
 
  //-----------------------------------------------------------
 
+// NOTE: Properties are indexed by an open addressing hash table over their case-insensitive names and can be
+//       enumerated with GetAt in insertion order. Property headers and names are carved from a per-bag arena so
+//       adding a property does not allocate in the common case and changing a numeric value never does. Memory of
+//       cleared properties is reclaimed when the arena is compacted or the bag is reset.
+//
+//       Names are matched case-insensitively for ASCII letters only, as _stricmp does in the "C" locale. Any other
+//       byte, including those of UTF-8 sequences, must match exactly.
+//
+//       Serialized bags use a versioned little endian binary format that does not depend on the process so it can
+//       be persisted or sent to other processes.
+
 namespace MX {
 
 class CPropertyBag : public virtual CBaseMemObj, public CNonCopyableObj
@@ -56,6 +67,9 @@ public:
     HRESULT SetString(_In_z_ LPCSTR szNameA, _In_z_ LPCSTR szValueA);
     HRESULT SetString(_In_z_ LPCSTR szNameA, _In_z_ LPCWSTR szValueW);
 
+    SIZE_T GetCount() const;
+    // NOTE: The returned name is only valid until the next Clear, Reset or Deserialize. Clearing a property may
+    //       compact the arena and move the remaining properties, so copy names that must outlive those calls.
     LPCSTR GetAt(_In_ SIZE_T nIndex) const;
 
     eType GetType(_In_ SIZE_T nIndex) const;
@@ -73,11 +87,18 @@ public:
     HRESULT GetString(_In_z_ LPCSTR szNameA, _Out_ LPCSTR &szValueA, _In_opt_z_ LPCSTR szDefValueA = NULL);
     HRESULT GetString(_In_z_ LPCSTR szNameA, _Out_ LPCWSTR &szValueW, _In_opt_z_ LPCWSTR szDefValueW = NULL);
 
+    SIZE_T GetSerializedSize() const;
+    // NOTE: Returns MX_E_BufferOverflow if the destination is smaller than GetSerializedSize.
+    HRESULT Serialize(_Out_writes_bytes_(nDestSize) LPVOID lpDest, _In_ SIZE_T nDestSize) const;
+    // NOTE: Replaces the bag's contents. On failure, the bag is left empty.
+    HRESULT Deserialize(_In_reads_bytes_(nDataLen) LPCVOID lpData, _In_ SIZE_T nDataLen);
+
 private:
-    typedef struct
+    typedef struct tagPROPERTY
     {
         eType nType;
-        LPSTR szNameA;
+        ULONG nHash;
+        SIZE_T nNameLen;
         union
         {
             DWORD dwValue;
@@ -86,24 +107,38 @@ private:
             LPSTR szValueA;
             LPWSTR szValueW;
         } u;
-    } PROPERTY;
+        CHAR szNameA[1];
+    } PROPERTY, *LPPROPERTY;
+
+    typedef struct tagARENA_BLOCK
+    {
+        struct tagARENA_BLOCK *lpNext;
+        SIZE_T nUsed;
+        SIZE_T nSize;
+    } ARENA_BLOCK, *LPARENA_BLOCK;
 
 private:
-    BOOL Insert(_In_ PROPERTY *lpNewProp);
-    SIZE_T Find(_In_z_ LPCSTR szNameA);
+    HRESULT AddProperty(_In_reads_(nNameLen) LPCSTR szNameA, _In_ SIZE_T nNameLen, _Out_ LPPROPERTY *lplpProp);
+    LPPROPERTY Find(_In_reads_(nNameLen) LPCSTR szNameA, _In_ SIZE_T nNameLen, _In_ ULONG nHash) const;
+    LPPROPERTY Find(_In_z_ LPCSTR szNameA) const;
 
-    static int InsertCompareFunc(_In_ LPVOID lpContext, _In_ PROPERTY **lpItem1, _In_ PROPERTY **lpItem2)
-    {
-        return StrCompareA((*lpItem1)->szNameA, (*lpItem2)->szNameA, TRUE);
-    };
+    BOOL GrowHashTable();
+    VOID RebuildHashTable();
 
-    static int SearchCompareFunc(_In_ LPVOID lpContext, _In_ LPCVOID lpKey, _In_ PROPERTY **lpItem)
-    {
-        return StrCompareA((LPCSTR)lpKey, (*lpItem)->szNameA, TRUE);
-    };
+    LPVOID ArenaAlloc(_In_ SIZE_T nSize);
+    VOID CompactArena();
+    VOID FreeArena();
+
+    static VOID FreeValue(_In_ LPPROPERTY lpProp);
+    static ULONG HashName(_In_reads_(nNameLen) LPCSTR szNameA, _In_ SIZE_T nNameLen);
 
 private:
-    TArrayListWithFree<PROPERTY *> cPropertiesList;
+    TArrayList<LPPROPERTY> cPropertiesList;
+    LPPROPERTY *lplpHashTable{ NULL };
+    SIZE_T nHashTableSize{ 0 };
+    LPARENA_BLOCK lpArena{ NULL };
+    SIZE_T nArenaUsedBytes{ 0 };
+    SIZE_T nArenaWastedBytes{ 0 };
 };
 
 } // namespace MX
@@ -323,6 +323,91 @@ public:
 
 //-----------------------------------------------------------
 
+// NOTE: Per-processor reader counters for data that is read far more often than it is written. Readers only touch the
+//       counter of the processor they run on. A writer raises a flag that keeps new readers out, so writers are never
+//       starved, and then waits for every counter to drain.
+class CReaderBiasedRWLock : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CReaderBiasedRWLock();
+    ~CReaderBiasedRWLock();
+
+    // NOTE: The returned slot must be passed to ReleaseShared.
+    ULONG AcquireShared();
+    BOOL TryAcquireShared(_Out_ PULONG lpnSlot);
+    VOID ReleaseShared(_In_ ULONG nSlot);
+
+    VOID AcquireExclusive();
+    BOOL TryAcquireExclusive();
+    VOID ReleaseExclusive();
+
+private:
+    LONG volatile *GetSlotCounter(_In_ ULONG nSlot);
+    VOID WaitForReaders();
+
+private:
+    LPBYTE lpSlots, lpSlotsBuffer;
+    ULONG nSlotsMask;
+    LONG volatile nSingleSlot;
+    LONG volatile nWriterMutex;
+    LONG volatile nWriterActive;
+};
+
+class CAutoReaderBiasedRWLShared : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CAutoReaderBiasedRWLShared(_In_ CReaderBiasedRWLock *_lpLock) : CBaseMemObj(), CNonCopyableObj(), lpLock(_lpLock)
+    {
+        nSlot = lpLock->AcquireShared();
+        return;
+    };
+
+    ~CAutoReaderBiasedRWLShared()
+    {
+        lpLock->ReleaseShared(nSlot);
+        return;
+    };
+
+private:
+    CReaderBiasedRWLock *lpLock;
+    ULONG nSlot;
+};
+
+class CAutoReaderBiasedRWLExclusive : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CAutoReaderBiasedRWLExclusive(_In_ CReaderBiasedRWLock *_lpLock) : CBaseMemObj(), CNonCopyableObj(), lpLock(_lpLock)
+    {
+        lpLock->AcquireExclusive();
+        return;
+    };
+
+    ~CAutoReaderBiasedRWLExclusive()
+    {
+        lpLock->ReleaseExclusive();
+        return;
+    };
+
+private:
+    CReaderBiasedRWLock *lpLock;
+};
+
+//-----------------------------------------------------------
+
+// NOTE: Process-wide counters updated only on the slow paths of FastLock, bitmask locks and CReaderBiasedRWLock.
+typedef struct tagLOCK_CONTENTION_STATS
+{
+    ULONGLONG nContentions;   // acquisitions that did not succeed at the first attempt
+    ULONGLONG nSpinAcquires;  // contended acquisitions that succeeded while spinning
+    ULONGLONG nParks;         // times a thread went to sleep waiting for a lock
+    ULONGLONG nReaderRetries; // readers that had to back off because of a writer
+    ULONGLONG nWriterWaits;   // writers that had to wait for readers to drain
+} LOCK_CONTENTION_STATS, *LPLOCK_CONTENTION_STATS;
+
+VOID GetLockContentionStats(_Out_ LPLOCK_CONTENTION_STATS lpStats);
+
+//-----------------------------------------------------------
+
 #define MX_RUNDOWNPROT_INIT 0
 
 VOID RundownProt_Initialize(_Inout_ _Interlocked_operand_ LONG volatile *lpnValue);
@@ -0,0 +1,130 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_PARALLELDEFLATE_H
+#define _MX_PARALLELDEFLATE_H
+
+#include "..\Defines.h"
+#include "..\Callbacks.h"
+#include "..\Threads.h"
+#include "..\AutoHandle.h"
+
+ //-----------------------------------------------------------
+
+ // NOTE: Input is split in blocks that are compressed concurrently. Each block is primed with the last 32KB of the
+ //       preceding one and all but the last end in a sync flush so the concatenated output is a single standard
+ //       deflate stream. Output is delivered in order, one batch of blocks at a time.
+
+namespace MX {
+
+class CParallelDeflate : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    enum class eFormat
+    {
+        Raw,
+        ZLib,
+        GZip
+    };
+
+    typedef Callback<HRESULT(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam)> OnOutputCallback;
+
+public:
+    CParallelDeflate();
+    ~CParallelDeflate();
+
+    // NOTE: If threads count is zero, one thread per processor is used.
+    HRESULT Begin(_In_ int nCompressionLevel, _In_ eFormat nFormat, _In_ OnOutputCallback cOutputCallback,
+                  _In_opt_ LPVOID lpUserParam = NULL, _In_opt_ DWORD dwThreadsCount = 0, _In_opt_ SIZE_T nBlockSize = 0);
+    HRESULT Write(_In_ LPCVOID lpSrc, _In_ SIZE_T nSrcLen);
+    HRESULT End();
+
+    // NOTE: Adler-32 for ZLib format, CRC-32 for the others.
+    ULONG GetChecksum() const
+    {
+        return nChecksum;
+    };
+
+    ULONGLONG GetInputSize() const
+    {
+        return ullInputSize;
+    };
+
+private:
+    typedef struct tagBLOCK
+    {
+        LPBYTE lpInput;
+        SIZE_T nInputLen;
+        LPBYTE lpOutput;
+        SIZE_T nOutputLen, nOutputSize;
+        LPBYTE lpDictionary;
+        SIZE_T nDictionaryLen;
+        BOOL bIsLast;
+        ULONG nChecksum;
+        HRESULT hRes;
+    } BLOCK, *LPBLOCK;
+
+private:
+    HRESULT ProcessBatch(_In_ SIZE_T nBlocksCount, _In_ BOOL bFinal);
+    VOID CompressPendingBlocks(_In_ SIZE_T nStreamIndex);
+    HRESULT CompressBlock(_In_ LPBLOCK lpBlock, _In_ LPVOID lpStream);
+
+    HRESULT WriteHeader();
+    HRESULT WriteTrailer();
+
+    VOID WorkerThreadProc(_In_ SIZE_T nParam);
+
+    VOID Cleanup();
+
+private:
+    typedef TClassWorkerThread<CParallelDeflate> CWorkerThread;
+
+    int nLevel{ 0 };
+    eFormat nFormat{ eFormat::Raw };
+    OnOutputCallback cOutputCallback;
+    LPVOID lpUserParam{ NULL };
+    SIZE_T nBlockSize{ 0 };
+    BOOL bInUse{ FALSE };
+
+    LPVOID *lplpStreams{ NULL };
+    SIZE_T nStreamsCount{ 0 };
+    CWorkerThread *lpWorkers{ NULL };
+    SIZE_T nWorkersCount{ 0 };
+    CWindowsHandle cStartSem;
+    CWindowsEvent cDoneEvent;
+
+    LPBLOCK lpBlocks{ NULL };
+    SIZE_T nBlocksCount{ 0 };
+    SIZE_T nFilledBlocks{ 0 };
+    SIZE_T nBatchBlocksCount{ 0 };
+    LONG volatile nNextBlock{ 0 };
+    LONG volatile nRunningWorkers{ 0 };
+
+    BYTE aDictionary[32768];
+    SIZE_T nDictionaryLen{ 0 };
+
+    ULONG nChecksum{ 0 };
+    ULONGLONG ullInputSize{ 0 };
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_PARALLELDEFLATE_H
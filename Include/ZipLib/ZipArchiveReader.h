@@ -0,0 +1,160 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_ZIP_ARCHIVE_READER_H
+#define _MX_ZIP_ARCHIVE_READER_H
+
+#include "..\Defines.h"
+#include "..\Streams.h"
+#include "..\RefCounted.h"
+
+ //-----------------------------------------------------------
+
+ // NOTE: The archive is mapped in memory and its central directory is indexed once by Open. After that, the object
+ //       is read-only and can be shared among threads. Each thread must use its own entry stream. Stored entries can
+ //       be accessed without copies through GetEntryData.
+ //
+ //       Entry streams keep the mapped archive alive, so Close can be called while they are still open. Entries and
+ //       the data pointers returned by GetEntryData are only valid until Close.
+
+namespace MX {
+
+class CZipArchiveReader : public virtual TRefCounted<CBaseMemObj>, public CNonCopyableObj
+{
+public:
+    class CEntryStream;
+
+    typedef struct tagENTRY
+    {
+        LPCSTR szNameA; // NOTE: Points inside the mapped archive and it is NOT nul-terminated.
+        SIZE_T nNameLen;
+        ULONG nHash;
+        WORD wMethod;
+        WORD wFlags;
+        ULONG nCrc32;
+        DWORD dwDosDateTime;
+        DWORD dwExternalAttributes;
+        ULONGLONG nCompressedSize;
+        ULONGLONG nUncompressedSize;
+        ULONGLONG nLocalHeaderOffset;
+        ULONGLONG nDataOffset;
+    } ENTRY, *LPENTRY;
+
+public:
+    CZipArchiveReader();
+    ~CZipArchiveReader();
+
+    HRESULT Open(_In_z_ LPCWSTR szFileNameW);
+    VOID Close();
+
+    SIZE_T GetEntriesCount() const
+    {
+        return nEntriesCount;
+    };
+    const ENTRY* GetEntry(_In_ SIZE_T nIndex) const;
+
+    // NOTE: Names are matched case-sensitive against the UTF-8 names stored in the archive.
+    const ENTRY* FindEntry(_In_ LPCSTR szNameA, _In_opt_ SIZE_T nNameLen = (SIZE_T)-1) const;
+    const ENTRY* FindEntry(_In_z_ LPCWSTR szNameW) const;
+
+    BOOL IsStored(_In_ const ENTRY *lpEntry) const;
+
+    // NOTE: Returns a pointer to the raw entry data inside the mapped archive. For stored entries, this is the entry
+    //       content. Unlike entry streams, no CRC check is done.
+    HRESULT GetEntryData(_In_ const ENTRY *lpEntry, _Out_ LPCVOID *lplpData, _Out_ SIZE_T *lpnDataSize) const;
+
+    HRESULT OpenEntry(_In_ const ENTRY *lpEntry, _Out_ CStream **lplpStream);
+
+private:
+    class CMappedArchive : public virtual TRefCounted<CBaseMemObj>, public CNonCopyableObj
+    {
+    public:
+        CMappedArchive() : TRefCounted<CBaseMemObj>(), CNonCopyableObj()
+        {
+            return;
+        };
+        ~CMappedArchive();
+
+    public:
+        LPBYTE lpView{ NULL };
+        LPENTRY lpEntries{ NULL };
+    };
+
+private:
+    HRESULT ParseCentralDirectory();
+    HRESULT BuildIndex();
+    HRESULT ResolveDataOffset(_In_ LPENTRY lpEntry);
+
+    BOOL IsEncrypted(_In_ const ENTRY *lpEntry) const
+    {
+        return ((lpEntry->wFlags & 0x0001) != 0) ? TRUE : FALSE;
+    };
+
+private:
+    TAutoRefCounted<CMappedArchive> cMapping;
+    LPBYTE lpView{ NULL };
+    ULONGLONG nFileSize{ 0 };
+    LPENTRY lpEntries{ NULL };
+    SIZE_T nEntriesCount{ 0 };
+    ULONG *lpnBuckets{ NULL };
+    SIZE_T nBucketsMask{ 0 };
+};
+
+//-----------------------------------------------------------
+
+class CZipArchiveReader::CEntryStream : public CStream, public CNonCopyableObj
+{
+protected:
+    friend class CZipArchiveReader;
+
+    CEntryStream(_In_ CZipArchiveReader *lpArchive, _In_ const ENTRY *lpEntry);
+
+public:
+    ~CEntryStream();
+
+    HRESULT Read(_Out_ LPVOID lpDest, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesRead, _In_opt_ ULONGLONG nStartOffset = ULONGLONG_MAX);
+    HRESULT Write(_In_ LPCVOID lpSrc, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesWritten, _In_opt_ ULONGLONG nStartOffset = ULONGLONG_MAX);
+
+    // NOTE: Seeking backwards in a deflated entry restarts decompression. The CRC is verified when the last byte is
+    //       read, stored entries are only verified if every byte up to the end was read.
+    HRESULT Seek(_In_ ULONGLONG nPosition, _In_opt_ CStream::eSeekMethod nMethod = CStream::eSeekMethod::Start);
+
+    ULONGLONG GetLength() const;
+
+private:
+    HRESULT Initialize();
+    HRESULT Rewind();
+    HRESULT Inflate(_Out_ LPBYTE lpDest, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesRead);
+
+private:
+    TAutoRefCounted<CMappedArchive> cMapping;
+    const ENTRY *lpEntry;
+    LPBYTE lpData;
+    LPVOID lpStream{ NULL };
+    ULONGLONG nCompressedPos{ 0 };
+    ULONGLONG nPos{ 0 };
+    ULONG nCrc32{ 0 };
+    ULONGLONG nCrcPos{ 0 };
+};
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_ZIP_ARCHIVE_READER_H
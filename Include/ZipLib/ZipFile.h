@@ -37,6 +37,10 @@ public:
     HRESULT OpenArchive(_In_z_ LPCWSTR szFileNameW);
     VOID CloseArchive();
 
+    // NOTE: When more than one thread is used, entries without password are compressed with CParallelDeflate. If
+    //       count is zero, one thread per processor is used.
+    VOID SetOption_CompressionThreadsCount(_In_ DWORD dwCount);
+
     HRESULT AddFile(_In_z_ LPCWSTR szFileNameInZipW, _In_z_ LPCWSTR szSrcFileNameW, _In_opt_z_ LPCWSTR szPasswordW = NULL);
     HRESULT AddStream(_In_z_ LPCWSTR szFileNameInZipW, _In_ CStream *lpStream, _In_opt_z_ LPCWSTR szPasswordW = NULL);
 
@@ -51,8 +55,11 @@ public:
 private:
     HRESULT CreateOrOpenArchive(_In_z_ LPCWSTR szFileNameW, _In_ int mode);
 
+    static HRESULT OnParallelDeflateOutput(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam);
+
 private:
     LPVOID lpData;
+    DWORD dwCompressionThreadsCount{ 1 };
 };
 
 } // namespace MX
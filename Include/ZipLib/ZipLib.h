@@ -27,6 +27,8 @@
 
 namespace MX {
 
+class CParallelDeflate;
+
 class CZipLib : public virtual CBaseMemObj, public CNonCopyableObj
 {
 public:
@@ -34,6 +36,10 @@ public:
     virtual ~CZipLib();
 
     HRESULT BeginCompress(_In_ int nCompressionLevel);
+    // NOTE: Compresses blocks of input concurrently. The output is a standard stream but it becomes available one
+    //       batch of blocks at a time instead of after each call to CompressStream. If threads count is zero, one
+    //       thread per processor is used.
+    HRESULT BeginParallelCompress(_In_ int nCompressionLevel, _In_opt_ DWORD dwThreadsCount = 0);
     HRESULT BeginDecompress();
     HRESULT CompressStream(_In_ LPCVOID lpSrc, _In_ SIZE_T nSrcLen);
     HRESULT DecompressStream(_In_ LPCVOID lpSrc, _In_ SIZE_T nSrcLen, _Out_opt_ SIZE_T *lpnUnusedBytes = NULL);
@@ -48,6 +54,8 @@ protected:
     VOID Cleanup();
     BOOL CheckAndSkipGZipHeader(_Inout_ LPBYTE &s, _Inout_ SIZE_T &nSrcLen, _Inout_opt_ SIZE_T *lpnUnusedBytes);
 
+    HRESULT OnParallelDeflateOutput(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam);
+
 protected:
     BOOL bUseZipLibHeader;
     int nInUse, nLevel, nGZipHdrState;
@@ -57,6 +65,7 @@ protected:
     BOOL bEndReached;
     WORD wTemp16;
     CCircularBuffer cProcessed;
+    CParallelDeflate *lpParallelDeflate;
 };
 
 } // namespace MX
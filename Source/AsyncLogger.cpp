@@ -0,0 +1,577 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\Include\AsyncLogger.h"
+#include <stdio.h>
+
+ //-----------------------------------------------------------
+
+#define DEFAULT_RING_SIZE 65536
+#define MAX_TEXT_LENGTH MX_LOGGABLE_MAX_TEXT_LENGTH
+#define MAX_RECORD_SIZE ((sizeof(RECORD) + (MAX_TEXT_LENGTH + 1) * sizeof(WCHAR) + 15) & (~(SIZE_T)15))
+
+#define BATCH_SIZE 262144
+#define MAX_LINE_PREFIX_LENGTH 48
+
+#define DRAIN_INTERVAL_MS 50
+
+//-----------------------------------------------------------
+
+static LONG volatile nNextRingIndex = 0;
+static __declspec(thread) ULONG nThreadRingIndex = 0;
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+CAsyncLogger::CAsyncLogger() : CBaseMemObj(), CNonCopyableObj()
+{
+    cCallback = NullCallback();
+    return;
+}
+
+CAsyncLogger::~CAsyncLogger()
+{
+    Stop();
+
+    if (lpRings != NULL)
+    {
+        for (SIZE_T i = 0; i < MX_ASYNCLOGGER_SHARDS_COUNT; i++)
+        {
+            MX_FREE(lpRings[i].lpBuffer);
+        }
+        MX_FREE(lpRings);
+    }
+    MX_FREE(lpBatch);
+    return;
+}
+
+HRESULT CAsyncLogger::Start(_In_z_ LPCWSTR szFileNameW, _In_opt_ SIZE_T _nRingSize)
+{
+    HRESULT hRes;
+
+    if (szFileNameW == NULL)
+    {
+        return E_POINTER;
+    }
+    if (*szFileNameW == 0)
+    {
+        return E_INVALIDARG;
+    }
+    if (__InterlockedRead(&nRunning) != 0)
+    {
+        return MX_E_AlreadyInitialized;
+    }
+
+    if (lpBatch == NULL)
+    {
+        lpBatch = (LPBYTE)MX_MALLOC(BATCH_SIZE);
+        if (lpBatch == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+    nBatchLen = 0;
+
+    cFile.Attach(::CreateFileW(szFileNameW, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL, NULL));
+    if (!cFile)
+    {
+        hRes = MX_HRESULT_FROM_LASTERROR();
+        goto done;
+    }
+
+    hRes = Initialize(_nRingSize);
+
+done:
+    if (FAILED(hRes))
+    {
+        cFile.Close();
+        MX_FREE(lpBatch);
+    }
+    return hRes;
+}
+
+HRESULT CAsyncLogger::Start(_In_ CLoggable::OnLogCallback _cCallback, _In_opt_ SIZE_T _nRingSize)
+{
+    HRESULT hRes;
+
+    if (!_cCallback)
+    {
+        return E_POINTER;
+    }
+    if (__InterlockedRead(&nRunning) != 0)
+    {
+        return MX_E_AlreadyInitialized;
+    }
+
+    cCallback = _cCallback;
+
+    hRes = Initialize(_nRingSize);
+    if (FAILED(hRes))
+    {
+        cCallback = NullCallback();
+    }
+    return hRes;
+}
+
+VOID CAsyncLogger::Stop()
+{
+    if (__InterlockedRead(&nRunning) == 0)
+    {
+        return;
+    }
+
+    // reject new messages and wait for writers still holding a ring
+    _InterlockedExchange(&nRunning, 0);
+    for (SIZE_T i = 0; i < MX_ASYNCLOGGER_SHARDS_COUNT; i++)
+    {
+        CFastLock cLock(&(lpRings[i].nMutex));
+    }
+
+    // the drain thread does a last pass before exiting
+    cDrainThread.Stop();
+
+    cFile.Close();
+    cCallback = NullCallback();
+    return;
+}
+
+HRESULT CAsyncLogger::Write(_In_z_ LPCWSTR szTextW)
+{
+    LPRING lpRing;
+    LPRECORD lpRecord;
+    SIZE_T nLen;
+
+    if (szTextW == NULL)
+    {
+        return E_POINTER;
+    }
+    if (lpRings == NULL)
+    {
+        return MX_E_NotReady;
+    }
+
+    nLen = wcsnlen(szTextW, MAX_TEXT_LENGTH);
+
+    lpRing = GetThreadRing();
+    {
+        CFastLock cLock(&(lpRing->nMutex));
+
+        lpRecord = ReserveRecord(lpRing);
+        if (lpRecord == NULL)
+        {
+            return MX_E_NotReady;
+        }
+        ::MxMemCopy(lpRecord + 1, szTextW, nLen * sizeof(WCHAR));
+        CommitRecord(lpRing, lpRecord, nLen);
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CAsyncLogger::WriteV(_In_ BOOL bAddError, _In_ HRESULT hResError, _In_z_ LPCWSTR szFormatW,
+                             _In_ va_list argptr)
+{
+    LPRING lpRing;
+    LPRECORD lpRecord;
+    LPWSTR szDestW;
+    int count[2];
+
+    if (szFormatW == NULL)
+    {
+        return E_POINTER;
+    }
+    if (lpRings == NULL)
+    {
+        return MX_E_NotReady;
+    }
+
+    lpRing = GetThreadRing();
+    {
+        CFastLock cLock(&(lpRing->nMutex));
+
+        lpRecord = ReserveRecord(lpRing);
+        if (lpRecord == NULL)
+        {
+            return MX_E_NotReady;
+        }
+
+        // format in place, a single pass is enough because the record has room for the maximum length
+        szDestW = (LPWSTR)(lpRecord + 1);
+        count[0] = 0;
+        if (bAddError != FALSE)
+        {
+            count[0] = _snwprintf_s(szDestW, MAX_TEXT_LENGTH + 1, _TRUNCATE, L"Error 0x%08X: ", hResError);
+            if (count[0] < 0)
+            {
+                count[0] = 0;
+            }
+        }
+        count[1] = _vsnwprintf_s(szDestW + (SIZE_T)count[0], MAX_TEXT_LENGTH + 1 - (SIZE_T)count[0], _TRUNCATE,
+                                 szFormatW, argptr);
+        if (count[1] < 0)
+        {
+            count[1] = (int)(unsigned int)wcslen(szDestW + (SIZE_T)count[0]);
+        }
+        CommitRecord(lpRing, lpRecord, (SIZE_T)count[0] + (SIZE_T)count[1]);
+    }
+
+    // done
+    return S_OK;
+}
+
+VOID CAsyncLogger::Flush()
+{
+    SIZE_T aTails[MX_ASYNCLOGGER_SHARDS_COUNT];
+    DWORD dwTries;
+
+    if (__InterlockedRead(&nRunning) == 0)
+    {
+        return;
+    }
+
+    for (SIZE_T i = 0; i < MX_ASYNCLOGGER_SHARDS_COUNT; i++)
+    {
+        aTails[i] = __InterlockedReadSizeT(&(lpRings[i].nTail));
+    }
+
+    // heads are advanced after the batch containing their messages is delivered
+    for (SIZE_T i = 0; i < MX_ASYNCLOGGER_SHARDS_COUNT; i++)
+    {
+        dwTries = 0;
+        while ((SSIZE_T)(aTails[i] - __InterlockedReadSizeT(&(lpRings[i].nHead))) > 0)
+        {
+            if (cDrainThread.IsRunning() == FALSE)
+            {
+                return;
+            }
+            if (dwTries == 0)
+            {
+                cWakeEvent.Set();
+            }
+            ::Sleep(1);
+            dwTries = (dwTries + 1) & 15;
+        }
+    }
+
+    // done
+    return;
+}
+
+VOID CAsyncLogger::GetStats(_Out_ LPSTATS lpStats)
+{
+    lpStats->nMessages = (ULONGLONG)__InterlockedRead64(&(sStats.nMessages));
+    lpStats->nBatches = (ULONGLONG)__InterlockedRead64(&(sStats.nBatches));
+    lpStats->nBytesWritten = (ULONGLONG)__InterlockedRead64(&(sStats.nBytesWritten));
+    lpStats->nProducerWaits = (ULONGLONG)__InterlockedRead64(&(sStats.nProducerWaits));
+    lpStats->nWriteErrors = (ULONGLONG)__InterlockedRead64(&(sStats.nWriteErrors));
+    lpStats->nBytesDropped = (ULONGLONG)__InterlockedRead64(&(sStats.nBytesDropped));
+    return;
+}
+
+HRESULT CAsyncLogger::Initialize(_In_ SIZE_T _nRingSize)
+{
+    LPRING _lpRings = NULL;
+    SIZE_T _nFinalRingSize;
+    HRESULT hRes;
+
+    // NOTE: Rings survive Stop because late writers may still be looking at them, they are freed on destruction.
+    if (lpRings == NULL)
+    {
+        if (_nRingSize < DEFAULT_RING_SIZE)
+        {
+            _nRingSize = DEFAULT_RING_SIZE;
+        }
+        else if (_nRingSize > 0x40000000)
+        {
+            return E_INVALIDARG;
+        }
+        for (_nFinalRingSize = DEFAULT_RING_SIZE; _nFinalRingSize < _nRingSize; _nFinalRingSize <<= 1);
+
+        _lpRings = (LPRING)MX_MALLOC(MX_ASYNCLOGGER_SHARDS_COUNT * sizeof(RING));
+        if (_lpRings == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        ::MxMemSet(_lpRings, 0, MX_ASYNCLOGGER_SHARDS_COUNT * sizeof(RING));
+        for (SIZE_T i = 0; i < MX_ASYNCLOGGER_SHARDS_COUNT; i++)
+        {
+            _lpRings[i].lpBuffer = (LPBYTE)MX_MALLOC(_nFinalRingSize);
+            if (_lpRings[i].lpBuffer == NULL)
+            {
+                for (SIZE_T j = 0; j < i; j++)
+                {
+                    MX_FREE(_lpRings[j].lpBuffer);
+                }
+                MX_FREE(_lpRings);
+                return E_OUTOFMEMORY;
+            }
+        }
+
+        // publish the rings once they are complete
+        nRingSize = _nFinalRingSize;
+        _ReadWriteBarrier();
+        lpRings = _lpRings;
+    }
+
+    if (cWakeEvent.Get() == NULL)
+    {
+        hRes = cWakeEvent.Create(FALSE, FALSE);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    _InterlockedExchange(&nRunning, 1);
+    if (cDrainThread.Start(this, &CAsyncLogger::ThreadProc) == FALSE)
+    {
+        _InterlockedExchange(&nRunning, 0);
+        return E_OUTOFMEMORY;
+    }
+    cDrainThread.SetThreadName("AsyncLogger/Drain");
+
+    // done
+    return S_OK;
+}
+
+CAsyncLogger::LPRING CAsyncLogger::GetThreadRing()
+{
+    ULONG nIndex;
+
+    nIndex = nThreadRingIndex;
+    if (nIndex == 0)
+    {
+        nIndex = ((ULONG)_InterlockedIncrement(&nNextRingIndex) % MX_ASYNCLOGGER_SHARDS_COUNT) + 1;
+        nThreadRingIndex = nIndex;
+    }
+    return &lpRings[nIndex - 1];
+}
+
+CAsyncLogger::LPRECORD CAsyncLogger::ReserveRecord(_In_ LPRING lpRing)
+{
+    LPRECORD lpRecord;
+    SIZE_T nTail, nOffset, nContiguous, nNeeded;
+    DWORD dwTries = 0;
+
+    // the tail is only modified by writers holding the ring lock
+    nTail = lpRing->nTail;
+    for (;;)
+    {
+        if (__InterlockedRead(&nRunning) == 0)
+        {
+            return NULL;
+        }
+
+        nOffset = nTail & (nRingSize - 1);
+        nContiguous = nRingSize - nOffset;
+        nNeeded = MAX_RECORD_SIZE + ((nContiguous < MAX_RECORD_SIZE) ? nContiguous : 0);
+        if (nRingSize - (nTail - __InterlockedReadSizeT(&(lpRing->nHead))) >= nNeeded)
+        {
+            break;
+        }
+
+        // ring is full, wait for the drain thread
+        if (dwTries == 0)
+        {
+            _InterlockedIncrement64(&(sStats.nProducerWaits));
+            cWakeEvent.Set();
+        }
+        ::Sleep((dwTries < 8) ? 0 : 1);
+        dwTries++;
+    }
+
+    if (nContiguous < MAX_RECORD_SIZE)
+    {
+        // not enough room up to the end of the buffer so skip it
+        lpRecord = (LPRECORD)(lpRing->lpBuffer + nOffset);
+        lpRecord->dwSize = (DWORD)nContiguous;
+        lpRecord->dwThreadId = 0;
+        nTail += nContiguous;
+        __InterlockedExchangeSizeT(&(lpRing->nTail), nTail);
+        nOffset = 0;
+    }
+
+    lpRecord = (LPRECORD)(lpRing->lpBuffer + nOffset);
+    ::GetSystemTimeAsFileTime((LPFILETIME)&(lpRecord->nTime));
+    lpRecord->dwThreadId = ::GetCurrentThreadId();
+    return lpRecord;
+}
+
+VOID CAsyncLogger::CommitRecord(_In_ LPRING lpRing, _In_ LPRECORD lpRecord, _In_ SIZE_T nTextLen)
+{
+    SIZE_T nTail;
+
+    ((LPWSTR)(lpRecord + 1))[nTextLen] = 0;
+    lpRecord->dwSize = (DWORD)((sizeof(RECORD) + (nTextLen + 1) * sizeof(WCHAR) + 15) & (~(SIZE_T)15));
+
+    nTail = lpRing->nTail + (SIZE_T)(lpRecord->dwSize);
+    __InterlockedExchangeSizeT(&(lpRing->nTail), nTail);
+
+    // wake up the drain thread early if the ring is getting full but avoid signaling the event on every message
+    if (nTail - lpRing->nHead >= nRingSize / 2 && __InterlockedRead(&nWakeRequested) == 0)
+    {
+        if (_InterlockedExchange(&nWakeRequested, 1) == 0)
+        {
+            cWakeEvent.Set();
+        }
+    }
+    return;
+}
+
+VOID CAsyncLogger::ThreadProc()
+{
+    HANDLE hEvent;
+
+    hEvent = cWakeEvent.Get();
+    while (cDrainThread.CheckForAbort(DRAIN_INTERVAL_MS, 1, &hEvent) == FALSE)
+    {
+        DrainRings();
+    }
+
+    // deliver whatever was written before stopping
+    DrainRings();
+    return;
+}
+
+VOID CAsyncLogger::DrainRings()
+{
+    SIZE_T aHeads[MX_ASYNCLOGGER_SHARDS_COUNT], nTail;
+    LPRECORD lpRecord;
+    LONGLONG nMessages = 0;
+
+    _InterlockedExchange(&nWakeRequested, 0);
+
+    for (SIZE_T i = 0; i < MX_ASYNCLOGGER_SHARDS_COUNT; i++)
+    {
+        aHeads[i] = lpRings[i].nHead;
+        nTail = __InterlockedReadSizeT(&(lpRings[i].nTail));
+        while (aHeads[i] != nTail)
+        {
+            lpRecord = (LPRECORD)(lpRings[i].lpBuffer + (aHeads[i] & (nRingSize - 1)));
+            if (lpRecord->dwThreadId != 0)
+            {
+                DeliverRecord(lpRecord);
+                nMessages++;
+            }
+            aHeads[i] += (SIZE_T)(lpRecord->dwSize);
+        }
+    }
+    FlushBatch();
+
+    // release the space only after the messages reached the sink so Flush can rely on ring heads
+    for (SIZE_T i = 0; i < MX_ASYNCLOGGER_SHARDS_COUNT; i++)
+    {
+        __InterlockedExchangeSizeT(&(lpRings[i].nHead), aHeads[i]);
+    }
+    if (nMessages > 0)
+    {
+        _InterlockedExchangeAdd64(&(sStats.nMessages), nMessages);
+    }
+    return;
+}
+
+VOID CAsyncLogger::DeliverRecord(_In_ LPRECORD lpRecord)
+{
+    LPCWSTR szTextW = (LPCWSTR)(lpRecord + 1);
+    FILETIME ftLocal;
+    SYSTEMTIME sSysTime;
+    SIZE_T nLen;
+    int nPrefixLen, nTextLen;
+
+    if (!cFile)
+    {
+        if (cCallback)
+        {
+            cCallback(szTextW);
+        }
+        return;
+    }
+
+    // lines get their own terminator
+    nLen = wcslen(szTextW);
+    while (nLen > 0 && (szTextW[nLen - 1] == L'\n' || szTextW[nLen - 1] == L'\r'))
+    {
+        nLen--;
+    }
+
+    if (nBatchLen + MAX_LINE_PREFIX_LENGTH + nLen * 3 + 2 > BATCH_SIZE)
+    {
+        FlushBatch();
+    }
+
+    if (::FileTimeToLocalFileTime((LPFILETIME)&(lpRecord->nTime), &ftLocal) == FALSE ||
+        ::FileTimeToSystemTime(&ftLocal, &sSysTime) == FALSE)
+    {
+        ::MxMemSet(&sSysTime, 0, sizeof(sSysTime));
+    }
+    nPrefixLen = _snprintf_s((LPSTR)(lpBatch + nBatchLen), MAX_LINE_PREFIX_LENGTH, _TRUNCATE,
+                             "%04u-%02u-%02u %02u:%02u:%02u.%03u [%lu] ", sSysTime.wYear, sSysTime.wMonth,
+                             sSysTime.wDay, sSysTime.wHour, sSysTime.wMinute, sSysTime.wSecond,
+                             sSysTime.wMilliseconds, lpRecord->dwThreadId);
+    if (nPrefixLen > 0)
+    {
+        nBatchLen += (SIZE_T)nPrefixLen;
+    }
+
+    if (nLen > 0)
+    {
+        nTextLen = ::WideCharToMultiByte(CP_UTF8, 0, szTextW, (int)nLen, (LPSTR)(lpBatch + nBatchLen),
+                                         (int)(BATCH_SIZE - nBatchLen), NULL, NULL);
+        if (nTextLen > 0)
+        {
+            nBatchLen += (SIZE_T)nTextLen;
+        }
+    }
+    lpBatch[nBatchLen++] = '\r';
+    lpBatch[nBatchLen++] = '\n';
+    return;
+}
+
+VOID CAsyncLogger::FlushBatch()
+{
+    SIZE_T nOffset;
+    DWORD dwWritten;
+
+    if (nBatchLen > 0)
+    {
+        // a write may be partial, and a failed one (disk full, file deleted...) must not stall the producers
+        for (nOffset = 0; nOffset < nBatchLen; nOffset += (SIZE_T)dwWritten)
+        {
+            if (::WriteFile(cFile.Get(), lpBatch + nOffset, (DWORD)(nBatchLen - nOffset), &dwWritten, NULL) == FALSE ||
+                dwWritten == 0)
+            {
+                _InterlockedIncrement64(&(sStats.nWriteErrors));
+                _InterlockedExchangeAdd64(&(sStats.nBytesDropped), (LONGLONG)(nBatchLen - nOffset));
+                break;
+            }
+            _InterlockedExchangeAdd64(&(sStats.nBytesWritten), (LONGLONG)dwWritten);
+        }
+        if (nOffset >= nBatchLen)
+        {
+            _InterlockedIncrement64(&(sStats.nBatches));
+        }
+        nBatchLen = 0;
+    }
+    return;
+}
+
+} // namespace MX
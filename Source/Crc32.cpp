@@ -0,0 +1,397 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\Include\Crc32.h"
+#include "..\Include\WaitableObjects.h"
+#include "..\Include\AtomicOps.h"
+#include <intrin.h>
+
+ //-----------------------------------------------------------
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define CRC_HAS_X86_KERNELS
+#endif //_M_IX86 || _M_X64
+
+#define CRC32_POLYNOMIAL 0xEDB88320UL
+#define CRC32C_POLYNOMIAL 0x82F63B78UL
+
+// NOTE: Below this size setting up the folding kernel costs more than it saves.
+#define FOLD_MIN_LENGTH 64
+
+//-----------------------------------------------------------
+
+typedef struct tagCRC_ENGINE
+{
+    ULONG nPolynomial;
+    const ULONGLONG *lpFoldConstants;
+    ULONG aTable[8][256];
+    ULONG aX2nTable[32];
+} CRC_ENGINE, *LPCRC_ENGINE;
+
+//-----------------------------------------------------------
+
+// NOTE: Bit-reflected folding constants as described in Intel's "Fast CRC Computation for Generic Polynomials Using
+//       PCLMULQDQ Instruction": x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32) and x^64 mod P, then P' and the
+//       Barrett constant u'.
+static const ULONGLONG aCrc32FoldConstants[8] = {
+    0x0154442BD4ui64, 0x01C6E41596ui64, 0x01751997D0ui64, 0x00CCAA009Eui64,
+    0x0163CD6124ui64, 0x0000000000ui64, 0x01DB710641ui64, 0x01F7011641ui64
+};
+static const ULONGLONG aCrc32CFoldConstants[8] = {
+    0x00740EEF02ui64, 0x009E4ADDF8ui64, 0x00F20C0DFEui64, 0x014CD00BD6ui64,
+    0x00DD45AAB8ui64, 0x0000000000ui64, 0x0105EC76F1ui64, 0x00DEA713F1ui64
+};
+
+static LONG volatile nInitialized = 0;
+static LONG volatile nInitMutex = 0;
+static CRC_ENGINE sCrc32 = { CRC32_POLYNOMIAL, aCrc32FoldConstants };
+static CRC_ENGINE sCrc32C = { CRC32C_POLYNOMIAL, aCrc32CFoldConstants };
+#ifdef CRC_HAS_X86_KERNELS
+static BOOL bHasPclMul = FALSE;
+static BOOL bHasSse42 = FALSE;
+#endif //CRC_HAS_X86_KERNELS
+
+//-----------------------------------------------------------
+
+static VOID InitializeEngines();
+static VOID InitializeEngine(_Inout_ LPCRC_ENGINE lpEngine);
+static ULONG Update(_In_ LPCRC_ENGINE lpEngine, _In_ ULONG nCrc, _In_ const BYTE *p, _In_ SIZE_T nLength);
+static ULONG UpdateSlicing8(_In_ LPCRC_ENGINE lpEngine, _In_ ULONG nCrc, _In_ const BYTE *p, _In_ SIZE_T nLength);
+#ifdef CRC_HAS_X86_KERNELS
+static ULONG UpdateFoldPclMul(_In_ const ULONGLONG *lpConstants, _In_ ULONG nCrc, _In_ const BYTE *p,
+                              _In_ SIZE_T nLength);
+static ULONG UpdateCrc32CSse42(_In_ ULONG nCrc, _In_ const BYTE *p, _In_ SIZE_T nLength);
+#endif //CRC_HAS_X86_KERNELS
+static ULONG Combine(_In_ LPCRC_ENGINE lpEngine, _In_ ULONG nCrc1, _In_ ULONG nCrc2, _In_ ULONGLONG nLength2);
+static ULONG MultModP(_In_ ULONG a, _In_ ULONG b, _In_ ULONG nPolynomial);
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+ULONG Crc32(_In_ ULONG nCrc, _In_reads_bytes_(nLength) LPCVOID lpData, _In_ SIZE_T nLength)
+{
+    if (lpData == NULL || nLength == 0)
+    {
+        return nCrc;
+    }
+    InitializeEngines();
+    return ~Update(&sCrc32, ~nCrc, (const BYTE *)lpData, nLength);
+}
+
+ULONG Crc32Combine(_In_ ULONG nCrc1, _In_ ULONG nCrc2, _In_ ULONGLONG nLength2)
+{
+    InitializeEngines();
+    return Combine(&sCrc32, nCrc1, nCrc2, nLength2);
+}
+
+ULONG Crc32C(_In_ ULONG nCrc, _In_reads_bytes_(nLength) LPCVOID lpData, _In_ SIZE_T nLength)
+{
+    if (lpData == NULL || nLength == 0)
+    {
+        return nCrc;
+    }
+    InitializeEngines();
+    return ~Update(&sCrc32C, ~nCrc, (const BYTE *)lpData, nLength);
+}
+
+ULONG Crc32CCombine(_In_ ULONG nCrc1, _In_ ULONG nCrc2, _In_ ULONGLONG nLength2)
+{
+    InitializeEngines();
+    return Combine(&sCrc32C, nCrc1, nCrc2, nLength2);
+}
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+static VOID InitializeEngines()
+{
+    // NOTE: A plain volatile read is enough for the fast path and avoids a locked instruction on every call, which
+    //       matters for callers like the zip's traditional encryption that update the crc one byte at a time.
+    if (nInitialized == 0)
+    {
+        MX::CFastLock cLock(&nInitMutex);
+
+        if (__InterlockedRead(&nInitialized) == 0)
+        {
+#ifdef CRC_HAS_X86_KERNELS
+            int aCpuInfo[4];
+
+            __cpuid(aCpuInfo, 1);
+            // PCLMULQDQ (the kernel also needs SSE4.1 for pextrd)
+            bHasPclMul = ((aCpuInfo[2] & (1 << 1)) != 0 && (aCpuInfo[2] & (1 << 19)) != 0) ? TRUE : FALSE;
+            bHasSse42 = ((aCpuInfo[2] & (1 << 20)) != 0) ? TRUE : FALSE;
+#endif //CRC_HAS_X86_KERNELS
+
+            InitializeEngine(&sCrc32);
+            InitializeEngine(&sCrc32C);
+
+            // done
+            _InterlockedExchange(&nInitialized, 1);
+        }
+    }
+    return;
+}
+
+static VOID InitializeEngine(_Inout_ LPCRC_ENGINE lpEngine)
+{
+    ULONG nCrc, p;
+
+    for (ULONG i = 0; i < 256; i++)
+    {
+        nCrc = i;
+        for (int k = 0; k < 8; k++)
+        {
+            nCrc = (nCrc & 1) ? ((nCrc >> 1) ^ lpEngine->nPolynomial) : (nCrc >> 1);
+        }
+        lpEngine->aTable[0][i] = nCrc;
+    }
+    for (ULONG i = 0; i < 256; i++)
+    {
+        nCrc = lpEngine->aTable[0][i];
+        for (int k = 1; k < 8; k++)
+        {
+            nCrc = lpEngine->aTable[0][nCrc & 0xFF] ^ (nCrc >> 8);
+            lpEngine->aTable[k][i] = nCrc;
+        }
+    }
+
+    // x^(2^n) mod P, used to combine
+    p = 1UL << 30; // x^1
+    lpEngine->aX2nTable[0] = p;
+    for (int n = 1; n < 32; n++)
+    {
+        lpEngine->aX2nTable[n] = p = MultModP(p, p, lpEngine->nPolynomial);
+    }
+    return;
+}
+
+static ULONG Update(_In_ LPCRC_ENGINE lpEngine, _In_ ULONG nCrc, _In_ const BYTE *p, _In_ SIZE_T nLength)
+{
+#ifdef CRC_HAS_X86_KERNELS
+    if (bHasPclMul != FALSE && nLength >= FOLD_MIN_LENGTH)
+    {
+        SIZE_T nChunkLength = nLength & (~((SIZE_T)15));
+
+        nCrc = UpdateFoldPclMul(lpEngine->lpFoldConstants, nCrc, p, nChunkLength);
+        p += nChunkLength;
+        nLength -= nChunkLength;
+    }
+    if (lpEngine == &sCrc32C && bHasSse42 != FALSE)
+    {
+        return UpdateCrc32CSse42(nCrc, p, nLength);
+    }
+#endif //CRC_HAS_X86_KERNELS
+    return UpdateSlicing8(lpEngine, nCrc, p, nLength);
+}
+
+static ULONG UpdateSlicing8(_In_ LPCRC_ENGINE lpEngine, _In_ ULONG nCrc, _In_ const BYTE *p, _In_ SIZE_T nLength)
+{
+    ULONG (*T)[256] = lpEngine->aTable;
+    ULONG nLow, nHigh;
+
+    while (nLength > 0 && ((SIZE_T)p & 7) != 0)
+    {
+        nCrc = T[0][(nCrc ^ (*p++)) & 0xFF] ^ (nCrc >> 8);
+        nLength--;
+    }
+    while (nLength >= 8)
+    {
+        nLow = *((const ULONG *)p) ^ nCrc;
+        nHigh = *((const ULONG *)(p + 4));
+        nCrc = T[7][nLow & 0xFF] ^ T[6][(nLow >> 8) & 0xFF] ^ T[5][(nLow >> 16) & 0xFF] ^ T[4][nLow >> 24] ^
+               T[3][nHigh & 0xFF] ^ T[2][(nHigh >> 8) & 0xFF] ^ T[1][(nHigh >> 16) & 0xFF] ^ T[0][nHigh >> 24];
+        p += 8;
+        nLength -= 8;
+    }
+    while (nLength > 0)
+    {
+        nCrc = T[0][(nCrc ^ (*p++)) & 0xFF] ^ (nCrc >> 8);
+        nLength--;
+    }
+    return nCrc;
+}
+
+#ifdef CRC_HAS_X86_KERNELS
+
+// NOTE: Length must be a multiple of 16 and at least 64 bytes. Four 128-bit lanes are folded in parallel, then
+//       reduced to one lane, to 64 bits and finally to 32 bits with a Barrett reduction.
+static ULONG UpdateFoldPclMul(_In_ const ULONGLONG *lpConstants, _In_ ULONG nCrc, _In_ const BYTE *p,
+                              _In_ SIZE_T nLength)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)nCrc));
+
+    x0 = _mm_loadu_si128((const __m128i *)(lpConstants + 0)); // k1k2
+    p += 64;
+    nLength -= 64;
+
+    // parallel fold blocks of 64
+    while (nLength >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        p += 64;
+        nLength -= 64;
+    }
+
+    // fold into 128 bits
+    x0 = _mm_loadu_si128((const __m128i *)(lpConstants + 2)); // k3k4
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // single fold blocks of 16
+    while (nLength >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i *)p);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        p += 16;
+        nLength -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i *)(lpConstants + 4)); // k5k0
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_loadu_si128((const __m128i *)(lpConstants + 6)); // P' and u'
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (ULONG)_mm_extract_epi32(x1, 1);
+}
+
+static ULONG UpdateCrc32CSse42(_In_ ULONG nCrc, _In_ const BYTE *p, _In_ SIZE_T nLength)
+{
+#if defined(_M_X64)
+    ULONGLONG nCrc64 = nCrc;
+
+    while (nLength >= 8)
+    {
+        nCrc64 = _mm_crc32_u64(nCrc64, *((const ULONGLONG *)p));
+        p += 8;
+        nLength -= 8;
+    }
+    nCrc = (ULONG)nCrc64;
+#endif //_M_X64
+    while (nLength >= 4)
+    {
+        nCrc = _mm_crc32_u32(nCrc, *((const ULONG *)p));
+        p += 4;
+        nLength -= 4;
+    }
+    while (nLength > 0)
+    {
+        nCrc = _mm_crc32_u8(nCrc, *p++);
+        nLength--;
+    }
+    return nCrc;
+}
+
+#endif //CRC_HAS_X86_KERNELS
+
+static ULONG Combine(_In_ LPCRC_ENGINE lpEngine, _In_ ULONG nCrc1, _In_ ULONG nCrc2, _In_ ULONGLONG nLength2)
+{
+    ULONG p = 1UL << 31; // x^0 == 1
+    int k = 3;           // x^(8 * nLength2)
+
+    while (nLength2 != 0)
+    {
+        if ((nLength2 & 1) != 0)
+        {
+            p = MultModP(lpEngine->aX2nTable[k & 31], p, lpEngine->nPolynomial);
+        }
+        nLength2 >>= 1;
+        k++;
+    }
+    return MultModP(p, nCrc1, lpEngine->nPolynomial) ^ nCrc2;
+}
+
+// NOTE: Multiplies a(x) by b(x) modulo P(x) with both polynomials in reflected order. 'a' must not be zero.
+static ULONG MultModP(_In_ ULONG a, _In_ ULONG b, _In_ ULONG nPolynomial)
+{
+    ULONG m = 1UL << 31;
+    ULONG p = 0;
+
+    for (;;)
+    {
+        if ((a & m) != 0)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+            {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? ((b >> 1) ^ nPolynomial) : (b >> 1);
+    }
+    return p;
+}
@@ -0,0 +1,286 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "DigestCache.h"
+#include "..\..\Include\AtomicOps.h"
+#include <OpenSSL\core_names.h>
+#include <OpenSSL\params.h>
+
+ //-----------------------------------------------------------
+
+#define ALGORITHMS_COUNT ((SIZE_T)(MX::CMessageDigest::eAlgorithm::Blake2b_512) + 1)
+
+#define POOL_SLOTS_COUNT 32
+
+//-----------------------------------------------------------
+
+typedef struct
+{
+    LPCSTR szNameA;
+    LPCSTR szPropertiesA;
+} DIGEST_NAME;
+
+//-----------------------------------------------------------
+
+static const DIGEST_NAME aDigestNames[ALGORITHMS_COUNT] = {
+    { NULL, NULL },         { "MD5", NULL },        { "MD4", NULL },      { "SHA1", NULL },
+    { "SHA224", NULL },     { "SHA256", NULL },     { "SHA384", NULL },   { "SHA512", NULL },
+    { "SHA512-224", NULL }, { "SHA512-256", NULL }, { "SHA3-224", NULL }, { "SHA3-256", NULL },
+    { "SHA3-384", NULL },   { "SHA3-512", NULL },   { "BLAKE2s256", NULL }, { "BLAKE2b512", NULL }
+};
+
+static EVP_MD *volatile aCachedDigests[ALGORITHMS_COUNT] = { 0 };
+static EVP_MAC *volatile lpCachedHmac = NULL;
+static EVP_MD_CTX *volatile aDigestCtxPool[POOL_SLOTS_COUNT] = { 0 };
+static EVP_MAC_CTX *volatile aHmacTemplates[ALGORITHMS_COUNT] = { 0 };
+
+//-----------------------------------------------------------
+
+static EVP_MAC *GetCachedHmac();
+static EVP_MAC_CTX *GetHmacTemplate(_In_ SIZE_T nIndex);
+static LPVOID PopFromPool(_In_ LPVOID volatile *lpSlots, _In_ SIZE_T nCount);
+static BOOL PushToPool(_In_ LPVOID volatile *lpSlots, _In_ SIZE_T nCount, _In_ LPVOID lpItem);
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+namespace Internals {
+
+namespace OpenSSL {
+
+const EVP_MD *GetCachedDigest(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm)
+{
+    EVP_MD *lpMd, *lpPrevMd;
+    SIZE_T nIndex = (SIZE_T)nAlgorithm;
+
+    if (nIndex >= ALGORITHMS_COUNT || aDigestNames[nIndex].szNameA == NULL)
+    {
+        return NULL;
+    }
+    lpMd = (EVP_MD *)__InterlockedReadPointer(&aCachedDigests[nIndex]);
+    if (lpMd == NULL)
+    {
+        lpMd = EVP_MD_fetch(NULL, aDigestNames[nIndex].szNameA, aDigestNames[nIndex].szPropertiesA);
+        if (lpMd != NULL)
+        {
+            lpPrevMd = (EVP_MD *)_InterlockedCompareExchangePointer((PVOID volatile *)&aCachedDigests[nIndex], lpMd,
+                                                                    NULL);
+            if (lpPrevMd != NULL)
+            {
+                // another thread won the race
+                EVP_MD_free(lpMd);
+                lpMd = lpPrevMd;
+            }
+        }
+    }
+    return lpMd;
+}
+
+EVP_MD_CTX *AcquireDigestContext()
+{
+    EVP_MD_CTX *lpCtx;
+
+    lpCtx = (EVP_MD_CTX *)PopFromPool((LPVOID volatile *)aDigestCtxPool, POOL_SLOTS_COUNT);
+    return (lpCtx != NULL) ? lpCtx : EVP_MD_CTX_new();
+}
+
+VOID ReleaseDigestContext(_In_ EVP_MD_CTX *lpCtx)
+{
+    if (lpCtx != NULL)
+    {
+        EVP_MD_CTX_reset(lpCtx);
+        if (PushToPool((LPVOID volatile *)aDigestCtxPool, POOL_SLOTS_COUNT, lpCtx) == FALSE)
+        {
+            EVP_MD_CTX_free(lpCtx);
+        }
+    }
+    return;
+}
+
+EVP_MAC_CTX *AcquireHmacContext(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm)
+{
+    SIZE_T nIndex = (SIZE_T)nAlgorithm;
+    EVP_MAC_CTX *lpTemplateCtx;
+
+    if (nIndex >= ALGORITHMS_COUNT || nAlgorithm == MX::CMessageDigest::eAlgorithm::CRC32)
+    {
+        return NULL;
+    }
+    lpTemplateCtx = GetHmacTemplate(nIndex);
+    return (lpTemplateCtx != NULL) ? EVP_MAC_CTX_dup(lpTemplateCtx) : NULL;
+}
+
+VOID ReleaseHmacContext(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm, _In_ EVP_MAC_CTX *lpCtx)
+{
+    UNREFERENCED_PARAMETER(nAlgorithm);
+
+    // NOTE: Used contexts hold the caller's key so they are never pooled. Freeing them also cleanses the key.
+    if (lpCtx != NULL)
+    {
+        EVP_MAC_CTX_free(lpCtx);
+    }
+    return;
+}
+
+VOID FinalizeDigestCache()
+{
+    EVP_MD_CTX *lpMdCtx;
+    EVP_MAC_CTX *lpMacCtx;
+    EVP_MD *lpMd;
+    EVP_MAC *lpMac;
+
+    for (SIZE_T i = 0; i < POOL_SLOTS_COUNT; i++)
+    {
+        lpMdCtx = (EVP_MD_CTX *)_InterlockedExchangePointer((PVOID volatile *)&aDigestCtxPool[i], NULL);
+        if (lpMdCtx != NULL)
+        {
+            EVP_MD_CTX_free(lpMdCtx);
+        }
+    }
+    for (SIZE_T nIndex = 0; nIndex < ALGORITHMS_COUNT; nIndex++)
+    {
+        lpMacCtx = (EVP_MAC_CTX *)_InterlockedExchangePointer((PVOID volatile *)&aHmacTemplates[nIndex], NULL);
+        if (lpMacCtx != NULL)
+        {
+            EVP_MAC_CTX_free(lpMacCtx);
+        }
+        lpMd = (EVP_MD *)_InterlockedExchangePointer((PVOID volatile *)&aCachedDigests[nIndex], NULL);
+        if (lpMd != NULL)
+        {
+            EVP_MD_free(lpMd);
+        }
+    }
+    lpMac = (EVP_MAC *)_InterlockedExchangePointer((PVOID volatile *)&lpCachedHmac, NULL);
+    if (lpMac != NULL)
+    {
+        EVP_MAC_free(lpMac);
+    }
+    return;
+}
+
+} // namespace OpenSSL
+
+} // namespace Internals
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+static EVP_MAC *GetCachedHmac()
+{
+    EVP_MAC *lpMac, *lpPrevMac;
+
+    lpMac = (EVP_MAC *)__InterlockedReadPointer(&lpCachedHmac);
+    if (lpMac == NULL)
+    {
+        lpMac = EVP_MAC_fetch(NULL, OSSL_MAC_NAME_HMAC, NULL);
+        if (lpMac != NULL)
+        {
+            lpPrevMac = (EVP_MAC *)_InterlockedCompareExchangePointer((PVOID volatile *)&lpCachedHmac, lpMac, NULL);
+            if (lpPrevMac != NULL)
+            {
+                EVP_MAC_free(lpMac);
+                lpMac = lpPrevMac;
+            }
+        }
+    }
+    return lpMac;
+}
+
+// NOTE: Templates have the digest bound, the costly part of a hmac initialization, but never a key. They are only
+//       duplicated, never handed out.
+static EVP_MAC_CTX *GetHmacTemplate(_In_ SIZE_T nIndex)
+{
+    OSSL_PARAM aParams[2];
+    EVP_MAC_CTX *lpCtx, *lpPrevCtx;
+    EVP_MAC *lpMac;
+
+    lpCtx = (EVP_MAC_CTX *)__InterlockedReadPointer(&aHmacTemplates[nIndex]);
+    if (lpCtx == NULL)
+    {
+        lpMac = GetCachedHmac();
+        if (lpMac == NULL)
+        {
+            return NULL;
+        }
+        lpCtx = EVP_MAC_CTX_new(lpMac);
+        if (lpCtx == NULL)
+        {
+            return NULL;
+        }
+        aParams[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)(aDigestNames[nIndex].szNameA),
+                                                      0);
+        aParams[1] = OSSL_PARAM_construct_end();
+        if (EVP_MAC_CTX_set_params(lpCtx, aParams) <= 0)
+        {
+            EVP_MAC_CTX_free(lpCtx);
+            return NULL;
+        }
+        lpPrevCtx = (EVP_MAC_CTX *)_InterlockedCompareExchangePointer((PVOID volatile *)&aHmacTemplates[nIndex], lpCtx,
+                                                                      NULL);
+        if (lpPrevCtx != NULL)
+        {
+            // another thread won the race
+            EVP_MAC_CTX_free(lpCtx);
+            lpCtx = lpPrevCtx;
+        }
+    }
+    return lpCtx;
+}
+
+// NOTE: Each thread starts probing at a slot derived from its id so concurrent threads usually touch different
+//       cache lines and, most of the time, get back the same context they released.
+static LPVOID PopFromPool(_In_ LPVOID volatile *lpSlots, _In_ SIZE_T nCount)
+{
+    SIZE_T nStart = (SIZE_T)(::GetCurrentThreadId() >> 2);
+    LPVOID lpItem;
+
+    for (SIZE_T i = 0; i < nCount; i++)
+    {
+        LPVOID volatile *lpSlot = &lpSlots[(nStart + i) % nCount];
+
+        if (__InterlockedReadPointer(lpSlot) != NULL)
+        {
+            lpItem = _InterlockedExchangePointer((PVOID volatile *)lpSlot, NULL);
+            if (lpItem != NULL)
+            {
+                return lpItem;
+            }
+        }
+    }
+    return NULL;
+}
+
+static BOOL PushToPool(_In_ LPVOID volatile *lpSlots, _In_ SIZE_T nCount, _In_ LPVOID lpItem)
+{
+    SIZE_T nStart = (SIZE_T)(::GetCurrentThreadId() >> 2);
+
+    for (SIZE_T i = 0; i < nCount; i++)
+    {
+        LPVOID volatile *lpSlot = &lpSlots[(nStart + i) % nCount];
+
+        if (__InterlockedReadPointer(lpSlot) == NULL &&
+            _InterlockedCompareExchangePointer((PVOID volatile *)lpSlot, lpItem, NULL) == NULL)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
@@ -0,0 +1,56 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_OPENSSL_DIGEST_CACHE_H
+#define _MX_OPENSSL_DIGEST_CACHE_H
+
+#include "InitOpenSSL.h"
+#include "..\..\Include\Crypto\MessageDigest.h"
+#include <OpenSSL\evp.h>
+
+ //-----------------------------------------------------------
+
+namespace MX {
+
+namespace Internals {
+
+namespace OpenSSL {
+
+// NOTE: Returned digest handles are owned by the cache and must not be freed. CRC algorithms are not OpenSSL based
+//       and always return NULL.
+const EVP_MD *GetCachedDigest(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm);
+
+// NOTE: Digest contexts are kept in a small lock-free pool. Hmac contexts are fresh copies of a per-algorithm
+//       template that already has the digest set, so they only need EVP_MAC_init with the key.
+EVP_MD_CTX *AcquireDigestContext();
+VOID ReleaseDigestContext(_In_ EVP_MD_CTX *lpCtx);
+EVP_MAC_CTX *AcquireHmacContext(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm);
+VOID ReleaseHmacContext(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm, _In_ EVP_MAC_CTX *lpCtx);
+
+VOID FinalizeDigestCache();
+
+} // namespace OpenSSL
+
+} // namespace Internals
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_OPENSSL_DIGEST_CACHE_H
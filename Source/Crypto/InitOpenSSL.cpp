@@ -27,7 +27,7 @@
 #include <OpenSSL\conf.h>
 #include <OpenSSL\pkcs12err.h>
 #include <corecrt_share.h>
-#include "CRC32_Provider.h"
+#include "DigestCache.h"
 #include "SecureBuffer_BIO.h"
 
 #pragma comment(lib, "openssl_libssl.lib")
@@ -309,14 +309,6 @@ static HRESULT _OpenSSL_Init()
             }
             ERR_clear_error();
 
-            // register our custom crc32 provider
-            hRes = MX::Internals::OpenSSL::InitializeCRC32Provider();
-            if (FAILED(hRes))
-            {
-                OpenSSL_Shutdown();
-                return hRes;
-            }
-
             // create secure buffer BIO
             hRes = MX::Internals::OpenSSL::InitializeSecureBufferBIO();
             if (FAILED(hRes))
@@ -347,7 +339,7 @@ static HRESULT _OpenSSL_Init()
 static VOID OpenSSL_Shutdown()
 {
     MX::Internals::OpenSSL::FinalizeSecureBufferBIO();
-    MX::Internals::OpenSSL::FinalizeCRC32Provider();
+    MX::Internals::OpenSSL::FinalizeDigestCache();
     for (SIZE_T i = 0; i < MX_ARRAYLEN(lpSslContexts); i++)
     {
         if (lpSslContexts[i] != NULL)
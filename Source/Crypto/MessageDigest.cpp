@@ -20,7 +20,9 @@
 #include "..\..\Include\Crypto\MessageDigest.h"
 #include "..\..\Include\AtomicOps.h"
 #include "..\..\Include\Strings\Strings.h"
+#include "..\..\Include\Crc32.h"
 #include "InitOpenSSL.h"
+#include "DigestCache.h"
 #include <OpenSSL\evp.h>
 #include <OpenSSL\core_names.h>
 
@@ -31,14 +33,19 @@
 typedef struct tagMD_DATA
 {
     EVP_MD_CTX *lpMdCtx;
-    EVP_MD *lpMd;
-    EVP_PKEY *lpKey;
+    EVP_MAC_CTX *lpMacCtx;
+    MX::CMessageDigest::eAlgorithm nAlgorithm;
+    BOOL bCrcInUse;
+    ULONG nCrc;
     BYTE aOutput[64];
     SIZE_T nOutputSize;
 } MD_DATA, *LPMD_DATA;
 
 #define md_data ((LPMD_DATA)lpInternalData)
 
+#define IS_CRC_ALGORITHM(_alg) \
+    ((_alg) == MX::CMessageDigest::eAlgorithm::CRC32 || (_alg) == MX::CMessageDigest::eAlgorithm::CRC32C)
+
 //-------------------------------------------------------
 
 namespace MX {
@@ -78,6 +85,7 @@ HRESULT CMessageDigest::BeginDigest(_In_z_ LPCSTR szAlgorithmA, _In_opt_ LPCVOID
 
 HRESULT CMessageDigest::BeginDigest(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm, _In_opt_ LPCVOID lpKey, _In_opt_ SIZE_T nKeyLen)
 {
+    const EVP_MD *lpMd;
     int ret;
     HRESULT hRes;
 
@@ -89,16 +97,11 @@ HRESULT CMessageDigest::BeginDigest(_In_ MX::CMessageDigest::eAlgorithm nAlgorit
     {
         return E_INVALIDARG;
     }
-    if (nKeyLen > 0 && nAlgorithm == MX::CMessageDigest::eAlgorithm::CRC32)
+    if (nKeyLen > 0 && IS_CRC_ALGORITHM(nAlgorithm))
     {
         return MX_E_Unsupported;
     }
 
-    hRes = Internals::OpenSSL::Init();
-    if (FAILED(hRes))
-    {
-        return hRes;
-    }
     if (lpInternalData == NULL)
     {
         lpInternalData = MX_MALLOC(sizeof(MD_DATA));
@@ -110,115 +113,59 @@ HRESULT CMessageDigest::BeginDigest(_In_ MX::CMessageDigest::eAlgorithm nAlgorit
     }
     CleanUp(TRUE);
 
-    // create context
-    md_data->lpMdCtx = EVP_MD_CTX_new();
-    if (md_data->lpMdCtx == NULL)
+    // crc algorithms are computed natively
+    if (IS_CRC_ALGORITHM(nAlgorithm))
     {
-        CleanUp(TRUE);
-        return E_OUTOFMEMORY;
+        md_data->nAlgorithm = nAlgorithm;
+        md_data->nCrc = 0;
+        md_data->bCrcInUse = TRUE;
+        return S_OK;
     }
 
-    // get digest manager
-    ERR_clear_error();
-    switch (nAlgorithm)
+    hRes = Internals::OpenSSL::Init();
+    if (FAILED(hRes))
     {
-        case MX::CMessageDigest::eAlgorithm::CRC32:
-            md_data->lpMd = EVP_MD_fetch(NULL, "CRC32", "provider=mxlib");
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::MD5:
-            md_data->lpMd = EVP_MD_fetch(NULL, "MD5", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::MD4:
-            md_data->lpMd = EVP_MD_fetch(NULL, "MD4", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA1:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA1", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA224:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA224", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA256:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA256", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA384:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA384", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA512:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA512", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA512_224:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA512-224", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA512_256:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA512-256", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA3_224:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA3-224", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA3_256:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA3-256", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA3_384:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA3-384", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::SHA3_512:
-            md_data->lpMd = EVP_MD_fetch(NULL, "SHA3-512", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::Blake2s_256:
-            md_data->lpMd = EVP_MD_fetch(NULL, "BLAKE2s256", NULL);
-            break;
-
-        case MX::CMessageDigest::eAlgorithm::Blake2b_512:
-            md_data->lpMd = EVP_MD_fetch(NULL, "BLAKE2b512", NULL);
-            break;
+        return hRes;
+    }
 
-        default:
-            CleanUp(TRUE);
-            return E_INVALIDARG;
+    // get cached digest manager
+    if ((SIZE_T)nAlgorithm > (SIZE_T)(MX::CMessageDigest::eAlgorithm::Blake2b_512))
+    {
+        return E_INVALIDARG;
     }
-    if (md_data->lpMd == NULL)
+    ERR_clear_error();
+    lpMd = Internals::OpenSSL::GetCachedDigest(nAlgorithm);
+    if (lpMd == NULL)
     {
-        hRes = MX::Internals::OpenSSL::GetLastErrorCode(E_NOTIMPL);
-        CleanUp(TRUE);
-        return hRes;
+        return MX::Internals::OpenSSL::GetLastErrorCode(E_NOTIMPL);
     }
+    md_data->nAlgorithm = nAlgorithm;
 
-    // create key if needed
-    if (nKeyLen > 0)
+    // initialize
+    if (nKeyLen == 0)
     {
-        md_data->lpKey = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, (const unsigned char *)lpKey, (int)nKeyLen);
-        if (md_data->lpKey == NULL)
+        md_data->lpMdCtx = Internals::OpenSSL::AcquireDigestContext();
+        if (md_data->lpMdCtx == NULL)
         {
-            CleanUp(TRUE);
             return E_OUTOFMEMORY;
         }
+        ret = EVP_DigestInit_ex(md_data->lpMdCtx, lpMd, NULL);
     }
-    // initialize
-    if (md_data->lpMd != (EVP_MD *)1)
+    else
     {
-        ret = (md_data->lpKey == NULL)
-            ? EVP_DigestInit_ex(md_data->lpMdCtx, md_data->lpMd, NULL)
-            : EVP_DigestSignInit(md_data->lpMdCtx, NULL, md_data->lpMd, NULL, md_data->lpKey);
-        if (ret <= 0)
+        md_data->lpMacCtx = Internals::OpenSSL::AcquireHmacContext(nAlgorithm);
+        if (md_data->lpMacCtx == NULL)
         {
-            CleanUp(TRUE);
-            return E_OUTOFMEMORY;
+            return MX::Internals::OpenSSL::GetLastErrorCode(E_OUTOFMEMORY);
         }
+        ret = EVP_MAC_init(md_data->lpMacCtx, (const unsigned char *)lpKey, nKeyLen, NULL);
     }
+    if (ret <= 0)
+    {
+        CleanUp(TRUE);
+        return E_OUTOFMEMORY;
+    }
+
     // done
     return S_OK;
 }
@@ -231,11 +178,19 @@ HRESULT CMessageDigest::DigestStream(_In_ LPCVOID lpData, _In_ SIZE_T nDataLengt
     {
         return E_POINTER;
     }
-    if (lpInternalData == NULL || md_data->lpMdCtx == NULL)
+    if (lpInternalData == NULL || (md_data->lpMdCtx == NULL && md_data->lpMacCtx == NULL &&
+                                   md_data->bCrcInUse == FALSE))
     {
         return MX_E_NotReady;
     }
-    ret = EVP_DigestUpdate(md_data->lpMdCtx, lpData, nDataLength); // NOTE: EVP_DigestSignUpdate == EVP_DigestUpdate
+    if (md_data->bCrcInUse != FALSE)
+    {
+        md_data->nCrc = (md_data->nAlgorithm == MX::CMessageDigest::eAlgorithm::CRC32)
+                      ? Crc32(md_data->nCrc, lpData, nDataLength) : Crc32C(md_data->nCrc, lpData, nDataLength);
+        return S_OK;
+    }
+    ret = (md_data->lpMacCtx == NULL) ? EVP_DigestUpdate(md_data->lpMdCtx, lpData, nDataLength)
+                                      : EVP_MAC_update(md_data->lpMacCtx, (const unsigned char *)lpData, nDataLength);
     return (ret > 0) ? S_OK : E_FAIL;
 }
 
@@ -342,12 +297,19 @@ HRESULT CMessageDigest::EndDigest()
     };
     int ret;
 
-    if (lpInternalData == NULL || md_data->lpMdCtx == NULL)
+    if (lpInternalData == NULL || (md_data->lpMdCtx == NULL && md_data->lpMacCtx == NULL &&
+                                   md_data->bCrcInUse == FALSE))
     {
         return MX_E_NotReady;
     }
 
-    if (md_data->lpKey == NULL)
+    if (md_data->bCrcInUse != FALSE)
+    {
+        *((LPDWORD)(md_data->aOutput)) = md_data->nCrc;
+        md_data->nOutputSize = sizeof(DWORD);
+        ret = 1;
+    }
+    else if (md_data->lpMacCtx == NULL)
     {
         ret = EVP_DigestFinal_ex(md_data->lpMdCtx, md_data->aOutput, &nOutputSizeUI);
         if (ret > 0)
@@ -357,7 +319,7 @@ HRESULT CMessageDigest::EndDigest()
     }
     else
     {
-        ret = EVP_DigestSignFinal(md_data->lpMdCtx, md_data->aOutput, &nOutputSizeST);
+        ret = EVP_MAC_final(md_data->lpMacCtx, md_data->aOutput, &nOutputSizeST, sizeof(md_data->aOutput));
         if (ret > 0)
         {
             md_data->nOutputSize = nOutputSizeST;
@@ -392,6 +354,10 @@ MX::CMessageDigest::eAlgorithm CMessageDigest::GetAlgorithm(_In_z_ LPCSTR szAlgo
     {
         return MX::CMessageDigest::eAlgorithm::CRC32;
     }
+    else if (StrCompareA(szAlgorithmA, "crc32c", TRUE) == 0)
+    {
+        return MX::CMessageDigest::eAlgorithm::CRC32C;
+    }
     else if (StrNCompareA(szAlgorithmA, "md", 2, TRUE) == 0)
     {
         szAlgorithmA += 2;
@@ -474,25 +440,202 @@ MX::CMessageDigest::eAlgorithm CMessageDigest::GetAlgorithm(_In_z_ LPCSTR szAlgo
     return MX::CMessageDigest::eAlgorithm::Invalid;
 }
 
+SIZE_T CMessageDigest::GetDigestSize(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm)
+{
+    const EVP_MD *lpMd;
+    int nSize;
+
+    if (IS_CRC_ALGORITHM(nAlgorithm))
+    {
+        return sizeof(DWORD);
+    }
+    if ((SIZE_T)nAlgorithm > (SIZE_T)(MX::CMessageDigest::eAlgorithm::Blake2b_512))
+    {
+        return 0;
+    }
+    if (FAILED(Internals::OpenSSL::Init()))
+    {
+        return 0;
+    }
+    lpMd = Internals::OpenSSL::GetCachedDigest(nAlgorithm);
+    if (lpMd == NULL)
+    {
+        return 0;
+    }
+    nSize = EVP_MD_get_size(lpMd);
+    return (nSize > 0) ? (SIZE_T)nSize : 0;
+}
+
+HRESULT CMessageDigest::Hash(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCVOID lpData, _In_ SIZE_T nDataLength,
+                             _Out_writes_bytes_(nOutputSize) LPVOID lpOutput, _In_ SIZE_T nOutputSize,
+                             _Out_opt_ SIZE_T *lpnResultSize)
+{
+    const EVP_MD *lpMd;
+    EVP_MD_CTX *lpCtx;
+    unsigned int nResultSize;
+    int ret;
+    HRESULT hRes;
+
+    if (lpnResultSize != NULL)
+    {
+        *lpnResultSize = 0;
+    }
+    if ((lpData == NULL && nDataLength > 0) || lpOutput == NULL)
+    {
+        return E_POINTER;
+    }
+    if (IS_CRC_ALGORITHM(nAlgorithm))
+    {
+        if (nOutputSize < sizeof(DWORD))
+        {
+            return MX_E_BufferOverflow;
+        }
+        *((LPDWORD)lpOutput) = (nAlgorithm == MX::CMessageDigest::eAlgorithm::CRC32) ? Crc32(0, lpData, nDataLength)
+                                                                                    : Crc32C(0, lpData, nDataLength);
+        if (lpnResultSize != NULL)
+        {
+            *lpnResultSize = sizeof(DWORD);
+        }
+        return S_OK;
+    }
+    if ((SIZE_T)nAlgorithm > (SIZE_T)(MX::CMessageDigest::eAlgorithm::Blake2b_512))
+    {
+        return E_INVALIDARG;
+    }
+
+    hRes = Internals::OpenSSL::Init();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    ERR_clear_error();
+    lpMd = Internals::OpenSSL::GetCachedDigest(nAlgorithm);
+    if (lpMd == NULL)
+    {
+        return MX::Internals::OpenSSL::GetLastErrorCode(E_NOTIMPL);
+    }
+    if (nOutputSize < (SIZE_T)EVP_MD_get_size(lpMd))
+    {
+        return MX_E_BufferOverflow;
+    }
+
+    lpCtx = Internals::OpenSSL::AcquireDigestContext();
+    if (lpCtx == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    ret = EVP_DigestInit_ex(lpCtx, lpMd, NULL);
+    if (ret > 0)
+    {
+        ret = EVP_DigestUpdate(lpCtx, lpData, nDataLength);
+    }
+    if (ret > 0)
+    {
+        ret = EVP_DigestFinal_ex(lpCtx, (unsigned char *)lpOutput, &nResultSize);
+    }
+    Internals::OpenSSL::ReleaseDigestContext(lpCtx);
+    if (ret <= 0)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    if (lpnResultSize != NULL)
+    {
+        *lpnResultSize = (SIZE_T)nResultSize;
+    }
+    return S_OK;
+}
+
+HRESULT CMessageDigest::Hmac(_In_ MX::CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCVOID lpKey, _In_ SIZE_T nKeyLen,
+                             _In_ LPCVOID lpData, _In_ SIZE_T nDataLength, _Out_writes_bytes_(nOutputSize) LPVOID lpOutput,
+                             _In_ SIZE_T nOutputSize, _Out_opt_ SIZE_T *lpnResultSize)
+{
+    static const BYTE aEmptyKey[1] = { 0 };
+    const EVP_MD *lpMd;
+    EVP_MAC_CTX *lpCtx;
+    size_t nResultSize;
+    int ret;
+    HRESULT hRes;
+
+    if (lpnResultSize != NULL)
+    {
+        *lpnResultSize = 0;
+    }
+    if ((lpKey == NULL && nKeyLen > 0) || (lpData == NULL && nDataLength > 0) || lpOutput == NULL)
+    {
+        return E_POINTER;
+    }
+    if (IS_CRC_ALGORITHM(nAlgorithm))
+    {
+        return MX_E_Unsupported;
+    }
+    if ((SIZE_T)nAlgorithm > (SIZE_T)(MX::CMessageDigest::eAlgorithm::Blake2b_512))
+    {
+        return E_INVALIDARG;
+    }
+
+    hRes = Internals::OpenSSL::Init();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    ERR_clear_error();
+    lpMd = Internals::OpenSSL::GetCachedDigest(nAlgorithm);
+    if (lpMd == NULL)
+    {
+        return MX::Internals::OpenSSL::GetLastErrorCode(E_NOTIMPL);
+    }
+    if (nOutputSize < (SIZE_T)EVP_MD_get_size(lpMd))
+    {
+        return MX_E_BufferOverflow;
+    }
+
+    lpCtx = Internals::OpenSSL::AcquireHmacContext(nAlgorithm);
+    if (lpCtx == NULL)
+    {
+        return MX::Internals::OpenSSL::GetLastErrorCode(E_OUTOFMEMORY);
+    }
+    // NOTE: The context was never keyed so EVP_MAC_init needs a non-NULL key even when it is empty.
+    ret = EVP_MAC_init(lpCtx, (nKeyLen > 0) ? (const unsigned char *)lpKey : aEmptyKey, nKeyLen, NULL);
+    if (ret > 0)
+    {
+        ret = EVP_MAC_update(lpCtx, (const unsigned char *)lpData, nDataLength);
+    }
+    if (ret > 0)
+    {
+        ret = EVP_MAC_final(lpCtx, (unsigned char *)lpOutput, &nResultSize, nOutputSize);
+    }
+    Internals::OpenSSL::ReleaseHmacContext(nAlgorithm, lpCtx);
+    if (ret <= 0)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    if (lpnResultSize != NULL)
+    {
+        *lpnResultSize = nResultSize;
+    }
+    return S_OK;
+}
+
 VOID CMessageDigest::CleanUp(_In_ BOOL bZeroData)
 {
     if (md_data->lpMdCtx != NULL)
     {
-        EVP_MD_CTX_free(md_data->lpMdCtx);
+        Internals::OpenSSL::ReleaseDigestContext(md_data->lpMdCtx);
         md_data->lpMdCtx = NULL;
     }
     //----
-    if (md_data->lpMd != NULL)
-    {
-        EVP_MD_free(md_data->lpMd);
-        md_data->lpMd = NULL;
-    }
-    //----
-    if (md_data->lpKey != NULL)
+    if (md_data->lpMacCtx != NULL)
     {
-        EVP_PKEY_free(md_data->lpKey);
-        md_data->lpKey = NULL;
+        Internals::OpenSSL::ReleaseHmacContext(md_data->nAlgorithm, md_data->lpMacCtx);
+        md_data->lpMacCtx = NULL;
     }
+    md_data->bCrcInUse = FALSE;
     //----
     if (bZeroData != FALSE)
     {
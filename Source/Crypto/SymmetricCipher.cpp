@@ -26,6 +26,12 @@
 
 #define BLOCK_SIZE 2048
 
+// NOTE: OpenSSL takes int sized lengths
+#define AEAD_CHUNK_SIZE 0x40000000
+
+#define AEAD_MIN_TAG_SIZE 4
+#define AEAD_MAX_TAG_SIZE 16
+
 //-----------------------------------------------------------
 
 namespace MX {
@@ -79,6 +85,28 @@ public:
     CSymmetricCipherData() : CBaseMemObj()
     {
         lpCipher = NULL;
+        lpAeadEncryptCtx = lpAeadDecryptCtx = NULL;
+        return;
+    };
+
+    ~CSymmetricCipherData()
+    {
+        ResetAead();
+        return;
+    };
+
+    VOID ResetAead()
+    {
+        if (lpAeadEncryptCtx != NULL)
+        {
+            EVP_CIPHER_CTX_free(lpAeadEncryptCtx);
+            lpAeadEncryptCtx = NULL;
+        }
+        if (lpAeadDecryptCtx != NULL)
+        {
+            EVP_CIPHER_CTX_free(lpAeadDecryptCtx);
+            lpAeadDecryptCtx = NULL;
+        }
         return;
     };
 
@@ -91,6 +119,11 @@ public:
     EVP_CIPHER *lpCipher;
     CSymmetricCipherEncoderDecoder cEncryptor;
     CSymmetricCipherEncoderDecoder cDecryptor;
+    // NOTE: Keyed once by SetAeadKey and shared by every AeadEncrypt/AeadDecrypt call, so an object must not be
+    //       used from more than one thread at a time.
+    EVP_CIPHER_CTX *lpAeadEncryptCtx;
+    EVP_CIPHER_CTX *lpAeadDecryptCtx;
+    SIZE_T nAeadEncryptNonceLen{ 0 }, nAeadDecryptNonceLen{ 0 };
 };
 
 } // namespace Internals
@@ -102,6 +135,10 @@ public:
 //-----------------------------------------------------------
 
 static const EVP_CIPHER *GetCipher(_In_ MX::CSymmetricCipher::eAlgorithm nAlgorithm);
+static HRESULT AeadProcess(_In_ EVP_CIPHER_CTX *lpCtx, _In_ BOOL bEncrypt, _Inout_ SIZE_T &nCurrentNonceLen,
+                           _In_ LPCVOID lpNonce, _In_ SIZE_T nNonceLen, _In_opt_ LPCVOID lpAad, _In_ SIZE_T nAadLen,
+                           _In_ LPCVOID lpInput, _In_ SIZE_T nLength, _Out_writes_bytes_(nLength) LPVOID lpOutput,
+                           _Inout_updates_bytes_(nTagLen) LPVOID lpTag, _In_ SIZE_T nTagLen);
 
 //-----------------------------------------------------------
 
@@ -149,6 +186,7 @@ HRESULT CSymmetricCipher::SetAlgorithm(_In_ MX::CSymmetricCipher::eAlgorithm nAl
     }
 
     // change
+    symcipher_data->ResetAead();
     if (symcipher_data->lpCipher != NULL)
     {
         EVP_CIPHER_free(symcipher_data->lpCipher);
@@ -460,6 +498,80 @@ SIZE_T CSymmetricCipher::GetDecryptedData(_Out_writes_(nDestSize) LPVOID lpDest,
     return symcipher_data->cDecryptor.cOutputBuffer->Read(lpDest, nDestSize);
 }
 
+HRESULT CSymmetricCipher::SetAeadKey(_In_ LPCVOID lpKey, _In_ SIZE_T nKeyLen)
+{
+    Internals::CSymmetricCipherData *lpData;
+    HRESULT hRes;
+
+    if (lpKey == NULL)
+    {
+        return E_POINTER;
+    }
+    if (lpInternalData == NULL || symcipher_data->lpCipher == NULL)
+    {
+        return MX_E_NotReady;
+    }
+    lpData = symcipher_data;
+    if ((EVP_CIPHER_get_flags(lpData->lpCipher) & EVP_CIPH_FLAG_AEAD_CIPHER) == 0)
+    {
+        return MX_E_Unsupported;
+    }
+    if (nKeyLen != (SIZE_T)EVP_CIPHER_get_key_length(lpData->lpCipher))
+    {
+        return E_INVALIDARG;
+    }
+
+    lpData->ResetAead();
+    lpData->lpAeadEncryptCtx = EVP_CIPHER_CTX_new();
+    lpData->lpAeadDecryptCtx = EVP_CIPHER_CTX_new();
+    if (lpData->lpAeadEncryptCtx == NULL || lpData->lpAeadDecryptCtx == NULL)
+    {
+        lpData->ResetAead();
+        return E_OUTOFMEMORY;
+    }
+
+    // expand the key once, each message only sets its nonce
+    ERR_clear_error();
+    if (EVP_EncryptInit_ex(lpData->lpAeadEncryptCtx, lpData->lpCipher, NULL, (const unsigned char *)lpKey, NULL) <= 0 ||
+        EVP_DecryptInit_ex(lpData->lpAeadDecryptCtx, lpData->lpCipher, NULL, (const unsigned char *)lpKey, NULL) <= 0)
+    {
+        hRes = Internals::OpenSSL::GetLastErrorCode(MX_E_InvalidData);
+        lpData->ResetAead();
+        return hRes;
+    }
+    lpData->nAeadEncryptNonceLen = lpData->nAeadDecryptNonceLen =
+        (SIZE_T)EVP_CIPHER_get_iv_length(lpData->lpCipher);
+
+    // done
+    return S_OK;
+}
+
+HRESULT CSymmetricCipher::AeadEncrypt(_In_ LPCVOID lpNonce, _In_ SIZE_T nNonceLen, _In_opt_ LPCVOID lpAad,
+                                      _In_ SIZE_T nAadLen, _In_ LPCVOID lpPlainText, _In_ SIZE_T nLength,
+                                      _Out_writes_bytes_(nLength) LPVOID lpCipherText,
+                                      _Out_writes_bytes_(nTagLen) LPVOID lpTag, _In_opt_ SIZE_T nTagLen)
+{
+    if (lpInternalData == NULL || symcipher_data->lpAeadEncryptCtx == NULL)
+    {
+        return MX_E_NotReady;
+    }
+    return AeadProcess(symcipher_data->lpAeadEncryptCtx, TRUE, symcipher_data->nAeadEncryptNonceLen, lpNonce,
+                       nNonceLen, lpAad, nAadLen, lpPlainText, nLength, lpCipherText, lpTag, nTagLen);
+}
+
+HRESULT CSymmetricCipher::AeadDecrypt(_In_ LPCVOID lpNonce, _In_ SIZE_T nNonceLen, _In_opt_ LPCVOID lpAad,
+                                      _In_ SIZE_T nAadLen, _In_ LPCVOID lpCipherText, _In_ SIZE_T nLength,
+                                      _Out_writes_bytes_(nLength) LPVOID lpPlainText,
+                                      _In_reads_bytes_(nTagLen) LPCVOID lpTag, _In_opt_ SIZE_T nTagLen)
+{
+    if (lpInternalData == NULL || symcipher_data->lpAeadDecryptCtx == NULL)
+    {
+        return MX_E_NotReady;
+    }
+    return AeadProcess(symcipher_data->lpAeadDecryptCtx, FALSE, symcipher_data->nAeadDecryptNonceLen, lpNonce,
+                       nNonceLen, lpAad, nAadLen, lpCipherText, nLength, lpPlainText, (LPVOID)lpTag, nTagLen);
+}
+
 HRESULT CSymmetricCipher::InternalInitialize()
 {
     HRESULT hRes;
@@ -572,6 +684,103 @@ static const EVP_CIPHER *GetCipher(_In_ MX::CSymmetricCipher::eAlgorithm nAlgori
             return EVP_CIPHER_fetch(NULL, "AES-256-CFB8", NULL);
         case MX::CSymmetricCipher::eAlgorithm::AES_256_CFB128:
             return EVP_CIPHER_fetch(NULL, "AES-256-CFB", NULL);
+
+        case MX::CSymmetricCipher::eAlgorithm::ChaCha20_Poly1305:
+            return EVP_CIPHER_fetch(NULL, "ChaCha20-Poly1305", NULL);
     }
     return NULL;
 }
+
+static HRESULT AeadProcess(_In_ EVP_CIPHER_CTX *lpCtx, _In_ BOOL bEncrypt, _Inout_ SIZE_T &nCurrentNonceLen,
+                           _In_ LPCVOID lpNonce, _In_ SIZE_T nNonceLen, _In_opt_ LPCVOID lpAad, _In_ SIZE_T nAadLen,
+                           _In_ LPCVOID lpInput, _In_ SIZE_T nLength, _Out_writes_bytes_(nLength) LPVOID lpOutput,
+                           _Inout_updates_bytes_(nTagLen) LPVOID lpTag, _In_ SIZE_T nTagLen)
+{
+    const unsigned char *lpIn;
+    unsigned char *lpOut;
+    SIZE_T nChunk, nRemaining;
+    int nOutSize;
+
+    if (lpNonce == NULL || (lpAad == NULL && nAadLen > 0) || ((lpInput == NULL || lpOutput == NULL) && nLength > 0) ||
+        lpTag == NULL)
+    {
+        return E_POINTER;
+    }
+    if (nNonceLen == 0 || nNonceLen > EVP_MAX_IV_LENGTH || nTagLen < AEAD_MIN_TAG_SIZE || nTagLen > AEAD_MAX_TAG_SIZE)
+    {
+        return E_INVALIDARG;
+    }
+
+    ERR_clear_error();
+
+    // the nonce length only needs to be set when it changes
+    if (nNonceLen != nCurrentNonceLen)
+    {
+        if (EVP_CIPHER_CTX_ctrl(lpCtx, EVP_CTRL_AEAD_SET_IVLEN, (int)nNonceLen, NULL) <= 0)
+        {
+            return MX::Internals::OpenSSL::GetLastErrorCode(E_INVALIDARG);
+        }
+        nCurrentNonceLen = nNonceLen;
+    }
+
+    // NULL cipher and key keep the expanded key, only the nonce is set
+    if (EVP_CipherInit_ex(lpCtx, NULL, NULL, NULL, (const unsigned char *)lpNonce, (bEncrypt != FALSE) ? 1 : 0) <= 0)
+    {
+        return MX::Internals::OpenSSL::GetLastErrorCode(MX_E_InvalidData);
+    }
+
+    // additional authenticated data
+    lpIn = (const unsigned char *)lpAad;
+    for (nRemaining = nAadLen; nRemaining > 0; nRemaining -= nChunk, lpIn += nChunk)
+    {
+        nChunk = (nRemaining > AEAD_CHUNK_SIZE) ? AEAD_CHUNK_SIZE : nRemaining;
+        if (EVP_CipherUpdate(lpCtx, NULL, &nOutSize, lpIn, (int)nChunk) <= 0)
+        {
+            return MX_E_InvalidData;
+        }
+    }
+
+    // payload, stream modes output exactly as many bytes as they get so in-place works
+    lpIn = (const unsigned char *)lpInput;
+    lpOut = (unsigned char *)lpOutput;
+    for (nRemaining = nLength; nRemaining > 0; nRemaining -= nChunk, lpIn += nChunk, lpOut += nChunk)
+    {
+        nChunk = (nRemaining > AEAD_CHUNK_SIZE) ? AEAD_CHUNK_SIZE : nRemaining;
+        if (EVP_CipherUpdate(lpCtx, lpOut, &nOutSize, lpIn, (int)nChunk) <= 0)
+        {
+            if (bEncrypt == FALSE)
+            {
+                // part of the output may already hold unauthenticated plaintext
+                MxMemSet(lpOutput, 0, nLength);
+            }
+            ERR_clear_error();
+            return MX_E_InvalidData;
+        }
+    }
+
+    if (bEncrypt != FALSE)
+    {
+        if (EVP_CipherFinal_ex(lpCtx, lpOut, &nOutSize) <= 0 ||
+            EVP_CIPHER_CTX_ctrl(lpCtx, EVP_CTRL_AEAD_GET_TAG, (int)nTagLen, lpTag) <= 0)
+        {
+            return MX::Internals::OpenSSL::GetLastErrorCode(MX_E_InvalidData);
+        }
+    }
+    else
+    {
+        if (EVP_CIPHER_CTX_ctrl(lpCtx, EVP_CTRL_AEAD_SET_TAG, (int)nTagLen, lpTag) <= 0 ||
+            EVP_CipherFinal_ex(lpCtx, lpOut, &nOutSize) <= 0)
+        {
+            // never hand out unauthenticated plaintext
+            if (nLength > 0)
+            {
+                MxMemSet(lpOutput, 0, nLength);
+            }
+            ERR_clear_error();
+            return MX_E_InvalidData;
+        }
+    }
+
+    // done
+    return S_OK;
+}
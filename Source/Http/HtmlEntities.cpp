@@ -19,7 +19,7 @@
  */
 #include "..\..\Include\Http\HtmlEntities.h"
 #include "..\..\Include\Strings\Utf8.h"
-#include <search.h>
+#include "PerfectHash.h"
 
  //-----------------------------------------------------------
 
@@ -31,265 +31,11 @@ typedef struct
 
 //-----------------------------------------------------------
 
-static HTMLENTITY_DEF aHtmlEntities[] = {
-    {"quot",34},
-    {"amp",38},
-    {"apos",39},
-    {"lt",60},
-    {"gt",62},
-    {"nbsp",160},
-    {"iexcl",161},
-    {"cent",162},
-    {"pound",163},
-    {"curren",164},
-    {"yen",165},
-    {"brvbar",166},
-    {"sect",167},
-    {"uml",168},
-    {"copy",169},
-    {"ordf",170},
-    {"laquo",171},
-    {"not",172},
-    {"shy",173},
-    {"reg",174},
-    {"macr",175},
-    {"deg",176},
-    {"plusmn",177},
-    {"sup2",178},
-    {"sup3",179},
-    {"acute",180},
-    {"micro",181},
-    {"para",182},
-    {"middot",183},
-    {"cedil",184},
-    {"sup1",185},
-    {"ordm",186},
-    {"raquo",187},
-    {"frac14",188},
-    {"frac12",189},
-    {"frac34",190},
-    {"iquest",191},
-    {"Agrave",192},
-    {"Aacute",193},
-    {"Acirc",194},
-    {"Atilde",195},
-    {"Auml",196},
-    {"Aring",197},
-    {"AElig",198},
-    {"Ccedil",199},
-    {"Egrave",200},
-    {"Eacute",201},
-    {"Ecirc",202},
-    {"Euml",203},
-    {"Igrave",204},
-    {"Iacute",205},
-    {"Icirc",206},
-    {"Iuml",207},
-    {"ETH",208},
-    {"Ntilde",209},
-    {"Ograve",210},
-    {"Oacute",211},
-    {"Ocirc",212},
-    {"Otilde",213},
-    {"Ouml",214},
-    {"times",215},
-    {"Oslash",216},
-    {"Ugrave",217},
-    {"Uacute",218},
-    {"Ucirc",219},
-    {"Uuml",220},
-    {"Yacute",221},
-    {"THORN",222},
-    {"szlig",223},
-    {"agrave",224},
-    {"aacute",225},
-    {"acirc",226},
-    {"atilde",227},
-    {"auml",228},
-    {"aring",229},
-    {"aelig",230},
-    {"ccedil",231},
-    {"egrave",232},
-    {"eacute",233},
-    {"ecirc",234},
-    {"euml",235},
-    {"igrave",236},
-    {"iacute",237},
-    {"icirc",238},
-    {"iuml",239},
-    {"eth",240},
-    {"ntilde",241},
-    {"ograve",242},
-    {"oacute",243},
-    {"ocirc",244},
-    {"otilde",245},
-    {"ouml",246},
-    {"divide",247},
-    {"oslash",248},
-    {"ugrave",249},
-    {"uacute",250},
-    {"ucirc",251},
-    {"uuml",252},
-    {"yacute",253},
-    {"thorn",254},
-    {"yuml",255},
-    {"OElig",338},
-    {"oelig",339},
-    {"Scaron",352},
-    {"scaron",353},
-    {"Yuml",376},
-    {"fnof",402},
-    {"circ",710},
-    {"tilde",732},
-    {"Alpha",913},
-    {"Beta",914},
-    {"Gamma",915},
-    {"Delta",916},
-    {"Epsilon",917},
-    {"Zeta",918},
-    {"Eta",919},
-    {"Theta",920},
-    {"Iota",921},
-    {"Kappa",922},
-    {"Lambda",923},
-    {"Mu",924},
-    {"Nu",925},
-    {"Xi",926},
-    {"Omicron",927},
-    {"Pi",928},
-    {"Rho",929},
-    {"Sigma",931},
-    {"Tau",932},
-    {"Upsilon",933},
-    {"Phi",934},
-    {"Chi",935},
-    {"Psi",936},
-    {"Omega",937},
-    {"alpha",945},
-    {"beta",946},
-    {"gamma",947},
-    {"delta",948},
-    {"epsilon",949},
-    {"zeta",950},
-    {"eta",951},
-    {"theta",952},
-    {"iota",953},
-    {"kappa",954},
-    {"lambda",955},
-    {"mu",956},
-    {"nu",957},
-    {"xi",958},
-    {"omicron",959},
-    {"pi",960},
-    {"rho",961},
-    {"sigmaf",962},
-    {"sigma",963},
-    {"tau",964},
-    {"upsilon",965},
-    {"phi",966},
-    {"chi",967},
-    {"psi",968},
-    {"omega",969},
-    {"thetasym",977},
-    {"upsih",978},
-    {"piv",982},
-    {"ensp",8194},
-    {"emsp",8195},
-    {"thinsp",8201},
-    {"zwnj",8204},
-    {"zwj",8205},
-    {"lrm",8206},
-    {"rlm",8207},
-    {"ndash",8211},
-    {"mdash",8212},
-    {"lsquo",8216},
-    {"rsquo",8217},
-    {"sbquo",8218},
-    {"ldquo",8220},
-    {"rdquo",8221},
-    {"bdquo",8222},
-    {"dagger",8224},
-    {"Dagger",8225},
-    {"bull",8226},
-    {"hellip",8230},
-    {"permil",8240},
-    {"prime",8242},
-    {"Prime",8243},
-    {"lsaquo",8249},
-    {"rsaquo",8250},
-    {"oline",8254},
-    {"frasl",8260},
-    {"euro",8364},
-    {"image",8465},
-    {"weierp",8472},
-    {"real",8476},
-    {"trade",8482},
-    {"alefsym",8501},
-    {"larr",8592},
-    {"uarr",8593},
-    {"rarr",8594},
-    {"darr",8595},
-    {"harr",8596},
-    {"crarr",8629},
-    {"lArr",8656},
-    {"uArr",8657},
-    {"rArr",8658},
-    {"dArr",8659},
-    {"hArr",8660},
-    {"forall",8704},
-    {"part",8706},
-    {"exist",8707},
-    {"empty",8709},
-    {"nabla",8711},
-    {"isin",8712},
-    {"notin",8713},
-    {"ni",8715},
-    {"prod",8719},
-    {"sum",8721},
-    {"minus",8722},
-    {"lowast",8727},
-    {"radic",8730},
-    {"prop",8733},
-    {"infin",8734},
-    {"ang",8736},
-    {"and",8743},
-    {"or",8744},
-    {"cap",8745},
-    {"cup",8746},
-    {"int",8747},
-    {"there4",8756},
-    {"sim",8764},
-    {"cong",8773},
-    {"asymp",8776},
-    {"ne",8800},
-    {"equiv",8801},
-    {"le",8804},
-    {"ge",8805},
-    {"sub",8834},
-    {"sup",8835},
-    {"nsub",8836},
-    {"sube",8838},
-    {"supe",8839},
-    {"oplus",8853},
-    {"otimes",8855},
-    {"perp",8869},
-    {"sdot",8901},
-    {"lceil",8968},
-    {"rceil",8969},
-    {"lfloor",8970},
-    {"rfloor",8971},
-    {"lang",9001},
-    {"rang",9002},
-    {"loz",9674},
-    {"spades",9824},
-    {"clubs",9827},
-    {"hearts",9829},
-    {"diams",9830}
-};
+// NOTE: Generated at build time from HtmlEntities.phf. aHtmlEntitiesOrder lists the slots sorted by character code.
+#include <HtmlEntities.phf.h>
 
 //-----------------------------------------------------------
 
-static int HtmlEntities_Compare(void *, const void *key, const void *datum);
 static BOOL AddString(_Inout_ MX::CStringA &cStrA, _In_ LPCSTR szStartA, _In_ LPCSTR szCurrentA);
 static BOOL AddString(_Inout_ MX::CStringW &cStrW, _In_ LPCWSTR szStartW, _In_ LPCWSTR szCurrentW);
 
@@ -301,12 +47,26 @@ namespace HtmlEntities {
 
 LPCSTR Get(_In_ WCHAR chW)
 {
-    HTMLENTITY_DEF *lpDef;
+    SIZE_T nBase = 0;
+    SIZE_T n = HTMLENTITIES_COUNT;
 
-#pragma warning(suppress : 6387)
-    lpDef = (HTMLENTITY_DEF *)bsearch_s(&chW, aHtmlEntities, MX_ARRAYLEN(aHtmlEntities), sizeof(HTMLENTITY_DEF), &HtmlEntities_Compare,
-                                        NULL);
-    return (lpDef != NULL) ? lpDef->szNameA : NULL;
+    while (n > 0)
+    {
+        SIZE_T nMid = nBase + (n >> 1);
+        const HTMLENTITY_DEF *lpDef = &aHtmlEntities[aHtmlEntitiesOrder[nMid]];
+
+        if (chW == lpDef->chCharCodeW)
+        {
+            return lpDef->szNameA;
+        }
+        if (chW > lpDef->chCharCodeW)
+        {
+            nBase = nMid + 1;
+            n--;
+        }
+        n >>= 1;
+    }
+    return NULL;
 }
 
 HRESULT ConvertTo(_Out_ CStringA &cStrA, _In_ LPCSTR szStrA, _In_ SIZE_T nStrLen)
@@ -712,24 +472,25 @@ WCHAR Decode(_In_ LPCSTR szStrA, _In_ SIZE_T nStrLen, _Out_opt_ LPCSTR *lpszAfte
     }
     else
     {
-        LPCSTR sA;
-        SIZE_T i, j;
+        SIZE_T nNameLen, nSlot;
 
-        for (i = 0; i < MX_ARRAYLEN(aHtmlEntities); i++)
+        for (nNameLen = 0; nNameLen < nStrLen && nNameLen <= HTMLENTITIES_MAX_KEY_LENGTH; nNameLen++)
         {
-            sA = aHtmlEntities[i].szNameA;
-            for (j = 0; j < nStrLen && sA[j] != 0 && szStrA[j] == sA[j]; j++)
+            if (szStrA[nNameLen] == 0 || szStrA[nNameLen] == ';')
             {
-                ;
+                break;
             }
-
-            if (sA[j] == 0 && nStrLen - 1 > j && szStrA[j] == ';')
+        }
+        if (nNameLen > 0 && nNameLen < nStrLen && szStrA[nNameLen] == ';')
+        {
+            nSlot = PerfectHash::Lookup<CHAR>(aHtmlEntitiesDisplacements, HTMLENTITIES_COUNT, szStrA, nNameLen, FALSE);
+            if (StrNCompareA(aHtmlEntities[nSlot].szNameA, szStrA, nNameLen) == 0 && aHtmlEntities[nSlot].szNameA[nNameLen] == 0)
             {
                 if (lpszAfterEntityA != NULL)
                 {
-                    *lpszAfterEntityA = szStrA + (j + 1);
+                    *lpszAfterEntityA = szStrA + (nNameLen + 1);
                 }
-                return aHtmlEntities[i].chCharCodeW;
+                return aHtmlEntities[nSlot].chCharCodeW;
             }
         }
     }
@@ -823,24 +584,25 @@ WCHAR Decode(_In_ LPCWSTR szStrW, _In_ SIZE_T nStrLen, _Out_opt_ LPCWSTR *lpszAf
     }
     else
     {
-        LPCSTR sA;
-        SIZE_T i, j;
+        SIZE_T nNameLen, nSlot;
 
-        for (i = 0; i < MX_ARRAYLEN(aHtmlEntities); i++)
+        for (nNameLen = 0; nNameLen < nStrLen && nNameLen <= HTMLENTITIES_MAX_KEY_LENGTH; nNameLen++)
         {
-            sA = aHtmlEntities[i].szNameA;
-            for (j = 0; j < nStrLen && sA[j] != 0 && szStrW[j] == (WCHAR)((UCHAR)sA[j]); j++)
+            if (szStrW[nNameLen] == 0 || szStrW[nNameLen] == L';')
             {
-                ;
+                break;
             }
-
-            if (sA[j] == 0 && nStrLen - 1 > j && szStrW[j] == L';')
+        }
+        if (nNameLen > 0 && nNameLen < nStrLen && szStrW[nNameLen] == L';')
+        {
+            nSlot = PerfectHash::Lookup<WCHAR>(aHtmlEntitiesDisplacements, HTMLENTITIES_COUNT, szStrW, nNameLen, FALSE);
+            if (StrNCompareAW(aHtmlEntities[nSlot].szNameA, szStrW, nNameLen) == 0 && aHtmlEntities[nSlot].szNameA[nNameLen] == 0)
             {
                 if (lpszAfterEntityW != NULL)
                 {
-                    *lpszAfterEntityW = szStrW + (j + 1);
+                    *lpszAfterEntityW = szStrW + (nNameLen + 1);
                 }
-                return aHtmlEntities[i].chCharCodeW;
+                return aHtmlEntities[nSlot].chCharCodeW;
             }
         }
     }
@@ -855,19 +617,6 @@ WCHAR Decode(_In_ LPCWSTR szStrW, _In_ SIZE_T nStrLen, _Out_opt_ LPCWSTR *lpszAf
 
 //-----------------------------------------------------------
 
-static int HtmlEntities_Compare(void *, const void *key, const void *datum)
-{
-    if (*((WCHAR *)key) < ((HTMLENTITY_DEF *)datum)->chCharCodeW)
-    {
-        return -1;
-    }
-    if (*((WCHAR *)key) > ((HTMLENTITY_DEF *)datum)->chCharCodeW)
-    {
-        return 1;
-    }
-    return 0;
-}
-
 static BOOL AddString(_Inout_ MX::CStringA &cStrA, _In_ LPCSTR szStartA, _In_ LPCSTR szCurrentA)
 {
     if (szCurrentA > szStartA)
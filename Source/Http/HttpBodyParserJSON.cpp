@@ -22,11 +22,253 @@
 
  //-----------------------------------------------------------
 
+// NOTE: Same dialect the whole body was parsed with before.
+#define JSON_PARSE_FLAGS (rapidjson::kParseIterativeFlag | rapidjson::kParseValidateEncodingFlag |                \
+                          rapidjson::kParseNanAndInfFlag | rapidjson::kParseFullPrecisionFlag |                    \
+                          rapidjson::kParseTrailingCommasFlag | rapidjson::kParseEscapedApostropheFlag)
+
+#define IS_WHITESPACE(_x) ((_x) == ' ' || (_x) == '\t' || (_x) == '\r' || (_x) == '\n')
+
+//-----------------------------------------------------------
+
 namespace MX {
 
-CHttpBodyParserJSON::CHttpBodyParserJSON() : CHttpBodyParserBase()
+class CHttpBodyParserJSON::CReaderHandler
 {
+public:
+    CReaderHandler(_In_ CHttpBodyParserJSON *_lpParser)
+    {
+        lpParser = _lpParser;
+        return;
+    };
+
+    bool Null()
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Null();
+        }
+        sEvent.nType = eEventType::Null;
+        return Emit();
+    };
+
+    bool Bool(bool b)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Bool(b);
+        }
+        sEvent.nType = eEventType::Boolean;
+        sEvent.bValue = (b != false) ? TRUE : FALSE;
+        return Emit();
+    };
+
+    bool Int(int i)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Int(i);
+        }
+        sEvent.nType = eEventType::Integer;
+        sEvent.llValue = (LONGLONG)i;
+        return Emit();
+    };
+
+    bool Uint(unsigned u)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Uint(u);
+        }
+        sEvent.nType = eEventType::Integer;
+        sEvent.llValue = (LONGLONG)u;
+        return Emit();
+    };
+
+    bool Int64(int64_t i)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Int64(i);
+        }
+        sEvent.nType = eEventType::Integer;
+        sEvent.llValue = (LONGLONG)i;
+        return Emit();
+    };
+
+    bool Uint64(uint64_t u)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Uint64(u);
+        }
+        if (u <= 0x7FFFFFFFFFFFFFFFui64)
+        {
+            sEvent.nType = eEventType::Integer;
+            sEvent.llValue = (LONGLONG)u;
+        }
+        else
+        {
+            sEvent.nType = eEventType::UnsignedInteger;
+            sEvent.ullValue = (ULONGLONG)u;
+        }
+        return Emit();
+    };
+
+    bool Double(double d)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Double(d);
+        }
+        sEvent.nType = eEventType::Double;
+        sEvent.nDblValue = d;
+        return Emit();
+    };
+
+    bool RawNumber(const char *, rapidjson::SizeType, bool)
+    {
+        return false; // not used without kParseNumbersAsStringsFlag
+    };
+
+    bool String(const char *str, rapidjson::SizeType length, bool copy)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.String(str, length, copy);
+        }
+        sEvent.nType = eEventType::String;
+        sEvent.sString.szValueA = str;
+        sEvent.sString.nLength = (SIZE_T)length;
+        return Emit();
+    };
+
+    bool StartObject()
+    {
+        if (EnterContainer() == false)
+        {
+            return false;
+        }
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.StartObject();
+        }
+        sEvent.nType = eEventType::StartObject;
+        return Emit();
+    };
+
+    bool Key(const char *str, rapidjson::SizeType length, bool copy)
+    {
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.Key(str, length, copy);
+        }
+        sEvent.nType = eEventType::Key;
+        sEvent.sString.szValueA = str;
+        sEvent.sString.nLength = (SIZE_T)length;
+        return Emit();
+    };
+
+    bool EndObject(rapidjson::SizeType memberCount)
+    {
+        lpParser->dwDepth--;
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.EndObject(memberCount);
+        }
+        sEvent.nType = eEventType::EndObject;
+        sEvent.nItemsCount = (ULONG)memberCount;
+        return Emit();
+    };
+
+    bool StartArray()
+    {
+        if (EnterContainer() == false)
+        {
+            return false;
+        }
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.StartArray();
+        }
+        sEvent.nType = eEventType::StartArray;
+        return Emit();
+    };
+
+    bool EndArray(rapidjson::SizeType elementCount)
+    {
+        lpParser->dwDepth--;
+        if (!(lpParser->cEventCallback))
+        {
+            return lpParser->d.EndArray(elementCount);
+        }
+        sEvent.nType = eEventType::EndArray;
+        sEvent.nItemsCount = (ULONG)elementCount;
+        return Emit();
+    };
+
+private:
+    bool EnterContainer()
+    {
+        if (lpParser->dwDepth >= lpParser->dwMaxDepth)
+        {
+            lpParser->hrHandlerError = MX_E_BadLength;
+            return false;
+        }
+        lpParser->dwDepth++;
+        return true;
+    };
+
+    bool Emit()
+    {
+        HRESULT hRes;
+
+        hRes = lpParser->EmitEvent(sEvent);
+        if (FAILED(hRes))
+        {
+            lpParser->hrHandlerError = hRes;
+            return false;
+        }
+        return true;
+    };
+
+private:
+    CHttpBodyParserJSON *lpParser;
+    EVENT sEvent;
+};
+
+//-----------------------------------------------------------
+
+class CHttpBodyParserJSON::CDocumentFinalizer
+{
+public:
+    CDocumentFinalizer(_In_ BOOL _bSuccess)
+    {
+        bSuccess = _bSuccess;
+        return;
+    };
+
+    template <typename Handler>
+    bool operator()(_In_ Handler &)
+    {
+        return (bSuccess != FALSE) ? true : false;
+    };
+
+private:
+    BOOL bSuccess;
+};
+
+//-----------------------------------------------------------
+
+CHttpBodyParserJSON::CHttpBodyParserJSON(_In_opt_ OnEventCallback _cEventCallback, _In_opt_ LPVOID _lpUserParam,
+                                         _In_ ULONGLONG _ullMaxBodySize, _In_ DWORD _dwMaxDepth) : CHttpBodyParserBase()
+{
+    cEventCallback = _cEventCallback;
+    lpUserParam = _lpUserParam;
+    ullMaxBodySize = _ullMaxBodySize;
+    dwMaxDepth = (_dwMaxDepth > 0) ? _dwMaxDepth : 1;
     nState = eState::Data;
+    cReader.IterativeParseInit();
     return;
 }
 
@@ -50,45 +292,228 @@ HRESULT CHttpBodyParserJSON::Parse(_In_opt_ LPCVOID lpData, _In_opt_ SIZE_T nDat
         return E_POINTER;
     }
 
-    // end of parsing?
-    if (lpData != NULL)
+    if (nState != eState::Data)
     {
-        if (cStrTempA.ConcatN((LPCSTR)lpData, nDataSize) != FALSE)
+        nState = eState::Error;
+        return MX_E_InvalidData;
+    }
+
+    RAPIDJSON_TRY
+    {
+        // end of parsing?
+        hRes = (lpData != NULL) ? ParseData((LPCSTR)lpData, nDataSize) : EndOfData();
+    }
+    RAPIDJSON_CATCH(hRes)
+
+    if (FAILED(hRes))
+    {
+        if (!cEventCallback)
         {
-            return S_OK;
+            CDocumentFinalizer cFinalizer(FALSE);
+
+            // release partially built values
+            d.Populate(cFinalizer);
         }
+        sScanner.cStrPendingA.Empty();
         nState = eState::Error;
-        return E_OUTOFMEMORY;
+        return hRes;
     }
 
-    if (nState == eState::Done)
+    // success
+    if (lpData == NULL)
+    {
+        nState = eState::Done;
+    }
+    return S_OK;
+}
+
+HRESULT CHttpBodyParserJSON::ParseData(_In_ LPCSTR szDataA, _In_ SIZE_T nDataSize)
+{
+    SIZE_T nPendingLen, nSafeEnd;
+    HRESULT hRes;
+
+    ullBodySize += (ULONGLONG)nDataSize;
+    if (ullMaxBodySize != 0 && ullBodySize > ullMaxBodySize)
+    {
+        return MX_E_BadLength;
+    }
+
+    nPendingLen = sScanner.cStrPendingA.GetLength();
+    nSafeEnd = ScanTokens(szDataA, nDataSize, nPendingLen);
+    if (nSafeEnd == (SIZE_T)-1)
+    {
+        // still inside a token, keep everything
+        return (sScanner.cStrPendingA.ConcatN(szDataA, nDataSize) != FALSE) ? S_OK : E_OUTOFMEMORY;
+    }
+
+    if (nPendingLen == 0)
+    {
+        // feed the complete tokens straight from the caller's buffer and keep the rest
+        hRes = FeedReader(szDataA, nSafeEnd);
+        if (SUCCEEDED(hRes) && nSafeEnd < nDataSize)
+        {
+            if (sScanner.cStrPendingA.ConcatN(szDataA + nSafeEnd, nDataSize - nSafeEnd) == FALSE)
+            {
+                hRes = E_OUTOFMEMORY;
+            }
+        }
+    }
+    else
+    {
+        if (sScanner.cStrPendingA.ConcatN(szDataA, nDataSize) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+        hRes = FeedReader((LPCSTR)(sScanner.cStrPendingA), nSafeEnd);
+        if (SUCCEEDED(hRes))
+        {
+            sScanner.cStrPendingA.Delete(0, nSafeEnd);
+        }
+    }
+
+    // done
+    return hRes;
+}
+
+HRESULT CHttpBodyParserJSON::EndOfData()
+{
+    HRESULT hRes;
+
+    // whatever is left must complete the document, for example a number at the root level
+    hRes = FeedReader((LPCSTR)(sScanner.cStrPendingA), sScanner.cStrPendingA.GetLength());
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    sScanner.cStrPendingA.Empty();
+    if (cReader.HasParseError() != false || cReader.IterativeParseComplete() == false)
     {
-        nState = eState::Error;
         return MX_E_InvalidData;
     }
 
-    RAPIDJSON_TRY
+    if (!cEventCallback)
     {
-        if (d.ParseInsitu<rapidjson::kParseValidateEncodingFlag | rapidjson::kParseNanAndInfFlag |
-                          rapidjson::kParseFullPrecisionFlag | rapidjson::kParseTrailingCommasFlag |
-                          rapidjson::kParseEscapedApostropheFlag>((LPSTR)cStrTempA).HasParseError() != false)
+        CDocumentFinalizer cFinalizer(TRUE);
+
+        // move the root value from the building stack into the document
+        d.Populate(cFinalizer);
+    }
+
+    // done
+    return S_OK;
+}
+
+SIZE_T CHttpBodyParserJSON::ScanTokens(_In_ LPCSTR szDataA, _In_ SIZE_T nDataSize, _In_ SIZE_T nOffset)
+{
+    SIZE_T i, nSafeEnd = (SIZE_T)-1;
+    CHAR chA;
+
+    // NOTE: A position is a safe end for the reader when it is outside a string, not right after a ',' or ':'
+    //       (the reader would look for the next value) and it cannot split a number or a literal, that is, the
+    //       previous character ends a token or the next one is a delimiter.
+    for (i = 0; i < nDataSize; i++)
+    {
+        chA = szDataA[i];
+
+        if (sScanner.bInString != FALSE)
         {
-            nState = eState::Error;
-            return MX_E_InvalidData;
+            if (sScanner.bEscape != FALSE)
+            {
+                sScanner.bEscape = FALSE;
+            }
+            else if (chA == '\\')
+            {
+                sScanner.bEscape = TRUE;
+            }
+            else if (chA == '"')
+            {
+                sScanner.bInString = FALSE;
+                sScanner.bPrevIsTerminal = TRUE;
+                sScanner.chLastSignificant = '"';
+            }
+            continue;
         }
-        hRes = S_OK;
+
+        if (sScanner.chLastSignificant != ',' && sScanner.chLastSignificant != ':' &&
+            (sScanner.bPrevIsTerminal != FALSE || IS_WHITESPACE(chA) || chA == ',' || chA == ':' || chA == ']' ||
+             chA == '}'))
+        {
+            nSafeEnd = nOffset + i;
+        }
+
+        if (IS_WHITESPACE(chA))
+        {
+            sScanner.bPrevIsTerminal = TRUE;
+            continue;
+        }
+        switch (chA)
+        {
+            case '"':
+                sScanner.bInString = TRUE;
+                sScanner.bPrevIsTerminal = FALSE;
+                break;
+
+            case '{':
+            case '[':
+            case '}':
+            case ']':
+                sScanner.bPrevIsTerminal = TRUE;
+                break;
+
+            default:
+                // ',', ':' or part of a number or a literal
+                sScanner.bPrevIsTerminal = (chA == ',' || chA == ':') ? TRUE : FALSE;
+                break;
+        }
+        sScanner.chLastSignificant = chA;
     }
-        RAPIDJSON_CATCH(hRes)
 
-        if (FAILED(hRes))
+    if (sScanner.bInString == FALSE && sScanner.bPrevIsTerminal != FALSE && sScanner.chLastSignificant != ',' &&
+        sScanner.chLastSignificant != ':')
+    {
+        nSafeEnd = nOffset + nDataSize;
+    }
+
+    // done
+    return nSafeEnd;
+}
+
+HRESULT CHttpBodyParserJSON::FeedReader(_In_ LPCSTR szDataA, _In_ SIZE_T nDataSize)
+{
+    CReaderHandler cHandler(this);
+    rapidjson::MemoryStream cStream(szDataA, nDataSize);
+
+    // NOTE: The reader reports the end of the stream as a '\0' so it must only be called while a token remains.
+    for (;;)
+    {
+        while (cStream.Tell() < nDataSize && IS_WHITESPACE(cStream.Peek()))
+        {
+            cStream.Take();
+        }
+        if (cStream.Tell() >= nDataSize)
         {
-            nState = eState::Error;
-            return hRes;
+            break;
+        }
+        if (cStream.Peek() == 0 || cReader.IterativeParseComplete() != false)
+        {
+            return MX_E_InvalidData; // embedded NUL or data after the root value
         }
 
-    // success
-    nState = eState::Done;
+        hrHandlerError = S_OK;
+        if (cReader.IterativeParseNext<JSON_PARSE_FLAGS>(cStream, cHandler) == false)
+        {
+            return (FAILED(hrHandlerError)) ? hrHandlerError : MX_E_InvalidData;
+        }
+    }
+
+    // done
     return S_OK;
 }
 
+HRESULT CHttpBodyParserJSON::EmitEvent(_In_ const EVENT &sEvent)
+{
+    // NOTE: Only used when a callback was provided. Otherwise the reader handler builds the document directly.
+    return cEventCallback(sEvent, lpUserParam);
+}
+
 } // namespace MX
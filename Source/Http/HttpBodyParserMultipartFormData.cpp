@@ -57,6 +57,7 @@ HRESULT CHttpBodyParserMultipartFormData::Initialize(_In_ Internals::CHttpParser
 {
     CHttpHeaderEntContentType *lpHeader;
     LPCWSTR szBoundaryW;
+    SIZE_T k, nLen;
 
     lpHeader = cHttpParser.Headers().Find<CHttpHeaderEntContentType>();
     if (lpHeader == NULL)
@@ -72,6 +73,23 @@ HRESULT CHttpBodyParserMultipartFormData::Initialize(_In_ Internals::CHttpParser
     {
         return E_OUTOFMEMORY;
     }
+
+    // build the delimiter and Boyer-Moore-Horspool skip table used to locate the end of part data. The search is
+    // done for "\n--boundary" so parts ending with a bare LF are also detected.
+    if (cStrDelimiterA.Format("\n--%s", (LPCSTR)cStrBoundaryA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    nLen = cStrDelimiterA.GetLength();
+    for (k = 0; k < MX_ARRAYLEN(aDelimiterSkipTable); k++)
+    {
+        aDelimiterSkipTable[k] = nLen;
+    }
+    for (k = 0; k < nLen - 1; k++)
+    {
+        aDelimiterSkipTable[(BYTE)(((LPCSTR)cStrDelimiterA)[k])] = nLen - 1 - k;
+    }
+
     // done
     return S_OK;
 }
@@ -81,7 +99,6 @@ HRESULT CHttpBodyParserMultipartFormData::Parse(_In_opt_ LPCVOID lpData, _In_opt
 {
     CStringW cStrTempW;
     LPCSTR szDataA;
-    DWORD dw;
     SIZE_T k;
     HRESULT hRes;
 
@@ -391,6 +408,19 @@ err_nomem:
                 break;
 
             case eState::Data:
+                // skip as much part data as possible in a single step
+                k = GetDataBlockLength(szDataA, (SIZE_T)((LPCSTR)lpData + nDataSize - szDataA));
+                if (k > 0)
+                {
+                    hRes = AccumulateData(szDataA, k);
+                    if (FAILED(hRes))
+                    {
+                        goto done;
+                    }
+                    szDataA += k - 1;
+                    break;
+                }
+
                 if (*szDataA == '\r')
                 {
                     sParser.nState = eState::MayBeDataEnd;
@@ -495,18 +525,8 @@ not_boundary_end:
                         else
                         {
                             // flush buffers
-                            hRes = S_OK;
-                            if (sParser.nUsedTempBuf >= 0)
-                            {
-                                if (::WriteFile(sParser.cFileH, sParser.aTempBuf, (DWORD)(sParser.nUsedTempBuf), &dw, NULL) == FALSE)
-                                {
-                                    hRes = MX_HRESULT_FROM_LASTERROR();
-                                }
-                                else if ((SIZE_T)dw != sParser.nUsedTempBuf)
-                                {
-                                    hRes = MX_E_WriteFault;
-                                }
-                            }
+                            hRes = WriteToFile(sParser.aTempBuf, sParser.nUsedTempBuf);
+                            sParser.nUsedTempBuf = 0;
                             if (SUCCEEDED(hRes))
                             {
                                 hRes = AddFileField((LPCWSTR)(sParser.sCurrentBlock.sContentDisposition.cStrNameW),
@@ -722,41 +742,126 @@ HRESULT CHttpBodyParserMultipartFormData::ParseHeader(_Inout_ CStringA &cStrLine
 
 HRESULT CHttpBodyParserMultipartFormData::AccumulateData(_In_ CHAR chA)
 {
-    DWORD dw;
+    return AccumulateData(&chA, 1);
+}
+
+HRESULT CHttpBodyParserMultipartFormData::AccumulateData(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen)
+{
+    HRESULT hRes;
 
-    sParser.aTempBuf[sParser.nUsedTempBuf++] = (BYTE)chA;
     if (!(sParser.cFileH))
     {
-        if (sParser.cStrCurrLineA.GetLength() > (SIZE_T)dwMaxFieldSize)
+        if (sParser.cStrCurrLineA.GetLength() + nDataLen > (SIZE_T)dwMaxFieldSize)
         {
             return MX_E_BadLength;
         }
-        if (sParser.cStrCurrLineA.ConcatN(&chA, 1) == FALSE)
+        if (sParser.cStrCurrLineA.ConcatN(szDataA, nDataLen) == FALSE)
         {
             return E_OUTOFMEMORY;
         }
     }
     else
     {
-        if ((++sParser.nFileUploadSize) >= ullMaxFileSize)
+        sParser.nFileUploadSize += (ULONGLONG)nDataLen;
+        if (sParser.nFileUploadSize >= ullMaxFileSize)
         {
             return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
         }
-        // flush current data?
-        if (sParser.nUsedTempBuf >= sizeof(sParser.aTempBuf))
+
+        if (sParser.nUsedTempBuf + nDataLen <= sizeof(sParser.aTempBuf))
         {
-            if (::WriteFile(sParser.cFileH, sParser.aTempBuf, (DWORD)(sParser.nUsedTempBuf), &dw, NULL) == FALSE)
+            ::MxMemCopy(sParser.aTempBuf + sParser.nUsedTempBuf, szDataA, nDataLen);
+            sParser.nUsedTempBuf += nDataLen;
+            if (sParser.nUsedTempBuf < sizeof(sParser.aTempBuf))
             {
-                return MX_HRESULT_FROM_LASTERROR();
+                return S_OK;
             }
-            if ((SIZE_T)dw != sParser.nUsedTempBuf)
+            nDataLen = 0;
+        }
+
+        // flush current data and, if the block is large, write it directly
+        if (sParser.nUsedTempBuf > 0)
+        {
+            hRes = WriteToFile(sParser.aTempBuf, sParser.nUsedTempBuf);
+            if (FAILED(hRes))
             {
-                return MX_E_WriteFault;
+                return hRes;
             }
             sParser.nUsedTempBuf = 0;
         }
+        if (nDataLen >= sizeof(sParser.aTempBuf))
+        {
+            return WriteToFile(szDataA, nDataLen);
+        }
+        ::MxMemCopy(sParser.aTempBuf, szDataA, nDataLen);
+        sParser.nUsedTempBuf = nDataLen;
+    }
+    return S_OK;
+}
+
+HRESULT CHttpBodyParserMultipartFormData::WriteToFile(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen)
+{
+    DWORD dwToWrite, dw;
+
+    while (nDataLen > 0)
+    {
+        dwToWrite = (nDataLen > 0x40000000) ? 0x40000000 : (DWORD)nDataLen;
+        if (::WriteFile(sParser.cFileH, lpData, dwToWrite, &dw, NULL) == FALSE)
+        {
+            return MX_HRESULT_FROM_LASTERROR();
+        }
+        if (dw != dwToWrite)
+        {
+            return MX_E_WriteFault;
+        }
+        lpData = (LPBYTE)lpData + (SIZE_T)dw;
+        nDataLen -= (SIZE_T)dw;
     }
     return S_OK;
 }
 
+SIZE_T CHttpBodyParserMultipartFormData::GetDataBlockLength(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen)
+{
+    LPCSTR szDelimiterA = (LPCSTR)cStrDelimiterA;
+    SIZE_T nDelimiterLen = cStrDelimiterA.GetLength();
+    SIZE_T nPos, nLast, i;
+
+    // NOTE: Returns the amount of bytes, starting at 'szDataA', that can be safely treated as part data. The byte
+    //       at the returned offset is either the start of a delimiter (CR or LF) or belongs to a trailing region
+    //       that may be the beginning of a delimiter split across packets and must be checked byte by byte.
+    if (nDataLen < nDelimiterLen || nDelimiterLen == 0)
+    {
+        return 0;
+    }
+
+    nLast = nDelimiterLen - 1;
+    nPos = 0;
+    while (nPos <= nDataLen - nDelimiterLen)
+    {
+        i = nLast;
+        while (szDataA[nPos + i] == szDelimiterA[i])
+        {
+            if (i == 0)
+            {
+                // delimiter found, leave the preceding CR to the state machine
+                if (nPos > 0 && szDataA[nPos - 1] == '\r')
+                {
+                    nPos--;
+                }
+                return nPos;
+            }
+            i--;
+        }
+        nPos += aDelimiterSkipTable[(BYTE)szDataA[nPos + nLast]];
+    }
+
+    // no delimiter found, the last bytes may be a partial one
+    nPos = nDataLen - nLast;
+    if (szDataA[nPos - 1] == '\r')
+    {
+        nPos--;
+    }
+    return nPos;
+}
+
 } // namespace MX
@@ -0,0 +1,191 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\..\Include\Http\HttpBodyParserStream.h"
+
+ //-----------------------------------------------------------
+
+namespace MX {
+
+CHttpBodyParserStream::CHttpBodyParserStream(_In_ OnDataCallback _cDataCallback, _In_opt_ LPVOID _lpUserParam,
+                                             _In_ ULONGLONG _ullMaxBodySize)
+    : CHttpBodyParserBase(), CNonCopyableObj()
+{
+    cDataCallback = _cDataCallback;
+    lpUserParam = _lpUserParam;
+    ullMaxBodySize = _ullMaxBodySize;
+    nSize = 0ui64;
+    sParser.nState = eState::Reading;
+    return;
+}
+
+CHttpBodyParserStream::CHttpBodyParserStream(_In_ CStream *lpStream, _In_ ULONGLONG _ullMaxBodySize)
+    : CHttpBodyParserBase(), CNonCopyableObj()
+{
+    cDataCallback = NullCallback();
+    lpUserParam = NULL;
+    cStream = lpStream;
+    ullMaxBodySize = _ullMaxBodySize;
+    nSize = 0ui64;
+    sParser.nState = eState::Reading;
+    return;
+}
+
+CHttpBodyParserStream::CHttpBodyParserStream(_In_ CHttpClient *lpHttpClient, _In_ ULONGLONG _ullMaxBodySize)
+    : CHttpBodyParserBase(), CNonCopyableObj()
+{
+    cDataCallback = NullCallback();
+    lpUserParam = NULL;
+    cHttpClient = lpHttpClient;
+    ullMaxBodySize = _ullMaxBodySize;
+    nSize = 0ui64;
+    sParser.nState = eState::Reading;
+    return;
+}
+
+CHttpBodyParserStream::~CHttpBodyParserStream()
+{
+    cStream.Release();
+    cHttpClient.Release();
+    return;
+}
+
+CStream *CHttpBodyParserStream::GetStream() const
+{
+    CStream *lpStream;
+
+    lpStream = cStream.Get();
+    if (lpStream != NULL)
+    {
+        lpStream->AddRef();
+    }
+    return lpStream;
+}
+
+CHttpClient *CHttpBodyParserStream::GetHttpClient() const
+{
+    CHttpClient *lpHttpClient;
+
+    lpHttpClient = cHttpClient.Get();
+    if (lpHttpClient != NULL)
+    {
+        lpHttpClient->AddRef();
+    }
+    return lpHttpClient;
+}
+
+HRESULT CHttpBodyParserStream::Initialize(_In_ Internals::CHttpParser &cHttpParser)
+{
+    if ((!cDataCallback) && (!cStream) && (!cHttpClient))
+    {
+        return E_POINTER;
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CHttpBodyParserStream::Parse(_In_opt_ LPCVOID lpData, _In_opt_ SIZE_T nDataSize)
+{
+    HRESULT hRes;
+
+    if (lpData == NULL && nDataSize > 0)
+    {
+        return E_POINTER;
+    }
+    if (sParser.nState == eState::Done)
+    {
+        return S_OK;
+    }
+    if (sParser.nState == eState::Error)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // end of parsing?
+    if (lpData == NULL)
+    {
+        if (cDataCallback)
+        {
+            hRes = cDataCallback(NULL, 0, lpUserParam);
+        }
+        else
+        {
+            hRes = (cHttpClient) ? cHttpClient->SignalEndOfPostData() : S_OK;
+        }
+        sParser.nState = (SUCCEEDED(hRes)) ? eState::Done : eState::Error;
+        return hRes;
+    }
+    if (nDataSize == 0)
+    {
+        return S_OK;
+    }
+
+    // check if size is greater than max size or overflow
+    if (nSize + (ULONGLONG)nDataSize > ullMaxBodySize || nSize + (ULONGLONG)nDataSize < nSize)
+    {
+        sParser.nState = eState::Error;
+        return MX_E_BadLength;
+    }
+
+    // hand the data to the consumer, no copies are made here
+    if (cDataCallback)
+    {
+        hRes = cDataCallback(lpData, nDataSize, lpUserParam);
+    }
+    else
+    {
+        hRes = (cHttpClient) ? cHttpClient->AddRequestRawPostData(lpData, nDataSize) : WriteToStream(lpData, nDataSize);
+    }
+    if (FAILED(hRes))
+    {
+        sParser.nState = eState::Error;
+        return hRes;
+    }
+    nSize += (ULONGLONG)nDataSize;
+
+    // done
+    return S_OK;
+}
+
+HRESULT CHttpBodyParserStream::WriteToStream(_In_ LPCVOID lpData, _In_ SIZE_T nDataSize)
+{
+    SIZE_T nWritten;
+    HRESULT hRes;
+
+    while (nDataSize > 0)
+    {
+        hRes = cStream->Write(lpData, nDataSize, nWritten);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (nWritten == 0)
+        {
+            return MX_E_WriteFault;
+        }
+        lpData = (LPBYTE)lpData + nWritten;
+        nDataSize -= nWritten;
+    }
+
+    // done
+    return S_OK;
+}
+
+} // namespace MX
@@ -930,9 +930,11 @@ HRESULT CHttpClient::AddRequestRawPostData(_In_ LPCVOID lpData, _In_ SIZE_T nLen
     CCriticalSection::CAutoLock cLock(cMutex);
     HRESULT hRes;
 
+    // NOTE: While the request headers are being sent, dynamic data is queued and sent right after them.
     if (nState != eState::Closed && nState != eState::SendingDynamicRequestBody &&
         nState != eState::WaitingForRedirection && nState != eState::EstablishingProxyTunnelConnection &&
-        nState != eState::WaitingProxyTunnelConnectionResponse)
+        nState != eState::WaitingProxyTunnelConnectionResponse &&
+        (nState != eState::SendingRequestHeaders || sRequest.sPostData.nDynamicFlags == 0))
     {
         return MX_E_NotReady;
     }
@@ -966,9 +968,9 @@ HRESULT CHttpClient::AddRequestRawPostData(_In_ LPCVOID lpData, _In_ SIZE_T nLen
                 lpNode = sRequest.sPostData.cList.GetTail();
                 lpPostDataItem = CONTAINING_RECORD(lpNode, CPostDataItem, cListNode);
 
-                if (lpPostDataItem->cStream && lpPostDataItem->cStream->GetLength() + nLength < 65536)
+                if (lpPostDataItem->bAppendable != FALSE && lpPostDataItem->cStream->GetLength() + nLength < 65536)
                 {
-                    return cStream->Write(lpData, nLength, nWritten);
+                    return lpPostDataItem->cStream->Write(lpData, nLength, nWritten);
                 }
             }
         }
@@ -989,6 +991,7 @@ HRESULT CHttpClient::AddRequestRawPostData(_In_ LPCVOID lpData, _In_ SIZE_T nLen
                     lpNewPostDataItem = MX_DEBUG_NEW CPostDataItem(cStream.Get());
                     if (lpNewPostDataItem != NULL)
                     {
+                        lpNewPostDataItem->bAppendable = TRUE;
                         sRequest.sPostData.cList.PushTail(&(lpNewPostDataItem->cListNode));
                         sRequest.sPostData.bHasRaw = TRUE;
                     }
@@ -1169,9 +1172,9 @@ HRESULT CHttpClient::SignalEndOfPostData()
     CCriticalSection::CAutoLock cLock(cMutex);
     HRESULT hRes;
 
-    if (nState != eState::Closed && nState != eState::SendingDynamicRequestBody &&
-        nState != eState::WaitingForRedirection && nState != eState::EstablishingProxyTunnelConnection &&
-        nState != eState::WaitingProxyTunnelConnectionResponse)
+    if (nState != eState::Closed && nState != eState::SendingRequestHeaders &&
+        nState != eState::SendingDynamicRequestBody && nState != eState::WaitingForRedirection &&
+        nState != eState::EstablishingProxyTunnelConnection && nState != eState::WaitingProxyTunnelConnectionResponse)
     {
         return MX_E_NotReady;
     }
@@ -29,6 +29,8 @@
 #define MAX_REQUEST_STATUS_LINE_LENGTH 4096
 #define MAX_HEADERS_LENGTH 32 * 1048576
 
+#define MAX_RETAINED_LIST_SIZE 64
+
 #define HEADER_FLAG_TransferEncodingChunked 0x0001
 #define HEADER_FLAG_ContentEncodingGZip 0x0002
 #define HEADER_FLAG_ContentEncodingDeflate 0x0004
@@ -80,15 +82,20 @@ VOID CHttpParser::SetOption_MaxHeaderSize(_In_ DWORD dwSize)
 VOID CHttpParser::Reset()
 {
     nState = eState::Start;
-    cStrCurrLineA.Empty();
+    // NOTE: Buffers are kept so a keep-alive connection does not reallocate them on every request.
+    cStrCurrLineA.Delete(0, (SIZE_T)-1);
     dwHeadersLen = 0;
     nHeaderFlags = 0;
-    cHeaders.RemoveAllElements();
-    cCookies.RemoveAllElements();
+    cHeaders.RemoveAllElementsKeepingBuffer(MAX_RETAINED_LIST_SIZE);
+    cCookies.RemoveAllElementsKeepingBuffer(MAX_RETAINED_LIST_SIZE);
+    cRequestCookies.Reset();
     //----
     sRequest.nHttpProtocol = 0;
     sRequest.szMethodA = NULL;
+    sRequest.cStrRawUrlA.Delete(0, (SIZE_T)-1);
+    sRequest.cUrlView.Reset();
     sRequest.cUrl.Reset();
+    sRequest.bUrlBuilt = FALSE;
     sRequest.nBrowser = Http::eBrowser::Other;
     //----
     sResponse.nStatusCode = 0;
@@ -321,11 +328,19 @@ err_line_too_long:
                 }
                 szDataA++;
 
-                cStrCurrLineA.Empty(); // free some memory
+                cStrCurrLineA.Delete(0, (SIZE_T)-1); // keep the buffer for the next request
 
                 // do some checks
                 if (bActAsServer != FALSE)
                 {
+                    // NOTE: Reject now a target CUrl would not accept so handlers never get an empty url. The
+                    //       "Host" header was already validated when parsed and the CUrl is still built on demand.
+                    hRes = sRequest.cUrlView.Validate();
+                    if (FAILED(hRes))
+                    {
+                        goto done;
+                    }
+
                     if (StrCompareA(GetRequestMethod(), "HEAD") == 0 || StrCompareA(GetRequestMethod(), "GET") == 0)
                     {
                         // content or chunked transfer is not allowed
@@ -607,9 +622,25 @@ LPCSTR CHttpParser::GetRequestMethod() const
 
 CUrl *CHttpParser::GetRequestUri() const
 {
+    if (sRequest.bUrlBuilt == FALSE)
+    {
+        CHttpParser *lpThis = const_cast<CHttpParser *>(this);
+        HRESULT hRes;
+
+        hRes = lpThis->BuildRequestUri();
+        if (FAILED(hRes) && ShouldLog(1) != FALSE)
+        {
+            lpThis->Log(L"HttpCommon(RequestUri/0x%p): Unable to build URL [0x%08X]", this, hRes);
+        }
+    }
     return const_cast<CUrl *>(&(sRequest.cUrl));
 }
 
+const CUrlView &CHttpParser::GetRequestUrlView() const
+{
+    return sRequest.cUrlView;
+}
+
 MX::Http::eBrowser CHttpParser::GetRequestBrowser() const
 {
     return sRequest.nBrowser;
@@ -676,13 +707,22 @@ HRESULT CHttpParser::ParseRequestLine(_In_z_ LPCSTR szLineA)
         (nUriLength >= 8 && StrNCompareA(szUriStartA, "https://", 8) == 0) || szUriStartA[0] == '/')
     {
         // full uri specified or absolute path
-        hRes = sRequest.cUrl.ParseFromString(szUriStartA, nUriLength);
+        // NOTE: Only the raw target is kept and split here, the CUrl is built when someone asks for it.
+        sRequest.cStrRawUrlA.Delete(0, (SIZE_T)-1);
+        if (sRequest.cStrRawUrlA.ConcatN(szUriStartA, nUriLength) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+        hRes = sRequest.cUrlView.Parse((LPCSTR)(sRequest.cStrRawUrlA), nUriLength);
         if (FAILED(hRes))
         {
             return hRes;
         }
-        sRequest.cUrl.SetScheme((LPCSTR)NULL);
-        // leave host if any
+        if (sRequest.cUrlView.GetHost().nLength > 0 &&
+            CUrl::IsValidHostAddress(sRequest.cUrlView.GetHost().szStrA, sRequest.cUrlView.GetHost().nLength) == FALSE)
+        {
+            return MX_E_InvalidData;
+        }
     }
     else
     {
@@ -814,13 +854,7 @@ HRESULT CHttpParser::ParseHeader(_In_ CStringA &cStrLineA)
     if (bActAsServer != FALSE && (((SIZE_T)(szNameEndA - szNameStartA) == 6 && StrNCompareA(szNameStartA, "Cookie", 6, TRUE) == 0) ||
                                   ((SIZE_T)(szNameEndA - szNameStartA) == 7 && StrNCompareA(szNameStartA, "Cookie2", 7, TRUE) == 0)))
     {
-        CHttpCookieArray cCookieArray;
-
-        hRes = cCookieArray.ParseFromRequestHeader(szValueStartA, (SIZE_T)(szValueEndA - szValueStartA));
-        if (SUCCEEDED(hRes))
-        {
-            hRes = cCookies.Merge(cCookieArray, FALSE);
-        }
+        hRes = cRequestCookies.ParseFromRequestHeader(szValueStartA, (SIZE_T)(szValueEndA - szValueStartA));
         if (FAILED(hRes))
         {
             return hRes;
@@ -939,17 +973,8 @@ HRESULT CHttpParser::ParseHeader(_In_ CStringA &cStrLineA)
         }
         else if (bActAsServer != FALSE && StrCompareA(cNewHeader->GetHeaderName(), "Host", TRUE) == 0)
         {
-            CHttpHeaderReqHost *lpHdr = (CHttpHeaderReqHost *)(cNewHeader.Get());
-
-            hRes = sRequest.cUrl.SetHost(lpHdr->GetHost());
-            if (SUCCEEDED(hRes))
-            {
-                hRes = sRequest.cUrl.SetPort(lpHdr->GetPort());
-            }
-            if (FAILED(hRes))
-            {
-                return hRes;
-            }
+            // NOTE: Already validated by the header parser, it is applied when the request url is built.
+            sRequest.bUrlBuilt = FALSE;
         }
         else if (bActAsServer != FALSE && StrCompareA(cNewHeader->GetHeaderName(), "User-Agent", TRUE) == 0)
         {
@@ -963,6 +988,35 @@ HRESULT CHttpParser::ParseHeader(_In_ CStringA &cStrLineA)
     return S_OK;
 }
 
+HRESULT CHttpParser::BuildRequestUri()
+{
+    CHttpHeaderReqHost *lpHostHeader;
+    HRESULT hRes;
+
+    sRequest.bUrlBuilt = TRUE;
+    hRes = sRequest.cUrlView.ToUrl(sRequest.cUrl);
+    if (SUCCEEDED(hRes))
+    {
+        sRequest.cUrl.SetScheme((LPCSTR)NULL);
+        // leave host if any unless the Host header was received
+        lpHostHeader = (bActAsServer != FALSE) ? cHeaders.Find<CHttpHeaderReqHost>() : NULL;
+        if (lpHostHeader != NULL)
+        {
+            hRes = sRequest.cUrl.SetHost(lpHostHeader->GetHost());
+            if (SUCCEEDED(hRes))
+            {
+                hRes = sRequest.cUrl.SetPort(lpHostHeader->GetPort());
+            }
+        }
+    }
+    if (FAILED(hRes))
+    {
+        sRequest.cUrl.Reset();
+    }
+    // done
+    return hRes;
+}
+
 HRESULT CHttpParser::ProcessContent(_In_ LPCVOID lpContent, _In_ SIZE_T nContentSize)
 {
     BYTE aTempBuf[4096];
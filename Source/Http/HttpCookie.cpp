@@ -22,6 +22,7 @@
 #include "..\..\Include\Http\Url.h"
 #include "..\..\Include\Http\punycode.h"
 #include "..\..\Include\Http\HttpCommon.h"
+#include "PerfectHash.h"
 #include <stdlib.h>
 
  //-----------------------------------------------------------
@@ -37,6 +38,8 @@ static const MX::CDateTime cZeroDt(1, 1, 1);
 //-----------------------------------------------------------
 
 static VOID SkipBlanks(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen);
+static HRESULT ScanPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BOOL bAdv, _Out_ LPCSTR *lpszNameA,
+                         _Out_ SIZE_T *lpnNameLen, _Out_ LPCSTR *lpszValueA, _Out_ SIZE_T *lpnValueLen);
 static HRESULT GetPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BOOL bAdv, _Inout_ MX::CStringA &cStrNameA,
                         _Inout_ MX::CStringA &cStrValueA);
 
@@ -1006,6 +1009,307 @@ HRESULT CHttpCookieArray::RemoveExpiredAndInvalid(_In_opt_ const CDateTime *lpDa
     return S_OK;
 }
 
+//-----------------------------------------------------------
+
+CHttpCookieJar::CHttpCookieJar() : CBaseMemObj(), CNonCopyableObj()
+{
+    ::MxMemSet(aBuckets, 0xFF, sizeof(aBuckets));
+    return;
+}
+
+CHttpCookieJar::~CHttpCookieJar()
+{
+    RemoveEntriesFrom(0);
+    return;
+}
+
+VOID CHttpCookieJar::Reset()
+{
+    RemoveEntriesFrom(0);
+    // NOTE: Keep the buffers. The jar lives inside a parser that is reused by every request of a connection.
+    cStrBufferA.Delete(0, (SIZE_T)-1);
+    return;
+}
+
+HRESULT CHttpCookieJar::ParseFromRequestHeader(_In_ LPCSTR szSrcA, _In_opt_ SIZE_T nSrcLen)
+{
+    SIZE_T nBaseOffset, nOrigCount, nIndex, nCount;
+    LPCSTR szNameA, szValueA;
+    SIZE_T nNameLen, nValueLen;
+    LPSTR szBufferA;
+    ENTRY sEntry;
+    HRESULT hRes;
+
+    if (nSrcLen == (SIZE_T)-1)
+    {
+        nSrcLen = StrLenA(szSrcA);
+    }
+    if (szSrcA == NULL && nSrcLen > 0)
+    {
+        return E_POINTER;
+    }
+
+    // copy the header once, slices below are offsets into this copy
+    nBaseOffset = cStrBufferA.GetLength();
+    if (nBaseOffset + nSrcLen + 1 > (SIZE_T)ULONG_MAX)
+    {
+        return MX_E_InvalidData;
+    }
+    if (cStrBufferA.ConcatN(szSrcA, nSrcLen) == FALSE || cStrBufferA.ConcatN("", 1) == FALSE)
+    {
+        cStrBufferA.Delete(nBaseOffset, (SIZE_T)-1);
+        return E_OUTOFMEMORY;
+    }
+    szBufferA = (LPSTR)cStrBufferA;
+    szSrcA = szBufferA + nBaseOffset;
+
+    nOrigCount = aEntriesList.GetCount();
+    hRes = S_OK;
+    while (nSrcLen > 0)
+    {
+        SkipBlanks(szSrcA, nSrcLen);
+        // get name/value pair
+        hRes = ScanPairA(szSrcA, nSrcLen, FALSE, &szNameA, &nNameLen, &szValueA, &nValueLen);
+        if (FAILED(hRes))
+        {
+            break;
+        }
+        // skip $Version, $Path and so on....
+        if (*szNameA == '$')
+        {
+            continue;
+        }
+        // same validation as CHttpCookie::SetName and CHttpCookie::SetValue
+        for (nIndex = 0; nIndex < nNameLen; nIndex++)
+        {
+            if (szNameA[nIndex] == ';' || szNameA[nIndex] == ',' || *((LPBYTE)(szNameA + nIndex)) <= 32)
+            {
+                break;
+            }
+        }
+        if (nIndex < nNameLen)
+        {
+            hRes = E_INVALIDARG;
+            break;
+        }
+        for (nIndex = 0; nIndex < nValueLen; nIndex++)
+        {
+            if (szValueA[nIndex] == ';')
+            {
+                break;
+            }
+        }
+        if (nIndex < nValueLen)
+        {
+            hRes = E_INVALIDARG;
+            break;
+        }
+
+        sEntry.nHash = PerfectHash::Hash<CHAR>(0, szNameA, nNameLen, TRUE);
+        if (FindEntry(szNameA, nNameLen, sEntry.nHash) != (SIZE_T)-1)
+        {
+            continue; // first one wins
+        }
+        sEntry.nNameOffset = (ULONG)(SIZE_T)(szNameA - szBufferA);
+        sEntry.nNameLen = (ULONG)nNameLen;
+        // an empty value points to the name terminator
+        sEntry.nValueOffset = (nValueLen > 0) ? (ULONG)(SIZE_T)(szValueA - szBufferA) : (sEntry.nNameOffset + (ULONG)nNameLen);
+        sEntry.nValueLen = (ULONG)nValueLen;
+        sEntry.nNextInBucket = aBuckets[sEntry.nHash & (_countof(aBuckets) - 1)];
+        sEntry.lpCookie = NULL;
+        if (aEntriesList.AddElement(&sEntry) == FALSE)
+        {
+            hRes = E_OUTOFMEMORY;
+            break;
+        }
+        aBuckets[sEntry.nHash & (_countof(aBuckets) - 1)] = (ULONG)(aEntriesList.GetCount() - 1);
+    }
+    if (FAILED(hRes))
+    {
+        RemoveEntriesFrom(nOrigCount);
+        cStrBufferA.Delete(nBaseOffset, (SIZE_T)-1);
+        return hRes;
+    }
+
+    // terminate names and values, the delimiters are no longer needed once the whole header was scanned
+    nCount = aEntriesList.GetCount();
+    for (nIndex = nOrigCount; nIndex < nCount; nIndex++)
+    {
+        LPENTRY lpEntry = &aEntriesList.GetElementAt(nIndex);
+
+        szBufferA[lpEntry->nNameOffset + lpEntry->nNameLen] = 0;
+        szBufferA[lpEntry->nValueOffset + lpEntry->nValueLen] = 0;
+    }
+
+    // done
+    return S_OK;
+}
+
+LPCSTR CHttpCookieJar::GetName(_In_ SIZE_T nIndex) const
+{
+    if (nIndex >= aEntriesList.GetCount())
+    {
+        return NULL;
+    }
+    return (LPCSTR)cStrBufferA + aEntriesList.GetElementAt(nIndex).nNameOffset;
+}
+
+LPCSTR CHttpCookieJar::GetValue(_In_ SIZE_T nIndex) const
+{
+    if (nIndex >= aEntriesList.GetCount())
+    {
+        return NULL;
+    }
+    return (LPCSTR)cStrBufferA + aEntriesList.GetElementAt(nIndex).nValueOffset;
+}
+
+SIZE_T CHttpCookieJar::Find(_In_z_ LPCSTR szNameA) const
+{
+    SIZE_T nNameLen;
+
+    if (szNameA == NULL || *szNameA == 0)
+    {
+        return (SIZE_T)-1;
+    }
+    nNameLen = StrLenA(szNameA);
+    return FindEntry(szNameA, nNameLen, PerfectHash::Hash<CHAR>(0, szNameA, nNameLen, TRUE));
+}
+
+SIZE_T CHttpCookieJar::Find(_In_z_ LPCWSTR szNameW) const
+{
+    CHAR szTempA[64];
+    SIZE_T i, nCount;
+
+    if (szNameW == NULL || *szNameW == 0)
+    {
+        return (SIZE_T)-1;
+    }
+
+    // short ASCII names can use the index
+    for (i = 0; i < _countof(szTempA) && szNameW[i] != 0 && szNameW[i] < 0x80; i++)
+    {
+        szTempA[i] = (CHAR)szNameW[i];
+    }
+    if (szNameW[i] == 0)
+    {
+        return FindEntry(szTempA, i, PerfectHash::Hash<CHAR>(0, szTempA, i, TRUE));
+    }
+
+    nCount = aEntriesList.GetCount();
+    for (i = 0; i < nCount; i++)
+    {
+        if (StrCompareAW(GetName(i), szNameW, TRUE) == 0)
+        {
+            return i;
+        }
+    }
+    return (SIZE_T)-1;
+}
+
+HRESULT CHttpCookieJar::GetCookie(_In_ SIZE_T nIndex, _Deref_out_ CHttpCookie **lplpCookie)
+{
+    TAutoRefCounted<CHttpCookie> cCookie;
+    LPENTRY lpEntry;
+    HRESULT hRes;
+
+    if (lplpCookie == NULL)
+    {
+        return E_POINTER;
+    }
+    *lplpCookie = NULL;
+    if (nIndex >= aEntriesList.GetCount())
+    {
+        return E_INVALIDARG;
+    }
+    lpEntry = &aEntriesList.GetElementAt(nIndex);
+    if (lpEntry->lpCookie == NULL)
+    {
+        cCookie.Attach(MX_DEBUG_NEW CHttpCookie());
+        if (!cCookie)
+        {
+            return E_OUTOFMEMORY;
+        }
+        hRes = cCookie->SetName(GetName(nIndex));
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cCookie->SetValue(GetValue(nIndex));
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        lpEntry->lpCookie = cCookie.Detach();
+    }
+    *lplpCookie = lpEntry->lpCookie;
+    return S_OK;
+}
+
+HRESULT CHttpCookieJar::ToArray(_Inout_ CHttpCookieArray &cDestArray)
+{
+    SIZE_T i, nCount;
+    HRESULT hRes;
+
+    nCount = aEntriesList.GetCount();
+    for (i = 0; i < nCount; i++)
+    {
+        CHttpCookie *lpCookie;
+
+        hRes = GetCookie(i, &lpCookie);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cDestArray.Merge(lpCookie, FALSE);
+            if (hRes == MX_E_AlreadyExists)
+            {
+                hRes = S_OK;
+            }
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+    return S_OK;
+}
+
+SIZE_T CHttpCookieJar::FindEntry(_In_ LPCSTR szNameA, _In_ SIZE_T nNameLen, _In_ ULONG nHash) const
+{
+    ULONG nIndex;
+
+    for (nIndex = aBuckets[nHash & (_countof(aBuckets) - 1)]; nIndex != ULONG_MAX;)
+    {
+        LPENTRY lpEntry = &aEntriesList.GetElementAt((SIZE_T)nIndex);
+
+        // NOTE: Names of the header being parsed are not terminated yet, so compare by length.
+        if (lpEntry->nHash == nHash && (SIZE_T)(lpEntry->nNameLen) == nNameLen &&
+            StrNCompareA((LPCSTR)cStrBufferA + lpEntry->nNameOffset, szNameA, nNameLen, TRUE) == 0)
+        {
+            return (SIZE_T)nIndex;
+        }
+        nIndex = lpEntry->nNextInBucket;
+    }
+    return (SIZE_T)-1;
+}
+
+VOID CHttpCookieJar::RemoveEntriesFrom(_In_ SIZE_T nIndex)
+{
+    SIZE_T nCount;
+
+    // entries are pushed at the head of their bucket so unlinking them backwards restores the previous state
+    nCount = aEntriesList.GetCount();
+    while (nCount > nIndex)
+    {
+        LPENTRY lpEntry = &aEntriesList.GetElementAt(--nCount);
+
+        aBuckets[lpEntry->nHash & (_countof(aBuckets) - 1)] = lpEntry->nNextInBucket;
+        if (lpEntry->lpCookie != NULL)
+        {
+            lpEntry->lpCookie->Release();
+        }
+    }
+    aEntriesList.SetCount(nIndex);
+    return;
+}
+
 } // namespace MX
 
 //-----------------------------------------------------------
@@ -1020,15 +1324,13 @@ static VOID SkipBlanks(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen)
     return;
 }
 
-static HRESULT GetPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BOOL bAdv, _Inout_ MX::CStringA &cStrNameA,
-                        _Inout_ MX::CStringA &cStrValueA)
+static HRESULT ScanPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BOOL bAdv, _Out_ LPCSTR *lpszNameA,
+                         _Out_ SIZE_T *lpnNameLen, _Out_ LPCSTR *lpszValueA, _Out_ SIZE_T *lpnValueLen)
 {
     LPCSTR szStartA;
 
-    cStrNameA.Empty();
-    cStrValueA.Empty();
     SkipBlanks(szSrcA, nSrcLen);
-    // get and store name
+    // get name
     szStartA = szSrcA;
     while (nSrcLen > 0 && *szSrcA != '=' && *szSrcA != ';')
     {
@@ -1039,10 +1341,10 @@ static HRESULT GetPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BO
     {
         return MX_E_InvalidData;
     }
-    if (cStrNameA.CopyN(szStartA, (SIZE_T)(szSrcA - szStartA)) == FALSE)
-    {
-        return E_OUTOFMEMORY;
-    }
+    *lpszNameA = szStartA;
+    *lpnNameLen = (SIZE_T)(szSrcA - szStartA);
+    *lpszValueA = szSrcA;
+    *lpnValueLen = 0;
     SkipBlanks(szSrcA, nSrcLen);
     // end of cookie?
     if (nSrcLen == 0)
@@ -1069,10 +1371,8 @@ static HRESULT GetPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BO
                 szSrcA++;
                 nSrcLen--;
             }
-            if (cStrValueA.CopyN(szStartA, (SIZE_T)(szSrcA - szStartA)) == FALSE)
-            {
-                return E_OUTOFMEMORY;
-            }
+            *lpszValueA = szStartA;
+            *lpnValueLen = (SIZE_T)(szSrcA - szStartA);
         }
         else
         {
@@ -1087,10 +1387,8 @@ static HRESULT GetPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BO
             {
                 return MX_E_InvalidData;
             }
-            if (cStrValueA.CopyN(szStartA, (SIZE_T)(szSrcA - szStartA)) == FALSE)
-            {
-                return E_OUTOFMEMORY;
-            }
+            *lpszValueA = szStartA;
+            *lpnValueLen = (SIZE_T)(szSrcA - szStartA);
             // skip closing quotes
             szSrcA++;
             nSrcLen--;
@@ -1109,3 +1407,28 @@ static HRESULT GetPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BO
     }
     return S_OK;
 }
+
+static HRESULT GetPairA(_Inout_ LPCSTR &szSrcA, _Inout_ SIZE_T &nSrcLen, _In_ BOOL bAdv, _Inout_ MX::CStringA &cStrNameA,
+                        _Inout_ MX::CStringA &cStrValueA)
+{
+    LPCSTR szNameA, szValueA;
+    SIZE_T nNameLen, nValueLen;
+    HRESULT hRes;
+
+    cStrNameA.Empty();
+    cStrValueA.Empty();
+    hRes = ScanPairA(szSrcA, nSrcLen, bAdv, &szNameA, &nNameLen, &szValueA, &nValueLen);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (cStrNameA.CopyN(szNameA, nNameLen) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    if (nValueLen > 0 && cStrValueA.CopyN(szValueA, nValueLen) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
@@ -20,9 +20,36 @@
 #include "..\..\Include\Http\HttpHeaderBase.h"
 #include "..\..\Include\AutoPtr.h"
 #include "..\..\Include\Strings\Utf8.h"
+#include "PerfectHash.h"
 
  //-----------------------------------------------------------
 
+typedef MX::CHttpHeaderBase *(*lpfnCreateHttpHeader)();
+
+typedef struct
+{
+    LPCSTR szNameA;
+    lpfnCreateHttpHeader lpfnCreateRequest;
+    lpfnCreateHttpHeader lpfnCreateResponse;
+} HTTPHEADER_DEF;
+
+//-----------------------------------------------------------
+
+template<class T>
+static MX::CHttpHeaderBase *CreateHttpHeader()
+{
+    return MX_DEBUG_NEW T();
+}
+
+#define HTTPHEADER_FACTORY(_hdr) &CreateHttpHeader<MX::CHttpHeader##_hdr>
+
+// NOTE: Generated at build time from HttpHeaderNames.phf.
+#include <HttpHeaderNames.phf.h>
+
+#undef HTTPHEADER_FACTORY
+
+//-----------------------------------------------------------
+
 namespace MX {
 
 CHttpHeaderBase::CHttpHeaderBase() : TRefCounted<CBaseMemObj>()
@@ -35,18 +62,10 @@ CHttpHeaderBase::~CHttpHeaderBase()
     return;
 }
 
-#define CHECK_AND_CREATE_HEADER(_hdr)                                                                                  \
-    szNameA = CHttpHeader##_hdr::GetHeaderNameStatic();                                                                \
-    if (StrNCompareA(szHeaderNameA, szNameA, nHeaderNameLen, TRUE) == 0 && szNameA[nHeaderNameLen] == 0)               \
-    {                                                                                                                  \
-        *lplpHeader = MX_DEBUG_NEW CHttpHeader##_hdr();                                                                \
-        return (*lplpHeader != NULL) ? S_OK : E_OUTOFMEMORY;                                                           \
-    }
 HRESULT CHttpHeaderBase::Create(_In_ LPCSTR szHeaderNameA, _In_ BOOL bIsRequest, _Out_ CHttpHeaderBase **lplpHeader,
                                 _In_opt_ SIZE_T nHeaderNameLen)
 {
     TAutoRefCounted<CHttpHeaderGeneric> cHeaderGeneric;
-    LPCSTR szNameA;
     HRESULT hRes;
 
     if (lplpHeader == NULL)
@@ -68,55 +87,23 @@ HRESULT CHttpHeaderBase::Create(_In_ LPCSTR szHeaderNameA, _In_ BOOL bIsRequest,
     }
 
     // create header
-    if (bIsRequest != FALSE)
-    {
-        CHECK_AND_CREATE_HEADER(ReqAccept);
-        CHECK_AND_CREATE_HEADER(ReqAcceptCharset);
-        CHECK_AND_CREATE_HEADER(ReqAcceptEncoding);
-        CHECK_AND_CREATE_HEADER(ReqAcceptLanguage);
-        CHECK_AND_CREATE_HEADER(ReqCacheControl);
-        CHECK_AND_CREATE_HEADER(ReqExpect);
-        CHECK_AND_CREATE_HEADER(ReqHost);
-        CHECK_AND_CREATE_HEADER(ReqIfMatch);
-        CHECK_AND_CREATE_HEADER(ReqIfNoneMatch);
-        CHECK_AND_CREATE_HEADER(ReqIfModifiedSince);
-        CHECK_AND_CREATE_HEADER(ReqIfUnmodifiedSince);
-        CHECK_AND_CREATE_HEADER(ReqRange);
-        CHECK_AND_CREATE_HEADER(ReqReferer);
-        CHECK_AND_CREATE_HEADER(ReqSecWebSocketKey);
-        CHECK_AND_CREATE_HEADER(ReqSecWebSocketProtocol);
-        CHECK_AND_CREATE_HEADER(ReqSecWebSocketVersion);
-    }
-    else
+    if (nHeaderNameLen <= HTTPHEADERS_MAX_KEY_LENGTH)
     {
-        CHECK_AND_CREATE_HEADER(RespAcceptRanges);
-        CHECK_AND_CREATE_HEADER(RespAge);
-        CHECK_AND_CREATE_HEADER(RespCacheControl);
-        CHECK_AND_CREATE_HEADER(RespETag);
-        CHECK_AND_CREATE_HEADER(RespLocation);
-        CHECK_AND_CREATE_HEADER(RespRetryAfter);
-        CHECK_AND_CREATE_HEADER(RespWwwAuthenticate);
-        CHECK_AND_CREATE_HEADER(RespProxyAuthenticate);
-        CHECK_AND_CREATE_HEADER(RespSecWebSocketAccept);
-        CHECK_AND_CREATE_HEADER(RespSecWebSocketProtocol);
-        CHECK_AND_CREATE_HEADER(RespSecWebSocketVersion);
-    }
-    //----
-    CHECK_AND_CREATE_HEADER(EntAllow);
-    CHECK_AND_CREATE_HEADER(EntContentDisposition);
-    CHECK_AND_CREATE_HEADER(EntContentEncoding);
-    CHECK_AND_CREATE_HEADER(EntContentLanguage);
-    CHECK_AND_CREATE_HEADER(EntContentLength);
-    CHECK_AND_CREATE_HEADER(EntContentRange);
-    CHECK_AND_CREATE_HEADER(EntContentType);
-    CHECK_AND_CREATE_HEADER(EntExpires);
-    CHECK_AND_CREATE_HEADER(EntLastModified);
-    //----
-    CHECK_AND_CREATE_HEADER(GenConnection);
-    CHECK_AND_CREATE_HEADER(GenDate);
-    CHECK_AND_CREATE_HEADER(GenTransferEncoding);
-    CHECK_AND_CREATE_HEADER(GenSecWebSocketExtensions);
-    CHECK_AND_CREATE_HEADER(GenUpgrade);
+        const HTTPHEADER_DEF *lpDef;
+        lpfnCreateHttpHeader lpfnCreate;
+
+        lpDef = &aHttpHeaders[PerfectHash::Lookup<CHAR>(aHttpHeadersDisplacements, HTTPHEADERS_COUNT, szHeaderNameA,
+                                                        nHeaderNameLen, TRUE)];
+        if (StrNCompareA(szHeaderNameA, lpDef->szNameA, nHeaderNameLen, TRUE) == 0 && lpDef->szNameA[nHeaderNameLen] == 0)
+        {
+            lpfnCreate = (bIsRequest != FALSE) ? lpDef->lpfnCreateRequest : lpDef->lpfnCreateResponse;
+            if (lpfnCreate != NULL)
+            {
+                *lplpHeader = lpfnCreate();
+                return (*lplpHeader != NULL) ? S_OK : E_OUTOFMEMORY;
+            }
+        }
+    }
 
     // else create a generic header
     cHeaderGeneric.Attach(MX_DEBUG_NEW CHttpHeaderGeneric());
@@ -131,7 +118,6 @@ HRESULT CHttpHeaderBase::Create(_In_ LPCSTR szHeaderNameA, _In_ BOOL bIsRequest,
     }
     return hRes;
 }
-#undef CHECK_AND_CREATE_HEADER
 
 HRESULT CHttpHeaderBase::Parse(_In_z_ LPCWSTR szValueW, _In_opt_ SIZE_T nValueLen)
 {
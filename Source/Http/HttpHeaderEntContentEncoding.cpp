@@ -78,6 +78,17 @@ HRESULT CHttpHeaderEntContentEncoding::Parse(_In_z_ LPCSTR szValueA, _In_opt_ SI
         // check encoding
         switch ((SIZE_T)(szValueA - szStartA))
         {
+            case 2:
+                if (StrNCompareA(szStartA, "br", 2, TRUE) == 0)
+                {
+                    _nEncoding = eEncoding::Brotli;
+                }
+                else
+                {
+                    return MX_E_Unsupported;
+                }
+                break;
+
             case 4:
                 if (StrNCompareA(szStartA, "gzip", 4, TRUE) == 0)
                 {
@@ -176,6 +187,13 @@ HRESULT CHttpHeaderEntContentEncoding::Build(_Inout_ CStringA &cStrDestA, _In_ H
                 return E_OUTOFMEMORY;
             }
             return S_OK;
+
+        case eEncoding::Brotli:
+            if (cStrDestA.Copy("br") == FALSE)
+            {
+                return E_OUTOFMEMORY;
+            }
+            return S_OK;
     }
 
     cStrDestA.Empty();
@@ -185,7 +203,7 @@ HRESULT CHttpHeaderEntContentEncoding::Build(_Inout_ CStringA &cStrDestA, _In_ H
 HRESULT CHttpHeaderEntContentEncoding::SetEncoding(_In_ eEncoding _nEncoding)
 {
     if (_nEncoding != eEncoding::Identity && _nEncoding != eEncoding::GZip && _nEncoding != eEncoding::Deflate &&
-        _nEncoding != eEncoding::Unsupported)
+        _nEncoding != eEncoding::Brotli && _nEncoding != eEncoding::Unsupported)
     {
         return E_INVALIDARG;
     }
@@ -206,9 +206,19 @@ HRESULT CHttpHeaderEntContentRange::Parse(_In_z_ LPCSTR szValueA, _In_opt_ SIZE_
 HRESULT CHttpHeaderEntContentRange::Build(_Inout_ CStringA &cStrDestA, _In_ Http::eBrowser nBrowser)
 {
     // fill ranges
-    if (cStrDestA.Format("bytes %I64u-%I64u/", nByteStart, nByteEnd) == FALSE)
+    if (nByteStart == ULONGLONG_MAX)
     {
-        return E_OUTOFMEMORY;
+        if (cStrDestA.CopyN("bytes */", 8) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+    else
+    {
+        if (cStrDestA.Format("bytes %I64u-%I64u/", nByteStart, nByteEnd) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
     }
     if (nTotalBytes == ULONGLONG_MAX)
     {
@@ -241,6 +251,17 @@ HRESULT CHttpHeaderEntContentRange::SetRange(_In_ ULONGLONG _nByteStart, _In_ UL
     return S_OK;
 }
 
+HRESULT CHttpHeaderEntContentRange::SetUnsatisfiedRange(_In_ ULONGLONG _nTotalBytes)
+{
+    if (_nTotalBytes == ULONGLONG_MAX)
+    {
+        return E_INVALIDARG;
+    }
+    nByteStart = nByteEnd = ULONGLONG_MAX;
+    nTotalBytes = _nTotalBytes;
+    return S_OK;
+}
+
 ULONGLONG CHttpHeaderEntContentRange::GetRangeStart() const
 {
     return nByteStart;
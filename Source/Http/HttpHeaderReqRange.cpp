@@ -56,7 +56,7 @@ HRESULT CHttpHeaderReqRange::Parse(_In_z_ LPCSTR szValueA, _In_opt_ SIZE_T nValu
     szValueA = SkipSpaces(szValueA, szValueEndA);
 
     // check units
-    if ((SIZE_T)(szValueEndA - szValueA) < 5 && StrNCompareA(szValueA, "bytes", 5, TRUE) != 0)
+    if ((SIZE_T)(szValueEndA - szValueA) < 5 || StrNCompareA(szValueA, "bytes", 5, TRUE) != 0)
     {
         return MX_E_InvalidData;
     }
@@ -82,6 +82,7 @@ HRESULT CHttpHeaderReqRange::Parse(_In_z_ LPCSTR szValueA, _In_opt_ SIZE_T nValu
         }
 
         sRangeSet.nByteStart = sRangeSet.nByteEnd = 0ui64;
+        sRangeSet.bIsSuffix = TRUE;
 
         // get starting byte
         if (szValueA < szValueEndA && *szValueA != '-')
@@ -106,6 +107,8 @@ HRESULT CHttpHeaderReqRange::Parse(_In_z_ LPCSTR szValueA, _In_opt_ SIZE_T nValu
                 szValueA++;
             }
 
+            sRangeSet.bIsSuffix = FALSE;
+
             // skip spaces
             szValueA = SkipSpaces(szValueA, szValueEndA);
         }
@@ -138,13 +141,17 @@ HRESULT CHttpHeaderReqRange::Parse(_In_z_ LPCSTR szValueA, _In_opt_ SIZE_T nValu
                 szValueA++;
             }
         }
-        else
+        else if (sRangeSet.bIsSuffix == FALSE)
         {
             sRangeSet.nByteEnd = ULONGLONG_MAX;
         }
+        else
+        {
+            return MX_E_InvalidData;
+        }
 
-        // check values
-        if (sRangeSet.nByteStart > sRangeSet.nByteEnd)
+        // check values (in a suffix range set, the end holds the suffix length)
+        if (sRangeSet.bIsSuffix == FALSE && sRangeSet.nByteStart > sRangeSet.nByteEnd)
         {
             return MX_E_InvalidData;
         }
@@ -195,8 +202,22 @@ HRESULT CHttpHeaderReqRange::Build(_Inout_ CStringA &cStrDestA, _In_ Http::eBrow
     }
     for (i = 0; i < nCount; i++)
     {
-        if (cStrDestA.AppendFormat("%c%I64u-%I64u", ((i == 0) ? '=' : ','), cRangeSetsList[i].nByteStart,
-                                   cRangeSetsList[i].nByteEnd) == FALSE)
+        BOOL b;
+
+        if (cRangeSetsList[i].bIsSuffix != FALSE)
+        {
+            b = cStrDestA.AppendFormat("%c-%I64u", ((i == 0) ? '=' : ','), cRangeSetsList[i].nByteEnd);
+        }
+        else if (cRangeSetsList[i].nByteEnd == ULONGLONG_MAX)
+        {
+            b = cStrDestA.AppendFormat("%c%I64u-", ((i == 0) ? '=' : ','), cRangeSetsList[i].nByteStart);
+        }
+        else
+        {
+            b = cStrDestA.AppendFormat("%c%I64u-%I64u", ((i == 0) ? '=' : ','), cRangeSetsList[i].nByteStart,
+                                       cRangeSetsList[i].nByteEnd);
+        }
+        if (b == FALSE)
         {
             return E_OUTOFMEMORY;
         }
@@ -217,6 +238,23 @@ HRESULT CHttpHeaderReqRange::AddRangeSet(_In_ ULONGLONG nByteStart, _In_ ULONGLO
 
     sNewRangeSet.nByteStart = nByteStart;
     sNewRangeSet.nByteEnd = nByteEnd;
+    sNewRangeSet.bIsSuffix = FALSE;
+    if (cRangeSetsList.AddElement(&sNewRangeSet) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CHttpHeaderReqRange::AddSuffixRangeSet(_In_ ULONGLONG nSuffixLength)
+{
+    RANGESET sNewRangeSet;
+
+    sNewRangeSet.nByteStart = 0ui64;
+    sNewRangeSet.nByteEnd = nSuffixLength;
+    sNewRangeSet.bIsSuffix = TRUE;
     if (cRangeSetsList.AddElement(&sNewRangeSet) == FALSE)
     {
         return E_OUTOFMEMORY;
@@ -241,4 +279,41 @@ ULONGLONG CHttpHeaderReqRange::GetRangeSetEnd(_In_ SIZE_T nIndex) const
     return (nIndex < cRangeSetsList.GetCount()) ? cRangeSetsList[nIndex].nByteEnd : 0ui64;
 }
 
+BOOL CHttpHeaderReqRange::IsSuffixRangeSet(_In_ SIZE_T nIndex) const
+{
+    return (nIndex < cRangeSetsList.GetCount()) ? cRangeSetsList[nIndex].bIsSuffix : FALSE;
+}
+
+BOOL CHttpHeaderReqRange::GetRangeSetBounds(_In_ SIZE_T nIndex, _In_ ULONGLONG nTotalSize, _Out_ PULONGLONG lpnByteStart,
+                                            _Out_ PULONGLONG lpnByteEnd) const
+{
+    *lpnByteStart = *lpnByteEnd = 0ui64;
+    if (nIndex >= cRangeSetsList.GetCount() || nTotalSize == 0ui64)
+    {
+        return FALSE;
+    }
+
+    if (cRangeSetsList[nIndex].bIsSuffix != FALSE)
+    {
+        if (cRangeSetsList[nIndex].nByteEnd == 0ui64)
+        {
+            return FALSE;
+        }
+        *lpnByteStart = (cRangeSetsList[nIndex].nByteEnd < nTotalSize) ? (nTotalSize - cRangeSetsList[nIndex].nByteEnd) : 0ui64;
+        *lpnByteEnd = nTotalSize - 1ui64;
+    }
+    else
+    {
+        if (cRangeSetsList[nIndex].nByteStart >= nTotalSize)
+        {
+            return FALSE;
+        }
+        *lpnByteStart = cRangeSetsList[nIndex].nByteStart;
+        *lpnByteEnd = (cRangeSetsList[nIndex].nByteEnd < nTotalSize) ? cRangeSetsList[nIndex].nByteEnd : (nTotalSize - 1ui64);
+    }
+
+    // done
+    return TRUE;
+}
+
 } // namespace MX
@@ -0,0 +1,472 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\..\Include\Http\HttpRequestLimiter.h"
+#include "..\..\Include\FnvHash.h"
+
+#define SWEEP_INTERVAL_US 1000000i64
+
+ //-----------------------------------------------------------
+
+namespace MX {
+
+class CHttpRequestLimiter::CBucket : public virtual CBaseMemObj
+{
+public:
+    CBucket(_In_ LPKEY lpKey) : CBaseMemObj()
+    {
+        ::MxMemCopy(&sKey, lpKey, sizeof(sKey));
+        return;
+    };
+
+    static int InsertCompareFunc(_In_ LPVOID lpContext, _In_ CRedBlackTreeNode *lpNode1, _In_ CRedBlackTreeNode *lpNode2)
+    {
+        CBucket *lpBucket1 = CONTAINING_RECORD(lpNode1, CBucket, cTreeNode);
+        CBucket *lpBucket2 = CONTAINING_RECORD(lpNode2, CBucket, cTreeNode);
+
+        return ::MxMemCompare(&(lpBucket1->sKey), &(lpBucket2->sKey), sizeof(KEY));
+    };
+
+    static int SearchCompareFunc(_In_ LPVOID lpContext, _In_ LPKEY lpKey, _In_ CRedBlackTreeNode *lpNode)
+    {
+        CBucket *lpBucket = CONTAINING_RECORD(lpNode, CBucket, cTreeNode);
+
+        return ::MxMemCompare(lpKey, &(lpBucket->sKey), sizeof(KEY));
+    };
+
+public:
+    KEY sKey;
+    LONG volatile nConnections{ 0 };
+    LONGLONG volatile llTat{ 0 };
+    CRedBlackTreeNode cTreeNode;
+};
+
+//-----------------------------------------------------------
+
+CHttpRequestLimiter::CHttpRequestLimiter() : CBaseMemObj(), CNonCopyableObj()
+{
+    for (SIZE_T i = 0; i < MX_ARRAYLEN(aShards); i++)
+    {
+        SlimRWL_Initialize(&(aShards[i].sRwMutex));
+        aShards[i].llLastSweepUs = 0;
+    }
+
+    if (!NT_SUCCESS(::MxNtQueryPerformanceCounter((PLARGE_INTEGER)&uliStart, (PLARGE_INTEGER)&uliFrequency)))
+    {
+        uliStart.HighPart = 0;
+#pragma warning(suppress : 28159)
+        uliStart.LowPart = ::GetTickCount();
+        uliFrequency.QuadPart = 0ui64;
+    }
+    return;
+}
+
+CHttpRequestLimiter::~CHttpRequestLimiter()
+{
+    for (SIZE_T i = 0; i < MX_ARRAYLEN(aShards); i++)
+    {
+        CAutoSlimRWLExclusive cLock(&(aShards[i].sRwMutex));
+        CRedBlackTreeNode *lpNode;
+
+        while ((lpNode = aShards[i].cTree.GetFirst()) != NULL)
+        {
+            CBucket *lpBucket = CONTAINING_RECORD(lpNode, CBucket, cTreeNode);
+
+            lpNode->Remove();
+            delete lpBucket;
+        }
+    }
+    return;
+}
+
+VOID CHttpRequestLimiter::SetMaxConnectionsPerIp(_In_ DWORD dwLimit)
+{
+    dwMaxConnectionsPerIp = dwLimit;
+    return;
+}
+
+VOID CHttpRequestLimiter::SetMaxConnectionsPerSubnet(_In_ DWORD dwLimit)
+{
+    dwMaxConnectionsPerSubnet = dwLimit;
+    return;
+}
+
+VOID CHttpRequestLimiter::SetSubnetPrefixLength(_In_ DWORD dwIPv4Bits, _In_ DWORD dwIPv6Bits)
+{
+    dwIPv4SubnetBits = (dwIPv4Bits <= 32) ? dwIPv4Bits : 32;
+    dwIPv6SubnetBits = (dwIPv6Bits <= 128) ? dwIPv6Bits : 128;
+    return;
+}
+
+VOID CHttpRequestLimiter::SetMaxRequestsPerSecond(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize)
+{
+    SetRate(&sServerRate, dwMaxRequestsPerSecond, dwBurstSize);
+    return;
+}
+
+VOID CHttpRequestLimiter::SetMaxRequestsPerSecondPerIp(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize)
+{
+    SetRate(&sIpRate, dwMaxRequestsPerSecond, dwBurstSize);
+    return;
+}
+
+VOID CHttpRequestLimiter::SetMaxRequestsPerSecondPerSubnet(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize)
+{
+    SetRate(&sSubnetRate, dwMaxRequestsPerSecond, dwBurstSize);
+    return;
+}
+
+BOOL CHttpRequestLimiter::IsTrackingAddresses() const
+{
+    return (dwMaxConnectionsPerIp != 0 || dwMaxConnectionsPerSubnet != 0 || sIpRate.llIntervalUs != 0 ||
+            sSubnetRate.llIntervalUs != 0) ? TRUE : FALSE;
+}
+
+HRESULT CHttpRequestLimiter::AddConnection(_In_ PSOCKADDR_INET lpAddr, _Out_ LPCONNECTION lpConn)
+{
+    KEY sKey;
+    HRESULT hRes;
+
+    if (lpConn == NULL)
+    {
+        return E_POINTER;
+    }
+    lpConn->lpIpBucket = lpConn->lpSubnetBucket = NULL;
+    if (lpAddr == NULL)
+    {
+        return E_POINTER;
+    }
+    if (lpAddr->si_family != AF_INET && lpAddr->si_family != AF_INET6)
+    {
+        return S_OK; //untracked
+    }
+
+    if (dwMaxConnectionsPerIp != 0 || sIpRate.llIntervalUs != 0)
+    {
+        BuildKey(&sKey, lpAddr, FALSE, dwIPv4SubnetBits, dwIPv6SubnetBits);
+        lpConn->lpIpBucket = AcquireBucket(&sKey, dwMaxConnectionsPerIp, hRes);
+        if (lpConn->lpIpBucket == NULL)
+        {
+            if (hRes == E_ACCESSDENIED)
+            {
+                _InterlockedIncrement64(&(sStats.nConnectionsRejectedByIp));
+            }
+            return hRes;
+        }
+    }
+
+    if (dwMaxConnectionsPerSubnet != 0 || sSubnetRate.llIntervalUs != 0)
+    {
+        BuildKey(&sKey, lpAddr, TRUE, dwIPv4SubnetBits, dwIPv6SubnetBits);
+        lpConn->lpSubnetBucket = AcquireBucket(&sKey, dwMaxConnectionsPerSubnet, hRes);
+        if (lpConn->lpSubnetBucket == NULL)
+        {
+            if (hRes == E_ACCESSDENIED)
+            {
+                _InterlockedIncrement64(&(sStats.nConnectionsRejectedBySubnet));
+            }
+            RemoveConnection(lpConn);
+            return hRes;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+VOID CHttpRequestLimiter::RemoveConnection(_Inout_ LPCONNECTION lpConn)
+{
+    // NOTE: Buckets are not freed here. Once the last connection is gone, they will be lazily removed after its
+    //       tokens are refilled so a client cannot reset its request rate by reconnecting.
+    if (lpConn != NULL)
+    {
+        if (lpConn->lpIpBucket != NULL)
+        {
+            _InterlockedDecrement(&(lpConn->lpIpBucket->nConnections));
+            lpConn->lpIpBucket = NULL;
+        }
+        if (lpConn->lpSubnetBucket != NULL)
+        {
+            _InterlockedDecrement(&(lpConn->lpSubnetBucket->nConnections));
+            lpConn->lpSubnetBucket = NULL;
+        }
+    }
+    return;
+}
+
+BOOL CHttpRequestLimiter::AllowRequest(_In_opt_ LPCONNECTION lpConn)
+{
+    LONGLONG llNowUs;
+
+    if (sServerRate.llIntervalUs == 0 && sIpRate.llIntervalUs == 0 && sSubnetRate.llIntervalUs == 0)
+    {
+        return TRUE;
+    }
+
+    llNowUs = GetTimeUs();
+
+    // check the narrowest buckets first so an abusive client does not consume the server-wide budget
+    if (lpConn != NULL)
+    {
+        if (lpConn->lpIpBucket != NULL && ConsumeToken(&(lpConn->lpIpBucket->llTat), &sIpRate, llNowUs) == FALSE)
+        {
+            _InterlockedIncrement64(&(sStats.nRequestsRejectedByIp));
+            return FALSE;
+        }
+        if (lpConn->lpSubnetBucket != NULL &&
+            ConsumeToken(&(lpConn->lpSubnetBucket->llTat), &sSubnetRate, llNowUs) == FALSE)
+        {
+            _InterlockedIncrement64(&(sStats.nRequestsRejectedBySubnet));
+            return FALSE;
+        }
+    }
+    if (ConsumeToken(&llServerTat, &sServerRate, llNowUs) == FALSE)
+    {
+        _InterlockedIncrement64(&(sStats.nRequestsRejectedByServer));
+        return FALSE;
+    }
+
+    // done
+    return TRUE;
+}
+
+VOID CHttpRequestLimiter::GetStats(_Out_ LPSTATS lpStats)
+{
+    if (lpStats != NULL)
+    {
+        lpStats->nIpBuckets = (ULONGLONG)__InterlockedRead64(&(sStats.nIpBuckets));
+        lpStats->nSubnetBuckets = (ULONGLONG)__InterlockedRead64(&(sStats.nSubnetBuckets));
+        lpStats->nConnectionsRejectedByIp = (ULONGLONG)__InterlockedRead64(&(sStats.nConnectionsRejectedByIp));
+        lpStats->nConnectionsRejectedBySubnet = (ULONGLONG)__InterlockedRead64(&(sStats.nConnectionsRejectedBySubnet));
+        lpStats->nRequestsRejectedByServer = (ULONGLONG)__InterlockedRead64(&(sStats.nRequestsRejectedByServer));
+        lpStats->nRequestsRejectedByIp = (ULONGLONG)__InterlockedRead64(&(sStats.nRequestsRejectedByIp));
+        lpStats->nRequestsRejectedBySubnet = (ULONGLONG)__InterlockedRead64(&(sStats.nRequestsRejectedBySubnet));
+        lpStats->nExpiredBuckets = (ULONGLONG)__InterlockedRead64(&(sStats.nExpiredBuckets));
+    }
+    return;
+}
+
+CHttpRequestLimiter::CBucket *CHttpRequestLimiter::AcquireBucket(_In_ LPKEY lpKey, _In_ DWORD dwMaxConnections,
+                                                                 _Out_ HRESULT &hRes)
+{
+    LPSHARD lpShard;
+    CBucket *lpBucket, *lpNewBucket;
+    CRedBlackTreeNode *lpNode;
+
+    lpShard = &aShards[fnv_32a_buf(lpKey, sizeof(KEY), FNV1A_32_INIT) & (MX_HTTP_REQUEST_LIMITER_SHARDS_COUNT - 1)];
+
+    // fast path, the bucket already exists
+    {
+        CAutoSlimRWLShared cLock(&(lpShard->sRwMutex));
+
+        lpNode = lpShard->cTree.Find(lpKey, &CBucket::SearchCompareFunc);
+        if (lpNode != NULL)
+        {
+            lpBucket = CONTAINING_RECORD(lpNode, CBucket, cTreeNode);
+
+            if ((DWORD)_InterlockedIncrement(&(lpBucket->nConnections)) > dwMaxConnections && dwMaxConnections != 0)
+            {
+                _InterlockedDecrement(&(lpBucket->nConnections));
+                hRes = E_ACCESSDENIED;
+                return NULL;
+            }
+            hRes = S_OK;
+            return lpBucket;
+        }
+    }
+
+    // slow path, create a new bucket
+    lpNewBucket = MX_DEBUG_NEW CBucket(lpKey);
+    if (lpNewBucket == NULL)
+    {
+        hRes = E_OUTOFMEMORY;
+        return NULL;
+    }
+
+    {
+        CAutoSlimRWLExclusive cLock(&(lpShard->sRwMutex));
+        LONGLONG llNowUs;
+
+        llNowUs = GetTimeUs();
+        if (llNowUs - lpShard->llLastSweepUs >= SWEEP_INTERVAL_US)
+        {
+            SweepShard(lpShard, llNowUs);
+            lpShard->llLastSweepUs = llNowUs;
+        }
+
+        if (lpShard->cTree.Insert(&(lpNewBucket->cTreeNode), &CBucket::InsertCompareFunc, FALSE, &lpNode) != FALSE)
+        {
+            lpBucket = lpNewBucket;
+            _InterlockedIncrement64((lpKey->bIsSubnet != FALSE) ? &(sStats.nSubnetBuckets) : &(sStats.nIpBuckets));
+        }
+        else
+        {
+            delete lpNewBucket;
+            lpBucket = CONTAINING_RECORD(lpNode, CBucket, cTreeNode);
+        }
+
+        if ((DWORD)_InterlockedIncrement(&(lpBucket->nConnections)) > dwMaxConnections && dwMaxConnections != 0)
+        {
+            _InterlockedDecrement(&(lpBucket->nConnections));
+            hRes = E_ACCESSDENIED;
+            return NULL;
+        }
+    }
+
+    // done
+    hRes = S_OK;
+    return lpBucket;
+}
+
+VOID CHttpRequestLimiter::SweepShard(_In_ LPSHARD lpShard, _In_ LONGLONG llNowUs)
+{
+    CRedBlackTreeNode *lpNode, *lpNextNode;
+
+    // NOTE: Shard must be exclusively locked so no new connection can reference a bucket being removed
+    lpNode = lpShard->cTree.GetFirst();
+    while (lpNode != NULL)
+    {
+        CBucket *lpBucket = CONTAINING_RECORD(lpNode, CBucket, cTreeNode);
+
+        lpNextNode = lpNode->GetNext();
+        if (__InterlockedRead(&(lpBucket->nConnections)) == 0 && __InterlockedRead64(&(lpBucket->llTat)) <= llNowUs)
+        {
+            _InterlockedDecrement64((lpBucket->sKey.bIsSubnet != FALSE) ? &(sStats.nSubnetBuckets) : &(sStats.nIpBuckets));
+            _InterlockedIncrement64(&(sStats.nExpiredBuckets));
+
+            lpNode->Remove();
+            delete lpBucket;
+        }
+        lpNode = lpNextNode;
+    }
+    return;
+}
+
+BOOL CHttpRequestLimiter::ConsumeToken(_Inout_ LONGLONG volatile *lpllTat, _In_ LPRATE lpRate, _In_ LONGLONG llNowUs)
+{
+    LONGLONG llTat, llNewTat;
+
+    if (lpRate->llIntervalUs == 0)
+    {
+        return TRUE;
+    }
+
+    // generic cell rate algorithm: the bucket stores the theoretical arrival time of the next request
+    do
+    {
+        llTat = __InterlockedRead64(lpllTat);
+        llNewTat = (llTat > llNowUs) ? llTat : llNowUs;
+        if (llNewTat - llNowUs > lpRate->llToleranceUs)
+        {
+            return FALSE;
+        }
+        llNewTat += lpRate->llIntervalUs;
+    }
+    while (_InterlockedCompareExchange64(lpllTat, llNewTat, llTat) != llTat);
+
+    // done
+    return TRUE;
+}
+
+LONGLONG CHttpRequestLimiter::GetTimeUs() const
+{
+    if (uliFrequency.QuadPart != 0ui64)
+    {
+        ULARGE_INTEGER uliNow, _uliFrequency;
+        ULONGLONG ullDiff;
+
+        ::MxNtQueryPerformanceCounter((PLARGE_INTEGER)&uliNow, (PLARGE_INTEGER)&_uliFrequency);
+        ullDiff = uliNow.QuadPart - uliStart.QuadPart;
+        return (LONGLONG)((ullDiff / uliFrequency.QuadPart) * 1000000ui64 +
+                          ((ullDiff % uliFrequency.QuadPart) * 1000000ui64) / uliFrequency.QuadPart);
+    }
+#pragma warning(suppress : 28159)
+    return (LONGLONG)(::GetTickCount() - uliStart.LowPart) * 1000i64;
+}
+
+VOID CHttpRequestLimiter::SetRate(_Out_ LPRATE lpRate, _In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize)
+{
+    if (dwMaxRequestsPerSecond == 0)
+    {
+        lpRate->llIntervalUs = lpRate->llToleranceUs = 0;
+        return;
+    }
+    if (dwBurstSize == 0)
+    {
+        dwBurstSize = dwMaxRequestsPerSecond;
+    }
+    lpRate->llIntervalUs = 1000000i64 / (LONGLONG)dwMaxRequestsPerSecond;
+    if (lpRate->llIntervalUs == 0)
+    {
+        lpRate->llIntervalUs = 1;
+    }
+    lpRate->llToleranceUs = lpRate->llIntervalUs * (LONGLONG)(dwBurstSize - 1);
+    return;
+}
+
+VOID CHttpRequestLimiter::BuildKey(_Out_ LPKEY lpKey, _In_ PSOCKADDR_INET lpAddr, _In_ BOOL bIsSubnet, _In_ DWORD dwIPv4Bits,
+                                   _In_ DWORD dwIPv6Bits)
+{
+    static const BYTE aIPv4MappedPrefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+    DWORD dwBits;
+
+    ::MxMemSet(lpKey, 0, sizeof(KEY));
+
+    if (lpAddr->si_family == AF_INET6 &&
+        ::MxMemCompare(lpAddr->Ipv6.sin6_addr.u.Byte, aIPv4MappedPrefix, sizeof(aIPv4MappedPrefix)) != 0)
+    {
+        ::MxMemCopy(lpKey->aAddress, lpAddr->Ipv6.sin6_addr.u.Byte, 16);
+        lpKey->nFamily = 6;
+        dwBits = (bIsSubnet != FALSE) ? dwIPv6Bits : 128;
+    }
+    else
+    {
+        // NOTE: IPv4-mapped IPv6 addresses share the bucket with the plain IPv4 address
+        if (lpAddr->si_family == AF_INET6)
+        {
+            ::MxMemCopy(lpKey->aAddress, lpAddr->Ipv6.sin6_addr.u.Byte + 12, 4);
+        }
+        else
+        {
+            ::MxMemCopy(lpKey->aAddress, &(lpAddr->Ipv4.sin_addr.S_un.S_addr), 4);
+        }
+        lpKey->nFamily = 4;
+        dwBits = (bIsSubnet != FALSE) ? dwIPv4Bits : 32;
+    }
+
+    // mask host bits
+    for (DWORD i = 0; i < 16; i++)
+    {
+        if (dwBits >= 8)
+        {
+            dwBits -= 8;
+        }
+        else
+        {
+            lpKey->aAddress[i] &= (BYTE)(0xFF00 >> dwBits);
+            dwBits = 0;
+        }
+    }
+    lpKey->nPrefixLength = (BYTE)((lpKey->nFamily == 6) ? ((bIsSubnet != FALSE) ? dwIPv6Bits : 128)
+                                                      : ((bIsSubnet != FALSE) ? dwIPv4Bits : 32));
+    lpKey->bIsSubnet = (bIsSubnet != FALSE) ? 1 : 0;
+    return;
+}
+
+} // namespace MX
@@ -27,6 +27,8 @@
 
 #define MAX_ACCEPTS_PER_SECOND 65536
 
+#define MAX_RECYCLED_REQUEST_PROBES 8
+
  //-----------------------------------------------------------
 
 static const LPCSTR szServerInfoA = "MX-Library";
@@ -218,17 +220,15 @@ CHttpServer::~CHttpServer()
     }
     while (b == FALSE);
 
-    // remove limiters
+    // free recycled requests (nothing can be added once the list is empty, see OnSocketDestroy)
     {
-        CAutoSlimRWLExclusive cLimiterLock(&(sRequestLimiter.sRwMutex));
-        CRedBlackTreeNode *lpNode;
+        CFastLock cLock(&(sRecycledRequests.nMutex));
+        CLnkLstNode *lpNode;
 
-        while ((lpNode = sRequestLimiter.cTree.GetFirst()) != NULL)
+        while ((lpNode = sRecycledRequests.cList.PopHead()) != NULL)
         {
-            CRequestLimiter *lpLimiter = CONTAINING_RECORD(lpNode, CRequestLimiter, cTreeNode);
-
-            lpNode->Remove();
-            delete lpLimiter;
+            lpRequest = CONTAINING_RECORD(lpNode, CClientRequest, cListNode);
+            lpRequest->Release();
         }
     }
 
@@ -242,7 +242,29 @@ VOID CHttpServer::SetOption_MaxConnectionsPerIp(_In_ DWORD dwLimit)
 
     if (hAcceptConn == NULL)
     {
-        dwMaxConnectionsPerIp = (dwLimit == 0) ? 0xFFFFFFFFUL : dwLimit;
+        cRequestLimiter.SetMaxConnectionsPerIp(dwLimit);
+    }
+    return;
+}
+
+VOID CHttpServer::SetOption_MaxConnectionsPerSubnet(_In_ DWORD dwLimit)
+{
+    CCriticalSection::CAutoLock cLock(cs);
+
+    if (hAcceptConn == NULL)
+    {
+        cRequestLimiter.SetMaxConnectionsPerSubnet(dwLimit);
+    }
+    return;
+}
+
+VOID CHttpServer::SetOption_SubnetPrefixLength(_In_ DWORD dwIPv4Bits, _In_ DWORD dwIPv6Bits)
+{
+    CCriticalSection::CAutoLock cLock(cs);
+
+    if (hAcceptConn == NULL)
+    {
+        cRequestLimiter.SetSubnetPrefixLength(dwIPv4Bits, dwIPv6Bits);
     }
     return;
 }
@@ -435,21 +457,52 @@ VOID CHttpServer::SetOption_MaxIncomingBytesWhileSending(_In_ DWORD _dwMaxIncomi
     return;
 }
 
-VOID CHttpServer::SetOption_MaxRequestsPerSecond(_In_ DWORD _dwMaxRequestsPerSecond, _In_ DWORD _dwBurstSize)
+VOID CHttpServer::SetOption_MaxRequestsPerSecond(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize)
 {
     CCriticalSection::CAutoLock cLock(cs);
 
     if (hAcceptConn == NULL)
     {
-        dwMaxRequestsPerSecond = (_dwMaxRequestsPerSecond > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND : _dwMaxRequestsPerSecond;
+        cRequestLimiter.SetMaxRequestsPerSecond((dwMaxRequestsPerSecond > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND
+                                                                                                  : dwMaxRequestsPerSecond,
+                                                (dwBurstSize > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND : dwBurstSize);
+    }
+    return;
+}
 
-        if (_dwBurstSize > 0)
-        {
-            dwMaxRequestsPerSecond *= 1000;
+VOID CHttpServer::SetOption_MaxRequestsPerSecondPerIp(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize)
+{
+    CCriticalSection::CAutoLock cLock(cs);
 
-            dwMaxRequestsBurstSize = (_dwBurstSize > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND : _dwBurstSize;
-            dwMaxRequestsBurstSize *= 1000;
-        }
+    if (hAcceptConn == NULL)
+    {
+        cRequestLimiter.SetMaxRequestsPerSecondPerIp((dwMaxRequestsPerSecond > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND
+                                                                                                       : dwMaxRequestsPerSecond,
+                                                     (dwBurstSize > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND : dwBurstSize);
+    }
+    return;
+}
+
+VOID CHttpServer::SetOption_MaxRequestsPerSecondPerSubnet(_In_ DWORD dwMaxRequestsPerSecond, _In_ DWORD dwBurstSize)
+{
+    CCriticalSection::CAutoLock cLock(cs);
+
+    if (hAcceptConn == NULL)
+    {
+        cRequestLimiter.SetMaxRequestsPerSecondPerSubnet((dwMaxRequestsPerSecond > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND
+                                                                                                           : dwMaxRequestsPerSecond,
+                                                         (dwBurstSize > MAX_ACCEPTS_PER_SECOND) ? MAX_ACCEPTS_PER_SECOND : dwBurstSize);
+    }
+    return;
+}
+
+VOID CHttpServer::SetOption_MaxRecycledRequests(_In_ DWORD dwCount)
+{
+    CCriticalSection::CAutoLock cLock(cs);
+
+    if (hAcceptConn == NULL)
+    {
+        dwMaxRecycledRequests = dwCount;
     }
     return;
 }
@@ -590,6 +643,12 @@ VOID CHttpServer::StopListening()
     return;
 }
 
+VOID CHttpServer::GetRequestLimiterStats(_Out_ CHttpRequestLimiter::LPSTATS lpStats)
+{
+    cRequestLimiter.GetStats(lpStats);
+    return;
+}
+
 VOID CHttpServer::OnHeadersTimeoutTimerCallback(_In_ LONG nTimerId, _In_ LPVOID lpUserData, _In_opt_ LPBOOL lpbCancel)
 {
     CAutoRundownProtection cAutoRundownProt(&nRundownLock);
@@ -645,7 +704,12 @@ VOID CHttpServer::OnThroughputTimerCallback(_In_ LONG nTimerId, _In_ LPVOID lpUs
             switch (lpRequest->nState)
             {
                 case CClientRequest::eState::ReceivingRequestBody:
-                    if (SUCCEEDED(cSocketMgr.GetReadStats(lpRequest->hConn, NULL, &nKbps)))
+                    // a paused body is not the client's fault
+                    if ((__InterlockedRead(&(lpRequest->nFlags)) & REQUEST_FLAG_BodyPaused) != 0)
+                    {
+                        lpRequest->dwLowThroughputCounter = 0;
+                    }
+                    else if (SUCCEEDED(cSocketMgr.GetReadStats(lpRequest->hConn, NULL, &nKbps)))
                     {
                         if (nKbps < nRequestBodyMinimumThroughputInKbps)
                         {
@@ -796,7 +860,6 @@ HRESULT CHttpServer::OnSocketCreate(_In_ CIpc *lpIpc, _In_ HANDLE h, _Inout_ CIp
     {
         case CIpc::eConnectionClass::Listener:
             // setup callbacks
-            sLimiter.cTimer.Reset();
             sData.cDestroyCallback = MX_BIND_MEMBER_CALLBACK(&CHttpServer::OnListenerSocketDestroy, this);
             break;
 
@@ -821,7 +884,15 @@ HRESULT CHttpServer::OnSocketCreate(_In_ CIpc *lpIpc, _In_ HANDLE h, _Inout_ CIp
                 }
                 else
                 {
-                    cNewRequest.Attach(MX_DEBUG_NEW CClientRequest());
+                    cNewRequest.Attach(GetRecycledRequest());
+                    if (!cNewRequest)
+                    {
+                        cNewRequest.Attach(MX_DEBUG_NEW CClientRequest());
+                        if (cNewRequest)
+                        {
+                            cNewRequest->bRecyclable = TRUE;
+                        }
+                    }
                 }
                 if (!cNewRequest)
                 {
@@ -865,34 +936,7 @@ VOID CHttpServer::OnSocketDestroy(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ CIpc::CU
 
     RundownProt_WaitForRelease(&(lpRequest->nTimerCallbackRundownLock));
 
-    if (lpRequest->sPeerAddr.si_family != 0)
-    {
-        CAutoSlimRWLShared cLimiterLock(&(sRequestLimiter.sRwMutex));
-        CRedBlackTreeNode *lpNode;
-
-        lpNode = sRequestLimiter.cTree.Find(&(lpRequest->sPeerAddr), &CRequestLimiter::SearchCompareFunc);
-        if (lpNode != NULL)
-        {
-            CRequestLimiter *lpLimiter = CONTAINING_RECORD(lpNode, CRequestLimiter, cTreeNode);
-
-            if ((DWORD)_InterlockedDecrement(&(lpLimiter->nCount)) == 0)
-            {
-                cLimiterLock.UpgradeToExclusive();
-
-                lpNode = sRequestLimiter.cTree.Find(&(lpRequest->sPeerAddr), &CRequestLimiter::SearchCompareFunc);
-                if (lpNode != NULL)
-                {
-                    lpLimiter = CONTAINING_RECORD(lpNode, CRequestLimiter, cTreeNode);
-
-                    if (__InterlockedRead(&(lpLimiter->nCount)) == 0)
-                    {
-                        lpNode->Remove();
-                        delete lpLimiter;
-                    }
-                }
-            }
-        }
-    }
+    cRequestLimiter.RemoveConnection(&(lpRequest->sLimiterConn));
 
     {
         CCriticalSection::CAutoLock cLock(lpRequest->cMutex);
@@ -910,6 +954,13 @@ VOID CHttpServer::OnSocketDestroy(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ CIpc::CU
     // stop timers
     lpRequest->StopTimeoutTimers(CClientRequest::eTimeoutTimer::All);
 
+    if (cRequestDestroyedCallback)
+    {
+        cRequestDestroyedCallback(this, lpRequest);
+    }
+
+    // NOTE: The request is moved to the recycle pool in the same critical section that removes it from the list
+    //       so the destructor, which waits for the list to drain before freeing the pool, cannot miss it.
     {
         CAutoSlimRWLExclusive cListLock(&sRequestsListRwMutex);
 
@@ -917,15 +968,17 @@ VOID CHttpServer::OnSocketDestroy(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ CIpc::CU
         {
             lpRequest->cListNode.Remove();
         }
+        if (lpRequest->bRecyclable != FALSE && RecycleRequest(lpRequest) != FALSE)
+        {
+            lpRequest = NULL;
+        }
     }
 
-    if (cRequestDestroyedCallback)
+    // done
+    if (lpRequest != NULL)
     {
-        cRequestDestroyedCallback(this, lpRequest);
+        lpRequest->Release();
     }
-
-    // done
-    lpRequest->Release();
     return;
 }
 
@@ -943,44 +996,14 @@ HRESULT CHttpServer::OnSocketConnect(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ CIpc:
     MX_ASSERT(lpUserData != NULL);
 
     // count connections from the same IP
-    if (SUCCEEDED(cSocketMgr.GetPeerAddress(h, &(lpRequest->sPeerAddr))) && dwMaxConnectionsPerIp != 0xFFFFFFFFUL)
+    if (SUCCEEDED(cSocketMgr.GetPeerAddress(h, &(lpRequest->sPeerAddr))))
     {
-        CAutoSlimRWLShared cLimiterLock(&(sRequestLimiter.sRwMutex));
-        CRedBlackTreeNode *lpNode;
-
-        lpNode = sRequestLimiter.cTree.Find(&(lpRequest->sPeerAddr), &CRequestLimiter::SearchCompareFunc);
-        if (lpNode != NULL)
+        if (cRequestLimiter.IsTrackingAddresses() != FALSE)
         {
-            CRequestLimiter *lpLimiter = CONTAINING_RECORD(lpNode, CRequestLimiter, cTreeNode);
-
-            if ((DWORD)_InterlockedIncrement(&(lpLimiter->nCount)) > dwMaxConnectionsPerIp)
-            {
-                return E_ACCESSDENIED;
-            }
-        }
-        else
-        {
-            CRequestLimiter *lpNewLimiter;
-            CRedBlackTreeNode *lpMatchingNode;
-
-            lpNewLimiter = MX_DEBUG_NEW CRequestLimiter(&(lpRequest->sPeerAddr));
-            if (lpNewLimiter == NULL)
-            {
-                return E_OUTOFMEMORY;
-            }
-            cLimiterLock.UpgradeToExclusive();
-
-            if (sRequestLimiter.cTree.Insert(&(lpNewLimiter->cTreeNode), &CRequestLimiter::InsertCompareFunc, FALSE,
-                                             &lpMatchingNode) == FALSE)
+            hRes = cRequestLimiter.AddConnection(&(lpRequest->sPeerAddr), &(lpRequest->sLimiterConn));
+            if (FAILED(hRes))
             {
-                CRequestLimiter *lpMatchingLimiter = CONTAINING_RECORD(lpNode, CRequestLimiter, cTreeNode);
-
-                delete lpNewLimiter;
-
-                if ((DWORD)_InterlockedIncrement(&(lpMatchingLimiter->nCount)) > dwMaxConnectionsPerIp)
-                {
-                    return E_ACCESSDENIED;
-                }
+                return hRes;
             }
         }
     }
@@ -1129,6 +1152,13 @@ on_request_error:
             {
                 case CClientRequest::eState::ReceivingRequestHeaders:
                 case CClientRequest::eState::ReceivingRequestBody:
+                    // stop if a streamed body was paused by its consumer, the rest stays buffered until resumed
+                    if ((__InterlockedRead(&(lpRequest->nFlags)) & REQUEST_FLAG_BodyPaused) != 0)
+                    {
+                        bBreakLoop = TRUE;
+                        break;
+                    }
+
                     // process http being received
                     hRes = lpRequest->cRequestParser.Parse(aMsgBuf, nMsgSize, nMsgUsed);
                     if (FAILED(hRes))
@@ -1149,7 +1179,7 @@ on_request_error:
                     switch (nParserState)
                     {
                         case Internals::CHttpParser::eState::BodyStart:
-                            if (CheckRateLimit() != FALSE)
+                            if (CheckRateLimit(lpRequest) != FALSE)
                             {
                                 hRes = MX_E_Busy;
                                 goto on_request_error;
@@ -1175,7 +1205,7 @@ on_request_error:
                             break;
 
                         case Internals::CHttpParser::eState::Done:
-                            if (CheckRateLimit() != FALSE)
+                            if (CheckRateLimit(lpRequest) != FALSE)
                             {
                                 hRes = MX_E_Busy;
                                 goto on_request_error;
@@ -1402,7 +1432,7 @@ on_request_error:
                                 }
                                 else if (StrCompareA(lpHeader->GetType(), "application/json") == 0)
                                 {
-                                    cBodyParser.Attach(MX_DEBUG_NEW CHttpBodyParserJSON());
+                                    cBodyParser.Attach(MX_DEBUG_NEW CHttpBodyParserJSON(NullCallback(), NULL, ullMaxBodySize));
                                 }
                             }
                             if (!cBodyParser)
@@ -1500,60 +1530,57 @@ on_request_error:
     return S_OK;
 }
 
-BOOL CHttpServer::CheckRateLimit()
+BOOL CHttpServer::CheckRateLimit(_In_ CClientRequest *lpRequest)
 {
-    if (dwMaxRequestsPerSecond > 0)
+    return (cRequestLimiter.AllowRequest(&(lpRequest->sLimiterConn)) == FALSE) ? TRUE : FALSE;
+}
+
+CHttpServer::CClientRequest *CHttpServer::GetRecycledRequest()
+{
+    CClientRequest *lpRequest = NULL;
+
     {
-        CFastLock cLock(&(sLimiter.nMutex));
+        CFastLock cLock(&(sRecycledRequests.nMutex));
+        CLnkLst::Iterator it;
+        DWORD dwProbes = 0;
 
-        if (dwMaxRequestsBurstSize == 0)
+        // NOTE: The socket layer drops its own reference after the destroy callback returns, so a recycled
+        //       request can only be reused once ours is the last one left.
+        for (CLnkLstNode *lpNode = it.Begin(sRecycledRequests.cList); lpNode != NULL && dwProbes < MAX_RECYCLED_REQUEST_PROBES;
+             lpNode = it.Next(), dwProbes++)
         {
-            sLimiter.cTimer.Mark();
-            if (sLimiter.cTimer.GetElapsedTimeMs() >= 1000)
-            {
-                sLimiter.dwRequestCounter = 1;
-                sLimiter.cTimer.ResetToLastMark();
-            }
-            else
+            CClientRequest *_lpRequest = CONTAINING_RECORD(lpNode, CClientRequest, cListNode);
+
+            if (_lpRequest->AddRef() == 2)
             {
-                if (sLimiter.dwRequestCounter >= dwMaxRequestsPerSecond)
-                {
-                    return TRUE;
-                }
-                (sLimiter.dwRequestCounter)++;
+                lpNode->Remove();
+                _lpRequest->Release();
+                lpRequest = _lpRequest;
+                break;
             }
+            _lpRequest->Release();
         }
-        else
-        {
-            DWORD dw, dwDiffMs, dwNewExcess;
+    }
 
-            sLimiter.cTimer.Mark();
-            dwDiffMs = sLimiter.cTimer.GetElapsedTimeMs();
-            if ((LONG)dwDiffMs < -60000)
-            {
-                dwDiffMs = 1;
-            }
-            else if ((LONG)dwDiffMs < 0)
-            {
-                dwDiffMs = 0;
-            }
+    if (lpRequest != NULL)
+    {
+        lpRequest->ResetForReuse();
+    }
 
-            dw = (dwMaxRequestsPerSecond * dwDiffMs) / 1000;
-            dwNewExcess = (sLimiter.dwCurrentExcess + 1000 >= dw) ? (sLimiter.dwCurrentExcess + 1000 - dw) : 0;
+    // done
+    return lpRequest;
+}
 
-            if (dwNewExcess > dwMaxRequestsBurstSize)
-            {
-                return TRUE;
-            }
+BOOL CHttpServer::RecycleRequest(_In_ CClientRequest *lpRequest)
+{
+    CFastLock cLock(&(sRecycledRequests.nMutex));
 
-            sLimiter.dwCurrentExcess = dwNewExcess;
-            if (dwDiffMs != 0)
-            {
-                sLimiter.cTimer.ResetToLastMark();
-            }
-        }
+    if (sRecycledRequests.cList.GetCount() >= (SIZE_T)dwMaxRecycledRequests)
+    {
+        return FALSE;
     }
-    return FALSE;
+    sRecycledRequests.cList.PushTail(&(lpRequest->cListNode));
+    return TRUE;
 }
 
 VOID CHttpServer::TerminateRequest(_In_ CClientRequest *lpRequest, _In_ HRESULT hrErrorCode)
@@ -2062,6 +2089,15 @@ LPCSTR CHttpServer::GetStatusCodeMessage(_In_ LONG nStatusCode)
     return NULL;
 }
 
+VOID CHttpServer::OnResponseOutputDrained(_In_ CIpc *lpIpc, _In_ HANDLE h, _In_ LPVOID lpCookie, _In_ CIpc::CUserData *lpUserData)
+{
+    CClientRequest *lpRequest = (CClientRequest *)lpUserData;
+
+    // NOTE: Do not lock the request here, the signal can be raised while FlushResponse holds the lock.
+    lpRequest->cOutputDrainedEv.Set();
+    return;
+}
+
 BOOL CHttpServer::IsWebSocket(_In_ CClientRequest *lpRequest)
 {
     CHttpHeaderGenConnection *lpHeaderGenConnection;
@@ -2422,6 +2458,11 @@ VOID CHttpServer::OnRequestEnding(_In_ CClientRequest *lpRequest, _In_ HRESULT h
                     hRes = lpRequest->SendQueuedStreams();
                 }
             }
+            else if (SUCCEEDED(hRes) && lpRequest->sResponse.bStreamed != FALSE)
+            {
+                // send the headers if nothing was written and the last chunk
+                hRes = lpRequest->EndChunkedResponse();
+            }
 
             if (SUCCEEDED(hRes))
             {
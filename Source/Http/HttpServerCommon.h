@@ -28,6 +28,7 @@
 #include "..\..\Include\Http\Url.h"
 #include "..\..\Include\MemoryStream.h"
 #include "..\..\Include\FileStream.h"
+#include "..\..\Include\RangeStream.h"
 
  //-----------------------------------------------------------
 
@@ -37,6 +38,7 @@
 #define REQUEST_FLAG_LinkClosed 0x0008
 #define REQUEST_FLAG_HeadersSent 0x0010
 #define REQUEST_FLAG_RequestTimeoutProcessed 0x0020
+#define REQUEST_FLAG_BodyPaused 0x0040
 
 //-----------------------------------------------------------
 
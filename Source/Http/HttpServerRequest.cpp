@@ -21,13 +21,48 @@
 
  //-----------------------------------------------------------
 
-static const CHAR szServerInfoA[] = "MX-Library";
-static const SIZE_T nServerInfoLen = MX_ARRAYLEN(szServerInfoA) - 1;
+// NOTE: CIpc::CConnectionBase::SendMsg splits messages between 4097 and 8192 bytes into 4096-byte packets so only
+//       coalesce what fits in a single one.
+#define MAX_COALESCED_SEND_SIZE 4096
+#define MAX_RETAINED_HEADER_BUFFER_SIZE 65536
+#define MAX_RETAINED_LIST_SIZE 64
+
+#define MAX_BYTE_RANGE_SETS 64
+#define MAX_BYTE_RANGES 16
+
+#define BYTE_RANGES_BOUNDARY_LENGTH 28
+
+#define MAX_COALESCED_CHUNK_SIZE 4064
+
+//-----------------------------------------------------------
+
+static const CHAR szServerLineA[] = "Server: MX-Library\r\n";
+static const SIZE_T nServerLineLen = MX_ARRAYLEN(szServerLineA) - 1;
 static MX::CUrl cZeroUrl;
+static const MX::CUrlView cZeroUrlView;
+
+static struct
+{
+    MX::RWLOCK sRwMutex;
+    ULONGLONG nSecond;
+    CHAR szLineA[64];
+    SIZE_T nLen;
+} sCachedDate = { MX_RWLOCK_INIT, 0, { 0 }, 0 };
+
+typedef struct tagBYTE_RANGE
+{
+    ULONGLONG nStart;
+    ULONGLONG nEnd;
+} BYTE_RANGE, *LPBYTE_RANGE;
 
 //-----------------------------------------------------------
 
-static HRESULT WriteToStream(_In_ MX::CMemoryStream *lpStream, _In_ LPCSTR szStrA, _In_opt_ SIZE_T nStrLen = (SIZE_T)-1);
+static SIZE_T GetCachedDateHeader(_Out_writes_(64) LPSTR szDestA);
+static SIZE_T FormatUInt64(_Out_writes_(24) LPSTR szDestA, _In_ ULONGLONG nValue);
+static SIZE_T FormatChunkHeader(_Out_writes_(24) LPSTR szDestA, _In_ ULONGLONG nChunkLen, _In_ BOOL bCloseLast);
+static SIZE_T CoalesceByteRanges(_Inout_updates_(nCount) LPBYTE_RANGE lpRanges, _In_ SIZE_T nCount);
+static VOID GenerateByteRangesBoundary(_Out_writes_(BYTE_RANGES_BOUNDARY_LENGTH + 1) LPSTR szDestA, _In_ LPVOID lpContext);
+static HRESULT SendByteRangesPartHeader(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_ MX::CStringA &cStrPartA);
 
 //-----------------------------------------------------------
 
@@ -45,6 +80,7 @@ CHttpServer::CClientRequest::~CClientRequest()
     MX_ASSERT(__InterlockedRead(&nThroughputTimerId) == 0);
     MX_ASSERT(__InterlockedRead(&nGracefulTerminationTimerId) == 0);
     MX_ASSERT(__InterlockedRead(&nKeepAliveTimeoutTimerId) == 0);
+    MX_FREE(sHeaderBuffer.lpBuffer);
     return;
 }
 
@@ -103,6 +139,55 @@ HRESULT CHttpServer::CClientRequest::EnableDirectResponse()
     return hRes;
 }
 
+HRESULT CHttpServer::CClientRequest::EnableChunkedResponse()
+{
+    CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
+    HRESULT hRes;
+
+    if (sResponse.bStreamed != FALSE)
+    {
+        return S_OK;
+    }
+    if (nState != eState::BuildingResponse && nState != eState::AfterHeaders)
+    {
+        return MX_E_InvalidState;
+    }
+
+    // HTTP/1.0 clients do not understand chunks so the end of the body is signaled by closing the connection
+    if (cRequestParser.GetRequestVersionMajor() > 1 ||
+        (cRequestParser.GetRequestVersionMajor() == 1 && cRequestParser.GetRequestVersionMinor() >= 1))
+    {
+        CHttpHeaderGenTransferEncoding *lpHeader;
+
+        hRes = AddResponseHeader<CHttpHeaderGenTransferEncoding>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetEncoding(CHttpHeaderGenTransferEncoding::eEncoding::Chunked);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        sResponse.bChunked = TRUE;
+    }
+    else
+    {
+        _InterlockedOr(&nFlags, REQUEST_FLAG_DontKeepAlive);
+    }
+
+    hRes = SetState(eState::SendingResponse);
+    if (FAILED(hRes))
+    {
+        sResponse.bChunked = FALSE;
+        return hRes;
+    }
+    sResponse.bDirect = sResponse.bStreamed = TRUE;
+    sResponse.ullUnflushedBytes = 0ui64;
+
+    // done
+    return S_OK;
+}
+
 LPCSTR CHttpServer::CClientRequest::GetMethod() const
 {
     CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
@@ -125,6 +210,17 @@ CUrl *CHttpServer::CClientRequest::GetUrl() const
     return cRequestParser.GetRequestUri();
 }
 
+const CUrlView &CHttpServer::CClientRequest::GetUrlView() const
+{
+    CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return cZeroUrlView;
+    }
+    return cRequestParser.GetRequestUrlView();
+}
+
 CHttpBodyParserBase *CHttpServer::CClientRequest::GetRequestBodyParser() const
 {
     CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
@@ -136,6 +232,44 @@ CHttpBodyParserBase *CHttpServer::CClientRequest::GetRequestBodyParser() const
     return cRequestParser.GetBodyParser();
 }
 
+HRESULT CHttpServer::CClientRequest::PauseRequestBody()
+{
+    CCriticalSection::CAutoLock cLock(cMutex);
+    HRESULT hRes;
+
+    if (nState != eState::ReceivingRequestBody)
+    {
+        return MX_E_InvalidState;
+    }
+    if ((__InterlockedRead(&nFlags) & REQUEST_FLAG_BodyPaused) != 0)
+    {
+        return S_OK;
+    }
+    hRes = lpHttpServer->cSocketMgr.PauseInputProcessing(hConn);
+    if (SUCCEEDED(hRes))
+    {
+        _InterlockedOr(&nFlags, REQUEST_FLAG_BodyPaused);
+    }
+    return hRes;
+}
+
+HRESULT CHttpServer::CClientRequest::ResumeRequestBody()
+{
+    CCriticalSection::CAutoLock cLock(cMutex);
+
+    if (nState != eState::ReceivingRequestBody)
+    {
+        return MX_E_InvalidState;
+    }
+    if ((_InterlockedAnd(&nFlags, ~REQUEST_FLAG_BodyPaused) & REQUEST_FLAG_BodyPaused) == 0)
+    {
+        return S_OK;
+    }
+
+    // NOTE: Data buffered while paused is processed by the worker thread that handles the resume.
+    return lpHttpServer->cSocketMgr.ResumeInputProcessing(hConn);
+}
+
 SIZE_T CHttpServer::CClientRequest::GetRequestHeadersCount() const
 {
     CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
@@ -197,25 +331,22 @@ SIZE_T CHttpServer::CClientRequest::GetRequestCookiesCount() const
     {
         return 0;
     }
-    return cRequestParser.Cookies().GetCount();
+    return cRequestParser.RequestCookies().GetCount();
 }
 
 CHttpCookie *CHttpServer::CClientRequest::GetRequestCookie(_In_ SIZE_T nIndex) const
 {
     CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
-    CHttpCookieArray *lpCookieArray;
     CHttpCookie *lpCookie;
 
     if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
     {
         return NULL;
     }
-    lpCookieArray = &(cRequestParser.Cookies());
-    if (nIndex >= lpCookieArray->GetCount())
+    if (FAILED(cRequestParser.RequestCookies().GetCookie(nIndex, &lpCookie)))
     {
         return NULL;
     }
-    lpCookie = lpCookieArray->GetElementAt(nIndex);
     lpCookie->AddRef();
     return lpCookie;
 }
@@ -223,7 +354,7 @@ CHttpCookie *CHttpServer::CClientRequest::GetRequestCookie(_In_ SIZE_T nIndex) c
 CHttpCookie *CHttpServer::CClientRequest::GetRequestCookieByName(_In_z_ LPCSTR szNameA) const
 {
     CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
-    CHttpCookieArray *lpCookieArray;
+    CHttpCookieJar *lpCookieJar;
     CHttpCookie *lpCookie;
     SIZE_T nIndex;
 
@@ -231,13 +362,12 @@ CHttpCookie *CHttpServer::CClientRequest::GetRequestCookieByName(_In_z_ LPCSTR s
     {
         return NULL;
     }
-    lpCookieArray = &(cRequestParser.Cookies());
-    nIndex = lpCookieArray->Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    lpCookieJar = &(cRequestParser.RequestCookies());
+    nIndex = lpCookieJar->Find(szNameA);
+    if (nIndex == (SIZE_T)-1 || FAILED(lpCookieJar->GetCookie(nIndex, &lpCookie)))
     {
         return NULL;
     }
-    lpCookie = lpCookieArray->GetElementAt(nIndex);
     lpCookie->AddRef();
     return lpCookie;
 }
@@ -245,7 +375,7 @@ CHttpCookie *CHttpServer::CClientRequest::GetRequestCookieByName(_In_z_ LPCSTR s
 CHttpCookie *CHttpServer::CClientRequest::GetRequestCookieByName(_In_z_ LPCWSTR szNameW) const
 {
     CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
-    CHttpCookieArray *lpCookieArray;
+    CHttpCookieJar *lpCookieJar;
     CHttpCookie *lpCookie;
     SIZE_T nIndex;
 
@@ -253,17 +383,53 @@ CHttpCookie *CHttpServer::CClientRequest::GetRequestCookieByName(_In_z_ LPCWSTR
     {
         return NULL;
     }
-    lpCookieArray = &(cRequestParser.Cookies());
-    nIndex = lpCookieArray->Find(szNameW);
-    if (nIndex == (SIZE_T)-1)
+    lpCookieJar = &(cRequestParser.RequestCookies());
+    nIndex = lpCookieJar->Find(szNameW);
+    if (nIndex == (SIZE_T)-1 || FAILED(lpCookieJar->GetCookie(nIndex, &lpCookie)))
     {
         return NULL;
     }
-    lpCookie = lpCookieArray->GetElementAt(nIndex);
     lpCookie->AddRef();
     return lpCookie;
 }
 
+LPCSTR CHttpServer::CClientRequest::GetRequestCookieName(_In_ SIZE_T nIndex) const
+{
+    CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return NULL;
+    }
+    return cRequestParser.RequestCookies().GetName(nIndex);
+}
+
+LPCSTR CHttpServer::CClientRequest::GetRequestCookieValue(_In_ SIZE_T nIndex) const
+{
+    CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return NULL;
+    }
+    return cRequestParser.RequestCookies().GetValue(nIndex);
+}
+
+LPCSTR CHttpServer::CClientRequest::GetRequestCookieValueByName(_In_z_ LPCSTR szNameA) const
+{
+    CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
+    CHttpCookieJar *lpCookieJar;
+    SIZE_T nIndex;
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return NULL;
+    }
+    lpCookieJar = &(cRequestParser.RequestCookies());
+    nIndex = lpCookieJar->Find(szNameA);
+    return (nIndex != (SIZE_T)-1) ? lpCookieJar->GetValue(nIndex) : NULL;
+}
+
 HRESULT CHttpServer::CClientRequest::ResetResponse()
 {
     CCriticalSection::CAutoLock cLock(cMutex);
@@ -869,10 +1035,16 @@ HRESULT CHttpServer::CClientRequest::SendResponse(_In_ LPCVOID lpData, _In_ SIZE
             return MX_E_InvalidState;
         }
 
-        hRes = SendHeaders(); // send headers if we didn't before
+        // send headers if we didn't before
+        hRes = (sResponse.bStreamed != FALSE) ? StartStreamedResponse() : SendHeaders();
         if (SUCCEEDED(hRes))
         {
-            hRes = lpHttpServer->cSocketMgr.SendMsg(hConn, lpData, nDataLen);
+            hRes = (sResponse.bChunked != FALSE) ? SendChunk(lpData, nDataLen)
+                                                 : lpHttpServer->cSocketMgr.SendMsg(hConn, lpData, nDataLen);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            sResponse.ullUnflushedBytes += (ULONGLONG)nDataLen;
         }
         return hRes;
     }
@@ -974,6 +1146,7 @@ HRESULT CHttpServer::CClientRequest::SendStream(_In_ CStream *lpStream)
     // sending a direct response?
     if (sResponse.bDirect != FALSE)
     {
+        ULONGLONG nLen;
         HRESULT hRes;
 
         if (nState != eState::SendingResponse)
@@ -981,10 +1154,31 @@ HRESULT CHttpServer::CClientRequest::SendStream(_In_ CStream *lpStream)
             return MX_E_InvalidState;
         }
 
-        hRes = SendHeaders(); // send headers if we didn't before
+        // send headers and anything queued before the switch if we didn't before
+        hRes = (sResponse.bStreamed != FALSE) ? StartStreamedResponse() : SendHeaders();
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+
+        nLen = lpStream->GetLength();
+        if (sResponse.bChunked != FALSE)
+        {
+            // NOTE: A zero-length chunk would end the body.
+            if (nLen == 0ui64)
+            {
+                return S_OK;
+            }
+            hRes = SendChunkHeader(nLen);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        hRes = lpHttpServer->cSocketMgr.SendStream(hConn, lpStream);
         if (SUCCEEDED(hRes))
         {
-            hRes = lpHttpServer->cSocketMgr.SendStream(hConn, lpStream);
+            sResponse.ullUnflushedBytes += nLen;
         }
         return hRes;
     }
@@ -1003,130 +1197,463 @@ HRESULT CHttpServer::CClientRequest::SendStream(_In_ CStream *lpStream)
 
     // done
     sResponse.bLastStreamIsData = FALSE;
+    sResponse.bHasExternalStreams = TRUE;
     return S_OK;
 }
 
-HRESULT CHttpServer::CClientRequest::SetMimeTypeFromFileName(_In_opt_z_ LPCWSTR szFileNameW)
+HRESULT CHttpServer::CClientRequest::FlushResponse(_In_opt_ SIZE_T nMaxPendingBytes)
 {
-    CCriticalSection::CAutoLock cLock(cMutex);
-
-    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
-    {
-        return MX_E_InvalidState;
-    }
+    HANDLE hEvents[2], h;
+    ULONGLONG ullWritten, ullLastWritten;
+    DWORD dwStalledSecs;
+    HRESULT hRes;
 
-    // sending a direct response?
-    if (sResponse.bDirect != FALSE)
     {
-        return MX_E_InvalidState;
-    }
+        CCriticalSection::CAutoLock cLock(cMutex);
 
-    // set response info
-    sResponse.szMimeTypeHintA = (szFileNameW != FALSE) ? Http::GetMimeType(szFileNameW) : NULL;
+        if (nState != eState::SendingResponse || sResponse.bDirect == FALSE)
+        {
+            return MX_E_InvalidState;
+        }
 
-    // done
-    return S_OK;
-}
+        hRes = (sResponse.bStreamed != FALSE) ? StartStreamedResponse() : SendHeaders();
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (nMaxPendingBytes > 0 && sResponse.ullUnflushedBytes <= (ULONGLONG)nMaxPendingBytes)
+        {
+            return S_OK;
+        }
+        sResponse.ullUnflushedBytes = 0ui64;
 
-HRESULT CHttpServer::CClientRequest::SetFileName(_In_opt_z_ LPCWSTR szFileNameW, _In_opt_ BOOL bInline)
-{
-    CCriticalSection::CAutoLock cLock(cMutex);
-    CStringW cStrTempFileNameW;
+        if (cOutputDrainedEv.Get() == NULL)
+        {
+            hRes = cOutputDrainedEv.Create(FALSE, FALSE);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        else
+        {
+            cOutputDrainedEv.Reset();
+        }
 
-    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
-    {
-        return MX_E_InvalidState;
+        // the signal is raised once every packet queued before it was written
+        hRes = lpHttpServer->cSocketMgr.AfterWriteSignal(
+            hConn, MX_BIND_MEMBER_CALLBACK(&CHttpServer::OnResponseOutputDrained, lpHttpServer), this);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        h = hConn;
     }
 
-    // sending a direct response?
-    if (sResponse.bDirect != FALSE)
+    // NOTE: The signal is not raised if the connection is closed so check it from time to time. A client that stops
+    //       reading is given up after the same time the throughput timer allows once the request has ended.
+    hEvents[0] = cOutputDrainedEv.Get();
+    hEvents[1] = lpHttpServer->cShutdownEv.Get();
+    ullLastWritten = 0ui64;
+    lpHttpServer->cSocketMgr.GetWriteStats(h, &ullLastWritten, NULL);
+    dwStalledSecs = 0;
+    for (;;)
     {
-        return MX_E_InvalidState;
-    }
+        switch (::WaitForMultipleObjects(2, hEvents, FALSE, 1000))
+        {
+            case WAIT_OBJECT_0:
+                return S_OK;
 
-    // extract name
-    if (szFileNameW != NULL && *szFileNameW != 0)
-    {
-        LPCWSTR sW[2];
+            case WAIT_OBJECT_0 + 1:
+                return MX_E_Cancelled;
 
-        sW[0] = StrChrW(szFileNameW, L'\\', TRUE);
-        sW[0] = (sW[0] != NULL) ? (sW[0] + 1) : szFileNameW;
-        sW[1] = StrChrW(szFileNameW, L'/', TRUE);
-        sW[1] = (sW[1] != NULL) ? (sW[1] + 1) : szFileNameW;
+            case WAIT_TIMEOUT:
+                break;
 
-        if (cStrTempFileNameW.Copy((sW[0] > sW[1]) ? sW[0] : sW[1]) == FALSE)
-        {
-            return E_OUTOFMEMORY;
+            default:
+                return MX_HRESULT_FROM_LASTERROR();
         }
-    }
 
-    // set response info
-    if (cStrTempFileNameW.IsEmpty() == FALSE && szFileNameW != NULL && *szFileNameW != 0)
-    {
-        sResponse.szMimeTypeHintA = Http::GetMimeType(szFileNameW);
-        sResponse.cStrFileNameW.Attach(cStrTempFileNameW.Detach());
-        sResponse.bIsInline = bInline;
-    }
-    else
-    {
-        sResponse.szMimeTypeHintA = NULL;
-        sResponse.cStrFileNameW.Empty();
-        sResponse.bIsInline = FALSE;
+        if (IsLinkClosed() != FALSE || lpHttpServer->cSocketMgr.IsClosed(h) != S_FALSE)
+        {
+            return MX_E_BrokenPipe;
+        }
+        hRes = lpHttpServer->cSocketMgr.GetWriteStats(h, &ullWritten, NULL);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (ullWritten != ullLastWritten)
+        {
+            ullLastWritten = ullWritten;
+            dwStalledSecs = 0;
+        }
+        else if (lpHttpServer->dwResponseSecondsOfLowThroughput > 0 &&
+                 (++dwStalledSecs) >= lpHttpServer->dwResponseSecondsOfLowThroughput)
+        {
+            return MX_E_Timeout;
+        }
     }
-
-    // done
-    return S_OK;
 }
 
-HRESULT CHttpServer::CClientRequest::SendErrorPage(_In_ LONG nStatusCode, _In_ HRESULT hrErrorCode,
-                                                   _In_opt_z_ LPCSTR szAdditionalExplanationA)
+HRESULT CHttpServer::CClientRequest::SendFileRange(_In_z_ LPCWSTR szFileNameW, _In_opt_ CHttpHeaderReqRange *lpRangeHeader)
 {
     CCriticalSection::CAutoLock cLock(cMutex);
+    TAutoRefCounted<CFileStream> cStream;
     HRESULT hRes;
 
-    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    if (szFileNameW == NULL)
     {
-        return MX_E_InvalidState;
+        return E_POINTER;
     }
-    if (HasHeadersBeenSent() != FALSE)
+    // create file stream
+    cStream.Attach(MX_DEBUG_NEW CFileStream());
+    if (!cStream)
     {
-        return MX_E_InvalidState;
+        return E_OUTOFMEMORY;
+    }
+    hRes = cStream->Create(szFileNameW);
+    if (SUCCEEDED(hRes))
+    {
+        // NOTE: The parts of a multipart response carry the entity type so guess it now if not set.
+        if (sResponse.bDirect == FALSE && sResponse.szMimeTypeHintA == NULL)
+        {
+            sResponse.szMimeTypeHintA = Http::GetMimeType(szFileNameW);
+        }
+        hRes = SendStreamRange(cStream, lpRangeHeader);
     }
-    _InterlockedOr(&nFlags, REQUEST_FLAG_DontKeepAlive);
-    hRes = lpHttpServer->FillResponseWithError(this, nStatusCode, hrErrorCode, szAdditionalExplanationA);
-
     // done
     return hRes;
 }
 
-HRESULT CHttpServer::CClientRequest::DisableClientCache()
+HRESULT CHttpServer::CClientRequest::SendStreamRange(_In_ CStream *lpStream, _In_opt_ CHttpHeaderReqRange *lpRangeHeader)
 {
     CCriticalSection::CAutoLock cLock(cMutex);
+    BYTE_RANGE aRanges[MAX_BYTE_RANGE_SETS];
+    TAutoRefCounted<CRangeStream> cRangeStream;
+    ULONGLONG nTotalSize;
+    SIZE_T i, nCount, nRangeSetsCount;
     HRESULT hRes;
 
     if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
     {
         return MX_E_InvalidState;
     }
-    if (HasHeadersBeenSent() != FALSE)
+    if (lpStream == NULL)
+    {
+        return E_POINTER;
+    }
+    // NOTE: A partial response needs its own status and headers so it must be the whole body of a buffered response.
+    if (sResponse.bDirect != FALSE || sResponse.aStreamsList.GetCount() > 0)
     {
         return MX_E_InvalidState;
     }
 
-    RemoveResponseHeader("Cache-Control");
-    RemoveResponseHeader("Pragma");
-    RemoveResponseHeader("Expires");
+    // advertise range support
+    if (sResponse.cHeaders.Find<CHttpHeaderRespAcceptRanges>() == NULL)
+    {
+        CHttpHeaderRespAcceptRanges *lpHeader;
 
-    hRes = AddResponseHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-    if (SUCCEEDED(hRes))
+        hRes = AddResponseHeader<CHttpHeaderRespAcceptRanges>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetRange(CHttpHeaderRespAcceptRanges::RangeBytes);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // use the request ranges if none were specified
+    // NOTE: A stale "If-Range" means the whole entity, even for ranges given by the caller.
+    if (IsIfRangeSatisfied() == FALSE)
     {
-        hRes = AddResponseHeader("Pragma", "no-cache");
+        lpRangeHeader = NULL;
     }
-    if (SUCCEEDED(hRes))
+    else if (lpRangeHeader == NULL && StrCompareA(GetMethod(), "GET") == 0)
     {
-        hRes = AddResponseHeader("Expires", "0");
+        lpRangeHeader = GetRequestHeader<CHttpHeaderReqRange>();
     }
-    // done
+    nTotalSize = lpStream->GetLength();
+    if (lpRangeHeader == NULL || nTotalSize == 0ui64 || (sResponse.nStatus != 0 && sResponse.nStatus != 200))
+    {
+        return SendStream(lpStream);
+    }
+
+    // resolve the range sets and merge the overlapping ones
+    nRangeSetsCount = lpRangeHeader->GetRangeSetsCount();
+    if (nRangeSetsCount == 0 || nRangeSetsCount > MAX_BYTE_RANGE_SETS)
+    {
+        return SendStream(lpStream);
+    }
+    nCount = 0;
+    for (i = 0; i < nRangeSetsCount; i++)
+    {
+        if (lpRangeHeader->GetRangeSetBounds(i, nTotalSize, &(aRanges[nCount].nStart), &(aRanges[nCount].nEnd)) != FALSE)
+        {
+            nCount++;
+        }
+    }
+    nCount = CoalesceByteRanges(aRanges, nCount);
+
+    // nothing satisfiable?
+    if (nCount == 0)
+    {
+        CHttpHeaderEntContentRange *lpHeader;
+
+        hRes = SetResponseStatus(416);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = AddResponseHeader<CHttpHeaderEntContentRange>(&lpHeader);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetUnsatisfiedRange(nTotalSize);
+        }
+        return hRes;
+    }
+
+    // NOTE: Too many disjoint ranges are cheaper to answer with the whole entity.
+    if (nCount > MAX_BYTE_RANGES)
+    {
+        return SendStream(lpStream);
+    }
+
+    hRes = SetResponseStatus(206);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // single range
+    if (nCount == 1)
+    {
+        CHttpHeaderEntContentRange *lpHeader;
+
+        hRes = AddResponseHeader<CHttpHeaderEntContentRange>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetRange(aRanges[0].nStart, aRanges[0].nEnd, nTotalSize);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            cRangeStream.Attach(MX_DEBUG_NEW CRangeStream());
+            if (cRangeStream)
+            {
+                hRes = cRangeStream->Create(lpStream, aRanges[0].nStart, aRanges[0].nEnd - aRanges[0].nStart + 1ui64);
+            }
+            else
+            {
+                hRes = E_OUTOFMEMORY;
+            }
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = SendStream(cRangeStream.Get());
+        }
+        return hRes;
+    }
+
+    // multiple ranges
+    {
+        CHttpHeaderEntContentType *lpContentTypeHeader;
+        CHAR szBoundaryA[BYTE_RANGES_BOUNDARY_LENGTH + 1];
+        CStringA cStrPartTypeA, cStrTempA;
+
+        lpContentTypeHeader = sResponse.cHeaders.Find<CHttpHeaderEntContentType>();
+        if (lpContentTypeHeader != NULL)
+        {
+            hRes = lpContentTypeHeader->Build(cStrPartTypeA, cRequestParser.GetRequestBrowser());
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        else if (cStrPartTypeA.Copy((sResponse.szMimeTypeHintA != NULL) ? sResponse.szMimeTypeHintA
+                                                                         : "application/octet-stream") == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        GenerateByteRangesBoundary(szBoundaryA, this);
+        if (cStrTempA.Format("multipart/byteranges; boundary=%s", szBoundaryA) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+        hRes = AddResponseHeader("Content-Type", (LPCSTR)cStrTempA, cStrTempA.GetLength());
+
+        // each part is a small header followed by a window of the entity
+        for (i = 0; SUCCEEDED(hRes) && i < nCount; i++)
+        {
+            if (cStrTempA.Format("%s--%s\r\nContent-Type: %s\r\nContent-Range: bytes %I64u-%I64u/%I64u\r\n\r\n",
+                                 ((i > 0) ? "\r\n" : ""), szBoundaryA, (LPCSTR)cStrPartTypeA, aRanges[i].nStart,
+                                 aRanges[i].nEnd, nTotalSize) == FALSE)
+            {
+                hRes = E_OUTOFMEMORY;
+                break;
+            }
+            hRes = SendByteRangesPartHeader(this, cStrTempA);
+            if (SUCCEEDED(hRes))
+            {
+                cRangeStream.Attach(MX_DEBUG_NEW CRangeStream());
+                if (cRangeStream)
+                {
+                    hRes = cRangeStream->Create(lpStream, aRanges[i].nStart, aRanges[i].nEnd - aRanges[i].nStart + 1ui64);
+                }
+                else
+                {
+                    hRes = E_OUTOFMEMORY;
+                }
+            }
+            if (SUCCEEDED(hRes))
+            {
+                hRes = SendStream(cRangeStream.Get());
+            }
+        }
+        if (SUCCEEDED(hRes))
+        {
+            if (cStrTempA.Format("\r\n--%s--\r\n", szBoundaryA) != FALSE)
+            {
+                hRes = SendByteRangesPartHeader(this, cStrTempA);
+            }
+            else
+            {
+                hRes = E_OUTOFMEMORY;
+            }
+        }
+        if (FAILED(hRes))
+        {
+            sResponse.aStreamsList.RemoveAllElements();
+            return hRes;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CHttpServer::CClientRequest::SetMimeTypeFromFileName(_In_opt_z_ LPCWSTR szFileNameW)
+{
+    CCriticalSection::CAutoLock cLock(cMutex);
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return MX_E_InvalidState;
+    }
+
+    // sending a direct response?
+    if (sResponse.bDirect != FALSE)
+    {
+        return MX_E_InvalidState;
+    }
+
+    // set response info
+    sResponse.szMimeTypeHintA = (szFileNameW != FALSE) ? Http::GetMimeType(szFileNameW) : NULL;
+
+    // done
+    return S_OK;
+}
+
+HRESULT CHttpServer::CClientRequest::SetFileName(_In_opt_z_ LPCWSTR szFileNameW, _In_opt_ BOOL bInline)
+{
+    CCriticalSection::CAutoLock cLock(cMutex);
+    CStringW cStrTempFileNameW;
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return MX_E_InvalidState;
+    }
+
+    // sending a direct response?
+    if (sResponse.bDirect != FALSE)
+    {
+        return MX_E_InvalidState;
+    }
+
+    // extract name
+    if (szFileNameW != NULL && *szFileNameW != 0)
+    {
+        LPCWSTR sW[2];
+
+        sW[0] = StrChrW(szFileNameW, L'\\', TRUE);
+        sW[0] = (sW[0] != NULL) ? (sW[0] + 1) : szFileNameW;
+        sW[1] = StrChrW(szFileNameW, L'/', TRUE);
+        sW[1] = (sW[1] != NULL) ? (sW[1] + 1) : szFileNameW;
+
+        if (cStrTempFileNameW.Copy((sW[0] > sW[1]) ? sW[0] : sW[1]) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    // set response info
+    if (cStrTempFileNameW.IsEmpty() == FALSE && szFileNameW != NULL && *szFileNameW != 0)
+    {
+        sResponse.szMimeTypeHintA = Http::GetMimeType(szFileNameW);
+        sResponse.cStrFileNameW.Attach(cStrTempFileNameW.Detach());
+        sResponse.bIsInline = bInline;
+    }
+    else
+    {
+        sResponse.szMimeTypeHintA = NULL;
+        sResponse.cStrFileNameW.Empty();
+        sResponse.bIsInline = FALSE;
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CHttpServer::CClientRequest::SendErrorPage(_In_ LONG nStatusCode, _In_ HRESULT hrErrorCode,
+                                                   _In_opt_z_ LPCSTR szAdditionalExplanationA)
+{
+    CCriticalSection::CAutoLock cLock(cMutex);
+    HRESULT hRes;
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return MX_E_InvalidState;
+    }
+    if (HasHeadersBeenSent() != FALSE)
+    {
+        return MX_E_InvalidState;
+    }
+    _InterlockedOr(&nFlags, REQUEST_FLAG_DontKeepAlive);
+    hRes = lpHttpServer->FillResponseWithError(this, nStatusCode, hrErrorCode, szAdditionalExplanationA);
+
+    // done
+    return hRes;
+}
+
+HRESULT CHttpServer::CClientRequest::DisableClientCache()
+{
+    CCriticalSection::CAutoLock cLock(cMutex);
+    HRESULT hRes;
+
+    if (nState != eState::AfterHeaders && nState != eState::BuildingResponse && nState != eState::NegotiatingWebSocket)
+    {
+        return MX_E_InvalidState;
+    }
+    if (HasHeadersBeenSent() != FALSE)
+    {
+        return MX_E_InvalidState;
+    }
+
+    RemoveResponseHeader("Cache-Control");
+    RemoveResponseHeader("Pragma");
+    RemoveResponseHeader("Expires");
+
+    hRes = AddResponseHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+    if (SUCCEEDED(hRes))
+    {
+        hRes = AddResponseHeader("Pragma", "no-cache");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = AddResponseHeader("Expires", "0");
+    }
+    // done
     return hRes;
 }
 
@@ -1150,6 +1677,23 @@ CSockets *CHttpServer::CClientRequest::GetUnderlyingSocketManager() const
     return lpSocketMgr;
 }
 
+HRESULT CHttpServer::CClientRequest::GetPeerAddress(_Out_ PSOCKADDR_INET lpAddr) const
+{
+    CCriticalSection::CAutoLock cLock(const_cast<CCriticalSection &>(cMutex));
+
+    if (lpAddr == NULL)
+    {
+        return E_POINTER;
+    }
+    if (sPeerAddr.si_family == 0)
+    {
+        ::MxMemSet(lpAddr, 0, sizeof(SOCKADDR_INET));
+        return MX_E_NotFound;
+    }
+    ::MxMemCopy(lpAddr, &sPeerAddr, sizeof(SOCKADDR_INET));
+    return S_OK;
+}
+
 HRESULT CHttpServer::CClientRequest::Initialize(_In_ CHttpServer *_lpHttpServer, _In_ CSockets *_lpSocketMgr, _In_ HANDLE _hConn,
                                                 _In_ DWORD dwMaxHeaderSize)
 {
@@ -1187,6 +1731,28 @@ HRESULT CHttpServer::CClientRequest::ResetForNewRequest()
     return S_OK;
 }
 
+VOID CHttpServer::CClientRequest::ResetForReuse()
+{
+    MX_ASSERT(nState == eState::Terminated);
+    MX_ASSERT(hConn == NULL);
+
+    RundownProt_Initialize(&nTimerCallbackRundownLock);
+    lpHttpServer = NULL;
+    lpSocketMgr = NULL;
+    ::MxMemSet(&sPeerAddr, 0, sizeof(sPeerAddr));
+    ::MxMemSet(&sLimiterConn, 0, sizeof(sLimiterConn));
+    nState = eState::Inactive;
+    _InterlockedExchange(&nFlags, 0);
+    hrErrorCode = S_OK;
+    dwLowThroughputCounter = 0;
+    cRequestParser.Reset();
+    ResetResponseForNewRequest(FALSE);
+    sResponse.bIsInline = FALSE;
+
+    // NOTE: The output drained event and the headers buffer are kept for the next connection.
+    return;
+}
+
 HRESULT CHttpServer::CClientRequest::SetState(_In_ eState nNewState)
 {
     HRESULT hRes;
@@ -1272,6 +1838,19 @@ HRESULT CHttpServer::CClientRequest::SetState(_In_ eState nNewState)
                 }
             }
             break;
+
+        case eState::ReceivingRequestBody:
+            // a body paused by the handler must not keep the connection paused
+            if (nNewState != nState && (_InterlockedAnd(&nFlags, ~REQUEST_FLAG_BodyPaused) & REQUEST_FLAG_BodyPaused) != 0 &&
+                nNewState != eState::Terminated)
+            {
+                hRes = lpHttpServer->cSocketMgr.ResumeInputProcessing(hConn);
+                if (FAILED(hRes))
+                {
+                    return hRes;
+                }
+            }
+            break;
     }
     switch (nNewState)
     {
@@ -1320,11 +1899,12 @@ BOOL CHttpServer::CClientRequest::HasHeadersBeenSent() const
 
 HRESULT CHttpServer::CClientRequest::SendHeaders()
 {
-    TAutoRefCounted<CMemoryStream> cHdrStream;
     CStringA cStrTempA;
+    CHAR szTempA[64];
     int nHttpVersion[2];
     LONG nStatus = 0;
     LPCSTR sA;
+    SIZE_T nLen;
     HRESULT hRes;
 
     if ((_InterlockedOr(&nFlags, REQUEST_FLAG_HeadersSent) & REQUEST_FLAG_HeadersSent) != 0)
@@ -1332,9 +1912,11 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
         return S_FALSE;
     }
 
-    cHdrStream.Attach(MX_DEBUG_NEW CMemoryStream(65536));
-    hRes = (cHdrStream) ? cHdrStream->Create() : E_OUTOFMEMORY;
+    // reuse the buffer of the previous response sent through this connection
+    sHeaderBuffer.nLen = 0;
+
     // status
+    hRes = AppendToHeaders("HTTP/", 5);
     if (SUCCEEDED(hRes))
     {
         if ((nStatus = sResponse.nStatus) == 0)
@@ -1366,8 +1948,23 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
             nHttpVersion[0] = 1;
             nHttpVersion[1] = 0;
         }
-        hRes = cHdrStream->WriteString("HTTP/%d.%d %03d %s\r\n", nHttpVersion[0], nHttpVersion[1], nStatus,
-                                       ((sA != NULL) ? sA : "Undefined"));
+        szTempA[0] = (CHAR)('0' + (nHttpVersion[0] % 10));
+        szTempA[1] = '.';
+        szTempA[2] = (CHAR)('0' + (nHttpVersion[1] % 10));
+        szTempA[3] = ' ';
+        szTempA[4] = (CHAR)('0' + ((nStatus / 100) % 10));
+        szTempA[5] = (CHAR)('0' + ((nStatus / 10) % 10));
+        szTempA[6] = (CHAR)('0' + (nStatus % 10));
+        szTempA[7] = ' ';
+        hRes = AppendToHeaders(szTempA, 8);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = AppendToHeaders((sA != NULL) ? sA : "Undefined");
+            if (SUCCEEDED(hRes))
+            {
+                hRes = AppendToHeaders("\r\n", 2);
+            }
+        }
     }
 
     // date
@@ -1381,30 +1978,21 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
             hRes = lpHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
             if (SUCCEEDED(hRes))
             {
-                hRes = WriteToStream(cHdrStream, "Date: ", 5);
+                hRes = AppendToHeaders("Date: ", 6);
                 if (SUCCEEDED(hRes))
                 {
-                    hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                    hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                        hRes = AppendToHeaders("\r\n", 2);
                     }
                 }
             }
         }
         else
         {
-            CDateTime cDtNow;
-
-            hRes = cDtNow.SetFromNow(FALSE);
-            if (SUCCEEDED(hRes))
-            {
-                hRes = cDtNow.Format(cStrTempA, "Date: %a, %d %b %Y %H:%M:%S %z\r\n");
-                if (SUCCEEDED(hRes))
-                {
-                    hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
-                }
-            }
+            nLen = GetCachedDateHeader(szTempA);
+            hRes = (nLen > 0) ? AppendToHeaders(szTempA, nLen) : E_OUTOFMEMORY;
         }
     }
 
@@ -1419,13 +2007,13 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
             hRes = lpHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
             if (SUCCEEDED(hRes))
             {
-                hRes = WriteToStream(cHdrStream, "Location: ", 10);
+                hRes = AppendToHeaders("Location: ", 10);
                 if (SUCCEEDED(hRes))
                 {
-                    hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                    hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                        hRes = AppendToHeaders("\r\n", 2);
                     }
                 }
             }
@@ -1435,30 +2023,30 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
     // server
     if (SUCCEEDED(hRes))
     {
-        hRes = WriteToStream(cHdrStream, "Server: ", 8);
-        if (SUCCEEDED(hRes))
+        SIZE_T nIndex;
+
+        nIndex = sResponse.cHeaders.Find("Server");
+        if (nIndex != (SIZE_T)-1)
         {
-            SIZE_T nIndex;
+            CHttpHeaderBase *lpHeader = sResponse.cHeaders.GetElementAt(nIndex);
 
-            nIndex = sResponse.cHeaders.Find("Server");
-            if (nIndex != (SIZE_T)-1)
+            hRes = lpHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
+            if (SUCCEEDED(hRes))
             {
-                CHttpHeaderBase *lpHeader = sResponse.cHeaders.GetElementAt(nIndex);
-
-                hRes = lpHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
+                hRes = AppendToHeaders("Server: ", 8);
                 if (SUCCEEDED(hRes))
                 {
-                    hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                    hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
+                    if (SUCCEEDED(hRes))
+                    {
+                        hRes = AppendToHeaders("\r\n", 2);
+                    }
                 }
             }
-            else
-            {
-                hRes = WriteToStream(cHdrStream, szServerInfoA, nServerInfoLen);
-            }
-            if (SUCCEEDED(hRes))
-            {
-                hRes = WriteToStream(cHdrStream, "\r\n", 2);
-            }
+        }
+        else
+        {
+            hRes = AppendToHeaders(szServerLineA, nServerLineLen);
         }
     }
 
@@ -1473,29 +2061,29 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
             hRes = lpHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
             if (SUCCEEDED(hRes))
             {
-                hRes = WriteToStream(cHdrStream, "Connection: ", 12);
+                hRes = AppendToHeaders("Connection: ", 12);
                 if (SUCCEEDED(hRes))
                 {
-                    hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                    hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                        hRes = AppendToHeaders("\r\n", 2);
                     }
                 }
             }
         }
-        else if (IsKeepAliveRequest() != FALSE)
+        else if (IsKeepAliveRequest() != FALSE && (__InterlockedRead(&nFlags) & REQUEST_FLAG_DontKeepAlive) == 0)
         {
-            hRes = WriteToStream(cHdrStream, "Connection: Keep-Alive\r\n", 24);
+            hRes = AppendToHeaders("Connection: Keep-Alive\r\n", 24);
         }
         else
         {
-            hRes = WriteToStream(cHdrStream, "Connection: Close\r\n", 19);
+            hRes = AppendToHeaders("Connection: Close\r\n", 19);
         }
     }
 
     // content type
-    if (SUCCEEDED(hRes) && sResponse.aStreamsList.GetCount() > 0)
+    if (SUCCEEDED(hRes) && (sResponse.aStreamsList.GetCount() > 0 || sResponse.bDirect != FALSE))
     {
         CHttpHeaderEntContentType *lpHeader;
 
@@ -1505,48 +2093,48 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
             hRes = lpHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
             if (SUCCEEDED(hRes))
             {
-                hRes = WriteToStream(cHdrStream, "Content-Type: ", 14);
+                hRes = AppendToHeaders("Content-Type: ", 14);
                 if (SUCCEEDED(hRes))
                 {
-                    hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                    hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                        hRes = AppendToHeaders("\r\n", 2);
                     }
                 }
             }
         }
         else
         {
-            // only send automatic "Content-Type" header if not direct response and has a body
-            if (sResponse.bDirect == FALSE)
+            // only send automatic "Content-Type" header if not a raw direct response and has a body
+            if (sResponse.bDirect == FALSE || sResponse.bStreamed != FALSE)
             {
                 if (sResponse.szMimeTypeHintA != NULL)
                 {
-                    hRes = WriteToStream(cHdrStream, "Content-Type: ", 14);
+                    hRes = AppendToHeaders("Content-Type: ", 14);
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, sResponse.szMimeTypeHintA);
+                        hRes = AppendToHeaders(sResponse.szMimeTypeHintA);
                         if (SUCCEEDED(hRes))
                         {
                             if (StrNCompareA(sResponse.szMimeTypeHintA, "text/", 5) == 0)
                             {
-                                hRes = WriteToStream(cHdrStream, "; charset=utf-8\r\n", 17);
+                                hRes = AppendToHeaders("; charset=utf-8\r\n", 17);
                             }
                             else
                             {
-                                hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                                hRes = AppendToHeaders("\r\n", 2);
                             }
                         }
                     }
                 }
-                else if (sResponse.bLastStreamIsData != FALSE)
+                else if (sResponse.bLastStreamIsData != FALSE || sResponse.aStreamsList.GetCount() == 0)
                 {
-                    hRes = WriteToStream(cHdrStream, "Content-Type: text/html; charset=utf-8\r\n", 40);
+                    hRes = AppendToHeaders("Content-Type: text/html; charset=utf-8\r\n", 40);
                 }
                 else
                 {
-                    hRes = WriteToStream(cHdrStream, "Content-Type: application/octet-stream\r\n", 40);
+                    hRes = AppendToHeaders("Content-Type: application/octet-stream\r\n", 40);
                 }
             }
         }
@@ -1570,13 +2158,13 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
                     hRes = cHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, "Content-Disposition: ", 21);
+                        hRes = AppendToHeaders("Content-Disposition: ", 21);
                         if (SUCCEEDED(hRes))
                         {
-                            hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                            hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                             if (SUCCEEDED(hRes))
                             {
-                                hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                                hRes = AppendToHeaders("\r\n", 2);
                             }
                         }
                     }
@@ -1623,7 +2211,14 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
                         }
                         if (SUCCEEDED(hRes))
                         {
-                            hRes = cHdrStream->WriteString("Content-Length: %I64u\r\n", nTotalLength);
+                            hRes = AppendToHeaders("Content-Length: ", 16);
+                            if (SUCCEEDED(hRes))
+                            {
+                                nLen = FormatUInt64(szTempA, nTotalLength);
+                                szTempA[nLen++] = '\r';
+                                szTempA[nLen++] = '\n';
+                                hRes = AppendToHeaders(szTempA, nLen);
+                            }
                         }
                     }
                     else if (sResponse.aStreamsList.GetCount() > 0)
@@ -1639,13 +2234,13 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
                     hRes = lpHeaderEntContentLength->Build(cStrTempA, cRequestParser.GetRequestBrowser());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, "Content-Length: ", 16);
+                        hRes = AppendToHeaders("Content-Length: ", 16);
                         if (SUCCEEDED(hRes))
                         {
-                            hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                            hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                             if (SUCCEEDED(hRes))
                             {
-                                hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                                hRes = AppendToHeaders("\r\n", 2);
                             }
                         }
                     }
@@ -1677,16 +2272,16 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
                 hRes = lpHeader->Build(cStrTempA, cRequestParser.GetRequestBrowser());
                 if (SUCCEEDED(hRes))
                 {
-                    hRes = WriteToStream(cHdrStream, lpHeader->GetHeaderName());
+                    hRes = AppendToHeaders(lpHeader->GetHeaderName());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, ": ", 2);
+                        hRes = AppendToHeaders(": ", 2);
                         if (SUCCEEDED(hRes))
                         {
-                            hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                            hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                             if (SUCCEEDED(hRes))
                             {
-                                hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                                hRes = AppendToHeaders("\r\n", 2);
                             }
                         }
                     }
@@ -1709,13 +2304,13 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
             hRes = lpCookie->ToString(cStrTempA);
             if (SUCCEEDED(hRes))
             {
-                hRes = WriteToStream(cHdrStream, "Set-Cookie: ", 12);
+                hRes = AppendToHeaders("Set-Cookie: ", 12);
                 if (SUCCEEDED(hRes))
                 {
-                    hRes = WriteToStream(cHdrStream, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+                    hRes = AppendToHeaders((LPCSTR)cStrTempA, cStrTempA.GetLength());
                     if (SUCCEEDED(hRes))
                     {
-                        hRes = WriteToStream(cHdrStream, "\r\n", 2);
+                        hRes = AppendToHeaders("\r\n", 2);
                     }
                 }
             }
@@ -1725,13 +2320,45 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
     // add end of header
     if (SUCCEEDED(hRes))
     {
-        hRes = WriteToStream(cHdrStream, "\r\n", 2);
+        hRes = AppendToHeaders("\r\n", 2);
+    }
+
+    // small in-memory bodies go out in the same packet as the headers
+    if (SUCCEEDED(hRes) && sResponse.bDirect == FALSE && sResponse.bHasExternalStreams == FALSE &&
+        sResponse.aStreamsList.GetCount() > 0)
+    {
+        CMemoryStream *lpStream;
+        ULONGLONG nTotalLength;
+        SIZE_T i, nCount;
+
+        nTotalLength = 0ui64;
+        nCount = sResponse.aStreamsList.GetCount();
+        for (i = 0; i < nCount; i++)
+        {
+            nTotalLength += sResponse.aStreamsList[i]->GetLength();
+        }
+        if (nTotalLength <= (ULONGLONG)MAX_COALESCED_SEND_SIZE &&
+            sHeaderBuffer.nLen + (SIZE_T)nTotalLength <= MAX_COALESCED_SEND_SIZE && nStatus >= 200 && nStatus != 204 &&
+            nStatus != 304)
+        {
+            for (i = 0; SUCCEEDED(hRes) && i < nCount; i++)
+            {
+                // NOTE: When no external stream was added, all of them were created by SendResponse or the error page
+                lpStream = static_cast<CMemoryStream *>(sResponse.aStreamsList.GetElementAt(i));
+
+                hRes = AppendToHeaders((LPCSTR)(lpStream->GetRawBuffer()), (SIZE_T)(lpStream->GetLength()));
+            }
+            if (SUCCEEDED(hRes))
+            {
+                sResponse.aStreamsList.RemoveAllElements();
+            }
+        }
     }
 
-    // send stream
+    // send
     if (SUCCEEDED(hRes))
     {
-        hRes = lpHttpServer->cSocketMgr.SendStream(hConn, cHdrStream.Get());
+        hRes = lpHttpServer->cSocketMgr.SendMsg(hConn, sHeaderBuffer.lpBuffer, sHeaderBuffer.nLen);
     }
 
     if (FAILED(hRes))
@@ -1746,6 +2373,41 @@ HRESULT CHttpServer::CClientRequest::SendHeaders()
     return hRes;
 }
 
+HRESULT CHttpServer::CClientRequest::AppendToHeaders(_In_ LPCSTR szStrA, _In_opt_ SIZE_T nStrLen)
+{
+    if (nStrLen == (SIZE_T)-1)
+    {
+        nStrLen = StrLenA(szStrA);
+    }
+    if (nStrLen > sHeaderBuffer.nSize - sHeaderBuffer.nLen)
+    {
+        LPBYTE lpNewBuffer;
+        SIZE_T nNewSize;
+
+        nNewSize = (sHeaderBuffer.nSize > 0) ? sHeaderBuffer.nSize : 1024;
+        while (nNewSize - sHeaderBuffer.nLen < nStrLen)
+        {
+            if (nNewSize + nNewSize < nNewSize)
+            {
+                return E_OUTOFMEMORY;
+            }
+            nNewSize += nNewSize;
+        }
+        lpNewBuffer = (LPBYTE)MX_MALLOC(nNewSize);
+        if (lpNewBuffer == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        ::MxMemCopy(lpNewBuffer, sHeaderBuffer.lpBuffer, sHeaderBuffer.nLen);
+        MX_FREE(sHeaderBuffer.lpBuffer);
+        sHeaderBuffer.lpBuffer = lpNewBuffer;
+        sHeaderBuffer.nSize = nNewSize;
+    }
+    ::MxMemCopy(sHeaderBuffer.lpBuffer + sHeaderBuffer.nLen, szStrA, nStrLen);
+    sHeaderBuffer.nLen += nStrLen;
+    return S_OK;
+}
+
 HRESULT CHttpServer::CClientRequest::SendQueuedStreams()
 {
     CStream *lpStream;
@@ -1764,6 +2426,155 @@ HRESULT CHttpServer::CClientRequest::SendQueuedStreams()
     return hRes;
 }
 
+HRESULT CHttpServer::CClientRequest::StartStreamedResponse()
+{
+    CStream *lpStream;
+    ULONGLONG nLen;
+    SIZE_T i, nCount;
+    HRESULT hRes;
+
+    hRes = SendHeaders();
+    if (hRes != S_OK)
+    {
+        return (SUCCEEDED(hRes)) ? S_OK : hRes;
+    }
+
+    // data queued before the response was switched to streamed goes first
+    hRes = S_OK;
+    nCount = sResponse.aStreamsList.GetCount();
+    for (i = 0; SUCCEEDED(hRes) && i < nCount; i++)
+    {
+        lpStream = sResponse.aStreamsList.GetElementAt(i);
+
+        nLen = lpStream->GetLength();
+        if (nLen > 0ui64)
+        {
+            if (sResponse.bChunked != FALSE)
+            {
+                hRes = SendChunkHeader(nLen);
+            }
+            if (SUCCEEDED(hRes))
+            {
+                hRes = lpHttpServer->cSocketMgr.SendStream(hConn, lpStream);
+            }
+        }
+    }
+    sResponse.aStreamsList.RemoveAllElements();
+    sResponse.bLastStreamIsData = FALSE;
+
+    // done
+    return hRes;
+}
+
+HRESULT CHttpServer::CClientRequest::SendChunk(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen)
+{
+    CHAR szBufA[24 + MAX_COALESCED_CHUNK_SIZE];
+    SIZE_T nLen;
+
+    // NOTE: Small chunks are sent along with their header in the same packet. Larger ones are handed as is to the
+    //       socket manager which copies them into its own packets.
+    if (nDataLen <= MAX_COALESCED_CHUNK_SIZE)
+    {
+        nLen = FormatChunkHeader(szBufA, (ULONGLONG)nDataLen, sResponse.bChunkOpen);
+        ::MxMemCopy(szBufA + nLen, lpData, nDataLen);
+        sResponse.bChunkOpen = TRUE;
+        return lpHttpServer->cSocketMgr.SendMsg(hConn, szBufA, nLen + nDataLen);
+    }
+    else
+    {
+        HRESULT hRes;
+
+        hRes = SendChunkHeader((ULONGLONG)nDataLen);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHttpServer->cSocketMgr.SendMsg(hConn, lpData, nDataLen);
+        }
+        return hRes;
+    }
+}
+
+HRESULT CHttpServer::CClientRequest::SendChunkHeader(_In_ ULONGLONG nChunkLen)
+{
+    CHAR szBufA[24];
+    SIZE_T nLen;
+
+    // the CRLF that closes the previous chunk goes along with the header of the next one
+    nLen = FormatChunkHeader(szBufA, nChunkLen, sResponse.bChunkOpen);
+    sResponse.bChunkOpen = TRUE;
+    return lpHttpServer->cSocketMgr.SendMsg(hConn, szBufA, nLen);
+}
+
+HRESULT CHttpServer::CClientRequest::EndChunkedResponse()
+{
+    CHAR szBufA[24];
+    SIZE_T nLen;
+    HRESULT hRes;
+
+    hRes = StartStreamedResponse();
+    if (SUCCEEDED(hRes) && sResponse.bChunked != FALSE)
+    {
+        nLen = FormatChunkHeader(szBufA, 0ui64, sResponse.bChunkOpen);
+        szBufA[nLen++] = '\r';
+        szBufA[nLen++] = '\n';
+        sResponse.bChunkOpen = FALSE;
+        hRes = lpHttpServer->cSocketMgr.SendMsg(hConn, szBufA, nLen);
+    }
+    // done
+    return hRes;
+}
+
+BOOL CHttpServer::CClientRequest::IsIfRangeSatisfied() const
+{
+    CHttpHeaderBase *lpHeader;
+    LPCSTR szValueA;
+
+    lpHeader = GetRequestHeaderByName("If-Range");
+    if (lpHeader == NULL)
+    {
+        return TRUE;
+    }
+    szValueA = static_cast<CHttpHeaderGeneric *>(lpHeader)->GetValue();
+    while (*szValueA == ' ' || *szValueA == '\t')
+    {
+        szValueA++;
+    }
+
+    // NOTE: Only strong validators can be used with ranges so a weak entity tag never matches.
+    if (*szValueA == '"')
+    {
+        CHttpHeaderRespETag *lpETagHeader;
+        LPCSTR szTagA;
+        SIZE_T nTagLen;
+
+        lpETagHeader = sResponse.cHeaders.Find<CHttpHeaderRespETag>();
+        if (lpETagHeader == NULL || lpETagHeader->GetWeak() != FALSE)
+        {
+            return FALSE;
+        }
+        szTagA = lpETagHeader->GetTag();
+        nTagLen = StrLenA(szTagA);
+        if (StrNCompareA(szValueA + 1, szTagA, nTagLen) != 0 || szValueA[nTagLen + 1] != '"')
+        {
+            return FALSE;
+        }
+        for (szValueA += nTagLen + 2; *szValueA == ' ' || *szValueA == '\t'; szValueA++);
+        return (*szValueA == 0) ? TRUE : FALSE;
+    }
+    if (*szValueA != 'W' || szValueA[1] != '/')
+    {
+        CHttpHeaderEntLastModified *lpLastModifiedHeader;
+        CDateTime cDt;
+
+        lpLastModifiedHeader = sResponse.cHeaders.Find<CHttpHeaderEntLastModified>();
+        if (lpLastModifiedHeader != NULL && SUCCEEDED(Http::ParseDate(cDt, szValueA)) &&
+            cDt == lpLastModifiedHeader->GetDate())
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 VOID CHttpServer::CClientRequest::MarkLinkAsClosed()
 {
     _InterlockedOr(&nFlags, REQUEST_FLAG_LinkClosed);
@@ -1784,7 +2595,7 @@ VOID CHttpServer::CClientRequest::ResetResponseForNewRequest(_In_ BOOL bPreserve
     sResponse.cStrReasonA.Empty();
     if (bPreserveWebSocket == FALSE)
     {
-        sResponse.cHeaders.RemoveAllElements();
+        sResponse.cHeaders.RemoveAllElementsKeepingBuffer(MAX_RETAINED_LIST_SIZE);
     }
     else
     {
@@ -1802,12 +2613,22 @@ VOID CHttpServer::CClientRequest::ResetResponseForNewRequest(_In_ BOOL bPreserve
             }
         }
     }
-    sResponse.cCookies.RemoveAllElements();
-    sResponse.aStreamsList.RemoveAllElements();
-    sResponse.bLastStreamIsData = FALSE;
+    sResponse.cCookies.RemoveAllElementsKeepingBuffer(MAX_RETAINED_LIST_SIZE);
+    sResponse.aStreamsList.RemoveAllElementsKeepingBuffer(MAX_RETAINED_LIST_SIZE);
+    sResponse.bLastStreamIsData = sResponse.bHasExternalStreams = FALSE;
     sResponse.szMimeTypeHintA = NULL;
     sResponse.cStrFileNameW.Empty();
     sResponse.bDirect = sResponse.bPreserveWebSocketHeaders = FALSE;
+    sResponse.bStreamed = sResponse.bChunked = sResponse.bChunkOpen = FALSE;
+    sResponse.ullUnflushedBytes = 0ui64;
+
+    // keep the headers buffer for the next request unless a large response made it grow too much
+    if (sHeaderBuffer.nSize > MAX_RETAINED_HEADER_BUFFER_SIZE)
+    {
+        MX_FREE(sHeaderBuffer.lpBuffer);
+        sHeaderBuffer.nSize = 0;
+    }
+    sHeaderBuffer.nLen = 0;
     return;
 }
 
@@ -1933,19 +2754,173 @@ LPCWSTR CHttpServer::CClientRequest::GetNamedState(_In_ eState nState)
 
 //-----------------------------------------------------------
 
-static HRESULT WriteToStream(_In_ MX::CMemoryStream *lpStream, _In_ LPCSTR szStrA, _In_opt_ SIZE_T nStrLen)
+static SIZE_T GetCachedDateHeader(_Out_writes_(64) LPSTR szDestA)
 {
+    ULONGLONG nNow;
+    SIZE_T nLen;
+
+    ::GetSystemTimeAsFileTime((LPFILETIME)&nNow);
+    nNow /= 10000000ui64;
+
+    // the Date header has a one second resolution so format it once per second and share it between requests
+    {
+        MX::CAutoSlimRWLShared cLock(&(sCachedDate.sRwMutex));
+
+        if (sCachedDate.nSecond == nNow)
+        {
+            ::MxMemCopy(szDestA, sCachedDate.szLineA, sCachedDate.nLen);
+            return sCachedDate.nLen;
+        }
+    }
+
+    {
+        MX::CAutoSlimRWLExclusive cLock(&(sCachedDate.sRwMutex));
+
+        if (sCachedDate.nSecond != nNow)
+        {
+            MX::CDateTime cDtNow;
+            MX::CStringA cStrTempA;
+
+            if (FAILED(cDtNow.SetFromNow(FALSE)) ||
+                FAILED(cDtNow.Format(cStrTempA, "Date: %a, %d %b %Y %H:%M:%S %z\r\n")) ||
+                cStrTempA.GetLength() > MX_ARRAYLEN(sCachedDate.szLineA))
+            {
+                return 0;
+            }
+            ::MxMemCopy(sCachedDate.szLineA, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+            sCachedDate.nLen = cStrTempA.GetLength();
+            sCachedDate.nSecond = nNow;
+        }
+        ::MxMemCopy(szDestA, sCachedDate.szLineA, sCachedDate.nLen);
+        nLen = sCachedDate.nLen;
+    }
+    return nLen;
+}
+
+static SIZE_T FormatUInt64(_Out_writes_(24) LPSTR szDestA, _In_ ULONGLONG nValue)
+{
+    CHAR szTempA[24];
+    SIZE_T nLen = 0, i;
+
+    do
+    {
+        szTempA[nLen++] = (CHAR)('0' + (int)(nValue % 10ui64));
+        nValue /= 10ui64;
+    }
+    while (nValue > 0ui64);
+    for (i = 0; i < nLen; i++)
+    {
+        szDestA[i] = szTempA[nLen - i - 1];
+    }
+    return nLen;
+}
+
+static SIZE_T FormatChunkHeader(_Out_writes_(24) LPSTR szDestA, _In_ ULONGLONG nChunkLen, _In_ BOOL bCloseLast)
+{
+    static const CHAR szHexDigitsA[] = "0123456789ABCDEF";
+    SIZE_T nLen = 0;
+    int nShift;
+
+    if (bCloseLast != FALSE)
+    {
+        szDestA[nLen++] = '\r';
+        szDestA[nLen++] = '\n';
+    }
+    for (nShift = 60; nShift > 0 && (nChunkLen >> nShift) == 0ui64; nShift -= 4);
+    for (; nShift >= 0; nShift -= 4)
+    {
+        szDestA[nLen++] = szHexDigitsA[(int)((nChunkLen >> nShift) & 0x0Fui64)];
+    }
+    szDestA[nLen++] = '\r';
+    szDestA[nLen++] = '\n';
+    return nLen;
+}
+
+static SIZE_T CoalesceByteRanges(_Inout_updates_(nCount) LPBYTE_RANGE lpRanges, _In_ SIZE_T nCount)
+{
+    BYTE_RANGE sTemp;
+    SIZE_T i, j;
+
+    if (nCount == 0)
+    {
+        return 0;
+    }
+
+    // sort by start offset (the list is short)
+    for (i = 1; i < nCount; i++)
+    {
+        sTemp = lpRanges[i];
+        for (j = i; j > 0 && lpRanges[j - 1].nStart > sTemp.nStart; j--)
+        {
+            lpRanges[j] = lpRanges[j - 1];
+        }
+        lpRanges[j] = sTemp;
+    }
+
+    // merge overlapping and adjacent ranges
+    for (i = 0, j = 1; j < nCount; j++)
+    {
+        if (lpRanges[j].nStart <= lpRanges[i].nEnd + 1ui64)
+        {
+            if (lpRanges[j].nEnd > lpRanges[i].nEnd)
+            {
+                lpRanges[i].nEnd = lpRanges[j].nEnd;
+            }
+        }
+        else
+        {
+            lpRanges[++i] = lpRanges[j];
+        }
+    }
+    return i + 1;
+}
+
+static VOID GenerateByteRangesBoundary(_Out_writes_(BYTE_RANGES_BOUNDARY_LENGTH + 1) LPSTR szDestA, _In_ LPVOID lpContext)
+{
+    static LONG volatile nCounter = 0;
+    Fnv64_t value;
+    LONG nValue;
+    DWORD dw;
+    SIZE_T i, val;
+
+    MxMemCopy(szDestA, "MXLIB_RANGES", 12);
+#pragma warning(suppress : 28159)
+    dw = ::GetTickCount();
+    value = fnv_64a_buf(&dw, 4, FNV1A_64_INIT);
+    dw = MxGetCurrentProcessId();
+    value = fnv_64a_buf(&dw, 4, value);
+    value = fnv_64a_buf(&lpContext, sizeof(lpContext), value);
+    nValue = _InterlockedIncrement(&nCounter);
+    value = fnv_64a_buf(&nValue, sizeof(nValue), value);
+    for (i = 0; i < 16; i++)
+    {
+        val = (SIZE_T)(value & 15);
+        szDestA[12 + i] = (CHAR)(((val >= 10) ? 55 : 48) + val);
+        value >>= 4;
+    }
+    szDestA[BYTE_RANGES_BOUNDARY_LENGTH] = 0;
+    return;
+}
+
+static HRESULT SendByteRangesPartHeader(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_ MX::CStringA &cStrPartA)
+{
+    MX::TAutoRefCounted<MX::CMemoryStream> cStream;
     SIZE_T nWritten;
     HRESULT hRes;
 
-    if (nStrLen == (SIZE_T)-1)
+    cStream.Attach(MX_DEBUG_NEW MX::CMemoryStream(256));
+    if (!cStream)
     {
-        nStrLen = MX::StrLenA(szStrA);
+        return E_OUTOFMEMORY;
     }
-    hRes = lpStream->Write(szStrA, nStrLen, nWritten);
-    if (SUCCEEDED(hRes) && nStrLen != nWritten)
+    hRes = cStream->Create(cStrPartA.GetLength(), FALSE);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cStream->Write((LPCSTR)cStrPartA, cStrPartA.GetLength(), nWritten);
+    }
+    if (SUCCEEDED(hRes))
     {
-        hRes = MX_E_WriteFault;
+        hRes = lpRequest->SendStream(cStream.Get());
     }
     return hRes;
 }
@@ -0,0 +1,1085 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\..\Include\Http\HttpStaticFileCache.h"
+#include "..\..\Include\MemoryStream.h"
+#include "..\..\Include\FileStream.h"
+#include "..\..\Include\RangeStream.h"
+#include "..\..\Include\DateTime\DateTime.h"
+
+// NOTE: Larger bodies would not fit in the headers packet so copying them buys nothing.
+#define SMALL_BODY_SIZE 4096
+
+ //-----------------------------------------------------------
+
+static const LPCWSTR aVariantSuffixesW[] = { L"", L".br", L".gz" };
+
+//-----------------------------------------------------------
+
+static BOOL AcceptsEncoding(_In_opt_ MX::CHttpHeaderReqAcceptEncoding *lpHeader, _In_z_ LPCSTR szEncodingA);
+static VOID FormatETag(_Out_writes_(17) LPSTR szDestA, _In_ Fnv64_t nHash);
+static ULONGLONG FileTimeToSeconds(_In_ const FILETIME &ft);
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+class CHttpStaticFileCache::CCachedFile : public virtual TRefCounted<CBaseMemObj>
+{
+public:
+    CCachedFile() : TRefCounted<CBaseMemObj>()
+    {
+        SIZE_T i;
+
+        for (i = 0; i < MX_ARRAYLEN(aVariants); i++)
+        {
+            aVariants[i].sInfo.nSize = ULONGLONG_MAX;
+            aVariants[i].sInfo.ftLastWrite.dwLowDateTime = aVariants[i].sInfo.ftLastWrite.dwHighDateTime = 0;
+            aVariants[i].szETagA[0] = 0;
+        }
+        return;
+    };
+
+public:
+    CLnkLstNode cLruListNode;
+    CCachedFile *lpNextInBucket{ NULL };
+    Fnv64_t nHash{ 0 };
+    BOOL bLinked{ FALSE };
+    CStringW cStrRelativeW;
+    CStringW cStrFullPathW;
+    LPCSTR szMimeTypeA{ NULL };
+    LONG volatile nGeneration{ 0 };
+    LONG volatile nLastCheckTick{ 0 };
+    SIZE_T nMemoryBytes{ 0 };
+    struct
+    {
+        FILE_INFO sInfo;
+        TAutoRefCounted<CMemoryStream> cStream; // NULL if the variant is read from disk on each request
+        CHAR szETagA[20];
+    } aVariants[VariantsCount];
+};
+
+//-----------------------------------------------------------
+
+CHttpStaticFileCache::CHttpStaticFileCache() : CBaseMemObj(), CNonCopyableObj()
+{
+    SIZE_T i;
+
+    for (i = 0; i < MX_ARRAYLEN(aShards); i++)
+    {
+        aShards[i].nMutex = MX_FASTLOCK_INIT;
+        ::MxMemSet(aShards[i].aBuckets, 0, sizeof(aShards[i].aBuckets));
+        aShards[i].nBytes = 0;
+    }
+    return;
+}
+
+CHttpStaticFileCache::~CHttpStaticFileCache()
+{
+    Flush();
+    if (hChangeNotification != NULL)
+    {
+        ::FindCloseChangeNotification(hChangeNotification);
+    }
+    return;
+}
+
+HRESULT CHttpStaticFileCache::Initialize(_In_z_ LPCWSTR szRootFolderW)
+{
+    DWORD dwAttributes;
+    SIZE_T nLen;
+
+    if (szRootFolderW == NULL)
+    {
+        return E_POINTER;
+    }
+    if (*szRootFolderW == 0)
+    {
+        return E_INVALIDARG;
+    }
+    if (cStrRootFolderW.IsEmpty() == FALSE)
+    {
+        return MX_E_AlreadyInitialized;
+    }
+
+    dwAttributes = ::GetFileAttributesW(szRootFolderW);
+    if (dwAttributes == INVALID_FILE_ATTRIBUTES)
+    {
+        return MX_HRESULT_FROM_LASTERROR();
+    }
+    if ((dwAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+    {
+        return MX_E_PathNotFound;
+    }
+
+    nLen = StrLenW(szRootFolderW);
+    while (nLen > 1 && (szRootFolderW[nLen - 1] == L'\\' || szRootFolderW[nLen - 1] == L'/'))
+    {
+        nLen--;
+    }
+    if (cStrRootFolderW.CopyN(szRootFolderW, nLen) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // NOTE: If the notification cannot be set up, we fall back to polling.
+    hChangeNotification = ::FindFirstChangeNotificationW((LPCWSTR)cStrRootFolderW, TRUE,
+                                                         FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                                                         FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if (hChangeNotification == INVALID_HANDLE_VALUE)
+    {
+        hChangeNotification = NULL;
+    }
+
+    // done
+    return S_OK;
+}
+
+VOID CHttpStaticFileCache::SetMaxCacheSize(_In_ SIZE_T nMaxBytes)
+{
+    nMaxCacheSize = nMaxBytes;
+    return;
+}
+
+VOID CHttpStaticFileCache::SetMaxCachedFileSize(_In_ SIZE_T nMaxBytes)
+{
+    nMaxCachedFileSize = nMaxBytes;
+    return;
+}
+
+VOID CHttpStaticFileCache::SetRevalidateInterval(_In_ DWORD dwMilliseconds)
+{
+    dwRevalidateIntervalMs = dwMilliseconds;
+    return;
+}
+
+VOID CHttpStaticFileCache::SetMaxAge(_In_ DWORD dwSeconds)
+{
+    dwMaxAge = dwSeconds;
+    return;
+}
+
+VOID CHttpStaticFileCache::SetDefaultDocument(_In_opt_z_ LPCWSTR szFileNameW)
+{
+    if (szFileNameW != NULL && *szFileNameW != 0)
+    {
+        cStrDefaultDocumentW.Copy(szFileNameW);
+    }
+    else
+    {
+        cStrDefaultDocumentW.Empty();
+    }
+    return;
+}
+
+VOID CHttpStaticFileCache::EnablePrecompressed(_In_ BOOL bEnable)
+{
+    bPrecompressed = bEnable;
+    return;
+}
+
+HRESULT CHttpStaticFileCache::Serve(_In_ CHttpServer::CClientRequest *lpRequest)
+{
+    CUrl *lpUrl;
+
+    if (lpRequest == NULL)
+    {
+        return E_POINTER;
+    }
+    lpUrl = lpRequest->GetUrl();
+    if (lpUrl == NULL)
+    {
+        return MX_E_InvalidState;
+    }
+    return Serve(lpRequest, lpUrl->GetPath());
+}
+
+HRESULT CHttpStaticFileCache::Serve(_In_ CHttpServer::CClientRequest *lpRequest, _In_z_ LPCWSTR szPathW)
+{
+    TAutoRefCounted<CCachedFile> cFile;
+    CStringW cStrRelativeW, cStrFullPathW;
+    FILE_INFO sInfo;
+    LPCSTR szMethodA;
+    Fnv64_t nHash;
+    HRESULT hRes;
+
+    if (lpRequest == NULL || szPathW == NULL)
+    {
+        return E_POINTER;
+    }
+    if (cStrRootFolderW.IsEmpty() != FALSE)
+    {
+        return MX_E_NotReady;
+    }
+    szMethodA = lpRequest->GetMethod();
+    if (szMethodA == NULL || (StrCompareA(szMethodA, "GET") != 0 && StrCompareA(szMethodA, "HEAD") != 0))
+    {
+        return MX_E_Unsupported;
+    }
+
+    hRes = BuildFileName(szPathW, cStrRelativeW, cStrFullPathW);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    nHash = fnv_64a_buf((LPCWSTR)cStrRelativeW, cStrRelativeW.GetLength() * sizeof(WCHAR), FNV1A_64_INIT);
+
+    CheckChangeNotification();
+
+    // lookup the cache
+    cFile.Attach(Lookup(nHash, cStrRelativeW));
+    if (cFile && Revalidate(cFile.Get()) == FALSE)
+    {
+        Remove(cFile.Get());
+        cFile.Release();
+    }
+
+    if (cFile)
+    {
+        _InterlockedIncrement64(&(sStats.nHits));
+    }
+    else
+    {
+        _InterlockedIncrement64(&(sStats.nMisses));
+
+        hRes = GetFileInfo((LPCWSTR)cStrFullPathW, &sInfo);
+        if (FAILED(hRes))
+        {
+            return MX_E_NotFound;
+        }
+        hRes = LoadFile(nHash, cStrRelativeW, cStrFullPathW, &sInfo, &cFile);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (cFile->nMemoryBytes > 0)
+        {
+            Insert(cFile.Get());
+        }
+        if (cFile->bLinked == FALSE)
+        {
+            _InterlockedIncrement64(&(sStats.nUncacheable));
+        }
+    }
+
+    // done
+    return SendFile(lpRequest, cFile.Get());
+}
+
+VOID CHttpStaticFileCache::Flush()
+{
+    SIZE_T i;
+
+    for (i = 0; i < MX_ARRAYLEN(aShards); i++)
+    {
+        FlushShard(&aShards[i]);
+    }
+    return;
+}
+
+VOID CHttpStaticFileCache::GetStats(_Out_ LPSTATS lpStats)
+{
+    if (lpStats != NULL)
+    {
+        lpStats->nEntries = (ULONGLONG)__InterlockedRead64(&(sStats.nEntries));
+        lpStats->nCachedBytes = (ULONGLONG)__InterlockedRead64(&(sStats.nCachedBytes));
+        lpStats->nHits = (ULONGLONG)__InterlockedRead64(&(sStats.nHits));
+        lpStats->nMisses = (ULONGLONG)__InterlockedRead64(&(sStats.nMisses));
+        lpStats->nUncacheable = (ULONGLONG)__InterlockedRead64(&(sStats.nUncacheable));
+        lpStats->nEvictions = (ULONGLONG)__InterlockedRead64(&(sStats.nEvictions));
+        lpStats->nRevalidations = (ULONGLONG)__InterlockedRead64(&(sStats.nRevalidations));
+        lpStats->nNotModified = (ULONGLONG)__InterlockedRead64(&(sStats.nNotModified));
+        lpStats->nPartialContent = (ULONGLONG)__InterlockedRead64(&(sStats.nPartialContent));
+    }
+    return;
+}
+
+HRESULT CHttpStaticFileCache::BuildFileName(_In_z_ LPCWSTR szPathW, _Inout_ CStringW &cStrRelativeW,
+                                            _Inout_ CStringW &cStrFullPathW)
+{
+    LPCWSTR sW, szSegmentW;
+    LPWSTR szDestW;
+    SIZE_T nLen;
+
+    while (*szPathW == L'/' || *szPathW == L'\\')
+    {
+        szPathW++;
+    }
+
+    // reject anything that may escape the root folder or alias another file
+    for (sW = szPathW; *sW != 0; sW++)
+    {
+        szSegmentW = sW;
+        while (*sW != 0 && *sW != L'/' && *sW != L'\\')
+        {
+            if (*sW < 32 || *sW == L':' || *sW == L'*' || *sW == L'?' || *sW == L'"' || *sW == L'<' || *sW == L'>' ||
+                *sW == L'|')
+            {
+                return MX_E_NotFound;
+            }
+            sW++;
+        }
+        if (sW == szSegmentW)
+        {
+            if (*sW != 0)
+            {
+                return MX_E_NotFound; // empty segment
+            }
+            break;
+        }
+        if (*(sW - 1) == L'.' || *(sW - 1) == L' ')
+        {
+            return MX_E_NotFound; // also catches "." and ".."
+        }
+        if (*sW == 0)
+        {
+            break;
+        }
+    }
+    nLen = (SIZE_T)(sW - szPathW);
+
+    if (cStrRelativeW.CopyN(szPathW, nLen) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    if (nLen == 0 || szPathW[nLen - 1] == L'/' || szPathW[nLen - 1] == L'\\')
+    {
+        if (cStrDefaultDocumentW.IsEmpty() != FALSE)
+        {
+            return MX_E_NotFound;
+        }
+        if (cStrRelativeW.ConcatN((LPCWSTR)cStrDefaultDocumentW, cStrDefaultDocumentW.GetLength()) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+    for (szDestW = (LPWSTR)cStrRelativeW; *szDestW != 0; szDestW++)
+    {
+        if (*szDestW == L'/')
+        {
+            *szDestW = L'\\';
+        }
+    }
+
+    if (cStrFullPathW.CopyN((LPCWSTR)cStrRootFolderW, cStrRootFolderW.GetLength()) == FALSE ||
+        cStrFullPathW.ConcatN(L"\\", 1) == FALSE ||
+        cStrFullPathW.ConcatN((LPCWSTR)cStrRelativeW, cStrRelativeW.GetLength()) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // NOTE: The file system is case insensitive so the cache key is too.
+    StrToLowerW((LPWSTR)cStrRelativeW);
+
+    // done
+    return S_OK;
+}
+
+VOID CHttpStaticFileCache::CheckChangeNotification()
+{
+    if (hChangeNotification != NULL && ::WaitForSingleObject(hChangeNotification, 0) == WAIT_OBJECT_0)
+    {
+        // mark all entries as stale and rearm
+        _InterlockedIncrement(&nGeneration);
+        ::FindNextChangeNotification(hChangeNotification);
+    }
+    return;
+}
+
+CHttpStaticFileCache::CCachedFile *CHttpStaticFileCache::Lookup(_In_ Fnv64_t nHash, _In_ CStringW &cStrRelativeW)
+{
+    LPSHARD lpShard = &aShards[(SIZE_T)(nHash >> 60) & (MX_HTTP_STATIC_FILE_CACHE_SHARDS_COUNT - 1)];
+    CFastLock cLock(&(lpShard->nMutex));
+    CCachedFile *lpFile;
+
+    for (lpFile = lpShard->aBuckets[(SIZE_T)nHash & (MX_HTTP_STATIC_FILE_CACHE_BUCKETS_COUNT - 1)]; lpFile != NULL;
+         lpFile = lpFile->lpNextInBucket)
+    {
+        if (lpFile->nHash == nHash && lpFile->cStrRelativeW.GetLength() == cStrRelativeW.GetLength() &&
+            StrCompareW((LPCWSTR)(lpFile->cStrRelativeW), (LPCWSTR)cStrRelativeW) == 0)
+        {
+            // move to the front of the lru list
+            lpShard->cLruList.Remove(&(lpFile->cLruListNode));
+            lpShard->cLruList.PushHead(&(lpFile->cLruListNode));
+
+            lpFile->AddRef();
+            return lpFile;
+        }
+    }
+    return NULL;
+}
+
+VOID CHttpStaticFileCache::Insert(_In_ CCachedFile *lpFile)
+{
+    LPSHARD lpShard = &aShards[(SIZE_T)(lpFile->nHash >> 60) & (MX_HTTP_STATIC_FILE_CACHE_SHARDS_COUNT - 1)];
+    CFastLock cLock(&(lpShard->nMutex));
+    CCachedFile **lplpBucket, *lpOldFile;
+    SIZE_T nMaxBytes;
+
+    nMaxBytes = nMaxCacheSize / MX_HTTP_STATIC_FILE_CACHE_SHARDS_COUNT;
+    if (lpFile->nMemoryBytes > nMaxBytes)
+    {
+        return;
+    }
+
+    // another thread may have loaded the same file, keep the newest copy
+    lplpBucket = &(lpShard->aBuckets[(SIZE_T)(lpFile->nHash) & (MX_HTTP_STATIC_FILE_CACHE_BUCKETS_COUNT - 1)]);
+    for (lpOldFile = *lplpBucket; lpOldFile != NULL; lpOldFile = lpOldFile->lpNextInBucket)
+    {
+        if (lpOldFile->nHash == lpFile->nHash && StrCompareW((LPCWSTR)(lpOldFile->cStrRelativeW),
+                                                             (LPCWSTR)(lpFile->cStrRelativeW)) == 0)
+        {
+            Unlink(lpShard, lpOldFile);
+            break;
+        }
+    }
+
+    // evict the least recently used files
+    while (lpShard->nBytes + lpFile->nMemoryBytes > nMaxBytes && lpShard->cLruList.IsEmpty() == FALSE)
+    {
+        lpOldFile = CONTAINING_RECORD(lpShard->cLruList.GetTail(), CCachedFile, cLruListNode);
+        Unlink(lpShard, lpOldFile);
+
+        _InterlockedIncrement64(&(sStats.nEvictions));
+    }
+
+    lpFile->AddRef();
+    lpFile->lpNextInBucket = *lplpBucket;
+    *lplpBucket = lpFile;
+    lpShard->cLruList.PushHead(&(lpFile->cLruListNode));
+    lpShard->nBytes += lpFile->nMemoryBytes;
+    lpFile->bLinked = TRUE;
+
+    _InterlockedIncrement64(&(sStats.nEntries));
+    _InterlockedExchangeAdd64(&(sStats.nCachedBytes), (LONGLONG)(lpFile->nMemoryBytes));
+    return;
+}
+
+VOID CHttpStaticFileCache::Remove(_In_ CCachedFile *lpFile)
+{
+    LPSHARD lpShard = &aShards[(SIZE_T)(lpFile->nHash >> 60) & (MX_HTTP_STATIC_FILE_CACHE_SHARDS_COUNT - 1)];
+    CFastLock cLock(&(lpShard->nMutex));
+
+    // the entry may have been evicted or replaced meanwhile
+    if (lpFile->bLinked != FALSE)
+    {
+        Unlink(lpShard, lpFile);
+    }
+    return;
+}
+
+VOID CHttpStaticFileCache::Unlink(_In_ LPSHARD lpShard, _In_ CCachedFile *lpFile)
+{
+    CCachedFile **lplpPrev;
+
+    lplpPrev = &(lpShard->aBuckets[(SIZE_T)(lpFile->nHash) & (MX_HTTP_STATIC_FILE_CACHE_BUCKETS_COUNT - 1)]);
+    while (*lplpPrev != lpFile)
+    {
+        lplpPrev = &((*lplpPrev)->lpNextInBucket);
+    }
+    *lplpPrev = lpFile->lpNextInBucket;
+    lpFile->lpNextInBucket = NULL;
+    lpShard->cLruList.Remove(&(lpFile->cLruListNode));
+    lpShard->nBytes -= lpFile->nMemoryBytes;
+    lpFile->bLinked = FALSE;
+
+    _InterlockedDecrement64(&(sStats.nEntries));
+    _InterlockedExchangeAdd64(&(sStats.nCachedBytes), -(LONGLONG)(lpFile->nMemoryBytes));
+
+    lpFile->Release();
+    return;
+}
+
+VOID CHttpStaticFileCache::FlushShard(_In_ LPSHARD lpShard)
+{
+    CFastLock cLock(&(lpShard->nMutex));
+    CLnkLstNode *lpNode;
+    CCachedFile *lpFile;
+
+    while ((lpNode = lpShard->cLruList.PopHead()) != NULL)
+    {
+        lpFile = CONTAINING_RECORD(lpNode, CCachedFile, cLruListNode);
+        lpFile->lpNextInBucket = NULL;
+        lpFile->bLinked = FALSE;
+
+        _InterlockedDecrement64(&(sStats.nEntries));
+        _InterlockedExchangeAdd64(&(sStats.nCachedBytes), -(LONGLONG)(lpFile->nMemoryBytes));
+
+        lpFile->Release();
+    }
+    ::MxMemSet(lpShard->aBuckets, 0, sizeof(lpShard->aBuckets));
+    lpShard->nBytes = 0;
+    return;
+}
+
+HRESULT CHttpStaticFileCache::LoadFile(_In_ Fnv64_t nHash, _In_ CStringW &cStrRelativeW, _In_ CStringW &cStrFullPathW,
+                                       _In_ LPFILE_INFO lpInfo, _Deref_out_ CCachedFile **lplpFile)
+{
+    TAutoRefCounted<CCachedFile> cFile;
+    CStringW cStrFileNameW;
+    BOOL bCacheable;
+    SIZE_T nVariant;
+    HRESULT hRes;
+
+    *lplpFile = NULL;
+
+    cFile.Attach(MX_DEBUG_NEW CCachedFile());
+    if (!cFile)
+    {
+        return E_OUTOFMEMORY;
+    }
+    cFile->nHash = nHash;
+    if (cFile->cStrRelativeW.CopyN((LPCWSTR)cStrRelativeW, cStrRelativeW.GetLength()) == FALSE ||
+        cFile->cStrFullPathW.CopyN((LPCWSTR)cStrFullPathW, cStrFullPathW.GetLength()) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    cFile->szMimeTypeA = Http::GetMimeType((LPCWSTR)cStrFullPathW);
+
+    // NOTE: Take the generation before reading so a change made while loading marks the entry as stale.
+    cFile->nGeneration = __InterlockedRead(&nGeneration);
+    cFile->nLastCheckTick = (LONG)::GetTickCount();
+
+    bCacheable = (nMaxCacheSize > 0 && lpInfo->nSize <= (ULONGLONG)nMaxCachedFileSize) ? TRUE : FALSE;
+    for (nVariant = 0; nVariant < (SIZE_T)VariantsCount; nVariant++)
+    {
+        FILE_INFO &sInfo = cFile->aVariants[nVariant].sInfo;
+
+        if (nVariant == (SIZE_T)VariantIdentity)
+        {
+            ::MxMemCopy(&sInfo, lpInfo, sizeof(FILE_INFO));
+        }
+        else
+        {
+            if (bPrecompressed == FALSE)
+            {
+                break;
+            }
+            hRes = GetVariantFileName(cStrFullPathW, (eVariant)nVariant, cStrFileNameW);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+            if (FAILED(GetFileInfo((LPCWSTR)cStrFileNameW, &sInfo)))
+            {
+                continue;
+            }
+        }
+
+        if (bCacheable != FALSE && sInfo.nSize <= (ULONGLONG)nMaxCachedFileSize)
+        {
+            TAutoRefCounted<CFileStream> cFileStream;
+            TAutoRefCounted<CMemoryStream> cMemStream;
+            SIZE_T nRead;
+
+            if (nVariant != (SIZE_T)VariantIdentity)
+            {
+                hRes = GetVariantFileName(cStrFullPathW, (eVariant)nVariant, cStrFileNameW);
+                if (FAILED(hRes))
+                {
+                    return hRes;
+                }
+            }
+            cFileStream.Attach(MX_DEBUG_NEW CFileStream());
+            cMemStream.Attach(MX_DEBUG_NEW CMemoryStream((SIZE_T)(sInfo.nSize) + 1));
+            if ((!cFileStream) || (!cMemStream))
+            {
+                return E_OUTOFMEMORY;
+            }
+            hRes = cFileStream->Create((nVariant == (SIZE_T)VariantIdentity) ? (LPCWSTR)cStrFullPathW
+                                                                              : (LPCWSTR)cStrFileNameW,
+                                       GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cMemStream->Create((SIZE_T)(sInfo.nSize));
+            }
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cFileStream->CopyTo(cMemStream.Get(), (SIZE_T)(sInfo.nSize), nRead, 0ui64);
+            }
+            if (FAILED(hRes))
+            {
+                if (nVariant == (SIZE_T)VariantIdentity)
+                {
+                    return (hRes == MX_E_FileNotFound || hRes == MX_E_PathNotFound) ? MX_E_NotFound : hRes;
+                }
+                sInfo.nSize = ULONGLONG_MAX;
+                continue;
+            }
+
+            // NOTE: If the file was modified while reading, the next revalidation will see a different size or
+            //       write time and reload it.
+            sInfo.nSize = (ULONGLONG)nRead;
+            FormatETag(cFile->aVariants[nVariant].szETagA,
+                       fnv_64a_buf(cMemStream->GetRawBuffer(), nRead, FNV1A_64_INIT));
+
+            cFile->aVariants[nVariant].cStream = cMemStream;
+            cFile->nMemoryBytes += nRead;
+        }
+        else
+        {
+            FormatETag(cFile->aVariants[nVariant].szETagA, fnv_64a_buf(&sInfo, sizeof(sInfo), FNV1A_64_INIT));
+        }
+    }
+
+    // done
+    *lplpFile = cFile.Detach();
+    return S_OK;
+}
+
+BOOL CHttpStaticFileCache::Revalidate(_In_ CCachedFile *lpFile)
+{
+    CStringW cStrFileNameW;
+    FILE_INFO sInfo;
+    LONG nCurrGeneration;
+    SIZE_T nVariant;
+
+    nCurrGeneration = __InterlockedRead(&nGeneration);
+    if (lpFile->nGeneration == nCurrGeneration)
+    {
+        if (hChangeNotification != NULL || dwRevalidateIntervalMs == 0)
+        {
+            return TRUE;
+        }
+        if ((DWORD)(::GetTickCount() - (DWORD)__InterlockedRead(&(lpFile->nLastCheckTick))) < dwRevalidateIntervalMs)
+        {
+            return TRUE;
+        }
+    }
+
+    _InterlockedIncrement64(&(sStats.nRevalidations));
+
+    for (nVariant = 0; nVariant < (SIZE_T)VariantsCount; nVariant++)
+    {
+        if (nVariant != (SIZE_T)VariantIdentity && bPrecompressed == FALSE)
+        {
+            break;
+        }
+        if (FAILED(GetVariantFileName(lpFile->cStrFullPathW, (eVariant)nVariant, cStrFileNameW)))
+        {
+            return FALSE;
+        }
+        if (FAILED(GetFileInfo((LPCWSTR)cStrFileNameW, &sInfo)))
+        {
+            sInfo.nSize = ULONGLONG_MAX;
+            sInfo.ftLastWrite.dwLowDateTime = sInfo.ftLastWrite.dwHighDateTime = 0;
+        }
+        if (sInfo.nSize != lpFile->aVariants[nVariant].sInfo.nSize ||
+            (sInfo.nSize != ULONGLONG_MAX &&
+             ::CompareFileTime(&(sInfo.ftLastWrite), &(lpFile->aVariants[nVariant].sInfo.ftLastWrite)) != 0))
+        {
+            return FALSE;
+        }
+    }
+
+    // still valid
+    _InterlockedExchange(&(lpFile->nGeneration), nCurrGeneration);
+    _InterlockedExchange(&(lpFile->nLastCheckTick), (LONG)::GetTickCount());
+    return TRUE;
+}
+
+HRESULT CHttpStaticFileCache::SendFile(_In_ CHttpServer::CClientRequest *lpRequest, _In_ CCachedFile *lpFile)
+{
+    CHttpHeaderReqAcceptEncoding *lpAcceptEncodingHeader;
+    CHttpHeaderReqIfNoneMatch *lpIfNoneMatchHeader;
+    CHttpHeaderReqIfModifiedSince *lpIfModifiedSinceHeader;
+    CHttpHeaderReqRange *lpRangeHeader;
+    TAutoRefCounted<CStream> cStream;
+    CStringW cStrFileNameW;
+    eVariant nVariant;
+    ULONGLONG nSize, nRangeStart, nRangeEnd;
+    BOOL bHasVariants, bNotModified, bPartial, bMultiRange, bIsHead;
+    HRESULT hRes;
+
+    bIsHead = (StrCompareA(lpRequest->GetMethod(), "HEAD") == 0) ? TRUE : FALSE;
+
+    // pick the representation
+    nVariant = VariantIdentity;
+    bHasVariants = FALSE;
+    if (bPrecompressed != FALSE)
+    {
+        bHasVariants = (lpFile->aVariants[VariantBrotli].sInfo.nSize != ULONGLONG_MAX ||
+                        lpFile->aVariants[VariantGZip].sInfo.nSize != ULONGLONG_MAX) ? TRUE : FALSE;
+        if (bHasVariants != FALSE)
+        {
+            lpAcceptEncodingHeader = lpRequest->GetRequestHeader<CHttpHeaderReqAcceptEncoding>();
+            if (lpFile->aVariants[VariantBrotli].sInfo.nSize != ULONGLONG_MAX &&
+                AcceptsEncoding(lpAcceptEncodingHeader, "br") != FALSE)
+            {
+                nVariant = VariantBrotli;
+            }
+            else if (lpFile->aVariants[VariantGZip].sInfo.nSize != ULONGLONG_MAX &&
+                     AcceptsEncoding(lpAcceptEncodingHeader, "gzip") != FALSE)
+            {
+                nVariant = VariantGZip;
+            }
+        }
+    }
+    nSize = lpFile->aVariants[nVariant].sInfo.nSize;
+
+    // conditional requests
+    bNotModified = FALSE;
+    lpIfNoneMatchHeader = lpRequest->GetRequestHeader<CHttpHeaderReqIfNoneMatch>();
+    if (lpIfNoneMatchHeader != NULL)
+    {
+        CHttpHeaderReqIfNoneMatch::CEntity *lpEntity;
+        SIZE_T i, nCount;
+
+        nCount = lpIfNoneMatchHeader->GetEntitiesCount();
+        for (i = 0; i < nCount; i++)
+        {
+            lpEntity = lpIfNoneMatchHeader->GetEntity(i);
+            if (StrCompareA(lpEntity->GetTag(), "*") == 0 ||
+                StrCompareA(lpEntity->GetTag(), lpFile->aVariants[nVariant].szETagA) == 0)
+            {
+                bNotModified = TRUE;
+                break;
+            }
+        }
+    }
+    else
+    {
+        lpIfModifiedSinceHeader = lpRequest->GetRequestHeader<CHttpHeaderReqIfModifiedSince>();
+        if (lpIfModifiedSinceHeader != NULL)
+        {
+            CDateTime cDt = lpIfModifiedSinceHeader->GetDate();
+            FILETIME ft;
+
+            if (SUCCEEDED(cDt.GetFileTime(ft)) &&
+                FileTimeToSeconds(lpFile->aVariants[VariantIdentity].sInfo.ftLastWrite) <= FileTimeToSeconds(ft))
+            {
+                bNotModified = TRUE;
+            }
+        }
+    }
+
+    // validators
+    hRes = (bNotModified != FALSE) ? lpRequest->SetResponseStatus(304) : S_OK;
+    if (SUCCEEDED(hRes))
+    {
+        CHttpHeaderRespETag *lpHeader;
+
+        hRes = lpRequest->AddResponseHeader<CHttpHeaderRespETag>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetTag(lpFile->aVariants[nVariant].szETagA);
+        }
+    }
+    if (SUCCEEDED(hRes))
+    {
+        CHttpHeaderEntLastModified *lpHeader;
+        CDateTime cDt;
+        ULARGE_INTEGER uli;
+        FILETIME ft;
+
+        // whole seconds so a date sent back in "If-Range" can match it exactly
+        uli.QuadPart = FileTimeToSeconds(lpFile->aVariants[VariantIdentity].sInfo.ftLastWrite) * 10000000ui64;
+        ft.dwLowDateTime = uli.LowPart;
+        ft.dwHighDateTime = uli.HighPart;
+        hRes = cDt.SetFromFileTime(ft);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpRequest->AddResponseHeader<CHttpHeaderEntLastModified>(&lpHeader);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = lpHeader->SetDate(cDt);
+            }
+        }
+    }
+    if (SUCCEEDED(hRes) && dwMaxAge > 0)
+    {
+        CHttpHeaderRespCacheControl *lpHeader;
+
+        hRes = lpRequest->AddResponseHeader<CHttpHeaderRespCacheControl>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetPublic(TRUE);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = lpHeader->SetMaxAge((ULONGLONG)dwMaxAge);
+            }
+        }
+    }
+    if (SUCCEEDED(hRes) && bHasVariants != FALSE)
+    {
+        hRes = lpRequest->AddResponseHeader("Vary", "Accept-Encoding", 15);
+    }
+    if (FAILED(hRes) || bNotModified != FALSE)
+    {
+        if (SUCCEEDED(hRes))
+        {
+            _InterlockedIncrement64(&(sStats.nNotModified));
+        }
+        return hRes;
+    }
+
+    // range requests
+    // NOTE: "If-Range" is checked against the validators added above. If it does not match, the whole entity is sent
+    //       for both single and multiple ranges.
+    bPartial = bMultiRange = FALSE;
+    nRangeStart = 0ui64;
+    nRangeEnd = (nSize > 0ui64) ? (nSize - 1ui64) : 0ui64;
+    lpRangeHeader = lpRequest->GetRequestHeader<CHttpHeaderReqRange>();
+    if (lpRangeHeader != NULL && lpRequest->IsIfRangeSatisfied() == FALSE)
+    {
+        lpRangeHeader = NULL;
+    }
+    if (lpRangeHeader != NULL && lpRangeHeader->GetRangeSetsCount() == 1)
+    {
+        if (lpRangeHeader->GetRangeSetBounds(0, nSize, &nRangeStart, &nRangeEnd) == FALSE)
+        {
+            CHttpHeaderEntContentRange *lpContentRangeHeader;
+
+            hRes = lpRequest->SetResponseStatus(416);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = lpRequest->AddResponseHeader<CHttpHeaderEntContentRange>(&lpContentRangeHeader);
+            }
+            if (SUCCEEDED(hRes))
+            {
+                hRes = lpContentRangeHeader->SetUnsatisfiedRange(nSize);
+            }
+            return hRes;
+        }
+        hRes = lpRequest->SetResponseStatus(206);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        bPartial = TRUE;
+    }
+    else if (lpRangeHeader != NULL && lpRangeHeader->GetRangeSetsCount() > 1 && bIsHead == FALSE)
+    {
+        // NOTE: Multiple ranges are answered as "multipart/byteranges" by the request itself.
+        bMultiRange = TRUE;
+    }
+
+    // entity headers
+    if (nVariant != VariantIdentity)
+    {
+        CHttpHeaderEntContentEncoding *lpHeader;
+
+        hRes = lpRequest->AddResponseHeader<CHttpHeaderEntContentEncoding>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetEncoding((nVariant == VariantBrotli) ? CHttpHeaderEntContentEncoding::eEncoding::Brotli
+                                                                     : CHttpHeaderEntContentEncoding::eEncoding::GZip);
+        }
+    }
+    if (SUCCEEDED(hRes))
+    {
+        CHttpHeaderRespAcceptRanges *lpHeader;
+
+        hRes = lpRequest->AddResponseHeader<CHttpHeaderRespAcceptRanges>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetRange(CHttpHeaderRespAcceptRanges::RangeBytes);
+        }
+    }
+    if (SUCCEEDED(hRes) && bPartial != FALSE)
+    {
+        CHttpHeaderEntContentRange *lpHeader;
+
+        hRes = lpRequest->AddResponseHeader<CHttpHeaderEntContentRange>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetRange(nRangeStart, nRangeEnd, nSize);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            _InterlockedIncrement64(&(sStats.nPartialContent));
+        }
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // a HEAD request only gets the headers
+    if (bIsHead != FALSE)
+    {
+        CHttpHeaderEntContentLength *lpHeader;
+
+        hRes = lpRequest->AddResponseHeader<CHttpHeaderEntContentLength>(&lpHeader);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpHeader->SetLength((nSize > 0ui64) ? (nRangeEnd - nRangeStart + 1ui64) : 0ui64);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = lpRequest->AddResponseHeader("Content-Type", (lpFile->szMimeTypeA != NULL) ? lpFile->szMimeTypeA
+                                                                                              : "application/octet-stream");
+        }
+        return hRes;
+    }
+
+    // body
+    if (nSize > 0ui64)
+    {
+        if (lpFile->aVariants[nVariant].cStream)
+        {
+            CMemoryStream *lpMemStream = lpFile->aVariants[nVariant].cStream.Get();
+
+            // small bodies are copied so they can leave in the same packet as the headers
+            if (bMultiRange == FALSE && nRangeEnd - nRangeStart + 1ui64 <= (ULONGLONG)SMALL_BODY_SIZE)
+            {
+                hRes = lpRequest->SendResponse(lpMemStream->GetRawBuffer() + (SIZE_T)nRangeStart,
+                                               (SIZE_T)(nRangeEnd - nRangeStart + 1ui64));
+            }
+            else
+            {
+                cStream = lpMemStream;
+            }
+        }
+        else
+        {
+            TAutoRefCounted<CFileStream> cFileStream;
+
+            hRes = GetVariantFileName(lpFile->cStrFullPathW, nVariant, cStrFileNameW);
+            if (SUCCEEDED(hRes))
+            {
+                cFileStream.Attach(MX_DEBUG_NEW CFileStream());
+                if (cFileStream)
+                {
+                    hRes = cFileStream->Create((LPCWSTR)cStrFileNameW, GENERIC_READ,
+                                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE);
+                }
+                else
+                {
+                    hRes = E_OUTOFMEMORY;
+                }
+            }
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+            cStream = cFileStream.Get();
+        }
+
+        if (SUCCEEDED(hRes) && cStream)
+        {
+            if (bMultiRange != FALSE)
+            {
+                hRes = lpRequest->SetMimeTypeFromFileName((LPCWSTR)(lpFile->cStrFullPathW));
+                if (SUCCEEDED(hRes))
+                {
+                    hRes = lpRequest->SendStreamRange(cStream.Get(), lpRangeHeader);
+                }
+                if (SUCCEEDED(hRes))
+                {
+                    _InterlockedIncrement64(&(sStats.nPartialContent));
+                }
+            }
+            else
+            {
+                if (bPartial != FALSE)
+                {
+                    TAutoRefCounted<CRangeStream> cRangeStream;
+
+                    cRangeStream.Attach(MX_DEBUG_NEW CRangeStream());
+                    if (!cRangeStream)
+                    {
+                        return E_OUTOFMEMORY;
+                    }
+                    hRes = cRangeStream->Create(cStream.Get(), nRangeStart, nRangeEnd - nRangeStart + 1ui64);
+                    if (FAILED(hRes))
+                    {
+                        return hRes;
+                    }
+                    cStream = cRangeStream.Get();
+                }
+                hRes = lpRequest->SendStream(cStream.Get());
+            }
+        }
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SetMimeTypeFromFileName((LPCWSTR)(lpFile->cStrFullPathW));
+    }
+
+    // done
+    return hRes;
+}
+
+HRESULT CHttpStaticFileCache::GetFileInfo(_In_z_ LPCWSTR szFileNameW, _Out_ LPFILE_INFO lpInfo)
+{
+    WIN32_FILE_ATTRIBUTE_DATA sAttrData;
+
+    if (::GetFileAttributesExW(szFileNameW, GetFileExInfoStandard, &sAttrData) == FALSE)
+    {
+        return MX_HRESULT_FROM_LASTERROR();
+    }
+    if ((sAttrData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+    {
+        return MX_E_NotFound;
+    }
+    lpInfo->nSize = ((ULONGLONG)(sAttrData.nFileSizeHigh) << 32) | (ULONGLONG)(sAttrData.nFileSizeLow);
+    lpInfo->ftLastWrite = sAttrData.ftLastWriteTime;
+    return S_OK;
+}
+
+HRESULT CHttpStaticFileCache::GetVariantFileName(_In_ CStringW &cStrFullPathW, _In_ eVariant nVariant,
+                                                 _Inout_ CStringW &cStrFileNameW)
+{
+    if (cStrFileNameW.CopyN((LPCWSTR)cStrFullPathW, cStrFullPathW.GetLength()) == FALSE ||
+        cStrFileNameW.Concat(aVariantSuffixesW[nVariant]) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+static BOOL AcceptsEncoding(_In_opt_ MX::CHttpHeaderReqAcceptEncoding *lpHeader, _In_z_ LPCSTR szEncodingA)
+{
+    MX::CHttpHeaderReqAcceptEncoding::CEncoding *lpEncoding;
+
+    if (lpHeader == NULL)
+    {
+        return FALSE;
+    }
+    lpEncoding = lpHeader->GetEncoding(szEncodingA);
+    if (lpEncoding == NULL)
+    {
+        lpEncoding = lpHeader->GetEncoding("*");
+    }
+    return (lpEncoding != NULL && lpEncoding->GetQ() > 0.0) ? TRUE : FALSE;
+}
+
+static VOID FormatETag(_Out_writes_(17) LPSTR szDestA, _In_ Fnv64_t nHash)
+{
+    static const CHAR szHexaNumA[] = "0123456789abcdef";
+    int i;
+
+    for (i = 15; i >= 0; i--)
+    {
+        szDestA[i] = szHexaNumA[(SIZE_T)(nHash & 15)];
+        nHash >>= 4;
+    }
+    szDestA[16] = 0;
+    return;
+}
+
+static ULONGLONG FileTimeToSeconds(_In_ const FILETIME &ft)
+{
+    return (((ULONGLONG)(ft.dwHighDateTime) << 32) | (ULONGLONG)(ft.dwLowDateTime)) / 10000000ui64;
+}
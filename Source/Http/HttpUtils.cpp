@@ -19,6 +19,9 @@
  */
 #include "..\..\Include\Http\HttpUtils.h"
 #include "..\..\Include\Strings\Utf8.h"
+#include "..\..\Include\WaitableObjects.h"
+#include "..\..\Include\Crc32.h"
+#include "PerfectHash.h"
 #include <stdlib.h>
 
  //-----------------------------------------------------------
@@ -59,11 +62,63 @@ static struct
 
 static const LPCSTR szDefaultMimeTypeA = "application/octet-stream";
 
+typedef struct
+{
+    LPCSTR szExtensionA;
+    LPCSTR szMimeTypeA;
+} MIMETYPE_DEF;
+
+// NOTE: Generated at build time from HttpMimeFromExtension.phf.
+#include <HttpMimeFromExtension.phf.h>
+
+// NOTE: Sorted by priority. A lower index wins when several patterns are present in the same User-Agent.
+#define UA_PATTERN_MSIE       0
+#define UA_PATTERN_OPERA      1
+#define UA_PATTERN_CHROME     2
+#define UA_PATTERN_SAFARI     3
+#define UA_PATTERN_MACOSX     4
+#define UA_PATTERN_KONQUEROR  5
+#define UA_PATTERN_GECKO      6
+#define UA_PATTERN_NONE       7
+
+static const struct
+{
+    LPCSTR szPatternA;
+    SIZE_T nPatternLen;
+    MX::Http::eBrowser nBrowser;
+} aUserAgentPatterns[UA_PATTERN_NONE] = {
+    { "MSIE ",     5, MX::Http::eBrowser::IE },
+    { "Opera ",    6, MX::Http::eBrowser::Opera },
+    { "Chrome/",   7, MX::Http::eBrowser::Chrome },
+    { "Safari/",   7, MX::Http::eBrowser::Safari },
+    { "Mac OS X",  8, MX::Http::eBrowser::Safari },
+    { "Konqueror", 9, MX::Http::eBrowser::Konqueror },
+    { "Gecko/",    6, MX::Http::eBrowser::Gecko }
+};
+
+// NOTE: Real traffic repeats a few hundred distinct User-Agents so their classification is kept in a small
+//       direct-mapped table. Each slot has its own slim lock and a copy of the string so a hit is exact.
+#define UA_CACHE_SLOTS_COUNT 256 // must be a power of two
+#define UA_CACHE_MIN_LENGTH 24
+#define UA_CACHE_MAX_LENGTH 256
+
+typedef struct tagUA_CACHE_SLOT
+{
+    MX::RWLOCK sRwMutex;
+    ULONG nHash;
+    ULONG nLength;
+    MX::Http::eBrowser nBrowser;
+    CHAR szUserAgentA[UA_CACHE_MAX_LENGTH];
+} UA_CACHE_SLOT;
+
+static UA_CACHE_SLOT aUserAgentCache[UA_CACHE_SLOTS_COUNT] = {};
+
 //-----------------------------------------------------------
 
 static LPCSTR GetMimeTypeFromExtensionA(_In_z_ LPCSTR szExtA);
 static LPCSTR GetMimeTypeFromExtensionW(_In_z_ LPCWSTR szExtW);
 static CHAR UTF16_to_ISO_8859_1(_In_ WCHAR chW);
+static MX::Http::eBrowser ClassifyUserAgent(_In_ LPCSTR szUserAgentA, _In_ SIZE_T nUserAgentLen);
 
 //-----------------------------------------------------------
 
@@ -73,7 +128,9 @@ namespace Http {
 
 eBrowser GetBrowserFromUserAgent(_In_ LPCSTR szUserAgentA, _In_opt_ SIZE_T nUserAgentLen)
 {
-    LPCSTR sA;
+    UA_CACHE_SLOT *lpSlot;
+    eBrowser nBrowser;
+    ULONG nHash;
 
     if (nUserAgentLen == (SIZE_T)-1)
     {
@@ -84,66 +141,38 @@ eBrowser GetBrowserFromUserAgent(_In_ LPCSTR szUserAgentA, _In_opt_ SIZE_T nUser
         return eBrowser::Other;
     }
 
-    sA = StrNFindA(szUserAgentA, "MSIE ", nUserAgentLen);
-    if (sA != NULL)
-    {
-        SIZE_T nOffset = (SIZE_T)(sA - szUserAgentA);
-
-        if (nOffset + 6 < nUserAgentLen && sA[6] == '.')
-        {
-            switch (sA[5])
-            {
-                case '4':
-                case '5':
-                    return eBrowser::IE6;
-
-                case '6':
-                    if (nOffset + 8 < nUserAgentLen && StrNCompareA(sA + 8, "SV1", nUserAgentLen - (nOffset + 8)) != NULL)
-                    {
-                        return eBrowser::IE6;
-                    }
-                    break;
-            }
-        }
-        return eBrowser::IE;
-    }
-
-    sA = StrNFindA(szUserAgentA, "Opera ", nUserAgentLen);
-    if (sA != NULL)
+    // short strings are cheaper to classify than to look up
+    if (nUserAgentLen < UA_CACHE_MIN_LENGTH || nUserAgentLen > UA_CACHE_MAX_LENGTH)
     {
-        return eBrowser::Opera;
+        return ClassifyUserAgent(szUserAgentA, nUserAgentLen);
     }
 
-    sA = StrNFindA(szUserAgentA, "Chrome/", nUserAgentLen);
-    if (sA != NULL)
+    nHash = Crc32C(0, szUserAgentA, nUserAgentLen);
+    lpSlot = &aUserAgentCache[nHash & (UA_CACHE_SLOTS_COUNT - 1)];
     {
-        return eBrowser::Chrome;
-    }
+        CAutoSlimRWLShared cLock(&(lpSlot->sRwMutex));
 
-    sA = StrNFindA(szUserAgentA, "Safari/", nUserAgentLen);
-    if (sA != NULL)
-    {
-        return eBrowser::Safari;
-    }
-    sA = StrNFindA(szUserAgentA, "Mac OS X", nUserAgentLen);
-    if (sA != NULL)
-    {
-        return eBrowser::Safari;
+        if (lpSlot->nHash == nHash && (SIZE_T)(lpSlot->nLength) == nUserAgentLen &&
+            ::MxMemCompare(lpSlot->szUserAgentA, szUserAgentA, nUserAgentLen) == 0)
+        {
+            return lpSlot->nBrowser;
+        }
     }
 
-    sA = StrNFindA(szUserAgentA, "Konqueror", nUserAgentLen);
-    if (sA != NULL)
-    {
-        return eBrowser::Konqueror;
-    }
+    nBrowser = ClassifyUserAgent(szUserAgentA, nUserAgentLen);
 
-    sA = StrNFindA(szUserAgentA, "Gecko/", nUserAgentLen);
-    if (sA != NULL)
+    // NOTE: Do not wait for the slot if another thread is using it. The next request will fill it.
+    if (SlimRWL_TryAcquireExclusive(&(lpSlot->sRwMutex)) != FALSE)
     {
-        return eBrowser::Gecko;
+        ::MxMemCopy(lpSlot->szUserAgentA, szUserAgentA, nUserAgentLen);
+        lpSlot->nHash = nHash;
+        lpSlot->nLength = (ULONG)nUserAgentLen;
+        lpSlot->nBrowser = nBrowser;
+        SlimRWL_ReleaseExclusive(&(lpSlot->sRwMutex));
     }
 
-    return eBrowser::Other;
+    // done
+    return nBrowser;
 }
 
 LPCSTR IsValidVerb(_In_ LPCSTR szStrA, _In_ SIZE_T nStrLen)
@@ -596,35 +625,15 @@ HRESULT ParseDate(_Out_ CDateTime &cDt, _In_z_ LPCWSTR szDateTimeW, _In_opt_ SIZ
 
 static LPCSTR GetMimeTypeFromExtensionA(_In_z_ LPCSTR szExtA)
 {
-#include "HttpMimeFromExtension.h"
-    CHAR szExtLcA[8];
-    SIZE_T i;
+    SIZE_T nLen, nSlot;
 
-    for (i = 0; i < MX_ARRAYLEN(szExtLcA) && szExtA[i] != 0; i++)
-    {
-        szExtLcA[i] = MX::CharToLowerA(szExtA[i]);
-    }
-    if (i > 0 && i < MX_ARRAYLEN(szExtLcA) && szExtA[i] == 0)
+    nLen = MX::StrLenA(szExtA);
+    if (nLen > 0)
     {
-        SIZE_T nBase = 0;
-        SIZE_T n = MX_ARRAYLEN(aMimeTypes);
-
-        szExtLcA[i] = 0;
-        while (n > 0)
+        nSlot = MX::PerfectHash::Lookup<CHAR>(aMimeTypesDisplacements, MIMETYPES_COUNT, szExtA, nLen, TRUE);
+        if (MX::StrCompareA(aMimeTypes[nSlot].szExtensionA, szExtA, TRUE) == 0)
         {
-            SIZE_T nMid = nBase + (n >> 1);
-
-            int comp = MX::StrCompareA(szExtA, aMimeTypes[nMid].szExtensionA);
-            if (comp == 0)
-            {
-                return aMimeTypes[nMid].szMimeTypeA;
-            }
-            if (comp > 0)
-            {
-                nBase = nMid + 1;
-                n--;
-            }
-            n >>= 1;
+            return aMimeTypes[nSlot].szMimeTypeA;
         }
     }
     return szDefaultMimeTypeA;
@@ -632,23 +641,18 @@ static LPCSTR GetMimeTypeFromExtensionA(_In_z_ LPCSTR szExtA)
 
 static LPCSTR GetMimeTypeFromExtensionW(_In_z_ LPCWSTR szExtW)
 {
-    CHAR szExtA[8];
-    SIZE_T i;
+    SIZE_T nLen, nSlot;
 
-    for (i = 0; i < MX_ARRAYLEN(szExtA) && szExtW[i] != 0; i++)
+    nLen = MX::StrLenW(szExtW);
+    if (nLen > 0)
     {
-        if (szExtW[i] > 127)
+        nSlot = MX::PerfectHash::Lookup<WCHAR>(aMimeTypesDisplacements, MIMETYPES_COUNT, szExtW, nLen, TRUE);
+        if (MX::StrCompareAW(aMimeTypes[nSlot].szExtensionA, szExtW, TRUE) == 0)
         {
-            break;
+            return aMimeTypes[nSlot].szMimeTypeA;
         }
-        szExtA[i] = (CHAR)(UCHAR)szExtW[i];
-    }
-    if (i >= MX_ARRAYLEN(szExtA) || szExtW[i] != 0)
-    {
-        return szDefaultMimeTypeA;
     }
-    szExtA[i] = 0;
-    return GetMimeTypeFromExtensionA(szExtA);
+    return szDefaultMimeTypeA;
 }
 
 static CHAR UTF16_to_ISO_8859_1(_In_ WCHAR chW)
@@ -783,3 +787,81 @@ static CHAR UTF16_to_ISO_8859_1(_In_ WCHAR chW)
     }
     return '?';
 }
+
+static MX::Http::eBrowser ClassifyUserAgent(_In_ LPCSTR szUserAgentA, _In_ SIZE_T nUserAgentLen)
+{
+    LPCSTR sA, szUserAgentEndA, szMsieA;
+    SIZE_T nBest, nCandidates, nPattern, nLeft;
+
+    // single pass over the string. The first character selects which patterns can start at each position.
+    szUserAgentEndA = szUserAgentA + nUserAgentLen;
+    szMsieA = NULL;
+    nBest = UA_PATTERN_NONE;
+    for (sA = szUserAgentA; sA < szUserAgentEndA && nBest > UA_PATTERN_MSIE; sA++)
+    {
+        switch (*sA)
+        {
+            case 'M':
+                nCandidates = (1 << UA_PATTERN_MSIE) | (1 << UA_PATTERN_MACOSX);
+                break;
+            case 'O':
+                nCandidates = 1 << UA_PATTERN_OPERA;
+                break;
+            case 'C':
+                nCandidates = 1 << UA_PATTERN_CHROME;
+                break;
+            case 'S':
+                nCandidates = 1 << UA_PATTERN_SAFARI;
+                break;
+            case 'K':
+                nCandidates = 1 << UA_PATTERN_KONQUEROR;
+                break;
+            case 'G':
+                nCandidates = 1 << UA_PATTERN_GECKO;
+                break;
+            default:
+                continue;
+        }
+
+        // only patterns with a higher priority than the best match so far are worth checking
+        nCandidates &= ((SIZE_T)1 << nBest) - 1;
+        nLeft = (SIZE_T)(szUserAgentEndA - sA);
+        for (nPattern = 0; nCandidates != 0; nPattern++, nCandidates >>= 1)
+        {
+            if ((nCandidates & 1) != 0 && nLeft >= aUserAgentPatterns[nPattern].nPatternLen &&
+                ::MxMemCompare(sA, aUserAgentPatterns[nPattern].szPatternA, aUserAgentPatterns[nPattern].nPatternLen) == 0)
+            {
+                nBest = nPattern;
+                if (nPattern == UA_PATTERN_MSIE)
+                {
+                    szMsieA = sA;
+                }
+                break;
+            }
+        }
+    }
+
+    if (nBest == UA_PATTERN_MSIE)
+    {
+        SIZE_T nOffset = (SIZE_T)(szMsieA - szUserAgentA);
+
+        if (nOffset + 6 < nUserAgentLen && szMsieA[6] == '.')
+        {
+            switch (szMsieA[5])
+            {
+                case '4':
+                case '5':
+                    return MX::Http::eBrowser::IE6;
+
+                case '6':
+                    if (nOffset + 8 < nUserAgentLen &&
+                        MX::StrNCompareA(szMsieA + 8, "SV1", nUserAgentLen - (nOffset + 8)) != NULL)
+                    {
+                        return MX::Http::eBrowser::IE6;
+                    }
+                    break;
+            }
+        }
+    }
+    return (nBest != UA_PATTERN_NONE) ? aUserAgentPatterns[nBest].nBrowser : MX::Http::eBrowser::Other;
+}
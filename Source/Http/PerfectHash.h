@@ -0,0 +1,78 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MX_HTTP_PERFECTHASH_H
+#define _MX_HTTP_PERFECTHASH_H
+
+#include "..\..\Include\Defines.h"
+
+ //-----------------------------------------------------------
+
+namespace MX {
+
+namespace PerfectHash {
+
+// NOTE: Must match hash_key in Utilities\PerfectHash\PerfectHash.py. Keys are ASCII so, when ignoring case,
+//       only 'A'-'Z' are folded. Wide characters above 0xFF never match a key and the final compare rejects them.
+template<typename TChar>
+static __forceinline ULONG Hash(_In_ ULONG nSeed, _In_reads_(nKeyLen) const TChar *szKey, _In_ SIZE_T nKeyLen,
+                                _In_ BOOL bIgnoreCase)
+{
+    ULONG nHash = 0x811C9DC5 ^ nSeed;
+
+    while (nKeyLen > 0)
+    {
+        ULONG c = (ULONG)(*szKey);
+
+        if (bIgnoreCase != FALSE && c >= (ULONG)'A' && c <= (ULONG)'Z')
+        {
+            c += 0x20;
+        }
+        nHash = (nHash ^ c) * 0x01000193;
+        szKey++;
+        nKeyLen--;
+    }
+    nHash ^= nHash >> 16;
+    nHash *= 0x7FEB352D;
+    nHash ^= nHash >> 15;
+    return nHash;
+}
+
+// Returns the only slot where the key can be. Callers must still compare the key stored there.
+template<typename TChar>
+static __forceinline SIZE_T Lookup(_In_reads_(nCount) const LONG *lpnDisplacements, _In_ SIZE_T nCount,
+                                   _In_reads_(nKeyLen) const TChar *szKey, _In_ SIZE_T nKeyLen, _In_ BOOL bIgnoreCase)
+{
+    LONG nDisp;
+
+    nDisp = lpnDisplacements[(SIZE_T)Hash<TChar>(0, szKey, nKeyLen, bIgnoreCase) % nCount];
+    if (nDisp < 0)
+    {
+        return (SIZE_T)(-nDisp - 1);
+    }
+    return (SIZE_T)Hash<TChar>((ULONG)nDisp, szKey, nKeyLen, bIgnoreCase) % nCount;
+}
+
+} // namespace PerfectHash
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+#endif //_MX_HTTP_PERFECTHASH_H
@@ -24,6 +24,8 @@
 #include "..\..\Include\AutoPtr.h"
 #include "..\..\Include\Strings\Utf8.h"
 #include <wchar.h>
+#include <intrin.h>
+#include <emmintrin.h>
 
  // #define ENABLE_FILE_SCHEME_AUTODETECTION
 
@@ -139,6 +141,11 @@ static __inline BOOL IsUnreservedChar(_In_ WCHAR chW)
     return (chW < 0x80) ? IsUnreservedChar((CHAR)(UCHAR)chW) : FALSE;
 }
 
+static SIZE_T ScanDecodePlainRun(_In_ LPCSTR szStrA, _In_ SIZE_T nLen);
+static SIZE_T ScanEncodePlainRun(_In_ LPCSTR szStrA, _In_ SIZE_T nLen, _In_opt_z_ LPCSTR szAllowedCharsA);
+static int DecodeEscapedChar(_Out_writes_(4) LPSTR szDestA, _In_ LPCSTR szStrA, _In_ SIZE_T nLen,
+                             _Out_ SIZE_T *lpnConsumed);
+
 //-----------------------------------------------------------
 
 namespace MX {
@@ -2299,7 +2306,7 @@ HRESULT CUrl::Encode(_Inout_ CStringA &cStrDestA, _In_z_ LPCSTR szUrlA, _In_opt_
                      _In_opt_ BOOL bAppend)
 {
     CHAR chA[3];
-    LPCSTR szStartA;
+    SIZE_T nRun;
 
     if (bAppend == FALSE)
     {
@@ -2313,21 +2320,32 @@ HRESULT CUrl::Encode(_Inout_ CStringA &cStrDestA, _In_z_ LPCSTR szUrlA, _In_opt_
     {
         return E_POINTER;
     }
+    if (nUrlLen == 0)
+    {
+        return S_OK;
+    }
+
+    // NOTE: Reserve the worst case up front so the loop below never reallocates.
+    if (nUrlLen > ((SIZE_T)-1 - cStrDestA.GetLength() - 1) / 3)
+    {
+        return E_OUTOFMEMORY;
+    }
+    if (cStrDestA.EnsureBuffer(cStrDestA.GetLength() + 3 * nUrlLen + 1) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
     while (nUrlLen > 0)
     {
-        szStartA = szUrlA;
-        while (nUrlLen > 0 && (IsUnreservedChar(*szUrlA) != FALSE ||
-                               (szAllowedCharsA != NULL && StrChrA(szAllowedCharsA, *szUrlA) != NULL)))
-        {
-            szUrlA++;
-            nUrlLen--;
-        }
-        if (szUrlA > szStartA)
+        nRun = ScanEncodePlainRun(szUrlA, nUrlLen, szAllowedCharsA);
+        if (nRun > 0)
         {
-            if (cStrDestA.ConcatN(szStartA, (SIZE_T)(szUrlA - szStartA)) == FALSE)
+            if (cStrDestA.ConcatN(szUrlA, nRun) == FALSE)
             {
                 return E_OUTOFMEMORY;
             }
+            szUrlA += nRun;
+            nUrlLen -= nRun;
         }
         if (nUrlLen > 0)
         {
@@ -2349,7 +2367,7 @@ HRESULT CUrl::Encode(_Inout_ CStringA &cStrDestA, _In_z_ LPCSTR szUrlA, _In_opt_
 
 SIZE_T CUrl::GetEncodedLength(_In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen, _In_opt_z_ LPCSTR szAllowedCharsA)
 {
-    SIZE_T nCount;
+    SIZE_T nCount, nRun;
 
     nCount = 0;
     if (nUrlLen == (SIZE_T)-1)
@@ -2362,13 +2380,10 @@ SIZE_T CUrl::GetEncodedLength(_In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen, _In
     }
     while (nUrlLen > 0)
     {
-        while (nUrlLen > 0 && (IsUnreservedChar(*szUrlA) != FALSE ||
-                               (szAllowedCharsA != NULL && StrChrA(szAllowedCharsA, *szUrlA) != NULL)))
-        {
-            szUrlA++;
-            nUrlLen--;
-            nCount++;
-        }
+        nRun = ScanEncodePlainRun(szUrlA, nUrlLen, szAllowedCharsA);
+        szUrlA += nRun;
+        nUrlLen -= nRun;
+        nCount += nRun;
         if (nUrlLen > 0)
         {
             // encode char
@@ -2383,11 +2398,9 @@ SIZE_T CUrl::GetEncodedLength(_In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen, _In
 
 HRESULT CUrl::Decode(_Inout_ CStringA &cStrDestA, _In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen, _In_opt_ BOOL bAppend)
 {
-    CStringA cStrTempA;
-    CHAR chA;
-    WCHAR chW;
-    LPCSTR szStartA;
-    HRESULT hRes;
+    CHAR chA[4];
+    SIZE_T nRun, nConsumed;
+    int nWritten;
 
     if (bAppend == FALSE)
     {
@@ -2401,83 +2414,115 @@ HRESULT CUrl::Decode(_Inout_ CStringA &cStrDestA, _In_z_ LPCSTR szUrlA, _In_opt_
     {
         return 0;
     }
+    if (nUrlLen == 0)
+    {
+        return S_OK;
+    }
+
+    // NOTE: Decoded data is never longer than the source so a single reservation is enough.
+    if (nUrlLen > (SIZE_T)-1 - cStrDestA.GetLength() - 1)
+    {
+        return E_OUTOFMEMORY;
+    }
+    if (cStrDestA.EnsureBuffer(cStrDestA.GetLength() + nUrlLen + 1) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
     while (nUrlLen > 0)
     {
-        szStartA = szUrlA;
-        while (nUrlLen > 0 && *szUrlA != '%' && *szUrlA != '+' && (*szUrlA & 0x80) == 0)
+        nRun = ScanDecodePlainRun(szUrlA, nUrlLen);
+        if (nRun > 0)
         {
-            szUrlA++;
-            nUrlLen--;
-        }
-        if (szUrlA > szStartA)
-        {
-            if (cStrDestA.ConcatN(szStartA, (SIZE_T)(szUrlA - szStartA)) == FALSE)
+            if (cStrDestA.ConcatN(szUrlA, nRun) == FALSE)
             {
                 return E_OUTOFMEMORY;
             }
+            szUrlA += nRun;
+            nUrlLen -= nRun;
         }
         if (nUrlLen > 0)
         {
-            switch (*szUrlA)
+            nWritten = DecodeEscapedChar(chA, szUrlA, nUrlLen, &nConsumed);
+            if (nWritten < 0)
             {
-                case '+':
-                    if (cStrDestA.ConcatN(" ", 1) == FALSE)
-                    {
-                        return E_OUTOFMEMORY;
-                    }
-                    szUrlA++;
-                    nUrlLen--;
-                    break;
+                return MX_E_InvalidData;
+            }
+            if (cStrDestA.ConcatN(chA, (SIZE_T)nWritten) == FALSE)
+            {
+                return E_OUTOFMEMORY;
+            }
+            szUrlA += nConsumed;
+            nUrlLen -= nConsumed;
+        }
+    }
+    // done
+    return S_OK;
+}
 
-                case '%':
-                    if (nUrlLen >= 3 && (chA = DecodePct(szUrlA)) != 0)
-                    {
-                        if (cStrDestA.ConcatN(&chA, 1) == FALSE)
-                        {
-                            return E_OUTOFMEMORY;
-                        }
-                        szUrlA += 3;
-                        nUrlLen -= 3;
-                    }
-                    else if (nUrlLen >= 6 && (chW = DecodePctU(szUrlA)) != 0)
-                    {
-                        hRes = Utf8_Encode(cStrTempA, &chW, 1);
-                        if (FAILED(hRes))
-                        {
-                            return hRes;
-                        }
-                        if (cStrDestA.Concat((LPSTR)cStrTempA) == FALSE)
-                        {
-                            return E_OUTOFMEMORY;
-                        }
-                        szUrlA += 6;
-                        nUrlLen -= 6;
-                    }
-                    else
-                    {
-                        if (cStrDestA.ConcatN("%", 1) == FALSE)
-                        {
-                            return E_OUTOFMEMORY;
-                        }
-                        szUrlA++;
-                        nUrlLen--;
-                    }
-                    break;
+HRESULT CUrl::Decode(_Out_writes_to_(nDestSize, *lpnDecodedLen) LPSTR szDestA, _In_ SIZE_T nDestSize, _In_ LPCSTR szUrlA,
+                     _In_ SIZE_T nUrlLen, _Out_ SIZE_T *lpnDecodedLen)
+{
+    CHAR chA[4];
+    SIZE_T nRun, nConsumed, nWritten;
+    int k;
+
+    if (lpnDecodedLen == NULL)
+    {
+        return E_POINTER;
+    }
+    *lpnDecodedLen = 0;
+    if (nUrlLen > 0 && szUrlA == NULL)
+    {
+        return E_POINTER;
+    }
+    if (nDestSize > 0 && szDestA == NULL)
+    {
+        return E_POINTER;
+    }
 
-                default:
-                    return MX_E_InvalidData;
+    nWritten = 0;
+    while (nUrlLen > 0)
+    {
+        nRun = ScanDecodePlainRun(szUrlA, nUrlLen);
+        if (nRun > 0)
+        {
+            if (nRun > nDestSize - nWritten)
+            {
+                return E_NOT_SUFFICIENT_BUFFER;
             }
+            ::MxMemCopy(szDestA + nWritten, szUrlA, nRun);
+            nWritten += nRun;
+            szUrlA += nRun;
+            nUrlLen -= nRun;
+        }
+        if (nUrlLen > 0)
+        {
+            k = DecodeEscapedChar(chA, szUrlA, nUrlLen, &nConsumed);
+            if (k < 0)
+            {
+                return MX_E_InvalidData;
+            }
+            if ((SIZE_T)k > nDestSize - nWritten)
+            {
+                return E_NOT_SUFFICIENT_BUFFER;
+            }
+            ::MxMemCopy(szDestA + nWritten, chA, (SIZE_T)k);
+            nWritten += (SIZE_T)k;
+            szUrlA += nConsumed;
+            nUrlLen -= nConsumed;
         }
     }
     // done
+    *lpnDecodedLen = nWritten;
     return S_OK;
 }
 
 SIZE_T CUrl::GetDecodedLength(_In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen)
 {
-    CHAR chA;
-    WCHAR chW;
-    SIZE_T nCount;
+    CHAR chA[4];
+    SIZE_T nCount, nRun, nConsumed;
+    int k;
 
     nCount = 0;
     if (nUrlLen == (SIZE_T)-1)
@@ -2490,50 +2535,21 @@ SIZE_T CUrl::GetDecodedLength(_In_z_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen)
     }
     while (nUrlLen > 0)
     {
-        if ((*szUrlA & 0x80) != 0)
-        {
-            return 0;
-        }
-        if (*szUrlA == '%')
+        nRun = ScanDecodePlainRun(szUrlA, nUrlLen);
+        szUrlA += nRun;
+        nUrlLen -= nRun;
+        nCount += nRun;
+        if (nUrlLen > 0)
         {
-            if (nUrlLen >= 3)
+            k = DecodeEscapedChar(chA, szUrlA, nUrlLen, &nConsumed);
+            if (k < 0)
             {
-                chA = DecodePct(szUrlA);
-                if (chA != 0)
-                {
-                    szUrlA += 3;
-                    nUrlLen -= 3;
-                    nCount++;
-                    continue;
-                }
-            }
-            if (nUrlLen >= 6)
-            {
-                chW = DecodePctU(szUrlA);
-                if (chW != 0)
-                {
-                    szUrlA += 6;
-                    nUrlLen -= 6;
-                    if (chW < 0x80)
-                    {
-                        nCount++;
-                    }
-                    else if (chW < 0x800)
-                    {
-                        nCount += 2;
-                    }
-                    else
-                    {
-                        nCount += 3;
-                    }
-                    continue;
-                }
+                return 0;
             }
+            szUrlA += nConsumed;
+            nUrlLen -= nConsumed;
+            nCount += (SIZE_T)k;
         }
-
-        szUrlA++;
-        nUrlLen--;
-        nCount++;
     }
     // done
     return nCount;
@@ -3201,6 +3217,129 @@ static BOOL IsLocalHost(_In_z_ LPCWSTR szHostW)
     return FALSE;
 }
 
+// NOTE: Returns the length of the leading run that Decode can copy verbatim, that is, with no '%', '+' or
+//       bytes above 0x7F. Sixteen bytes are checked per step with SSE2.
+static SIZE_T ScanDecodePlainRun(_In_ LPCSTR szStrA, _In_ SIZE_T nLen)
+{
+    __m128i vPct, vPlus, vData, vMask;
+    unsigned long nBit;
+    SIZE_T i;
+    int nMask;
+
+    vPct = _mm_set1_epi8('%');
+    vPlus = _mm_set1_epi8('+');
+    for (i = 0; i + 16 <= nLen; i += 16)
+    {
+        vData = _mm_loadu_si128((const __m128i *)(szStrA + i));
+        //the data itself is or'ed in so bytes above 0x7F set their mask bit too
+        vMask = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(vData, vPct), _mm_cmpeq_epi8(vData, vPlus)), vData);
+        nMask = _mm_movemask_epi8(vMask);
+        if (nMask != 0)
+        {
+            _BitScanForward(&nBit, (unsigned long)nMask);
+            return i + (SIZE_T)nBit;
+        }
+    }
+    while (i < nLen && szStrA[i] != '%' && szStrA[i] != '+' && (szStrA[i] & 0x80) == 0)
+    {
+        i++;
+    }
+    return i;
+}
+
+// NOTE: Returns the length of the leading run that Encode can copy verbatim. Unreserved characters are
+//       classified with SSE2; the optional extra allowed characters are checked one by one when the vector
+//       scan stops on them.
+static SIZE_T ScanEncodePlainRun(_In_ LPCSTR szStrA, _In_ SIZE_T nLen, _In_opt_z_ LPCSTR szAllowedCharsA)
+{
+    __m128i vData, vLower, vSafe;
+    unsigned long nBit;
+    SIZE_T i;
+    int nMask;
+
+    i = 0;
+    while (i < nLen)
+    {
+        while (i + 16 <= nLen)
+        {
+            vData = _mm_loadu_si128((const __m128i *)(szStrA + i));
+            //signed compares leave bytes above 0x7F out of every range
+            vLower = _mm_or_si128(vData, _mm_set1_epi8(0x20));
+            vSafe = _mm_and_si128(_mm_cmpgt_epi8(vLower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(vLower, _mm_set1_epi8('z' + 1)));
+            vSafe = _mm_or_si128(vSafe, _mm_and_si128(_mm_cmpgt_epi8(vData, _mm_set1_epi8('0' - 1)),
+                                                      _mm_cmplt_epi8(vData, _mm_set1_epi8('9' + 1))));
+            vSafe = _mm_or_si128(vSafe, _mm_or_si128(_mm_cmpeq_epi8(vData, _mm_set1_epi8('-')),
+                                                     _mm_cmpeq_epi8(vData, _mm_set1_epi8('_'))));
+            vSafe = _mm_or_si128(vSafe, _mm_or_si128(_mm_cmpeq_epi8(vData, _mm_set1_epi8('.')),
+                                                     _mm_cmpeq_epi8(vData, _mm_set1_epi8('~'))));
+            nMask = _mm_movemask_epi8(vSafe) ^ 0xFFFF;
+            if (nMask != 0)
+            {
+                _BitScanForward(&nBit, (unsigned long)nMask);
+                i += (SIZE_T)nBit;
+                break;
+            }
+            i += 16;
+        }
+        while (i < nLen && IsUnreservedChar(szStrA[i]) != FALSE)
+        {
+            i++;
+        }
+        if (i >= nLen || szAllowedCharsA == NULL || MX::StrChrA(szAllowedCharsA, szStrA[i]) == NULL)
+        {
+            break;
+        }
+        i++;
+    }
+    return i;
+}
+
+// NOTE: Decodes the '+' or escape sequence at the start of szStrA into szDestA. Returns the number of bytes
+//       written (a lone '%' is kept as is) or -1 if the input is not valid.
+static int DecodeEscapedChar(_Out_writes_(4) LPSTR szDestA, _In_ LPCSTR szStrA, _In_ SIZE_T nLen,
+                             _Out_ SIZE_T *lpnConsumed)
+{
+    CHAR chA;
+    WCHAR chW;
+    int k;
+
+    switch (*szStrA)
+    {
+        case '+':
+            *szDestA = ' ';
+            *lpnConsumed = 1;
+            return 1;
+
+        case '%':
+            if (nLen >= 3 && (chA = DecodePct(szStrA)) != 0)
+            {
+                *szDestA = chA;
+                *lpnConsumed = 3;
+                return 1;
+            }
+            if (nLen >= 6 && (chW = DecodePctU(szStrA)) != 0)
+            {
+                if (chW >= 0xD800 && chW <= 0xDBFF)
+                {
+                    break; //unpaired surrogate
+                }
+                k = MX::Utf8_EncodeChar(szDestA, chW);
+                if (k < 0)
+                {
+                    break;
+                }
+                *lpnConsumed = 6;
+                return k;
+            }
+            *szDestA = '%';
+            *lpnConsumed = 1;
+            return 1;
+    }
+    *lpnConsumed = 0;
+    return -1;
+}
+
 static BOOL HasDisallowedEscapedSequences(_In_z_ LPCSTR szSrcA, _In_ SIZE_T nSrcLen)
 {
     return (MX::StrNFindA(szSrcA, "%00", nSrcLen) != NULL || MX::StrNFindA(szSrcA, "%2F", nSrcLen) != NULL ||
@@ -0,0 +1,680 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\..\Include\Http\UrlView.h"
+#include "..\..\Include\Strings\Utf8.h"
+
+#define MAX_STACK_NAME_LENGTH 256
+#define MAX_ESCAPE_LENGTH 6
+
+ //-----------------------------------------------------------
+
+typedef struct tagPATH_CHECK
+{
+    BOOL bCanBeFilename;
+    BOOL bAtStart;
+    BOOL bInFirstSegment;
+    SIZE_T nLeadingSlashes;
+    SIZE_T nSegmentLen;
+    BOOL bDotsOnly;
+    CHAR chFirstA;
+    SIZE_T nDepth;
+} PATH_CHECK, *LPPATH_CHECK;
+
+//-----------------------------------------------------------
+
+static __inline BOOL IsAlpha(_In_ CHAR chA)
+{
+    return ((chA >= 'A' && chA <= 'Z') || (chA >= 'a' && chA <= 'z')) ? TRUE : FALSE;
+}
+
+static __inline BOOL IsSlash(_In_ CHAR chA)
+{
+    return (chA == '/' || chA == '\\') ? TRUE : FALSE;
+}
+
+static __inline BOOL IsValidUrlChar(_In_ CHAR chA)
+{
+    return (chA > ' ' && chA < 0x7F) ? TRUE : FALSE;
+}
+
+static BOOL IsValidScheme(_In_ LPCSTR szSchemeA, _In_ SIZE_T nLen);
+static BOOL IsDisallowedPathEscape(_In_ LPCSTR szStrA, _In_ SIZE_T nLen);
+static VOID SetSlice(_Out_ MX::CUrlView::LPSLICE lpSlice, _In_ LPCSTR szStrA, _In_ SIZE_T nLength);
+
+static HRESULT CheckDecoded(_In_ const MX::CUrlView::SLICE &sSlice, _In_opt_ LPPATH_CHECK lpPathCheck);
+static BOOL CheckUtf8(_Inout_updates_(4) LPSTR szPendingA, _Inout_ SIZE_T *lpnPending, _In_ BOOL bFlush);
+static BOOL CheckPathChar(_Inout_ LPPATH_CHECK lpPathCheck, _In_ CHAR chA);
+static BOOL EndPathSegment(_Inout_ LPPATH_CHECK lpPathCheck);
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+CUrlView::CUrlView() : CBaseMemObj()
+{
+    Reset();
+    return;
+}
+
+VOID CUrlView::Reset()
+{
+    SetSlice(&sUrl, "", 0);
+    SetSlice(&sScheme, "", 0);
+    SetSlice(&sUserInfo, "", 0);
+    SetSlice(&sHost, "", 0);
+    SetSlice(&sPath, "", 0);
+    SetSlice(&sQuery, "", 0);
+    SetSlice(&sFragment, "", 0);
+    nPort = -1;
+    return;
+}
+
+HRESULT CUrlView::Parse(_In_ LPCSTR szUrlA, _In_opt_ SIZE_T nUrlLen)
+{
+    SIZE_T i, nStart, nColon;
+    BOOL bHasUserInfo;
+    LPCSTR sA;
+    CHAR chA;
+
+    Reset();
+
+    if (nUrlLen == (SIZE_T)-1)
+    {
+        nUrlLen = StrLenA(szUrlA);
+    }
+    if (nUrlLen > 0 && szUrlA == NULL)
+    {
+        return E_POINTER;
+    }
+
+    // skip 'url:' prefix
+    while (nUrlLen >= 4 && StrNCompareA(szUrlA, "URL:", 4, TRUE) == 0)
+    {
+        szUrlA += 4;
+        nUrlLen -= 4;
+    }
+    SetSlice(&sUrl, szUrlA, nUrlLen);
+
+    // is scheme specified?
+    for (i = 0; i < nUrlLen; i++)
+    {
+        chA = szUrlA[i];
+        if (chA == ':' || chA == '@' || chA == '?' || chA == '#' || IsSlash(chA) != FALSE)
+        {
+            break;
+        }
+    }
+    nStart = 0;
+    if (i < nUrlLen && szUrlA[i] == ':')
+    {
+        if (IsValidScheme(szUrlA, i) == FALSE)
+        {
+            goto err_invalid;
+        }
+        SetSlice(&sScheme, szUrlA, i);
+        nStart = i + 1;
+
+        if ((i == 6 && StrNCompareA(szUrlA, "mailto", 6, TRUE) == 0) ||
+            (i == 4 && StrNCompareA(szUrlA, "news", 4, TRUE) == 0))
+        {
+            goto parse_path;
+        }
+
+        // skip double slash if present and get the authority
+        if (nStart + 2 <= nUrlLen && IsSlash(szUrlA[nStart]) != FALSE && IsSlash(szUrlA[nStart + 1]) != FALSE)
+        {
+            nStart += 2;
+        }
+        nColon = (SIZE_T)-1;
+        bHasUserInfo = FALSE;
+        for (i = nStart; i < nUrlLen; i++)
+        {
+            chA = szUrlA[i];
+            if (chA == '?' || chA == '#' || IsSlash(chA) != FALSE)
+            {
+                break;
+            }
+            if (IsValidUrlChar(chA) == FALSE)
+            {
+                goto err_invalid;
+            }
+            if (chA == '@' && bHasUserInfo == FALSE)
+            {
+                if (i == nStart)
+                {
+                    goto err_invalid;
+                }
+                SetSlice(&sUserInfo, szUrlA + nStart, i - nStart);
+                bHasUserInfo = TRUE;
+                nColon = (SIZE_T)-1;
+                nStart = i + 1;
+            }
+            else if (chA == ':')
+            {
+                nColon = i;
+            }
+            else if (chA == ']')
+            {
+                nColon = (SIZE_T)-1; //colons inside an IPv6 literal are not a port separator
+            }
+        }
+        if (nColon != (SIZE_T)-1)
+        {
+            if (nColon == nStart || nColon + 1 == i)
+            {
+                goto err_invalid;
+            }
+            nPort = 0;
+            for (sA = szUrlA + nColon + 1; sA < szUrlA + i; sA++)
+            {
+                if (*sA < '0' || *sA > '9')
+                {
+                    goto err_invalid;
+                }
+                nPort = nPort * 10 + (int)(*sA - '0');
+                if (nPort > 65535)
+                {
+                    goto err_invalid;
+                }
+            }
+            if (nPort < 1)
+            {
+                goto err_invalid;
+            }
+            SetSlice(&sHost, szUrlA + nStart, nColon - nStart);
+        }
+        else
+        {
+            SetSlice(&sHost, szUrlA + nStart, i - nStart);
+        }
+        nStart = i;
+    }
+
+parse_path:
+    for (i = nStart; i < nUrlLen; i++)
+    {
+        chA = szUrlA[i];
+        if (chA == '?' || chA == '#')
+        {
+            break;
+        }
+        if (IsValidUrlChar(chA) == FALSE)
+        {
+            goto err_invalid;
+        }
+        if (chA == '%' && IsDisallowedPathEscape(szUrlA + i, nUrlLen - i) != FALSE)
+        {
+            goto err_invalid;
+        }
+    }
+    SetSlice(&sPath, szUrlA + nStart, i - nStart);
+
+    // are query parameters specified?
+    if (i < nUrlLen && szUrlA[i] == '?')
+    {
+        nStart = ++i;
+        while (i < nUrlLen && szUrlA[i] != '#')
+        {
+            if (IsValidUrlChar(szUrlA[i]) == FALSE)
+            {
+                goto err_invalid;
+            }
+            i++;
+        }
+        SetSlice(&sQuery, szUrlA + nStart, i - nStart);
+    }
+
+    // is fragment specified?
+    if (i < nUrlLen)
+    {
+        nStart = ++i;
+        while (i < nUrlLen)
+        {
+            if (IsValidUrlChar(szUrlA[i]) == FALSE)
+            {
+                goto err_invalid;
+            }
+            i++;
+        }
+        SetSlice(&sFragment, szUrlA + nStart, i - nStart);
+    }
+
+    // done
+    return S_OK;
+
+err_invalid:
+    Reset();
+    return MX_E_InvalidData;
+}
+
+HRESULT CUrlView::Validate() const
+{
+    PATH_CHECK sPathCheck;
+    SLICE sName, sValue;
+    SIZE_T nCursor;
+    HRESULT hRes;
+
+    if (sHost.nLength > 0 && CUrl::IsValidHostAddress(sHost.szStrA, sHost.nLength) == FALSE)
+    {
+        return MX_E_InvalidData;
+    }
+    hRes = CheckDecoded(sUserInfo, NULL);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // mail addresses and news groups are not paths so dot segments are not reduced
+    if ((sScheme.nLength == 6 && StrNCompareA(sScheme.szStrA, "mailto", 6, TRUE) == 0) ||
+        (sScheme.nLength == 4 && StrNCompareA(sScheme.szStrA, "news", 4, TRUE) == 0))
+    {
+        hRes = CheckDecoded(sPath, NULL);
+    }
+    else
+    {
+        ::MxMemSet(&sPathCheck, 0, sizeof(sPathCheck));
+        sPathCheck.bCanBeFilename = (sScheme.nLength == 0 ||
+                                     (sScheme.nLength == 4 && StrNCompareA(sScheme.szStrA, "file", 4, TRUE) == 0))
+                                    ? TRUE : FALSE;
+        sPathCheck.bAtStart = TRUE;
+        sPathCheck.bDotsOnly = TRUE;
+        hRes = CheckDecoded(sPath, &sPathCheck);
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // CUrl decodes query names and values separately and does not accept an item without a name
+    nCursor = 0;
+    while (GetNextQueryString(nCursor, &sName, &sValue) != FALSE)
+    {
+        if (sName.nLength == 0)
+        {
+            return MX_E_InvalidData;
+        }
+        hRes = CheckDecoded(sName, NULL);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = CheckDecoded(sValue, NULL);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // done
+    return CheckDecoded(sFragment, NULL);
+}
+
+BOOL CUrlView::IsEmpty() const
+{
+    return (sUrl.nLength == 0) ? TRUE : FALSE;
+}
+
+const CUrlView::SLICE &CUrlView::GetUrl() const
+{
+    return sUrl;
+}
+
+const CUrlView::SLICE &CUrlView::GetScheme() const
+{
+    return sScheme;
+}
+
+const CUrlView::SLICE &CUrlView::GetUserInfo() const
+{
+    return sUserInfo;
+}
+
+const CUrlView::SLICE &CUrlView::GetHost() const
+{
+    return sHost;
+}
+
+int CUrlView::GetPort() const
+{
+    return nPort;
+}
+
+const CUrlView::SLICE &CUrlView::GetPath() const
+{
+    return sPath;
+}
+
+const CUrlView::SLICE &CUrlView::GetQuery() const
+{
+    return sQuery;
+}
+
+const CUrlView::SLICE &CUrlView::GetFragment() const
+{
+    return sFragment;
+}
+
+BOOL CUrlView::GetNextQueryString(_Inout_ SIZE_T &nCursor, _Out_ LPSLICE lpName, _Out_ LPSLICE lpValue) const
+{
+    LPCSTR sA, szEndA, szItemA;
+
+    SetSlice(lpName, "", 0);
+    SetSlice(lpValue, "", 0);
+
+    szEndA = sQuery.szStrA + sQuery.nLength;
+    sA = sQuery.szStrA + nCursor;
+    // skip empty items
+    while (sA < szEndA && *sA == '&')
+    {
+        sA++;
+    }
+    if (sA >= szEndA)
+    {
+        nCursor = sQuery.nLength;
+        return FALSE;
+    }
+
+    szItemA = sA;
+    while (sA < szEndA && *sA != '&' && *sA != '=')
+    {
+        sA++;
+    }
+    SetSlice(lpName, szItemA, (SIZE_T)(sA - szItemA));
+    if (sA < szEndA && *sA == '=')
+    {
+        szItemA = ++sA;
+        while (sA < szEndA && *sA != '&')
+        {
+            sA++;
+        }
+        SetSlice(lpValue, szItemA, (SIZE_T)(sA - szItemA));
+    }
+    nCursor = (SIZE_T)(sA - sQuery.szStrA);
+    return TRUE;
+}
+
+BOOL CUrlView::FindQueryString(_In_z_ LPCSTR szNameA, _Out_ LPSLICE lpValue) const
+{
+    CHAR szDecodedA[MAX_STACK_NAME_LENGTH];
+    CStringA cStrTempA;
+    SLICE sName;
+    SIZE_T nCursor, nNameLen, nDecodedLen;
+    LPCSTR szDecodedNameA;
+
+    SetSlice(lpValue, "", 0);
+    if (szNameA == NULL || *szNameA == 0)
+    {
+        return FALSE;
+    }
+    nNameLen = StrLenA(szNameA);
+
+    nCursor = 0;
+    while (GetNextQueryString(nCursor, &sName, lpValue) != FALSE)
+    {
+        // an encoded name is never shorter than the decoded one and each escape is six chars at most
+        if (sName.nLength < nNameLen || sName.nLength / 6 > nNameLen)
+        {
+            continue;
+        }
+        if (sName.nLength <= MAX_STACK_NAME_LENGTH)
+        {
+            if (FAILED(CUrl::Decode(szDecodedA, sizeof(szDecodedA), sName.szStrA, sName.nLength, &nDecodedLen)))
+            {
+                continue;
+            }
+            szDecodedNameA = szDecodedA;
+        }
+        else
+        {
+            if (FAILED(CUrl::Decode(cStrTempA, sName.szStrA, sName.nLength)))
+            {
+                continue;
+            }
+            szDecodedNameA = (LPCSTR)cStrTempA;
+            nDecodedLen = cStrTempA.GetLength();
+        }
+        if (nDecodedLen == nNameLen && StrNCompareA(szDecodedNameA, szNameA, nNameLen, TRUE) == 0)
+        {
+            return TRUE;
+        }
+    }
+    SetSlice(lpValue, "", 0);
+    return FALSE;
+}
+
+HRESULT CUrlView::DecodePath(_Inout_ CStringA &cStrDestA) const
+{
+    return CUrl::Decode(cStrDestA, sPath.szStrA, sPath.nLength);
+}
+
+HRESULT CUrlView::DecodePath(_Inout_ CStringW &cStrDestW) const
+{
+    CStringA cStrTempA;
+    HRESULT hRes;
+
+    hRes = CUrl::Decode(cStrTempA, sPath.szStrA, sPath.nLength);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = Utf8_Decode(cStrDestW, (LPCSTR)cStrTempA, cStrTempA.GetLength());
+    }
+    if (FAILED(hRes))
+    {
+        cStrDestW.Empty();
+    }
+    // done
+    return hRes;
+}
+
+HRESULT CUrlView::ToUrl(_Inout_ CUrl &cUrl) const
+{
+    return cUrl.ParseFromString(sUrl.szStrA, sUrl.nLength);
+}
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+static BOOL IsValidScheme(_In_ LPCSTR szSchemeA, _In_ SIZE_T nLen)
+{
+    SIZE_T i;
+
+    if (nLen == 0 || IsAlpha(*szSchemeA) == FALSE)
+    {
+        return FALSE;
+    }
+    for (i = 1; i < nLen; i++)
+    {
+        if (IsAlpha(szSchemeA[i]) == FALSE && (szSchemeA[i] < '0' || szSchemeA[i] > '9') &&
+            szSchemeA[i] != '+' && szSchemeA[i] != '-' && szSchemeA[i] != '.')
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static BOOL IsDisallowedPathEscape(_In_ LPCSTR szStrA, _In_ SIZE_T nLen)
+{
+    // same sequences rejected by CUrl::SetPath: %00, %2F, %5C, %u0000, %u002F and %u005C
+    if (nLen >= 3 && (MX::StrNCompareA(szStrA, "%00", 3) == 0 || MX::StrNCompareA(szStrA, "%2F", 3) == 0 ||
+                      MX::StrNCompareA(szStrA, "%5C", 3) == 0))
+    {
+        return TRUE;
+    }
+    if (nLen >= 6 && (MX::StrNCompareA(szStrA, "%u0000", 6) == 0 || MX::StrNCompareA(szStrA, "%u002F", 6) == 0 ||
+                      MX::StrNCompareA(szStrA, "%u005C", 6) == 0))
+    {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static VOID SetSlice(_Out_ MX::CUrlView::LPSLICE lpSlice, _In_ LPCSTR szStrA, _In_ SIZE_T nLength)
+{
+    lpSlice->szStrA = szStrA;
+    lpSlice->nLength = nLength;
+    return;
+}
+
+static HRESULT CheckDecoded(_In_ const MX::CUrlView::SLICE &sSlice, _In_opt_ LPPATH_CHECK lpPathCheck)
+{
+    CHAR szDecodedA[MAX_STACK_NAME_LENGTH], szPendingA[4];
+    LPCSTR szStrA;
+    SIZE_T i, nLen, nChunkLen, nDecodedLen, nPending;
+    HRESULT hRes;
+
+    szStrA = sSlice.szStrA;
+    nLen = sSlice.nLength;
+    nPending = 0;
+    while (nLen > 0)
+    {
+        // NOTE: Decoded data is never longer than the source. Chunks do not end inside an escape sequence so
+        //       each one decodes exactly as it does within the whole string.
+        nChunkLen = nLen;
+        if (nChunkLen > sizeof(szDecodedA))
+        {
+            nChunkLen = sizeof(szDecodedA);
+            for (i = nChunkLen - (MAX_ESCAPE_LENGTH - 1); i < nChunkLen; i++)
+            {
+                if (szStrA[i] == '%')
+                {
+                    nChunkLen = i;
+                    break;
+                }
+            }
+        }
+        hRes = MX::CUrl::Decode(szDecodedA, sizeof(szDecodedA), szStrA, nChunkLen, &nDecodedLen);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        for (i = 0; i < nDecodedLen; i++)
+        {
+            szPendingA[nPending++] = szDecodedA[i];
+            if (nPending == 4 && CheckUtf8(szPendingA, &nPending, FALSE) == FALSE)
+            {
+                return MX_E_InvalidData;
+            }
+            if (lpPathCheck != NULL && CheckPathChar(lpPathCheck, szDecodedA[i]) == FALSE)
+            {
+                return MX_E_InvalidData;
+            }
+        }
+        szStrA += nChunkLen;
+        nLen -= nChunkLen;
+    }
+    if (CheckUtf8(szPendingA, &nPending, TRUE) == FALSE)
+    {
+        return MX_E_InvalidData;
+    }
+    if (lpPathCheck != NULL && EndPathSegment(lpPathCheck) == FALSE)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // done
+    return S_OK;
+}
+
+static BOOL CheckUtf8(_Inout_updates_(4) LPSTR szPendingA, _Inout_ SIZE_T *lpnPending, _In_ BOOL bFlush)
+{
+    int nCharLen;
+
+    // NOTE: Utf8_DecodeChar looks at four bytes at most so, until the end, it gets the same input as Utf8_Decode
+    //       does with the whole decoded string.
+    while (*lpnPending > 0 && (*lpnPending == 4 || bFlush != FALSE))
+    {
+        nCharLen = MX::Utf8_DecodeChar(NULL, szPendingA, *lpnPending);
+        if (nCharLen <= 0)
+        {
+            return FALSE;
+        }
+        *lpnPending -= (SIZE_T)nCharLen;
+        ::MxMemMove(szPendingA, szPendingA + nCharLen, *lpnPending);
+    }
+    return TRUE;
+}
+
+static BOOL CheckPathChar(_Inout_ LPPATH_CHECK lpPathCheck, _In_ CHAR chA)
+{
+    if (IsSlash(chA) != FALSE)
+    {
+        if (lpPathCheck->bAtStart != FALSE)
+        {
+            lpPathCheck->nLeadingSlashes++;
+            return TRUE;
+        }
+        return EndPathSegment(lpPathCheck);
+    }
+
+    if (lpPathCheck->bAtStart != FALSE)
+    {
+        lpPathCheck->bAtStart = FALSE;
+        lpPathCheck->bInFirstSegment = TRUE;
+    }
+    if (lpPathCheck->nSegmentLen == 0)
+    {
+        lpPathCheck->chFirstA = chA;
+    }
+    lpPathCheck->nSegmentLen++;
+    if (chA != '.')
+    {
+        lpPathCheck->bDotsOnly = FALSE;
+    }
+
+    // like CUrl, a drive letter is the root of a file path
+    if (lpPathCheck->bCanBeFilename != FALSE && lpPathCheck->bInFirstSegment != FALSE &&
+        lpPathCheck->nSegmentLen == 2 && IsAlpha(lpPathCheck->chFirstA) != FALSE && (chA == ':' || chA == '|'))
+    {
+        lpPathCheck->bInFirstSegment = FALSE;
+        lpPathCheck->nSegmentLen = 0;
+        lpPathCheck->bDotsOnly = TRUE;
+    }
+    return TRUE;
+}
+
+static BOOL EndPathSegment(_Inout_ LPPATH_CHECK lpPathCheck)
+{
+    BOOL bIsServerName;
+
+    bIsServerName = (lpPathCheck->bCanBeFilename != FALSE && lpPathCheck->bInFirstSegment != FALSE &&
+                     lpPathCheck->nLeadingSlashes >= 2) ? TRUE : FALSE;
+    lpPathCheck->bInFirstSegment = FALSE;
+
+    // empty and "." segments are removed, ".." removes the previous one and the server name of an UNC path is kept
+    if (lpPathCheck->nSegmentLen > 0 && bIsServerName == FALSE &&
+        (lpPathCheck->bDotsOnly == FALSE || lpPathCheck->nSegmentLen > 1))
+    {
+        if (lpPathCheck->bDotsOnly != FALSE && lpPathCheck->nSegmentLen == 2)
+        {
+            if (lpPathCheck->nDepth == 0)
+            {
+                return FALSE;
+            }
+            lpPathCheck->nDepth--;
+        }
+        else
+        {
+            lpPathCheck->nDepth++;
+        }
+    }
+    lpPathCheck->nSegmentLen = 0;
+    lpPathCheck->bDotsOnly = TRUE;
+    return TRUE;
+}
@@ -116,6 +116,10 @@ HRESULT CJsHttpServer::CJvmManager::AllocAndInitVM(_Out_ CJvm **lplpJVM, _Out_ B
         // helper functions
         hRes = Internals::JsHttpServer::AddHelpersMethods(*cJVM.Get());
         __EXIT_ON_ERROR(hRes);
+
+        // native json
+        hRes = cJVM->AddNativeJsonSupport();
+        __EXIT_ON_ERROR(hRes);
     }
     else
     {
@@ -262,15 +266,14 @@ HRESULT CJsHttpServer::CJvmManager::AllocAndInitVM(_Out_ CJvm **lplpJVM, _Out_ B
     __EXIT_ON_ERROR(hRes);
     for (i = 0;; i++)
     {
-        TAutoRefCounted<CHttpCookie> cCookie;
+        LPCSTR szNameA = lpRequest->GetRequestCookieName(i);
 
-        cCookie.Attach(lpRequest->GetRequestCookie(i));
-        if (!cCookie)
+        if (szNameA == NULL)
         {
             break;
         }
 
-        if (cStrTempA.Copy(cCookie->GetName()) == FALSE)
+        if (cStrTempA.Copy(szNameA) == FALSE)
         {
             return E_OUTOFMEMORY;
         }
@@ -285,7 +288,7 @@ HRESULT CJsHttpServer::CJvmManager::AllocAndInitVM(_Out_ CJvm **lplpJVM, _Out_ B
         if (hRes == S_FALSE)
         {
             // don't add duplicates
-            hRes = cJVM->AddObjectStringProperty("request.cookies", (LPCSTR)cStrTempA, cCookie->GetValue(),
+            hRes = cJVM->AddObjectStringProperty("request.cookies", (LPCSTR)cStrTempA, lpRequest->GetRequestCookieValue(i),
                                                  CJavascriptVM::ePropertyFlags::Enumerable |
                                                      CJavascriptVM::ePropertyFlags::Configurable);
         }
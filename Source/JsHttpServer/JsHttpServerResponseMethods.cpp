@@ -21,8 +21,14 @@
 
  //-----------------------------------------------------------
 
+// NOTE: response.write() waits for the client once this amount of data is queued in the connection.
+#define MAX_STREAMED_RESPONSE_PENDING_BYTES (256 * 1024)
+
+//-----------------------------------------------------------
+
 static DukTape::duk_ret_t OnResetOutput(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
 static DukTape::duk_ret_t OnEcho(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
+static DukTape::duk_ret_t OnEchoJson(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
 static DukTape::duk_ret_t OnSetStatus(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
 static DukTape::duk_ret_t OnSetCookie(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
 static DukTape::duk_ret_t OnSetHeader(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
@@ -30,6 +36,10 @@ static DukTape::duk_ret_t OnRemoveHeader(_In_ DukTape::duk_context *lpCtx, _In_z
 static DukTape::duk_ret_t OnObStart(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
 static DukTape::duk_ret_t OnObEnd(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
 static DukTape::duk_ret_t OnObGetContents(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
+static DukTape::duk_ret_t OnResponseWrite(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
+static DukTape::duk_ret_t OnResponseFlush(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA);
+
+static HRESULT OnEchoJsonOutput(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam);
 
 //-----------------------------------------------------------
 
@@ -45,6 +55,8 @@ HRESULT AddResponseMethods(_In_ CJavascriptVM &cJvm)
 
     hRes = cJvm.AddNativeFunction("echo", MX_BIND_CALLBACK(&OnEcho), 1);
     __EXIT_ON_ERROR(hRes);
+    hRes = cJvm.AddNativeFunction("echoJson", MX_BIND_CALLBACK(&OnEchoJson), MX_JS_VARARGS);
+    __EXIT_ON_ERROR(hRes);
     hRes = cJvm.AddNativeFunction("setStatus", MX_BIND_CALLBACK(&OnSetStatus), MX_JS_VARARGS);
     __EXIT_ON_ERROR(hRes);
     hRes = cJvm.AddNativeFunction("setCookie", MX_BIND_CALLBACK(&OnSetCookie), MX_JS_VARARGS);
@@ -61,6 +73,12 @@ HRESULT AddResponseMethods(_In_ CJavascriptVM &cJvm)
     __EXIT_ON_ERROR(hRes);
     hRes = cJvm.AddNativeFunction("obGetContents", MX_BIND_CALLBACK(&OnObGetContents), 0);
     __EXIT_ON_ERROR(hRes);
+    hRes = cJvm.CreateObject("response");
+    __EXIT_ON_ERROR(hRes);
+    hRes = cJvm.AddObjectNativeFunction("response", "write", MX_BIND_CALLBACK(&OnResponseWrite), 1);
+    __EXIT_ON_ERROR(hRes);
+    hRes = cJvm.AddObjectNativeFunction("response", "flush", MX_BIND_CALLBACK(&OnResponseFlush), 0);
+    __EXIT_ON_ERROR(hRes);
     // done
     return S_OK;
 }
@@ -110,6 +128,51 @@ static DukTape::duk_ret_t OnEcho(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR
     return 0;
 }
 
+static DukTape::duk_ret_t OnEchoJson(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA)
+{
+    MX::CJsHttpServer::CClientRequest *lpRequest = MX::CJsHttpServer::GetServerRequestFromContext(lpCtx);
+    DukTape::duk_idx_t nParamsCount;
+    CHAR szIndentA[16];
+
+    // get parameters
+    nParamsCount = DukTape::duk_get_top(lpCtx);
+    if (nParamsCount < 1 || nParamsCount > 2)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG);
+    }
+    szIndentA[0] = 0;
+    if (nParamsCount > 1)
+    {
+        if (DukTape::duk_is_number(lpCtx, 1) != 0)
+        {
+            DukTape::duk_int_t i, nSpaces;
+
+            nSpaces = DukTape::duk_get_int(lpCtx, 1);
+            for (i = 0; i < nSpaces && i < 10; i++)
+            {
+                szIndentA[i] = ' ';
+            }
+            szIndentA[i] = 0;
+        }
+        else
+        {
+            LPCSTR sA = DukTape::duk_require_string(lpCtx, 1);
+            SIZE_T i;
+
+            for (i = 0; i < 10 && sA[i] != 0; i++)
+            {
+                szIndentA[i] = sA[i];
+            }
+            szIndentA[i] = 0;
+        }
+    }
+
+    // NOTE: The value is encoded in chunks straight into the active output buffer or the response body so large
+    //       results are never converted into a single Javascript string.
+    MX::CJavascriptVM::EncodeJson(lpCtx, 0, MX_BIND_CALLBACK(&OnEchoJsonOutput), lpRequest, szIndentA);
+    return 0;
+}
+
 static DukTape::duk_ret_t OnSetStatus(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA)
 {
     MX::CJsHttpServer::CClientRequest *lpRequest = MX::CJsHttpServer::GetServerRequestFromContext(lpCtx);
@@ -361,3 +424,81 @@ static DukTape::duk_ret_t OnObGetContents(_In_ DukTape::duk_context *lpCtx, _In_
     }
     return 1;
 }
+
+static DukTape::duk_ret_t OnResponseWrite(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA)
+{
+    MX::CJsHttpServer::CClientRequest *lpRequest = MX::CJsHttpServer::GetServerRequestFromContext(lpCtx);
+    DukTape::duk_size_t nDataLen;
+    LPCVOID lpData;
+    SIZE_T nIdx;
+    HRESULT hRes;
+
+    // NOTE: Buffers are sent as is and other types converted to string. The data is handed straight from the
+    //       Javascript heap to the connection without a temporary copy.
+    if (DukTape::duk_is_buffer_data(lpCtx, 0) != 0)
+    {
+        lpData = DukTape::duk_get_buffer_data(lpCtx, 0, &nDataLen);
+    }
+    else
+    {
+        lpData = DukTape::duk_to_lstring(lpCtx, 0, &nDataLen);
+    }
+
+    // switch to a chunked response on first use so the headers cannot be changed anymore
+    hRes = lpRequest->EnableChunkedResponse();
+    if (SUCCEEDED(hRes) && nDataLen > 0)
+    {
+        nIdx = lpRequest->cOutputBuffersList.GetCount();
+        if (nIdx > 0)
+        {
+            MX::CStringA *lpStrA = lpRequest->cOutputBuffersList.GetElementAt(nIdx - 1);
+
+            hRes = (lpStrA->ConcatN((LPCSTR)lpData, (SIZE_T)nDataLen) != FALSE) ? S_OK : E_OUTOFMEMORY;
+        }
+        else
+        {
+            hRes = lpRequest->SendResponse(lpData, (SIZE_T)nDataLen);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = lpRequest->FlushResponse(MAX_STREAMED_RESPONSE_PENDING_BYTES);
+            }
+        }
+    }
+    if (FAILED(hRes))
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
+    }
+    return 0;
+}
+
+static DukTape::duk_ret_t OnResponseFlush(_In_ DukTape::duk_context *lpCtx, _In_z_ LPCSTR szObjectNameA, _In_z_ LPCSTR szFunctionNameA)
+{
+    MX::CJsHttpServer::CClientRequest *lpRequest = MX::CJsHttpServer::GetServerRequestFromContext(lpCtx);
+    HRESULT hRes;
+
+    hRes = lpRequest->EnableChunkedResponse();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->FlushResponse();
+    }
+    if (FAILED(hRes))
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
+    }
+    return 0;
+}
+
+static HRESULT OnEchoJsonOutput(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam)
+{
+    MX::CJsHttpServer::CClientRequest *lpRequest = (MX::CJsHttpServer::CClientRequest*)lpUserParam;
+    SIZE_T nIdx;
+
+    nIdx = lpRequest->cOutputBuffersList.GetCount();
+    if (nIdx > 0)
+    {
+        MX::CStringA *lpStrA = lpRequest->cOutputBuffersList.GetElementAt(nIdx - 1);
+
+        return (lpStrA->ConcatN(szDataA, nDataLen) != FALSE) ? S_OK : E_OUTOFMEMORY;
+    }
+    return lpRequest->SendResponse(szDataA, nDataLen);
+}
@@ -40,6 +40,7 @@ CJsHttpServerSessionPlugin::CJsHttpServerSessionPlugin() : CJsObjectBase(), CNon
     szSessionVarNameA = SESSION_ID_COOKIE_NAME;
     cPersistanceCallback = NullCallback();
     bDirty = FALSE;
+    bSaveAll = TRUE;
     return;
 }
 
@@ -62,6 +63,7 @@ HRESULT CJsHttpServerSessionPlugin::Save()
     if (SUCCEEDED(hRes))
     {
         bDirty = FALSE;
+        ResetChanges(FALSE);
     }
     return hRes;
 }
@@ -76,6 +78,7 @@ VOID CJsHttpServerSessionPlugin::Destroy()
     }
     cBag.Reset();
     bDirty = FALSE;
+    ResetChanges(TRUE);
     return;
 }
 
@@ -99,6 +102,7 @@ on_error:
         szSessionVarNameA = SESSION_ID_COOKIE_NAME;
         cPersistanceCallback = NullCallback();
         bDirty = FALSE;
+        ResetChanges(TRUE);
 
         return hRes;
     }
@@ -168,17 +172,16 @@ on_error:
     // initialize session data
     for (i = 0;; i++)
     {
-        MX::TAutoRefCounted<CHttpCookie> cCookie;
+        LPCSTR szNameA = lpRequest->GetRequestCookieName(i);
 
-        cCookie.Attach(lpRequest->GetRequestCookie(i));
-        if (!cCookie)
+        if (szNameA == NULL)
         {
             break;
         }
 
-        if (StrCompareA(cCookie->GetName(), szSessionVarNameA) == 0)
+        if (StrCompareA(szNameA, szSessionVarNameA) == 0)
         {
-            LPCSTR szValueA = cCookie->GetValue();
+            LPCSTR szValueA = lpRequest->GetRequestCookieValue(i);
 
             if (IsValidSessionId(szValueA) != FALSE)
             {
@@ -186,6 +189,7 @@ on_error:
                 hRes = cPersistanceCallback(this, ePersistanceOption::Load);
                 if (SUCCEEDED(hRes))
                 {
+                    ResetChanges(FALSE);
                     return S_OK;
                 }
                 if (hRes == E_OUTOFMEMORY)
@@ -201,6 +205,7 @@ on_error:
 
     // if we reach here, create a new session id
     cBag.Reset();
+    ResetChanges(TRUE);
     GenerateSessionId();
     hRes = CreateRequestCookie();
     if (FAILED(hRes))
@@ -346,6 +351,46 @@ HRESULT CJsHttpServerSessionPlugin::CreateRequestCookie()
     return hRes;
 }
 
+VOID CJsHttpServerSessionPlugin::MarkChanged(_In_z_ LPCSTR szPropNameA)
+{
+    LPSTR szNameA;
+    SIZE_T nLen;
+
+    // once the whole bag must be saved there is no need to track single properties
+    if (bSaveAll != FALSE)
+    {
+        return;
+    }
+    if (aChangedNamesList.BinarySearch(szPropNameA, &CJsHttpServerSessionPlugin::ChangedNameSearchFunc) != (SIZE_T)-1)
+    {
+        return;
+    }
+
+    nLen = StrLenA(szPropNameA) + 1;
+    szNameA = (LPSTR)MX_MALLOC(nLen);
+    if (szNameA != NULL)
+    {
+        ::MxMemCopy(szNameA, szPropNameA, nLen);
+        if (aChangedNamesList.SortedInsert(szNameA, &CJsHttpServerSessionPlugin::ChangedNameCompareFunc) != FALSE)
+        {
+            return;
+        }
+        MX_FREE(szNameA);
+    }
+
+    // on low memory, fall back to a full save
+    aChangedNamesList.RemoveAllElements();
+    bSaveAll = TRUE;
+    return;
+}
+
+VOID CJsHttpServerSessionPlugin::ResetChanges(_In_ BOOL _bSaveAll)
+{
+    aChangedNamesList.RemoveAllElements();
+    bSaveAll = _bSaveAll;
+    return;
+}
+
 DukTape::duk_ret_t CJsHttpServerSessionPlugin::_Save(_In_ DukTape::duk_context *lpCtx)
 {
     HRESULT hRes;
@@ -383,6 +428,7 @@ DukTape::duk_ret_t CJsHttpServerSessionPlugin::RegenerateId(_In_ DukTape::duk_co
 
     // on success
     bDirty = TRUE;
+    ResetChanges(TRUE);
     return 0;
 }
 
@@ -460,46 +506,36 @@ int CJsHttpServerSessionPlugin::OnProxySetNamedProperty(_In_ DukTape::duk_contex
     {
         hRes = cBag.Clear(szPropNameA);
         bDirty = TRUE;
+        MarkChanged(szPropNameA);
         return 0;
     }
     if (DukTape::duk_is_null(lpCtx, nValueIndex) != 0)
     {
         hRes = cBag.SetNull(szPropNameA);
-        if (SUCCEEDED(hRes))
-        {
-            bDirty = TRUE;
-            return 0;
-        }
     }
     else if (DukTape::duk_is_boolean(lpCtx, nValueIndex) != 0)
     {
         hRes = cBag.SetDouble(szPropNameA, DukTape::duk_get_boolean(lpCtx, nValueIndex) ? 1.0 : 0.0);
-        return (SUCCEEDED(hRes)) ? 0 : -1;
-        if (SUCCEEDED(hRes))
-        {
-            bDirty = TRUE;
-            return 0;
-        }
     }
     else if (DukTape::duk_is_number(lpCtx, nValueIndex) != 0)
     {
         hRes = cBag.SetDouble(szPropNameA, DukTape::duk_get_number(lpCtx, nValueIndex));
-        if (SUCCEEDED(hRes))
-        {
-            bDirty = TRUE;
-            return 0;
-        }
     }
     else if (DukTape::duk_is_string(lpCtx, nValueIndex) != 0)
     {
         hRes = cBag.SetString(szPropNameA, DukTape::duk_get_string(lpCtx, nValueIndex));
-        if (SUCCEEDED(hRes))
-        {
-            bDirty = TRUE;
-            return 0;
-        }
     }
-    return -1; // throw error
+    else
+    {
+        return -1; // throw error
+    }
+    if (FAILED(hRes))
+    {
+        return -1; // throw error
+    }
+    bDirty = TRUE;
+    MarkChanged(szPropNameA);
+    return 0;
 }
 
 int CJsHttpServerSessionPlugin::OnProxySetIndexedProperty(_In_ DukTape::duk_context *lpCtx, _In_ int nIndex,
@@ -517,6 +553,7 @@ int CJsHttpServerSessionPlugin::OnProxyDeleteNamedProperty(_In_ DukTape::duk_con
     if (SUCCEEDED(cBag.Clear(szPropNameA)))
     {
         bDirty = TRUE;
+        MarkChanged(szPropNameA);
     }
     return 1;
 }
@@ -0,0 +1,1238 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\..\..\Include\JsHttpServer\Plugins\JsHttpServerSessionStore.h"
+#include "..\..\..\Include\FnvHash.h"
+
+ //-----------------------------------------------------------
+
+#define SESSION_ID_SIZE 32
+
+#define SWEEP_INTERVAL_MS 10000i64
+
+#define JOURNAL_MAGIC 0x4A53584DUL // "MXSJ"
+#define JOURNAL_VERSION 1UL
+
+#define JOURNAL_OP_RESET 1
+#define JOURNAL_OP_SET 2
+#define JOURNAL_OP_CLEAR 3
+#define JOURNAL_OP_DELETE 4
+
+#define JOURNAL_TYPE_NULL 1
+#define JOURNAL_TYPE_DWORD 2
+#define JOURNAL_TYPE_QWORD 3
+#define JOURNAL_TYPE_DOUBLE 4
+#define JOURNAL_TYPE_ANSISTRING 5
+#define JOURNAL_TYPE_WIDESTRING 6
+
+#define JOURNAL_WRITE_INTERVAL_MS 1000
+#define JOURNAL_WAKEUP_SIZE 65536
+#define JOURNAL_DEFAULT_COMPACTION_SIZE (16ui64 * 1048576ui64)
+
+#define IS_EXPIRED(llExpiresMs, llNowMs) ((llExpiresMs) != 0 && (llExpiresMs) <= (llNowMs))
+
+//-----------------------------------------------------------
+
+#pragma pack(push, 1)
+typedef struct tagJOURNAL_HEADER
+{
+    DWORD dwMagic;
+    DWORD dwVersion;
+} JOURNAL_HEADER;
+
+// NOTE: Set and clear records are followed by a WORD with the name length and the name. Set records continue with
+//       the value type and the value. Strings are stored as a DWORD with the length in characters and the data.
+typedef struct tagJOURNAL_RECORD
+{
+    BYTE nOp;
+    BYTE aId[SESSION_ID_SIZE];
+    LONGLONG llExpiresMs;
+} JOURNAL_RECORD;
+#pragma pack(pop)
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+class CJsHttpServerSessionStore::CSession : public virtual CBaseMemObj
+{
+public:
+    CSession(_In_ LPBYTE lpId) : CBaseMemObj()
+    {
+        ::MxMemCopy(aId, lpId, sizeof(aId));
+        return;
+    };
+
+    static int InsertCompareFunc(_In_ LPVOID lpContext, _In_ CRedBlackTreeNode *lpNode1, _In_ CRedBlackTreeNode *lpNode2)
+    {
+        CSession *lpSession1 = CONTAINING_RECORD(lpNode1, CSession, cTreeNode);
+        CSession *lpSession2 = CONTAINING_RECORD(lpNode2, CSession, cTreeNode);
+
+        return ::MxMemCompare(lpSession1->aId, lpSession2->aId, SESSION_ID_SIZE);
+    };
+
+    static int SearchCompareFunc(_In_ LPVOID lpContext, _In_ LPBYTE lpId, _In_ CRedBlackTreeNode *lpNode)
+    {
+        CSession *lpSession = CONTAINING_RECORD(lpNode, CSession, cTreeNode);
+
+        return ::MxMemCompare(lpId, lpSession->aId, SESSION_ID_SIZE);
+    };
+
+public:
+    BYTE aId[SESSION_ID_SIZE];
+    LONGLONG volatile llExpiresMs{ 0 };
+    CPropertyBag cBag;
+    CRedBlackTreeNode cTreeNode;
+};
+
+//-----------------------------------------------------------
+
+CJsHttpServerSessionStore::CJsHttpServerSessionStore() : CBaseMemObj(), CNonCopyableObj()
+{
+    for (SIZE_T i = 0; i < MX_ARRAYLEN(aShards); i++)
+    {
+        SlimRWL_Initialize(&(aShards[i].sRwMutex));
+        aShards[i].llLastSweepMs = 0;
+    }
+    return;
+}
+
+CJsHttpServerSessionStore::~CJsHttpServerSessionStore()
+{
+    // the journal thread writes pending changes before exiting
+    cJournalThread.Stop();
+    cJournalFile.Close();
+
+    RemoveAllSessions();
+
+    MX_FREE(sJournalBuffer.lpData);
+    MX_FREE(sWriteBuffer.lpData);
+    return;
+}
+
+HRESULT CJsHttpServerSessionStore::Initialize(_In_ DWORD dwTimeToLiveSecs, _In_opt_z_ LPCWSTR szJournalFileNameW,
+                                              _In_opt_ ULONGLONG nJournalCompactionSize)
+{
+    HRESULT hRes;
+
+    if (bUseJournal != FALSE)
+    {
+        return MX_E_AlreadyInitialized;
+    }
+
+    llTimeToLiveMs = (LONGLONG)dwTimeToLiveSecs * 1000i64;
+
+    if (szJournalFileNameW != NULL && *szJournalFileNameW != 0)
+    {
+        this->nJournalCompactionSize = (nJournalCompactionSize != 0) ? nJournalCompactionSize
+                                                                     : JOURNAL_DEFAULT_COMPACTION_SIZE;
+        hRes = OpenJournal(szJournalFileNameW);
+        if (FAILED(hRes))
+        {
+            bUseJournal = FALSE;
+            cJournalThread.Stop();
+            cJournalFile.Close();
+            cStrJournalFileNameW.Empty();
+            RemoveAllSessions();
+            return hRes;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CJsHttpServerSessionStore::OnPersistance(_In_ CJsHttpServerSessionPlugin *lpPlugin,
+                                                 _In_ CJsHttpServerSessionPlugin::ePersistanceOption nPersistanceOption)
+{
+    if (lpPlugin == NULL)
+    {
+        return E_POINTER;
+    }
+
+    switch (nPersistanceOption)
+    {
+        case CJsHttpServerSessionPlugin::ePersistanceOption::Load:
+            return Load(lpPlugin->GetSessionId(), *(lpPlugin->GetBag()));
+
+        case CJsHttpServerSessionPlugin::ePersistanceOption::Save:
+            if (lpPlugin->MustSaveAll() != FALSE || lpPlugin->GetChangedPropertiesCount() == 0)
+            {
+                return Save(lpPlugin->GetSessionId(), *(lpPlugin->GetBag()));
+            }
+            return Save(lpPlugin->GetSessionId(), *(lpPlugin->GetBag()), lpPlugin->GetChangedProperties(),
+                        lpPlugin->GetChangedPropertiesCount());
+
+        case CJsHttpServerSessionPlugin::ePersistanceOption::Delete:
+            return Delete(lpPlugin->GetSessionId());
+    }
+    return E_INVALIDARG;
+}
+
+HRESULT CJsHttpServerSessionStore::Load(_In_z_ LPCSTR szSessionIdA, _Inout_ CPropertyBag &cBag)
+{
+    BYTE aId[SESSION_ID_SIZE];
+    LPSHARD lpShard;
+    CSession *lpSession;
+    CRedBlackTreeNode *lpNode;
+    LPCSTR szNameA;
+    LONGLONG llNowMs;
+    HRESULT hRes;
+
+    if (szSessionIdA == NULL)
+    {
+        return E_POINTER;
+    }
+    if (ParseSessionId(szSessionIdA, aId) == FALSE)
+    {
+        return E_INVALIDARG;
+    }
+
+    lpShard = GetShard(aId);
+    llNowMs = GetTimeMs();
+
+    {
+        CAutoSlimRWLShared cLock(&(lpShard->sRwMutex));
+
+        lpNode = lpShard->cTree.Find(aId, &CSession::SearchCompareFunc);
+        lpSession = (lpNode != NULL) ? CONTAINING_RECORD(lpNode, CSession, cTreeNode) : NULL;
+        if (lpSession == NULL || IS_EXPIRED(__InterlockedRead64(&(lpSession->llExpiresMs)), llNowMs))
+        {
+            _InterlockedIncrement64(&(sStats.nLoadMisses));
+            return MX_E_NotFound;
+        }
+
+        // loaders only share the lock so the refreshed expiration time is stored atomically
+        if (llTimeToLiveMs != 0)
+        {
+            _InterlockedExchange64(&(lpSession->llExpiresMs), GetExpirationTimeMs(llNowMs));
+        }
+
+        cBag.Reset();
+        for (SIZE_T i = 0; (szNameA = lpSession->cBag.GetAt(i)) != NULL; i++)
+        {
+            hRes = CopyProperty(cBag, lpSession->cBag, szNameA);
+            if (FAILED(hRes))
+            {
+                cBag.Reset();
+                return hRes;
+            }
+        }
+    }
+
+    // done
+    _InterlockedIncrement64(&(sStats.nLoads));
+    return S_OK;
+}
+
+HRESULT CJsHttpServerSessionStore::Save(_In_z_ LPCSTR szSessionIdA, _In_ CPropertyBag &cBag,
+                                        _In_opt_ LPCSTR *lpszChangedNamesA, _In_opt_ SIZE_T nChangedNamesCount)
+{
+    BYTE aId[SESSION_ID_SIZE];
+    LPSHARD lpShard;
+    CSession *lpSession;
+    CRedBlackTreeNode *lpNode;
+    LPCSTR szNameA;
+    LONGLONG llNowMs, nSaved = 0;
+    BOOL bReplace;
+    HRESULT hRes = S_OK;
+
+    if (szSessionIdA == NULL || (lpszChangedNamesA == NULL && nChangedNamesCount > 0))
+    {
+        return E_POINTER;
+    }
+    if (ParseSessionId(szSessionIdA, aId) == FALSE)
+    {
+        return E_INVALIDARG;
+    }
+
+    lpShard = GetShard(aId);
+    llNowMs = GetTimeMs();
+
+    {
+        CAutoSlimRWLExclusive cLock(&(lpShard->sRwMutex));
+
+        lpNode = lpShard->cTree.Find(aId, &CSession::SearchCompareFunc);
+        if (lpNode != NULL)
+        {
+            lpSession = CONTAINING_RECORD(lpNode, CSession, cTreeNode);
+
+            // an expired session cannot be patched because the unchanged properties are gone from the caller's bag
+            bReplace = (lpszChangedNamesA == NULL || IS_EXPIRED(lpSession->llExpiresMs, llNowMs)) ? TRUE : FALSE;
+        }
+        else
+        {
+            if (llNowMs - lpShard->llLastSweepMs >= SWEEP_INTERVAL_MS)
+            {
+                SweepShard(lpShard, llNowMs);
+                lpShard->llLastSweepMs = llNowMs;
+            }
+
+            lpSession = MX_DEBUG_NEW CSession(aId);
+            if (lpSession == NULL)
+            {
+                return E_OUTOFMEMORY;
+            }
+            lpShard->cTree.Insert(&(lpSession->cTreeNode), &CSession::InsertCompareFunc);
+            _InterlockedIncrement64(&(sStats.nSessions));
+
+            bReplace = TRUE;
+        }
+
+        lpSession->llExpiresMs = GetExpirationTimeMs(llNowMs);
+
+        if (bReplace != FALSE)
+        {
+            lpSession->cBag.Reset();
+            if (bUseJournal != FALSE)
+            {
+                hRes = QueueJournalRecord(JOURNAL_OP_RESET, lpSession);
+            }
+            for (SIZE_T i = 0; SUCCEEDED(hRes) && (szNameA = cBag.GetAt(i)) != NULL; i++)
+            {
+                hRes = ApplyProperty(lpSession, cBag, szNameA);
+                nSaved++;
+            }
+        }
+        else
+        {
+            for (SIZE_T i = 0; SUCCEEDED(hRes) && i < nChangedNamesCount; i++)
+            {
+                hRes = ApplyProperty(lpSession, cBag, lpszChangedNamesA[i]);
+                nSaved++;
+            }
+        }
+    }
+
+    // done
+    _InterlockedIncrement64(&(sStats.nSaves));
+    _InterlockedExchangeAdd64(&(sStats.nPropertiesSaved), nSaved);
+    return hRes;
+}
+
+HRESULT CJsHttpServerSessionStore::Delete(_In_z_ LPCSTR szSessionIdA)
+{
+    BYTE aId[SESSION_ID_SIZE];
+    LPSHARD lpShard;
+    CSession *lpSession;
+    CRedBlackTreeNode *lpNode;
+    HRESULT hRes = S_OK;
+
+    if (szSessionIdA == NULL)
+    {
+        return E_POINTER;
+    }
+    if (ParseSessionId(szSessionIdA, aId) == FALSE)
+    {
+        return E_INVALIDARG;
+    }
+
+    lpShard = GetShard(aId);
+
+    {
+        CAutoSlimRWLExclusive cLock(&(lpShard->sRwMutex));
+
+        lpNode = lpShard->cTree.Find(aId, &CSession::SearchCompareFunc);
+        if (lpNode != NULL)
+        {
+            lpSession = CONTAINING_RECORD(lpNode, CSession, cTreeNode);
+
+            if (bUseJournal != FALSE)
+            {
+                hRes = QueueJournalRecord(JOURNAL_OP_DELETE, lpSession);
+            }
+            lpNode->Remove();
+            delete lpSession;
+            _InterlockedDecrement64(&(sStats.nSessions));
+        }
+    }
+
+    // done
+    _InterlockedIncrement64(&(sStats.nDeletes));
+    return hRes;
+}
+
+HRESULT CJsHttpServerSessionStore::FlushJournal()
+{
+    LONGLONG nQueuedBytes;
+
+    if (bUseJournal == FALSE)
+    {
+        return S_OK;
+    }
+
+    nQueuedBytes = __InterlockedRead64(&nJournalQueuedBytes);
+    while (__InterlockedRead64(&nJournalProcessedBytes) < nQueuedBytes && cJournalThread.IsRunning() != FALSE)
+    {
+        cJournalEvent.Set();
+        ::Sleep(1);
+    }
+    return (HRESULT)__InterlockedRead(&hrJournalError);
+}
+
+VOID CJsHttpServerSessionStore::GetStats(_Out_ LPSTATS lpStats)
+{
+    if (lpStats != NULL)
+    {
+        lpStats->nSessions = (ULONGLONG)__InterlockedRead64(&(sStats.nSessions));
+        lpStats->nLoads = (ULONGLONG)__InterlockedRead64(&(sStats.nLoads));
+        lpStats->nLoadMisses = (ULONGLONG)__InterlockedRead64(&(sStats.nLoadMisses));
+        lpStats->nSaves = (ULONGLONG)__InterlockedRead64(&(sStats.nSaves));
+        lpStats->nPropertiesSaved = (ULONGLONG)__InterlockedRead64(&(sStats.nPropertiesSaved));
+        lpStats->nDeletes = (ULONGLONG)__InterlockedRead64(&(sStats.nDeletes));
+        lpStats->nExpiredSessions = (ULONGLONG)__InterlockedRead64(&(sStats.nExpiredSessions));
+        lpStats->nJournalBytes = (ULONGLONG)__InterlockedRead64(&nJournalWrittenBytes);
+        lpStats->nJournalCompactions = (ULONGLONG)__InterlockedRead64(&(sStats.nJournalCompactions));
+        lpStats->nJournalWriteErrors = (ULONGLONG)__InterlockedRead64(&(sStats.nJournalWriteErrors));
+    }
+    return;
+}
+
+CJsHttpServerSessionStore::LPSHARD CJsHttpServerSessionStore::GetShard(_In_ LPBYTE lpId)
+{
+    return &aShards[fnv_32a_buf(lpId, SESSION_ID_SIZE, FNV1A_32_INIT) & (MX_JS_HTTP_SERVER_SESSION_STORE_SHARDS_COUNT - 1)];
+}
+
+VOID CJsHttpServerSessionStore::SweepShard(_In_ LPSHARD lpShard, _In_ LONGLONG llNowMs)
+{
+    CRedBlackTreeNode *lpNode, *lpNextNode;
+
+    // NOTE: Shard must be exclusively locked. Expired sessions are not journaled because replay drops them too.
+    lpNode = lpShard->cTree.GetFirst();
+    while (lpNode != NULL)
+    {
+        CSession *lpSession = CONTAINING_RECORD(lpNode, CSession, cTreeNode);
+
+        lpNextNode = lpNode->GetNext();
+        if (IS_EXPIRED(__InterlockedRead64(&(lpSession->llExpiresMs)), llNowMs))
+        {
+            lpNode->Remove();
+            delete lpSession;
+            _InterlockedDecrement64(&(sStats.nSessions));
+            _InterlockedIncrement64(&(sStats.nExpiredSessions));
+        }
+        lpNode = lpNextNode;
+    }
+    return;
+}
+
+VOID CJsHttpServerSessionStore::RemoveAllSessions()
+{
+    for (SIZE_T i = 0; i < MX_ARRAYLEN(aShards); i++)
+    {
+        CAutoSlimRWLExclusive cLock(&(aShards[i].sRwMutex));
+        CRedBlackTreeNode *lpNode;
+
+        while ((lpNode = aShards[i].cTree.GetFirst()) != NULL)
+        {
+            CSession *lpSession = CONTAINING_RECORD(lpNode, CSession, cTreeNode);
+
+            lpNode->Remove();
+            delete lpSession;
+        }
+    }
+    _InterlockedExchange64(&(sStats.nSessions), 0);
+    return;
+}
+
+HRESULT CJsHttpServerSessionStore::ApplyProperty(_In_ CSession *lpSession, _In_ CPropertyBag &cSrcBag, _In_z_ LPCSTR szNameA)
+{
+    HRESULT hRes;
+
+    hRes = CopyProperty(lpSession->cBag, cSrcBag, szNameA);
+    if (SUCCEEDED(hRes) && bUseJournal != FALSE)
+    {
+        hRes = QueueJournalRecord(JOURNAL_OP_SET, lpSession, szNameA);
+    }
+    return hRes;
+}
+
+HRESULT CJsHttpServerSessionStore::OpenJournal(_In_z_ LPCWSTR szFileNameW)
+{
+    CWindowsHandle cFile;
+    LARGE_INTEGER liSize;
+    LPBYTE lpData;
+    DWORD dwRead;
+    HRESULT hRes;
+
+    // replay the existing journal, if any
+    cFile.Attach(::CreateFileW(szFileNameW, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                               NULL));
+    if (cFile)
+    {
+        if (::GetFileSizeEx(cFile.Get(), &liSize) == FALSE)
+        {
+            return MX_HRESULT_FROM_LASTERROR();
+        }
+        if (liSize.QuadPart > 0x7FFFFFFFi64)
+        {
+            return MX_E_BufferOverflow;
+        }
+        if (liSize.QuadPart > 0)
+        {
+            lpData = (LPBYTE)MX_MALLOC((SIZE_T)(liSize.QuadPart));
+            if (lpData == NULL)
+            {
+                return E_OUTOFMEMORY;
+            }
+            if (::ReadFile(cFile.Get(), lpData, (DWORD)(liSize.QuadPart), &dwRead, NULL) == FALSE)
+            {
+                hRes = MX_HRESULT_FROM_LASTERROR();
+                MX_FREE(lpData);
+                return hRes;
+            }
+            hRes = ReplayJournal(lpData, (SIZE_T)dwRead);
+            MX_FREE(lpData);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        cFile.Close();
+    }
+    else
+    {
+        hRes = MX_HRESULT_FROM_LASTERROR();
+        if (hRes != MX_E_FileNotFound && hRes != MX_E_PathNotFound)
+        {
+            return hRes;
+        }
+    }
+
+    // compact it
+    if (cStrJournalFileNameW.Copy(szFileNameW) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = WriteJournalSnapshot(szFileNameW, &nJournalSnapshotSize);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // and start appending changes
+    hRes = OpenJournalForAppend();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    nJournalFileSize = nJournalSnapshotSize;
+    hRes = cJournalEvent.Create(FALSE, FALSE);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (cJournalThread.Start(this, &CJsHttpServerSessionStore::JournalThreadProc) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    cJournalThread.SetThreadName("SessionStore/Journal");
+
+    // done
+    bUseJournal = TRUE;
+    return S_OK;
+}
+
+HRESULT CJsHttpServerSessionStore::ReplayJournal(_In_ LPBYTE lpData, _In_ SIZE_T nDataLen)
+{
+    JOURNAL_HEADER *lpHeader;
+    JOURNAL_RECORD *lpRecord;
+    CSession *lpSession;
+    CRedBlackTreeNode *lpNode;
+    LPSHARD lpShard;
+    CStringA cStrNameA, cStrValueA;
+    CStringW cStrValueW;
+    SIZE_T nOffset, nNameLen, nLen;
+    BYTE nType;
+    HRESULT hRes;
+
+    if (nDataLen < sizeof(JOURNAL_HEADER))
+    {
+        return MX_E_InvalidData;
+    }
+    lpHeader = (JOURNAL_HEADER *)lpData;
+    if (lpHeader->dwMagic != JOURNAL_MAGIC || lpHeader->dwVersion != JOURNAL_VERSION)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // NOTE: A truncated or damaged record ends the replay. It can only be the tail left by an interrupted write.
+    nOffset = sizeof(JOURNAL_HEADER);
+    while (nDataLen - nOffset >= sizeof(JOURNAL_RECORD))
+    {
+        lpRecord = (JOURNAL_RECORD *)(lpData + nOffset);
+        nOffset += sizeof(JOURNAL_RECORD);
+
+        if (lpRecord->nOp < JOURNAL_OP_RESET || lpRecord->nOp > JOURNAL_OP_DELETE)
+        {
+            break;
+        }
+
+        if (lpRecord->nOp == JOURNAL_OP_SET || lpRecord->nOp == JOURNAL_OP_CLEAR)
+        {
+            if (nDataLen - nOffset < sizeof(WORD))
+            {
+                break;
+            }
+            nNameLen = (SIZE_T)*((WORD UNALIGNED *)(lpData + nOffset));
+            nOffset += sizeof(WORD);
+            if (nNameLen == 0 || nDataLen - nOffset < nNameLen)
+            {
+                break;
+            }
+            if (cStrNameA.CopyN((LPCSTR)(lpData + nOffset), nNameLen) == FALSE)
+            {
+                return E_OUTOFMEMORY;
+            }
+            nOffset += nNameLen;
+        }
+
+        lpShard = GetShard(lpRecord->aId);
+        lpNode = lpShard->cTree.Find(lpRecord->aId, &CSession::SearchCompareFunc);
+        lpSession = (lpNode != NULL) ? CONTAINING_RECORD(lpNode, CSession, cTreeNode) : NULL;
+
+        if (lpRecord->nOp == JOURNAL_OP_DELETE)
+        {
+            if (lpSession != NULL)
+            {
+                lpNode->Remove();
+                delete lpSession;
+                _InterlockedDecrement64(&(sStats.nSessions));
+            }
+            continue;
+        }
+
+        if (lpSession == NULL)
+        {
+            lpSession = MX_DEBUG_NEW CSession(lpRecord->aId);
+            if (lpSession == NULL)
+            {
+                return E_OUTOFMEMORY;
+            }
+            lpShard->cTree.Insert(&(lpSession->cTreeNode), &CSession::InsertCompareFunc);
+            _InterlockedIncrement64(&(sStats.nSessions));
+        }
+        lpSession->llExpiresMs = lpRecord->llExpiresMs;
+
+        switch (lpRecord->nOp)
+        {
+            case JOURNAL_OP_RESET:
+                lpSession->cBag.Reset();
+                hRes = S_OK;
+                break;
+
+            case JOURNAL_OP_CLEAR:
+                hRes = lpSession->cBag.Clear((LPCSTR)cStrNameA);
+                if (hRes == MX_E_NotFound)
+                {
+                    hRes = S_OK;
+                }
+                break;
+
+            default:
+                if (nOffset >= nDataLen)
+                {
+                    hRes = MX_E_EndOfFileReached;
+                    break;
+                }
+                nType = lpData[nOffset++];
+                switch (nType)
+                {
+                    case JOURNAL_TYPE_NULL:
+                        hRes = lpSession->cBag.SetNull((LPCSTR)cStrNameA);
+                        break;
+
+                    case JOURNAL_TYPE_DWORD:
+                        if (nDataLen - nOffset < sizeof(DWORD))
+                        {
+                            hRes = MX_E_EndOfFileReached;
+                            break;
+                        }
+                        hRes = lpSession->cBag.SetDWord((LPCSTR)cStrNameA, *((DWORD UNALIGNED *)(lpData + nOffset)));
+                        nOffset += sizeof(DWORD);
+                        break;
+
+                    case JOURNAL_TYPE_QWORD:
+                        if (nDataLen - nOffset < sizeof(ULONGLONG))
+                        {
+                            hRes = MX_E_EndOfFileReached;
+                            break;
+                        }
+                        hRes = lpSession->cBag.SetQWord((LPCSTR)cStrNameA, *((ULONGLONG UNALIGNED *)(lpData + nOffset)));
+                        nOffset += sizeof(ULONGLONG);
+                        break;
+
+                    case JOURNAL_TYPE_DOUBLE:
+                        if (nDataLen - nOffset < sizeof(double))
+                        {
+                            hRes = MX_E_EndOfFileReached;
+                            break;
+                        }
+                        hRes = lpSession->cBag.SetDouble((LPCSTR)cStrNameA, *((double UNALIGNED *)(lpData + nOffset)));
+                        nOffset += sizeof(double);
+                        break;
+
+                    case JOURNAL_TYPE_ANSISTRING:
+                    case JOURNAL_TYPE_WIDESTRING:
+                        if (nDataLen - nOffset < sizeof(DWORD))
+                        {
+                            hRes = MX_E_EndOfFileReached;
+                            break;
+                        }
+                        nLen = (SIZE_T)*((DWORD UNALIGNED *)(lpData + nOffset));
+                        nOffset += sizeof(DWORD);
+                        if (nType == JOURNAL_TYPE_WIDESTRING)
+                        {
+                            if (nLen > (nDataLen - nOffset) / sizeof(WCHAR))
+                            {
+                                hRes = MX_E_EndOfFileReached;
+                                break;
+                            }
+                            if (cStrValueW.CopyN((LPCWSTR)(lpData + nOffset), nLen) == FALSE)
+                            {
+                                return E_OUTOFMEMORY;
+                            }
+                            hRes = lpSession->cBag.SetString((LPCSTR)cStrNameA, (LPCWSTR)cStrValueW);
+                            nOffset += nLen * sizeof(WCHAR);
+                        }
+                        else
+                        {
+                            if (nLen > nDataLen - nOffset)
+                            {
+                                hRes = MX_E_EndOfFileReached;
+                                break;
+                            }
+                            if (cStrValueA.CopyN((LPCSTR)(lpData + nOffset), nLen) == FALSE)
+                            {
+                                return E_OUTOFMEMORY;
+                            }
+                            hRes = lpSession->cBag.SetString((LPCSTR)cStrNameA, (LPCSTR)cStrValueA);
+                            nOffset += nLen;
+                        }
+                        break;
+
+                    default:
+                        hRes = MX_E_InvalidData;
+                        break;
+                }
+                break;
+        }
+        if (hRes == E_OUTOFMEMORY)
+        {
+            return hRes;
+        }
+        if (FAILED(hRes))
+        {
+            break;
+        }
+    }
+
+    // drop what expired while the store was not running
+    for (SIZE_T i = 0; i < MX_ARRAYLEN(aShards); i++)
+    {
+        SweepShard(&aShards[i], GetTimeMs());
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CJsHttpServerSessionStore::WriteJournalSnapshot(_In_z_ LPCWSTR szFileNameW, _Out_ ULONGLONG *lpnSize)
+{
+    CWindowsHandle cFile;
+    CStringW cStrTempFileNameW;
+    BUFFER sBuffer = {};
+    JOURNAL_HEADER sHeader;
+    CRedBlackTreeNode *lpNode;
+    LPCSTR szNameA;
+    DWORD dwWritten;
+    HRESULT hRes = S_OK;
+
+    *lpnSize = 0;
+
+    sHeader.dwMagic = JOURNAL_MAGIC;
+    sHeader.dwVersion = JOURNAL_VERSION;
+    if (GrowBuffer(&sBuffer, sizeof(sHeader)) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    ::MxMemCopy(sBuffer.lpData, &sHeader, sizeof(sHeader));
+    sBuffer.nLen = sizeof(sHeader);
+
+    for (SIZE_T i = 0; SUCCEEDED(hRes) && i < MX_ARRAYLEN(aShards); i++)
+    {
+        CAutoSlimRWLShared cLock(&(aShards[i].sRwMutex));
+
+        for (lpNode = aShards[i].cTree.GetFirst(); SUCCEEDED(hRes) && lpNode != NULL; lpNode = lpNode->GetNext())
+        {
+            CSession *lpSession = CONTAINING_RECORD(lpNode, CSession, cTreeNode);
+
+            hRes = AppendJournalRecord(&sBuffer, JOURNAL_OP_RESET, lpSession);
+            for (SIZE_T j = 0; SUCCEEDED(hRes) && (szNameA = lpSession->cBag.GetAt(j)) != NULL; j++)
+            {
+                hRes = AppendJournalRecord(&sBuffer, JOURNAL_OP_SET, lpSession, szNameA);
+            }
+        }
+    }
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    if (sBuffer.nLen > 0xFFFFFFFF)
+    {
+        hRes = MX_E_BufferOverflow;
+        goto done;
+    }
+
+    // write to a temporary file and replace the journal so a crash never leaves a partial snapshot
+    if (cStrTempFileNameW.Copy(szFileNameW) == FALSE || cStrTempFileNameW.Concat(L".tmp") == FALSE)
+    {
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+    cFile.Attach(::CreateFileW((LPCWSTR)cStrTempFileNameW, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                               NULL));
+    if (!cFile)
+    {
+        hRes = MX_HRESULT_FROM_LASTERROR();
+        goto done;
+    }
+    if (::WriteFile(cFile.Get(), sBuffer.lpData, (DWORD)(sBuffer.nLen), &dwWritten, NULL) == FALSE ||
+        ::FlushFileBuffers(cFile.Get()) == FALSE)
+    {
+        hRes = MX_HRESULT_FROM_LASTERROR();
+    }
+    else if (dwWritten != (DWORD)(sBuffer.nLen))
+    {
+        hRes = MX_E_WriteFault;
+    }
+    if (FAILED(hRes))
+    {
+        cFile.Close();
+        ::DeleteFileW((LPCWSTR)cStrTempFileNameW);
+        goto done;
+    }
+    cFile.Close();
+    if (::MoveFileExW((LPCWSTR)cStrTempFileNameW, szFileNameW, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) == FALSE)
+    {
+        hRes = MX_HRESULT_FROM_LASTERROR();
+        ::DeleteFileW((LPCWSTR)cStrTempFileNameW);
+        goto done;
+    }
+    *lpnSize = (ULONGLONG)(sBuffer.nLen);
+
+done:
+    MX_FREE(sBuffer.lpData);
+    return hRes;
+}
+
+HRESULT CJsHttpServerSessionStore::OpenJournalForAppend()
+{
+    cJournalFile.Attach(::CreateFileW((LPCWSTR)cStrJournalFileNameW, FILE_APPEND_DATA, FILE_SHARE_READ, NULL,
+                                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+    return (cJournalFile) ? S_OK : MX_HRESULT_FROM_LASTERROR();
+}
+
+HRESULT CJsHttpServerSessionStore::CompactJournal()
+{
+    ULONGLONG nSize;
+    HRESULT hRes, hRes2;
+
+    // NOTE: Runs on the journal thread. Changes queued while the snapshot is taken are appended to the new file
+    //       afterwards. Replaying one whose effect is already in the snapshot gives the same result because each
+    //       record either sets or clears a single property or starts the session from scratch.
+    cJournalFile.Close();
+    hRes = WriteJournalSnapshot((LPCWSTR)cStrJournalFileNameW, &nSize);
+    if (SUCCEEDED(hRes))
+    {
+        nJournalSnapshotSize = nJournalFileSize = nSize;
+        _InterlockedIncrement64(&(sStats.nJournalCompactions));
+    }
+
+    // keep appending to the old file if the snapshot could not replace it
+    hRes2 = OpenJournalForAppend();
+    return (SUCCEEDED(hRes)) ? hRes2 : hRes;
+}
+
+HRESULT CJsHttpServerSessionStore::QueueJournalRecord(_In_ BYTE nOp, _In_ CSession *lpSession, _In_opt_z_ LPCSTR szNameA)
+{
+    CFastLock cLock(&nJournalMutex);
+    SIZE_T nOldLen;
+    HRESULT hRes;
+
+    nOldLen = sJournalBuffer.nLen;
+    hRes = AppendJournalRecord(&sJournalBuffer, nOp, lpSession, szNameA);
+    if (SUCCEEDED(hRes))
+    {
+        _InterlockedExchangeAdd64(&nJournalQueuedBytes, (LONGLONG)(sJournalBuffer.nLen - nOldLen));
+
+        // wake up the writer early on bursts
+        if (nOldLen < JOURNAL_WAKEUP_SIZE && sJournalBuffer.nLen >= JOURNAL_WAKEUP_SIZE)
+        {
+            cJournalEvent.Set();
+        }
+    }
+    return hRes;
+}
+
+HRESULT CJsHttpServerSessionStore::AppendJournalRecord(_Inout_ LPBUFFER lpBuffer, _In_ BYTE nOp, _In_ CSession *lpSession,
+                                                       _In_opt_z_ LPCSTR szNameA)
+{
+    JOURNAL_RECORD sRecord;
+    CPropertyBag::eType nType = CPropertyBag::eType::Undefined;
+    union
+    {
+        DWORD dw;
+        ULONGLONG ull;
+        double dbl;
+    } uValue;
+    LPCSTR szValueA = NULL;
+    LPCWSTR szValueW = NULL;
+    SIZE_T nNameLen = 0, nValueLen = 0, nLen;
+    LPBYTE p;
+
+    if (nOp == JOURNAL_OP_SET)
+    {
+        nType = lpSession->cBag.GetType(szNameA);
+        switch (nType)
+        {
+            case CPropertyBag::eType::DWord:
+                lpSession->cBag.GetDWord(szNameA, uValue.dw);
+                nValueLen = sizeof(DWORD);
+                break;
+            case CPropertyBag::eType::QWord:
+                lpSession->cBag.GetQWord(szNameA, uValue.ull);
+                nValueLen = sizeof(ULONGLONG);
+                break;
+            case CPropertyBag::eType::Double:
+                lpSession->cBag.GetDouble(szNameA, uValue.dbl);
+                nValueLen = sizeof(double);
+                break;
+            case CPropertyBag::eType::AnsiString:
+                lpSession->cBag.GetString(szNameA, szValueA);
+                nValueLen = StrLenA(szValueA);
+                break;
+            case CPropertyBag::eType::WideString:
+                lpSession->cBag.GetString(szNameA, szValueW);
+                nValueLen = StrLenW(szValueW) * sizeof(WCHAR);
+                break;
+            case CPropertyBag::eType::Null:
+                break;
+            default:
+                // property was deleted
+                nOp = JOURNAL_OP_CLEAR;
+                break;
+        }
+    }
+    if (nOp == JOURNAL_OP_SET || nOp == JOURNAL_OP_CLEAR)
+    {
+        nNameLen = StrLenA(szNameA);
+        if (nNameLen == 0 || nNameLen > 0xFFFF || nValueLen > 0xFFFFFFFF)
+        {
+            return MX_E_BufferOverflow;
+        }
+    }
+
+    nLen = sizeof(JOURNAL_RECORD);
+    if (nOp == JOURNAL_OP_SET || nOp == JOURNAL_OP_CLEAR)
+    {
+        nLen += sizeof(WORD) + nNameLen;
+        if (nOp == JOURNAL_OP_SET)
+        {
+            nLen += 1 + nValueLen + ((szValueA != NULL || szValueW != NULL) ? sizeof(DWORD) : 0);
+        }
+    }
+    if (GrowBuffer(lpBuffer, nLen) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    p = lpBuffer->lpData + lpBuffer->nLen;
+    sRecord.nOp = nOp;
+    ::MxMemCopy(sRecord.aId, lpSession->aId, SESSION_ID_SIZE);
+    sRecord.llExpiresMs = lpSession->llExpiresMs;
+    ::MxMemCopy(p, &sRecord, sizeof(sRecord));
+    p += sizeof(sRecord);
+
+    if (nOp == JOURNAL_OP_SET || nOp == JOURNAL_OP_CLEAR)
+    {
+        *((WORD UNALIGNED *)p) = (WORD)nNameLen;
+        p += sizeof(WORD);
+        ::MxMemCopy(p, szNameA, nNameLen);
+        p += nNameLen;
+    }
+    if (nOp == JOURNAL_OP_SET)
+    {
+        switch (nType)
+        {
+            case CPropertyBag::eType::Null:
+                *p++ = JOURNAL_TYPE_NULL;
+                break;
+            case CPropertyBag::eType::DWord:
+                *p++ = JOURNAL_TYPE_DWORD;
+                break;
+            case CPropertyBag::eType::QWord:
+                *p++ = JOURNAL_TYPE_QWORD;
+                break;
+            case CPropertyBag::eType::Double:
+                *p++ = JOURNAL_TYPE_DOUBLE;
+                break;
+            case CPropertyBag::eType::AnsiString:
+                *p++ = JOURNAL_TYPE_ANSISTRING;
+                *((DWORD UNALIGNED *)p) = (DWORD)nValueLen;
+                p += sizeof(DWORD);
+                break;
+            case CPropertyBag::eType::WideString:
+                *p++ = JOURNAL_TYPE_WIDESTRING;
+                *((DWORD UNALIGNED *)p) = (DWORD)(nValueLen / sizeof(WCHAR));
+                p += sizeof(DWORD);
+                break;
+        }
+        if (szValueA != NULL)
+        {
+            ::MxMemCopy(p, szValueA, nValueLen);
+        }
+        else if (szValueW != NULL)
+        {
+            ::MxMemCopy(p, szValueW, nValueLen);
+        }
+        else if (nValueLen > 0)
+        {
+            ::MxMemCopy(p, &uValue, nValueLen);
+        }
+        p += nValueLen;
+    }
+    lpBuffer->nLen += nLen;
+
+    // done
+    return S_OK;
+}
+
+VOID CJsHttpServerSessionStore::JournalThreadProc()
+{
+    HANDLE hEvent;
+
+    hEvent = cJournalEvent.Get();
+    while (cJournalThread.CheckForAbort(JOURNAL_WRITE_INTERVAL_MS, 1, &hEvent) == FALSE)
+    {
+        WriteJournal();
+    }
+
+    // write whatever was queued before stopping
+    WriteJournal();
+    return;
+}
+
+VOID CJsHttpServerSessionStore::WriteJournal()
+{
+    BUFFER sTemp;
+    SIZE_T nLen;
+    DWORD dwWritten;
+    HRESULT hRes;
+
+    // swap buffers so savers are blocked only while the pointers are exchanged
+    {
+        CFastLock cLock(&nJournalMutex);
+
+        sTemp = sWriteBuffer;
+        sWriteBuffer = sJournalBuffer;
+        sJournalBuffer = sTemp;
+        sJournalBuffer.nLen = 0;
+    }
+
+    nLen = sWriteBuffer.nLen;
+    sWriteBuffer.nLen = 0;
+
+    // NOTE: After a failed write the file may end with a partial record and anything appended to it would be lost
+    //       on replay, so the queued changes are dropped until a snapshot of the sessions in memory, which already
+    //       contains them, replaces the file.
+    if (bJournalDamaged != FALSE)
+    {
+        if (SUCCEEDED(CompactJournal()))
+        {
+            bJournalDamaged = FALSE;
+        }
+    }
+    else if (nLen > 0)
+    {
+        hRes = (cJournalFile) ? S_OK : MX_E_NotReady;
+        dwWritten = 0;
+        if (SUCCEEDED(hRes) && ::WriteFile(cJournalFile.Get(), sWriteBuffer.lpData, (DWORD)nLen, &dwWritten,
+                                           NULL) == FALSE)
+        {
+            hRes = MX_HRESULT_FROM_LASTERROR();
+        }
+        if (SUCCEEDED(hRes) && (SIZE_T)dwWritten != nLen)
+        {
+            hRes = MX_E_WriteFault;
+        }
+        nJournalFileSize += (ULONGLONG)dwWritten;
+        _InterlockedExchangeAdd64(&nJournalWrittenBytes, (LONGLONG)dwWritten);
+        if (FAILED(hRes))
+        {
+            _InterlockedCompareExchange(&hrJournalError, (LONG)hRes, (LONG)S_OK);
+            _InterlockedIncrement64(&(sStats.nJournalWriteErrors));
+            bJournalDamaged = TRUE;
+        }
+        else if (nJournalFileSize >= nJournalCompactionSize && nJournalFileSize >= 2 * nJournalSnapshotSize)
+        {
+            // a failed compaction leaves the current journal intact and is retried after the next write
+            CompactJournal();
+        }
+    }
+
+    // count dropped changes too so FlushJournal does not wait forever
+    _InterlockedExchangeAdd64(&nJournalProcessedBytes, (LONGLONG)nLen);
+    return;
+}
+
+LONGLONG CJsHttpServerSessionStore::GetExpirationTimeMs(_In_ LONGLONG llNowMs) const
+{
+    return (llTimeToLiveMs != 0) ? (llNowMs + llTimeToLiveMs) : 0;
+}
+
+BOOL CJsHttpServerSessionStore::ParseSessionId(_In_z_ LPCSTR szSessionIdA, _Out_writes_(32) LPBYTE lpId)
+{
+    BYTE nNibble;
+
+    for (SIZE_T i = 0; i < SESSION_ID_SIZE * 2; i++)
+    {
+        if (szSessionIdA[i] >= '0' && szSessionIdA[i] <= '9')
+        {
+            nNibble = (BYTE)(szSessionIdA[i] - '0');
+        }
+        else if (szSessionIdA[i] >= 'A' && szSessionIdA[i] <= 'F')
+        {
+            nNibble = (BYTE)(szSessionIdA[i] - 'A' + 10);
+        }
+        else if (szSessionIdA[i] >= 'a' && szSessionIdA[i] <= 'f')
+        {
+            nNibble = (BYTE)(szSessionIdA[i] - 'a' + 10);
+        }
+        else
+        {
+            return FALSE;
+        }
+        if ((i & 1) == 0)
+        {
+            lpId[i >> 1] = (BYTE)(nNibble << 4);
+        }
+        else
+        {
+            lpId[i >> 1] |= nNibble;
+        }
+    }
+    return (szSessionIdA[SESSION_ID_SIZE * 2] == 0) ? TRUE : FALSE;
+}
+
+HRESULT CJsHttpServerSessionStore::CopyProperty(_Inout_ CPropertyBag &cDestBag, _In_ CPropertyBag &cSrcBag,
+                                                _In_z_ LPCSTR szNameA)
+{
+    DWORD dwValue;
+    ULONGLONG ullValue;
+    double nDblValue;
+    LPCSTR szValueA;
+    LPCWSTR szValueW;
+    HRESULT hRes;
+
+    switch (cSrcBag.GetType(szNameA))
+    {
+        case CPropertyBag::eType::Null:
+            return cDestBag.SetNull(szNameA);
+
+        case CPropertyBag::eType::DWord:
+            hRes = cSrcBag.GetDWord(szNameA, dwValue);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cDestBag.SetDWord(szNameA, dwValue);
+            }
+            return hRes;
+
+        case CPropertyBag::eType::QWord:
+            hRes = cSrcBag.GetQWord(szNameA, ullValue);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cDestBag.SetQWord(szNameA, ullValue);
+            }
+            return hRes;
+
+        case CPropertyBag::eType::Double:
+            hRes = cSrcBag.GetDouble(szNameA, nDblValue);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cDestBag.SetDouble(szNameA, nDblValue);
+            }
+            return hRes;
+
+        case CPropertyBag::eType::AnsiString:
+            hRes = cSrcBag.GetString(szNameA, szValueA);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cDestBag.SetString(szNameA, szValueA);
+            }
+            return hRes;
+
+        case CPropertyBag::eType::WideString:
+            hRes = cSrcBag.GetString(szNameA, szValueW);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cDestBag.SetString(szNameA, szValueW);
+            }
+            return hRes;
+    }
+
+    // property was deleted
+    hRes = cDestBag.Clear(szNameA);
+    return (hRes != MX_E_NotFound) ? hRes : S_OK;
+}
+
+BOOL CJsHttpServerSessionStore::GrowBuffer(_Inout_ LPBUFFER lpBuffer, _In_ SIZE_T nExtraLen)
+{
+    LPBYTE lpNewData;
+    SIZE_T nNewSize;
+
+    if (lpBuffer->nLen + nExtraLen <= lpBuffer->nSize)
+    {
+        return TRUE;
+    }
+    nNewSize = (lpBuffer->nSize > 0) ? (lpBuffer->nSize << 1) : 4096;
+    while (nNewSize < lpBuffer->nLen + nExtraLen)
+    {
+        nNewSize <<= 1;
+    }
+    lpNewData = (LPBYTE)MX_REALLOC(lpBuffer->lpData, nNewSize);
+    if (lpNewData == NULL)
+    {
+        return FALSE;
+    }
+    lpBuffer->lpData = lpNewData;
+    lpBuffer->nSize = nNewSize;
+    return TRUE;
+}
+
+LONGLONG CJsHttpServerSessionStore::GetTimeMs()
+{
+    ULARGE_INTEGER uliSysTime;
+
+    // wall clock time so expiration times in the journal survive restarts
+    ::MxNtQuerySystemTime(&uliSysTime);
+    return (LONGLONG)(uliSysTime.QuadPart / 10000ui64);
+}
+
+} // namespace MX
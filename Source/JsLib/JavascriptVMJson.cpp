@@ -0,0 +1,1212 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "JavascriptVMCommon.h"
+#include "..\..\Include\RapidJSON\rapidjson-all.h"
+#include <math.h>
+
+ //-----------------------------------------------------------
+
+#define JSON_MAX_DEPTH 1000
+#define JSON_MAX_INDENT 10
+
+#define JSON_INITIAL_BUFFER_SIZE 4096
+#define JSON_STREAM_CHUNK_SIZE 16384
+
+#define JSON_CHAR_Copy 0
+#define JSON_CHAR_Escape 1
+#define JSON_CHAR_Special 2
+
+//-----------------------------------------------------------
+
+static const CHAR szHexaNumA[] = "0123456789abcdef";
+
+static const BYTE aJsonCharClass[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x00
+    0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, // 0x40
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x60
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x80
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xA0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xC0
+    0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0  // 0xE0
+};
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+namespace Internals {
+
+namespace JsLib {
+
+// NOTE: Values are written into a growable buffer. When an output callback is set, the buffer has a fixed size and
+//       is handed to the callback each time it fills up so large documents are never fully kept in memory.
+class CJsonEncoder : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CJsonEncoder(_In_ DukTape::duk_context *lpCtx, _In_opt_z_ LPCSTR szIndentA);
+    ~CJsonEncoder();
+
+    VOID SetOutputCallback(_In_ CJavascriptVM::OnJsonOutputCallback cOutputCallback, _In_opt_ LPVOID lpUserParam);
+
+    BOOL Encode(_In_ DukTape::duk_idx_t nObjIdx);
+
+    VOID Flush();
+
+    LPSTR GetBuffer() const
+    {
+        return szBufA;
+    };
+
+    SIZE_T GetLength() const
+    {
+        return nBufLen;
+    };
+
+    LPSTR Detach();
+
+private:
+    DukTape::duk_idx_t ResolveValue(_In_ DukTape::duk_idx_t nIdx, _In_ DukTape::duk_idx_t nKeyIdx,
+                                    _In_ DukTape::duk_uarridx_t nArrayIndex);
+    BOOL CanEncode(_In_ DukTape::duk_idx_t nIdx);
+
+    VOID EncodeValue(_In_ DukTape::duk_idx_t nIdx);
+    VOID EncodeArray(_In_ DukTape::duk_idx_t nIdx);
+    VOID EncodeObject(_In_ DukTape::duk_idx_t nIdx);
+    VOID EncodeNumber(_In_ double nValue);
+    VOID EncodeString(_In_ LPCSTR szStrA, _In_ SIZE_T nLen);
+
+    VOID EnterContainer(_In_ DukTape::duk_idx_t nIdx);
+    VOID LeaveContainer();
+    VOID WriteNewLine();
+
+    __inline VOID Write(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen)
+    {
+        if (nDataLen > nBufSize - nBufLen)
+        {
+            WriteSlow(szDataA, nDataLen);
+        }
+        else
+        {
+            ::MxMemCopy(szBufA + nBufLen, szDataA, nDataLen);
+            nBufLen += nDataLen;
+        }
+        return;
+    };
+
+    __inline VOID WriteChar(_In_ CHAR chA)
+    {
+        if (nBufLen == nBufSize)
+        {
+            Reserve(1);
+        }
+        szBufA[nBufLen++] = chA;
+        return;
+    };
+
+    VOID WriteSlow(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen);
+    LPSTR Reserve(_In_ SIZE_T nBytes);
+
+private:
+    DukTape::duk_context *lpCtx;
+    LPSTR szBufA{ NULL };
+    SIZE_T nBufLen{ 0 }, nBufSize{ 0 };
+    CJavascriptVM::OnJsonOutputCallback cOutputCallback;
+    LPVOID lpUserParam{ NULL };
+    CHAR szIndentA[JSON_MAX_INDENT + 1]{};
+    SIZE_T nIndentLen{ 0 };
+    TArrayList<LPVOID> aContainersList;
+};
+
+//-----------------------------------------------------------
+
+// NOTE: RapidJSON SAX handler that builds the values straight onto the Duktape value stack. While an object or an
+//       array is being parsed, the container sits on the stack (followed by the current key, for objects) and each
+//       completed value is stored into it.
+class CJsonDecoderHandler : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CJsonDecoderHandler(_In_ DukTape::duk_context *lpCtx) : CBaseMemObj(), CNonCopyableObj()
+    {
+        this->lpCtx = lpCtx;
+        return;
+    };
+
+    bool Null()
+    {
+        DukTape::duk_push_null(lpCtx);
+        return StoreValue();
+    };
+
+    bool Bool(bool b)
+    {
+        DukTape::duk_push_boolean(lpCtx, (b != false) ? 1 : 0);
+        return StoreValue();
+    };
+
+    bool Int(int i)
+    {
+        DukTape::duk_push_int(lpCtx, (DukTape::duk_int_t)i);
+        return StoreValue();
+    };
+
+    bool Uint(unsigned u)
+    {
+        DukTape::duk_push_uint(lpCtx, (DukTape::duk_uint_t)u);
+        return StoreValue();
+    };
+
+    bool Int64(int64_t i)
+    {
+        DukTape::duk_push_number(lpCtx, (DukTape::duk_double_t)i);
+        return StoreValue();
+    };
+
+    bool Uint64(uint64_t u)
+    {
+        DukTape::duk_push_number(lpCtx, (DukTape::duk_double_t)u);
+        return StoreValue();
+    };
+
+    bool Double(double d)
+    {
+        DukTape::duk_push_number(lpCtx, (DukTape::duk_double_t)d);
+        return StoreValue();
+    };
+
+    bool RawNumber(const char *str, rapidjson::SizeType length, bool copy)
+    {
+        return false;
+    };
+
+    bool String(const char *str, rapidjson::SizeType length, bool copy)
+    {
+        PushString(str, (SIZE_T)length);
+        return StoreValue();
+    };
+
+    bool Key(const char *str, rapidjson::SizeType length, bool copy)
+    {
+        PushString(str, (SIZE_T)length);
+        return true;
+    };
+
+    bool StartObject()
+    {
+        EnterContainer(FALSE);
+        DukTape::duk_push_object(lpCtx);
+        return true;
+    };
+
+    bool EndObject(rapidjson::SizeType memberCount)
+    {
+        aLevelsList.RemoveElementAt(aLevelsList.GetCount() - 1);
+        return StoreValue();
+    };
+
+    bool StartArray()
+    {
+        EnterContainer(TRUE);
+        DukTape::duk_push_array(lpCtx);
+        return true;
+    };
+
+    bool EndArray(rapidjson::SizeType elementCount)
+    {
+        aLevelsList.RemoveElementAt(aLevelsList.GetCount() - 1);
+        return StoreValue();
+    };
+
+private:
+    VOID EnterContainer(_In_ BOOL bIsArray);
+    bool StoreValue();
+    VOID PushString(_In_ LPCSTR szStrA, _In_ SIZE_T nLen);
+
+private:
+    DukTape::duk_context *lpCtx;
+    TArrayList<DukTape::duk_uarridx_t> aLevelsList; // next index for arrays, (duk_uarridx_t)-1 for objects
+    CStringA cStrTempA;
+};
+
+} // namespace JsLib
+
+} // namespace Internals
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+BOOL CJavascriptVM::EncodeJson(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nObjIdx, _Inout_ CStringA &cStrJsonA,
+                               _In_opt_ BOOL bAppend, _In_opt_z_ LPCSTR szIndentA)
+{
+    Internals::JsLib::CJsonEncoder cEncoder(lpCtx, szIndentA);
+    LPSTR szBufA;
+
+    if (bAppend == FALSE)
+    {
+        cStrJsonA.Empty();
+    }
+    if (cEncoder.Encode(nObjIdx) == FALSE)
+    {
+        return FALSE;
+    }
+
+    if (cStrJsonA.IsEmpty() != FALSE)
+    {
+        szBufA = cEncoder.Detach();
+        if (szBufA == NULL)
+        {
+            MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+        }
+        cStrJsonA.Attach(szBufA);
+    }
+    else
+    {
+        if (cStrJsonA.ConcatN(cEncoder.GetBuffer(), cEncoder.GetLength()) == FALSE)
+        {
+            MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+        }
+    }
+    return TRUE;
+}
+
+BOOL CJavascriptVM::EncodeJson(_In_ DukTape::duk_idx_t nObjIdx, _Inout_ CStringA &cStrJsonA, _In_opt_ BOOL bAppend,
+                               _In_opt_z_ LPCSTR szIndentA)
+{
+    return EncodeJson(lpCtx, nObjIdx, cStrJsonA, bAppend, szIndentA);
+}
+
+BOOL CJavascriptVM::EncodeJson(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nObjIdx,
+                               _In_ OnJsonOutputCallback cOutputCallback, _In_opt_ LPVOID lpUserParam, _In_opt_z_ LPCSTR szIndentA)
+{
+    Internals::JsLib::CJsonEncoder cEncoder(lpCtx, szIndentA);
+
+    if (!cOutputCallback)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_POINTER);
+    }
+    cEncoder.SetOutputCallback(cOutputCallback, lpUserParam);
+    if (cEncoder.Encode(nObjIdx) == FALSE)
+    {
+        return FALSE;
+    }
+    cEncoder.Flush();
+    return TRUE;
+}
+
+BOOL CJavascriptVM::EncodeJson(_In_ DukTape::duk_idx_t nObjIdx, _In_ OnJsonOutputCallback cOutputCallback,
+                               _In_opt_ LPVOID lpUserParam, _In_opt_z_ LPCSTR szIndentA)
+{
+    return EncodeJson(lpCtx, nObjIdx, cOutputCallback, lpUserParam, szIndentA);
+}
+
+VOID CJavascriptVM::DecodeJson(_In_ DukTape::duk_context *lpCtx, _In_reads_(nJsonLen) LPCSTR szJsonA, _In_ SIZE_T nJsonLen)
+{
+    Internals::JsLib::CJsonDecoderHandler cHandler(lpCtx);
+    rapidjson::Reader cReader;
+    rapidjson::MemoryStream cStream(szJsonA, nJsonLen);
+    rapidjson::ParseResult cResult;
+    DukTape::duk_idx_t nTop;
+
+    if (szJsonA == NULL && nJsonLen > 0)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_POINTER);
+    }
+
+    nTop = DukTape::duk_get_top(lpCtx);
+    cResult = cReader.Parse<rapidjson::kParseIterativeFlag | rapidjson::kParseFullPrecisionFlag>(cStream, cHandler);
+    if (cResult.IsError() != false)
+    {
+        DukTape::duk_set_top(lpCtx, nTop);
+        MX_JS_THROW_ERROR(lpCtx, DUK_ERR_SYNTAX_ERROR, "invalid json (offset %Iu)", cResult.Offset());
+    }
+    return;
+}
+
+VOID CJavascriptVM::DecodeJson(_In_reads_(nJsonLen) LPCSTR szJsonA, _In_ SIZE_T nJsonLen)
+{
+    DecodeJson(lpCtx, szJsonA, nJsonLen);
+    return;
+}
+
+HRESULT CJavascriptVM::AddNativeJsonSupport(_In_ DukTape::duk_context *lpCtx)
+{
+    return RunNativeProtectedAndGetError(lpCtx, 0, 0, [](_In_ DukTape::duk_context *lpCtx) -> VOID
+    {
+        DukTape::duk_push_global_object(lpCtx);
+        if (DukTape::duk_has_prop_string(lpCtx, -1, "NativeJSON") == 0)
+        {
+            DukTape::duk_push_object(lpCtx);
+
+            DukTape::duk_push_c_function(lpCtx, &CJavascriptVM::OnNativeJsonStringify, MX_JS_VARARGS);
+            DukTape::duk_put_prop_string(lpCtx, -2, "stringify");
+
+            DukTape::duk_push_c_function(lpCtx, &CJavascriptVM::OnNativeJsonParse, MX_JS_VARARGS);
+            DukTape::duk_put_prop_string(lpCtx, -2, "parse");
+
+            DukTape::duk_put_prop_string(lpCtx, -2, "NativeJSON");
+        }
+        DukTape::duk_pop(lpCtx); // pop global object
+        return;
+    });
+}
+
+HRESULT CJavascriptVM::AddNativeJsonSupport()
+{
+    return AddNativeJsonSupport(lpCtx);
+}
+
+DukTape::duk_ret_t CJavascriptVM::OnNativeJsonStringify(_In_ DukTape::duk_context *lpCtx)
+{
+    DukTape::duk_idx_t nArgsCount;
+    CHAR szIndentA[JSON_MAX_INDENT + 1];
+    CStringA cStrJsonA;
+
+    nArgsCount = DukTape::duk_get_top(lpCtx);
+    if (nArgsCount == 0)
+    {
+        return 0; // undefined
+    }
+
+    // replacers are left to the built-in implementation
+    if (nArgsCount > 1 &&
+        (DukTape::duk_get_type_mask(lpCtx, 1) & (DUK_TYPE_MASK_NULL | DUK_TYPE_MASK_UNDEFINED)) == 0)
+    {
+        DukTape::duk_idx_t i;
+
+        DukTape::duk_get_global_string(lpCtx, "JSON");
+        DukTape::duk_get_prop_string(lpCtx, -1, "stringify");
+        DukTape::duk_swap_top(lpCtx, -2);
+        for (i = 0; i < nArgsCount; i++)
+        {
+            DukTape::duk_dup(lpCtx, i);
+        }
+        DukTape::duk_call_method(lpCtx, nArgsCount);
+        return 1;
+    }
+
+    // indentation
+    szIndentA[0] = 0;
+    if (nArgsCount > 2)
+    {
+        if (DukTape::duk_is_number(lpCtx, 2) != 0)
+        {
+            DukTape::duk_double_t nSpaces = DukTape::duk_get_number(lpCtx, 2);
+            int i, nCount;
+
+            nCount = (nSpaces >= (DukTape::duk_double_t)JSON_MAX_INDENT) ? JSON_MAX_INDENT
+                                                                        : ((nSpaces >= 1.0) ? (int)nSpaces : 0);
+            for (i = 0; i < nCount; i++)
+            {
+                szIndentA[i] = ' ';
+            }
+            szIndentA[nCount] = 0;
+        }
+        else if (DukTape::duk_is_string(lpCtx, 2) != 0)
+        {
+            DukTape::duk_size_t nLen;
+            LPCSTR sA;
+            SIZE_T i;
+
+            // NOTE: Only the first ten bytes are used. Multibyte indents are very unusual.
+            sA = DukTape::duk_get_lstring(lpCtx, 2, &nLen);
+            for (i = 0; i < (SIZE_T)nLen && i < JSON_MAX_INDENT; i++)
+            {
+                szIndentA[i] = sA[i];
+            }
+            szIndentA[i] = 0;
+        }
+    }
+
+    if (EncodeJson(lpCtx, 0, cStrJsonA, FALSE, szIndentA) == FALSE)
+    {
+        return 0; // undefined
+    }
+    DukTape::duk_push_lstring(lpCtx, (LPCSTR)cStrJsonA, cStrJsonA.GetLength());
+    return 1;
+}
+
+DukTape::duk_ret_t CJavascriptVM::OnNativeJsonParse(_In_ DukTape::duk_context *lpCtx)
+{
+    DukTape::duk_idx_t nArgsCount;
+    DukTape::duk_size_t nLen;
+    LPCSTR szJsonA;
+
+    nArgsCount = DukTape::duk_get_top(lpCtx);
+
+    // revivers are left to the built-in implementation
+    if (nArgsCount > 1 && DukTape::duk_is_callable(lpCtx, 1) != 0)
+    {
+        DukTape::duk_idx_t i;
+
+        DukTape::duk_get_global_string(lpCtx, "JSON");
+        DukTape::duk_get_prop_string(lpCtx, -1, "parse");
+        DukTape::duk_swap_top(lpCtx, -2);
+        for (i = 0; i < nArgsCount; i++)
+        {
+            DukTape::duk_dup(lpCtx, i);
+        }
+        DukTape::duk_call_method(lpCtx, nArgsCount);
+        return 1;
+    }
+
+    if (nArgsCount == 0)
+    {
+        DukTape::duk_push_undefined(lpCtx);
+    }
+    szJsonA = DukTape::duk_to_lstring(lpCtx, 0, &nLen);
+    DecodeJson(lpCtx, szJsonA, (SIZE_T)nLen);
+    return 1;
+}
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+namespace Internals {
+
+namespace JsLib {
+
+CJsonEncoder::CJsonEncoder(_In_ DukTape::duk_context *lpCtx, _In_opt_z_ LPCSTR _szIndentA) : CBaseMemObj(), CNonCopyableObj()
+{
+    this->lpCtx = lpCtx;
+    if (_szIndentA != NULL)
+    {
+        while (nIndentLen < JSON_MAX_INDENT && _szIndentA[nIndentLen] != 0)
+        {
+            szIndentA[nIndentLen] = _szIndentA[nIndentLen];
+            nIndentLen++;
+        }
+    }
+    return;
+}
+
+CJsonEncoder::~CJsonEncoder()
+{
+    MX_FREE(szBufA);
+    return;
+}
+
+VOID CJsonEncoder::SetOutputCallback(_In_ CJavascriptVM::OnJsonOutputCallback _cOutputCallback, _In_opt_ LPVOID _lpUserParam)
+{
+    cOutputCallback = _cOutputCallback;
+    lpUserParam = _lpUserParam;
+    return;
+}
+
+BOOL CJsonEncoder::Encode(_In_ DukTape::duk_idx_t nObjIdx)
+{
+    DukTape::duk_idx_t nTop, nIdx;
+
+    nObjIdx = DukTape::duk_require_normalize_index(lpCtx, nObjIdx);
+    nTop = DukTape::duk_get_top(lpCtx);
+
+    nIdx = ResolveValue(nObjIdx, DUK_INVALID_INDEX, 0);
+    if (CanEncode(nIdx) == FALSE)
+    {
+        DukTape::duk_set_top(lpCtx, nTop);
+        return FALSE;
+    }
+    EncodeValue(nIdx);
+    DukTape::duk_set_top(lpCtx, nTop);
+
+    // keep the output null-terminated so it can be attached to a string
+    if (!cOutputCallback)
+    {
+        Reserve(1);
+        szBufA[nBufLen] = 0;
+    }
+    return TRUE;
+}
+
+VOID CJsonEncoder::Flush()
+{
+    HRESULT hRes;
+
+    if (nBufLen > 0 && cOutputCallback)
+    {
+        hRes = cOutputCallback(szBufA, nBufLen, lpUserParam);
+        nBufLen = 0;
+        if (FAILED(hRes))
+        {
+            MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
+        }
+    }
+    return;
+}
+
+LPSTR CJsonEncoder::Detach()
+{
+    LPSTR szRetA;
+
+    szRetA = szBufA;
+    szBufA = NULL;
+    nBufLen = nBufSize = 0;
+    return szRetA;
+}
+
+// NOTE: Applies toJSON() and unboxes Number, String and Boolean objects. If the value is replaced, the new one is
+//       left on top of the stack and its index is returned.
+DukTape::duk_idx_t CJsonEncoder::ResolveValue(_In_ DukTape::duk_idx_t nIdx, _In_ DukTape::duk_idx_t nKeyIdx,
+                                              _In_ DukTape::duk_uarridx_t nArrayIndex)
+{
+    if (DukTape::duk_is_object(lpCtx, nIdx) == 0 || DukTape::duk_is_callable(lpCtx, nIdx) != 0)
+    {
+        return nIdx;
+    }
+
+    DukTape::duk_get_prop_string(lpCtx, nIdx, "toJSON");
+    if (DukTape::duk_is_callable(lpCtx, -1) != 0)
+    {
+        DukTape::duk_dup(lpCtx, nIdx);
+        if (nKeyIdx != DUK_INVALID_INDEX)
+        {
+            DukTape::duk_dup(lpCtx, nKeyIdx);
+        }
+        else if (aContainersList.GetCount() > 0)
+        {
+            DukTape::duk_push_uint(lpCtx, (DukTape::duk_uint_t)nArrayIndex);
+            DukTape::duk_to_string(lpCtx, -1);
+        }
+        else
+        {
+            DukTape::duk_push_string(lpCtx, "");
+        }
+        DukTape::duk_call_method(lpCtx, 1);
+        return DukTape::duk_get_top_index(lpCtx);
+    }
+    DukTape::duk_pop(lpCtx);
+
+    if (DukTape::duk_is_array(lpCtx, nIdx) == 0)
+    {
+        // NOTE: Boxed primitives keep their value in an internal property. Dates also do but they were already
+        //       converted by their toJSON method.
+        DukTape::duk_get_prop_string(lpCtx, nIdx, DUK_INTERNAL_SYMBOL("Value"));
+        if (DukTape::duk_check_type_mask(lpCtx, -1, DUK_TYPE_MASK_NUMBER | DUK_TYPE_MASK_STRING | DUK_TYPE_MASK_BOOLEAN) != 0)
+        {
+            return DukTape::duk_get_top_index(lpCtx);
+        }
+        DukTape::duk_pop(lpCtx);
+    }
+    return nIdx;
+}
+
+BOOL CJsonEncoder::CanEncode(_In_ DukTape::duk_idx_t nIdx)
+{
+    switch (DukTape::duk_get_type(lpCtx, nIdx))
+    {
+        case DUK_TYPE_NULL:
+        case DUK_TYPE_BOOLEAN:
+        case DUK_TYPE_NUMBER:
+        case DUK_TYPE_BUFFER:
+            return TRUE;
+
+        case DUK_TYPE_STRING:
+            return (DukTape::duk_is_symbol(lpCtx, nIdx) == 0) ? TRUE : FALSE;
+
+        case DUK_TYPE_OBJECT:
+            return (DukTape::duk_is_callable(lpCtx, nIdx) == 0) ? TRUE : FALSE;
+    }
+    return FALSE;
+}
+
+VOID CJsonEncoder::EncodeValue(_In_ DukTape::duk_idx_t nIdx)
+{
+    DukTape::duk_size_t nLen;
+    LPCSTR sA;
+
+    switch (DukTape::duk_get_type(lpCtx, nIdx))
+    {
+        case DUK_TYPE_NULL:
+            Write("null", 4);
+            break;
+
+        case DUK_TYPE_BOOLEAN:
+            if (DukTape::duk_get_boolean(lpCtx, nIdx) != 0)
+            {
+                Write("true", 4);
+            }
+            else
+            {
+                Write("false", 5);
+            }
+            break;
+
+        case DUK_TYPE_NUMBER:
+            EncodeNumber((double)DukTape::duk_get_number(lpCtx, nIdx));
+            break;
+
+        case DUK_TYPE_STRING:
+            sA = DukTape::duk_get_lstring(lpCtx, nIdx, &nLen);
+            EncodeString(sA, (SIZE_T)nLen);
+            break;
+
+        default:
+            if (DukTape::duk_is_array(lpCtx, nIdx) != 0)
+            {
+                EncodeArray(nIdx);
+            }
+            else
+            {
+                EncodeObject(nIdx);
+            }
+            break;
+    }
+    return;
+}
+
+VOID CJsonEncoder::EncodeArray(_In_ DukTape::duk_idx_t nIdx)
+{
+    DukTape::duk_size_t i, nCount;
+    DukTape::duk_idx_t nTop, nValueIdx;
+
+    EnterContainer(nIdx);
+
+    WriteChar('[');
+    nCount = DukTape::duk_get_length(lpCtx, nIdx);
+    nTop = DukTape::duk_get_top(lpCtx);
+    for (i = 0; i < nCount; i++)
+    {
+        if (i > 0)
+        {
+            WriteChar(',');
+        }
+        WriteNewLine();
+
+        DukTape::duk_get_prop_index(lpCtx, nIdx, (DukTape::duk_uarridx_t)i);
+        nValueIdx = ResolveValue(nTop, DUK_INVALID_INDEX, (DukTape::duk_uarridx_t)i);
+        if (CanEncode(nValueIdx) != FALSE)
+        {
+            EncodeValue(nValueIdx);
+        }
+        else
+        {
+            Write("null", 4);
+        }
+        DukTape::duk_set_top(lpCtx, nTop);
+    }
+
+    LeaveContainer();
+    if (nCount > 0)
+    {
+        WriteNewLine();
+    }
+    WriteChar(']');
+    return;
+}
+
+VOID CJsonEncoder::EncodeObject(_In_ DukTape::duk_idx_t nIdx)
+{
+    DukTape::duk_idx_t nTop, nValueIdx;
+    DukTape::duk_size_t nLen;
+    BOOL bFirst = TRUE;
+    LPCSTR sA;
+
+    EnterContainer(nIdx);
+
+    WriteChar('{');
+    DukTape::duk_enum(lpCtx, nIdx, DUK_ENUM_OWN_PROPERTIES_ONLY);
+    nTop = DukTape::duk_get_top(lpCtx);
+    while (DukTape::duk_next(lpCtx, nTop - 1, 1) != 0)
+    {
+        // key at nTop, value at nTop + 1
+        nValueIdx = ResolveValue(nTop + 1, nTop, 0);
+        if (CanEncode(nValueIdx) != FALSE)
+        {
+            if (bFirst == FALSE)
+            {
+                WriteChar(',');
+            }
+            WriteNewLine();
+            bFirst = FALSE;
+
+            sA = DukTape::duk_get_lstring(lpCtx, nTop, &nLen);
+            EncodeString(sA, (SIZE_T)nLen);
+            if (nIndentLen > 0)
+            {
+                Write(": ", 2);
+            }
+            else
+            {
+                WriteChar(':');
+            }
+            EncodeValue(nValueIdx);
+        }
+        DukTape::duk_set_top(lpCtx, nTop);
+    }
+    DukTape::duk_pop(lpCtx); // pop enumerator
+
+    LeaveContainer();
+    if (bFirst == FALSE)
+    {
+        WriteNewLine();
+    }
+    WriteChar('}');
+    return;
+}
+
+VOID CJsonEncoder::EncodeNumber(_In_ double nValue)
+{
+    LPSTR sA, szEndA, p;
+
+    if (_finite(nValue) == 0)
+    {
+        Write("null", 4);
+        return;
+    }
+
+    sA = Reserve(32);
+    if (nValue == floor(nValue) && nValue > -9007199254740992.0 && nValue < 9007199254740992.0)
+    {
+        ULONGLONG nAbsValue;
+        CHAR szTempA[24];
+        int nDigits;
+
+        // integers (including negative zero, which is written as 0 like JSON.stringify does)
+        szEndA = sA;
+        if (nValue < 0.0)
+        {
+            *szEndA++ = '-';
+            nAbsValue = (ULONGLONG)(-nValue);
+        }
+        else
+        {
+            nAbsValue = (ULONGLONG)nValue;
+        }
+        nDigits = 0;
+        do
+        {
+            szTempA[nDigits++] = '0' + (CHAR)(nAbsValue % 10);
+            nAbsValue /= 10;
+        }
+        while (nAbsValue > 0);
+        while (nDigits > 0)
+        {
+            *szEndA++ = szTempA[--nDigits];
+        }
+    }
+    else
+    {
+        // shortest representation that round trips, formatted like javascript does (no trailing '.0' on big
+        // integers and an explicit sign on positive exponents)
+        szEndA = rapidjson::internal::dtoa(nValue, sA);
+        if (szEndA - sA > 2 && szEndA[-2] == '.' && szEndA[-1] == '0')
+        {
+            szEndA -= 2;
+        }
+        for (p = sA; p < szEndA; p++)
+        {
+            if (*p == 'e')
+            {
+                if (p[1] != '-')
+                {
+                    ::MxMemMove(p + 2, p + 1, (SIZE_T)(szEndA - (p + 1)));
+                    p[1] = '+';
+                    szEndA++;
+                }
+                break;
+            }
+        }
+    }
+    nBufLen += (SIZE_T)(szEndA - sA);
+    return;
+}
+
+VOID CJsonEncoder::EncodeString(_In_ LPCSTR szStrA, _In_ SIZE_T nLen)
+{
+    const BYTE *p = (const BYTE *)szStrA;
+    const BYTE *pEnd = p + nLen;
+    const BYTE *pStart;
+    LPSTR sA;
+
+    WriteChar('"');
+    while (p < pEnd)
+    {
+        pStart = p;
+        while (p < pEnd && aJsonCharClass[*p] == JSON_CHAR_Copy)
+        {
+            p++;
+        }
+        if (p > pStart)
+        {
+            Write((LPCSTR)pStart, (SIZE_T)(p - pStart));
+        }
+        if (p >= pEnd)
+        {
+            break;
+        }
+
+        if (aJsonCharClass[*p] == JSON_CHAR_Escape)
+        {
+            sA = Reserve(6);
+            sA[0] = '\\';
+            switch (*p)
+            {
+                case '"':
+                    sA[1] = '"';
+                    nBufLen += 2;
+                    break;
+                case '\\':
+                    sA[1] = '\\';
+                    nBufLen += 2;
+                    break;
+                case '\b':
+                    sA[1] = 'b';
+                    nBufLen += 2;
+                    break;
+                case '\f':
+                    sA[1] = 'f';
+                    nBufLen += 2;
+                    break;
+                case '\n':
+                    sA[1] = 'n';
+                    nBufLen += 2;
+                    break;
+                case '\r':
+                    sA[1] = 'r';
+                    nBufLen += 2;
+                    break;
+                case '\t':
+                    sA[1] = 't';
+                    nBufLen += 2;
+                    break;
+                default:
+                    sA[1] = 'u';
+                    sA[2] = '0';
+                    sA[3] = '0';
+                    sA[4] = szHexaNumA[(*p) >> 4];
+                    sA[5] = szHexaNumA[(*p) & 0x0F];
+                    nBufLen += 6;
+                    break;
+            }
+            p++;
+            continue;
+        }
+
+        // NOTE: U+2028 and U+2029 are escaped like the built-in encoder does so the output can be embedded in scripts.
+        if (*p == 0xE2)
+        {
+            if (pEnd - p >= 3 && p[1] == 0x80 && (p[2] == 0xA8 || p[2] == 0xA9))
+            {
+                sA = Reserve(6);
+                sA[0] = '\\';
+                sA[1] = 'u';
+                sA[2] = '2';
+                sA[3] = '0';
+                sA[4] = '2';
+                sA[5] = (p[2] == 0xA8) ? '8' : '9';
+                nBufLen += 6;
+                p += 3;
+            }
+            else
+            {
+                WriteChar((CHAR)*p);
+                p++;
+            }
+            continue;
+        }
+
+        // NOTE: Duktape stores non-BMP characters as CESU-8 surrogate pairs. Pairs are joined back into a four-byte
+        //       UTF-8 sequence and lone surrogates are escaped.
+        if (pEnd - p >= 3 && p[1] >= 0xA0 && p[1] <= 0xBF && (p[2] & 0xC0) == 0x80)
+        {
+            ULONG nHigh, nLow, nCodePoint;
+
+            nHigh = 0xD000 | ((ULONG)(p[1] & 0x3F) << 6) | (ULONG)(p[2] & 0x3F);
+            if (nHigh <= 0xDBFF && pEnd - p >= 6 && p[3] == 0xED && p[4] >= 0xB0 && p[4] <= 0xBF && (p[5] & 0xC0) == 0x80)
+            {
+                nLow = 0xD000 | ((ULONG)(p[4] & 0x3F) << 6) | (ULONG)(p[5] & 0x3F);
+                nCodePoint = 0x10000 + ((nHigh - 0xD800) << 10) + (nLow - 0xDC00);
+
+                sA = Reserve(4);
+                sA[0] = (CHAR)(0xF0 | (nCodePoint >> 18));
+                sA[1] = (CHAR)(0x80 | ((nCodePoint >> 12) & 0x3F));
+                sA[2] = (CHAR)(0x80 | ((nCodePoint >> 6) & 0x3F));
+                sA[3] = (CHAR)(0x80 | (nCodePoint & 0x3F));
+                nBufLen += 4;
+                p += 6;
+            }
+            else
+            {
+                sA = Reserve(6);
+                sA[0] = '\\';
+                sA[1] = 'u';
+                sA[2] = szHexaNumA[(nHigh >> 12) & 0x0F];
+                sA[3] = szHexaNumA[(nHigh >> 8) & 0x0F];
+                sA[4] = szHexaNumA[(nHigh >> 4) & 0x0F];
+                sA[5] = szHexaNumA[nHigh & 0x0F];
+                nBufLen += 6;
+                p += 3;
+            }
+        }
+        else
+        {
+            WriteChar((CHAR)*p);
+            p++;
+        }
+    }
+    WriteChar('"');
+    return;
+}
+
+VOID CJsonEncoder::EnterContainer(_In_ DukTape::duk_idx_t nIdx)
+{
+    LPVOID lpPtr;
+    SIZE_T i, nCount;
+
+    lpPtr = DukTape::duk_get_heapptr(lpCtx, nIdx);
+    nCount = aContainersList.GetCount();
+    if (nCount >= JSON_MAX_DEPTH)
+    {
+        MX_JS_THROW_ERROR(lpCtx, DUK_ERR_RANGE_ERROR, "json encode recursion limit");
+    }
+    for (i = 0; i < nCount; i++)
+    {
+        if (aContainersList.GetElementAt(i) == lpPtr)
+        {
+            MX_JS_THROW_ERROR(lpCtx, DUK_ERR_TYPE_ERROR, "cyclic input");
+        }
+    }
+    if (aContainersList.AddElement(lpPtr) == FALSE)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+    }
+    DukTape::duk_require_stack(lpCtx, 8);
+    return;
+}
+
+VOID CJsonEncoder::LeaveContainer()
+{
+    aContainersList.RemoveElementAt(aContainersList.GetCount() - 1);
+    return;
+}
+
+VOID CJsonEncoder::WriteNewLine()
+{
+    SIZE_T nLevel;
+
+    if (nIndentLen > 0)
+    {
+        WriteChar('\n');
+        for (nLevel = aContainersList.GetCount(); nLevel > 0; nLevel--)
+        {
+            Write(szIndentA, nIndentLen);
+        }
+    }
+    return;
+}
+
+VOID CJsonEncoder::WriteSlow(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen)
+{
+    SIZE_T nToCopy;
+
+    if (cOutputCallback)
+    {
+        while (nDataLen > 0)
+        {
+            if (nBufLen == nBufSize)
+            {
+                Reserve(1);
+            }
+            nToCopy = nBufSize - nBufLen;
+            if (nToCopy > nDataLen)
+            {
+                nToCopy = nDataLen;
+            }
+            ::MxMemCopy(szBufA + nBufLen, szDataA, nToCopy);
+            nBufLen += nToCopy;
+            szDataA += nToCopy;
+            nDataLen -= nToCopy;
+        }
+    }
+    else
+    {
+        ::MxMemCopy(Reserve(nDataLen), szDataA, nDataLen);
+        nBufLen += nDataLen;
+    }
+    return;
+}
+
+// NOTE: Ensures at least 'nBytes' are available after the current position (at most JSON_STREAM_CHUNK_SIZE when
+//       streaming) and returns a pointer to them. The caller advances 'nBufLen'.
+LPSTR CJsonEncoder::Reserve(_In_ SIZE_T nBytes)
+{
+    if (nBytes > nBufSize - nBufLen)
+    {
+        if (cOutputCallback)
+        {
+            MX_ASSERT(nBytes <= JSON_STREAM_CHUNK_SIZE);
+
+            if (szBufA == NULL)
+            {
+                szBufA = (LPSTR)MX_MALLOC(JSON_STREAM_CHUNK_SIZE);
+                if (szBufA == NULL)
+                {
+                    MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+                }
+                nBufSize = JSON_STREAM_CHUNK_SIZE;
+            }
+            else
+            {
+                Flush();
+            }
+        }
+        else
+        {
+            SIZE_T nNewSize;
+            LPSTR szNewBufA;
+
+            nNewSize = (nBufSize > 0) ? (nBufSize << 1) : JSON_INITIAL_BUFFER_SIZE;
+            if (nNewSize < nBufLen + nBytes)
+            {
+                nNewSize = nBufLen + nBytes;
+            }
+            if (nNewSize < nBufSize)
+            {
+                MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+            }
+            szNewBufA = (LPSTR)MX_REALLOC(szBufA, nNewSize);
+            if (szNewBufA == NULL)
+            {
+                MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+            }
+            szBufA = szNewBufA;
+            nBufSize = nNewSize;
+        }
+    }
+    return szBufA + nBufLen;
+}
+
+//-----------------------------------------------------------
+
+VOID CJsonDecoderHandler::EnterContainer(_In_ BOOL bIsArray)
+{
+    if (aLevelsList.GetCount() >= JSON_MAX_DEPTH)
+    {
+        MX_JS_THROW_ERROR(lpCtx, DUK_ERR_RANGE_ERROR, "json decode recursion limit");
+    }
+    if (aLevelsList.AddElement((bIsArray != FALSE) ? 0 : (DukTape::duk_uarridx_t)-1) == FALSE)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+    }
+    DukTape::duk_require_stack(lpCtx, 4);
+    return;
+}
+
+bool CJsonDecoderHandler::StoreValue()
+{
+    SIZE_T nCount;
+
+    nCount = aLevelsList.GetCount();
+    if (nCount > 0)
+    {
+        DukTape::duk_uarridx_t &nIndex = aLevelsList[nCount - 1];
+
+        if (nIndex != (DukTape::duk_uarridx_t)-1)
+        {
+            DukTape::duk_put_prop_index(lpCtx, -2, nIndex++);
+        }
+        else
+        {
+            DukTape::duk_size_t nKeyLen;
+            LPCSTR szKeyA;
+
+            // JSON.parse creates an own property even for '__proto__'
+            szKeyA = DukTape::duk_get_lstring(lpCtx, -2, &nKeyLen);
+            if (nKeyLen == 9 && ::MxMemCompare(szKeyA, "__proto__", 9) == 0)
+            {
+                DukTape::duk_def_prop(lpCtx, -3, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_SET_WRITABLE |
+                                                     DUK_DEFPROP_SET_ENUMERABLE | DUK_DEFPROP_SET_CONFIGURABLE);
+            }
+            else
+            {
+                DukTape::duk_put_prop(lpCtx, -3);
+            }
+        }
+    }
+    return true;
+}
+
+// NOTE: RapidJSON decodes escaped surrogate pairs into four-byte UTF-8 sequences. Duktape expects them as CESU-8
+//       so such strings are converted before being pushed.
+VOID CJsonDecoderHandler::PushString(_In_ LPCSTR szStrA, _In_ SIZE_T nLen)
+{
+    const BYTE *p, *pEnd;
+    ULONG nCodePoint;
+    LPSTR sA;
+
+    p = (const BYTE *)szStrA;
+    pEnd = p + nLen;
+    while (p < pEnd && *p < 0xF0)
+    {
+        p++;
+    }
+    if (p >= pEnd)
+    {
+        DukTape::duk_push_lstring(lpCtx, szStrA, nLen);
+        return;
+    }
+
+    // each four-byte sequence becomes six bytes
+    if (cStrTempA.EnsureBuffer(nLen + (nLen >> 1) + 1) == FALSE)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
+    }
+    sA = (LPSTR)cStrTempA;
+    ::MxMemCopy(sA, szStrA, (SIZE_T)(p - (const BYTE *)szStrA));
+    sA += (SIZE_T)(p - (const BYTE *)szStrA);
+    while (p < pEnd)
+    {
+        if (*p >= 0xF0 && *p <= 0xF4 && pEnd - p >= 4)
+        {
+            ULONG nHigh, nLow;
+
+            nCodePoint = ((ULONG)(p[0] & 0x07) << 18) | ((ULONG)(p[1] & 0x3F) << 12) | ((ULONG)(p[2] & 0x3F) << 6) |
+                         (ULONG)(p[3] & 0x3F);
+            nCodePoint -= 0x10000;
+            nHigh = 0xD800 + (nCodePoint >> 10);
+            nLow = 0xDC00 + (nCodePoint & 0x3FF);
+
+            *sA++ = (CHAR)(0xE0 | (nHigh >> 12));
+            *sA++ = (CHAR)(0x80 | ((nHigh >> 6) & 0x3F));
+            *sA++ = (CHAR)(0x80 | (nHigh & 0x3F));
+            *sA++ = (CHAR)(0xE0 | (nLow >> 12));
+            *sA++ = (CHAR)(0x80 | ((nLow >> 6) & 0x3F));
+            *sA++ = (CHAR)(0x80 | (nLow & 0x3F));
+            p += 4;
+        }
+        else
+        {
+            *sA++ = (CHAR)*p++;
+        }
+    }
+    DukTape::duk_push_lstring(lpCtx, (LPCSTR)cStrTempA, (DukTape::duk_size_t)(sA - (LPSTR)cStrTempA));
+    return;
+}
+
+} // namespace JsLib
+
+} // namespace Internals
+
+} // namespace MX
@@ -22,14 +22,150 @@
 #include "..\..\..\..\Include\DateTime\DateTime.h"
 #include "..\..\..\..\Include\Crypto\Base64.h"
 #include "..\..\..\..\Include\Crypto\MessageDigest.h"
+#include "..\..\..\..\Include\LinkedList.h"
+#include "..\..\..\..\Include\RefCounted.h"
+#include "..\..\..\..\Include\AtomicOps.h"
+#include "..\..\..\..\Include\Finalizer.h"
+#include "..\..\..\..\Include\FnvHash.h"
+#include "..\..\..\..\Include\RapidJSON\rapidjson-all.h"
 
  //-----------------------------------------------------------
 
+#define VERIFY_CACHE_SHARDS_COUNT 16
+#define VERIFY_CACHE_BUCKETS_COUNT 256 // per shard
+#define VERIFY_CACHE_DEFAULT_SIZE 4096
+#define VERIFY_CACHE_MAX_TOKEN_LENGTH 8192
+
+#define MAX_IMPORTED_KEYS_COUNT 32
+
+#define MAX_SIGNATURE_SIZE 64
+
+#define JWT_FINALIZER_PRIORITY 10001
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+namespace Internals {
+
+namespace JsonWebToken {
+
+// NOTE: A secret already seen by Verify. Up to MAX_IMPORTED_KEYS_COUNT keys are kept until the process ends so cached
+//       tokens can be matched against a key by address instead of comparing secrets on each call.
+class CImportedKey : public virtual CBaseMemObj, public CNonCopyableObj
+{
+public:
+    CImportedKey() : CBaseMemObj(), CNonCopyableObj()
+    {
+        return;
+    };
+
+public:
+    CImportedKey *lpNext{ NULL };
+    CMessageDigest::eAlgorithm nAlgorithm{ CMessageDigest::eAlgorithm::Invalid };
+    Fnv64_t nHash{ 0 };
+    CSecureStringA cStrSecretA;
+};
+
+//-----------------------------------------------------------
+
+class CVerifiedToken : public virtual TRefCounted<CBaseMemObj>, public CNonCopyableObj
+{
+public:
+    CVerifiedToken() : TRefCounted<CBaseMemObj>(), CNonCopyableObj()
+    {
+        return;
+    };
+
+    BOOL HasAudience(_In_z_ LPCSTR szAudienceA) const
+    {
+        SIZE_T i, nCount;
+
+        nCount = aAudiencesList.GetCount();
+        for (i = 0; i < nCount; i++)
+        {
+            if (StrCompareA((LPCSTR)*(aAudiencesList.GetElementAt(i)), szAudienceA) == 0)
+            {
+                return TRUE;
+            }
+        }
+        return FALSE;
+    };
+
+public:
+    CLnkLstNode cLruListNode;
+    CVerifiedToken *lpNextInBucket{ NULL };
+    Fnv64_t nHash{ 0 };
+    CImportedKey *lpKey{ NULL };
+    CStringA cStrTokenA;
+
+    CStringA cStrPayloadA;
+    BOOL bHasNotBefore{ FALSE }, bHasExpiresAt{ FALSE };
+    LONGLONG nNotBefore{ 0 }, nExpiresAt{ 0 };
+    CStringA cStrSubjectA, cStrIssuerA, cStrJwtIdA;
+    TArrayListWithDelete<CStringA*> aAudiencesList;
+};
+
+//-----------------------------------------------------------
+
+typedef struct tagCACHE_SHARD
+{
+    LONG volatile nMutex;
+    CVerifiedToken *aBuckets[VERIFY_CACHE_BUCKETS_COUNT];
+    CLnkLst cLruList;
+} CACHE_SHARD, *LPCACHE_SHARD;
+
+//-----------------------------------------------------------
+
+static HRESULT GetVerifiedToken(_In_ LPCSTR szTokenA, _In_ SIZE_T nTokenLen, _In_ SIZE_T nDotOffsets[2],
+                                _In_ CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCSTR szSecretA, _In_ SIZE_T nSecretLen,
+                                _Out_ CVerifiedToken **lplpToken);
+static HRESULT VerifyAndDecodeToken(_In_ CVerifiedToken *lpToken, _In_ LPCSTR szTokenA, _In_ SIZE_T nTokenLen,
+                                    _In_ SIZE_T nDotOffsets[2], _In_ CMessageDigest::eAlgorithm nAlgorithm,
+                                    _In_ LPCSTR szSecretA, _In_ SIZE_T nSecretLen);
+static HRESULT ParseClaims(_In_ CVerifiedToken *lpToken);
+
+static HRESULT InitializeCache();
+static VOID ShutdownCache();
+static CImportedKey *GetImportedKey(_In_ CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCSTR szSecretA,
+                                    _In_ SIZE_T nSecretLen);
+static CVerifiedToken *LookupToken(_In_ CImportedKey *lpKey, _In_ Fnv64_t nHash, _In_ LPCSTR szTokenA,
+                                   _In_ SIZE_T nTokenLen);
+static VOID InsertToken(_In_ CVerifiedToken *lpToken);
+static VOID FlushShard(_In_ LPCACHE_SHARD lpShard);
+
+} // namespace JsonWebToken
+
+} // namespace Internals
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+static MX::Internals::JsonWebToken::CACHE_SHARD aCacheShards[VERIFY_CACHE_SHARDS_COUNT];
+static LONG volatile nMaxCachedTokensPerShard = VERIFY_CACHE_DEFAULT_SIZE / VERIFY_CACHE_SHARDS_COUNT;
+static LONG volatile nCacheInitialized = 0;
+
+static RWLOCK sImportedKeysRwMutex = MX_RWLOCK_INIT;
+static MX::Internals::JsonWebToken::CImportedKey *lpImportedKeysList = NULL;
+static SIZE_T nImportedKeysCount = 0;
+
+static struct
+{
+    LONGLONG volatile nEntries;
+    LONGLONG volatile nHits;
+    LONGLONG volatile nMisses;
+    LONGLONG volatile nEvictions;
+} sCacheStats = { 0 };
+
+//-----------------------------------------------------------
+
 static VOID GetOptionalString(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nIdx, _Out_ MX::CStringA &cStrDestA);
 static VOID GetOptionalTimestamp(_In_ DukTape::duk_context *lpCtx, _In_ DukTape::duk_idx_t nIdx, _Out_ MX::CDateTime &cDt,
                                  _In_opt_ MX::CDateTime *lpBaseDt);
 static HRESULT EncodeAndConcatBuffer(_Inout_ MX::CStringA &cStrEncodedDataA, _In_ LPVOID lpBuffer, _In_ SIZE_T nBufferLen);
-static HRESULT DecodeBase64Buffer(_In_ MX::CBase64Decoder &cBase64Dec, _In_ LPCSTR szEncodedA, _In_ SIZE_T nEncodedLen);
+static HRESULT DecodeBase64Url(_In_ LPCSTR szEncodedA, _In_ SIZE_T nEncodedLen, _Out_ LPBYTE lpOutput,
+                               _In_ SIZE_T nOutputSize, _Out_ SIZE_T *lpnOutputLen);
 static MX::CMessageDigest::eAlgorithm GetHsAlgorithm(_In_z_ LPCSTR szAlgorithmA);
 
 //-----------------------------------------------------------
@@ -301,41 +437,40 @@ DukTape::duk_ret_t CJsonWebTokenPlugin::Verify(_In_ DukTape::duk_context *lpCtx)
     BOOL bIgnoreTimestamp;
     LONGLONG nNowTimestamp;
     CStringA cStrAudienceA, cStrSubjectA, cStrIssuerA, cStrJwtIdA;
-    CSecureStringA cStrKeyA;
-    LPCSTR sA;
+    LPCSTR szTokenA, szSecretA, sA;
+    DukTape::duk_size_t nTokenLen, nSecretLen;
     SIZE_T nDotOffsets[2];
-    CMessageDigest cHmacHash;
-    CBase64Decoder cBase64Dec;
+    TAutoRefCounted<Internals::JsonWebToken::CVerifiedToken> cToken;
     HRESULT hRes;
 
     // check if the payload is a string
-    sA = DukTape::duk_get_string(lpCtx, 0);
-    if (sA == NULL || *sA == 0)
+    szTokenA = DukTape::duk_get_lstring(lpCtx, 0, &nTokenLen);
+    if (szTokenA == NULL || *szTokenA == 0)
     {
         MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG);
     }
 
     nDotOffsets[0] = 0;
-    while (sA[nDotOffsets[0]] != 0 && sA[nDotOffsets[0]] != '.')
+    while (szTokenA[nDotOffsets[0]] != 0 && szTokenA[nDotOffsets[0]] != '.')
     {
         nDotOffsets[0]++;
     }
-    if (nDotOffsets[0] == 0 || sA[nDotOffsets[0]] != '.')
+    if (nDotOffsets[0] == 0 || szTokenA[nDotOffsets[0]] != '.')
     {
         MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG); // first dot not found or at the beginning
     }
 
     nDotOffsets[1] = nDotOffsets[0] + 1;
-    while (sA[nDotOffsets[1]] != 0 && sA[nDotOffsets[1]] != '.')
+    while (szTokenA[nDotOffsets[1]] != 0 && szTokenA[nDotOffsets[1]] != '.')
     {
         nDotOffsets[1]++;
     }
-    if (nDotOffsets[1] == nDotOffsets[0] + 1 || sA[nDotOffsets[1]] != '.')
+    if (nDotOffsets[1] == nDotOffsets[0] + 1 || szTokenA[nDotOffsets[1]] != '.')
     {
         MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG); // second dot not found or next to the first
     }
 
-    sA += nDotOffsets[1] + 1;
+    sA = szTokenA + nDotOffsets[1] + 1;
     if (*sA == 0)
     {
         MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG); // second dot at the end
@@ -348,19 +483,19 @@ DukTape::duk_ret_t CJsonWebTokenPlugin::Verify(_In_ DukTape::duk_context *lpCtx)
         }
         sA++;
     }
+    if ((SIZE_T)(sA - szTokenA) != (SIZE_T)nTokenLen)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG); // embedded nul
+    }
 
     // check if the secret/private key is a string or an object
     if (DukTape::duk_is_string(lpCtx, 1) != 0)
     {
-        sA = DukTape::duk_get_string(lpCtx, 1);
-        if (sA == NULL || *sA == 0)
+        szSecretA = DukTape::duk_get_lstring(lpCtx, 1, &nSecretLen);
+        if (szSecretA == NULL || *szSecretA == 0)
         {
             MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG);
         }
-        if (cStrKeyA.Copy(sA) == FALSE)
-        {
-            MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_OUTOFMEMORY);
-        }
     }
     else if (DukTape::duk_is_buffer_data(lpCtx, 1) != 0)
     {
@@ -407,13 +542,13 @@ DukTape::duk_ret_t CJsonWebTokenPlugin::Verify(_In_ DukTape::duk_context *lpCtx)
     hRes = cDtNow.GetUnixTime(&nNowTimestamp);
     if (FAILED(hRes))
     {
-        return hRes;
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
     }
 
     // threshold
     nThreshold = 0;
     DukTape::duk_get_prop_string(lpCtx, 2, "threshold");
-    if (DukTape::duk_is_undefined(lpCtx, -1) == 0 && DukTape::duk_is_null(lpCtx, 1) == 0)
+    if (DukTape::duk_is_undefined(lpCtx, -1) == 0 && DukTape::duk_is_null(lpCtx, -1) == 0)
     {
         nThreshold = (ULONG)DukTape::duk_require_uint(lpCtx, -1);
     }
@@ -422,7 +557,7 @@ DukTape::duk_ret_t CJsonWebTokenPlugin::Verify(_In_ DukTape::duk_context *lpCtx)
     // ignore timestamp
     bIgnoreTimestamp = FALSE;
     DukTape::duk_get_prop_string(lpCtx, 2, "ignoreTimestamp");
-    if (DukTape::duk_is_undefined(lpCtx, -1) == 0 && DukTape::duk_is_null(lpCtx, 1) == 0)
+    if (DukTape::duk_is_undefined(lpCtx, -1) == 0 && DukTape::duk_is_null(lpCtx, -1) == 0)
     {
         if (CJavascriptVM::GetInt(lpCtx, -1) != 0)
         {
@@ -451,175 +586,564 @@ DukTape::duk_ret_t CJsonWebTokenPlugin::Verify(_In_ DukTape::duk_context *lpCtx)
     GetOptionalString(lpCtx, -1, cStrJwtIdA);
     DukTape::duk_pop(lpCtx);
 
-    // verify the payload and signature
-    sA = DukTape::duk_get_string(lpCtx, 0);
-    hRes = cHmacHash.BeginDigest(nHsAlgorithm, (LPCSTR)cStrKeyA, cStrKeyA.GetLength());
-    if (SUCCEEDED(hRes))
+    // verify the signature and decode the token, or get it from the cache
+    hRes = Internals::JsonWebToken::GetVerifiedToken(szTokenA, (SIZE_T)nTokenLen, nDotOffsets, nHsAlgorithm, szSecretA,
+                                                     (SIZE_T)nSecretLen, &cToken);
+    if (FAILED(hRes))
     {
-        hRes = cHmacHash.DigestStream(sA, nDotOffsets[1]);
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
     }
-    if (SUCCEEDED(hRes))
+
+    // validate claims
+    if (cStrAudienceA.IsEmpty() == FALSE && cToken->HasAudience((LPCSTR)cStrAudienceA) == FALSE)
     {
-        hRes = cHmacHash.EndDigest();
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
     }
-    if (FAILED(hRes))
+    if (cStrSubjectA.IsEmpty() == FALSE && StrCompareA((LPCSTR)(cToken->cStrSubjectA), (LPCSTR)cStrSubjectA) != 0)
     {
-        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+    }
+    if (cStrIssuerA.IsEmpty() == FALSE && StrCompareA((LPCSTR)(cToken->cStrIssuerA), (LPCSTR)cStrIssuerA) != 0)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+    }
+    if (cStrJwtIdA.IsEmpty() == FALSE && StrCompareA((LPCSTR)(cToken->cStrJwtIdA), (LPCSTR)cStrJwtIdA) != 0)
+    {
+        MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+    }
+
+    if (bIgnoreTimestamp == FALSE)
+    {
+        // validate not before
+        if (cToken->bHasNotBefore != FALSE && nNowTimestamp < cToken->nNotBefore - (LONGLONG)(ULONGLONG)nThreshold)
+        {
+            MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+        }
+
+        // validate expire after
+        if (cToken->bHasExpiresAt != FALSE && nNowTimestamp >= cToken->nExpiresAt + (LONGLONG)(ULONGLONG)nThreshold)
+        {
+            MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+        }
     }
 
-    // decode signature
-    hRes = DecodeBase64Buffer(cBase64Dec, sA + nDotOffsets[1] + 1, StrLenA(sA) - (nDotOffsets[1] + 1));
+    // done, return the claims
+    CJavascriptVM::DecodeJson(lpCtx, (LPCSTR)(cToken->cStrPayloadA), cToken->cStrPayloadA.GetLength());
+    return 1;
+}
+
+VOID CJsonWebTokenPlugin::SetVerifyCacheSize(_In_ SIZE_T nMaxEntries)
+{
+    SIZE_T nPerShard;
+
+    nPerShard = (nMaxEntries + VERIFY_CACHE_SHARDS_COUNT - 1) / VERIFY_CACHE_SHARDS_COUNT;
+    _InterlockedExchange(&nMaxCachedTokensPerShard, (nPerShard < 0x7FFFFFFF) ? (LONG)nPerShard : 0x7FFFFFFFL);
+    FlushVerifyCache();
+    return;
+}
+
+VOID CJsonWebTokenPlugin::FlushVerifyCache()
+{
+    for (SIZE_T i = 0; i < VERIFY_CACHE_SHARDS_COUNT; i++)
+    {
+        Internals::JsonWebToken::FlushShard(&aCacheShards[i]);
+    }
+    return;
+}
+
+VOID CJsonWebTokenPlugin::GetVerifyCacheStats(_Out_ LPVERIFY_CACHE_STATS lpStats)
+{
+    lpStats->nEntries = (ULONGLONG)__InterlockedRead64(&(sCacheStats.nEntries));
+    lpStats->nHits = (ULONGLONG)__InterlockedRead64(&(sCacheStats.nHits));
+    lpStats->nMisses = (ULONGLONG)__InterlockedRead64(&(sCacheStats.nMisses));
+    lpStats->nEvictions = (ULONGLONG)__InterlockedRead64(&(sCacheStats.nEvictions));
+    return;
+}
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+namespace Internals {
+
+namespace JsonWebToken {
+
+static HRESULT GetVerifiedToken(_In_ LPCSTR szTokenA, _In_ SIZE_T nTokenLen, _In_ SIZE_T nDotOffsets[2],
+                                _In_ CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCSTR szSecretA, _In_ SIZE_T nSecretLen,
+                                _Out_ CVerifiedToken **lplpToken)
+{
+    TAutoRefCounted<CVerifiedToken> cToken;
+    CImportedKey *lpKey = NULL;
+    Fnv64_t nHash = 0;
+    HRESULT hRes;
+
+    *lplpToken = NULL;
+
+    if (nTokenLen <= VERIFY_CACHE_MAX_TOKEN_LENGTH && __InterlockedRead(&nMaxCachedTokensPerShard) > 0)
+    {
+        hRes = InitializeCache();
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+
+        // NOTE: If too many different secrets are in use, tokens signed with new ones are not cached.
+        lpKey = GetImportedKey(nAlgorithm, szSecretA, nSecretLen);
+        if (lpKey != NULL)
+        {
+            nHash = fnv_64a_buf(&lpKey, sizeof(lpKey), FNV1A_64_INIT);
+            nHash = fnv_64a_buf(szTokenA, nTokenLen, nHash);
+
+            *lplpToken = LookupToken(lpKey, nHash, szTokenA, nTokenLen);
+            if (*lplpToken != NULL)
+            {
+                _InterlockedIncrement64(&(sCacheStats.nHits));
+                return S_OK;
+            }
+            _InterlockedIncrement64(&(sCacheStats.nMisses));
+        }
+    }
+
+    cToken.Attach(MX_DEBUG_NEW CVerifiedToken());
+    if (!cToken)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = VerifyAndDecodeToken(cToken.Get(), szTokenA, nTokenLen, nDotOffsets, nAlgorithm, szSecretA, nSecretLen);
     if (FAILED(hRes))
     {
-        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
+        return hRes;
     }
 
-    // and verify
-    if (cBase64Dec.GetOutputLength() != cHmacHash.GetResultSize() ||
-        ::MxMemCompare(cBase64Dec.GetBuffer(), cHmacHash.GetResult(), cHmacHash.GetResultSize()) != 0)
+    // only tokens with a valid signature and well-formed claims reach the cache
+    if (lpKey != NULL)
     {
-        MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_BAD_DIGEST);
+        if (cToken->cStrTokenA.CopyN(szTokenA, nTokenLen) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+        cToken->lpKey = lpKey;
+        cToken->nHash = nHash;
+        InsertToken(cToken.Get());
     }
 
-    // decode header
-    hRes = DecodeBase64Buffer(cBase64Dec, sA, nDotOffsets[0]);
+    // done
+    *lplpToken = cToken.Detach();
+    return S_OK;
+}
+
+static HRESULT VerifyAndDecodeToken(_In_ CVerifiedToken *lpToken, _In_ LPCSTR szTokenA, _In_ SIZE_T nTokenLen,
+                                    _In_ SIZE_T nDotOffsets[2], _In_ CMessageDigest::eAlgorithm nAlgorithm,
+                                    _In_ LPCSTR szSecretA, _In_ SIZE_T nSecretLen)
+{
+    BYTE aDigest[MAX_SIGNATURE_SIZE], aSignature[MAX_SIGNATURE_SIZE + 3];
+    SIZE_T i, nDigestSize, nSignatureSize, nBufferSize, nLen;
+    rapidjson::Document cDoc;
+    const rapidjson::Value *lpValue;
+    LPCSTR szExpectedAlgA;
+    BYTE nDiff;
+    HRESULT hRes;
+
+    // verify the signature
+    hRes = CMessageDigest::Hmac(nAlgorithm, szSecretA, nSecretLen, szTokenA, nDotOffsets[1], aDigest, sizeof(aDigest),
+                                &nDigestSize);
     if (FAILED(hRes))
     {
-        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
+        return hRes;
+    }
+    hRes = DecodeBase64Url(szTokenA + nDotOffsets[1] + 1, nTokenLen - (nDotOffsets[1] + 1), aSignature,
+                           sizeof(aSignature), &nSignatureSize);
+    if (FAILED(hRes))
+    {
+        return (hRes == MX_E_BufferOverflow) ? TRUST_E_BAD_DIGEST : hRes;
+    }
+    if (nSignatureSize != nDigestSize)
+    {
+        return TRUST_E_BAD_DIGEST;
+    }
+    nDiff = 0;
+    for (i = 0; i < nDigestSize; i++)
+    {
+        nDiff |= aDigest[i] ^ aSignature[i];
+    }
+    if (nDiff != 0)
+    {
+        return TRUST_E_BAD_DIGEST;
     }
 
-    DukTape::duk_push_lstring(lpCtx, (LPCSTR)(cBase64Dec.GetBuffer()), cBase64Dec.GetOutputLength());
-    DukTape::duk_json_decode(lpCtx, -1);
-    DukTape::duk_check_type_mask(lpCtx, -1, DUK_TYPE_MASK_OBJECT | DUK_TYPE_MASK_THROW);
+    // decode the header and the payload into the same buffer, the header first
+    nBufferSize = (nDotOffsets[0] > nDotOffsets[1] - (nDotOffsets[0] + 1)) ? nDotOffsets[0]
+                                                                          : (nDotOffsets[1] - (nDotOffsets[0] + 1));
+    nBufferSize = (nBufferSize / 4) * 3 + 4;
+    if (lpToken->cStrPayloadA.EnsureBuffer(nBufferSize) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DecodeBase64Url(szTokenA, nDotOffsets[0], (LPBYTE)(LPSTR)(lpToken->cStrPayloadA), nBufferSize, &nLen);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
 
-    // validate type
-    DukTape::duk_get_prop_string(lpCtx, -1, "typ");
-    sA = DukTape::duk_require_string(lpCtx, -1);
-    if (StrCompareA(sA, "JWT", FALSE) != 0)
+    RAPIDJSON_TRY
     {
-        MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG);
+        // validate type and algorithm
+        cDoc.Parse((LPCSTR)(lpToken->cStrPayloadA), nLen);
+        if (cDoc.HasParseError() != false || cDoc.IsObject() == false)
+        {
+            return E_INVALIDARG;
+        }
+
+        lpValue = rapidjson::LookupMember(cDoc, "typ");
+        if (lpValue == NULL || lpValue->IsString() == false || StrCompareA(lpValue->GetString(), "JWT", FALSE) != 0)
+        {
+            return E_INVALIDARG;
+        }
+
+        switch (nAlgorithm)
+        {
+            case CMessageDigest::eAlgorithm::SHA256:
+                szExpectedAlgA = "HS256";
+                break;
+            case CMessageDigest::eAlgorithm::SHA384:
+                szExpectedAlgA = "HS384";
+                break;
+            default:
+                szExpectedAlgA = "HS512";
+                break;
+        }
+        lpValue = rapidjson::LookupMember(cDoc, "alg");
+        if (lpValue == NULL || lpValue->IsString() == false || StrCompareA(lpValue->GetString(), szExpectedAlgA, FALSE) != 0)
+        {
+            return E_INVALIDARG;
+        }
     }
-    DukTape::duk_pop(lpCtx);
+    RAPIDJSON_CATCH_RETURN
 
-    // validate algorithm
-    DukTape::duk_get_prop_string(lpCtx, -1, "alg");
-    sA = DukTape::duk_require_string(lpCtx, -1);
-    switch (nHsAlgorithm)
+    // the payload is kept as the decoded json text
+    hRes = DecodeBase64Url(szTokenA + nDotOffsets[0] + 1, nDotOffsets[1] - (nDotOffsets[0] + 1),
+                           (LPBYTE)(LPSTR)(lpToken->cStrPayloadA), nBufferSize, &nLen);
+    if (FAILED(hRes))
     {
-        case CMessageDigest::eAlgorithm::SHA256:
-            if (StrCompareA(sA, "HS256", FALSE) != 0)
+        return hRes;
+    }
+    ((LPSTR)(lpToken->cStrPayloadA))[nLen] = 0;
+    lpToken->cStrPayloadA.Refresh();
+    if (lpToken->cStrPayloadA.GetLength() != nLen)
+    {
+        return E_INVALIDARG; // embedded nul
+    }
+
+    // done
+    return ParseClaims(lpToken);
+}
+
+static HRESULT ParseClaims(_In_ CVerifiedToken *lpToken)
+{
+    rapidjson::Document cDoc;
+    const rapidjson::Value *lpValue;
+
+    RAPIDJSON_TRY
+    {
+        cDoc.Parse((LPCSTR)(lpToken->cStrPayloadA), lpToken->cStrPayloadA.GetLength());
+        if (cDoc.HasParseError() != false || cDoc.IsObject() == false)
+        {
+            return E_INVALIDARG;
+        }
+
+        // timestamps
+        lpValue = rapidjson::LookupMember(cDoc, "nbf");
+        if (lpValue != NULL)
+        {
+            if (lpValue->IsNumber() == false)
             {
-                MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG);
+                return E_INVALIDARG;
             }
-            break;
-        case CMessageDigest::eAlgorithm::SHA384:
-            if (StrCompareA(sA, "HS384", FALSE) != 0)
+            lpToken->nNotBefore = (LONGLONG)(lpValue->GetDouble());
+            lpToken->bHasNotBefore = TRUE;
+        }
+        lpValue = rapidjson::LookupMember(cDoc, "exp");
+        if (lpValue != NULL)
+        {
+            if (lpValue->IsNumber() == false)
             {
-                MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG);
+                return E_INVALIDARG;
             }
-            break;
-        case CMessageDigest::eAlgorithm::SHA512:
-            if (StrCompareA(sA, "HS512", FALSE) != 0)
+            lpToken->nExpiresAt = (LONGLONG)(lpValue->GetDouble());
+            lpToken->bHasExpiresAt = TRUE;
+        }
+
+        // string claims
+        lpValue = rapidjson::LookupMember(cDoc, "sub");
+        if (lpValue != NULL && lpValue->IsString() != false)
+        {
+            if (lpToken->cStrSubjectA.CopyN(lpValue->GetString(), (SIZE_T)(lpValue->GetStringLength())) == FALSE)
             {
-                MX_JS_THROW_WINDOWS_ERROR(lpCtx, E_INVALIDARG);
+                return E_OUTOFMEMORY;
             }
-            break;
-    }
-    DukTape::duk_pop_2(lpCtx);
+        }
+        lpValue = rapidjson::LookupMember(cDoc, "iss");
+        if (lpValue != NULL && lpValue->IsString() != false)
+        {
+            if (lpToken->cStrIssuerA.CopyN(lpValue->GetString(), (SIZE_T)(lpValue->GetStringLength())) == FALSE)
+            {
+                return E_OUTOFMEMORY;
+            }
+        }
+        lpValue = rapidjson::LookupMember(cDoc, "jti");
+        if (lpValue == NULL)
+        {
+            lpValue = rapidjson::LookupMember(cDoc, "jwtid"); // written by older versions of Create
+        }
+        if (lpValue != NULL && lpValue->IsString() != false)
+        {
+            if (lpToken->cStrJwtIdA.CopyN(lpValue->GetString(), (SIZE_T)(lpValue->GetStringLength())) == FALSE)
+            {
+                return E_OUTOFMEMORY;
+            }
+        }
 
-    // decode payload
-    sA = DukTape::duk_get_string(lpCtx, 0);
-    hRes = DecodeBase64Buffer(cBase64Dec, sA + nDotOffsets[0] + 1, nDotOffsets[1] - (nDotOffsets[0] + 1));
-    if (FAILED(hRes))
-    {
-        MX_JS_THROW_WINDOWS_ERROR(lpCtx, hRes);
+        // the audience can be a single string or an array of them
+        lpValue = rapidjson::LookupMember(cDoc, "aud");
+        if (lpValue != NULL)
+        {
+            rapidjson::Value::ConstValueIterator itBegin, itEnd, it;
+
+            if (lpValue->IsArray() != false)
+            {
+                itBegin = lpValue->Begin();
+                itEnd = lpValue->End();
+            }
+            else
+            {
+                itBegin = lpValue;
+                itEnd = lpValue + 1;
+            }
+            for (it = itBegin; it != itEnd; it++)
+            {
+                if (it->IsString() != false)
+                {
+                    TAutoDeletePtr<CStringA> cStrAudienceA;
+
+                    cStrAudienceA.Attach(MX_DEBUG_NEW CStringA());
+                    if (!cStrAudienceA || cStrAudienceA->CopyN(it->GetString(), (SIZE_T)(it->GetStringLength())) == FALSE ||
+                        lpToken->aAudiencesList.AddElement(cStrAudienceA.Get()) == FALSE)
+                    {
+                        return E_OUTOFMEMORY;
+                    }
+                    cStrAudienceA.Detach();
+                }
+            }
+        }
     }
+    RAPIDJSON_CATCH_RETURN
+
+    // done
+    return S_OK;
+}
 
-    DukTape::duk_push_lstring(lpCtx, (LPCSTR)(cBase64Dec.GetBuffer()), cBase64Dec.GetOutputLength());
-    DukTape::duk_json_decode(lpCtx, -1);
-    DukTape::duk_check_type_mask(lpCtx, -1, DUK_TYPE_MASK_OBJECT | DUK_TYPE_MASK_THROW);
+static HRESULT InitializeCache()
+{
+    static LONG volatile nMutex = MX_FASTLOCK_INIT;
 
-    // validate audience
-    if (cStrAudienceA.IsEmpty() == FALSE)
+    if (__InterlockedRead(&nCacheInitialized) == 0)
     {
-        DukTape::duk_get_prop_string(lpCtx, -1, "audience");
-        sA = duk_get_string(lpCtx, -1);
-        if (sA == NULL || StrCompareA(sA, (LPCSTR)cStrAudienceA) != 0)
+        CFastLock cLock(&nMutex);
+        HRESULT hRes;
+
+        if (__InterlockedRead(&nCacheInitialized) == 0)
         {
-            MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+            hRes = RegisterFinalizer(&ShutdownCache, JWT_FINALIZER_PRIORITY);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+            _InterlockedExchange(&nCacheInitialized, 1);
         }
-        DukTape::duk_pop(lpCtx);
     }
 
-    // validate subject
-    if (cStrSubjectA.IsEmpty() == FALSE)
+    // done
+    return S_OK;
+}
+
+static VOID ShutdownCache()
+{
+    CImportedKey *lpKey;
+
+    _InterlockedExchange(&nMaxCachedTokensPerShard, 0);
+    for (SIZE_T i = 0; i < VERIFY_CACHE_SHARDS_COUNT; i++)
+    {
+        FlushShard(&aCacheShards[i]);
+    }
+
+    SlimRWL_AcquireExclusive(&sImportedKeysRwMutex);
+    while (lpImportedKeysList != NULL)
     {
-        DukTape::duk_get_prop_string(lpCtx, -1, "subject");
-        sA = duk_get_string(lpCtx, -1);
-        if (sA == NULL || StrCompareA(sA, (LPCSTR)cStrSubjectA) != 0)
+        lpKey = lpImportedKeysList;
+        lpImportedKeysList = lpKey->lpNext;
+        delete lpKey;
+    }
+    nImportedKeysCount = 0;
+    SlimRWL_ReleaseExclusive(&sImportedKeysRwMutex);
+    return;
+}
+
+static CImportedKey *GetImportedKey(_In_ CMessageDigest::eAlgorithm nAlgorithm, _In_ LPCSTR szSecretA,
+                                    _In_ SIZE_T nSecretLen)
+{
+    CImportedKey *lpKey;
+    Fnv64_t nHash;
+
+    nHash = fnv_64a_buf(&nAlgorithm, sizeof(nAlgorithm), FNV1A_64_INIT);
+    nHash = fnv_64a_buf(szSecretA, nSecretLen, nHash);
+
+    {
+        CAutoSlimRWLShared cLock(&sImportedKeysRwMutex);
+
+        for (lpKey = lpImportedKeysList; lpKey != NULL; lpKey = lpKey->lpNext)
         {
-            MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+            if (lpKey->nHash == nHash && lpKey->nAlgorithm == nAlgorithm && lpKey->cStrSecretA.GetLength() == nSecretLen &&
+                ::MxMemCompare((LPCSTR)(lpKey->cStrSecretA), szSecretA, nSecretLen) == 0)
+            {
+                return lpKey;
+            }
         }
-        DukTape::duk_pop(lpCtx);
     }
 
-    // validate issuer
-    if (cStrIssuerA.IsEmpty() == FALSE)
     {
-        DukTape::duk_get_prop_string(lpCtx, -1, "issuer");
-        sA = duk_get_string(lpCtx, -1);
-        if (sA == NULL || StrCompareA(sA, (LPCSTR)cStrIssuerA) != 0)
+        CAutoSlimRWLExclusive cLock(&sImportedKeysRwMutex);
+
+        // another thread may have added it while the lock was released
+        for (lpKey = lpImportedKeysList; lpKey != NULL; lpKey = lpKey->lpNext)
         {
-            MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+            if (lpKey->nHash == nHash && lpKey->nAlgorithm == nAlgorithm && lpKey->cStrSecretA.GetLength() == nSecretLen &&
+                ::MxMemCompare((LPCSTR)(lpKey->cStrSecretA), szSecretA, nSecretLen) == 0)
+            {
+                return lpKey;
+            }
+        }
+        if (nImportedKeysCount >= MAX_IMPORTED_KEYS_COUNT)
+        {
+            return NULL;
+        }
+
+        lpKey = MX_DEBUG_NEW CImportedKey();
+        if (lpKey == NULL)
+        {
+            return NULL;
         }
-        DukTape::duk_pop(lpCtx);
+        if (lpKey->cStrSecretA.CopyN(szSecretA, nSecretLen) == FALSE)
+        {
+            delete lpKey;
+            return NULL;
+        }
+        lpKey->nAlgorithm = nAlgorithm;
+        lpKey->nHash = nHash;
+        lpKey->lpNext = lpImportedKeysList;
+        lpImportedKeysList = lpKey;
+        nImportedKeysCount++;
     }
 
-    // validate jwtid
-    if (cStrJwtIdA.IsEmpty() == FALSE)
+    // done
+    return lpKey;
+}
+
+static CVerifiedToken *LookupToken(_In_ CImportedKey *lpKey, _In_ Fnv64_t nHash, _In_ LPCSTR szTokenA,
+                                   _In_ SIZE_T nTokenLen)
+{
+    LPCACHE_SHARD lpShard = &aCacheShards[(SIZE_T)(nHash >> 60) & (VERIFY_CACHE_SHARDS_COUNT - 1)];
+    CFastLock cLock(&(lpShard->nMutex));
+    CVerifiedToken *lpToken;
+
+    for (lpToken = lpShard->aBuckets[(SIZE_T)nHash & (VERIFY_CACHE_BUCKETS_COUNT - 1)]; lpToken != NULL;
+         lpToken = lpToken->lpNextInBucket)
     {
-        DukTape::duk_get_prop_string(lpCtx, -1, "jwtid");
-        sA = duk_get_string(lpCtx, -1);
-        if (sA == NULL || StrCompareA(sA, (LPCSTR)cStrJwtIdA) != 0)
+        if (lpToken->nHash == nHash && lpToken->lpKey == lpKey && lpToken->cStrTokenA.GetLength() == nTokenLen &&
+            ::MxMemCompare((LPCSTR)(lpToken->cStrTokenA), szTokenA, nTokenLen) == 0)
         {
-            MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
+            // move to the front of the lru list
+            lpShard->cLruList.Remove(&(lpToken->cLruListNode));
+            lpShard->cLruList.PushHead(&(lpToken->cLruListNode));
+
+            lpToken->AddRef();
+            return lpToken;
         }
-        DukTape::duk_pop(lpCtx);
     }
+    return NULL;
+}
 
-    if (bIgnoreTimestamp == FALSE)
+static VOID InsertToken(_In_ CVerifiedToken *lpToken)
+{
+    LPCACHE_SHARD lpShard = &aCacheShards[(SIZE_T)(lpToken->nHash >> 60) & (VERIFY_CACHE_SHARDS_COUNT - 1)];
+    CFastLock cLock(&(lpShard->nMutex));
+    CVerifiedToken **lplpBucket, *lpOldToken;
+    SIZE_T nMaxCount;
+
+    nMaxCount = (SIZE_T)__InterlockedRead(&nMaxCachedTokensPerShard);
+    if (nMaxCount == 0)
     {
-        LONGLONG nTimestamp;
+        return;
+    }
 
-        // validate not before
-        DukTape::duk_get_prop_string(lpCtx, -1, "nbf");
-        if (DukTape::duk_is_undefined(lpCtx, -1) == 0)
+    // another thread may have verified the same token
+    lplpBucket = &(lpShard->aBuckets[(SIZE_T)(lpToken->nHash) & (VERIFY_CACHE_BUCKETS_COUNT - 1)]);
+    for (lpOldToken = *lplpBucket; lpOldToken != NULL; lpOldToken = lpOldToken->lpNextInBucket)
+    {
+        if (lpOldToken->nHash == lpToken->nHash && lpOldToken->lpKey == lpToken->lpKey &&
+            lpOldToken->cStrTokenA.GetLength() == lpToken->cStrTokenA.GetLength() &&
+            ::MxMemCompare((LPCSTR)(lpOldToken->cStrTokenA), (LPCSTR)(lpToken->cStrTokenA),
+                           lpToken->cStrTokenA.GetLength()) == 0)
         {
-            nTimestamp = (LONGLONG)DukTape::duk_require_number(lpCtx, -1);
-            if (nNowTimestamp < nTimestamp - (LONGLONG)(ULONGLONG)nThreshold)
-            {
-                MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
-            }
+            return;
         }
-        DukTape::duk_pop(lpCtx);
+    }
 
-        // validate expire after
-        DukTape::duk_get_prop_string(lpCtx, -1, "exp");
-        if (DukTape::duk_is_undefined(lpCtx, -1) == 0)
+    // evict the least recently used tokens
+    while (lpShard->cLruList.GetCount() >= nMaxCount)
+    {
+        CVerifiedToken **lplpPrev;
+
+        lpOldToken = CONTAINING_RECORD(lpShard->cLruList.PopTail(), CVerifiedToken, cLruListNode);
+        lplpPrev = &(lpShard->aBuckets[(SIZE_T)(lpOldToken->nHash) & (VERIFY_CACHE_BUCKETS_COUNT - 1)]);
+        while (*lplpPrev != lpOldToken)
         {
-            nTimestamp = (LONGLONG)DukTape::duk_require_number(lpCtx, -1);
-            if (nNowTimestamp >= nTimestamp + (LONGLONG)(ULONGLONG)nThreshold)
-            {
-                MX_JS_THROW_WINDOWS_ERROR(lpCtx, TRUST_E_FAIL);
-            }
+            lplpPrev = &((*lplpPrev)->lpNextInBucket);
         }
-        DukTape::duk_pop(lpCtx);
+        *lplpPrev = lpOldToken->lpNextInBucket;
+        lpOldToken->Release();
+
+        _InterlockedDecrement64(&(sCacheStats.nEntries));
+        _InterlockedIncrement64(&(sCacheStats.nEvictions));
     }
 
-    // done
-    return 1;
+    lpToken->AddRef();
+    lpToken->lpNextInBucket = *lplpBucket;
+    *lplpBucket = lpToken;
+    lpShard->cLruList.PushHead(&(lpToken->cLruListNode));
+    _InterlockedIncrement64(&(sCacheStats.nEntries));
+    return;
 }
 
+static VOID FlushShard(_In_ LPCACHE_SHARD lpShard)
+{
+    CFastLock cLock(&(lpShard->nMutex));
+    CLnkLstNode *lpNode;
+
+    while ((lpNode = lpShard->cLruList.PopHead()) != NULL)
+    {
+        CONTAINING_RECORD(lpNode, CVerifiedToken, cLruListNode)->Release();
+        _InterlockedDecrement64(&(sCacheStats.nEntries));
+    }
+    ::MxMemSet(lpShard->aBuckets, 0, sizeof(lpShard->aBuckets));
+    return;
+}
+
+} // namespace JsonWebToken
+
+} // namespace Internals
+
 } // namespace MX
 
 //-----------------------------------------------------------
@@ -916,53 +1440,75 @@ static HRESULT EncodeAndConcatBuffer(_Inout_ MX::CStringA &cStrEncodedDataA, _In
     return S_OK;
 }
 
-static HRESULT DecodeBase64Buffer(_In_ MX::CBase64Decoder &cBase64Dec, _In_ LPCSTR szEncodedA, _In_ SIZE_T nEncodedLen)
+static HRESULT DecodeBase64Url(_In_ LPCSTR szEncodedA, _In_ SIZE_T nEncodedLen, _Out_ LPBYTE lpOutput,
+                               _In_ SIZE_T nOutputSize, _Out_ SIZE_T *lpnOutputLen)
 {
-    HRESULT hRes;
-
-    hRes = cBase64Dec.Begin();
-    if (SUCCEEDED(hRes))
+    static const BYTE aDecodeTable[256] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0x00
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0x10
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, // 0x20
+        0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0x30
+        0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, // 0x40
+        0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F, // 0x50
+        0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, // 0x60
+        0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0x70
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0x80
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0x90
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0xA0
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0xB0
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0xC0
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0xD0
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0xE0
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF  // 0xF0
+    };
+    ULONG nAccum, nBits;
+    SIZE_T nOutputLen;
+    BYTE nValue;
+
+    *lpnOutputLen = 0;
+
+    // padding is not used in tokens but tolerated
+    if (nEncodedLen > 0 && szEncodedA[nEncodedLen - 1] == '=')
+    {
+        nEncodedLen--;
+        if (nEncodedLen > 0 && szEncodedA[nEncodedLen - 1] == '=')
+        {
+            nEncodedLen--;
+        }
+    }
+    if ((nEncodedLen & 3) == 1)
     {
-        SIZE_T nMissingEqualsCount;
-
-        nMissingEqualsCount = ((nEncodedLen & 3) != 0) ? (4 - (nEncodedLen & 3)) : 0;
+        return MX_E_InvalidData;
+    }
 
-        while (SUCCEEDED(hRes) && nEncodedLen > 0)
+    nAccum = nBits = 0;
+    nOutputLen = 0;
+    while (nEncodedLen > 0)
+    {
+        nValue = aDecodeTable[(BYTE)*szEncodedA];
+        if (nValue == 0xFF)
         {
-            if (*szEncodedA == '-')
-            {
-                hRes = cBase64Dec.Process("+", 1);
-                szEncodedA++;
-                nEncodedLen--;
-            }
-            else if (*szEncodedA == '_')
-            {
-                hRes = cBase64Dec.Process("/", 1);
-                szEncodedA++;
-                nEncodedLen--;
-            }
-            else
-            {
-                LPCSTR szStartA = szEncodedA;
-                while (nEncodedLen > 0 && *szEncodedA != '-' && *szEncodedA != '_')
-                {
-                    szEncodedA++;
-                    nEncodedLen--;
-                }
-                hRes = cBase64Dec.Process(szStartA, (SIZE_T)(szEncodedA - szStartA));
-            }
+            return MX_E_InvalidData;
         }
-        if (SUCCEEDED(hRes) && nMissingEqualsCount > 0)
+        nAccum = (nAccum << 6) | (ULONG)nValue;
+        nBits += 6;
+        if (nBits >= 8)
         {
-            hRes = cBase64Dec.Process("===", nMissingEqualsCount);
+            nBits -= 8;
+            if (nOutputLen >= nOutputSize)
+            {
+                return MX_E_BufferOverflow;
+            }
+            lpOutput[nOutputLen++] = (BYTE)(nAccum >> nBits);
+            nAccum &= (1UL << nBits) - 1;
         }
+        szEncodedA++;
+        nEncodedLen--;
     }
-    if (SUCCEEDED(hRes))
-    {
-        hRes = cBase64Dec.End();
-    }
+
     // done
-    return hRes;
+    *lpnOutputLen = nOutputLen;
+    return S_OK;
 }
 
 static MX::CMessageDigest::eAlgorithm GetHsAlgorithm(_In_z_ LPCSTR szAlgorithmA)
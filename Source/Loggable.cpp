@@ -18,6 +18,7 @@
  * limitations under the License.
  */
 #include "..\Include\Loggable.h"
+#include "..\Include\AsyncLogger.h"
 #include <stdio.h>
 
 #ifdef _DEBUG
@@ -32,6 +33,10 @@
 
 //-----------------------------------------------------------
 
+static LONG volatile nParentsGeneration = 0;
+
+//-----------------------------------------------------------
+
 namespace MX {
 
 CLoggable::CLoggable() : CBaseMemObj()
@@ -39,6 +44,9 @@ CLoggable::CLoggable() : CBaseMemObj()
     lpParentLog = NULL;
     dwLevel = 0;
     cCallback = NullCallback();
+    lpAsyncLogger = NULL;
+    lpCachedRoot = NULL;
+    nCachedRootGeneration = 0;
     return;
 }
 
@@ -47,6 +55,9 @@ CLoggable::CLoggable(_In_ OnLogCallback _cCallback) : CBaseMemObj()
     lpParentLog = NULL;
     dwLevel = 0;
     cCallback = _cCallback;
+    lpAsyncLogger = NULL;
+    lpCachedRoot = NULL;
+    nCachedRootGeneration = 0;
     return;
 }
 
@@ -55,12 +66,15 @@ CLoggable &CLoggable::operator=(_In_ const CLoggable &cSrc)
     lpParentLog = cSrc.lpParentLog;
     dwLevel = cSrc.dwLevel;
     cCallback = cSrc.cCallback;
+    lpAsyncLogger = cSrc.lpAsyncLogger;
+    lpCachedRoot = NULL;
     return *this;
 }
 
 VOID CLoggable::SetLogParent(_In_opt_ CLoggable *_lpParentLog)
 {
     lpParentLog = _lpParentLog;
+    _InterlockedIncrement(&nParentsGeneration);
     return;
 }
 
@@ -76,6 +90,12 @@ VOID CLoggable::SetLogCallback(_In_ OnLogCallback _cCallback)
     return;
 }
 
+VOID CLoggable::SetAsyncLogger(_In_opt_ CAsyncLogger *_lpAsyncLogger)
+{
+    lpAsyncLogger = _lpAsyncLogger;
+    return;
+}
+
 HRESULT CLoggable::Log(_Printf_format_string_ LPCWSTR szFormatW, ...)
 {
     va_list argptr;
@@ -134,26 +154,44 @@ HRESULT CLoggable::LogAlways(_In_ HRESULT hResError, _Printf_format_string_ LPCW
 CLoggable *CLoggable::GetRoot() const
 {
     CLoggable *lpThis;
+    LONG nGeneration;
 
     if (lpParentLog == NULL)
     {
         return const_cast<CLoggable *>(this);
     }
+
+    nGeneration = nParentsGeneration;
+    lpThis = lpCachedRoot;
+    if (lpThis != NULL && nCachedRootGeneration == nGeneration)
+    {
+        return lpThis;
+    }
+
     lpThis = lpParentLog;
     while (lpThis->lpParentLog != NULL)
     {
         lpThis = lpThis->lpParentLog;
     }
+
+    // store the root before the generation so a matching generation is never paired with an older root
+    lpCachedRoot = lpThis;
+    _ReadWriteBarrier();
+    nCachedRootGeneration = nGeneration;
     return lpThis;
 }
 
 HRESULT CLoggable::WriteLogCommon(_In_ BOOL bAddError, _In_ HRESULT hResError, _In_z_ LPCWSTR szFormatW, _In_ va_list argptr)
 {
-    WCHAR szTempBufW[1024], *lpszBufW;
-    int count[2];
-    SIZE_T nTotal, nBufLen = MX_ARRAYLEN(szTempBufW);
+    WCHAR szBufW[MX_LOGGABLE_MAX_TEXT_LENGTH + 1];
+    int nPrefixLen;
     HRESULT hRes;
 
+    if (lpAsyncLogger != NULL)
+    {
+        return lpAsyncLogger->WriteV(bAddError, hResError, szFormatW, argptr);
+    }
+
 #ifndef DEBUGOUTPUT_LOG
     if (!cCallback)
     {
@@ -161,53 +199,23 @@ HRESULT CLoggable::WriteLogCommon(_In_ BOOL bAddError, _In_ HRESULT hResError, _
     }
 #endif //! DEBUGOUTPUT_LOG
 
-    lpszBufW = szTempBufW;
-    count[0] = 0;
+    // format in a single pass, longer messages are truncated and the buffer is always terminated
+    nPrefixLen = 0;
     if (bAddError != FALSE)
     {
-        count[0] = _snwprintf_s(szTempBufW + (SIZE_T)count[0], MX_ARRAYLEN(szTempBufW) - (SIZE_T)count[0], _TRUNCATE, L"Error 0x%08X: ",
-                                hResError);
-        if (count[0] < 0)
-        {
-            count[0] = 0;
-        }
-    }
-
-    count[1] = _vscwprintf(szFormatW, argptr);
-    if (count[0] + count[1] + 3 < MX_ARRAYLEN(szTempBufW))
-    {
-        count[1] = _vsnwprintf_s(szTempBufW + count[0], MX_ARRAYLEN(szTempBufW) - (SIZE_T)count[0], _TRUNCATE, szFormatW, argptr);
-    }
-    else
-    {
-        lpszBufW = (LPWSTR)MX_MALLOC(4096 * sizeof(WCHAR));
-        if (lpszBufW == NULL)
-        {
-            return E_OUTOFMEMORY;
-        }
-        nBufLen = 4096;
-        ::MxMemCopy(lpszBufW, szTempBufW, (SIZE_T)count[0] * sizeof(WCHAR));
-        count[1] = _vsnwprintf_s(lpszBufW + (SIZE_T)count[0], nBufLen - (SIZE_T)count[0], _TRUNCATE, szFormatW, argptr);
-        if (count[1] < 0)
+        nPrefixLen = _snwprintf_s(szBufW, MX_ARRAYLEN(szBufW), _TRUNCATE, L"Error 0x%08X: ", hResError);
+        if (nPrefixLen < 0)
         {
-            count[1] = (int)(unsigned int)wcslen(lpszBufW + (SIZE_T)count[0]);
+            nPrefixLen = 0;
         }
     }
-    nTotal = (SIZE_T)count[0] + (SIZE_T)count[1];
-    if (nTotal > nBufLen - 1)
-    {
-        nTotal = nBufLen - 1;
-    }
-    lpszBufW[nTotal] = 0;
+    _vsnwprintf_s(szBufW + (SIZE_T)nPrefixLen, MX_ARRAYLEN(szBufW) - (SIZE_T)nPrefixLen, _TRUNCATE, szFormatW,
+                  argptr);
 
-    hRes = (cCallback) ? cCallback(lpszBufW) : S_OK;
+    hRes = (cCallback) ? cCallback(szBufW) : S_OK;
 #ifdef DEBUGOUTPUT_LOG
-    DebugPrint("%S\n", lpszBufW);
+    DebugPrint("%S\n", szBufW);
 #endif // DEBUGOUTPUT_LOG
-    if (lpszBufW != szTempBufW)
-    {
-        MX_FREE(lpszBufW);
-    }
 
     // done
     return hRes;
@@ -23,6 +23,45 @@
 
  //-----------------------------------------------------------
 
+#define ARENA_MIN_BLOCK_SIZE 1024
+#define ARENA_MAX_BLOCK_SIZE 65536
+#define ARENA_COMPACT_THRESHOLD 4096
+
+#define HASHTABLE_MIN_SIZE 16
+
+#define MAX_NAME_LENGTH 0xFFFF
+
+#define SERIALIZED_MAGIC 0x4250584DUL // "MXPB"
+#define SERIALIZED_VERSION 1
+
+#define SERIALIZED_TYPE_NULL 1
+#define SERIALIZED_TYPE_DWORD 2
+#define SERIALIZED_TYPE_QWORD 3
+#define SERIALIZED_TYPE_DOUBLE 4
+#define SERIALIZED_TYPE_ANSISTRING 5
+#define SERIALIZED_TYPE_WIDESTRING 6
+
+#define ALIGN_SIZE(_size) (((_size) + 7) & (~((SIZE_T)7)))
+
+// NOTE: ASCII only on purpose, names are narrow strings and folding other bytes would depend on the locale.
+#define TO_LOWER(_ch) (((_ch) >= 'A' && (_ch) <= 'Z') ? ((_ch) + 32) : (_ch))
+
+//-----------------------------------------------------------
+
+// NOTE: Each property is stored as a BYTE with the type, a WORD with the name length and the name followed by the
+//       value. Strings are stored as a DWORD with the length in characters and the characters without terminator.
+#pragma pack(push, 1)
+typedef struct tagSERIALIZED_HEADER
+{
+    DWORD dwMagic;
+    WORD wVersion;
+    WORD wReserved;
+    DWORD dwCount;
+} SERIALIZED_HEADER;
+#pragma pack(pop)
+
+//-----------------------------------------------------------
+
 namespace MX {
 
 CPropertyBag::CPropertyBag() : CBaseMemObj(), CNonCopyableObj()
@@ -38,13 +77,27 @@ CPropertyBag::~CPropertyBag()
 
 VOID CPropertyBag::Reset()
 {
+    SIZE_T nCount;
+
+    nCount = cPropertiesList.GetCount();
+    for (SIZE_T i = 0; i < nCount; i++)
+    {
+        FreeValue(cPropertiesList.GetElementAt(i));
+    }
     cPropertiesList.RemoveAllElements();
+
+    MX_FREE(lplpHashTable);
+    nHashTableSize = 0;
+
+    FreeArena();
     return;
 }
 
 HRESULT CPropertyBag::Clear(_In_z_ LPCSTR szNameA)
 {
-    SIZE_T nIndex;
+    LPPROPERTY lpProp;
+    SIZE_T nNameLen, nMask, nSlot, nNextSlot, nHomeSlot, nIndex;
+    ULONG nHash;
 
     if (szNameA == NULL)
     {
@@ -54,218 +107,215 @@ HRESULT CPropertyBag::Clear(_In_z_ LPCSTR szNameA)
     {
         return E_INVALIDARG;
     }
-    nIndex = Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    nNameLen = StrLenA(szNameA);
+    nHash = HashName(szNameA, nNameLen);
+    lpProp = Find(szNameA, nNameLen, nHash);
+    if (lpProp == NULL)
     {
         return MX_E_NotFound;
     }
-    // clear element
-    cPropertiesList.RemoveElementAt(nIndex);
+
+    // remove from the hash table shifting back the entries of the same probe sequence
+    nMask = nHashTableSize - 1;
+    nSlot = (SIZE_T)nHash & nMask;
+    while (lplpHashTable[nSlot] != lpProp)
+    {
+        nSlot = (nSlot + 1) & nMask;
+    }
+    nNextSlot = nSlot;
+    while (1)
+    {
+        nNextSlot = (nNextSlot + 1) & nMask;
+        if (lplpHashTable[nNextSlot] == NULL)
+        {
+            break;
+        }
+        nHomeSlot = (SIZE_T)(lplpHashTable[nNextSlot]->nHash) & nMask;
+        // move the entry only if its home slot is not between the hole and its current position
+        if ((nNextSlot > nSlot && (nHomeSlot <= nSlot || nHomeSlot > nNextSlot)) ||
+            (nNextSlot < nSlot && (nHomeSlot <= nSlot && nHomeSlot > nNextSlot)))
+        {
+            lplpHashTable[nSlot] = lplpHashTable[nNextSlot];
+            nSlot = nNextSlot;
+        }
+    }
+    lplpHashTable[nSlot] = NULL;
+
+    // remove from the list keeping the insertion order
+    nIndex = cPropertiesList.GetCount();
+    while (nIndex > 0)
+    {
+        nIndex--;
+        if (cPropertiesList.GetElementAt(nIndex) == lpProp)
+        {
+            cPropertiesList.RemoveElementAt(nIndex);
+            break;
+        }
+    }
+
+    FreeValue(lpProp);
+    nArenaWastedBytes += ALIGN_SIZE(sizeof(PROPERTY) + nNameLen);
+    if (nArenaWastedBytes >= ARENA_COMPACT_THRESHOLD && nArenaWastedBytes >= nArenaUsedBytes / 2)
+    {
+        CompactArena();
+    }
+
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::SetNull(_In_z_ LPCSTR szNameA)
 {
-    PROPERTY *lpNewProp;
-    SIZE_T nNameLen;
+    LPPROPERTY lpProp;
+    HRESULT hRes;
 
     if (szNameA == NULL)
     {
         return E_POINTER;
     }
-    if (*szNameA == 0)
-    {
-        return E_INVALIDARG;
-    }
-    // create new property
-    nNameLen = StrLenA(szNameA) + 1;
-    lpNewProp = (PROPERTY *)MX_MALLOC(sizeof(PROPERTY) + nNameLen);
-    if (lpNewProp == NULL)
-    {
-        return E_OUTOFMEMORY;
-    }
-    lpNewProp->szNameA = (LPSTR)(lpNewProp + 1);
-    MxMemCopy(lpNewProp->szNameA, szNameA, nNameLen);
-    lpNewProp->nType = eType::Null;
-    if (Insert(lpNewProp) == FALSE)
+    hRes = AddProperty(szNameA, StrLenA(szNameA), &lpProp);
+    if (FAILED(hRes))
     {
-        MX_FREE(lpNewProp);
-        return E_OUTOFMEMORY;
+        return hRes;
     }
+    FreeValue(lpProp);
+    lpProp->nType = eType::Null;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::SetDWord(_In_z_ LPCSTR szNameA, _In_ DWORD dwValue)
 {
-    PROPERTY *lpNewProp;
-    SIZE_T nNameLen;
+    LPPROPERTY lpProp;
+    HRESULT hRes;
 
     if (szNameA == NULL)
     {
         return E_POINTER;
     }
-    if (*szNameA == 0)
-    {
-        return E_INVALIDARG;
-    }
-    // create new property
-    nNameLen = StrLenA(szNameA) + 1;
-    lpNewProp = (PROPERTY *)MX_MALLOC(sizeof(PROPERTY) + nNameLen);
-    if (lpNewProp == NULL)
-    {
-        return E_OUTOFMEMORY;
-    }
-    lpNewProp->szNameA = (LPSTR)(lpNewProp + 1);
-    MxMemCopy(lpNewProp->szNameA, szNameA, nNameLen);
-    lpNewProp->nType = eType::DWord;
-    lpNewProp->u.dwValue = dwValue;
-    if (Insert(lpNewProp) == FALSE)
+    hRes = AddProperty(szNameA, StrLenA(szNameA), &lpProp);
+    if (FAILED(hRes))
     {
-        MX_FREE(lpNewProp);
-        return E_OUTOFMEMORY;
+        return hRes;
     }
+    FreeValue(lpProp);
+    lpProp->nType = eType::DWord;
+    lpProp->u.dwValue = dwValue;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::SetQWord(_In_z_ LPCSTR szNameA, _In_ ULONGLONG ullValue)
 {
-    PROPERTY *lpNewProp;
-    SIZE_T nNameLen;
+    LPPROPERTY lpProp;
+    HRESULT hRes;
 
     if (szNameA == NULL)
     {
         return E_POINTER;
     }
-    if (*szNameA == 0)
-    {
-        return E_INVALIDARG;
-    }
-    // create new property
-    nNameLen = StrLenA(szNameA) + 1;
-    lpNewProp = (PROPERTY *)MX_MALLOC(sizeof(PROPERTY) + nNameLen);
-    if (lpNewProp == NULL)
+    hRes = AddProperty(szNameA, StrLenA(szNameA), &lpProp);
+    if (FAILED(hRes))
     {
-        return E_OUTOFMEMORY;
-    }
-    lpNewProp->szNameA = (LPSTR)(lpNewProp + 1);
-    MxMemCopy(lpNewProp->szNameA, szNameA, nNameLen);
-    lpNewProp->nType = eType::QWord;
-    lpNewProp->u.ullValue = ullValue;
-    if (Insert(lpNewProp) == FALSE)
-    {
-        MX_FREE(lpNewProp);
-        return E_OUTOFMEMORY;
+        return hRes;
     }
+    FreeValue(lpProp);
+    lpProp->nType = eType::QWord;
+    lpProp->u.ullValue = ullValue;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::SetDouble(_In_z_ LPCSTR szNameA, _In_ double nValue)
 {
-    PROPERTY *lpNewProp;
-    SIZE_T nNameLen;
+    LPPROPERTY lpProp;
+    HRESULT hRes;
 
     if (szNameA == NULL)
     {
         return E_POINTER;
     }
-    if (*szNameA == 0)
+    hRes = AddProperty(szNameA, StrLenA(szNameA), &lpProp);
+    if (FAILED(hRes))
     {
-        return E_INVALIDARG;
-    }
-    // create new property
-    nNameLen = StrLenA(szNameA) + 1;
-    lpNewProp = (PROPERTY *)MX_MALLOC(sizeof(PROPERTY) + nNameLen);
-    if (lpNewProp == NULL)
-    {
-        return E_OUTOFMEMORY;
-    }
-    lpNewProp->szNameA = (LPSTR)(lpNewProp + 1);
-    MxMemCopy(lpNewProp->szNameA, szNameA, nNameLen);
-    lpNewProp->nType = eType::Double;
-    lpNewProp->u.dblValue = nValue;
-    if (Insert(lpNewProp) == FALSE)
-    {
-        MX_FREE(lpNewProp);
-        return E_OUTOFMEMORY;
+        return hRes;
     }
+    FreeValue(lpProp);
+    lpProp->nType = eType::Double;
+    lpProp->u.dblValue = nValue;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::SetString(_In_z_ LPCSTR szNameA, _In_z_ LPCSTR szValueA)
 {
-    PROPERTY *lpNewProp;
-    SIZE_T nNameLen, nValueLen;
+    LPPROPERTY lpProp;
+    LPSTR szNewValueA;
+    SIZE_T nValueLen;
+    HRESULT hRes;
 
     if (szNameA == NULL || szValueA == NULL)
     {
         return E_POINTER;
     }
-    if (*szNameA == 0)
-    {
-        return E_INVALIDARG;
-    }
-    // create new property
-    nNameLen = StrLenA(szNameA) + 1;
+    // copy the value first so the old one survives a failure
     nValueLen = StrLenA(szValueA) + 1;
-    lpNewProp = (PROPERTY *)MX_MALLOC(sizeof(PROPERTY) + nNameLen + nValueLen);
-    if (lpNewProp == NULL)
+    szNewValueA = (LPSTR)MX_MALLOC(nValueLen);
+    if (szNewValueA == NULL)
     {
         return E_OUTOFMEMORY;
     }
-    lpNewProp->szNameA = (LPSTR)(lpNewProp + 1);
-    MxMemCopy(lpNewProp->szNameA, szNameA, nNameLen);
-    lpNewProp->nType = eType::AnsiString;
-    lpNewProp->u.szValueA = (LPSTR)((LPBYTE)(lpNewProp + 1) + nNameLen);
-    MxMemCopy(lpNewProp->u.szValueA, szValueA, nValueLen);
-    if (Insert(lpNewProp) == FALSE)
+    ::MxMemCopy(szNewValueA, szValueA, nValueLen);
+    hRes = AddProperty(szNameA, StrLenA(szNameA), &lpProp);
+    if (FAILED(hRes))
     {
-        MX_FREE(lpNewProp);
-        return E_OUTOFMEMORY;
+        MX_FREE(szNewValueA);
+        return hRes;
     }
+    FreeValue(lpProp);
+    lpProp->nType = eType::AnsiString;
+    lpProp->u.szValueA = szNewValueA;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::SetString(_In_z_ LPCSTR szNameA, _In_z_ LPCWSTR szValueW)
 {
-    PROPERTY *lpNewProp;
-    SIZE_T nNameLen, nValueLen;
+    LPPROPERTY lpProp;
+    LPWSTR szNewValueW;
+    SIZE_T nValueLen;
+    HRESULT hRes;
 
     if (szNameA == NULL || szValueW == NULL)
     {
         return E_POINTER;
     }
-    if (*szNameA == 0)
-    {
-        return E_INVALIDARG;
-    }
-    // create new property
-    nNameLen = StrLenA(szNameA) + 1;
+    // copy the value first so the old one survives a failure
     nValueLen = (StrLenW(szValueW) + 1) * sizeof(WCHAR);
-    lpNewProp = (PROPERTY *)MX_MALLOC(sizeof(PROPERTY) + nNameLen + nValueLen);
-    if (lpNewProp == NULL)
+    szNewValueW = (LPWSTR)MX_MALLOC(nValueLen);
+    if (szNewValueW == NULL)
     {
         return E_OUTOFMEMORY;
     }
-    lpNewProp->szNameA = (LPSTR)(lpNewProp + 1);
-    MxMemCopy(lpNewProp->szNameA, szNameA, nNameLen);
-    lpNewProp->nType = eType::WideString;
-    lpNewProp->u.szValueW = (LPWSTR)((LPBYTE)(lpNewProp + 1) + nNameLen);
-    MxMemCopy(lpNewProp->u.szValueW, szValueW, nValueLen);
-    if (Insert(lpNewProp) == FALSE)
+    ::MxMemCopy(szNewValueW, szValueW, nValueLen);
+    hRes = AddProperty(szNameA, StrLenA(szNameA), &lpProp);
+    if (FAILED(hRes))
     {
-        MX_FREE(lpNewProp);
-        return E_OUTOFMEMORY;
+        MX_FREE(szNewValueW);
+        return hRes;
     }
+    FreeValue(lpProp);
+    lpProp->nType = eType::WideString;
+    lpProp->u.szValueW = szNewValueW;
     // done
     return S_OK;
 }
 
+SIZE_T CPropertyBag::GetCount() const
+{
+    return cPropertiesList.GetCount();
+}
+
 LPCSTR CPropertyBag::GetAt(_In_ SIZE_T nIndex) const
 {
     if (nIndex >= cPropertiesList.GetCount())
@@ -288,19 +338,19 @@ CPropertyBag::eType CPropertyBag::GetType(_In_ SIZE_T nIndex) const
 
 CPropertyBag::eType CPropertyBag::GetType(_In_z_ LPCSTR szNameA) const
 {
-    SIZE_T nIndex;
+    LPPROPERTY lpProp;
 
     if (szNameA == NULL || *szNameA == 0)
     {
         return eType::Undefined;
     }
-    nIndex = const_cast<CPropertyBag *>(this)->Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    lpProp = Find(szNameA);
+    if (lpProp == NULL)
     {
         return eType::Undefined;
     }
     // done
-    return cPropertiesList[nIndex]->nType;
+    return lpProp->nType;
 }
 
 HRESULT CPropertyBag::GetDWord(_In_ SIZE_T nIndex, _Out_ DWORD &dwValue, _In_opt_ DWORD dwDefValue)
@@ -385,7 +435,7 @@ HRESULT CPropertyBag::GetString(_In_ SIZE_T nIndex, _Out_ LPCWSTR &szValueW, _In
 
 HRESULT CPropertyBag::GetDWord(_In_z_ LPCSTR szNameA, _Out_ DWORD &dwValue, _In_opt_ DWORD dwDefValue)
 {
-    SIZE_T nIndex;
+    LPPROPERTY lpProp;
 
     dwValue = dwDefValue;
     if (szNameA == NULL)
@@ -396,23 +446,23 @@ HRESULT CPropertyBag::GetDWord(_In_z_ LPCSTR szNameA, _Out_ DWORD &dwValue, _In_
     {
         return E_INVALIDARG;
     }
-    nIndex = Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    lpProp = Find(szNameA);
+    if (lpProp == NULL)
     {
         return MX_E_NotFound;
     }
-    if (cPropertiesList[nIndex]->nType != eType::DWord)
+    if (lpProp->nType != eType::DWord)
     {
         return E_FAIL;
     }
-    dwValue = cPropertiesList[nIndex]->u.dwValue;
+    dwValue = lpProp->u.dwValue;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::GetQWord(_In_z_ LPCSTR szNameA, _Out_ ULONGLONG &ullValue, _In_opt_ ULONGLONG ullDefValue)
 {
-    SIZE_T nIndex;
+    LPPROPERTY lpProp;
 
     ullValue = ullDefValue;
     if (szNameA == NULL)
@@ -423,23 +473,23 @@ HRESULT CPropertyBag::GetQWord(_In_z_ LPCSTR szNameA, _Out_ ULONGLONG &ullValue,
     {
         return E_INVALIDARG;
     }
-    nIndex = Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    lpProp = Find(szNameA);
+    if (lpProp == NULL)
     {
         return MX_E_NotFound;
     }
-    if (cPropertiesList[nIndex]->nType != eType::QWord)
+    if (lpProp->nType != eType::QWord)
     {
         return E_FAIL;
     }
-    ullValue = cPropertiesList[nIndex]->u.ullValue;
+    ullValue = lpProp->u.ullValue;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::GetDouble(_In_z_ LPCSTR szNameA, _Out_ double &nValue, _In_opt_ double nDefValue)
 {
-    SIZE_T nIndex;
+    LPPROPERTY lpProp;
 
     nValue = nDefValue;
     if (szNameA == NULL)
@@ -450,23 +500,23 @@ HRESULT CPropertyBag::GetDouble(_In_z_ LPCSTR szNameA, _Out_ double &nValue, _In
     {
         return E_INVALIDARG;
     }
-    nIndex = Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    lpProp = Find(szNameA);
+    if (lpProp == NULL)
     {
         return MX_E_NotFound;
     }
-    if (cPropertiesList[nIndex]->nType != eType::Double)
+    if (lpProp->nType != eType::Double)
     {
         return E_FAIL;
     }
-    nValue = cPropertiesList[nIndex]->u.dblValue;
+    nValue = lpProp->u.dblValue;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::GetString(_In_z_ LPCSTR szNameA, _Out_ LPCSTR &szValueA, _In_opt_z_ LPCSTR szDefValueA)
 {
-    SIZE_T nIndex;
+    LPPROPERTY lpProp;
 
     szValueA = szDefValueA;
     if (szNameA == NULL)
@@ -477,23 +527,23 @@ HRESULT CPropertyBag::GetString(_In_z_ LPCSTR szNameA, _Out_ LPCSTR &szValueA, _
     {
         return E_INVALIDARG;
     }
-    nIndex = Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    lpProp = Find(szNameA);
+    if (lpProp == NULL)
     {
         return MX_E_NotFound;
     }
-    if (cPropertiesList[nIndex]->nType != eType::AnsiString)
+    if (lpProp->nType != eType::AnsiString)
     {
         return E_FAIL;
     }
-    szValueA = cPropertiesList[nIndex]->u.szValueA;
+    szValueA = lpProp->u.szValueA;
     // done
     return S_OK;
 }
 
 HRESULT CPropertyBag::GetString(_In_z_ LPCSTR szNameA, _Out_ LPCWSTR &szValueW, _In_opt_z_ LPCWSTR szDefValueW)
 {
-    SIZE_T nIndex;
+    LPPROPERTY lpProp;
 
     szValueW = szDefValueW;
     if (szNameA == NULL)
@@ -504,38 +554,595 @@ HRESULT CPropertyBag::GetString(_In_z_ LPCSTR szNameA, _Out_ LPCWSTR &szValueW,
     {
         return E_INVALIDARG;
     }
-    nIndex = Find(szNameA);
-    if (nIndex == (SIZE_T)-1)
+    lpProp = Find(szNameA);
+    if (lpProp == NULL)
     {
         return MX_E_NotFound;
     }
-    if (cPropertiesList[nIndex]->nType != eType::WideString)
+    if (lpProp->nType != eType::WideString)
     {
         return E_FAIL;
     }
-    szValueW = cPropertiesList[nIndex]->u.szValueW;
+    szValueW = lpProp->u.szValueW;
     // done
     return S_OK;
 }
 
-BOOL CPropertyBag::Insert(_In_ PROPERTY *lpNewProp)
+SIZE_T CPropertyBag::GetSerializedSize() const
 {
-    SIZE_T nIndex;
+    SIZE_T nCount, nSize;
 
-    nIndex = Find(lpNewProp->szNameA);
-    if (nIndex != (SIZE_T)-1)
+    nSize = sizeof(SERIALIZED_HEADER);
+    nCount = cPropertiesList.GetCount();
+    for (SIZE_T i = 0; i < nCount; i++)
     {
-        PROPERTY *lpOldProp = cPropertiesList.GetElementAt(nIndex);
-        cPropertiesList[nIndex] = lpNewProp;
-        MX_FREE(lpOldProp);
-        return TRUE;
+        LPPROPERTY lpProp = cPropertiesList.GetElementAt(i);
+
+        nSize += 1 + sizeof(WORD) + lpProp->nNameLen;
+        switch (lpProp->nType)
+        {
+            case eType::DWord:
+                nSize += sizeof(DWORD);
+                break;
+            case eType::QWord:
+                nSize += sizeof(ULONGLONG);
+                break;
+            case eType::Double:
+                nSize += sizeof(double);
+                break;
+            case eType::AnsiString:
+                nSize += sizeof(DWORD) + StrLenA(lpProp->u.szValueA);
+                break;
+            case eType::WideString:
+                nSize += sizeof(DWORD) + StrLenW(lpProp->u.szValueW) * sizeof(WCHAR);
+                break;
+        }
     }
-    return cPropertiesList.SortedInsert(lpNewProp, &CPropertyBag::InsertCompareFunc, NULL);
+    return nSize;
 }
 
-SIZE_T CPropertyBag::Find(_In_z_ LPCSTR szNameA)
+HRESULT CPropertyBag::Serialize(_Out_writes_bytes_(nDestSize) LPVOID lpDest, _In_ SIZE_T nDestSize) const
 {
-    return cPropertiesList.BinarySearch(szNameA, &CPropertyBag::SearchCompareFunc, NULL);
+    SERIALIZED_HEADER sHeader;
+    LPBYTE p, lpEnd;
+    SIZE_T nCount, nLen;
+
+    if (lpDest == NULL && nDestSize > 0)
+    {
+        return E_POINTER;
+    }
+    nCount = cPropertiesList.GetCount();
+    if (nDestSize < sizeof(SERIALIZED_HEADER) || nCount > 0xFFFFFFFF)
+    {
+        return MX_E_BufferOverflow;
+    }
+
+    p = (LPBYTE)lpDest;
+    lpEnd = p + nDestSize;
+
+    sHeader.dwMagic = SERIALIZED_MAGIC;
+    sHeader.wVersion = SERIALIZED_VERSION;
+    sHeader.wReserved = 0;
+    sHeader.dwCount = (DWORD)nCount;
+    ::MxMemCopy(p, &sHeader, sizeof(sHeader));
+    p += sizeof(sHeader);
+
+    for (SIZE_T i = 0; i < nCount; i++)
+    {
+        LPPROPERTY lpProp = cPropertiesList.GetElementAt(i);
+        LPCVOID lpValue = NULL;
+        SIZE_T nValueSize = 0;
+        BYTE nType = SERIALIZED_TYPE_NULL;
+        DWORD dwLen;
+
+        if ((SIZE_T)(lpEnd - p) < 1 + sizeof(WORD) + lpProp->nNameLen)
+        {
+            return MX_E_BufferOverflow;
+        }
+        switch (lpProp->nType)
+        {
+            case eType::DWord:
+                nType = SERIALIZED_TYPE_DWORD;
+                lpValue = &(lpProp->u.dwValue);
+                nValueSize = sizeof(DWORD);
+                break;
+            case eType::QWord:
+                nType = SERIALIZED_TYPE_QWORD;
+                lpValue = &(lpProp->u.ullValue);
+                nValueSize = sizeof(ULONGLONG);
+                break;
+            case eType::Double:
+                nType = SERIALIZED_TYPE_DOUBLE;
+                lpValue = &(lpProp->u.dblValue);
+                nValueSize = sizeof(double);
+                break;
+            case eType::AnsiString:
+                nType = SERIALIZED_TYPE_ANSISTRING;
+                lpValue = lpProp->u.szValueA;
+                nValueSize = StrLenA(lpProp->u.szValueA);
+                break;
+            case eType::WideString:
+                nType = SERIALIZED_TYPE_WIDESTRING;
+                lpValue = lpProp->u.szValueW;
+                nValueSize = StrLenW(lpProp->u.szValueW) * sizeof(WCHAR);
+                break;
+        }
+
+        *p++ = nType;
+        *((WORD UNALIGNED *)p) = (WORD)(lpProp->nNameLen);
+        p += sizeof(WORD);
+        ::MxMemCopy(p, lpProp->szNameA, lpProp->nNameLen);
+        p += lpProp->nNameLen;
+
+        if (nType == SERIALIZED_TYPE_ANSISTRING || nType == SERIALIZED_TYPE_WIDESTRING)
+        {
+            nLen = (nType == SERIALIZED_TYPE_WIDESTRING) ? (nValueSize / sizeof(WCHAR)) : nValueSize;
+            if (nLen > 0xFFFFFFFF || (SIZE_T)(lpEnd - p) < sizeof(DWORD))
+            {
+                return MX_E_BufferOverflow;
+            }
+            dwLen = (DWORD)nLen;
+            ::MxMemCopy(p, &dwLen, sizeof(DWORD));
+            p += sizeof(DWORD);
+        }
+        if ((SIZE_T)(lpEnd - p) < nValueSize)
+        {
+            return MX_E_BufferOverflow;
+        }
+        if (nValueSize > 0)
+        {
+            ::MxMemCopy(p, lpValue, nValueSize);
+            p += nValueSize;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CPropertyBag::Deserialize(_In_reads_bytes_(nDataLen) LPCVOID lpData, _In_ SIZE_T nDataLen)
+{
+    SERIALIZED_HEADER sHeader;
+    LPPROPERTY lpProp;
+    const BYTE *p, *lpEnd, *lpName;
+    SIZE_T nNameLen, nValueSize;
+    DWORD dwLen;
+    BYTE nType;
+    LPVOID lpValue;
+    HRESULT hRes;
+
+    Reset();
+
+    if (lpData == NULL && nDataLen > 0)
+    {
+        return E_POINTER;
+    }
+    if (nDataLen < sizeof(SERIALIZED_HEADER))
+    {
+        return MX_E_InvalidData;
+    }
+    ::MxMemCopy(&sHeader, lpData, sizeof(sHeader));
+    if (sHeader.dwMagic != SERIALIZED_MAGIC || sHeader.wVersion != SERIALIZED_VERSION)
+    {
+        return MX_E_InvalidData;
+    }
+    p = (const BYTE *)lpData + sizeof(sHeader);
+    lpEnd = (const BYTE *)lpData + nDataLen;
+
+    for (DWORD i = 0; i < sHeader.dwCount; i++)
+    {
+        if ((SIZE_T)(lpEnd - p) < 1 + sizeof(WORD))
+        {
+            hRes = MX_E_InvalidData;
+            goto on_error;
+        }
+        nType = *p++;
+        nNameLen = (SIZE_T)*((WORD UNALIGNED *)p);
+        p += sizeof(WORD);
+        if (nNameLen == 0 || (SIZE_T)(lpEnd - p) < nNameLen)
+        {
+            hRes = MX_E_InvalidData;
+            goto on_error;
+        }
+        lpName = p;
+        p += nNameLen;
+
+        lpValue = NULL;
+        switch (nType)
+        {
+            case SERIALIZED_TYPE_NULL:
+                nValueSize = 0;
+                break;
+
+            case SERIALIZED_TYPE_DWORD:
+                nValueSize = sizeof(DWORD);
+                break;
+
+            case SERIALIZED_TYPE_QWORD:
+            case SERIALIZED_TYPE_DOUBLE:
+                nValueSize = sizeof(ULONGLONG);
+                break;
+
+            case SERIALIZED_TYPE_ANSISTRING:
+            case SERIALIZED_TYPE_WIDESTRING:
+                if ((SIZE_T)(lpEnd - p) < sizeof(DWORD))
+                {
+                    hRes = MX_E_InvalidData;
+                    goto on_error;
+                }
+                ::MxMemCopy(&dwLen, p, sizeof(DWORD));
+                p += sizeof(DWORD);
+                if (nType == SERIALIZED_TYPE_WIDESTRING)
+                {
+                    if ((SIZE_T)dwLen > (SIZE_T)(lpEnd - p) / sizeof(WCHAR))
+                    {
+                        hRes = MX_E_InvalidData;
+                        goto on_error;
+                    }
+                    nValueSize = (SIZE_T)dwLen * sizeof(WCHAR);
+                    lpValue = MX_MALLOC(nValueSize + sizeof(WCHAR));
+                    if (lpValue == NULL)
+                    {
+                        hRes = E_OUTOFMEMORY;
+                        goto on_error;
+                    }
+                    ::MxMemCopy(lpValue, p, nValueSize);
+                    ((LPWSTR)lpValue)[dwLen] = 0;
+                }
+                else
+                {
+                    if ((SIZE_T)dwLen > (SIZE_T)(lpEnd - p))
+                    {
+                        hRes = MX_E_InvalidData;
+                        goto on_error;
+                    }
+                    nValueSize = (SIZE_T)dwLen;
+                    lpValue = MX_MALLOC(nValueSize + 1);
+                    if (lpValue == NULL)
+                    {
+                        hRes = E_OUTOFMEMORY;
+                        goto on_error;
+                    }
+                    ::MxMemCopy(lpValue, p, nValueSize);
+                    ((LPSTR)lpValue)[dwLen] = 0;
+                }
+                break;
+
+            default:
+                hRes = MX_E_InvalidData;
+                goto on_error;
+        }
+        if ((SIZE_T)(lpEnd - p) < nValueSize)
+        {
+            hRes = MX_E_InvalidData;
+            goto on_error;
+        }
+
+        hRes = AddProperty((LPCSTR)lpName, nNameLen, &lpProp);
+        if (FAILED(hRes))
+        {
+            MX_FREE(lpValue);
+            goto on_error;
+        }
+        FreeValue(lpProp);
+        switch (nType)
+        {
+            case SERIALIZED_TYPE_NULL:
+                lpProp->nType = eType::Null;
+                break;
+
+            case SERIALIZED_TYPE_DWORD:
+                lpProp->nType = eType::DWord;
+                ::MxMemCopy(&(lpProp->u.dwValue), p, sizeof(DWORD));
+                break;
+
+            case SERIALIZED_TYPE_QWORD:
+                lpProp->nType = eType::QWord;
+                ::MxMemCopy(&(lpProp->u.ullValue), p, sizeof(ULONGLONG));
+                break;
+
+            case SERIALIZED_TYPE_DOUBLE:
+                lpProp->nType = eType::Double;
+                ::MxMemCopy(&(lpProp->u.dblValue), p, sizeof(double));
+                break;
+
+            case SERIALIZED_TYPE_ANSISTRING:
+                lpProp->nType = eType::AnsiString;
+                lpProp->u.szValueA = (LPSTR)lpValue;
+                break;
+
+            case SERIALIZED_TYPE_WIDESTRING:
+                lpProp->nType = eType::WideString;
+                lpProp->u.szValueW = (LPWSTR)lpValue;
+                break;
+        }
+        p += nValueSize;
+    }
+    if (p != lpEnd)
+    {
+        hRes = MX_E_InvalidData;
+        goto on_error;
+    }
+
+    // done
+    return S_OK;
+
+on_error:
+    Reset();
+    return hRes;
+}
+
+HRESULT CPropertyBag::AddProperty(_In_reads_(nNameLen) LPCSTR szNameA, _In_ SIZE_T nNameLen, _Out_ LPPROPERTY *lplpProp)
+{
+    LPPROPERTY lpProp;
+    SIZE_T nSlot, nMask;
+    ULONG nHash;
+
+    *lplpProp = NULL;
+
+    if (nNameLen == 0)
+    {
+        return E_INVALIDARG;
+    }
+    if (nNameLen > MAX_NAME_LENGTH)
+    {
+        return MX_E_BadLength;
+    }
+
+    nHash = HashName(szNameA, nNameLen);
+    lpProp = Find(szNameA, nNameLen, nHash);
+    if (lpProp != NULL)
+    {
+        *lplpProp = lpProp;
+        return S_OK;
+    }
+
+    // keep the load factor at or below one half
+    if ((cPropertiesList.GetCount() + 1) * 2 > nHashTableSize)
+    {
+        if (GrowHashTable() == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    lpProp = (LPPROPERTY)ArenaAlloc(sizeof(PROPERTY) + nNameLen);
+    if (lpProp == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    lpProp->nType = eType::Undefined;
+    lpProp->nHash = nHash;
+    lpProp->nNameLen = nNameLen;
+    ::MxMemCopy(lpProp->szNameA, szNameA, nNameLen);
+    lpProp->szNameA[nNameLen] = 0;
+    if (cPropertiesList.AddElement(lpProp) == FALSE)
+    {
+        nArenaWastedBytes += ALIGN_SIZE(sizeof(PROPERTY) + nNameLen);
+        return E_OUTOFMEMORY;
+    }
+
+    nMask = nHashTableSize - 1;
+    nSlot = (SIZE_T)nHash & nMask;
+    while (lplpHashTable[nSlot] != NULL)
+    {
+        nSlot = (nSlot + 1) & nMask;
+    }
+    lplpHashTable[nSlot] = lpProp;
+
+    // done
+    *lplpProp = lpProp;
+    return S_OK;
+}
+
+CPropertyBag::LPPROPERTY CPropertyBag::Find(_In_reads_(nNameLen) LPCSTR szNameA, _In_ SIZE_T nNameLen, _In_ ULONG nHash) const
+{
+    LPPROPERTY lpProp;
+    SIZE_T nSlot, nMask, i;
+
+    if (nHashTableSize == 0)
+    {
+        return NULL;
+    }
+    nMask = nHashTableSize - 1;
+    for (nSlot = (SIZE_T)nHash & nMask; (lpProp = lplpHashTable[nSlot]) != NULL; nSlot = (nSlot + 1) & nMask)
+    {
+        if (lpProp->nHash == nHash && lpProp->nNameLen == nNameLen)
+        {
+            for (i = 0; i < nNameLen; i++)
+            {
+                if (TO_LOWER(lpProp->szNameA[i]) != TO_LOWER(szNameA[i]))
+                {
+                    break;
+                }
+            }
+            if (i == nNameLen)
+            {
+                return lpProp;
+            }
+        }
+    }
+    return NULL;
+}
+
+CPropertyBag::LPPROPERTY CPropertyBag::Find(_In_z_ LPCSTR szNameA) const
+{
+    SIZE_T nNameLen;
+
+    nNameLen = StrLenA(szNameA);
+    return Find(szNameA, nNameLen, HashName(szNameA, nNameLen));
+}
+
+BOOL CPropertyBag::GrowHashTable()
+{
+    LPPROPERTY *lplpNewHashTable;
+    SIZE_T nNewSize;
+
+    nNewSize = (nHashTableSize > 0) ? (nHashTableSize << 1) : HASHTABLE_MIN_SIZE;
+    lplpNewHashTable = (LPPROPERTY *)MX_MALLOC(nNewSize * sizeof(LPPROPERTY));
+    if (lplpNewHashTable == NULL)
+    {
+        return FALSE;
+    }
+    MX_FREE(lplpHashTable);
+    lplpHashTable = lplpNewHashTable;
+    nHashTableSize = nNewSize;
+    RebuildHashTable();
+    return TRUE;
+}
+
+VOID CPropertyBag::RebuildHashTable()
+{
+    SIZE_T nCount, nSlot, nMask;
+
+    ::MxMemSet(lplpHashTable, 0, nHashTableSize * sizeof(LPPROPERTY));
+    nMask = nHashTableSize - 1;
+    nCount = cPropertiesList.GetCount();
+    for (SIZE_T i = 0; i < nCount; i++)
+    {
+        LPPROPERTY lpProp = cPropertiesList.GetElementAt(i);
+
+        nSlot = (SIZE_T)(lpProp->nHash) & nMask;
+        while (lplpHashTable[nSlot] != NULL)
+        {
+            nSlot = (nSlot + 1) & nMask;
+        }
+        lplpHashTable[nSlot] = lpProp;
+    }
+    return;
+}
+
+LPVOID CPropertyBag::ArenaAlloc(_In_ SIZE_T nSize)
+{
+    LPARENA_BLOCK lpBlock;
+    SIZE_T nBlockSize;
+    LPVOID lpPtr;
+
+    nSize = ALIGN_SIZE(nSize);
+    if (lpArena == NULL || lpArena->nSize - lpArena->nUsed < nSize)
+    {
+        // blocks double in size so small bags stay small and big ones do few allocations
+        nBlockSize = (lpArena != NULL) ? (lpArena->nSize << 1) : ARENA_MIN_BLOCK_SIZE;
+        if (nBlockSize > ARENA_MAX_BLOCK_SIZE)
+        {
+            nBlockSize = ARENA_MAX_BLOCK_SIZE;
+        }
+        if (nBlockSize < nSize)
+        {
+            nBlockSize = nSize;
+        }
+        lpBlock = (LPARENA_BLOCK)MX_MALLOC(ALIGN_SIZE(sizeof(ARENA_BLOCK)) + nBlockSize);
+        if (lpBlock == NULL)
+        {
+            return NULL;
+        }
+        lpBlock->nUsed = 0;
+        lpBlock->nSize = nBlockSize;
+        if (lpArena != NULL)
+        {
+            // the remaining space of the previous block is lost
+            nArenaWastedBytes += lpArena->nSize - lpArena->nUsed;
+        }
+        lpBlock->lpNext = lpArena;
+        lpArena = lpBlock;
+    }
+
+    lpPtr = (LPBYTE)lpArena + ALIGN_SIZE(sizeof(ARENA_BLOCK)) + lpArena->nUsed;
+    lpArena->nUsed += nSize;
+    nArenaUsedBytes += nSize;
+    return lpPtr;
+}
+
+VOID CPropertyBag::CompactArena()
+{
+    LPARENA_BLOCK lpOldArena, lpBlock;
+    LPPROPERTY lpNewProp;
+    SIZE_T nCount, nSize, nTotalSize;
+
+    // move the live properties into a single block that fits them all so the copy cannot fail halfway
+    nTotalSize = 0;
+    nCount = cPropertiesList.GetCount();
+    for (SIZE_T i = 0; i < nCount; i++)
+    {
+        nTotalSize += ALIGN_SIZE(sizeof(PROPERTY) + cPropertiesList.GetElementAt(i)->nNameLen);
+    }
+    if (nTotalSize == 0)
+    {
+        FreeArena();
+        return;
+    }
+    lpBlock = (LPARENA_BLOCK)MX_MALLOC(ALIGN_SIZE(sizeof(ARENA_BLOCK)) + nTotalSize);
+    if (lpBlock == NULL)
+    {
+        return; // try again on the next clear
+    }
+    lpBlock->lpNext = NULL;
+    lpBlock->nUsed = 0;
+    lpBlock->nSize = nTotalSize;
+
+    lpOldArena = lpArena;
+    lpArena = lpBlock;
+    nArenaUsedBytes = nArenaWastedBytes = 0;
+    for (SIZE_T i = 0; i < nCount; i++)
+    {
+        LPPROPERTY lpProp = cPropertiesList.GetElementAt(i);
+
+        nSize = sizeof(PROPERTY) + lpProp->nNameLen;
+        lpNewProp = (LPPROPERTY)ArenaAlloc(nSize);
+        ::MxMemCopy(lpNewProp, lpProp, nSize);
+        cPropertiesList[i] = lpNewProp;
+    }
+
+    while (lpOldArena != NULL)
+    {
+        LPARENA_BLOCK lpNext = lpOldArena->lpNext;
+
+        MX_FREE(lpOldArena);
+        lpOldArena = lpNext;
+    }
+
+    RebuildHashTable();
+    return;
+}
+
+VOID CPropertyBag::FreeArena()
+{
+    while (lpArena != NULL)
+    {
+        LPARENA_BLOCK lpNext = lpArena->lpNext;
+
+        MX_FREE(lpArena);
+        lpArena = lpNext;
+    }
+    nArenaUsedBytes = nArenaWastedBytes = 0;
+    return;
+}
+
+VOID CPropertyBag::FreeValue(_In_ LPPROPERTY lpProp)
+{
+    if (lpProp->nType == eType::AnsiString)
+    {
+        MX_FREE(lpProp->u.szValueA);
+    }
+    else if (lpProp->nType == eType::WideString)
+    {
+        MX_FREE(lpProp->u.szValueW);
+    }
+    lpProp->nType = eType::Undefined;
+    return;
+}
+
+ULONG CPropertyBag::HashName(_In_reads_(nNameLen) LPCSTR szNameA, _In_ SIZE_T nNameLen)
+{
+    ULONG nHash = 0x811C9DC5UL;
+
+    // case-insensitive FNV-1a
+    for (SIZE_T i = 0; i < nNameLen; i++)
+    {
+        nHash ^= (ULONG)(BYTE)TO_LOWER(szNameA[i]);
+        nHash *= 0x01000193UL;
+    }
+    return nHash;
 }
 
 } // namespace MX
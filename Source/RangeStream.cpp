@@ -0,0 +1,157 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\Include\RangeStream.h"
+
+ //-----------------------------------------------------------
+
+namespace MX {
+
+CRangeStream::CRangeStream() : CStream(), CNonCopyableObj()
+{
+    nOffset = nLength = nCurrPos = 0;
+    return;
+}
+
+CRangeStream::~CRangeStream()
+{
+    Close();
+    return;
+}
+
+HRESULT CRangeStream::Create(_In_ CStream *lpStream, _In_ ULONGLONG _nOffset, _In_ ULONGLONG _nLength)
+{
+    ULONGLONG nStreamLength;
+
+    Close();
+    if (lpStream == NULL)
+    {
+        return E_POINTER;
+    }
+    nStreamLength = lpStream->GetLength();
+    if (_nOffset > nStreamLength || _nLength > nStreamLength - _nOffset)
+    {
+        return E_INVALIDARG;
+    }
+    cStream = lpStream;
+    nOffset = _nOffset;
+    nLength = _nLength;
+    // done
+    return S_OK;
+}
+
+VOID CRangeStream::Close()
+{
+    cStream.Release();
+    nOffset = nLength = nCurrPos = 0;
+    return;
+}
+
+HRESULT CRangeStream::Read(_Out_ LPVOID lpDest, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesRead, _In_opt_ ULONGLONG nStartOffset)
+{
+    ULONGLONG nReadPos;
+    HRESULT hRes;
+
+    nBytesRead = 0;
+    if (lpDest == NULL)
+    {
+        return E_POINTER;
+    }
+    if (!cStream)
+    {
+        return MX_E_NotReady;
+    }
+    nReadPos = (nStartOffset == ULONGLONG_MAX) ? nCurrPos : nStartOffset;
+    if (nReadPos >= nLength)
+    {
+        return MX_E_EndOfFileReached;
+    }
+    if ((ULONGLONG)nBytes > nLength - nReadPos)
+    {
+        nBytes = (SIZE_T)(nLength - nReadPos);
+    }
+
+    hRes = cStream->Read(lpDest, nBytes, nBytesRead, nOffset + nReadPos);
+    if (SUCCEEDED(hRes) && nStartOffset == ULONGLONG_MAX)
+    {
+        nCurrPos += (ULONGLONG)nBytesRead;
+    }
+    // done
+    return hRes;
+}
+
+HRESULT CRangeStream::Write(_In_ LPCVOID lpSrc, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesWritten, _In_opt_ ULONGLONG nStartOffset)
+{
+    nBytesWritten = 0;
+    return E_NOTIMPL;
+}
+
+HRESULT CRangeStream::Seek(_In_ ULONGLONG nPosition, _In_opt_ CStream::eSeekMethod nMethod)
+{
+    switch (nMethod)
+    {
+        case eSeekMethod::Start:
+            if (nPosition > nLength)
+            {
+                nPosition = nLength;
+            }
+            break;
+
+        case eSeekMethod::Current:
+            if ((LONGLONG)nPosition >= 0)
+            {
+                if (nPosition > nLength - nCurrPos)
+                {
+                    nPosition = nLength - nCurrPos;
+                }
+                nPosition += nCurrPos;
+            }
+            else
+            {
+                nPosition = (~nPosition) + 1;
+                if (nPosition > nCurrPos)
+                {
+                    return E_FAIL;
+                }
+                nPosition = nCurrPos - nPosition;
+            }
+            break;
+
+        case eSeekMethod::End:
+            if (nPosition > nLength)
+            {
+                nPosition = nLength;
+            }
+            nPosition = nLength - nPosition;
+            break;
+
+        default:
+            return E_INVALIDARG;
+    }
+    nCurrPos = nPosition;
+    // done
+    return S_OK;
+}
+
+ULONGLONG CRangeStream::GetLength() const
+{
+    return nLength;
+}
+
+} // namespace MX
@@ -32,6 +32,15 @@
 #endif // STATUS_PROCEDURE_NOT_FOUND
 
 #define FASTLOCK_SPIN_COUNT 2048
+#define FASTLOCK_MIN_SPIN_COUNT 64
+
+#define PARKING_SLOTS_COUNT 64 // must be a power of 2
+
+// NOTE: Thread ids never use the top bit so a FastLock uses it to tell the owner that some thread may be parked.
+#define FASTLOCK_PARKED_FLAG ((LONG)0x80000000)
+
+#define RWLOCK_MAX_READER_SLOTS 64
+#define RWLOCK_SLOT_SIZE 64 // a cache line
 
 //-----------------------------------------------------------
 
@@ -46,6 +55,16 @@ typedef struct
 
 typedef int (*_PIFV)(void);
 
+// NOTE: Threads that stop spinning wait on the lock's address. Bitmask locks have no spare bit to flag parked threads
+//       so locks are hashed into a small table whose slots count the threads parked on a bitmask lock and keep the
+//       adaptive spin limit.
+typedef struct
+{
+    LONG volatile nWaiters;
+    LONG volatile nSpinLimit;
+    BYTE aPadding[RWLOCK_SLOT_SIZE - 2 * sizeof(LONG)];
+} PARKING_SLOT, *LPPARKING_SLOT;
+
 //-----------------------------------------------------------
 
 typedef NTSTATUS(NTAPI *lpfnRtlGetNativeSystemInformation)(_In_ ULONG SystemInformationClass, _Inout_ PVOID SystemInformation,
@@ -66,6 +85,12 @@ typedef VOID(WINAPI *lpfnAcquireSRWLockShared)(_Inout_ PSRWLOCK SRWLock);
 typedef BOOLEAN(WINAPI *lpfnTryAcquireSRWLockExclusive)(_Inout_ PSRWLOCK SRWLock);
 typedef BOOLEAN(WINAPI *lpfnTryAcquireSRWLockShared)(_Inout_ PSRWLOCK SRWLock);
 
+typedef BOOL(WINAPI *lpfnWaitOnAddress)(_In_ volatile VOID *Address, _In_ PVOID CompareAddress, _In_ SIZE_T AddressSize,
+                                        _In_opt_ DWORD dwMilliseconds);
+typedef VOID(WINAPI *lpfnWakeByAddressSingle)(_In_ PVOID Address);
+typedef VOID(WINAPI *lpfnWakeByAddressAll)(_In_ PVOID Address);
+typedef DWORD(WINAPI *lpfnGetCurrentProcessorNumber)();
+
 //-----------------------------------------------------------
 
 static LONG volatile nProcessorsCount = 0;
@@ -83,11 +108,31 @@ static lpfnAcquireSRWLockShared fnAcquireSRWLockShared = NULL;
 static lpfnTryAcquireSRWLockExclusive fnTryAcquireSRWLockExclusive = NULL;
 static lpfnTryAcquireSRWLockShared fnTryAcquireSRWLockShared = NULL;
 
+static lpfnWaitOnAddress fnWaitOnAddress = NULL;
+static lpfnWakeByAddressSingle fnWakeByAddressSingle = NULL;
+static lpfnWakeByAddressAll fnWakeByAddressAll = NULL;
+static lpfnGetCurrentProcessorNumber fnGetCurrentProcessorNumber = NULL;
+
+static PARKING_SLOT aParkingSlots[PARKING_SLOTS_COUNT] = { 0 };
+
+static struct
+{
+    LONGLONG volatile nContentions;
+    LONGLONG volatile nSpinAcquires;
+    LONGLONG volatile nParks;
+    LONGLONG volatile nReaderRetries;
+    LONGLONG volatile nWriterWaits;
+} sLockStats = { 0 };
+
 //-----------------------------------------------------------
 
 static int __cdecl InitializeKernel32Apis();
 static NTSTATUS GetRootDirHandle(_Out_ PHANDLE lphRootDir);
 
+static LPPARKING_SLOT GetParkingSlot(_In_ LONG volatile *lpnAddress);
+static VOID WaitForFastLock(_Inout_ LONG volatile *lpnLock, _In_ LONG nBitMask, _In_ LONG nTid);
+static VOID ParkOnAddress(_In_ LONG volatile *lpnAddress, _In_ LONG nCompareValue);
+
 //-----------------------------------------------------------
 
 MX_LINKER_FORCE_INCLUDE(___mx_waitable_init);
@@ -443,35 +488,11 @@ VOID FastLock_Initialize(_Inout_ _Interlocked_operand_ LONG volatile *lpnLock)
 VOID FastLock_Enter(_Inout_ _Interlocked_operand_ LONG volatile *lpnLock)
 {
     LONG nTid = (LONG)::MxGetCurrentThreadId();
-    LONG nCpuCount = __InterlockedRead(&nProcessorsCount);
 
-    for (;;)
+    if (_InterlockedCompareExchange(lpnLock, nTid, 0) != 0)
     {
-        if (_InterlockedCompareExchange(lpnLock, nTid, 0) == 0)
-        {
-            return;
-        }
-
-        if (nCpuCount > 1)
-        {
-            for (SIZE_T nSpin = 1; nSpin < FASTLOCK_SPIN_COUNT; nSpin <<= 1)
-            {
-                for (SIZE_T i = 0; i < nSpin; i++)
-                {
-                    ::YieldProcessor();
-                }
-
-                if (_InterlockedCompareExchange(lpnLock, nTid, 0) == 0)
-                {
-                    return;
-                }
-            }
-        }
-
-        ::SwitchToThread();
+        WaitForFastLock(lpnLock, -1L, nTid);
     }
-    // while (_InterlockedCompareExchange(lpnLock, nTid, 0) != 0)
-    //   _YieldProcessor();
     return;
 }
 
@@ -484,47 +505,27 @@ BOOL FastLock_TryEnter(_Inout_ _Interlocked_operand_ LONG volatile *lpnLock)
 
 VOID FastLock_Exit(_Inout_ _Interlocked_operand_ LONG volatile *lpnLock)
 {
-    _InterlockedExchange(lpnLock, 0);
+    // waiters set the flag in the lock before parking so the release only looks at the lock itself
+    if ((_InterlockedExchange(lpnLock, 0) & FASTLOCK_PARKED_FLAG) != 0 && fnWakeByAddressSingle != NULL)
+    {
+        fnWakeByAddressSingle((PVOID)lpnLock);
+    }
     return;
 }
 
 DWORD FastLock_IsActive(_Inout_ _Interlocked_operand_ LONG volatile *lpnLock)
 {
-    return (DWORD)__InterlockedRead(lpnLock);
+    return (DWORD)(__InterlockedRead(lpnLock) & ~FASTLOCK_PARKED_FLAG);
 }
 
 VOID FastLock_Bitmask_Enter(_Inout_ _Interlocked_operand_ LONG volatile *lpnLock, _In_ int nBitIndex)
 {
     LONG nMask = 1L << nBitIndex;
-    LONG nCpuCount = __InterlockedRead(&nProcessorsCount);
 
-    for (;;)
+    if ((_InterlockedOr(lpnLock, nMask) & nMask) != 0)
     {
-        if ((_InterlockedOr(lpnLock, nMask) & nMask) == 0)
-        {
-            return;
-        }
-
-        if (nCpuCount > 1)
-        {
-            for (SIZE_T nSpin = 1; nSpin < FASTLOCK_SPIN_COUNT; nSpin <<= 1)
-            {
-                for (SIZE_T i = 0; i < nSpin; i++)
-                {
-                    ::YieldProcessor();
-                }
-
-                if ((_InterlockedOr(lpnLock, nMask) & nMask) == 0)
-                {
-                    return;
-                }
-            }
-        }
-
-        ::SwitchToThread();
+        WaitForFastLock(lpnLock, nMask, 0);
     }
-    // while ((_InterlockedOr(lpnLock, nMask) & nMask) != 0)
-    //   _YieldProcessor();
     return;
 }
 
@@ -540,6 +541,12 @@ VOID FastLock_Bitmask_Exit(_Inout_ _Interlocked_operand_ LONG volatile *lpnLock,
     LONG nMask = 1L << nBitIndex;
 
     _InterlockedAnd(lpnLock, ~nMask);
+
+    // waiters for other bits of the same value may be parked on it too so wake all of them
+    if (GetParkingSlot(lpnLock)->nWaiters != 0 && fnWakeByAddressAll != NULL)
+    {
+        fnWakeByAddressAll((PVOID)lpnLock);
+    }
     return;
 }
 
@@ -711,6 +718,184 @@ VOID SlimRWL_ReleaseExclusive(_In_ LPRWLOCK lpLock)
 
 //-----------------------------------------------------------
 
+CReaderBiasedRWLock::CReaderBiasedRWLock() : CBaseMemObj(), CNonCopyableObj()
+{
+    ULONG nCount;
+
+    nCount = (IsMultiProcessor() != FALSE) ? (ULONG)__InterlockedRead(&nProcessorsCount) : 1;
+    if (nCount > RWLOCK_MAX_READER_SLOTS)
+    {
+        nCount = RWLOCK_MAX_READER_SLOTS;
+    }
+    nSlotsMask = 0;
+    while (nSlotsMask + 1 < nCount)
+    {
+        nSlotsMask = (nSlotsMask << 1) | 1;
+    }
+
+    // slots are spread one per cache line so readers on different processors do not share them
+    lpSlots = lpSlotsBuffer = NULL;
+    nSingleSlot = nWriterMutex = nWriterActive = 0;
+    if (nSlotsMask > 0)
+    {
+        lpSlotsBuffer = (LPBYTE)MX_MALLOC((SIZE_T)(nSlotsMask + 2) * RWLOCK_SLOT_SIZE);
+        if (lpSlotsBuffer != NULL)
+        {
+            lpSlots = (LPBYTE)(((ULONG_PTR)lpSlotsBuffer + RWLOCK_SLOT_SIZE - 1) & (~((ULONG_PTR)RWLOCK_SLOT_SIZE - 1)));
+            ::MxMemSet(lpSlots, 0, (SIZE_T)(nSlotsMask + 1) * RWLOCK_SLOT_SIZE);
+        }
+    }
+    if (lpSlots == NULL)
+    {
+        nSlotsMask = 0;
+        lpSlots = (LPBYTE)&nSingleSlot;
+    }
+    return;
+}
+
+CReaderBiasedRWLock::~CReaderBiasedRWLock()
+{
+    MX_ASSERT(nWriterActive == 0);
+    MX_FREE(lpSlotsBuffer);
+    return;
+}
+
+ULONG CReaderBiasedRWLock::AcquireShared()
+{
+    ULONG nSlot;
+
+    while (TryAcquireShared(&nSlot) == FALSE)
+    {
+        _InterlockedIncrement64(&(sLockStats.nReaderRetries));
+        while (nWriterActive != 0)
+        {
+            ParkOnAddress(&nWriterActive, 1);
+        }
+    }
+    return nSlot;
+}
+
+BOOL CReaderBiasedRWLock::TryAcquireShared(_Out_ PULONG lpnSlot)
+{
+    LONG volatile *lpnCounter;
+    ULONG nSlot;
+
+    nSlot = ((fnGetCurrentProcessorNumber != NULL) ? fnGetCurrentProcessorNumber()
+                                                   : (ULONG)(::MxGetCurrentThreadId() >> 2)) & nSlotsMask;
+    lpnCounter = GetSlotCounter(nSlot);
+
+    _InterlockedIncrement(lpnCounter);
+    if (nWriterActive == 0)
+    {
+        *lpnSlot = nSlot;
+        return TRUE;
+    }
+
+    // a writer is active or waiting for readers to leave
+    ReleaseShared(nSlot);
+    *lpnSlot = 0;
+    return FALSE;
+}
+
+VOID CReaderBiasedRWLock::ReleaseShared(_In_ ULONG nSlot)
+{
+    LONG volatile *lpnCounter = GetSlotCounter(nSlot);
+
+    MX_ASSERT(nSlot <= nSlotsMask);
+    _InterlockedDecrement(lpnCounter);
+    if (nWriterActive != 0 && fnWakeByAddressSingle != NULL)
+    {
+        fnWakeByAddressSingle((PVOID)lpnCounter);
+    }
+    return;
+}
+
+VOID CReaderBiasedRWLock::AcquireExclusive()
+{
+    FastLock_Enter(&nWriterMutex);
+    _InterlockedExchange(&nWriterActive, 1);
+    WaitForReaders();
+    return;
+}
+
+BOOL CReaderBiasedRWLock::TryAcquireExclusive()
+{
+    if (FastLock_TryEnter(&nWriterMutex) == FALSE)
+    {
+        return FALSE;
+    }
+    _InterlockedExchange(&nWriterActive, 1);
+    for (ULONG i = 0; i <= nSlotsMask; i++)
+    {
+        if (*GetSlotCounter(i) != 0)
+        {
+            ReleaseExclusive();
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+VOID CReaderBiasedRWLock::ReleaseExclusive()
+{
+    MX_ASSERT(nWriterActive != 0);
+    _InterlockedExchange(&nWriterActive, 0);
+    if (fnWakeByAddressAll != NULL)
+    {
+        fnWakeByAddressAll((PVOID)&nWriterActive);
+    }
+    FastLock_Exit(&nWriterMutex);
+    return;
+}
+
+VOID CReaderBiasedRWLock::WaitForReaders()
+{
+    BOOL bWaited = FALSE;
+    LONG nValue;
+
+    for (ULONG i = 0; i <= nSlotsMask; i++)
+    {
+        LONG volatile *lpnCounter = GetSlotCounter(i);
+
+        for (SIZE_T nSpin = 0; (nValue = *lpnCounter) != 0; nSpin++)
+        {
+            bWaited = TRUE;
+            if (nSpin < FASTLOCK_MIN_SPIN_COUNT && IsMultiProcessor() != FALSE)
+            {
+                ::YieldProcessor();
+            }
+            else
+            {
+                ParkOnAddress(lpnCounter, nValue);
+            }
+        }
+    }
+    if (bWaited != FALSE)
+    {
+        _InterlockedIncrement64(&(sLockStats.nWriterWaits));
+    }
+    return;
+}
+
+LONG volatile *CReaderBiasedRWLock::GetSlotCounter(_In_ ULONG nSlot)
+{
+    return (LONG volatile *)(lpSlots + (SIZE_T)nSlot * RWLOCK_SLOT_SIZE);
+}
+
+//-----------------------------------------------------------
+
+VOID GetLockContentionStats(_Out_ LPLOCK_CONTENTION_STATS lpStats)
+{
+    lpStats->nContentions = (ULONGLONG)__InterlockedRead64(&(sLockStats.nContentions));
+    lpStats->nSpinAcquires = (ULONGLONG)__InterlockedRead64(&(sLockStats.nSpinAcquires));
+    lpStats->nParks = (ULONGLONG)__InterlockedRead64(&(sLockStats.nParks));
+    lpStats->nReaderRetries = (ULONGLONG)__InterlockedRead64(&(sLockStats.nReaderRetries));
+    lpStats->nWriterWaits = (ULONGLONG)__InterlockedRead64(&(sLockStats.nWriterWaits));
+    return;
+}
+
+//-----------------------------------------------------------
+
 VOID RundownProt_Initialize(_Inout_ _Interlocked_operand_ LONG volatile *lpnValue)
 {
     _InterlockedExchange(lpnValue, 0);
@@ -809,6 +994,16 @@ static int __cdecl InitializeKernel32Apis()
             fnTryAcquireSRWLockExclusive = NULL;
             fnTryAcquireSRWLockShared = NULL;
         }
+
+        _GETAPI(WaitOnAddress);
+        _GETAPI(WakeByAddressSingle);
+        _GETAPI(WakeByAddressAll);
+        if (fnWaitOnAddress == NULL || fnWakeByAddressSingle == NULL || fnWakeByAddressAll == NULL)
+        {
+            fnWaitOnAddress = NULL;
+            fnWakeByAddressSingle = NULL;
+            fnWakeByAddressAll = NULL;
+        }
     }
 
     hDll = ::MxGetDllHandle(L"kernel32.dll");
@@ -858,6 +1053,8 @@ static int __cdecl InitializeKernel32Apis()
                 fnTryAcquireSRWLockShared = NULL;
             }
         }
+
+        _GETAPI(GetCurrentProcessorNumber);
     }
 
     // done
@@ -865,6 +1062,136 @@ static int __cdecl InitializeKernel32Apis()
 }
 #undef _GETAPI
 
+static LPPARKING_SLOT GetParkingSlot(_In_ LONG volatile *lpnAddress)
+{
+    ULONG_PTR nHash = (ULONG_PTR)lpnAddress;
+
+    nHash = (nHash >> 2) ^ (nHash >> 8) ^ (nHash >> 14);
+    return &aParkingSlots[nHash & (PARKING_SLOTS_COUNT - 1)];
+}
+
+// NOTE: nBitMask is -1 for a FastLock, where the lock is taken by storing the thread id, or the bit of a bitmask lock.
+//       The thread spins with an exponential backoff up to an adaptive limit, which grows when spinning pays off and
+//       shrinks when it does not (for example when there are more threads than processors and the owner is not
+//       running), and then parks until the owner releases the lock.
+//
+//       A FastLock waiter sets FASTLOCK_PARKED_FLAG while the lock is held before parking. Once it has parked, it
+//       keeps the flag when it takes the lock because other threads may still be parked and the release clears it.
+static VOID WaitForFastLock(_Inout_ LONG volatile *lpnLock, _In_ LONG nBitMask, _In_ LONG nTid)
+{
+    LPPARKING_SLOT lpSlot = GetParkingSlot(lpnLock);
+    LONG nSpinLimit, nValue, nParkedFlag = 0;
+    SIZE_T nSpins, nBackoff;
+
+#define __TRY_ACQUIRE() ((nBitMask == -1L) ? (_InterlockedCompareExchange(lpnLock, nTid, 0) == 0)                      \
+                                           : ((_InterlockedOr(lpnLock, nBitMask) & nBitMask) == 0))
+
+    _InterlockedIncrement64(&(sLockStats.nContentions));
+
+    if (IsMultiProcessor() != FALSE)
+    {
+        nSpinLimit = lpSlot->nSpinLimit;
+        if (nSpinLimit < FASTLOCK_MIN_SPIN_COUNT || nSpinLimit > FASTLOCK_SPIN_COUNT)
+        {
+            nSpinLimit = FASTLOCK_SPIN_COUNT;
+        }
+
+        nSpins = 0;
+        for (nBackoff = 1; nSpins < (SIZE_T)nSpinLimit; nBackoff <<= 1)
+        {
+            for (SIZE_T i = 0; i < nBackoff; i++)
+            {
+                ::YieldProcessor();
+            }
+            nSpins += nBackoff;
+
+            // only try when the lock looks free to avoid bouncing its cache line
+            if ((*lpnLock & nBitMask) == 0 && __TRY_ACQUIRE())
+            {
+                if (nSpinLimit < FASTLOCK_SPIN_COUNT)
+                {
+                    _InterlockedExchange(&(lpSlot->nSpinLimit), nSpinLimit << 1);
+                }
+                _InterlockedIncrement64(&(sLockStats.nSpinAcquires));
+                return;
+            }
+        }
+
+        if (nSpinLimit > FASTLOCK_MIN_SPIN_COUNT)
+        {
+            _InterlockedExchange(&(lpSlot->nSpinLimit), nSpinLimit >> 1);
+        }
+    }
+
+    if (nBitMask == -1L && fnWaitOnAddress != NULL)
+    {
+        for (;;)
+        {
+            nValue = __InterlockedRead(lpnLock);
+            if (nValue == 0)
+            {
+                if (_InterlockedCompareExchange(lpnLock, nTid | nParkedFlag, 0) == 0)
+                {
+                    return;
+                }
+                continue;
+            }
+            if ((nValue & FASTLOCK_PARKED_FLAG) == 0)
+            {
+                if (_InterlockedCompareExchange(lpnLock, nValue | FASTLOCK_PARKED_FLAG, nValue) != nValue)
+                {
+                    continue;
+                }
+                nValue |= FASTLOCK_PARKED_FLAG;
+            }
+
+            _InterlockedIncrement64(&(sLockStats.nParks));
+            fnWaitOnAddress(lpnLock, &nValue, sizeof(LONG), INFINITE);
+            nParkedFlag = FASTLOCK_PARKED_FLAG;
+        }
+    }
+
+    for (;;)
+    {
+        if (fnWaitOnAddress != NULL)
+        {
+            _InterlockedIncrement(&(lpSlot->nWaiters));
+            nValue = __InterlockedRead(lpnLock);
+            if ((nValue & nBitMask) != 0)
+            {
+                _InterlockedIncrement64(&(sLockStats.nParks));
+                fnWaitOnAddress(lpnLock, &nValue, sizeof(LONG), INFINITE);
+            }
+            _InterlockedDecrement(&(lpSlot->nWaiters));
+        }
+        else
+        {
+            ::SwitchToThread();
+        }
+
+        if (__TRY_ACQUIRE())
+        {
+            return;
+        }
+    }
+
+#undef __TRY_ACQUIRE
+}
+
+static VOID ParkOnAddress(_In_ LONG volatile *lpnAddress, _In_ LONG nCompareValue)
+{
+    if (fnWaitOnAddress != NULL)
+    {
+        _InterlockedIncrement64(&(sLockStats.nParks));
+        fnWaitOnAddress(lpnAddress, &nCompareValue, sizeof(LONG), INFINITE);
+    }
+    else
+    {
+        ::SwitchToThread();
+    }
+    return;
+}
+
 static NTSTATUS GetRootDirHandle(_Out_ PHANDLE lphRootDir)
 {
     static HANDLE volatile hRootDirHandle = NULL;
@@ -0,0 +1,587 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\..\Include\ZipLib\ParallelDeflate.h"
+#include "..\..\Include\Crc32.h"
+#include "Source\zlib.h"
+
+ //-----------------------------------------------------------
+
+#define DEFAULT_BLOCK_SIZE 131072
+#define MIN_BLOCK_SIZE 65536
+#define MAX_THREADS_COUNT 64
+#define BLOCKS_PER_THREAD 2
+
+#define DICTIONARY_SIZE 32768
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+CParallelDeflate::CParallelDeflate() : CBaseMemObj(), CNonCopyableObj()
+{
+    return;
+}
+
+CParallelDeflate::~CParallelDeflate()
+{
+    Cleanup();
+    return;
+}
+
+HRESULT CParallelDeflate::Begin(_In_ int nCompressionLevel, _In_ eFormat _nFormat, _In_ OnOutputCallback _cOutputCallback,
+                                _In_opt_ LPVOID _lpUserParam, _In_opt_ DWORD dwThreadsCount, _In_opt_ SIZE_T _nBlockSize)
+{
+    SIZE_T i, nOutputSize;
+    HRESULT hRes;
+
+    if (nCompressionLevel < 1 || nCompressionLevel > 9 || (!_cOutputCallback))
+    {
+        return E_INVALIDARG;
+    }
+    if (bInUse != FALSE)
+    {
+        return MX_E_AlreadyInitialized;
+    }
+
+    if (dwThreadsCount == 0)
+    {
+        SYSTEM_INFO sSi;
+
+        ::GetSystemInfo(&sSi);
+        dwThreadsCount = sSi.dwNumberOfProcessors;
+    }
+    if (dwThreadsCount < 1)
+    {
+        dwThreadsCount = 1;
+    }
+    else if (dwThreadsCount > MAX_THREADS_COUNT)
+    {
+        dwThreadsCount = MAX_THREADS_COUNT;
+    }
+    if (_nBlockSize == 0)
+    {
+        _nBlockSize = DEFAULT_BLOCK_SIZE;
+    }
+    else if (_nBlockSize < MIN_BLOCK_SIZE)
+    {
+        _nBlockSize = MIN_BLOCK_SIZE;
+    }
+    else if (_nBlockSize > 0x10000000)
+    {
+        _nBlockSize = 0x10000000;
+    }
+
+    nLevel = nCompressionLevel;
+    nFormat = _nFormat;
+    cOutputCallback = _cOutputCallback;
+    lpUserParam = _lpUserParam;
+    nBlockSize = _nBlockSize;
+    nChecksum = (nFormat == eFormat::ZLib) ? 1 : 0;
+    ullInputSize = 0;
+    nDictionaryLen = 0;
+    nFilledBlocks = 0;
+    bInUse = TRUE;
+
+    // create one deflate stream per thread, the calling thread also compresses
+    nStreamsCount = (SIZE_T)dwThreadsCount;
+    lplpStreams = (LPVOID *)MX_MALLOC(nStreamsCount * sizeof(LPVOID));
+    if (lplpStreams == NULL)
+    {
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+    ::MxMemSet(lplpStreams, 0, nStreamsCount * sizeof(LPVOID));
+    for (i = 0; i < nStreamsCount; i++)
+    {
+        int nErr;
+
+        lplpStreams[i] = MX_MALLOC(sizeof(z_stream));
+        if (lplpStreams[i] == NULL)
+        {
+            hRes = E_OUTOFMEMORY;
+            goto done;
+        }
+        ::MxMemSet(lplpStreams[i], 0, sizeof(z_stream));
+        __try
+        {
+            nErr = deflateInit2((z_streamp)(lplpStreams[i]), nLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            nErr = Z_MEM_ERROR;
+        }
+        if (nErr != Z_OK)
+        {
+            MX_FREE(lplpStreams[i]);
+            hRes = (nErr == Z_MEM_ERROR) ? E_OUTOFMEMORY : E_FAIL;
+            goto done;
+        }
+    }
+
+    // allocate blocks
+    nBlocksCount = nStreamsCount * BLOCKS_PER_THREAD;
+    lpBlocks = (LPBLOCK)MX_MALLOC(nBlocksCount * sizeof(BLOCK));
+    if (lpBlocks == NULL)
+    {
+        nBlocksCount = 0;
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+    ::MxMemSet(lpBlocks, 0, nBlocksCount * sizeof(BLOCK));
+    nOutputSize = (SIZE_T)compressBound((uLong)nBlockSize) + 64;
+    for (i = 0; i < nBlocksCount; i++)
+    {
+        lpBlocks[i].lpInput = (LPBYTE)MX_MALLOC(nBlockSize);
+        lpBlocks[i].lpOutput = (LPBYTE)MX_MALLOC(nOutputSize);
+        if (lpBlocks[i].lpInput == NULL || lpBlocks[i].lpOutput == NULL)
+        {
+            hRes = E_OUTOFMEMORY;
+            goto done;
+        }
+        lpBlocks[i].nOutputSize = nOutputSize;
+    }
+
+    // start helper threads
+    if (nStreamsCount > 1)
+    {
+        cStartSem.Attach(::CreateSemaphoreW(NULL, 0, (LONG)nStreamsCount, NULL));
+        if (!cStartSem)
+        {
+            hRes = MX_HRESULT_FROM_LASTERROR();
+            goto done;
+        }
+        hRes = cDoneEvent.Create(FALSE, FALSE);
+        if (FAILED(hRes))
+        {
+            goto done;
+        }
+
+        lpWorkers = MX_DEBUG_NEW CWorkerThread[nStreamsCount - 1];
+        if (lpWorkers == NULL)
+        {
+            hRes = E_OUTOFMEMORY;
+            goto done;
+        }
+        for (i = 0; i < nStreamsCount - 1; i++)
+        {
+            if (lpWorkers[i].Start(this, &CParallelDeflate::WorkerThreadProc, i + 1) == FALSE)
+            {
+                hRes = E_OUTOFMEMORY;
+                goto done;
+            }
+            nWorkersCount++;
+        }
+    }
+
+    hRes = WriteHeader();
+
+done:
+    if (FAILED(hRes))
+    {
+        Cleanup();
+    }
+    return hRes;
+}
+
+HRESULT CParallelDeflate::Write(_In_ LPCVOID lpSrc, _In_ SIZE_T nSrcLen)
+{
+    LPBYTE s;
+    HRESULT hRes;
+
+    if (bInUse == FALSE)
+    {
+        return E_FAIL;
+    }
+    if (lpSrc == NULL && nSrcLen > 0)
+    {
+        return E_POINTER;
+    }
+
+    s = (LPBYTE)lpSrc;
+    while (nSrcLen > 0)
+    {
+        LPBLOCK lpBlock = &lpBlocks[nFilledBlocks];
+        SIZE_T nToCopy;
+
+        nToCopy = nBlockSize - lpBlock->nInputLen;
+        if (nToCopy > nSrcLen)
+        {
+            nToCopy = nSrcLen;
+        }
+        ::MxMemCopy(lpBlock->lpInput + lpBlock->nInputLen, s, nToCopy);
+        lpBlock->nInputLen += nToCopy;
+        s += nToCopy;
+        nSrcLen -= nToCopy;
+
+        if (lpBlock->nInputLen == nBlockSize)
+        {
+            nFilledBlocks++;
+            if (nFilledBlocks == nBlocksCount)
+            {
+                hRes = ProcessBatch(nBlocksCount, FALSE);
+                if (FAILED(hRes))
+                {
+                    Cleanup();
+                    return hRes;
+                }
+            }
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CParallelDeflate::End()
+{
+    SIZE_T nCount;
+    HRESULT hRes;
+
+    if (bInUse == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // the last block is the partially filled one or, if it is empty, the last filled block
+    nCount = nFilledBlocks;
+    if (nCount == 0 || lpBlocks[nFilledBlocks].nInputLen > 0)
+    {
+        nCount++;
+    }
+    hRes = ProcessBatch(nCount, TRUE);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = WriteTrailer();
+    }
+
+    // done
+    Cleanup();
+    return hRes;
+}
+
+HRESULT CParallelDeflate::ProcessBatch(_In_ SIZE_T nCount, _In_ BOOL bFinal)
+{
+    SIZE_T i;
+    HRESULT hRes;
+
+    // setup dictionaries
+    for (i = 0; i < nCount; i++)
+    {
+        if (i == 0)
+        {
+            lpBlocks[i].lpDictionary = aDictionary;
+            lpBlocks[i].nDictionaryLen = nDictionaryLen;
+        }
+        else
+        {
+            SIZE_T nLen = lpBlocks[i - 1].nInputLen;
+
+            lpBlocks[i].nDictionaryLen = (nLen > DICTIONARY_SIZE) ? DICTIONARY_SIZE : nLen;
+            lpBlocks[i].lpDictionary = lpBlocks[i - 1].lpInput + (nLen - lpBlocks[i].nDictionaryLen);
+        }
+        lpBlocks[i].bIsLast = (bFinal != FALSE && i == nCount - 1) ? TRUE : FALSE;
+        lpBlocks[i].nOutputLen = 0;
+        lpBlocks[i].hRes = S_OK;
+    }
+
+    // compress blocks using all threads
+    nBatchBlocksCount = nCount;
+    _InterlockedExchange(&nNextBlock, 0);
+    if (nWorkersCount > 0)
+    {
+        _InterlockedExchange(&nRunningWorkers, (LONG)nWorkersCount);
+        ::ReleaseSemaphore(cStartSem.Get(), (LONG)nWorkersCount, NULL);
+    }
+    CompressPendingBlocks(0);
+    if (nWorkersCount > 0)
+    {
+        cDoneEvent.Wait(INFINITE);
+    }
+
+    // send output in order
+    for (i = 0; i < nCount; i++)
+    {
+        if (FAILED(lpBlocks[i].hRes))
+        {
+            return lpBlocks[i].hRes;
+        }
+        if (lpBlocks[i].nOutputLen > 0)
+        {
+            hRes = cOutputCallback(lpBlocks[i].lpOutput, lpBlocks[i].nOutputLen, lpUserParam);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        if (nFormat == eFormat::ZLib)
+        {
+            nChecksum = (ULONG)adler32_combine((uLong)nChecksum, (uLong)(lpBlocks[i].nChecksum), (z_off_t)(lpBlocks[i].nInputLen));
+        }
+        else
+        {
+            nChecksum = MX::Crc32Combine(nChecksum, lpBlocks[i].nChecksum, (ULONGLONG)(lpBlocks[i].nInputLen));
+        }
+        ullInputSize += (ULONGLONG)(lpBlocks[i].nInputLen);
+    }
+
+    // keep the tail of the last block as the dictionary of the next batch and reset blocks
+    if (bFinal == FALSE)
+    {
+        LPBLOCK lpLastBlock = &lpBlocks[nCount - 1];
+
+        nDictionaryLen = (lpLastBlock->nInputLen > DICTIONARY_SIZE) ? DICTIONARY_SIZE : lpLastBlock->nInputLen;
+        ::MxMemCopy(aDictionary, lpLastBlock->lpInput + (lpLastBlock->nInputLen - nDictionaryLen), nDictionaryLen);
+    }
+    for (i = 0; i < nCount; i++)
+    {
+        lpBlocks[i].nInputLen = 0;
+    }
+    nFilledBlocks = 0;
+
+    // done
+    return S_OK;
+}
+
+VOID CParallelDeflate::CompressPendingBlocks(_In_ SIZE_T nStreamIndex)
+{
+    LONG nIndex;
+
+    while ((nIndex = _InterlockedIncrement(&nNextBlock) - 1) < (LONG)nBatchBlocksCount)
+    {
+        lpBlocks[nIndex].hRes = CompressBlock(&lpBlocks[nIndex], lplpStreams[nStreamIndex]);
+    }
+    return;
+}
+
+HRESULT CParallelDeflate::CompressBlock(_In_ LPBLOCK lpBlock, _In_ LPVOID lpStream)
+{
+    z_streamp lpZStream = (z_streamp)lpStream;
+    int nErr;
+
+    // checksum the input
+    if (nFormat == eFormat::ZLib)
+    {
+        lpBlock->nChecksum = (ULONG)adler32(1, lpBlock->lpInput, (uInt)(lpBlock->nInputLen));
+    }
+    else
+    {
+        lpBlock->nChecksum = MX::Crc32(0, lpBlock->lpInput, lpBlock->nInputLen);
+    }
+
+    __try
+    {
+        nErr = deflateReset(lpZStream);
+        if (nErr == Z_OK && lpBlock->nDictionaryLen > 0)
+        {
+            nErr = deflateSetDictionary(lpZStream, lpBlock->lpDictionary, (uInt)(lpBlock->nDictionaryLen));
+        }
+        if (nErr == Z_OK)
+        {
+            lpZStream->next_in = lpBlock->lpInput;
+            lpZStream->avail_in = (uInt)(lpBlock->nInputLen);
+            for (;;)
+            {
+                lpZStream->next_out = lpBlock->lpOutput + lpBlock->nOutputLen;
+                lpZStream->avail_out = (uInt)(lpBlock->nOutputSize - lpBlock->nOutputLen);
+                nErr = deflate(lpZStream, (lpBlock->bIsLast != FALSE) ? Z_FINISH : Z_SYNC_FLUSH);
+                lpBlock->nOutputLen = lpBlock->nOutputSize - (SIZE_T)(lpZStream->avail_out);
+                if (nErr == Z_STREAM_END)
+                {
+                    nErr = Z_OK;
+                    break;
+                }
+                if (nErr != Z_OK && nErr != Z_BUF_ERROR)
+                {
+                    break;
+                }
+                if (lpZStream->avail_out > 0)
+                {
+                    if (lpBlock->bIsLast == FALSE)
+                    {
+                        // sync flush completed
+                        nErr = Z_OK;
+                        break;
+                    }
+                }
+                else
+                {
+                    LPBYTE lpNewOutput;
+
+                    // output buffer is full, grow it
+                    lpNewOutput = (LPBYTE)MX_REALLOC(lpBlock->lpOutput, lpBlock->nOutputSize << 1);
+                    if (lpNewOutput == NULL)
+                    {
+                        nErr = Z_MEM_ERROR;
+                        break;
+                    }
+                    lpBlock->lpOutput = lpNewOutput;
+                    lpBlock->nOutputSize <<= 1;
+                }
+            }
+        }
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        nErr = Z_DATA_ERROR;
+    }
+    if (nErr != Z_OK)
+    {
+        return (nErr == Z_MEM_ERROR) ? E_OUTOFMEMORY : E_FAIL;
+    }
+    return S_OK;
+}
+
+HRESULT CParallelDeflate::WriteHeader()
+{
+    BYTE aHeader[10];
+
+    switch (nFormat)
+    {
+        case eFormat::ZLib:
+            // CMF = deflate with 32K window, FLG = compression level plus check bits
+            aHeader[0] = 0x78;
+            if (nLevel < 2)
+            {
+                aHeader[1] = 0x01;
+            }
+            else if (nLevel < 6)
+            {
+                aHeader[1] = 0x5E;
+            }
+            else if (nLevel == 6)
+            {
+                aHeader[1] = 0x9C;
+            }
+            else
+            {
+                aHeader[1] = 0xDA;
+            }
+            return cOutputCallback(aHeader, 2, lpUserParam);
+
+        case eFormat::GZip:
+            aHeader[0] = 0x1F;
+            aHeader[1] = 0x8B;
+            aHeader[2] = Z_DEFLATED;
+            aHeader[3] = 0;                                                   // flags
+            aHeader[4] = aHeader[5] = aHeader[6] = aHeader[7] = 0;            // mtime
+            aHeader[8] = (nLevel == 9) ? 2 : ((nLevel == 1) ? 4 : 0);         // xfl
+            aHeader[9] = 0x0B;                                                // NTFS
+            return cOutputCallback(aHeader, 10, lpUserParam);
+    }
+    return S_OK;
+}
+
+HRESULT CParallelDeflate::WriteTrailer()
+{
+    BYTE aTrailer[8];
+
+    switch (nFormat)
+    {
+        case eFormat::ZLib:
+            aTrailer[0] = (BYTE)(nChecksum >> 24);
+            aTrailer[1] = (BYTE)(nChecksum >> 16);
+            aTrailer[2] = (BYTE)(nChecksum >> 8);
+            aTrailer[3] = (BYTE)nChecksum;
+            return cOutputCallback(aTrailer, 4, lpUserParam);
+
+        case eFormat::GZip:
+            aTrailer[0] = (BYTE)nChecksum;
+            aTrailer[1] = (BYTE)(nChecksum >> 8);
+            aTrailer[2] = (BYTE)(nChecksum >> 16);
+            aTrailer[3] = (BYTE)(nChecksum >> 24);
+            aTrailer[4] = (BYTE)ullInputSize;
+            aTrailer[5] = (BYTE)(ullInputSize >> 8);
+            aTrailer[6] = (BYTE)(ullInputSize >> 16);
+            aTrailer[7] = (BYTE)(ullInputSize >> 24);
+            return cOutputCallback(aTrailer, 8, lpUserParam);
+    }
+    return S_OK;
+}
+
+VOID CParallelDeflate::WorkerThreadProc(_In_ SIZE_T nParam)
+{
+    HANDLE hStartSem = cStartSem.Get();
+
+    while (lpWorkers[nParam - 1].CheckForAbort(INFINITE, 1, &hStartSem) == FALSE)
+    {
+        CompressPendingBlocks(nParam);
+        if (_InterlockedDecrement(&nRunningWorkers) == 0)
+        {
+            cDoneEvent.Set();
+        }
+    }
+    return;
+}
+
+VOID CParallelDeflate::Cleanup()
+{
+    SIZE_T i;
+
+    if (lpWorkers != NULL)
+    {
+        for (i = 0; i < nWorkersCount; i++)
+        {
+            lpWorkers[i].Stop();
+        }
+        delete[] lpWorkers;
+        lpWorkers = NULL;
+    }
+    nWorkersCount = 0;
+    cStartSem.Close();
+    cDoneEvent.Close();
+
+    if (lplpStreams != NULL)
+    {
+        for (i = 0; i < nStreamsCount; i++)
+        {
+            if (lplpStreams[i] != NULL)
+            {
+                __try
+                {
+                    deflateEnd((z_streamp)(lplpStreams[i]));
+                }
+                __except (EXCEPTION_EXECUTE_HANDLER)
+                {
+                }
+                MX_FREE(lplpStreams[i]);
+            }
+        }
+        MX_FREE(lplpStreams);
+    }
+    nStreamsCount = 0;
+
+    if (lpBlocks != NULL)
+    {
+        for (i = 0; i < nBlocksCount; i++)
+        {
+            MX_FREE(lpBlocks[i].lpInput);
+            MX_FREE(lpBlocks[i].lpOutput);
+        }
+        MX_FREE(lpBlocks);
+    }
+    nBlocksCount = nFilledBlocks = 0;
+
+    ::MxMemSet(aDictionary, 0, sizeof(aDictionary));
+    nDictionaryLen = 0;
+    bInUse = FALSE;
+    return;
+}
+
+} // namespace MX
@@ -0,0 +1,810 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "..\..\Include\ZipLib\ZipArchiveReader.h"
+#include "..\..\Include\Strings\Utf8.h"
+#include "..\..\Include\AutoHandle.h"
+#include "..\..\Include\FnvHash.h"
+#include "..\..\Include\Crc32.h"
+#include "Source\zlib.h"
+
+ //-----------------------------------------------------------
+
+#define EOCD_SIGNATURE 0x06054B50UL
+#define EOCD_SIZE 22
+#define EOCD64_LOCATOR_SIGNATURE 0x07064B50UL
+#define EOCD64_LOCATOR_SIZE 20
+#define EOCD64_SIGNATURE 0x06064B50UL
+#define EOCD64_SIZE 56
+#define CENTRAL_HEADER_SIGNATURE 0x02014B50UL
+#define CENTRAL_HEADER_SIZE 46
+#define LOCAL_HEADER_SIGNATURE 0x04034B50UL
+#define LOCAL_HEADER_SIZE 30
+
+#define ZIP64_EXTRA_FIELD_ID 0x0001
+
+#define METHOD_STORE 0
+#define METHOD_DEFLATE 8
+
+#define MAX_INFLATE_INPUT 0x40000000UL
+
+#define __stream ((z_streamp)lpStream)
+
+//-----------------------------------------------------------
+
+static __inline WORD ReadU16(_In_ LPBYTE p)
+{
+    return (WORD)p[0] | ((WORD)p[1] << 8);
+}
+
+static __inline DWORD ReadU32(_In_ LPBYTE p)
+{
+    return (DWORD)p[0] | ((DWORD)p[1] << 8) | ((DWORD)p[2] << 16) | ((DWORD)p[3] << 24);
+}
+
+static __inline ULONGLONG ReadU64(_In_ LPBYTE p)
+{
+    return (ULONGLONG)ReadU32(p) | ((ULONGLONG)ReadU32(p + 4) << 32);
+}
+
+static VOID EndInflate(_In_ LPVOID lpStream);
+
+//-----------------------------------------------------------
+
+namespace MX {
+
+CZipArchiveReader::CZipArchiveReader() : TRefCounted<CBaseMemObj>(), CNonCopyableObj()
+{
+    return;
+}
+
+CZipArchiveReader::~CZipArchiveReader()
+{
+    Close();
+    return;
+}
+
+HRESULT CZipArchiveReader::Open(_In_z_ LPCWSTR szFileNameW)
+{
+    MX_FILE_STANDARD_INFORMATION sStdInfo;
+    MX_IO_STATUS_BLOCK sIoStatus;
+    CWindowsHandle cFileH, cSectionH;
+    HANDLE h;
+    PVOID lpBaseAddress;
+    SIZE_T nViewSize;
+    NTSTATUS nNtStatus;
+    HRESULT hRes;
+
+    if (szFileNameW == NULL)
+    {
+        return E_POINTER;
+    }
+    if (*szFileNameW == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    Close();
+
+    nNtStatus = ::MxCreateFile(&h, szFileNameW, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (!NT_SUCCESS(nNtStatus))
+    {
+        return MX_HRESULT_FROM_WIN32(::MxRtlNtStatusToDosError(nNtStatus));
+    }
+    cFileH.Attach(h);
+
+    ::MxMemSet(&sIoStatus, 0, sizeof(sIoStatus));
+    ::MxMemSet(&sStdInfo, 0, sizeof(sStdInfo));
+    nNtStatus = ::MxNtQueryInformationFile(cFileH.Get(), &sIoStatus, &sStdInfo, (ULONG)sizeof(sStdInfo),
+                                           MxFileStandardInformation);
+    if (!NT_SUCCESS(nNtStatus))
+    {
+        return MX_HRESULT_FROM_WIN32(::MxRtlNtStatusToDosError(nNtStatus));
+    }
+    if (sStdInfo.EndOfFile.QuadPart < EOCD_SIZE)
+    {
+        return MX_E_InvalidData;
+    }
+#if defined(_M_IX86)
+    if (sStdInfo.EndOfFile.QuadPart > 0x7FFFFFFFi64)
+    {
+        return MX_E_ArithmeticOverflow;
+    }
+#endif //_M_IX86
+
+    // map the whole archive
+    nNtStatus = ::MxNtCreateSection(&h, SECTION_MAP_READ | SECTION_QUERY, NULL, NULL, PAGE_READONLY, SEC_COMMIT,
+                                    cFileH.Get());
+    if (!NT_SUCCESS(nNtStatus))
+    {
+        return MX_HRESULT_FROM_WIN32(::MxRtlNtStatusToDosError(nNtStatus));
+    }
+    cSectionH.Attach(h);
+
+    lpBaseAddress = NULL;
+    nViewSize = 0;
+    nNtStatus = ::MxNtMapViewOfSection(cSectionH.Get(), MX_CURRENTPROCESS, &lpBaseAddress, 0, 0, NULL, &nViewSize,
+                                       2 /*ViewUnmap*/, 0, PAGE_READONLY);
+    if (!NT_SUCCESS(nNtStatus))
+    {
+        return MX_HRESULT_FROM_WIN32(::MxRtlNtStatusToDosError(nNtStatus));
+    }
+    cMapping.Attach(MX_DEBUG_NEW CMappedArchive());
+    if (!cMapping)
+    {
+        ::MxNtUnmapViewOfSection(MX_CURRENTPROCESS, lpBaseAddress);
+        return E_OUTOFMEMORY;
+    }
+    cMapping->lpView = lpView = (LPBYTE)lpBaseAddress;
+    nFileSize = (ULONGLONG)(sStdInfo.EndOfFile.QuadPart);
+
+    // the view keeps the section alive so handles can be closed
+    hRes = ParseCentralDirectory();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = BuildIndex();
+    }
+    if (FAILED(hRes))
+    {
+        Close();
+    }
+    return hRes;
+}
+
+VOID CZipArchiveReader::Close()
+{
+    MX_FREE(lpnBuckets);
+    nBucketsMask = 0;
+
+    // the view and the entries go away when the last open entry stream is released
+    lpEntries = NULL;
+    nEntriesCount = 0;
+    lpView = NULL;
+    nFileSize = 0;
+    cMapping.Release();
+    return;
+}
+
+const CZipArchiveReader::ENTRY* CZipArchiveReader::GetEntry(_In_ SIZE_T nIndex) const
+{
+    return (nIndex < nEntriesCount) ? &lpEntries[nIndex] : NULL;
+}
+
+const CZipArchiveReader::ENTRY* CZipArchiveReader::FindEntry(_In_ LPCSTR szNameA, _In_opt_ SIZE_T nNameLen) const
+{
+    SIZE_T nBucket;
+    ULONG nHash;
+
+    if (szNameA == NULL || lpnBuckets == NULL)
+    {
+        return NULL;
+    }
+    if (nNameLen == (SIZE_T)-1)
+    {
+        nNameLen = StrLenA(szNameA);
+    }
+
+    nHash = fnv_32a_buf(szNameA, nNameLen, FNV1A_32_INIT);
+    for (nBucket = (SIZE_T)nHash & nBucketsMask; lpnBuckets[nBucket] != 0; nBucket = (nBucket + 1) & nBucketsMask)
+    {
+        const ENTRY *lpEntry = &lpEntries[lpnBuckets[nBucket] - 1];
+
+        if (lpEntry->nHash == nHash && lpEntry->nNameLen == nNameLen &&
+            ::MxMemCompare(lpEntry->szNameA, szNameA, nNameLen) == 0)
+        {
+            return lpEntry;
+        }
+    }
+    return NULL;
+}
+
+const CZipArchiveReader::ENTRY* CZipArchiveReader::FindEntry(_In_z_ LPCWSTR szNameW) const
+{
+    CStringA cStrNameA;
+
+    if (szNameW == NULL || FAILED(Utf8_Encode(cStrNameA, szNameW)))
+    {
+        return NULL;
+    }
+    return FindEntry((LPCSTR)cStrNameA, cStrNameA.GetLength());
+}
+
+BOOL CZipArchiveReader::IsStored(_In_ const ENTRY *lpEntry) const
+{
+    return (lpEntry != NULL && lpEntry->wMethod == METHOD_STORE && IsEncrypted(lpEntry) == FALSE) ? TRUE : FALSE;
+}
+
+HRESULT CZipArchiveReader::GetEntryData(_In_ const ENTRY *lpEntry, _Out_ LPCVOID *lplpData, _Out_ SIZE_T *lpnDataSize) const
+{
+    if (lplpData != NULL)
+    {
+        *lplpData = NULL;
+    }
+    if (lpnDataSize != NULL)
+    {
+        *lpnDataSize = 0;
+    }
+    if (lpEntry == NULL || lplpData == NULL || lpnDataSize == NULL)
+    {
+        return E_POINTER;
+    }
+    if (lpView == NULL)
+    {
+        return MX_E_NotReady;
+    }
+
+    *lplpData = lpView + (SIZE_T)(lpEntry->nDataOffset);
+    *lpnDataSize = (SIZE_T)(lpEntry->nCompressedSize);
+    return S_OK;
+}
+
+HRESULT CZipArchiveReader::OpenEntry(_In_ const ENTRY *lpEntry, _Out_ CStream **lplpStream)
+{
+    TAutoRefCounted<CEntryStream> cStream;
+    HRESULT hRes;
+
+    if (lplpStream == NULL)
+    {
+        return E_POINTER;
+    }
+    *lplpStream = NULL;
+    if (lpEntry == NULL)
+    {
+        return E_POINTER;
+    }
+    if (lpView == NULL)
+    {
+        return MX_E_NotReady;
+    }
+    if (IsEncrypted(lpEntry) != FALSE || (lpEntry->wMethod != METHOD_STORE && lpEntry->wMethod != METHOD_DEFLATE))
+    {
+        return MX_E_Unsupported;
+    }
+
+    cStream.Attach(MX_DEBUG_NEW CEntryStream(this, lpEntry));
+    if (!cStream)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = cStream->Initialize();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // done
+    *lplpStream = cStream.Detach();
+    return S_OK;
+}
+
+HRESULT CZipArchiveReader::ParseCentralDirectory()
+{
+    LPBYTE p, lpEocd, lpEnd;
+    ULONGLONG nCdOffset, nCdSize, nCount, i;
+    SIZE_T nSearchLen;
+    HRESULT hRes;
+
+    __try
+    {
+        // locate the end of central directory record, it can be followed by a comment of up to 64KB
+        nSearchLen = (nFileSize > (ULONGLONG)(EOCD_SIZE + 65535)) ? (EOCD_SIZE + 65535) : (SIZE_T)nFileSize;
+        lpEnd = lpView + (SIZE_T)nFileSize;
+        lpEocd = NULL;
+        for (p = lpEnd - EOCD_SIZE; p >= lpEnd - nSearchLen; p--)
+        {
+            if (ReadU32(p) == EOCD_SIGNATURE && (SIZE_T)(lpEnd - p) >= EOCD_SIZE + (SIZE_T)ReadU16(p + 20))
+            {
+                lpEocd = p;
+                break;
+            }
+        }
+        if (lpEocd == NULL)
+        {
+            return MX_E_InvalidData;
+        }
+        nCount = (ULONGLONG)ReadU16(lpEocd + 10);
+        nCdSize = (ULONGLONG)ReadU32(lpEocd + 12);
+        nCdOffset = (ULONGLONG)ReadU32(lpEocd + 16);
+
+        // check for a ZIP64 end of central directory record
+        if ((SIZE_T)(lpEocd - lpView) >= EOCD64_LOCATOR_SIZE &&
+            ReadU32(lpEocd - EOCD64_LOCATOR_SIZE) == EOCD64_LOCATOR_SIGNATURE)
+        {
+            ULONGLONG nEocd64Offset = ReadU64(lpEocd - EOCD64_LOCATOR_SIZE + 8);
+
+            if (nFileSize < EOCD64_SIZE || nEocd64Offset > nFileSize - EOCD64_SIZE ||
+                ReadU32(lpView + (SIZE_T)nEocd64Offset) != EOCD64_SIGNATURE)
+            {
+                return MX_E_InvalidData;
+            }
+            nCount = ReadU64(lpView + (SIZE_T)nEocd64Offset + 32);
+            nCdSize = ReadU64(lpView + (SIZE_T)nEocd64Offset + 40);
+            nCdOffset = ReadU64(lpView + (SIZE_T)nEocd64Offset + 48);
+        }
+        if (nCdOffset > nFileSize || nCdSize > nFileSize - nCdOffset || nCount > nCdSize / CENTRAL_HEADER_SIZE)
+        {
+            return MX_E_InvalidData;
+        }
+        if (nCount == 0)
+        {
+            return S_OK;
+        }
+
+        lpEntries = (LPENTRY)MX_MALLOC((SIZE_T)nCount * sizeof(ENTRY));
+        if (lpEntries == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        cMapping->lpEntries = lpEntries;
+        ::MxMemSet(lpEntries, 0, (SIZE_T)nCount * sizeof(ENTRY));
+
+        p = lpView + (SIZE_T)nCdOffset;
+        lpEnd = p + (SIZE_T)nCdSize;
+        for (i = 0; i < nCount; i++)
+        {
+            LPENTRY lpEntry = &lpEntries[i];
+            SIZE_T nExtraLen, nCommentLen;
+            LPBYTE lpExtra, lpExtraEnd;
+
+            if ((SIZE_T)(lpEnd - p) < CENTRAL_HEADER_SIZE || ReadU32(p) != CENTRAL_HEADER_SIGNATURE)
+            {
+                return MX_E_InvalidData;
+            }
+            lpEntry->wFlags = ReadU16(p + 8);
+            lpEntry->wMethod = ReadU16(p + 10);
+            lpEntry->dwDosDateTime = ((DWORD)ReadU16(p + 14) << 16) | (DWORD)ReadU16(p + 12);
+            lpEntry->nCrc32 = (ULONG)ReadU32(p + 16);
+            lpEntry->nCompressedSize = (ULONGLONG)ReadU32(p + 20);
+            lpEntry->nUncompressedSize = (ULONGLONG)ReadU32(p + 24);
+            lpEntry->nNameLen = (SIZE_T)ReadU16(p + 28);
+            nExtraLen = (SIZE_T)ReadU16(p + 30);
+            nCommentLen = (SIZE_T)ReadU16(p + 32);
+            lpEntry->dwExternalAttributes = ReadU32(p + 38);
+            lpEntry->nLocalHeaderOffset = (ULONGLONG)ReadU32(p + 42);
+            if ((SIZE_T)(lpEnd - p) < CENTRAL_HEADER_SIZE + lpEntry->nNameLen + nExtraLen + nCommentLen)
+            {
+                return MX_E_InvalidData;
+            }
+            lpEntry->szNameA = (LPCSTR)(p + CENTRAL_HEADER_SIZE);
+
+            // ZIP64 extended information only contains the fields whose 32-bit value is saturated
+            lpExtra = p + CENTRAL_HEADER_SIZE + lpEntry->nNameLen;
+            lpExtraEnd = lpExtra + nExtraLen;
+            while ((SIZE_T)(lpExtraEnd - lpExtra) >= 4)
+            {
+                WORD wId = ReadU16(lpExtra);
+                SIZE_T nLen = (SIZE_T)ReadU16(lpExtra + 2);
+                LPBYTE lpField = lpExtra + 4;
+
+                if (nLen > (SIZE_T)(lpExtraEnd - lpField))
+                {
+                    return MX_E_InvalidData;
+                }
+                if (wId == ZIP64_EXTRA_FIELD_ID)
+                {
+                    if (lpEntry->nUncompressedSize == 0xFFFFFFFFui64 && nLen >= 8)
+                    {
+                        lpEntry->nUncompressedSize = ReadU64(lpField);
+                        lpField += 8;
+                        nLen -= 8;
+                    }
+                    if (lpEntry->nCompressedSize == 0xFFFFFFFFui64 && nLen >= 8)
+                    {
+                        lpEntry->nCompressedSize = ReadU64(lpField);
+                        lpField += 8;
+                        nLen -= 8;
+                    }
+                    if (lpEntry->nLocalHeaderOffset == 0xFFFFFFFFui64 && nLen >= 8)
+                    {
+                        lpEntry->nLocalHeaderOffset = ReadU64(lpField);
+                    }
+                    break;
+                }
+                lpExtra = lpField + nLen;
+            }
+
+            hRes = ResolveDataOffset(lpEntry);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+            nEntriesCount++;
+
+            p += CENTRAL_HEADER_SIZE + lpEntry->nNameLen + nExtraLen + nCommentLen;
+        }
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        return MX_E_ReadFault;
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CZipArchiveReader::BuildIndex()
+{
+    SIZE_T i, nBucketsCount;
+
+    if (nEntriesCount == 0)
+    {
+        return S_OK;
+    }
+
+    // keep the load factor at or below 50%
+    for (nBucketsCount = 16; nBucketsCount < (nEntriesCount << 1); nBucketsCount <<= 1);
+    if (nEntriesCount > (SIZE_T)0x7FFFFFFF)
+    {
+        return MX_E_ArithmeticOverflow;
+    }
+    lpnBuckets = (ULONG *)MX_MALLOC(nBucketsCount * sizeof(ULONG));
+    if (lpnBuckets == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    ::MxMemSet(lpnBuckets, 0, nBucketsCount * sizeof(ULONG));
+    nBucketsMask = nBucketsCount - 1;
+
+    for (i = 0; i < nEntriesCount; i++)
+    {
+        LPENTRY lpEntry = &lpEntries[i];
+        SIZE_T nBucket;
+
+        lpEntry->nHash = fnv_32a_buf(lpEntry->szNameA, lpEntry->nNameLen, FNV1A_32_INIT);
+        for (nBucket = (SIZE_T)(lpEntry->nHash) & nBucketsMask; lpnBuckets[nBucket] != 0;
+             nBucket = (nBucket + 1) & nBucketsMask)
+        {
+            const ENTRY *lpOther = &lpEntries[lpnBuckets[nBucket] - 1];
+
+            if (lpOther->nHash == lpEntry->nHash && lpOther->nNameLen == lpEntry->nNameLen &&
+                ::MxMemCompare(lpOther->szNameA, lpEntry->szNameA, lpEntry->nNameLen) == 0)
+            {
+                // duplicated name, first one wins
+                break;
+            }
+        }
+        if (lpnBuckets[nBucket] == 0)
+        {
+            lpnBuckets[nBucket] = (ULONG)(i + 1);
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+HRESULT CZipArchiveReader::ResolveDataOffset(_In_ LPENTRY lpEntry)
+{
+    LPBYTE p;
+    ULONGLONG nOffset;
+
+    if (lpEntry->nLocalHeaderOffset > nFileSize - LOCAL_HEADER_SIZE)
+    {
+        return MX_E_InvalidData;
+    }
+    p = lpView + (SIZE_T)(lpEntry->nLocalHeaderOffset);
+    if (ReadU32(p) != LOCAL_HEADER_SIGNATURE)
+    {
+        return MX_E_InvalidData;
+    }
+    nOffset = lpEntry->nLocalHeaderOffset + LOCAL_HEADER_SIZE + (ULONGLONG)ReadU16(p + 26) + (ULONGLONG)ReadU16(p + 28);
+    if (nOffset > nFileSize || lpEntry->nCompressedSize > nFileSize - nOffset)
+    {
+        return MX_E_InvalidData;
+    }
+    if (lpEntry->wMethod == METHOD_STORE && IsEncrypted(lpEntry) == FALSE &&
+        lpEntry->nCompressedSize != lpEntry->nUncompressedSize)
+    {
+        return MX_E_InvalidData;
+    }
+    lpEntry->nDataOffset = nOffset;
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+CZipArchiveReader::CMappedArchive::~CMappedArchive()
+{
+    MX_FREE(lpEntries);
+    if (lpView != NULL)
+    {
+        ::MxNtUnmapViewOfSection(MX_CURRENTPROCESS, lpView);
+    }
+    return;
+}
+
+//-----------------------------------------------------------
+
+CZipArchiveReader::CEntryStream::CEntryStream(_In_ CZipArchiveReader *lpArchive, _In_ const ENTRY *_lpEntry) :
+    CStream(), CNonCopyableObj(), cMapping(lpArchive->cMapping.Get())
+{
+    lpEntry = _lpEntry;
+    lpData = lpArchive->lpView + (SIZE_T)(_lpEntry->nDataOffset);
+    return;
+}
+
+CZipArchiveReader::CEntryStream::~CEntryStream()
+{
+    if (lpStream != NULL)
+    {
+        EndInflate(lpStream);
+        MX_FREE(lpStream);
+    }
+    return;
+}
+
+HRESULT CZipArchiveReader::CEntryStream::Read(_Out_ LPVOID lpDest, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesRead,
+                                              _In_opt_ ULONGLONG nStartOffset)
+{
+    HRESULT hRes;
+
+    nBytesRead = 0;
+    if (lpDest == NULL)
+    {
+        return E_POINTER;
+    }
+    if (nStartOffset != ULONGLONG_MAX)
+    {
+        hRes = Seek(nStartOffset, eSeekMethod::Start);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+    if (nPos >= lpEntry->nUncompressedSize)
+    {
+        return MX_E_EndOfFileReached;
+    }
+    if ((ULONGLONG)nBytes > lpEntry->nUncompressedSize - nPos)
+    {
+        nBytes = (SIZE_T)(lpEntry->nUncompressedSize - nPos);
+    }
+
+    if (lpStream == NULL)
+    {
+        // stored
+        __try
+        {
+            ::MxMemCopy(lpDest, lpData + (SIZE_T)nPos, nBytes);
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return MX_E_ReadFault;
+        }
+
+        // extend the checksum with the bytes not seen yet, a forward seek leaves a gap and disables the check
+        if (nPos <= nCrcPos && nPos + (ULONGLONG)nBytes > nCrcPos)
+        {
+            SIZE_T nSkip = (SIZE_T)(nCrcPos - nPos);
+
+            nCrc32 = MX::Crc32(nCrc32, (LPBYTE)lpDest + nSkip, nBytes - nSkip);
+            nCrcPos = nPos + (ULONGLONG)nBytes;
+            if (nCrcPos == lpEntry->nUncompressedSize && nCrc32 != lpEntry->nCrc32)
+            {
+                return MX_E_InvalidData;
+            }
+        }
+        nPos += (ULONGLONG)nBytes;
+        nBytesRead = nBytes;
+        return S_OK;
+    }
+    return Inflate((LPBYTE)lpDest, nBytes, nBytesRead);
+}
+
+HRESULT CZipArchiveReader::CEntryStream::Write(_In_ LPCVOID lpSrc, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesWritten,
+                                               _In_opt_ ULONGLONG nStartOffset)
+{
+    nBytesWritten = 0;
+    return E_NOTIMPL;
+}
+
+HRESULT CZipArchiveReader::CEntryStream::Seek(_In_ ULONGLONG nPosition, _In_opt_ CStream::eSeekMethod nMethod)
+{
+    BYTE aTempBuf[4096];
+    HRESULT hRes;
+
+    switch (nMethod)
+    {
+        case eSeekMethod::Start:
+            break;
+
+        case eSeekMethod::Current:
+            if ((LONGLONG)nPosition >= 0)
+            {
+                nPosition += nPos;
+            }
+            else
+            {
+                nPosition = (~nPosition) + 1;
+                if (nPosition > nPos)
+                {
+                    return E_FAIL;
+                }
+                nPosition = nPos - nPosition;
+            }
+            break;
+
+        case eSeekMethod::End:
+            if (nPosition > lpEntry->nUncompressedSize)
+            {
+                nPosition = lpEntry->nUncompressedSize;
+            }
+            nPosition = lpEntry->nUncompressedSize - nPosition;
+            break;
+
+        default:
+            return E_INVALIDARG;
+    }
+    if (nPosition > lpEntry->nUncompressedSize)
+    {
+        nPosition = lpEntry->nUncompressedSize;
+    }
+
+    if (lpStream == NULL)
+    {
+        nPos = nPosition;
+        return S_OK;
+    }
+
+    // deflated data can only be decompressed forward
+    if (nPosition < nPos)
+    {
+        hRes = Rewind();
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+    while (nPos < nPosition)
+    {
+        SIZE_T nToSkip, nSkipped;
+
+        nToSkip = (nPosition - nPos > (ULONGLONG)sizeof(aTempBuf)) ? sizeof(aTempBuf) : (SIZE_T)(nPosition - nPos);
+        hRes = Inflate(aTempBuf, nToSkip, nSkipped);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+    return S_OK;
+}
+
+ULONGLONG CZipArchiveReader::CEntryStream::GetLength() const
+{
+    return lpEntry->nUncompressedSize;
+}
+
+HRESULT CZipArchiveReader::CEntryStream::Initialize()
+{
+    int nErr;
+
+    if (lpEntry->wMethod == METHOD_STORE)
+    {
+        return S_OK;
+    }
+
+    lpStream = MX_MALLOC(sizeof(z_stream));
+    if (lpStream == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    ::MxMemSet(lpStream, 0, sizeof(z_stream));
+    __try
+    {
+        nErr = inflateInit2(__stream, -15);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        nErr = Z_MEM_ERROR;
+    }
+    if (nErr != Z_OK)
+    {
+        MX_FREE(lpStream);
+        return (nErr == Z_MEM_ERROR) ? E_OUTOFMEMORY : E_FAIL;
+    }
+    return S_OK;
+}
+
+HRESULT CZipArchiveReader::CEntryStream::Rewind()
+{
+    int nErr;
+
+    __try
+    {
+        nErr = inflateReset(__stream);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        nErr = Z_STREAM_ERROR;
+    }
+    if (nErr != Z_OK)
+    {
+        return E_FAIL;
+    }
+    nCompressedPos = nPos = 0;
+    nCrc32 = 0;
+    return S_OK;
+}
+
+HRESULT CZipArchiveReader::CEntryStream::Inflate(_Out_ LPBYTE lpDest, _In_ SIZE_T nBytes, _Out_ SIZE_T &nBytesRead)
+{
+    int nErr;
+
+    nBytesRead = 0;
+    while (nBytes > 0)
+    {
+        ULONGLONG nAvailIn = lpEntry->nCompressedSize - nCompressedPos;
+        SIZE_T nToRead, nInput, nOutput;
+
+        nToRead = (nBytes > (SIZE_T)MAX_INFLATE_INPUT) ? (SIZE_T)MAX_INFLATE_INPUT : nBytes;
+        __stream->next_in = lpData + (SIZE_T)nCompressedPos;
+        __stream->avail_in = (nAvailIn > (ULONGLONG)MAX_INFLATE_INPUT) ? MAX_INFLATE_INPUT : (uInt)nAvailIn;
+        __stream->next_out = lpDest;
+        __stream->avail_out = (uInt)nToRead;
+        nInput = (SIZE_T)(__stream->avail_in);
+        __try
+        {
+            nErr = inflate(__stream, Z_SYNC_FLUSH);
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            nErr = Z_DATA_ERROR;
+        }
+        if (nErr != Z_OK && nErr != Z_STREAM_END && nErr != Z_BUF_ERROR)
+        {
+            return (nErr == Z_MEM_ERROR) ? E_OUTOFMEMORY : MX_E_InvalidData;
+        }
+        nInput -= (SIZE_T)(__stream->avail_in);
+        nOutput = nToRead - (SIZE_T)(__stream->avail_out);
+        if (nOutput == 0)
+        {
+            // the entry's compressed data ended before its uncompressed size was reached
+            return MX_E_InvalidData;
+        }
+
+        nCrc32 = MX::Crc32(nCrc32, lpDest, nOutput);
+        nCompressedPos += (ULONGLONG)nInput;
+        nPos += (ULONGLONG)nOutput;
+        lpDest += nOutput;
+        nBytes -= nOutput;
+        nBytesRead += nOutput;
+
+        if (nPos == lpEntry->nUncompressedSize && nCrc32 != lpEntry->nCrc32)
+        {
+            return MX_E_InvalidData;
+        }
+    }
+    return S_OK;
+}
+
+} // namespace MX
+
+//-----------------------------------------------------------
+
+static VOID EndInflate(_In_ LPVOID lpStream)
+{
+    __try
+    {
+        inflateEnd(__stream);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+    }
+    return;
+}
@@ -18,10 +18,12 @@
  * limitations under the License.
  */
 #include "..\..\Include\ZipLib\ZipFile.h"
+#include "..\..\Include\ZipLib\ParallelDeflate.h"
 #include "..\..\Include\Strings\Utf8.h"
 #include "..\..\Include\FileStream.h"
 #include "..\..\Include\AutoPtr.h"
 #include "..\..\Include\DateTime\DateTime.h"
+#include "..\..\Include\Crc32.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,6 +55,14 @@ static HRESULT mzError_2_HRESULT(_In_ int32_t err);
 
 //-----------------------------------------------------------
 
+// NOTE: Minizip's mz_crypt.c is not built (see mz_custom.c) so this is the only definition.
+extern "C" uint32_t mz_crypt_crc32_update(uint32_t value, const uint8_t *buf, int32_t size)
+{
+    return (uint32_t)MX::Crc32((ULONG)value, buf, (size > 0) ? (SIZE_T)size : 0);
+}
+
+//-----------------------------------------------------------
+
 namespace MX {
 
 CZipFile::CZipFile() : CBaseMemObj(), CNonCopyableObj()
@@ -104,6 +114,19 @@ VOID CZipFile::CloseArchive()
     return;
 }
 
+VOID CZipFile::SetOption_CompressionThreadsCount(_In_ DWORD dwCount)
+{
+    if (dwCount == 0)
+    {
+        SYSTEM_INFO sSi;
+
+        ::GetSystemInfo(&sSi);
+        dwCount = sSi.dwNumberOfProcessors;
+    }
+    dwCompressionThreadsCount = dwCount;
+    return;
+}
+
 HRESULT CZipFile::AddFile(_In_z_ LPCWSTR szFileNameInZipW, _In_z_ LPCWSTR szSrcFileNameW, _In_opt_z_ LPCWSTR szPasswordW)
 {
     static const BYTE aSharingAccess[4] = { FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_SHARE_READ | FILE_SHARE_DELETE,
@@ -136,6 +159,7 @@ HRESULT CZipFile::AddStream(_In_z_ LPCWSTR szFileNameInZipW, _In_ MX::CStream *l
     mz_zip_file file_info;
     CStringA cStrFileNameA_Utf8;
     CSecureStringA cStrPasswordA_Utf8;
+    TAutoDeletePtr<CParallelDeflate> cParallelDeflate;
     CDateTime cDt;
     LONGLONG t;
     HRESULT hRes;
@@ -269,8 +293,31 @@ HRESULT CZipFile::AddStream(_In_z_ LPCWSTR szFileNameInZipW, _In_ MX::CStream *l
         }
     }
 
-    hRes = mzError_2_HRESULT(mz_zip_entry_write_open(zc_data->zip_handle, &file_info, MZ_COMPRESS_LEVEL_BEST, 0,
+    // big unencrypted entries are compressed in parallel and stored as raw data
+    if (dwCompressionThreadsCount > 1 && cStrPasswordA_Utf8.IsEmpty() != FALSE &&
+        file_info.uncompressed_size > (int64_t)sizeof(zc_data->aTempBuffer))
+    {
+        cParallelDeflate.Attach(MX_DEBUG_NEW CParallelDeflate());
+        if (!cParallelDeflate)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    hRes = mzError_2_HRESULT(mz_zip_entry_write_open(zc_data->zip_handle, &file_info, MZ_COMPRESS_LEVEL_BEST,
+                                                     (cParallelDeflate) ? 1 : 0,
                                                      (cStrPasswordA_Utf8.IsEmpty() != FALSE) ? NULL : (LPCSTR)cStrPasswordA_Utf8));
+    if (SUCCEEDED(hRes) && cParallelDeflate)
+    {
+        hRes = cParallelDeflate->Begin(MZ_COMPRESS_LEVEL_BEST, CParallelDeflate::eFormat::Raw,
+                                       MX_BIND_CALLBACK(&CZipFile::OnParallelDeflateOutput), zc_data->zip_handle,
+                                       dwCompressionThreadsCount);
+        if (FAILED(hRes))
+        {
+            mz_zip_entry_close(zc_data->zip_handle);
+            return hRes;
+        }
+    }
     if (SUCCEEDED(hRes))
     {
         ULONGLONG ullToRead;
@@ -294,11 +341,23 @@ HRESULT CZipFile::AddStream(_In_z_ LPCWSTR szFileNameInZipW, _In_ MX::CStream *l
                 break;
             }
 
-            written = mz_zip_entry_write(zc_data->zip_handle, zc_data->aTempBuffer, (int32_t)nBytesRead);
-            if (written < MZ_OK)
+            if (cParallelDeflate)
             {
-                hRes = mzError_2_HRESULT(written);
-                break;
+                hRes = cParallelDeflate->Write(zc_data->aTempBuffer, nBytesRead);
+                if (FAILED(hRes))
+                {
+                    break;
+                }
+                written = (int32_t)nBytesRead;
+            }
+            else
+            {
+                written = mz_zip_entry_write(zc_data->zip_handle, zc_data->aTempBuffer, (int32_t)nBytesRead);
+                if (written < MZ_OK)
+                {
+                    hRes = mzError_2_HRESULT(written);
+                    break;
+                }
             }
 
             ullToRead -= (ULONGLONG)(uint32_t)written;
@@ -306,7 +365,24 @@ HRESULT CZipFile::AddStream(_In_z_ LPCWSTR szFileNameInZipW, _In_ MX::CStream *l
 
         if (SUCCEEDED(hRes))
         {
-            hRes = mzError_2_HRESULT(mz_zip_entry_close(zc_data->zip_handle));
+            if (cParallelDeflate)
+            {
+                hRes = cParallelDeflate->End();
+                if (SUCCEEDED(hRes))
+                {
+                    hRes = mzError_2_HRESULT(mz_zip_entry_close_raw(zc_data->zip_handle,
+                                                                    (int64_t)(cParallelDeflate->GetInputSize()),
+                                                                    (uint32_t)(cParallelDeflate->GetChecksum())));
+                }
+                else
+                {
+                    mz_zip_entry_close(zc_data->zip_handle);
+                }
+            }
+            else
+            {
+                hRes = mzError_2_HRESULT(mz_zip_entry_close(zc_data->zip_handle));
+            }
         }
         else
         {
@@ -570,6 +646,24 @@ HRESULT CZipFile::Read(_In_ CStream *lpStream, _In_ SIZE_T nToRead, _Out_opt_ SI
     return S_OK;
 }
 
+HRESULT CZipFile::OnParallelDeflateOutput(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam)
+{
+    while (nDataLen > 0)
+    {
+        int32_t nToWrite, written;
+
+        nToWrite = (nDataLen > 0x10000000) ? 0x10000000 : (int32_t)nDataLen;
+        written = mz_zip_entry_write(lpUserParam, lpData, nToWrite);
+        if (written <= 0)
+        {
+            return (written < MZ_OK) ? mzError_2_HRESULT(written) : MX_E_WriteFault;
+        }
+        lpData = (LPBYTE)lpData + (SIZE_T)written;
+        nDataLen -= (SIZE_T)written;
+    }
+    return S_OK;
+}
+
 HRESULT CZipFile::CreateOrOpenArchive(_In_z_ LPCWSTR szFileNameW, _In_ int mode)
 {
     CStringA cStrUtf8FileNameA;
@@ -18,6 +18,7 @@
  * limitations under the License.
  */
 #include "..\..\Include\ZipLib\ZipLib.h"
+#include "..\..\Include\ZipLib\ParallelDeflate.h"
 #include "Source\zlib.h"
 
  //-----------------------------------------------------------
@@ -35,6 +36,7 @@
 #define INUSE_None 0
 #define INUSE_Compressing 1
 #define INUSE_Decompressing 2
+#define INUSE_ParallelCompressing 3
 
 #define __stream ((z_streamp)lpStream)
 
@@ -46,6 +48,7 @@ CZipLib::CZipLib(_In_ BOOL _bUseZipLibHeader) : CBaseMemObj(), CNonCopyableObj()
 {
     bUseZipLibHeader = _bUseZipLibHeader;
     nInUse = INUSE_None;
+    lpParallelDeflate = NULL;
     lpStream = (z_streamp)MX_MALLOC(sizeof(z_stream));
     Cleanup();
     return;
@@ -93,6 +96,39 @@ HRESULT CZipLib::BeginCompress(_In_ int nCompressionLevel)
     return S_OK;
 }
 
+HRESULT CZipLib::BeginParallelCompress(_In_ int nCompressionLevel, _In_opt_ DWORD dwThreadsCount)
+{
+    HRESULT hRes;
+
+    if (nCompressionLevel < 1 || nCompressionLevel > 9)
+    {
+        return E_INVALIDARG;
+    }
+    if (nInUse != INUSE_None)
+    {
+        return MX_E_AlreadyInitialized;
+    }
+    lpParallelDeflate = MX_DEBUG_NEW CParallelDeflate();
+    if (lpParallelDeflate == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    // free processed data
+    cProcessed.SetBufferSize(0);
+    // initialize compression
+    hRes = lpParallelDeflate->Begin(nCompressionLevel, (bUseZipLibHeader != FALSE) ? CParallelDeflate::eFormat::ZLib
+                                                                                   : CParallelDeflate::eFormat::Raw,
+                                    MX_BIND_MEMBER_CALLBACK(&CZipLib::OnParallelDeflateOutput, this), NULL,
+                                    dwThreadsCount);
+    if (FAILED(hRes))
+    {
+        MX_DELETE(lpParallelDeflate);
+        return hRes;
+    }
+    nInUse = INUSE_ParallelCompressing;
+    return S_OK;
+}
+
 HRESULT CZipLib::BeginDecompress()
 {
     int nErr;
@@ -132,6 +168,15 @@ HRESULT CZipLib::CompressStream(_In_ LPCVOID lpSrc, _In_ SIZE_T nSrcLen)
     int nErr;
     HRESULT hRes;
 
+    if (nInUse == INUSE_ParallelCompressing)
+    {
+        hRes = lpParallelDeflate->Write(lpSrc, nSrcLen);
+        if (FAILED(hRes))
+        {
+            Cleanup();
+        }
+        return hRes;
+    }
     if (nInUse != INUSE_Compressing)
     {
         return E_FAIL;
@@ -341,11 +386,21 @@ HRESULT CZipLib::DecompressStream(_In_ LPCVOID lpSrc, _In_ SIZE_T nSrcLen, _Out_
 
 HRESULT CZipLib::End()
 {
+    SIZE_T nWritten;
     int nErr, nRetry;
     HRESULT hRes;
 
     switch (nInUse)
     {
+        case INUSE_ParallelCompressing:
+            hRes = lpParallelDeflate->End();
+            Cleanup();
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+            break;
+
         case INUSE_Compressing:
             nErr = Z_OK;
             nRetry = 24;
@@ -368,16 +423,17 @@ HRESULT CZipLib::End()
                     Cleanup();
                     return (nErr == Z_MEM_ERROR) ? E_OUTOFMEMORY : E_FAIL;
                 }
-                if (__stream->avail_out > 0)
+                nWritten = sizeof(aTempBuf) - (SIZE_T)(__stream->avail_out);
+                if (nWritten > 0)
                 {
-                    hRes = cProcessed.Write(aTempBuf, (SIZE_T)(__stream->avail_out));
+                    hRes = cProcessed.Write(aTempBuf, nWritten);
                     if (FAILED(hRes))
                     {
                         Cleanup();
                         return hRes;
                     }
                 }
-                else
+                else if (nErr == Z_OK)
                 {
                     if ((--nRetry) == 0)
                     {
@@ -413,16 +469,17 @@ HRESULT CZipLib::End()
                         Cleanup();
                         return (nErr == Z_MEM_ERROR) ? E_OUTOFMEMORY : MX_E_InvalidData;
                     }
-                    if (__stream->avail_out > 0)
+                    nWritten = sizeof(aTempBuf) - (SIZE_T)(__stream->avail_out);
+                    if (nWritten > 0)
                     {
-                        hRes = cProcessed.Write(aTempBuf, (SIZE_T)(__stream->avail_out));
+                        hRes = cProcessed.Write(aTempBuf, nWritten);
                         if (FAILED(hRes))
                         {
                             Cleanup();
                             return hRes;
                         }
                     }
-                    else
+                    else if (nErr == Z_OK)
                     {
                         if ((--nRetry) == 0)
                         {
@@ -483,6 +540,10 @@ VOID CZipLib::Cleanup()
             {
             }
             break;
+
+        case INUSE_ParallelCompressing:
+            MX_DELETE(lpParallelDeflate);
+            break;
     }
     nInUse = INUSE_None;
     nLevel = nGZipHdrState = 0;
@@ -495,6 +556,11 @@ VOID CZipLib::Cleanup()
     return;
 }
 
+HRESULT CZipLib::OnParallelDeflateOutput(_In_ LPCVOID lpData, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam)
+{
+    return cProcessed.Write(lpData, nDataLen);
+}
+
 BOOL CZipLib::CheckAndSkipGZipHeader(_Inout_ LPBYTE &s, _Inout_ SIZE_T &nSrcLen, _Inout_opt_ SIZE_T *lpnUnusedBytes)
 {
     while (nGZipHdrState > 0 && nSrcLen > 0)
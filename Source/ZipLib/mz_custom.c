@@ -36,7 +36,8 @@
 #pragma warning(disable : 6262)
 
 #define strdup _strdup
-#include "MiniZipSource\mz_crypt.c"
+// NOTE: mz_crypt.c is left out of the build. Its crc32 is replaced by the forwarder in ZipFile.cpp and the pbkdf2
+//       routine is only used by the WinZip AES stream which is not built either.
 #include "MiniZipSource\mz_os.c"
 #include "MiniZipSource\mz_os_win32.c"
 #include "MiniZipSource\mz_strm.c"
@@ -0,0 +1,385 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "HttpTestClient.h"
+
+ //-----------------------------------------------------------
+
+#define MAX_HEADERS_SIZE 65536
+
+//-----------------------------------------------------------
+
+static HRESULT SendAndReceive(_In_ SOCKET sck, _In_z_ LPCSTR szRequestA, _In_ int nRequestLen, _In_ LPBYTE lpBuffer,
+                              _In_ SIZE_T nBufferSize, _Out_ HttpTestClient::RESPONSE *lpResponse);
+static HRESULT ReceiveChunkedBody(_In_ SOCKET sck, _In_ LPBYTE lpBuffer, _In_ SIZE_T nBufferSize,
+                                  _In_ SIZE_T nBodyStart, _In_ SIZE_T nReceived, _Out_ SIZE_T *lpnBodyLen);
+static HRESULT ReceiveMore(_In_ SOCKET sck, _In_ LPBYTE lpBuffer, _In_ SIZE_T nBufferSize, _Inout_ SIZE_T *lpnReceived);
+static HRESULT FormatRequest(_Out_writes_z_(nBufferSize) LPSTR szBufferA, _In_ SIZE_T nBufferSize,
+                             _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szConnectionA, _In_z_ LPCSTR szExtraHeadersA,
+                             _Out_ int *lpnLength);
+
+//-----------------------------------------------------------
+
+namespace HttpTestClient {
+
+HRESULT Connect(_In_ DWORD dwPort, _Out_ SOCKET *lpSck)
+{
+    SOCKADDR_IN sAddr;
+    SOCKET sck;
+    BOOL bNoDelay = TRUE;
+    DWORD dwTimeoutMs = 10000;
+
+    if (lpSck == NULL)
+    {
+        return E_POINTER;
+    }
+    *lpSck = INVALID_SOCKET;
+
+    sck = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sck == INVALID_SOCKET)
+    {
+        return MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    }
+    ::setsockopt(sck, IPPROTO_TCP, TCP_NODELAY, (const char *)&bNoDelay, (int)sizeof(bNoDelay));
+    ::setsockopt(sck, SOL_SOCKET, SO_RCVTIMEO, (const char *)&dwTimeoutMs, (int)sizeof(dwTimeoutMs));
+
+    ::MxMemSet(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port = htons((u_short)dwPort);
+    sAddr.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(sck, (const sockaddr *)&sAddr, (int)sizeof(sAddr)) == SOCKET_ERROR)
+    {
+        HRESULT hRes = MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+
+        ::closesocket(sck);
+        return hRes;
+    }
+
+    // done
+    *lpSck = sck;
+    return S_OK;
+}
+
+HRESULT DoRequest(_In_ SOCKET sck, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA, _In_ LPBYTE lpBuffer,
+                  _In_ SIZE_T nBufferSize, _Out_ RESPONSE *lpResponse)
+{
+    CHAR szRequestA[1024];
+    int nRequestLen;
+    HRESULT hRes;
+
+    if (lpResponse == NULL)
+    {
+        return E_POINTER;
+    }
+    ::MxMemSet(lpResponse, 0, sizeof(RESPONSE));
+
+    hRes = FormatRequest(szRequestA, _countof(szRequestA), szPathA, "Keep-Alive", szExtraHeadersA, &nRequestLen);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SendAndReceive(sck, szRequestA, nRequestLen, lpBuffer, nBufferSize, lpResponse);
+    }
+    return hRes;
+}
+
+HRESULT DoSingleRequest(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA,
+                        _In_ LPBYTE lpBuffer, _In_ SIZE_T nBufferSize, _Out_ RESPONSE *lpResponse)
+{
+    CHAR szRequestA[1024];
+    SOCKET sck;
+    int nRequestLen;
+    HRESULT hRes;
+
+    if (lpResponse == NULL)
+    {
+        return E_POINTER;
+    }
+    ::MxMemSet(lpResponse, 0, sizeof(RESPONSE));
+
+    hRes = FormatRequest(szRequestA, _countof(szRequestA), szPathA, "close", szExtraHeadersA, &nRequestLen);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = Connect(dwPort, &sck);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SendAndReceive(sck, szRequestA, nRequestLen, lpBuffer, nBufferSize, lpResponse);
+
+        ::closesocket(sck);
+    }
+    return hRes;
+}
+
+BOOL HasHeader(_In_ RESPONSE *lpResponse, _In_z_ LPCSTR szHeaderLineA)
+{
+    return (MX::StrFindA(lpResponse->szHeadersA, szHeaderLineA, FALSE, TRUE) != NULL) ? TRUE : FALSE;
+}
+
+BOOL GetHeaderValue(_In_ RESPONSE *lpResponse, _In_z_ LPCSTR szNameA, _Out_ MX::CStringA &cStrValueA)
+{
+    CHAR szSearchA[64];
+    LPCSTR szValueA, szEndA;
+
+    cStrValueA.Empty();
+    _snprintf_s(szSearchA, _countof(szSearchA), _TRUNCATE, "\r\n%s: ", szNameA);
+    szValueA = MX::StrFindA(lpResponse->szHeadersA, szSearchA, FALSE, TRUE);
+    if (szValueA == NULL)
+    {
+        return FALSE;
+    }
+    szValueA += MX::StrLenA(szSearchA);
+    for (szEndA = szValueA; *szEndA != 0 && *szEndA != '\r'; szEndA++);
+    return (szEndA > szValueA && cStrValueA.CopyN(szValueA, (SIZE_T)(szEndA - szValueA)) != FALSE) ? TRUE : FALSE;
+}
+
+BOOL HasBody(_In_ RESPONSE *lpResponse, _In_z_ LPCSTR szContentA)
+{
+    SIZE_T nLen = MX::StrLenA(szContentA);
+
+    return (lpResponse->nBodyLen == nLen && ::MxMemCompare(lpResponse->lpBody, szContentA, nLen) == 0) ? TRUE : FALSE;
+}
+
+}; // namespace HttpTestClient
+
+//-----------------------------------------------------------
+
+static HRESULT SendAndReceive(_In_ SOCKET sck, _In_z_ LPCSTR szRequestA, _In_ int nRequestLen, _In_ LPBYTE lpBuffer,
+                              _In_ SIZE_T nBufferSize, _Out_ HttpTestClient::RESPONSE *lpResponse)
+{
+    LPCSTR szHeadersEndA, szContentLengthA, szTransferEncodingA;
+    SIZE_T nReceived, nHeadersLen, nBodyLen, nMaxHeadersSize;
+    int r;
+
+    if (nBufferSize < 16)
+    {
+        return MX_E_BufferOverflow;
+    }
+    nMaxHeadersSize = (nBufferSize - 1 < MAX_HEADERS_SIZE) ? (nBufferSize - 1) : MAX_HEADERS_SIZE;
+
+    if (::send(sck, szRequestA, nRequestLen, 0) == SOCKET_ERROR)
+    {
+        return MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    }
+
+    // read the headers
+    nReceived = 0;
+    szHeadersEndA = NULL;
+    while (szHeadersEndA == NULL)
+    {
+        if (nReceived >= nMaxHeadersSize)
+        {
+            return MX_E_BufferOverflow;
+        }
+        r = ::recv(sck, (char *)lpBuffer + nReceived, (int)(nMaxHeadersSize - nReceived), 0);
+        if (r <= 0)
+        {
+            return (r == 0) ? MX_E_BrokenPipe : MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+        }
+        nReceived += (SIZE_T)r;
+        lpBuffer[nReceived] = 0;
+
+        szHeadersEndA = MX::StrFindA((LPCSTR)lpBuffer, "\r\n\r\n");
+    }
+    nHeadersLen = (SIZE_T)(szHeadersEndA - (LPCSTR)lpBuffer) + 2;
+    if (nHeadersLen < 14 || MX::StrNCompareA((LPCSTR)lpBuffer, "HTTP/1.1 ", 9) != 0)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // parse status and length
+    lpResponse->nStatus = (LONG)(lpBuffer[9] - '0') * 100 + (LONG)(lpBuffer[10] - '0') * 10 + (LONG)(lpBuffer[11] - '0');
+    szTransferEncodingA = MX::StrFindA((LPCSTR)lpBuffer, "\r\nTransfer-Encoding: chunked\r\n", FALSE, TRUE);
+    if (szTransferEncodingA != NULL && szTransferEncodingA < szHeadersEndA)
+    {
+        HRESULT hRes;
+
+        hRes = ReceiveChunkedBody(sck, lpBuffer, nBufferSize, nHeadersLen + 2, nReceived, &nBodyLen);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        goto split;
+    }
+    nBodyLen = 0;
+    szContentLengthA = MX::StrFindA((LPCSTR)lpBuffer, "\r\nContent-Length: ", FALSE, TRUE);
+    if (szContentLengthA != NULL && szContentLengthA < szHeadersEndA)
+    {
+        for (szContentLengthA += 18; *szContentLengthA >= '0' && *szContentLengthA <= '9'; szContentLengthA++)
+        {
+            nBodyLen = nBodyLen * 10 + (SIZE_T)(*szContentLengthA - '0');
+        }
+    }
+    if (nHeadersLen + 2 + nBodyLen >= nBufferSize)
+    {
+        return MX_E_BufferOverflow;
+    }
+
+    // read the body
+    while (nReceived < nHeadersLen + 2 + nBodyLen)
+    {
+        r = ::recv(sck, (char *)lpBuffer + nReceived, (int)(nHeadersLen + 2 + nBodyLen - nReceived), 0);
+        if (r <= 0)
+        {
+            return (r == 0) ? MX_E_BrokenPipe : MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+        }
+        nReceived += (SIZE_T)r;
+    }
+    if (nReceived != nHeadersLen + 2 + nBodyLen)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // split headers from body
+split:
+    lpBuffer[nHeadersLen] = 0;
+    lpBuffer[nHeadersLen + 2 + nBodyLen] = 0;
+    lpResponse->szHeadersA = (LPCSTR)lpBuffer;
+    lpResponse->lpBody = lpBuffer + nHeadersLen + 2;
+    lpResponse->nBodyLen = nBodyLen;
+    return S_OK;
+}
+
+static HRESULT ReceiveChunkedBody(_In_ SOCKET sck, _In_ LPBYTE lpBuffer, _In_ SIZE_T nBufferSize,
+                                  _In_ SIZE_T nBodyStart, _In_ SIZE_T nReceived, _Out_ SIZE_T *lpnBodyLen)
+{
+    SIZE_T nPos, nOut, nLineEnd, nChunkLen;
+    HRESULT hRes;
+
+    // NOTE: Chunks are decoded in place. The decoded body never overtakes the data still to be parsed because
+    //       every chunk is preceded by its header.
+    *lpnBodyLen = 0;
+    nPos = nOut = nBodyStart;
+    for (;;)
+    {
+        // read the chunk header line
+        for (;;)
+        {
+            for (nLineEnd = nPos; nLineEnd + 1 < nReceived; nLineEnd++)
+            {
+                if (lpBuffer[nLineEnd] == '\r' && lpBuffer[nLineEnd + 1] == '\n')
+                {
+                    break;
+                }
+            }
+            if (nLineEnd + 1 < nReceived)
+            {
+                break;
+            }
+            hRes = ReceiveMore(sck, lpBuffer, nBufferSize, &nReceived);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+
+        // parse the chunk size (extensions are not used by the server)
+        nChunkLen = 0;
+        if (nPos == nLineEnd)
+        {
+            return MX_E_InvalidData;
+        }
+        for (; nPos < nLineEnd; nPos++)
+        {
+            BYTE c = lpBuffer[nPos];
+
+            if (nChunkLen > ((SIZE_T)-1) >> 4)
+            {
+                return MX_E_ArithmeticOverflow;
+            }
+            if (c >= '0' && c <= '9')
+            {
+                nChunkLen = (nChunkLen << 4) + (SIZE_T)(c - '0');
+            }
+            else if (c >= 'A' && c <= 'F')
+            {
+                nChunkLen = (nChunkLen << 4) + (SIZE_T)(c - 'A' + 10);
+            }
+            else if (c >= 'a' && c <= 'f')
+            {
+                nChunkLen = (nChunkLen << 4) + (SIZE_T)(c - 'a' + 10);
+            }
+            else
+            {
+                return MX_E_InvalidData;
+            }
+        }
+        nPos += 2;
+        if (nChunkLen + 2 > nBufferSize - 1 - nPos)
+        {
+            return MX_E_BufferOverflow;
+        }
+
+        // read the chunk data and its trailing CRLF (or the final CRLF)
+        while (nReceived < nPos + nChunkLen + 2)
+        {
+            hRes = ReceiveMore(sck, lpBuffer, nBufferSize, &nReceived);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        if (lpBuffer[nPos + nChunkLen] != '\r' || lpBuffer[nPos + nChunkLen + 1] != '\n')
+        {
+            return MX_E_InvalidData;
+        }
+        if (nChunkLen == 0)
+        {
+            break;
+        }
+
+        ::MxMemMove(lpBuffer + nOut, lpBuffer + nPos, nChunkLen);
+        nOut += nChunkLen;
+        nPos += nChunkLen + 2;
+    }
+    if (nReceived != nPos + 2)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // done
+    *lpnBodyLen = nOut - nBodyStart;
+    return S_OK;
+}
+
+static HRESULT ReceiveMore(_In_ SOCKET sck, _In_ LPBYTE lpBuffer, _In_ SIZE_T nBufferSize, _Inout_ SIZE_T *lpnReceived)
+{
+    int r;
+
+    if (*lpnReceived >= nBufferSize - 1)
+    {
+        return MX_E_BufferOverflow;
+    }
+    r = ::recv(sck, (char *)lpBuffer + *lpnReceived, (int)(nBufferSize - 1 - *lpnReceived), 0);
+    if (r <= 0)
+    {
+        return (r == 0) ? MX_E_BrokenPipe : MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    }
+    *lpnReceived += (SIZE_T)r;
+    lpBuffer[*lpnReceived] = 0;
+    return S_OK;
+}
+
+static HRESULT FormatRequest(_Out_writes_z_(nBufferSize) LPSTR szBufferA, _In_ SIZE_T nBufferSize,
+                             _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szConnectionA, _In_z_ LPCSTR szExtraHeadersA,
+                             _Out_ int *lpnLength)
+{
+    *lpnLength = _snprintf_s(szBufferA, nBufferSize, _TRUNCATE,
+                             "GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: %s\r\n%s\r\n", szPathA,
+                             szConnectionA, szExtraHeadersA);
+    return (*lpnLength >= 0) ? S_OK : MX_E_BufferOverflow;
+}
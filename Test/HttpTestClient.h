@@ -0,0 +1,50 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Test.h"
+
+ //-----------------------------------------------------------
+
+namespace HttpTestClient {
+
+typedef struct tagRESPONSE
+{
+    LONG nStatus;
+    LPCSTR szHeadersA;
+    LPBYTE lpBody;
+    SIZE_T nBodyLen;
+} RESPONSE;
+
+HRESULT Connect(_In_ DWORD dwPort, _Out_ SOCKET *lpSck);
+
+// NOTE: Sends a keep-alive GET request over an already connected socket. Headers and body are stored in
+//       lpBuffer and lpResponse points into it.
+HRESULT DoRequest(_In_ SOCKET sck, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA, _In_ LPBYTE lpBuffer,
+                  _In_ SIZE_T nBufferSize, _Out_ RESPONSE *lpResponse);
+// NOTE: Same as above but uses a new connection that is closed after the response is received.
+HRESULT DoSingleRequest(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA,
+                        _In_ LPBYTE lpBuffer, _In_ SIZE_T nBufferSize, _Out_ RESPONSE *lpResponse);
+
+BOOL HasHeader(_In_ RESPONSE *lpResponse, _In_z_ LPCSTR szHeaderLineA);
+BOOL GetHeaderValue(_In_ RESPONSE *lpResponse, _In_z_ LPCSTR szNameA, _Out_ MX::CStringA &cStrValueA);
+BOOL HasBody(_In_ RESPONSE *lpResponse, _In_z_ LPCSTR szContentA);
+
+}; // namespace HttpTestClient
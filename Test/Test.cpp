@@ -26,6 +26,17 @@
 #include "TestJavascript.h"
 #include "TestJsHttpServer.h"
 #include "TestRedBlackTree.h"
+#include "TestPropertyBag.h"
+#include "TestLockFreeQueue.h"
+#include "TestHttpRange.h"
+#include "TestHttpJson.h"
+#include "TestHttpStaticFiles.h"
+#include "TestUrl.h"
+#include "TestHttpStreamedBody.h"
+#include "TestHttpRecycle.h"
+#include "TestJsSessionStore.h"
+#include "TestJsJwt.h"
+#include "TestBenchmark.h"
 #include "Comm\SslCertificates.h"
 #include "Comm\HostResolver.h"
 
@@ -45,9 +56,21 @@
 #endif // USE_JEMALLOC
 
 #ifdef USE_JEMALLOC
-MX_DEFINE_MALLOC_OVERRIDE(je_malloc, je_realloc, je_free, je_malloc_usable_size)
+static MX_MALLOC_OVERRIDE sJeMallocAllocator = { je_malloc, je_realloc, je_free, je_malloc_usable_size };
+#define BACKING_ALLOCATOR (&sJeMallocAllocator)
+#else //USE_JEMALLOC
+extern "C" LPMX_MALLOC_OVERRIDE lpMxDefaultAllocatorOverride;
+#define BACKING_ALLOCATOR lpMxDefaultAllocatorOverride
 #endif // USE_JEMALLOC
 
+// NOTE: Library allocations go through these wrappers so benchmarks can report allocations per operation.
+static void *CountingMalloc(_In_ size_t nSize);
+static void *CountingRealloc(_In_opt_ void *lpPtr, _In_ size_t nSize);
+static void CountingFree(_Frees_ptr_opt_ void *lpPtr);
+static size_t CountingMemSize(_In_opt_ void *lpPtr);
+
+MX_DEFINE_MALLOC_OVERRIDE(CountingMalloc, CountingRealloc, CountingFree, CountingMemSize)
+
 #ifdef _DEBUG
 #define USE_PATH_TO_SOURCE
 #endif //_DEBUG
@@ -83,7 +106,9 @@ int wmain(_In_ int argc, _In_ WCHAR *argv[])
     {
         wprintf_s(L"Use: Test.exe test-module [options]\n\n");
         wprintf_s(L"Where 'test-module' can be:\n");
-        wprintf_s(L"    HttpServer, JsHttpServer, HttpClient, Javascript or RedBlackTree\n\n");
+        wprintf_s(L"    HttpServer, JsHttpServer, HttpClient, HttpRange, HttpJson, HttpStaticFiles,\n");
+        wprintf_s(L"    Url, HttpStreamedBody, HttpRecycle, JsSessionStore, JsJwt, Javascript,\n");
+        wprintf_s(L"    RedBlackTree, PropertyBag, LockFreeQueue or Benchmark\n\n");
         wprintf_s(L"And 'options' can be:\n");
         wprintf_s(L"    /?, /help: Show test-module options.\n");
         wprintf_s(L"    /v #: Set the verbosity level to #.\n");
@@ -111,6 +136,50 @@ int wmain(_In_ int argc, _In_ WCHAR *argv[])
     {
         nTest = 5;
     }
+    else if (_wcsicmp(argv[1], L"Benchmark") == 0)
+    {
+        nTest = 6;
+    }
+    else if (_wcsicmp(argv[1], L"PropertyBag") == 0)
+    {
+        nTest = 7;
+    }
+    else if (_wcsicmp(argv[1], L"LockFreeQueue") == 0)
+    {
+        nTest = 8;
+    }
+    else if (_wcsicmp(argv[1], L"HttpRange") == 0)
+    {
+        nTest = 9;
+    }
+    else if (_wcsicmp(argv[1], L"HttpJson") == 0)
+    {
+        nTest = 10;
+    }
+    else if (_wcsicmp(argv[1], L"HttpStaticFiles") == 0)
+    {
+        nTest = 11;
+    }
+    else if (_wcsicmp(argv[1], L"Url") == 0)
+    {
+        nTest = 12;
+    }
+    else if (_wcsicmp(argv[1], L"HttpStreamedBody") == 0)
+    {
+        nTest = 13;
+    }
+    else if (_wcsicmp(argv[1], L"HttpRecycle") == 0)
+    {
+        nTest = 14;
+    }
+    else if (_wcsicmp(argv[1], L"JsSessionStore") == 0)
+    {
+        nTest = 15;
+    }
+    else if (_wcsicmp(argv[1], L"JsJwt") == 0)
+    {
+        nTest = 16;
+    }
     else
     {
         wprintf_s(L"Error: An unknown test name has been specified (%s).\n", argv[1]);
@@ -144,6 +213,39 @@ int wmain(_In_ int argc, _In_ WCHAR *argv[])
 
         case 5:
             return TestRedBlackTree();
+
+        case 6:
+            return TestBenchmark();
+
+        case 7:
+            return TestPropertyBag();
+
+        case 8:
+            return TestLockFreeQueue();
+
+        case 9:
+            return TestHttpRange();
+
+        case 10:
+            return TestHttpJson();
+
+        case 11:
+            return TestHttpStaticFiles();
+
+        case 12:
+            return TestUrl();
+
+        case 13:
+            return TestHttpStreamedBody();
+
+        case 14:
+            return TestHttpRecycle();
+
+        case 15:
+            return TestJsSessionStore();
+
+        case 16:
+            return TestJsJwt();
     }
     return 0;
 }
@@ -269,3 +371,28 @@ HRESULT GetCmdLineParamUInt(_In_z_ LPCWSTR szParamNameW, _Out_ LPDWORD lpdwValue
     }
     return MX_E_NotFound;
 }
+
+//-----------------------------------------------------------
+
+static void *CountingMalloc(_In_ size_t nSize)
+{
+    AddBenchmarkAllocation();
+    return BACKING_ALLOCATOR->alloc(nSize);
+}
+
+static void *CountingRealloc(_In_opt_ void *lpPtr, _In_ size_t nSize)
+{
+    AddBenchmarkAllocation();
+    return BACKING_ALLOCATOR->realloc(lpPtr, nSize);
+}
+
+static void CountingFree(_Frees_ptr_opt_ void *lpPtr)
+{
+    BACKING_ALLOCATOR->free(lpPtr);
+    return;
+}
+
+static size_t CountingMemSize(_In_opt_ void *lpPtr)
+{
+    return BACKING_ALLOCATOR->memsize(lpPtr);
+}
@@ -0,0 +1,366 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestBenchmark.h"
+#include <Psapi.h>
+
+ //-----------------------------------------------------------
+
+typedef int (*lpfnBenchmark)();
+
+typedef struct tagBENCHMARK_THREAD_DATA
+{
+    MX::CWorkerThread cWorkerThread;
+    lpfnBenchmarkJob lpfnJob{ NULL };
+    LPVOID lpContext{ NULL };
+    DWORD dwThreadIndex{ 0 };
+    LONG volatile *lpnStop{ NULL };
+    ULONGLONG nOps{ 0 };
+} BENCHMARK_THREAD_DATA;
+
+//-----------------------------------------------------------
+
+static LONG volatile nCountAllocations = 0;
+static LONG volatile nAllocationsCount = 0;
+
+//-----------------------------------------------------------
+
+static const struct
+{
+    LPCWSTR szNameW;
+    lpfnBenchmark lpfnBenchmark;
+    LPCWSTR szDescriptionW;
+} aBenchmarks[] = {
+    { L"HttpRequestLimiter", &BenchmarkHttpRequestLimiter, L"Many clients hitting the per-IP/subnet request limiter." },
+    { L"HttpMultipartUpload", &BenchmarkHttpMultipartUpload, L"Parses a large multipart/form-data upload (/size # in MB)." },
+    { L"HttpJsonBody", &BenchmarkHttpJsonBody, L"Parses a large JSON body into a DOM or, with /sax, as events (/size # in MB)." },
+    { L"HttpHelloWorld", &BenchmarkHttpHelloWorld, L"Requests per second of a keep-alive hello world server on loopback (/port #)." },
+    { L"HttpStaticFiles", &BenchmarkHttpStaticFiles, L"Requests per second and cache hit rate serving static files on loopback (/port # /cachesize # in KB)." },
+    { L"HttpRangeRequests", &BenchmarkHttpRangeRequests, L"Throughput of random 256KB range requests over a large file on loopback (/port # /size # in MB)." },
+    { L"HttpUserAgent", &BenchmarkHttpUserAgent, L"User-Agent classification calls per second over a real User-Agent corpus, cached and unique." },
+    { L"HttpLookupTables", &BenchmarkHttpLookupTables, L"MIME type and HTML entity lookups per second, binary search against perfect hash." },
+    { L"HttpUrlParsing", &BenchmarkHttpUrlParsing, L"URLs parsed per second from an access log corpus, CUrl against CUrlView." },
+    { L"HttpCookies", &BenchmarkHttpCookies, L"Requests with a large Cookie header parsed per second and allocations per request, eager vs lazy cookies." },
+    { L"HttpStreamedUpload", &BenchmarkHttpStreamedUpload, L"Hashes a large upload spooled to a temporary file against streamed to the handler (/size # in MB)." },
+    { L"HttpConnectionChurn", &BenchmarkHttpConnectionChurn, L"Short keep-alive connections per second and allocations per request, new vs recycled request objects (/port #)." },
+    { L"ZipParallelDeflate", &BenchmarkZipParallelDeflate, L"Compresses log-like data with 1 to N threads (/size # in MB)." },
+    { L"ZipArchiveReader", &BenchmarkZipArchiveReader, L"Entry lookups and reads from a memory-mapped archive (/files #)." },
+    { L"CryptoDigest", &BenchmarkCryptoDigest, L"Per-call latency of small SHA-256 hashes and HMACs, streaming vs one-shot." },
+    { L"CryptoAead", &BenchmarkCryptoAead, L"Small message AES-GCM and ChaCha20-Poly1305 encryption, streaming vs one-shot." },
+    { L"Crc32", &BenchmarkCrc32, L"CRC32 and CRC32C throughput against zlib's crc32 (/size # in MB)." },
+    { L"Logging", &BenchmarkLogging, L"Messages per second and per-call latency, synchronous callback vs asynchronous." },
+    { L"PropertyBag", &BenchmarkPropertyBag, L"Property lookups, updates and binary serialization of a bag (/keys #)." },
+    { L"LockFreeQueue", &BenchmarkLockFreeQueue, L"Lock-free stack and queues against a CFastLock protected CLnkLst." },
+    { L"LockContention", &BenchmarkLockContention, L"FastLock, SlimRWL and CReaderBiasedRWLock with 1x and 4x threads per CPU (/threads #)." },
+    { L"JsSessionStore", &BenchmarkJsSessionStore, L"Concurrent session load/save round trips, without and with journal (/sessions #)." },
+    { L"JsJson", &BenchmarkJsJson, L"Duktape's JSON.stringify/parse against the native encoder and decoder (/items #)." },
+    { L"JsJwt", &BenchmarkJsJwt, L"JWT.verify of a set of tokens without and with the verified tokens cache (/tokens # /items #)." },
+    { L"JsStreamedResponse", &BenchmarkJsStreamedResponse, L"Peak memory serving a large generated report with response.write or, with /buffered, echo (/port # /size # in MB)." }
+};
+
+//-----------------------------------------------------------
+
+static VOID BenchmarkThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam);
+
+//-----------------------------------------------------------
+
+int TestBenchmark()
+{
+    MX::CStringW cStrNameW;
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe Benchmark /name benchmark-name [/threads #] [/duration #]\n\n");
+        wprintf_s(L"Available benchmarks:\n");
+        for (SIZE_T i = 0; i < MX_ARRAYLEN(aBenchmarks); i++)
+        {
+            wprintf_s(L"    %s: %s\n", aBenchmarks[i].szNameW, aBenchmarks[i].szDescriptionW);
+        }
+        wprintf_s(L"\nAvailable 'options':\n");
+        wprintf_s(L"    /threads #: Number of worker threads. Defaults to the number of processors.\n");
+        wprintf_s(L"    /duration #: Duration in seconds of timed benchmarks. Defaults to 5.\n");
+        return 1;
+    }
+
+    hRes = GetCmdLineParamString(L"name", cStrNameW);
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Benchmark name not specified.\n");
+        return 1;
+    }
+    for (SIZE_T i = 0; i < MX_ARRAYLEN(aBenchmarks); i++)
+    {
+        if (_wcsicmp((LPCWSTR)cStrNameW, aBenchmarks[i].szNameW) == 0)
+        {
+            return aBenchmarks[i].lpfnBenchmark();
+        }
+    }
+    wprintf_s(L"Error: An unknown benchmark name has been specified (%s).\n", (LPCWSTR)cStrNameW);
+    return 1;
+}
+
+DWORD GetBenchmarkThreadsCount()
+{
+    SYSTEM_INFO sSi;
+    DWORD dw;
+
+    if (SUCCEEDED(GetCmdLineParamUInt(L"threads", &dw)) && dw > 0)
+    {
+        return (dw <= 256) ? dw : 256;
+    }
+    ::GetSystemInfo(&sSi);
+    return (sSi.dwNumberOfProcessors > 0) ? sSi.dwNumberOfProcessors : 1;
+}
+
+DWORD GetBenchmarkDurationMs()
+{
+    DWORD dw;
+
+    if (SUCCEEDED(GetCmdLineParamUInt(L"duration", &dw)) && dw > 0)
+    {
+        return ((dw <= 3600) ? dw : 3600) * 1000;
+    }
+    return 5000;
+}
+
+HRESULT RunBenchmarkThreads(_In_ DWORD dwThreadsCount, _In_ DWORD dwDurationMs, _In_ lpfnBenchmarkJob lpfnJob,
+                            _In_opt_ LPVOID lpContext, _Out_ PULONGLONG lpnTotalOps, _Out_opt_ LPDWORD lpdwElapsedMs)
+{
+    BENCHMARK_THREAD_DATA *lpThreadData;
+    LONG volatile nStop = 0;
+    MX::CTimer cTimer;
+    DWORD i, dwStarted;
+    HRESULT hRes = S_OK;
+
+    *lpnTotalOps = 0;
+    if (lpdwElapsedMs != NULL)
+    {
+        *lpdwElapsedMs = 0;
+    }
+
+    lpThreadData = MX_DEBUG_NEW BENCHMARK_THREAD_DATA[dwThreadsCount];
+    if (lpThreadData == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for (dwStarted = 0; dwStarted < dwThreadsCount; dwStarted++)
+    {
+        lpThreadData[dwStarted].lpfnJob = lpfnJob;
+        lpThreadData[dwStarted].lpContext = lpContext;
+        lpThreadData[dwStarted].dwThreadIndex = dwStarted;
+        lpThreadData[dwStarted].lpnStop = &nStop;
+        if (lpThreadData[dwStarted].cWorkerThread.SetRoutine(&BenchmarkThreadProc, &lpThreadData[dwStarted]) == FALSE ||
+            lpThreadData[dwStarted].cWorkerThread.Start() == FALSE)
+        {
+            hRes = E_OUTOFMEMORY;
+            break;
+        }
+    }
+
+    cTimer.Reset();
+    if (SUCCEEDED(hRes))
+    {
+        do
+        {
+            ::Sleep(50);
+            cTimer.Mark();
+        }
+        while (cTimer.GetElapsedTimeMs() < dwDurationMs && ShouldAbort() == FALSE);
+    }
+    _InterlockedExchange(&nStop, 1);
+
+    for (i = 0; i < dwStarted; i++)
+    {
+        lpThreadData[i].cWorkerThread.Wait(INFINITE);
+        *lpnTotalOps += lpThreadData[i].nOps;
+    }
+    cTimer.Mark();
+    if (lpdwElapsedMs != NULL)
+    {
+        *lpdwElapsedMs = cTimer.GetElapsedTimeMs();
+    }
+
+    delete[] lpThreadData;
+
+    // done
+    return hRes;
+}
+
+VOID PrintBenchmarkResult(_In_z_ LPCWSTR szNameW, _In_ ULONGLONG nOps, _In_ DWORD dwElapsedMs)
+{
+    if (dwElapsedMs == 0)
+    {
+        dwElapsedMs = 1;
+    }
+    wprintf_s(L"%s: %I64u ops in %lums (%.0f ops/s)\n", szNameW, nOps, dwElapsedMs,
+              (double)nOps * 1000.0 / (double)dwElapsedMs);
+    return;
+}
+
+HRESULT InitializeBenchmarkLatency(_Out_ BENCHMARK_LATENCY *lpLatency, _In_ DWORD dwThreadsCount)
+{
+    LARGE_INTEGER liFrequency;
+
+    ::MxMemSet(lpLatency, 0, sizeof(BENCHMARK_LATENCY));
+    ::QueryPerformanceFrequency(&liFrequency);
+    lpLatency->nBucketsPerTick = 10000000.0 / (double)(liFrequency.QuadPart);
+
+    lpLatency->lplpHistograms = (PULONG *)MX_MALLOC((SIZE_T)dwThreadsCount * sizeof(PULONG));
+    if (lpLatency->lplpHistograms == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    ::MxMemSet(lpLatency->lplpHistograms, 0, (SIZE_T)dwThreadsCount * sizeof(PULONG));
+    lpLatency->dwThreadsCount = dwThreadsCount;
+    for (DWORD i = 0; i < dwThreadsCount; i++)
+    {
+        lpLatency->lplpHistograms[i] = (PULONG)MX_MALLOC(BENCHMARK_LATENCY_BUCKETS * sizeof(ULONG));
+        if (lpLatency->lplpHistograms[i] == NULL)
+        {
+            FreeBenchmarkLatency(lpLatency);
+            return E_OUTOFMEMORY;
+        }
+    }
+    ResetBenchmarkLatency(lpLatency);
+
+    // done
+    return S_OK;
+}
+
+VOID FreeBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency)
+{
+    if (lpLatency->lplpHistograms != NULL)
+    {
+        for (DWORD i = 0; i < lpLatency->dwThreadsCount; i++)
+        {
+            MX_FREE(lpLatency->lplpHistograms[i]);
+        }
+        MX_FREE(lpLatency->lplpHistograms);
+    }
+    lpLatency->dwThreadsCount = 0;
+    return;
+}
+
+VOID ResetBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency)
+{
+    for (DWORD i = 0; i < lpLatency->dwThreadsCount; i++)
+    {
+        ::MxMemSet(lpLatency->lplpHistograms[i], 0, BENCHMARK_LATENCY_BUCKETS * sizeof(ULONG));
+    }
+    return;
+}
+
+VOID AddBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency, _In_ DWORD dwThreadIndex, _In_ LONGLONG llTicks)
+{
+    SIZE_T nBucket;
+
+    nBucket = (SIZE_T)((double)llTicks * lpLatency->nBucketsPerTick);
+    if (nBucket >= BENCHMARK_LATENCY_BUCKETS)
+    {
+        nBucket = BENCHMARK_LATENCY_BUCKETS - 1;
+    }
+    lpLatency->lplpHistograms[dwThreadIndex][nBucket]++;
+    return;
+}
+
+VOID PrintBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency, _In_ ULONGLONG nOps)
+{
+    static const double aPercentiles[3] = { 0.50, 0.99, 0.999 };
+    double aLatencies[3];
+    ULONGLONG nSum, nTarget;
+    SIZE_T nBucket, nPercentile;
+
+    // merge into the first histogram and walk it once for all the percentiles
+    for (DWORD i = 1; i < lpLatency->dwThreadsCount; i++)
+    {
+        for (nBucket = 0; nBucket < BENCHMARK_LATENCY_BUCKETS; nBucket++)
+        {
+            lpLatency->lplpHistograms[0][nBucket] += lpLatency->lplpHistograms[i][nBucket];
+        }
+    }
+    nSum = 0;
+    nPercentile = 0;
+    for (nBucket = 0; nBucket < BENCHMARK_LATENCY_BUCKETS && nPercentile < MX_ARRAYLEN(aPercentiles); nBucket++)
+    {
+        nSum += (ULONGLONG)(lpLatency->lplpHistograms[0][nBucket]);
+        nTarget = (ULONGLONG)((double)nOps * aPercentiles[nPercentile]);
+        while (nPercentile < MX_ARRAYLEN(aPercentiles) && nSum > 0 && nSum >= nTarget)
+        {
+            aLatencies[nPercentile] = (double)(nBucket + 1) / 10.0;
+            nPercentile++;
+            if (nPercentile < MX_ARRAYLEN(aPercentiles))
+            {
+                nTarget = (ULONGLONG)((double)nOps * aPercentiles[nPercentile]);
+            }
+        }
+    }
+    while (nPercentile < MX_ARRAYLEN(aPercentiles))
+    {
+        aLatencies[nPercentile++] = (double)BENCHMARK_LATENCY_BUCKETS / 10.0;
+    }
+    wprintf_s(L"  latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus\n", aLatencies[0], aLatencies[1], aLatencies[2]);
+    return;
+}
+
+VOID BeginBenchmarkAllocationsCount()
+{
+    _InterlockedExchange(&nAllocationsCount, 0);
+    _InterlockedExchange(&nCountAllocations, 1);
+    return;
+}
+
+ULONG EndBenchmarkAllocationsCount()
+{
+    _InterlockedExchange(&nCountAllocations, 0);
+    return (ULONG)__InterlockedRead(&nAllocationsCount);
+}
+
+VOID AddBenchmarkAllocation()
+{
+    if (__InterlockedRead(&nCountAllocations) != 0)
+    {
+        _InterlockedIncrement(&nAllocationsCount);
+    }
+    return;
+}
+
+SIZE_T GetBenchmarkPrivateBytes(_In_ BOOL bPeak)
+{
+    PROCESS_MEMORY_COUNTERS sPmc;
+
+    ::MxMemSet(&sPmc, 0, sizeof(sPmc));
+    sPmc.cb = (DWORD)sizeof(sPmc);
+    if (::GetProcessMemoryInfo(::GetCurrentProcess(), &sPmc, sizeof(sPmc)) == FALSE)
+    {
+        return 0;
+    }
+    return (bPeak != FALSE) ? sPmc.PeakPagefileUsage : sPmc.PagefileUsage;
+}
+
+//-----------------------------------------------------------
+
+static VOID BenchmarkThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam)
+{
+    BENCHMARK_THREAD_DATA *lpThreadData = (BENCHMARK_THREAD_DATA *)lpParam;
+
+    lpThreadData->nOps = lpThreadData->lpfnJob(lpThreadData->lpContext, lpThreadData->dwThreadIndex, lpThreadData->lpnStop);
+    return;
+}
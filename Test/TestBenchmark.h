@@ -0,0 +1,99 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Test.h"
+#include "Console.h"
+#include <Threads.h>
+#include <Timer.h>
+
+ //-----------------------------------------------------------
+
+#define BENCHMARK_LATENCY_BUCKETS 100000 // 100ns each
+
+//-----------------------------------------------------------
+
+typedef ULONGLONG (*lpfnBenchmarkJob)(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+
+// NOTE: Per-thread latency histograms so jobs can record each call without synchronization.
+typedef struct tagBENCHMARK_LATENCY
+{
+    PULONG *lplpHistograms;
+    DWORD dwThreadsCount;
+    double nBucketsPerTick;
+} BENCHMARK_LATENCY;
+
+//-----------------------------------------------------------
+
+int TestBenchmark();
+
+DWORD GetBenchmarkThreadsCount();
+DWORD GetBenchmarkDurationMs();
+
+HRESULT RunBenchmarkThreads(_In_ DWORD dwThreadsCount, _In_ DWORD dwDurationMs, _In_ lpfnBenchmarkJob lpfnJob,
+                            _In_opt_ LPVOID lpContext, _Out_ PULONGLONG lpnTotalOps, _Out_opt_ LPDWORD lpdwElapsedMs = NULL);
+VOID PrintBenchmarkResult(_In_z_ LPCWSTR szNameW, _In_ ULONGLONG nOps, _In_ DWORD dwElapsedMs);
+
+HRESULT InitializeBenchmarkLatency(_Out_ BENCHMARK_LATENCY *lpLatency, _In_ DWORD dwThreadsCount);
+VOID FreeBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency);
+VOID ResetBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency);
+VOID AddBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency, _In_ DWORD dwThreadIndex, _In_ LONGLONG llTicks);
+VOID PrintBenchmarkLatency(_Inout_ BENCHMARK_LATENCY *lpLatency, _In_ ULONGLONG nOps);
+
+// NOTE: Counts every library allocation and reallocation while enabled, from any thread. Use it on a
+//       single-threaded pass outside the timed runs.
+VOID BeginBenchmarkAllocationsCount();
+ULONG EndBenchmarkAllocationsCount();
+VOID AddBenchmarkAllocation();
+
+// NOTE: Current or peak private bytes of the process.
+SIZE_T GetBenchmarkPrivateBytes(_In_ BOOL bPeak);
+
+//-----------------------------------------------------------
+
+int BenchmarkHttpRequestLimiter();
+int BenchmarkHttpMultipartUpload();
+int BenchmarkHttpJsonBody();
+int BenchmarkHttpHelloWorld();
+int BenchmarkHttpStaticFiles();
+int BenchmarkHttpRangeRequests();
+int BenchmarkHttpUserAgent();
+int BenchmarkHttpLookupTables();
+int BenchmarkHttpUrlParsing();
+int BenchmarkHttpCookies();
+int BenchmarkHttpStreamedUpload();
+int BenchmarkHttpConnectionChurn();
+
+int BenchmarkZipParallelDeflate();
+int BenchmarkZipArchiveReader();
+
+int BenchmarkCryptoDigest();
+int BenchmarkCryptoAead();
+
+int BenchmarkCrc32();
+int BenchmarkLogging();
+int BenchmarkPropertyBag();
+int BenchmarkLockFreeQueue();
+int BenchmarkLockContention();
+
+int BenchmarkJsSessionStore();
+int BenchmarkJsJson();
+int BenchmarkJsJwt();
+int BenchmarkJsStreamedResponse();
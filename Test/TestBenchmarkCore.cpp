@@ -0,0 +1,938 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestBenchmark.h"
+#include <Crc32.h>
+#include <AsyncLogger.h>
+#include <PropertyBag.h>
+#include <LinkedList.h>
+#include <LockFreeQueue.h>
+
+ //-----------------------------------------------------------
+
+#define QUEUE_ITEMS_PER_THREAD 16
+
+#define LOCK_SHARED_DATA_COUNT 16
+#define LOCK_OVERSUBSCRIPTION_FACTOR 4
+#define LOCK_WRITE_PERCENT 10
+
+//-----------------------------------------------------------
+
+// NOTE: ZLib is built with Z_PREFIX so its crc32 is exported as z_crc32.
+extern "C" unsigned long z_crc32(unsigned long crc, const unsigned char *buf, unsigned int len);
+
+//-----------------------------------------------------------
+
+typedef struct tagCRC_CONTEXT
+{
+    LPBYTE lpData;
+    SIZE_T nDataSize;
+    int nKind;
+} CRC_CONTEXT;
+
+typedef struct tagLOG_CONTEXT
+{
+    MX::CLoggable *lpLog;
+    DWORD dwThreadsCount;
+    BENCHMARK_LATENCY sLatency;
+} LOG_CONTEXT;
+
+typedef struct tagPROPERTYBAG_CONTEXT
+{
+    MX::CPropertyBag *lpBag;
+    MX::CStringA *lpStrNamesA;
+    DWORD dwKeysCount;
+    LPBYTE lpData;
+    SIZE_T nDataLen;
+    int nKind;
+} PROPERTYBAG_CONTEXT;
+
+typedef struct tagQUEUE_ITEM
+{
+    MX::CLnkLstNode cListNode;
+    MX::CLockFreeNode cNode;
+    LONG volatile nQueued;
+} QUEUE_ITEM;
+
+typedef struct tagQUEUE_CONTEXT
+{
+    int nKind;
+    QUEUE_ITEM *lpItems;
+    LONG volatile nListMutex;
+    MX::CLnkLst cList;
+    MX::CLockFreeStack cStack;
+    MX::CLockFreeMpscQueue cMpscQueue;
+    MX::TLockFreeMpmcQueue<QUEUE_ITEM *> cMpmcQueue;
+} QUEUE_CONTEXT;
+
+typedef struct tagLOCK_CONTEXT
+{
+    int nKind;
+    LONG volatile nMutex;
+    MX::RWLOCK sRwLock;
+    MX::CReaderBiasedRWLock cRbLock;
+    ULONG aData[LOCK_SHARED_DATA_COUNT];
+} LOCK_CONTEXT;
+
+//-----------------------------------------------------------
+
+static LONG volatile nSyncLogMutex = 0;
+static FILE *fpSyncLog = NULL;
+static LONG volatile nCheckLogCount = 0;
+static SIZE_T volatile nCheckLogLength = 0;
+
+int BenchmarkLockContention()
+{
+    static const LPCWSTR szKindsW[] = {
+        L"CFastLock (exclusive)", L"SlimRWL (exclusive)", L"SlimRWL (10% writes)", L"CReaderBiasedRWLock (10% writes)"
+    };
+    LOCK_CONTEXT *lpCtx;
+    MX::LOCK_CONTENTION_STATS sStatsBefore, sStatsAfter;
+    DWORD dwThreadsCount[2];
+    ULONGLONG nOps;
+    DWORD dwElapsedMs;
+    HRESULT hRes = S_OK;
+
+    // undersubscribed runs keep every thread on its own processor so spinning pays off, oversubscribed ones preempt
+    // lock owners and show how quickly waiters give up the processor
+    dwThreadsCount[0] = GetBenchmarkThreadsCount();
+    dwThreadsCount[1] = dwThreadsCount[0] * LOCK_OVERSUBSCRIPTION_FACTOR;
+    if (dwThreadsCount[1] > 256)
+    {
+        dwThreadsCount[1] = 256;
+    }
+
+    lpCtx = MX_DEBUG_NEW LOCK_CONTEXT;
+    if (lpCtx == NULL)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+    lpCtx->nMutex = MX_FASTLOCK_INIT;
+    MX::SlimRWL_Initialize(&(lpCtx->sRwLock));
+    ::MxMemSet(lpCtx->aData, 0, sizeof(lpCtx->aData));
+
+    for (int nRun = 0; nRun < 2; nRun++)
+    {
+        wprintf_s(L"Running lock contention benchmark with %lu threads...\n", dwThreadsCount[nRun]);
+
+        for (lpCtx->nKind = 0; lpCtx->nKind < (int)MX_ARRAYLEN(szKindsW); lpCtx->nKind++)
+        {
+            MX::GetLockContentionStats(&sStatsBefore);
+
+            hRes = RunBenchmarkThreads(dwThreadsCount[nRun], GetBenchmarkDurationMs(), &LockJob, lpCtx, &nOps,
+                                       &dwElapsedMs);
+            if (FAILED(hRes))
+            {
+                goto done;
+            }
+            PrintBenchmarkResult(szKindsW[lpCtx->nKind], nOps, dwElapsedMs);
+
+            MX::GetLockContentionStats(&sStatsAfter);
+            wprintf_s(L"    Contentions: %I64u / Spin acquires: %I64u / Parks: %I64u / Reader retries: %I64u / "
+                      L"Writer waits: %I64u\n",
+                      sStatsAfter.nContentions - sStatsBefore.nContentions,
+                      sStatsAfter.nSpinAcquires - sStatsBefore.nSpinAcquires, sStatsAfter.nParks - sStatsBefore.nParks,
+                      sStatsAfter.nReaderRetries - sStatsBefore.nReaderRetries,
+                      sStatsAfter.nWriterWaits - sStatsBefore.nWriterWaits);
+        }
+    }
+
+done:
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Lock contention benchmark failed [0x%08X].\n", hRes);
+    }
+    delete lpCtx;
+    return (SUCCEEDED(hRes)) ? 0 : (int)hRes;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT VerifyCrc32(_In_ CRC_CONTEXT *lpCtx);
+static ULONGLONG Crc32Job(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+
+static HRESULT RunLoggingPhase(_In_z_ LPCWSTR szNameW, _In_ LOG_CONTEXT *lpCtx);
+static HRESULT OnSyncLog(_In_z_ LPCWSTR szInfoW);
+static HRESULT OnCheckLog(_In_z_ LPCWSTR szInfoW);
+static HRESULT CheckLoggerLimits(_In_ MX::CAsyncLogger &cAsyncLogger);
+static ULONGLONG LogJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+
+static ULONGLONG PropertyBagJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+
+static ULONGLONG QueueJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static VOID QueuePush(_In_ QUEUE_CONTEXT *lpCtx, _In_ QUEUE_ITEM *lpItem);
+static QUEUE_ITEM *QueuePop(_In_ QUEUE_CONTEXT *lpCtx);
+
+static ULONGLONG LockJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static ULONG ReadLockedData(_In_ LOCK_CONTEXT *lpCtx);
+static VOID WriteLockedData(_In_ LOCK_CONTEXT *lpCtx, _In_ ULONG nValue);
+
+//-----------------------------------------------------------
+
+int BenchmarkCrc32()
+{
+    static const LPCWSTR szKindsW[] = { L"zlib crc32", L"MX::Crc32", L"MX::Crc32C" };
+    CRC_CONTEXT sCtx;
+    ULONGLONG nBytes;
+    DWORD dw, dwElapsedMs;
+    ULONG nSeed;
+    HRESULT hRes;
+
+    if (FAILED(GetCmdLineParamUInt(L"size", &dw)) || dw == 0)
+    {
+        dw = 16;
+    }
+    MxMemSet(&sCtx, 0, sizeof(sCtx));
+    sCtx.nDataSize = (SIZE_T)dw * 1048576;
+    sCtx.lpData = (LPBYTE)MX_MALLOC(sCtx.nDataSize);
+    if (sCtx.lpData == NULL)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+    nSeed = 0x9E3779B9UL;
+    for (SIZE_T i = 0; i < sCtx.nDataSize; i++)
+    {
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+        sCtx.lpData[i] = (BYTE)nSeed;
+    }
+
+    hRes = VerifyCrc32(&sCtx);
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: CRC32 does not match zlib's [0x%08X].\n", hRes);
+        MX_FREE(sCtx.lpData);
+        return (int)hRes;
+    }
+
+    wprintf_s(L"Running CRC32 benchmark with %Iu MB of data...\n", sCtx.nDataSize / 1048576);
+
+    for (sCtx.nKind = 0; sCtx.nKind < (int)MX_ARRAYLEN(szKindsW); sCtx.nKind++)
+    {
+        hRes = RunBenchmarkThreads(1, GetBenchmarkDurationMs(), &Crc32Job, &sCtx, &nBytes, &dwElapsedMs);
+        if (FAILED(hRes))
+        {
+            wprintf_s(L"Error: CRC32 benchmark failed [0x%08X].\n", hRes);
+            MX_FREE(sCtx.lpData);
+            return (int)hRes;
+        }
+        if (dwElapsedMs == 0)
+        {
+            dwElapsedMs = 1;
+        }
+        wprintf_s(L"%s: %I64u bytes in %lums (%.2f GB/s)\n", szKindsW[sCtx.nKind], nBytes, dwElapsedMs,
+                  ((double)nBytes / 1073741824.0) * 1000.0 / (double)dwElapsedMs);
+    }
+
+    // done
+    MX_FREE(sCtx.lpData);
+    return 0;
+}
+
+int BenchmarkLogging()
+{
+    MX::CLoggable cSyncRoot(MX_BIND_CALLBACK(&OnSyncLog)), cAsyncRoot, cServerLog, cConnectionLog;
+    MX::CAsyncLogger cAsyncLogger;
+    MX::CAsyncLogger::STATS sStats;
+    MX::CStringW cStrSyncFileNameW, cStrAsyncFileNameW;
+    MX::CTimer cTimer;
+    LOG_CONTEXT sCtx;
+    HRESULT hRes;
+
+    ::MxMemSet(&sCtx, 0, sizeof(sCtx));
+    sCtx.dwThreadsCount = GetBenchmarkThreadsCount();
+    hRes = InitializeBenchmarkLatency(&(sCtx.sLatency), sCtx.dwThreadsCount);
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)hRes;
+    }
+
+    hRes = GetAppPath(cStrSyncFileNameW);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = GetAppPath(cStrAsyncFileNameW);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        if (cStrSyncFileNameW.Concat(L"BenchmarkSync.log") == FALSE ||
+            cStrAsyncFileNameW.Concat(L"BenchmarkAsync.log") == FALSE)
+        {
+            hRes = E_OUTOFMEMORY;
+        }
+    }
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    ::DeleteFileW((LPCWSTR)cStrSyncFileNameW);
+    ::DeleteFileW((LPCWSTR)cStrAsyncFileNameW);
+
+    fpSyncLog = _wfsopen((LPCWSTR)cStrSyncFileNameW, L"w", _SH_DENYWR);
+    if (fpSyncLog == NULL)
+    {
+        hRes = E_ACCESSDENIED;
+        goto done;
+    }
+    hRes = cAsyncLogger.Start((LPCWSTR)cStrAsyncFileNameW);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    cAsyncRoot.SetAsyncLogger(&cAsyncLogger);
+    cSyncRoot.SetLogLevel(1);
+    cAsyncRoot.SetLogLevel(1);
+
+    wprintf_s(L"Running logging benchmark with %lu threads...\n", sCtx.dwThreadsCount);
+
+    // messages are sent through a connection -> server -> root chain like the http server does
+    cConnectionLog.SetLogParent(&cServerLog);
+    sCtx.lpLog = &cConnectionLog;
+
+    cServerLog.SetLogParent(&cSyncRoot);
+    hRes = RunLoggingPhase(L"Synchronous callback", &sCtx);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    cServerLog.SetLogParent(&cAsyncRoot);
+    hRes = RunLoggingPhase(L"Asynchronous logger", &sCtx);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    // the asynchronous phase ends with messages still queued so report how long it takes to write them
+    cTimer.Reset();
+    cAsyncLogger.Flush();
+    cTimer.Mark();
+    cAsyncLogger.GetStats(&sStats);
+    wprintf_s(L"  flush: %lums, %I64u messages in %I64u writes (%I64u bytes), %I64u producer waits\n",
+              cTimer.GetElapsedTimeMs(), sStats.nMessages, sStats.nBatches, sStats.nBytesWritten,
+              sStats.nProducerWaits);
+    if (sStats.nWriteErrors != 0)
+    {
+        wprintf_s(L"Error: %I64u writes failed, %I64u bytes dropped.\n", sStats.nWriteErrors, sStats.nBytesDropped);
+        hRes = MX_E_WriteFault;
+        goto done;
+    }
+
+    cAsyncLogger.Stop();
+    hRes = CheckLoggerLimits(cAsyncLogger);
+
+done:
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Logging benchmark failed [0x%08X].\n", hRes);
+    }
+    cAsyncLogger.Stop();
+    if (fpSyncLog != NULL)
+    {
+        fclose(fpSyncLog);
+        fpSyncLog = NULL;
+    }
+    if (cStrSyncFileNameW.IsEmpty() == FALSE)
+    {
+        ::DeleteFileW((LPCWSTR)cStrSyncFileNameW);
+    }
+    if (cStrAsyncFileNameW.IsEmpty() == FALSE)
+    {
+        ::DeleteFileW((LPCWSTR)cStrAsyncFileNameW);
+    }
+    FreeBenchmarkLatency(&(sCtx.sLatency));
+    return (SUCCEEDED(hRes)) ? 0 : (int)hRes;
+}
+
+int BenchmarkPropertyBag()
+{
+    static const LPCWSTR szKindsW[] = { L"Lookup", L"Update", L"Serialize", L"Deserialize" };
+    MX::CPropertyBag cBag;
+    PROPERTYBAG_CONTEXT sCtx;
+    ULONGLONG nOps;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    ::MxMemSet(&sCtx, 0, sizeof(sCtx));
+    if (FAILED(GetCmdLineParamUInt(L"keys", &(sCtx.dwKeysCount))) || sCtx.dwKeysCount == 0)
+    {
+        sCtx.dwKeysCount = 256;
+    }
+    else if (sCtx.dwKeysCount < 4)
+    {
+        sCtx.dwKeysCount = 4;
+    }
+    sCtx.lpBag = &cBag;
+
+    sCtx.lpStrNamesA = MX_DEBUG_NEW MX::CStringA[sCtx.dwKeysCount];
+    if (sCtx.lpStrNamesA == NULL)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+
+    // session-like keys with long common prefixes
+    hRes = S_OK;
+    for (DWORD i = 0; SUCCEEDED(hRes) && i < sCtx.dwKeysCount; i++)
+    {
+        if (sCtx.lpStrNamesA[i].Format("user.preferences.item%lu", i) == FALSE)
+        {
+            hRes = E_OUTOFMEMORY;
+        }
+        else
+        {
+            switch (i & 3)
+            {
+                case 0:
+                    hRes = cBag.SetString((LPCSTR)(sCtx.lpStrNamesA[i]), "some value for the property");
+                    break;
+                case 1:
+                    hRes = cBag.SetDouble((LPCSTR)(sCtx.lpStrNamesA[i]), (double)i * 0.5);
+                    break;
+                default:
+                    hRes = cBag.SetDWord((LPCSTR)(sCtx.lpStrNamesA[i]), i);
+                    break;
+            }
+        }
+    }
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    sCtx.nDataLen = cBag.GetSerializedSize();
+    sCtx.lpData = (LPBYTE)MX_MALLOC(sCtx.nDataLen);
+    if (sCtx.lpData == NULL)
+    {
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+    hRes = cBag.Serialize(sCtx.lpData, sCtx.nDataLen);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    wprintf_s(L"Running property bag benchmark with %lu keys (%Iu bytes serialized)...\n", sCtx.dwKeysCount,
+              sCtx.nDataLen);
+
+    for (sCtx.nKind = 0; sCtx.nKind < (int)MX_ARRAYLEN(szKindsW); sCtx.nKind++)
+    {
+        hRes = RunBenchmarkThreads(1, GetBenchmarkDurationMs(), &PropertyBagJob, &sCtx, &nOps, &dwElapsedMs);
+        if (FAILED(hRes))
+        {
+            goto done;
+        }
+        PrintBenchmarkResult(szKindsW[sCtx.nKind], nOps, dwElapsedMs);
+        if (sCtx.nKind >= 2)
+        {
+            if (dwElapsedMs == 0)
+            {
+                dwElapsedMs = 1;
+            }
+            wprintf_s(L"  %.2f MB/s\n", ((double)nOps * (double)(sCtx.nDataLen) / 1048576.0) * 1000.0 / (double)dwElapsedMs);
+        }
+    }
+
+done:
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Property bag benchmark failed [0x%08X].\n", hRes);
+    }
+    MX_FREE(sCtx.lpData);
+    delete[] sCtx.lpStrNamesA;
+    return (SUCCEEDED(hRes)) ? 0 : (int)hRes;
+}
+
+int BenchmarkLockFreeQueue()
+{
+    static const LPCWSTR szKindsW[] = {
+        L"CFastLock + CLnkLst (push/pop)", L"CLockFreeStack (push/pop)", L"TLockFreeMpmcQueue (push/pop)",
+        L"CFastLock + CLnkLst (N producers/1 consumer)", L"CLockFreeMpscQueue (N producers/1 consumer)"
+    };
+    QUEUE_CONTEXT sCtx;
+    DWORD dwThreadsCount;
+    ULONGLONG nOps;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    dwThreadsCount = GetBenchmarkThreadsCount();
+    if (dwThreadsCount < 2)
+    {
+        dwThreadsCount = 2; // the single consumer phases need at least one producer
+    }
+
+    sCtx.nKind = 0;
+    sCtx.nListMutex = 0;
+    sCtx.lpItems = MX_DEBUG_NEW QUEUE_ITEM[(SIZE_T)dwThreadsCount * QUEUE_ITEMS_PER_THREAD];
+    if (sCtx.lpItems == NULL)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+    for (SIZE_T i = 0; i < (SIZE_T)dwThreadsCount * QUEUE_ITEMS_PER_THREAD; i++)
+    {
+        sCtx.lpItems[i].nQueued = 0;
+    }
+    hRes = sCtx.cMpmcQueue.Initialize((SIZE_T)dwThreadsCount * QUEUE_ITEMS_PER_THREAD);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    wprintf_s(L"Running queues benchmark with %lu threads...\n", dwThreadsCount);
+
+    for (sCtx.nKind = 0; sCtx.nKind < (int)MX_ARRAYLEN(szKindsW); sCtx.nKind++)
+    {
+        hRes = RunBenchmarkThreads(dwThreadsCount, GetBenchmarkDurationMs(), &QueueJob, &sCtx, &nOps, &dwElapsedMs);
+        if (FAILED(hRes))
+        {
+            goto done;
+        }
+        PrintBenchmarkResult(szKindsW[sCtx.nKind], nOps, dwElapsedMs);
+
+        // drain what the producers left behind
+        while (QueuePop(&sCtx) != NULL)
+        {
+            // keep popping
+        }
+        for (SIZE_T i = 0; i < (SIZE_T)dwThreadsCount * QUEUE_ITEMS_PER_THREAD; i++)
+        {
+            sCtx.lpItems[i].nQueued = 0;
+        }
+    }
+
+done:
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Queues benchmark failed [0x%08X].\n", hRes);
+    }
+    delete[] sCtx.lpItems;
+    return (SUCCEEDED(hRes)) ? 0 : (int)hRes;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT VerifyCrc32(_In_ CRC_CONTEXT *lpCtx)
+{
+    SIZE_T nLen, nSplit;
+    ULONG nCrc, nCrc1, nCrc2;
+
+    // odd lengths and offsets exercise the unaligned heads and tails of every kernel
+    for (nLen = 0; nLen < 4096 && nLen <= lpCtx->nDataSize - 7; nLen += (nLen < 256) ? 1 : 61)
+    {
+        for (SIZE_T nOffset = 0; nOffset < 8; nOffset += 3)
+        {
+            nCrc = MX::Crc32(0, lpCtx->lpData + nOffset, nLen);
+            if (nCrc != (ULONG)z_crc32(0, lpCtx->lpData + nOffset, (unsigned int)nLen))
+            {
+                return MX_E_InvalidData;
+            }
+
+            nSplit = nLen / 3;
+            nCrc1 = MX::Crc32(0, lpCtx->lpData + nOffset, nSplit);
+            nCrc2 = MX::Crc32(0, lpCtx->lpData + nOffset + nSplit, nLen - nSplit);
+            if (MX::Crc32Combine(nCrc1, nCrc2, (ULONGLONG)(nLen - nSplit)) != nCrc)
+            {
+                return MX_E_InvalidData;
+            }
+
+            nCrc = MX::Crc32C(0, lpCtx->lpData + nOffset, nLen);
+            nCrc1 = MX::Crc32C(0, lpCtx->lpData + nOffset, nSplit);
+            nCrc2 = MX::Crc32C(nCrc1, lpCtx->lpData + nOffset + nSplit, nLen - nSplit);
+            if (nCrc2 != nCrc)
+            {
+                return MX_E_InvalidData;
+            }
+        }
+    }
+
+    // well known check value of "123456789"
+    if (MX::Crc32C(0, "123456789", 9) != 0xE3069283UL || MX::Crc32(0, "123456789", 9) != 0xCBF43926UL)
+    {
+        return MX_E_InvalidData;
+    }
+    return S_OK;
+}
+
+static ULONGLONG Crc32Job(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    CRC_CONTEXT *lpCtx = (CRC_CONTEXT *)lpContext;
+    ULONGLONG nBytes = 0;
+    ULONG nCrc = 0;
+
+    UNREFERENCED_PARAMETER(dwThreadIndex);
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        switch (lpCtx->nKind)
+        {
+            case 0:
+                nCrc = (ULONG)z_crc32(nCrc, lpCtx->lpData, (unsigned int)(lpCtx->nDataSize));
+                break;
+            case 1:
+                nCrc = MX::Crc32(nCrc, lpCtx->lpData, lpCtx->nDataSize);
+                break;
+            default:
+                nCrc = MX::Crc32C(nCrc, lpCtx->lpData, lpCtx->nDataSize);
+                break;
+        }
+        nBytes += (ULONGLONG)(lpCtx->nDataSize);
+    }
+    return nBytes;
+}
+
+static HRESULT RunLoggingPhase(_In_z_ LPCWSTR szNameW, _In_ LOG_CONTEXT *lpCtx)
+{
+    ULONGLONG nMessages;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    ResetBenchmarkLatency(&(lpCtx->sLatency));
+
+    hRes = RunBenchmarkThreads(lpCtx->dwThreadsCount, GetBenchmarkDurationMs(), &LogJob, lpCtx, &nMessages,
+                               &dwElapsedMs);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    PrintBenchmarkResult(szNameW, nMessages, dwElapsedMs);
+    PrintBenchmarkLatency(&(lpCtx->sLatency), nMessages);
+
+    // done
+    return S_OK;
+}
+
+static HRESULT OnSyncLog(_In_z_ LPCWSTR szInfoW)
+{
+    MX::CFastLock cLock(&nSyncLogMutex);
+
+    // same as the test logger: a locked formatted write per message
+    fwprintf_s(fpSyncLog, L"%s\n", szInfoW);
+    return S_OK;
+}
+
+static HRESULT OnCheckLog(_In_z_ LPCWSTR szInfoW)
+{
+    _InterlockedIncrement(&nCheckLogCount);
+    nCheckLogLength = wcslen(szInfoW);
+    return S_OK;
+}
+
+static HRESULT CheckLoggerLimits(_In_ MX::CAsyncLogger &cAsyncLogger)
+{
+    MX::CLoggable cCheckRoot(MX_BIND_CALLBACK(&OnCheckLog));
+    MX::CStringW cStrLongW;
+    HRESULT hRes;
+
+    for (SIZE_T i = 0; i < MX_LOGGABLE_MAX_TEXT_LENGTH + 1000; i++)
+    {
+        if (cStrLongW.ConcatN(L"x", 1) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    // long messages are truncated the same way on the synchronous path...
+    nCheckLogCount = 0;
+    hRes = cCheckRoot.LogAlways(E_FAIL, L"%s", (LPCWSTR)cStrLongW);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (nCheckLogCount != 1 || nCheckLogLength != MX_LOGGABLE_MAX_TEXT_LENGTH)
+    {
+        wprintf_s(L"Error: Synchronous message length is %Iu.\n", nCheckLogLength);
+        return MX_E_InvalidData;
+    }
+
+    // ...and on a logger started again after being stopped
+    hRes = cAsyncLogger.Start(MX_BIND_CALLBACK(&OnCheckLog));
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Cannot restart the asynchronous logger [0x%08X].\n", hRes);
+        return hRes;
+    }
+    cCheckRoot.SetAsyncLogger(&cAsyncLogger);
+    nCheckLogCount = 0;
+    hRes = cCheckRoot.LogAlways(E_FAIL, L"%s", (LPCWSTR)cStrLongW);
+    cAsyncLogger.Flush();
+    cAsyncLogger.Stop();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (nCheckLogCount != 1 || nCheckLogLength != MX_LOGGABLE_MAX_TEXT_LENGTH)
+    {
+        wprintf_s(L"Error: Asynchronous message length is %Iu.\n", nCheckLogLength);
+        return MX_E_InvalidData;
+    }
+
+    // done
+    return S_OK;
+}
+
+static ULONGLONG LogJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    LOG_CONTEXT *lpCtx = (LOG_CONTEXT *)lpContext;
+    LARGE_INTEGER liStart, liEnd;
+    ULONGLONG nCount = 0;
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        ::QueryPerformanceCounter(&liStart);
+        if (lpCtx->lpLog->ShouldLog(1) != FALSE)
+        {
+            lpCtx->lpLog->Log(L"Request #%I64u on worker %lu completed with status %d in %lu us", nCount, dwThreadIndex,
+                              200, (ULONG)(nCount & 1023));
+        }
+        ::QueryPerformanceCounter(&liEnd);
+
+        AddBenchmarkLatency(&(lpCtx->sLatency), dwThreadIndex, liEnd.QuadPart - liStart.QuadPart);
+        nCount++;
+    }
+    return nCount;
+}
+
+static ULONGLONG PropertyBagJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    PROPERTYBAG_CONTEXT *lpCtx = (PROPERTYBAG_CONTEXT *)lpContext;
+    MX::CPropertyBag cBag;
+    ULONGLONG nCount = 0;
+    DWORD dw, dwIndex = 0;
+
+    UNREFERENCED_PARAMETER(dwThreadIndex);
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        switch (lpCtx->nKind)
+        {
+            case 0:
+                lpCtx->lpBag->GetType((LPCSTR)(lpCtx->lpStrNamesA[dwIndex]));
+                break;
+            case 1:
+                // only overwrite numeric keys so the serialized size does not change
+                dw = (dwIndex & (~3UL)) + 2;
+                lpCtx->lpBag->SetDWord((LPCSTR)(lpCtx->lpStrNamesA[(dw < lpCtx->dwKeysCount) ? dw : 2]), (DWORD)nCount);
+                break;
+            case 2:
+                lpCtx->lpBag->Serialize(lpCtx->lpData, lpCtx->nDataLen);
+                break;
+            default:
+                cBag.Deserialize(lpCtx->lpData, lpCtx->nDataLen);
+                break;
+        }
+
+        // visit the keys in a scattered order
+        dwIndex = (dwIndex + 97) % lpCtx->dwKeysCount;
+        nCount++;
+    }
+    return nCount;
+}
+
+static ULONGLONG QueueJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    QUEUE_CONTEXT *lpCtx = (QUEUE_CONTEXT *)lpContext;
+    QUEUE_ITEM *lpItems = lpCtx->lpItems + (SIZE_T)dwThreadIndex * QUEUE_ITEMS_PER_THREAD;
+    QUEUE_ITEM *lpItem;
+    ULONGLONG nCount = 0;
+    DWORD i;
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        if (lpCtx->nKind < 3)
+        {
+            // every thread pushes a batch of its items and then pops the same amount, maybe from other threads
+            for (i = 0; i < QUEUE_ITEMS_PER_THREAD; i++)
+            {
+                QueuePush(lpCtx, &lpItems[i]);
+            }
+            for (i = 0; i < QUEUE_ITEMS_PER_THREAD; i++)
+            {
+                // a bounded queue may look empty while another thread finishes a push
+                while (QueuePop(lpCtx) == NULL)
+                {
+                    ::YieldProcessor();
+                }
+            }
+            nCount += QUEUE_ITEMS_PER_THREAD;
+        }
+        else if (dwThreadIndex == 0)
+        {
+            // the consumer
+            lpItem = QueuePop(lpCtx);
+            if (lpItem != NULL)
+            {
+                _InterlockedExchange(&(lpItem->nQueued), 0);
+                nCount++;
+            }
+            else
+            {
+                ::YieldProcessor();
+            }
+        }
+        else
+        {
+            // producers requeue their items as soon as the consumer releases them
+            for (i = 0; i < QUEUE_ITEMS_PER_THREAD; i++)
+            {
+                if (__InterlockedRead(&(lpItems[i].nQueued)) == 0)
+                {
+                    _InterlockedExchange(&(lpItems[i].nQueued), 1);
+                    QueuePush(lpCtx, &lpItems[i]);
+                }
+            }
+        }
+    }
+    return nCount;
+}
+
+static VOID QueuePush(_In_ QUEUE_CONTEXT *lpCtx, _In_ QUEUE_ITEM *lpItem)
+{
+    if (lpCtx->nKind == 0 || lpCtx->nKind == 3)
+    {
+        MX::CFastLock cLock(&(lpCtx->nListMutex));
+
+        lpCtx->cList.PushTail(&(lpItem->cListNode));
+    }
+    else if (lpCtx->nKind == 1)
+    {
+        lpCtx->cStack.Push(&(lpItem->cNode));
+    }
+    else if (lpCtx->nKind == 2)
+    {
+        lpCtx->cMpmcQueue.Push(lpItem);
+    }
+    else
+    {
+        lpCtx->cMpscQueue.Push(&(lpItem->cNode));
+    }
+    return;
+}
+
+static QUEUE_ITEM *QueuePop(_In_ QUEUE_CONTEXT *lpCtx)
+{
+    MX::CLnkLstNode *lpListNode;
+    MX::CLockFreeNode *lpNode;
+    QUEUE_ITEM *lpItem;
+
+    if (lpCtx->nKind == 0 || lpCtx->nKind == 3)
+    {
+        MX::CFastLock cLock(&(lpCtx->nListMutex));
+
+        lpListNode = lpCtx->cList.PopHead();
+        return (lpListNode != NULL) ? CONTAINING_RECORD(lpListNode, QUEUE_ITEM, cListNode) : NULL;
+    }
+    if (lpCtx->nKind == 2)
+    {
+        return (lpCtx->cMpmcQueue.Pop(lpItem) != FALSE) ? lpItem : NULL;
+    }
+    lpNode = (lpCtx->nKind == 1) ? lpCtx->cStack.Pop() : lpCtx->cMpscQueue.Pop();
+    return (lpNode != NULL) ? CONTAINING_RECORD(lpNode, QUEUE_ITEM, cNode) : NULL;
+}
+
+static ULONGLONG LockJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    LOCK_CONTEXT *lpCtx = (LOCK_CONTEXT *)lpContext;
+    ULONGLONG nCount = 0;
+    ULONG nSeed = (ULONG)dwThreadIndex * 2654435761UL + 1;
+    ULONG nSum = 0;
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        // a cheap LCG decides which operations are writes
+        nSeed = nSeed * 1103515245UL + 12345UL;
+        if (lpCtx->nKind < 2 || ((nSeed >> 16) % 100) < LOCK_WRITE_PERCENT)
+        {
+            WriteLockedData(lpCtx, nSeed);
+        }
+        else
+        {
+            nSum += ReadLockedData(lpCtx);
+        }
+        nCount++;
+    }
+    return (nSum != 0xFFFFFFFFUL) ? nCount : nCount + 1; // keep the reads alive
+}
+
+static ULONG ReadLockedData(_In_ LOCK_CONTEXT *lpCtx)
+{
+    ULONG nSlot, nSum = 0;
+
+    if (lpCtx->nKind == 2)
+    {
+        MX::CAutoSlimRWLShared cLock(&(lpCtx->sRwLock));
+
+        for (int i = 0; i < LOCK_SHARED_DATA_COUNT; i++)
+        {
+            nSum += lpCtx->aData[i];
+        }
+    }
+    else
+    {
+        nSlot = lpCtx->cRbLock.AcquireShared();
+        for (int i = 0; i < LOCK_SHARED_DATA_COUNT; i++)
+        {
+            nSum += lpCtx->aData[i];
+        }
+        lpCtx->cRbLock.ReleaseShared(nSlot);
+    }
+    return nSum;
+}
+
+static VOID WriteLockedData(_In_ LOCK_CONTEXT *lpCtx, _In_ ULONG nValue)
+{
+    switch (lpCtx->nKind)
+    {
+        case 0:
+            MX::FastLock_Enter(&(lpCtx->nMutex));
+            break;
+        case 1:
+        case 2:
+            MX::SlimRWL_AcquireExclusive(&(lpCtx->sRwLock));
+            break;
+        default:
+            lpCtx->cRbLock.AcquireExclusive();
+            break;
+    }
+
+    for (int i = 0; i < LOCK_SHARED_DATA_COUNT; i++)
+    {
+        lpCtx->aData[i] += nValue;
+    }
+
+    switch (lpCtx->nKind)
+    {
+        case 0:
+            MX::FastLock_Exit(&(lpCtx->nMutex));
+            break;
+        case 1:
+        case 2:
+            MX::SlimRWL_ReleaseExclusive(&(lpCtx->sRwLock));
+            break;
+        default:
+            lpCtx->cRbLock.ReleaseExclusive();
+            break;
+    }
+    return;
+}
@@ -0,0 +1,466 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestBenchmark.h"
+#include <Crypto\MessageDigest.h>
+#include <Crypto\SymmetricCipher.h>
+
+ //-----------------------------------------------------------
+
+typedef struct tagDIGEST_CONTEXT
+{
+    MX::CMessageDigest::eAlgorithm nAlgorithm;
+    BYTE aData[256];
+    SIZE_T nDataSize;
+    BYTE aKey[32];
+    SIZE_T nKeySize;
+    LONG volatile nErrors;
+} DIGEST_CONTEXT;
+
+typedef struct tagAEAD_CONTEXT
+{
+    MX::CSymmetricCipher::eAlgorithm nAlgorithm;
+    BYTE aKey[32];
+    SIZE_T nKeySize;
+    SIZE_T nMessageSize;
+    LONG volatile nErrors;
+} AEAD_CONTEXT;
+
+//-----------------------------------------------------------
+
+static HRESULT VerifyOneShotDigest(_In_ DIGEST_CONTEXT *lpCtx);
+static HRESULT RunDigestPhase(_In_z_ LPCWSTR szNameW, _In_ DWORD dwThreadsCount, _In_ lpfnBenchmarkJob lpfnJob,
+                              _In_ DIGEST_CONTEXT *lpCtx);
+static ULONGLONG StreamingDigestJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static ULONGLONG OneShotDigestJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static HRESULT VerifyAead(_In_ AEAD_CONTEXT *lpCtx);
+static ULONGLONG StreamingCipherJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static ULONGLONG AeadJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+
+//-----------------------------------------------------------
+
+int BenchmarkCryptoDigest()
+{
+    static const SIZE_T aDataSizes[] = { 32, 256 };
+    DIGEST_CONTEXT sCtx;
+    WCHAR szNameW[64];
+    DWORD dwThreads;
+    HRESULT hRes;
+
+    MxMemSet(&sCtx, 0, sizeof(sCtx));
+    sCtx.nAlgorithm = MX::CMessageDigest::eAlgorithm::SHA256;
+    for (SIZE_T i = 0; i < sizeof(sCtx.aData); i++)
+    {
+        sCtx.aData[i] = (BYTE)(i * 131 + 7);
+    }
+    for (SIZE_T i = 0; i < sizeof(sCtx.aKey); i++)
+    {
+        sCtx.aKey[i] = (BYTE)(i * 17 + 3);
+    }
+    dwThreads = GetBenchmarkThreadsCount();
+
+    wprintf_s(L"Running SHA-256 digest latency benchmark with small inputs...\n");
+
+    for (SIZE_T nPass = 0; nPass < 2; nPass++)
+    {
+        sCtx.nKeySize = (nPass == 0) ? 0 : sizeof(sCtx.aKey);
+
+        for (SIZE_T i = 0; i < MX_ARRAYLEN(aDataSizes); i++)
+        {
+            sCtx.nDataSize = aDataSizes[i];
+
+            hRes = VerifyOneShotDigest(&sCtx);
+            if (FAILED(hRes))
+            {
+                wprintf_s(L"Error: One-shot digest does not match the streaming digest [0x%08X].\n", hRes);
+                return (int)hRes;
+            }
+
+            for (DWORD dwPhase = 0; dwPhase < 2; dwPhase++)
+            {
+                DWORD dwThreadsCount = (dwPhase == 0) ? 1 : dwThreads;
+
+                if (dwPhase > 0 && dwThreads == 1)
+                {
+                    break;
+                }
+
+                swprintf_s(szNameW, MX_ARRAYLEN(szNameW), L"%s/%Iu bytes/streaming/%lu thread(s)",
+                           ((sCtx.nKeySize == 0) ? L"Hash" : L"Hmac"), sCtx.nDataSize, dwThreadsCount);
+                hRes = RunDigestPhase(szNameW, dwThreadsCount, &StreamingDigestJob, &sCtx);
+                if (SUCCEEDED(hRes))
+                {
+                    swprintf_s(szNameW, MX_ARRAYLEN(szNameW), L"%s/%Iu bytes/one-shot/%lu thread(s)",
+                               ((sCtx.nKeySize == 0) ? L"Hash" : L"Hmac"), sCtx.nDataSize, dwThreadsCount);
+                    hRes = RunDigestPhase(szNameW, dwThreadsCount, &OneShotDigestJob, &sCtx);
+                }
+                if (FAILED(hRes))
+                {
+                    wprintf_s(L"Error: Digest benchmark failed [0x%08X].\n", hRes);
+                    return (int)hRes;
+                }
+            }
+        }
+    }
+
+    // done
+    return 0;
+}
+
+int BenchmarkCryptoAead()
+{
+    static const struct
+    {
+        MX::CSymmetricCipher::eAlgorithm nAlgorithm;
+        LPCWSTR szNameW;
+    } aAlgorithms[] = {
+        { MX::CSymmetricCipher::eAlgorithm::AES_256_GCM, L"AES-256-GCM" },
+        { MX::CSymmetricCipher::eAlgorithm::ChaCha20_Poly1305, L"ChaCha20-Poly1305" }
+    };
+    static const SIZE_T aMessageSizes[] = { 64, 1024 };
+    AEAD_CONTEXT sCtx;
+    WCHAR szNameW[64];
+    ULONGLONG nOps;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    MxMemSet(&sCtx, 0, sizeof(sCtx));
+    for (SIZE_T i = 0; i < sizeof(sCtx.aKey); i++)
+    {
+        sCtx.aKey[i] = (BYTE)(i * 29 + 11);
+    }
+    sCtx.nKeySize = sizeof(sCtx.aKey);
+
+    wprintf_s(L"Running AEAD benchmark with small messages...\n");
+
+    for (SIZE_T nAlg = 0; nAlg < MX_ARRAYLEN(aAlgorithms); nAlg++)
+    {
+        sCtx.nAlgorithm = aAlgorithms[nAlg].nAlgorithm;
+
+        hRes = VerifyAead(&sCtx);
+        if (FAILED(hRes))
+        {
+            wprintf_s(L"Error: %s round trip failed [0x%08X].\n", aAlgorithms[nAlg].szNameW, hRes);
+            return (int)hRes;
+        }
+
+        for (SIZE_T i = 0; i < MX_ARRAYLEN(aMessageSizes); i++)
+        {
+            sCtx.nMessageSize = aMessageSizes[i];
+
+            for (int nPhase = 0; nPhase < 2; nPhase++)
+            {
+                _InterlockedExchange(&(sCtx.nErrors), 0);
+                hRes = RunBenchmarkThreads(1, GetBenchmarkDurationMs(), ((nPhase == 0) ? &StreamingCipherJob : &AeadJob),
+                                           &sCtx, &nOps, &dwElapsedMs);
+                if (SUCCEEDED(hRes) && __InterlockedRead(&(sCtx.nErrors)) != 0)
+                {
+                    hRes = MX_E_InvalidData;
+                }
+                if (FAILED(hRes))
+                {
+                    wprintf_s(L"Error: AEAD benchmark failed [0x%08X].\n", hRes);
+                    return (int)hRes;
+                }
+                swprintf_s(szNameW, MX_ARRAYLEN(szNameW), L"%s/%Iu bytes/%s", aAlgorithms[nAlg].szNameW,
+                           sCtx.nMessageSize, ((nPhase == 0) ? L"streaming" : L"one-shot"));
+                PrintBenchmarkResult(szNameW, nOps, dwElapsedMs);
+            }
+        }
+    }
+
+    // done
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT VerifyOneShotDigest(_In_ DIGEST_CONTEXT *lpCtx)
+{
+    MX::CMessageDigest cDigest;
+    BYTE aOutput[64];
+    SIZE_T nOutputSize;
+    HRESULT hRes;
+
+    hRes = cDigest.BeginDigest(lpCtx->nAlgorithm, ((lpCtx->nKeySize > 0) ? lpCtx->aKey : NULL), lpCtx->nKeySize);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cDigest.DigestStream(lpCtx->aData, lpCtx->nDataSize);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cDigest.EndDigest();
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    hRes = (lpCtx->nKeySize == 0)
+        ? MX::CMessageDigest::Hash(lpCtx->nAlgorithm, lpCtx->aData, lpCtx->nDataSize, aOutput, sizeof(aOutput),
+                                   &nOutputSize)
+        : MX::CMessageDigest::Hmac(lpCtx->nAlgorithm, lpCtx->aKey, lpCtx->nKeySize, lpCtx->aData, lpCtx->nDataSize,
+                                   aOutput, sizeof(aOutput), &nOutputSize);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (nOutputSize != cDigest.GetResultSize() || MxMemCompare(aOutput, cDigest.GetResult(), nOutputSize) != 0)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // a keyed context must not leak its key into the next hmac (RFC 4231 style, empty key and message)
+    if (lpCtx->nKeySize > 0 && lpCtx->nAlgorithm == MX::CMessageDigest::eAlgorithm::SHA256)
+    {
+        static const BYTE aEmptyHmac[32] = {
+            0xB6, 0x13, 0x67, 0x9A, 0x08, 0x14, 0xD9, 0xEC, 0x77, 0x2F, 0x95, 0xD7, 0x78, 0xC3, 0x5F, 0xC5,
+            0xFF, 0x16, 0x97, 0xC4, 0x93, 0x71, 0x56, 0x53, 0xC6, 0xC7, 0x12, 0x14, 0x42, 0x92, 0xC5, 0xAD
+        };
+
+        hRes = MX::CMessageDigest::Hmac(lpCtx->nAlgorithm, NULL, 0, NULL, 0, aOutput, sizeof(aOutput), &nOutputSize);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (nOutputSize != sizeof(aEmptyHmac) || MxMemCompare(aOutput, aEmptyHmac, sizeof(aEmptyHmac)) != 0)
+        {
+            return MX_E_InvalidData;
+        }
+    }
+    return S_OK;
+}
+
+static HRESULT RunDigestPhase(_In_z_ LPCWSTR szNameW, _In_ DWORD dwThreadsCount, _In_ lpfnBenchmarkJob lpfnJob,
+                              _In_ DIGEST_CONTEXT *lpCtx)
+{
+    ULONGLONG nOps;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    _InterlockedExchange(&(lpCtx->nErrors), 0);
+    hRes = RunBenchmarkThreads(dwThreadsCount, GetBenchmarkDurationMs(), lpfnJob, lpCtx, &nOps, &dwElapsedMs);
+    if (SUCCEEDED(hRes) && __InterlockedRead(&(lpCtx->nErrors)) != 0)
+    {
+        hRes = MX_E_InvalidData;
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    PrintBenchmarkResult(szNameW, nOps, dwElapsedMs);
+    return S_OK;
+}
+
+static ULONGLONG StreamingDigestJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    DIGEST_CONTEXT *lpCtx = (DIGEST_CONTEXT *)lpContext;
+    ULONGLONG nOps = 0;
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(dwThreadIndex);
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        MX::CMessageDigest cDigest;
+
+        hRes = cDigest.BeginDigest(lpCtx->nAlgorithm, ((lpCtx->nKeySize > 0) ? lpCtx->aKey : NULL), lpCtx->nKeySize);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cDigest.DigestStream(lpCtx->aData, lpCtx->nDataSize);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cDigest.EndDigest();
+        }
+        if (FAILED(hRes))
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+        nOps++;
+    }
+    return nOps;
+}
+
+static ULONGLONG OneShotDigestJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    DIGEST_CONTEXT *lpCtx = (DIGEST_CONTEXT *)lpContext;
+    BYTE aOutput[64];
+    ULONGLONG nOps = 0;
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(dwThreadIndex);
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        hRes = (lpCtx->nKeySize == 0)
+            ? MX::CMessageDigest::Hash(lpCtx->nAlgorithm, lpCtx->aData, lpCtx->nDataSize, aOutput, sizeof(aOutput))
+            : MX::CMessageDigest::Hmac(lpCtx->nAlgorithm, lpCtx->aKey, lpCtx->nKeySize, lpCtx->aData,
+                                       lpCtx->nDataSize, aOutput, sizeof(aOutput));
+        if (FAILED(hRes))
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+        nOps++;
+    }
+    return nOps;
+}
+
+static HRESULT VerifyAead(_In_ AEAD_CONTEXT *lpCtx)
+{
+    MX::CSymmetricCipher cCipher;
+    BYTE aNonce[12], aPlain[256], aBuffer[256], aTag[16];
+    static const BYTE aAad[] = { 'm', 'x', 'l', 'i', 'b' };
+    HRESULT hRes;
+
+    for (SIZE_T i = 0; i < sizeof(aPlain); i++)
+    {
+        aPlain[i] = (BYTE)(i * 7 + 1);
+    }
+    MxMemSet(aNonce, 0x5A, sizeof(aNonce));
+
+    hRes = cCipher.SetAlgorithm(lpCtx->nAlgorithm);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cCipher.SetAeadKey(lpCtx->aKey, lpCtx->nKeySize);
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // in-place round trip
+    MxMemCopy(aBuffer, aPlain, sizeof(aPlain));
+    hRes = cCipher.AeadEncrypt(aNonce, sizeof(aNonce), aAad, sizeof(aAad), aBuffer, sizeof(aBuffer), aBuffer, aTag);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cCipher.AeadDecrypt(aNonce, sizeof(aNonce), aAad, sizeof(aAad), aBuffer, sizeof(aBuffer), aBuffer, aTag);
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (MxMemCompare(aBuffer, aPlain, sizeof(aPlain)) != 0)
+    {
+        return MX_E_InvalidData;
+    }
+
+    // a tampered tag must be rejected
+    hRes = cCipher.AeadEncrypt(aNonce, sizeof(aNonce), aAad, sizeof(aAad), aBuffer, sizeof(aBuffer), aBuffer, aTag);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    aTag[0] ^= 1;
+    hRes = cCipher.AeadDecrypt(aNonce, sizeof(aNonce), aAad, sizeof(aAad), aBuffer, sizeof(aBuffer), aBuffer, aTag);
+    if (hRes != MX_E_InvalidData)
+    {
+        return E_FAIL;
+    }
+
+    // and no unauthenticated plaintext may be left in the output
+    for (SIZE_T i = 0; i < sizeof(aBuffer); i++)
+    {
+        if (aBuffer[i] != 0)
+        {
+            return E_FAIL;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static ULONGLONG StreamingCipherJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    AEAD_CONTEXT *lpCtx = (AEAD_CONTEXT *)lpContext;
+    BYTE aNonce[12], aBuffer[1024 + 64];
+    ULONGLONG nOps = 0;
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(dwThreadIndex);
+
+    MxMemSet(aNonce, 0, sizeof(aNonce));
+    MxMemSet(aBuffer, 0, sizeof(aBuffer));
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        MX::CSymmetricCipher cCipher;
+
+        *((ULONGLONG *)aNonce) = nOps;
+        hRes = cCipher.SetAlgorithm(lpCtx->nAlgorithm);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cCipher.BeginEncrypt(FALSE, lpCtx->aKey, lpCtx->nKeySize, aNonce);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cCipher.EncryptStream(aBuffer, lpCtx->nMessageSize);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cCipher.EndEncrypt();
+        }
+        if (FAILED(hRes) || cCipher.GetEncryptedData(aBuffer, sizeof(aBuffer)) != lpCtx->nMessageSize)
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+        nOps++;
+    }
+    return nOps;
+}
+
+static ULONGLONG AeadJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    AEAD_CONTEXT *lpCtx = (AEAD_CONTEXT *)lpContext;
+    MX::CSymmetricCipher cCipher; // AEAD contexts cannot be shared between threads
+    BYTE aNonce[12], aBuffer[1024], aTag[16];
+    ULONGLONG nOps = 0;
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(dwThreadIndex);
+
+    MxMemSet(aNonce, 0, sizeof(aNonce));
+    MxMemSet(aBuffer, 0, sizeof(aBuffer));
+    hRes = cCipher.SetAlgorithm(lpCtx->nAlgorithm);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cCipher.SetAeadKey(lpCtx->aKey, lpCtx->nKeySize);
+    }
+    if (FAILED(hRes))
+    {
+        _InterlockedIncrement(&(lpCtx->nErrors));
+        return 0;
+    }
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        *((ULONGLONG *)aNonce) = nOps;
+        hRes = cCipher.AeadEncrypt(aNonce, sizeof(aNonce), NULL, 0, aBuffer, lpCtx->nMessageSize, aBuffer, aTag);
+        if (FAILED(hRes))
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+        nOps++;
+    }
+    return nOps;
+}
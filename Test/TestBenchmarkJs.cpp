@@ -0,0 +1,882 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestBenchmark.h"
+#include <JsHttpServer\JsHttpServer.h>
+#include <JsHttpServer\Plugins\JsHttpServerSessionStore.h>
+#include <JsLib\JavascriptVM.h>
+#include <JsLib\Plugins\JsonWebTokenPlugin.h>
+
+ //-----------------------------------------------------------
+
+#define SESSION_PROPERTIES_COUNT 16
+
+#define JSON_ROUNDS_COUNT 5
+
+#define JWT_DEFAULT_CACHE_SIZE 4096
+
+#define STREAMED_RESPONSE_DEFAULT_PORT 8088
+#define STREAMED_RESPONSE_DEFAULT_SIZE 1024 // MB
+#define STREAMED_RESPONSE_BUFFER_SIZE 65536
+
+//-----------------------------------------------------------
+
+typedef struct tagSESSION_ID
+{
+    CHAR szIdA[65];
+} SESSION_ID;
+
+typedef struct tagSESSION_STORE_CONTEXT
+{
+    MX::CJsHttpServerSessionStore *lpStore;
+    SESSION_ID *lpIds;
+    DWORD dwSessionsCount;
+    DWORD dwThreadsCount;
+    BENCHMARK_LATENCY sLatency;
+} SESSION_STORE_CONTEXT;
+
+//-----------------------------------------------------------
+
+static HRESULT RunSessionStorePhase(_In_z_ LPCWSTR szNameW, _In_ SESSION_STORE_CONTEXT *lpCtx,
+                                    _In_opt_z_ LPCWSTR szJournalFileNameW);
+static HRESULT FillSessionStore(_In_ SESSION_STORE_CONTEXT *lpCtx);
+static ULONGLONG SessionStoreJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+
+static HRESULT RunJsonPhase(_In_ MX::CJavascriptVM &cJvm, _In_z_ LPCWSTR szNameW, _In_z_ LPCSTR szCodeA,
+                            _In_ SIZE_T nJsonSize);
+static HRESULT RunJsonStreamPhase(_In_ MX::CJavascriptVM &cJvm, _In_ SIZE_T nJsonSize);
+static HRESULT OnJsonStreamOutput(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam);
+
+static HRESULT RunJwtPhase(_In_ MX::CJavascriptVM &cJvm, _In_z_ LPCWSTR szNameW, _In_ DWORD dwVerifyCount);
+
+static VOID OnStreamedReportRequestCompleted(_In_ MX::CJsHttpServer *lpHttp, _In_ MX::CJsHttpServer::CClientRequest *lpRequest);
+static HRESULT RequestStreamedReport(_In_ DWORD dwPort, _Out_ PULONGLONG lpnBodySize, _Out_ LPBOOL lpbChunked);
+static HRESULT ReceiveStreamedReport(_In_ SOCKET sck, _Out_ PULONGLONG lpnBodySize, _Out_ LPBOOL lpbChunked);
+
+//-----------------------------------------------------------
+
+static LPCSTR szStreamedReportCodeA = NULL;
+
+//-----------------------------------------------------------
+
+int BenchmarkJsSessionStore()
+{
+    SESSION_STORE_CONTEXT sCtx;
+    MX::CStringW cStrJournalFileNameW;
+    ULONG nSeed;
+    HRESULT hRes;
+
+    ::MxMemSet(&sCtx, 0, sizeof(sCtx));
+    if (FAILED(GetCmdLineParamUInt(L"sessions", &(sCtx.dwSessionsCount))) || sCtx.dwSessionsCount == 0)
+    {
+        sCtx.dwSessionsCount = 10000;
+    }
+    sCtx.dwThreadsCount = GetBenchmarkThreadsCount();
+
+    sCtx.lpIds = (SESSION_ID *)MX_MALLOC((SIZE_T)(sCtx.dwSessionsCount) * sizeof(SESSION_ID));
+    if (sCtx.lpIds == NULL)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+    nSeed = 0x9E3779B9UL;
+    for (DWORD i = 0; i < sCtx.dwSessionsCount; i++)
+    {
+        for (SIZE_T j = 0; j < 64; j++)
+        {
+            // xorshift32
+            nSeed ^= nSeed << 13;
+            nSeed ^= nSeed >> 17;
+            nSeed ^= nSeed << 5;
+            sCtx.lpIds[i].szIdA[j] = "0123456789ABCDEF"[nSeed & 15];
+        }
+        sCtx.lpIds[i].szIdA[64] = 0;
+    }
+
+    hRes = InitializeBenchmarkLatency(&(sCtx.sLatency), sCtx.dwThreadsCount);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = GetAppPath(cStrJournalFileNameW);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        if (cStrJournalFileNameW.Concat(L"BenchmarkSessions.journal") == FALSE)
+        {
+            hRes = E_OUTOFMEMORY;
+        }
+    }
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    ::DeleteFileW((LPCWSTR)cStrJournalFileNameW);
+
+    wprintf_s(L"Running session store benchmark with %lu sessions and %lu threads...\n", sCtx.dwSessionsCount,
+              sCtx.dwThreadsCount);
+
+    hRes = RunSessionStorePhase(L"In-memory", &sCtx, NULL);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    hRes = RunSessionStorePhase(L"With journal", &sCtx, (LPCWSTR)cStrJournalFileNameW);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+done:
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Session store benchmark failed [0x%08X].\n", hRes);
+    }
+    if (cStrJournalFileNameW.IsEmpty() == FALSE)
+    {
+        ::DeleteFileW((LPCWSTR)cStrJournalFileNameW);
+    }
+    FreeBenchmarkLatency(&(sCtx.sLatency));
+    MX_FREE(sCtx.lpIds);
+    return (SUCCEEDED(hRes)) ? 0 : (int)hRes;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT RunSessionStorePhase(_In_z_ LPCWSTR szNameW, _In_ SESSION_STORE_CONTEXT *lpCtx,
+                                    _In_opt_z_ LPCWSTR szJournalFileNameW)
+{
+    MX::CJsHttpServerSessionStore cStore;
+    MX::CJsHttpServerSessionStore::STATS sStats;
+    MX::CTimer cTimer;
+    ULONGLONG nOps;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    hRes = cStore.Initialize(2 * 60 * 60, szJournalFileNameW);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    lpCtx->lpStore = &cStore;
+    hRes = FillSessionStore(lpCtx);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    hRes = cStore.FlushJournal();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    ResetBenchmarkLatency(&(lpCtx->sLatency));
+
+    hRes = RunBenchmarkThreads(lpCtx->dwThreadsCount, GetBenchmarkDurationMs(), &SessionStoreJob, lpCtx, &nOps,
+                               &dwElapsedMs);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    PrintBenchmarkResult(szNameW, nOps, dwElapsedMs);
+    PrintBenchmarkLatency(&(lpCtx->sLatency), nOps);
+
+    if (szJournalFileNameW != NULL)
+    {
+        cTimer.Reset();
+        cStore.FlushJournal();
+        cTimer.Mark();
+        cStore.GetStats(&sStats);
+        wprintf_s(L"  flush: %lums, %I64u journal bytes, %I64u properties saved in %I64u saves\n",
+                  cTimer.GetElapsedTimeMs(), sStats.nJournalBytes, sStats.nPropertiesSaved, sStats.nSaves);
+    }
+
+    // done
+    lpCtx->lpStore = NULL;
+    return S_OK;
+}
+
+static HRESULT FillSessionStore(_In_ SESSION_STORE_CONTEXT *lpCtx)
+{
+    MX::CPropertyBag cBag;
+    CHAR szNameA[16];
+    HRESULT hRes;
+
+    // a typical session: a few counters, some flags and the user's identity
+    for (DWORD i = 0; i < SESSION_PROPERTIES_COUNT; i++)
+    {
+        _snprintf_s(szNameA, _countof(szNameA), _TRUNCATE, "prop%lu", i);
+        hRes = ((i & 3) == 0) ? cBag.SetString(szNameA, "some-user@example.com") : cBag.SetDWord(szNameA, i);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+    hRes = cBag.SetQWord("counter", 0);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    for (DWORD i = 0; i < lpCtx->dwSessionsCount; i++)
+    {
+        hRes = lpCtx->lpStore->Save(lpCtx->lpIds[i].szIdA, cBag);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static ULONGLONG SessionStoreJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    static LPCSTR szChangedNamesA[1] = { "counter" };
+    SESSION_STORE_CONTEXT *lpCtx = (SESSION_STORE_CONTEXT *)lpContext;
+    MX::CPropertyBag cBag;
+    LARGE_INTEGER liStart, liEnd;
+    ULONGLONG nCount = 0, nCounter;
+    ULONG nSeed;
+    LPCSTR szIdA;
+
+    nSeed = 0x9E3779B9UL ^ (dwThreadIndex * 0x85EBCA6BUL);
+    if (nSeed == 0)
+    {
+        nSeed = 1;
+    }
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+        szIdA = lpCtx->lpIds[nSeed % lpCtx->dwSessionsCount].szIdA;
+
+        // one request: load the session, touch a property and save the change
+        ::QueryPerformanceCounter(&liStart);
+        if (SUCCEEDED(lpCtx->lpStore->Load(szIdA, cBag)))
+        {
+            cBag.GetQWord("counter", nCounter);
+            cBag.SetQWord("counter", nCounter + 1);
+            lpCtx->lpStore->Save(szIdA, cBag, szChangedNamesA, MX_ARRAYLEN(szChangedNamesA));
+        }
+        ::QueryPerformanceCounter(&liEnd);
+
+        AddBenchmarkLatency(&(lpCtx->sLatency), dwThreadIndex, liEnd.QuadPart - liStart.QuadPart);
+        nCount++;
+    }
+    return nCount;
+}
+
+//-----------------------------------------------------------
+
+int BenchmarkJsJson()
+{
+    MX::CJavascriptVM cJvm;
+    DWORD dwItemsCount;
+    SIZE_T nJsonSize;
+    CHAR szCodeA[1024];
+    HRESULT hRes;
+
+    if (FAILED(GetCmdLineParamUInt(L"items", &dwItemsCount)) || dwItemsCount == 0)
+    {
+        dwItemsCount = 100000;
+    }
+
+    hRes = cJvm.Initialize();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cJvm.AddNativeJsonSupport();
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Unable to initialize the Javascript VM [0x%08X].\n", hRes);
+        return (int)hRes;
+    }
+
+    // a typical API response: an array of records with numbers, strings, flags and a nested object
+    _snprintf_s(szCodeA, _countof(szCodeA), _TRUNCATE,
+                "var data = [];\n"
+                "for (var i = 0; i < %lu; i++) {\n"
+                "  data.push({ id: i, name: 'User \\u00e1' + i, email: 'user' + i + '@example.com', score: i * 1.25,\n"
+                "              active: (i & 1) === 0, tags: ['alpha', 'beta', null],\n"
+                "              address: { street: 'Main St. ' + i, zip: 10000 + (i %% 5000) } });\n"
+                "}\n"
+                "var text = JSON.stringify(data);\n"
+                "var result;\n", dwItemsCount);
+    try
+    {
+        cJvm.Run(szCodeA);
+        cJvm.RunNativeProtected(0, 0, [&nJsonSize](_In_ DukTape::duk_context *lpCtx) -> VOID
+        {
+            DukTape::duk_size_t nLen = 0;
+
+            // byte length, duk_get_length() counts characters and the corpus is not pure ASCII
+            DukTape::duk_get_global_string(lpCtx, "text");
+            DukTape::duk_get_lstring(lpCtx, -1, &nLen);
+            nJsonSize = (SIZE_T)nLen;
+            DukTape::duk_pop(lpCtx);
+            return;
+        });
+    }
+    catch (MX::CJsWindowsError &e)
+    {
+        wprintf_s(L"Error: %S [0x%08X].\n", e.GetDescription(), e.GetHResult());
+        return (int)(e.GetHResult());
+    }
+    catch (MX::CJsError &e)
+    {
+        wprintf_s(L"Error: %S.\n", e.GetDescription());
+        return (int)E_FAIL;
+    }
+
+    wprintf_s(L"Running JSON benchmark with %lu items (%Iu bytes, %lu rounds)...\n", dwItemsCount, nJsonSize,
+              JSON_ROUNDS_COUNT);
+
+    hRes = RunJsonPhase(cJvm, L"JSON.stringify", "result = JSON.stringify(data);", nJsonSize);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = RunJsonPhase(cJvm, L"NativeJSON.stringify", "result = NativeJSON.stringify(data);", nJsonSize);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = RunJsonStreamPhase(cJvm, nJsonSize);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = RunJsonPhase(cJvm, L"JSON.parse", "result = JSON.parse(text);", nJsonSize);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = RunJsonPhase(cJvm, L"NativeJSON.parse", "result = NativeJSON.parse(text);", nJsonSize);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: JSON benchmark failed [0x%08X].\n", hRes);
+        return (int)hRes;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT RunJsonPhase(_In_ MX::CJavascriptVM &cJvm, _In_z_ LPCWSTR szNameW, _In_z_ LPCSTR szCodeA,
+                            _In_ SIZE_T nJsonSize)
+{
+    MX::CTimer cTimer;
+    DWORD dwElapsedMs;
+
+    try
+    {
+        cJvm.RunGC();
+        cTimer.Reset();
+        for (DWORD i = 0; i < JSON_ROUNDS_COUNT; i++)
+        {
+            cJvm.Run(szCodeA);
+        }
+        cTimer.Mark();
+        cJvm.Run("result = null;");
+    }
+    catch (MX::CJsWindowsError &e)
+    {
+        return e.GetHResult();
+    }
+    catch (MX::CJsError &e)
+    {
+        wprintf_s(L"%s: %S\n", szNameW, e.GetDescription());
+        return E_FAIL;
+    }
+
+    dwElapsedMs = cTimer.GetElapsedTimeMs();
+    if (dwElapsedMs == 0)
+    {
+        dwElapsedMs = 1;
+    }
+    wprintf_s(L"%s: %lums per round (%.1f MB/s)\n", szNameW, dwElapsedMs / JSON_ROUNDS_COUNT,
+              ((double)nJsonSize * (double)JSON_ROUNDS_COUNT / 1048576.0) * 1000.0 / (double)dwElapsedMs);
+    return S_OK;
+}
+
+static HRESULT RunJsonStreamPhase(_In_ MX::CJavascriptVM &cJvm, _In_ SIZE_T nJsonSize)
+{
+    MX::CTimer cTimer;
+    ULONGLONG nOutputSize = 0;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    // NOTE: Mimics echoJson: the output is handed over in chunks like the response body would be.
+    cTimer.Reset();
+    hRes = cJvm.RunNativeProtectedAndGetError(0, 0, [&nOutputSize](_In_ DukTape::duk_context *lpCtx) -> VOID
+    {
+        DukTape::duk_get_global_string(lpCtx, "data");
+        for (DWORD i = 0; i < JSON_ROUNDS_COUNT; i++)
+        {
+            MX::CJavascriptVM::EncodeJson(lpCtx, -1, MX_BIND_CALLBACK(&OnJsonStreamOutput), &nOutputSize);
+        }
+        DukTape::duk_pop(lpCtx);
+        return;
+    });
+    cTimer.Mark();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (nOutputSize != (ULONGLONG)nJsonSize * (ULONGLONG)JSON_ROUNDS_COUNT)
+    {
+        return MX_E_InvalidData;
+    }
+
+    dwElapsedMs = cTimer.GetElapsedTimeMs();
+    if (dwElapsedMs == 0)
+    {
+        dwElapsedMs = 1;
+    }
+    wprintf_s(L"Native streamed encode: %lums per round (%.1f MB/s)\n", dwElapsedMs / JSON_ROUNDS_COUNT,
+              ((double)nJsonSize * (double)JSON_ROUNDS_COUNT / 1048576.0) * 1000.0 / (double)dwElapsedMs);
+    return S_OK;
+}
+
+static HRESULT OnJsonStreamOutput(_In_ LPCSTR szDataA, _In_ SIZE_T nDataLen, _In_opt_ LPVOID lpUserParam)
+{
+    *((ULONGLONG *)lpUserParam) += (ULONGLONG)nDataLen;
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+int BenchmarkJsJwt()
+{
+    MX::CJavascriptVM cJvm;
+    DWORD dwTokensCount, dwVerifyCount;
+    CHAR szCodeA[1024];
+    HRESULT hRes;
+
+    if (FAILED(GetCmdLineParamUInt(L"tokens", &dwTokensCount)) || dwTokensCount == 0)
+    {
+        dwTokensCount = 256;
+    }
+    if (FAILED(GetCmdLineParamUInt(L"items", &dwVerifyCount)) || dwVerifyCount == 0)
+    {
+        dwVerifyCount = 100000;
+    }
+
+    hRes = cJvm.Initialize();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = MX::CJsonWebTokenPlugin::Register(cJvm);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Unable to initialize the Javascript VM [0x%08X].\n", hRes);
+        return (int)hRes;
+    }
+
+    // a small set of session tokens verified over and over like a busy API would do
+    _snprintf_s(szCodeA, _countof(szCodeA), _TRUNCATE,
+                "var secret = 'benchmark-secret-key';\n"
+                "var options = { algorithm: 'HS256', audience: 'api' };\n"
+                "var tokens = [];\n"
+                "for (var i = 0; i < %lu; i++) {\n"
+                "  tokens.push(JWT.create({ uid: i, role: 'user', name: 'User ' + i }, secret,\n"
+                "                         { algorithm: 'HS256', expiresAfter: '1h', audience: 'api',\n"
+                "                           subject: 'user' + i }));\n"
+                "}\n", dwTokensCount);
+    try
+    {
+        cJvm.Run(szCodeA);
+    }
+    catch (MX::CJsWindowsError &e)
+    {
+        wprintf_s(L"Error: %S [0x%08X].\n", e.GetDescription(), e.GetHResult());
+        return (int)(e.GetHResult());
+    }
+    catch (MX::CJsError &e)
+    {
+        wprintf_s(L"Error: %S.\n", e.GetDescription());
+        return (int)E_FAIL;
+    }
+
+    wprintf_s(L"Running JWT benchmark with %lu tokens and %lu verifications...\n", dwTokensCount, dwVerifyCount);
+
+    MX::CJsonWebTokenPlugin::SetVerifyCacheSize(0);
+    hRes = RunJwtPhase(cJvm, L"Uncached", dwVerifyCount);
+    if (SUCCEEDED(hRes))
+    {
+        MX::CJsonWebTokenPlugin::SetVerifyCacheSize(JWT_DEFAULT_CACHE_SIZE);
+        hRes = RunJwtPhase(cJvm, L"Cached", dwVerifyCount);
+    }
+    MX::CJsonWebTokenPlugin::SetVerifyCacheSize(JWT_DEFAULT_CACHE_SIZE);
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: JWT benchmark failed [0x%08X].\n", hRes);
+        return (int)hRes;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT RunJwtPhase(_In_ MX::CJavascriptVM &cJvm, _In_z_ LPCWSTR szNameW, _In_ DWORD dwVerifyCount)
+{
+    MX::CJsonWebTokenPlugin::VERIFY_CACHE_STATS sStats;
+    MX::CTimer cTimer;
+    CHAR szCodeA[256];
+    DWORD dwElapsedMs;
+
+    _snprintf_s(szCodeA, _countof(szCodeA), _TRUNCATE,
+                "for (var i = 0; i < %lu; i++) {\n"
+                "  JWT.verify(tokens[i %% tokens.length], secret, options);\n"
+                "}\n", dwVerifyCount);
+    try
+    {
+        cJvm.RunGC();
+        cTimer.Reset();
+        cJvm.Run(szCodeA);
+        cTimer.Mark();
+    }
+    catch (MX::CJsWindowsError &e)
+    {
+        return e.GetHResult();
+    }
+    catch (MX::CJsError &e)
+    {
+        wprintf_s(L"%s: %S\n", szNameW, e.GetDescription());
+        return E_FAIL;
+    }
+
+    dwElapsedMs = cTimer.GetElapsedTimeMs();
+    if (dwElapsedMs == 0)
+    {
+        dwElapsedMs = 1;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats);
+    wprintf_s(L"%s: %lums (%.0f verifications/s) / Entries: %I64u / Hits: %I64u / Misses: %I64u / Evictions: %I64u\n",
+              szNameW, dwElapsedMs, (double)dwVerifyCount * 1000.0 / (double)dwElapsedMs, sStats.nEntries,
+              sStats.nHits, sStats.nMisses, sStats.nEvictions);
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+int BenchmarkJsStreamedResponse()
+{
+    MX::CIoCompletionPortThreadPool cDispatcherPool;
+    MX::CSockets cSckMgr(cDispatcherPool);
+    MX::CJsHttpServer cJsHttpServer(cSckMgr);
+    MX::CSockets::CListenerOptions cOptions;
+    MX::CTimer cTimer;
+    CHAR szCodeA[1024];
+    ULONGLONG nReportSize, nBodySize;
+    SIZE_T nBaseMemory, nPeakMemory;
+    DWORD dw, dwPort, dwElapsedMs;
+    BOOL bBuffered, bChunked;
+    HRESULT hRes;
+
+    if (FAILED(GetCmdLineParamUInt(L"port", &dwPort)) || dwPort < 1 || dwPort > 65535)
+    {
+        dwPort = STREAMED_RESPONSE_DEFAULT_PORT;
+    }
+    if (FAILED(GetCmdLineParamUInt(L"size", &dw)) || dw < 1 || dw > 65536)
+    {
+        dw = STREAMED_RESPONSE_DEFAULT_SIZE;
+    }
+    nReportSize = (ULONGLONG)dw * 1048576ui64;
+    bBuffered = DoesCmdLineParamExist(L"buffered");
+
+    // a table report produced in 64KB pages, either echoed into the response body or written as it is generated
+    _snprintf_s(szCodeA, _countof(szCodeA), _TRUNCATE,
+                "<%%\n"
+                "var row = '<tr><td>Item</td><td>Lorem ipsum dolor sit amet, consectetur adipiscing elit</td>"
+                "<td>1234.56</td></tr>\\n';\n"
+                "var page = '';\n"
+                "while (page.length + row.length <= 65536) page += row;\n"
+                "var total = %I64u, sent = 0, out = %s;\n"
+                "while (sent < total) {\n"
+                "  var s = (total - sent < page.length) ? page.substring(0, total - sent) : page;\n"
+                "  out(s);\n"
+                "  sent += s.length;\n"
+                "}\n"
+                "%%>", nReportSize, ((bBuffered != FALSE) ? "echo" : "response.write"));
+    szStreamedReportCodeA = szCodeA;
+
+    hRes = cDispatcherPool.Initialize();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cSckMgr.Initialize();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        cJsHttpServer.SetRequestCompletedCallback(MX_BIND_CALLBACK(&OnStreamedReportRequestCompleted));
+
+        hRes = cJsHttpServer.StartListening("127.0.0.1", MX::CSockets::eFamily::IPv4, (int)dwPort, &cOptions);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Cannot start the HTTP server on port %lu [0x%08X].\n", dwPort, hRes);
+        szStreamedReportCodeA = NULL;
+        return (int)hRes;
+    }
+
+    wprintf_s(L"Running streamed response benchmark with a %lu MB report (%s)... ", dw,
+              ((bBuffered != FALSE) ? L"echo" : L"response.write"));
+
+    nBaseMemory = GetBenchmarkPrivateBytes(FALSE);
+    cTimer.Reset();
+    hRes = RequestStreamedReport(dwPort, &nBodySize, &bChunked);
+    cTimer.Mark();
+    dwElapsedMs = cTimer.GetElapsedTimeMs();
+    nPeakMemory = GetBenchmarkPrivateBytes(TRUE);
+
+    cJsHttpServer.StopListening();
+    szStreamedReportCodeA = NULL;
+    if (SUCCEEDED(hRes) && (nBodySize != nReportSize || bChunked == bBuffered))
+    {
+        hRes = MX_E_InvalidData;
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"\nError: 0x%08X.\n", hRes);
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    if (dwElapsedMs == 0)
+    {
+        dwElapsedMs = 1;
+    }
+    wprintf_s(L"Report received: %I64u bytes in %lums (%.1f MB/s)\n", nBodySize, dwElapsedMs,
+              ((double)nBodySize / 1048576.0) * 1000.0 / (double)dwElapsedMs);
+    wprintf_s(L"Peak private memory growth: %.1f MB\n",
+              (double)((nPeakMemory > nBaseMemory) ? (nPeakMemory - nBaseMemory) : 0) / 1048576.0);
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static VOID OnStreamedReportRequestCompleted(_In_ MX::CJsHttpServer *lpHttp, _In_ MX::CJsHttpServer::CClientRequest *lpRequest)
+{
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(lpHttp);
+
+    // NOTE: The script runs in a thread of the dispatcher pool. While response.write() waits for the client, the
+    //       other threads of the pool keep sending.
+    hRes = lpRequest->AttachJVM();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->RunScript(szStreamedReportCodeA);
+    }
+    lpRequest->End(hRes);
+    return;
+}
+
+static HRESULT RequestStreamedReport(_In_ DWORD dwPort, _Out_ PULONGLONG lpnBodySize, _Out_ LPBOOL lpbChunked)
+{
+    static const CHAR szRequestA[] = "GET /report HTTP/1.1\r\nHost: localhost\r\nConnection: Close\r\n\r\n";
+    SOCKADDR_IN sAddr;
+    SOCKET sck;
+    HRESULT hRes;
+
+    *lpnBodySize = 0;
+    *lpbChunked = FALSE;
+
+    sck = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sck == INVALID_SOCKET)
+    {
+        return MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    }
+
+    ::MxMemSet(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port = htons((u_short)dwPort);
+    sAddr.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(sck, (const sockaddr *)&sAddr, (int)sizeof(sAddr)) != SOCKET_ERROR &&
+        ::send(sck, szRequestA, (int)(MX_ARRAYLEN(szRequestA) - 1), 0) != SOCKET_ERROR)
+    {
+        hRes = ReceiveStreamedReport(sck, lpnBodySize, lpbChunked);
+    }
+    else
+    {
+        hRes = MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    }
+
+    ::closesocket(sck);
+    return hRes;
+}
+
+static HRESULT ReceiveStreamedReport(_In_ SOCKET sck, _Out_ PULONGLONG lpnBodySize, _Out_ LPBOOL lpbChunked)
+{
+    enum class eState
+    {
+        Headers = 0,
+        Identity,
+        ChunkSize,
+        ChunkData,
+        ChunkDataEnd,
+        LastChunkEnd,
+        Done
+    };
+    MX::TAutoFreePtr<CHAR> aBuffer;
+    eState nState = eState::Headers;
+    ULONGLONG nContentLength = 0, nChunkLeft = 0, nBodySize = 0, nLen;
+    SIZE_T nReceived = 0, nPos;
+    LPCSTR szHeadersEndA, sA;
+    LPSTR szBufA;
+    CHAR chA;
+    int r;
+
+    *lpnBodySize = 0;
+    *lpbChunked = FALSE;
+
+    aBuffer.Attach((LPSTR)MX_MALLOC(STREAMED_RESPONSE_BUFFER_SIZE + 1));
+    if (!aBuffer)
+    {
+        return E_OUTOFMEMORY;
+    }
+    szBufA = aBuffer.Get();
+
+    while (nState != eState::Done)
+    {
+        r = ::recv(sck, szBufA + nReceived, (int)(STREAMED_RESPONSE_BUFFER_SIZE - nReceived), 0);
+        if (r <= 0)
+        {
+            // without a length nor chunks, the body ends when the server closes the connection
+            if (r == 0 && nState == eState::Identity && nContentLength == (ULONGLONG)-1)
+            {
+                break;
+            }
+            return (r == 0) ? MX_E_BrokenPipe : MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+        }
+        nReceived += (SIZE_T)r;
+        nPos = 0;
+
+        if (nState == eState::Headers)
+        {
+            szBufA[nReceived] = 0;
+            szHeadersEndA = MX::StrFindA(szBufA, "\r\n\r\n");
+            if (szHeadersEndA == NULL)
+            {
+                if (nReceived >= STREAMED_RESPONSE_BUFFER_SIZE)
+                {
+                    return MX_E_BufferOverflow;
+                }
+                continue;
+            }
+            if (nReceived < 13 || MX::StrNCompareA(szBufA + 9, "200 ", 4) != 0)
+            {
+                return MX_E_InvalidData;
+            }
+
+            sA = MX::StrFindA(szBufA, "\r\nTransfer-Encoding: chunked\r\n", FALSE, TRUE);
+            if (sA != NULL && sA < szHeadersEndA)
+            {
+                *lpbChunked = TRUE;
+                nState = eState::ChunkSize;
+            }
+            else
+            {
+                nContentLength = (ULONGLONG)-1;
+                sA = MX::StrFindA(szBufA, "\r\nContent-Length: ", FALSE, TRUE);
+                if (sA != NULL && sA < szHeadersEndA)
+                {
+                    nContentLength = 0;
+                    for (sA += 18; *sA >= '0' && *sA <= '9'; sA++)
+                    {
+                        nContentLength = nContentLength * 10ui64 + (ULONGLONG)(*sA - '0');
+                    }
+                }
+                nState = eState::Identity;
+            }
+            nPos = (SIZE_T)(szHeadersEndA - szBufA) + 4;
+        }
+
+        // walk the body received so far
+        while (nPos < nReceived && nState != eState::Done)
+        {
+            switch (nState)
+            {
+                case eState::Identity:
+                    nBodySize += (ULONGLONG)(nReceived - nPos);
+                    nPos = nReceived;
+                    if (nContentLength != (ULONGLONG)-1 && nBodySize >= nContentLength)
+                    {
+                        nState = eState::Done;
+                    }
+                    break;
+
+                case eState::ChunkSize:
+                    chA = szBufA[nPos++];
+                    if (chA >= '0' && chA <= '9')
+                    {
+                        nChunkLeft = (nChunkLeft << 4) + (ULONGLONG)(chA - '0');
+                    }
+                    else if (chA >= 'A' && chA <= 'F')
+                    {
+                        nChunkLeft = (nChunkLeft << 4) + (ULONGLONG)(chA - 'A' + 10);
+                    }
+                    else if (chA >= 'a' && chA <= 'f')
+                    {
+                        nChunkLeft = (nChunkLeft << 4) + (ULONGLONG)(chA - 'a' + 10);
+                    }
+                    else if (chA == '\n')
+                    {
+                        nState = (nChunkLeft > 0ui64) ? eState::ChunkData : eState::LastChunkEnd;
+                    }
+                    else if (chA != '\r')
+                    {
+                        return MX_E_InvalidData;
+                    }
+                    break;
+
+                case eState::ChunkData:
+                    nLen = (ULONGLONG)(nReceived - nPos);
+                    if (nLen > nChunkLeft)
+                    {
+                        nLen = nChunkLeft;
+                    }
+                    nBodySize += nLen;
+                    nChunkLeft -= nLen;
+                    nPos += (SIZE_T)nLen;
+                    if (nChunkLeft == 0ui64)
+                    {
+                        nState = eState::ChunkDataEnd;
+                    }
+                    break;
+
+                case eState::ChunkDataEnd:
+                case eState::LastChunkEnd:
+                    chA = szBufA[nPos++];
+                    if (chA == '\n')
+                    {
+                        nState = (nState == eState::ChunkDataEnd) ? eState::ChunkSize : eState::Done;
+                    }
+                    else if (chA != '\r')
+                    {
+                        return MX_E_InvalidData;
+                    }
+                    break;
+            }
+        }
+        nReceived = 0;
+    }
+
+    // done
+    *lpnBodySize = nBodySize;
+    return S_OK;
+}
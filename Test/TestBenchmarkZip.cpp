@@ -0,0 +1,773 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestBenchmark.h"
+#include <ZipLib\ZipLib.h>
+#include <ZipLib\ZipFile.h>
+#include <ZipLib\ZipArchiveReader.h>
+#include <MemoryStream.h>
+#include <Strings\Utf8.h>
+#include <Crc32.h>
+
+ //-----------------------------------------------------------
+
+#define ZIP_CHUNK_SIZE 1048576
+
+#define ZIP_READ_BUFFER_SIZE 65536
+
+#define ZIP_STORED_CONTENT "stored entries are checked like deflated ones"
+
+//-----------------------------------------------------------
+
+typedef struct tagZIP_READER_CONTEXT
+{
+    MX::CZipArchiveReader *lpReader;
+    MX::CZipFile *lpZipFile;
+    MX::CStringA *lpNamesA;
+    MX::CStringW *lpNamesW;
+    DWORD dwFilesCount;
+    LONG volatile nErrors;
+} ZIP_READER_CONTEXT;
+
+//-----------------------------------------------------------
+
+static LPBYTE BuildLogLikeData(_In_ SIZE_T nSize);
+static HRESULT CompressBuffer(_In_ LPBYTE lpData, _In_ SIZE_T nDataSize, _In_ DWORD dwThreadsCount,
+                              _Inout_ MX::CCircularBuffer &cOutput, _Out_ LPDWORD lpdwElapsedMs);
+static HRESULT VerifyCompressedData(_In_ MX::CCircularBuffer &cCompressed, _In_ LPBYTE lpData, _In_ SIZE_T nDataSize);
+static HRESULT BuildBenchmarkArchive(_In_z_ LPCWSTR szFileNameW, _In_ ZIP_READER_CONTEXT *lpCtx);
+static HRESULT VerifyStoredEntries(_In_z_ LPCWSTR szFileNameW);
+static HRESULT WriteStoredArchive(_In_z_ LPCWSTR szFileNameW);
+static SIZE_T AddStoredEntry(_Out_ LPBYTE lpLocal, _Out_ LPBYTE lpCentral, _In_z_ LPCSTR szNameA,
+                             _In_ ULONG nCrc32, _In_ DWORD dwLocalOffset);
+static HRESULT ReadWholeEntry(_In_ MX::CStream *lpStream, _Out_ MX::CStringA &cStrContentA);
+static HRESULT RunZipReaderPhase(_In_z_ LPCWSTR szNameW, _In_ DWORD dwThreadsCount, _In_ lpfnBenchmarkJob lpfnJob,
+                                 _In_ ZIP_READER_CONTEXT *lpCtx, _In_ BOOL bThroughput);
+static ULONGLONG ZipFileLookupJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static ULONGLONG ZipReaderLookupJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static ULONGLONG ZipFileReadJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+static ULONGLONG ZipReaderReadJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop);
+
+//-----------------------------------------------------------
+
+int BenchmarkZipParallelDeflate()
+{
+    MX::CCircularBuffer cCompressed;
+    LPBYTE lpData;
+    SIZE_T nDataSize;
+    DWORD dw, dwMaxThreads, dwThreads, dwElapsedMs;
+    HRESULT hRes;
+
+    if (FAILED(GetCmdLineParamUInt(L"size", &dw)) || dw == 0)
+    {
+        dw = 128;
+    }
+    nDataSize = (SIZE_T)dw * 1048576;
+    dwMaxThreads = GetBenchmarkThreadsCount();
+
+    lpData = BuildLogLikeData(nDataSize);
+    if (lpData == NULL)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+
+    wprintf_s(L"Running parallel deflate benchmark with %Iu MB of log-like data...\n", nDataSize / 1048576);
+
+    // threads count of zero means the classic single stream compressor
+    hRes = S_OK;
+    for (dwThreads = 0; SUCCEEDED(hRes) && dwThreads <= dwMaxThreads; dwThreads = (dwThreads == 0) ? 1 : (dwThreads << 1))
+    {
+        hRes = CompressBuffer(lpData, nDataSize, dwThreads, cCompressed, &dwElapsedMs);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = VerifyCompressedData(cCompressed, lpData, nDataSize);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            if (dwElapsedMs == 0)
+            {
+                dwElapsedMs = 1;
+            }
+            if (dwThreads == 0)
+            {
+                wprintf_s(L"    Sequential: ");
+            }
+            else
+            {
+                wprintf_s(L"    %2lu thread(s): ", dwThreads);
+            }
+            wprintf_s(L"%lums (%.1f MB/s) / Ratio: %.2f%%\n", dwElapsedMs,
+                      ((double)nDataSize / 1048576.0) * 1000.0 / (double)dwElapsedMs,
+                      (double)(cCompressed.GetAvailableForRead()) * 100.0 / (double)nDataSize);
+        }
+        if (SUCCEEDED(hRes) && ShouldAbort() != FALSE)
+        {
+            hRes = MX_E_Cancelled;
+        }
+    }
+
+    MX_FREE(lpData);
+
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: 0x%08X.\n", hRes);
+        return (int)hRes;
+    }
+    return 0;
+}
+
+int BenchmarkZipArchiveReader()
+{
+    MX::CZipFile cZipFile;
+    MX::TAutoRefCounted<MX::CZipArchiveReader> cReader;
+    ZIP_READER_CONTEXT sContext;
+    MX::CStringW cStrFileNameW;
+    DWORD dwThreadsCount;
+    HRESULT hRes;
+
+    ::MxMemSet(&sContext, 0, sizeof(sContext));
+    if (FAILED(GetCmdLineParamUInt(L"files", &(sContext.dwFilesCount))) || sContext.dwFilesCount == 0)
+    {
+        sContext.dwFilesCount = 4096;
+    }
+    dwThreadsCount = GetBenchmarkThreadsCount();
+
+    hRes = GetAppPath(cStrFileNameW);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = (cStrFileNameW.Concat(L"BenchmarkArchive.zip") != FALSE) ? S_OK : E_OUTOFMEMORY;
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: 0x%08X.\n", hRes);
+        return (int)hRes;
+    }
+
+    sContext.lpNamesA = MX_DEBUG_NEW MX::CStringA[sContext.dwFilesCount];
+    sContext.lpNamesW = MX_DEBUG_NEW MX::CStringW[sContext.dwFilesCount];
+    if (sContext.lpNamesA == NULL || sContext.lpNamesW == NULL)
+    {
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+
+    wprintf_s(L"Building archive with %lu files... ", sContext.dwFilesCount);
+    hRes = BuildBenchmarkArchive((LPCWSTR)cStrFileNameW, &sContext);
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"\n");
+        goto done;
+    }
+    wprintf_s(L"OK\n");
+
+    hRes = cZipFile.OpenArchive((LPCWSTR)cStrFileNameW);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    cReader.Attach(MX_DEBUG_NEW MX::CZipArchiveReader());
+    if (!cReader)
+    {
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+    hRes = cReader->Open((LPCWSTR)cStrFileNameW);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    sContext.lpZipFile = &cZipFile;
+    sContext.lpReader = cReader.Get();
+
+    wprintf_s(L"Verifying stored entries... ");
+    hRes = VerifyStoredEntries((LPCWSTR)cStrFileNameW);
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"\n");
+        goto done;
+    }
+    wprintf_s(L"OK\n");
+
+    // CZipFile keeps a single open entry so it can only be used from one thread
+    hRes = RunZipReaderPhase(L"CZipFile lookups (1 thread)", 1, &ZipFileLookupJob, &sContext, FALSE);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = RunZipReaderPhase(L"CZipArchiveReader lookups", dwThreadsCount, &ZipReaderLookupJob, &sContext, FALSE);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = RunZipReaderPhase(L"CZipFile reads (1 thread)", 1, &ZipFileReadJob, &sContext, TRUE);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = RunZipReaderPhase(L"CZipArchiveReader reads", dwThreadsCount, &ZipReaderReadJob, &sContext, TRUE);
+    }
+
+done:
+    cReader.Release();
+    cZipFile.CloseArchive();
+    ::DeleteFileW((LPCWSTR)cStrFileNameW);
+    if (sContext.lpNamesA != NULL)
+    {
+        delete[] sContext.lpNamesA;
+    }
+    if (sContext.lpNamesW != NULL)
+    {
+        delete[] sContext.lpNamesW;
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: 0x%08X.\n", hRes);
+        return (int)hRes;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static LPBYTE BuildLogLikeData(_In_ SIZE_T nSize)
+{
+    static const LPCSTR aMethodsA[] = { "GET", "POST", "PUT", "DELETE" };
+    static const LPCSTR aPathsA[] = { "/", "/index.html", "/api/v1/users", "/api/v1/orders", "/static/app.js",
+                                      "/static/styles.css", "/login", "/favicon.ico" };
+    static const int aStatus[] = { 200, 200, 200, 204, 301, 304, 404, 500 };
+    LPBYTE lpData;
+    CHAR szLineA[256];
+    SIZE_T nOffset;
+    ULONG nSeed = 0x2545F491UL;
+
+    lpData = (LPBYTE)MX_MALLOC(nSize);
+    if (lpData == NULL)
+    {
+        return NULL;
+    }
+    for (nOffset = 0; nOffset < nSize; )
+    {
+        int nLen;
+        SIZE_T nToCopy;
+
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+
+        nLen = _snprintf_s(szLineA, _countof(szLineA), _TRUNCATE,
+                           "192.168.%lu.%lu - - [19/Oct/2026:10:%02lu:%02lu +0000] \"%s %s HTTP/1.1\" %d %lu\r\n",
+                           (nSeed >> 8) & 0xFF, nSeed & 0xFF, (nSeed >> 16) % 60, (nSeed >> 22) % 60,
+                           aMethodsA[(nSeed >> 3) & 3], aPathsA[(nSeed >> 5) & 7], aStatus[(nSeed >> 11) & 7],
+                           nSeed % 65536);
+        if (nLen <= 0)
+        {
+            break;
+        }
+        nToCopy = ((SIZE_T)nLen < nSize - nOffset) ? (SIZE_T)nLen : (nSize - nOffset);
+        ::MxMemCopy(lpData + nOffset, szLineA, nToCopy);
+        nOffset += nToCopy;
+    }
+    return lpData;
+}
+
+static HRESULT CompressBuffer(_In_ LPBYTE lpData, _In_ SIZE_T nDataSize, _In_ DWORD dwThreadsCount,
+                              _Inout_ MX::CCircularBuffer &cOutput, _Out_ LPDWORD lpdwElapsedMs)
+{
+    MX::CZipLib cZipLib(TRUE);
+    MX::CTimer cTimer;
+    BYTE aBuffer[32768];
+    SIZE_T nOffset;
+    HRESULT hRes;
+
+    *lpdwElapsedMs = 0;
+    cOutput.SetBufferSize(0);
+
+    cTimer.Reset();
+    hRes = (dwThreadsCount == 0) ? cZipLib.BeginCompress(6) : cZipLib.BeginParallelCompress(6, dwThreadsCount);
+    for (nOffset = 0; SUCCEEDED(hRes) && nOffset < nDataSize; nOffset += ZIP_CHUNK_SIZE)
+    {
+        SIZE_T nToCompress = (nDataSize - nOffset > ZIP_CHUNK_SIZE) ? ZIP_CHUNK_SIZE : (nDataSize - nOffset);
+
+        hRes = cZipLib.CompressStream(lpData + nOffset, nToCompress);
+        while (SUCCEEDED(hRes) && cZipLib.GetAvailableData() > 0)
+        {
+            hRes = cOutput.Write(aBuffer, cZipLib.GetData(aBuffer, sizeof(aBuffer)));
+        }
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cZipLib.End();
+    }
+    while (SUCCEEDED(hRes) && cZipLib.GetAvailableData() > 0)
+    {
+        hRes = cOutput.Write(aBuffer, cZipLib.GetData(aBuffer, sizeof(aBuffer)));
+    }
+    cTimer.Mark();
+
+    *lpdwElapsedMs = cTimer.GetElapsedTimeMs();
+    return hRes;
+}
+
+static HRESULT VerifyCompressedData(_In_ MX::CCircularBuffer &cCompressed, _In_ LPBYTE lpData, _In_ SIZE_T nDataSize)
+{
+    MX::CZipLib cZipLib(TRUE);
+    BYTE aBuffer[32768];
+    LPBYTE aPtrs[2];
+    SIZE_T aSizes[2], nOffset;
+    HRESULT hRes;
+
+    // the circular buffer may hold the compressed data in two pieces
+    cCompressed.GetReadPtr(&aPtrs[0], &aSizes[0], &aPtrs[1], &aSizes[1]);
+
+    nOffset = 0;
+    hRes = cZipLib.BeginDecompress();
+    for (SIZE_T nIndex = 0; SUCCEEDED(hRes) && nIndex < 2; nIndex++)
+    {
+        LPBYTE lpPtr = aPtrs[nIndex];
+        SIZE_T nSize = aSizes[nIndex];
+
+        while (SUCCEEDED(hRes) && nSize > 0)
+        {
+            SIZE_T nToDecompress = (nSize > ZIP_CHUNK_SIZE) ? ZIP_CHUNK_SIZE : nSize;
+
+            hRes = cZipLib.DecompressStream(lpPtr, nToDecompress);
+            lpPtr += nToDecompress;
+            nSize -= nToDecompress;
+            while (SUCCEEDED(hRes) && cZipLib.GetAvailableData() > 0)
+            {
+                SIZE_T nRead = cZipLib.GetData(aBuffer, sizeof(aBuffer));
+
+                if (nRead > nDataSize - nOffset || ::MxMemCompare(aBuffer, lpData + nOffset, nRead) != 0)
+                {
+                    hRes = MX_E_InvalidData;
+                    break;
+                }
+                nOffset += nRead;
+            }
+        }
+    }
+    if (SUCCEEDED(hRes) && (cZipLib.HasDecompressEndOfStreamBeenReached() == FALSE || nOffset != nDataSize))
+    {
+        hRes = MX_E_InvalidData;
+    }
+    cZipLib.End();
+    return hRes;
+}
+
+static HRESULT BuildBenchmarkArchive(_In_z_ LPCWSTR szFileNameW, _In_ ZIP_READER_CONTEXT *lpCtx)
+{
+    MX::CZipFile cZipFile;
+    LPBYTE lpData;
+    SIZE_T nDataSize;
+    ULONG nSeed = 0x2545F491UL;
+    HRESULT hRes;
+
+    // all entries are slices of the same log-like buffer, between 1KB and 64KB each
+    nDataSize = 1048576;
+    lpData = BuildLogLikeData(nDataSize);
+    if (lpData == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    hRes = cZipFile.CreateArchive(szFileNameW);
+    for (DWORD i = 0; SUCCEEDED(hRes) && i < lpCtx->dwFilesCount; i++)
+    {
+        MX::TAutoRefCounted<MX::CMemoryStream> cStream;
+        SIZE_T nOffset, nSize, nWritten;
+
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+
+        nSize = 1024 + (SIZE_T)(nSeed % 64512);
+        nOffset = (SIZE_T)(nSeed >> 7) % (nDataSize - nSize);
+
+        if (lpCtx->lpNamesA[i].Format("static/assets/%04lu/file-%lu.txt", i / 256, i) == FALSE)
+        {
+            hRes = E_OUTOFMEMORY;
+            break;
+        }
+        hRes = MX::Utf8_Decode(lpCtx->lpNamesW[i], (LPCSTR)(lpCtx->lpNamesA[i]));
+        if (FAILED(hRes))
+        {
+            break;
+        }
+
+        cStream.Attach(MX_DEBUG_NEW MX::CMemoryStream());
+        if (!cStream)
+        {
+            hRes = E_OUTOFMEMORY;
+            break;
+        }
+        hRes = cStream->Create(nSize, FALSE);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStream->Write(lpData + nOffset, nSize, nWritten);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cZipFile.AddStream((LPCWSTR)(lpCtx->lpNamesW[i]), cStream.Get());
+        }
+    }
+    cZipFile.CloseArchive();
+
+    MX_FREE(lpData);
+    return hRes;
+}
+
+static HRESULT VerifyStoredEntries(_In_z_ LPCWSTR szFileNameW)
+{
+    MX::TAutoRefCounted<MX::CZipArchiveReader> cReader;
+    MX::TAutoRefCounted<MX::CStream> cStream;
+    MX::CStringW cStrStoredFileNameW;
+    MX::CStringA cStrContentA;
+    HRESULT hRes;
+
+    if (cStrStoredFileNameW.Copy(szFileNameW) == FALSE || cStrStoredFileNameW.Concat(L".stored.zip") == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = WriteStoredArchive((LPCWSTR)cStrStoredFileNameW);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    cReader.Attach(MX_DEBUG_NEW MX::CZipArchiveReader());
+    if (!cReader)
+    {
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+    hRes = cReader->Open((LPCWSTR)cStrStoredFileNameW);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    // a stored entry whose data does not match its CRC must fail like a deflated one
+    hRes = cReader->OpenEntry(cReader->FindEntry("bad.txt"), &cStream);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = ReadWholeEntry(cStream.Get(), cStrContentA);
+        cStream.Release();
+    }
+    if (hRes != MX_E_InvalidData)
+    {
+        wprintf_s(L"Error: A corrupted stored entry was not detected (0x%08X).", hRes);
+        hRes = MX_E_InvalidData;
+        goto done;
+    }
+
+    // an open stream must survive the reader being closed
+    hRes = cReader->OpenEntry(cReader->FindEntry("good.txt"), &cStream);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    cReader->Close();
+    cReader.Release();
+    hRes = ReadWholeEntry(cStream.Get(), cStrContentA);
+    cStream.Release();
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    if (MX::StrCompareA((LPCSTR)cStrContentA, ZIP_STORED_CONTENT) != 0)
+    {
+        wprintf_s(L"Error: Stored entry content mismatch.");
+        hRes = MX_E_InvalidData;
+        goto done;
+    }
+
+done:
+    cStream.Release();
+    cReader.Release();
+    if (cStrStoredFileNameW.IsEmpty() == FALSE)
+    {
+        ::DeleteFileW((LPCWSTR)cStrStoredFileNameW);
+    }
+    return hRes;
+}
+
+static HRESULT WriteStoredArchive(_In_z_ LPCWSTR szFileNameW)
+{
+    BYTE aLocal[1024], aCentral[256], aEocd[22];
+    SIZE_T nLocalSize, nCentralSize;
+    ULONG nCrc32;
+    DWORD dwWritten;
+    HANDLE hFile;
+    BOOL b;
+
+    nCrc32 = MX::Crc32(0, ZIP_STORED_CONTENT, MX_ARRAYLEN(ZIP_STORED_CONTENT) - 1);
+    nLocalSize = AddStoredEntry(aLocal, aCentral, "good.txt", nCrc32, 0);
+    nLocalSize += AddStoredEntry(aLocal + nLocalSize, aCentral + 46 + 8, "bad.txt", nCrc32 ^ 1, (DWORD)nLocalSize);
+    nCentralSize = 46 + 8 + 46 + 7;
+
+    // end of central directory record
+    ::MxMemSet(aEocd, 0, sizeof(aEocd));
+    *((DWORD UNALIGNED *)(aEocd + 0)) = 0x06054B50UL;
+    *((WORD UNALIGNED *)(aEocd + 8)) = 2;
+    *((WORD UNALIGNED *)(aEocd + 10)) = 2;
+    *((DWORD UNALIGNED *)(aEocd + 12)) = (DWORD)nCentralSize;
+    *((DWORD UNALIGNED *)(aEocd + 16)) = (DWORD)nLocalSize;
+
+    hFile = ::CreateFileW(szFileNameW, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return MX_HRESULT_FROM_LASTERROR();
+    }
+    b = ::WriteFile(hFile, aLocal, (DWORD)nLocalSize, &dwWritten, NULL);
+    if (b != FALSE)
+    {
+        b = ::WriteFile(hFile, aCentral, (DWORD)nCentralSize, &dwWritten, NULL);
+    }
+    if (b != FALSE)
+    {
+        b = ::WriteFile(hFile, aEocd, (DWORD)sizeof(aEocd), &dwWritten, NULL);
+    }
+    ::CloseHandle(hFile);
+    return (b != FALSE) ? S_OK : MX_HRESULT_FROM_LASTERROR();
+}
+
+static SIZE_T AddStoredEntry(_Out_ LPBYTE lpLocal, _Out_ LPBYTE lpCentral, _In_z_ LPCSTR szNameA,
+                             _In_ ULONG nCrc32, _In_ DWORD dwLocalOffset)
+{
+    SIZE_T nNameLen = MX::StrLenA(szNameA);
+    SIZE_T nDataLen = MX_ARRAYLEN(ZIP_STORED_CONTENT) - 1;
+
+    // local file header followed by the name and the data
+    ::MxMemSet(lpLocal, 0, 30);
+    *((DWORD UNALIGNED *)(lpLocal + 0)) = 0x04034B50UL;
+    *((WORD UNALIGNED *)(lpLocal + 4)) = 10;
+    *((DWORD UNALIGNED *)(lpLocal + 14)) = nCrc32;
+    *((DWORD UNALIGNED *)(lpLocal + 18)) = (DWORD)nDataLen;
+    *((DWORD UNALIGNED *)(lpLocal + 22)) = (DWORD)nDataLen;
+    *((WORD UNALIGNED *)(lpLocal + 26)) = (WORD)nNameLen;
+    ::MxMemCopy(lpLocal + 30, szNameA, nNameLen);
+    ::MxMemCopy(lpLocal + 30 + nNameLen, ZIP_STORED_CONTENT, nDataLen);
+
+    // central directory header followed by the name
+    ::MxMemSet(lpCentral, 0, 46);
+    *((DWORD UNALIGNED *)(lpCentral + 0)) = 0x02014B50UL;
+    *((WORD UNALIGNED *)(lpCentral + 4)) = 10;
+    *((WORD UNALIGNED *)(lpCentral + 6)) = 10;
+    *((DWORD UNALIGNED *)(lpCentral + 16)) = nCrc32;
+    *((DWORD UNALIGNED *)(lpCentral + 20)) = (DWORD)nDataLen;
+    *((DWORD UNALIGNED *)(lpCentral + 24)) = (DWORD)nDataLen;
+    *((WORD UNALIGNED *)(lpCentral + 28)) = (WORD)nNameLen;
+    *((DWORD UNALIGNED *)(lpCentral + 42)) = dwLocalOffset;
+    ::MxMemCopy(lpCentral + 46, szNameA, nNameLen);
+
+    return 30 + nNameLen + nDataLen;
+}
+
+static HRESULT ReadWholeEntry(_In_ MX::CStream *lpStream, _Out_ MX::CStringA &cStrContentA)
+{
+    CHAR szBufA[16];
+    SIZE_T nRead;
+    HRESULT hRes;
+
+    // small reads so the checksum is built across several calls
+    cStrContentA.Empty();
+    for (;;)
+    {
+        hRes = lpStream->Read(szBufA, sizeof(szBufA), nRead);
+        if (FAILED(hRes))
+        {
+            return (hRes == MX_E_EndOfFileReached) ? S_OK : hRes;
+        }
+        if (cStrContentA.ConcatN(szBufA, nRead) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+}
+
+static HRESULT RunZipReaderPhase(_In_z_ LPCWSTR szNameW, _In_ DWORD dwThreadsCount, _In_ lpfnBenchmarkJob lpfnJob,
+                                 _In_ ZIP_READER_CONTEXT *lpCtx, _In_ BOOL bThroughput)
+{
+    ULONGLONG nOps;
+    DWORD dwElapsedMs;
+    HRESULT hRes;
+
+    _InterlockedExchange(&(lpCtx->nErrors), 0);
+    hRes = RunBenchmarkThreads(dwThreadsCount, GetBenchmarkDurationMs(), lpfnJob, lpCtx, &nOps, &dwElapsedMs);
+    if (SUCCEEDED(hRes) && __InterlockedRead(&(lpCtx->nErrors)) != 0)
+    {
+        hRes = MX_E_InvalidData;
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    if (bThroughput == FALSE)
+    {
+        PrintBenchmarkResult(szNameW, nOps, dwElapsedMs);
+    }
+    else
+    {
+        if (dwElapsedMs == 0)
+        {
+            dwElapsedMs = 1;
+        }
+        wprintf_s(L"%s: %I64u bytes in %lums (%.1f MB/s)\n", szNameW, nOps, dwElapsedMs,
+                  ((double)nOps / 1048576.0) * 1000.0 / (double)dwElapsedMs);
+    }
+    return S_OK;
+}
+
+static ULONGLONG ZipFileLookupJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    ZIP_READER_CONTEXT *lpCtx = (ZIP_READER_CONTEXT *)lpContext;
+    ULONG nSeed = 0x9E3779B9UL * (dwThreadIndex + 1);
+    ULONGLONG nOps = 0;
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+
+        if (FAILED(lpCtx->lpZipFile->OpenFile((LPCWSTR)(lpCtx->lpNamesW[nSeed % lpCtx->dwFilesCount]))))
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+        lpCtx->lpZipFile->CloseFile();
+        nOps++;
+    }
+    return nOps;
+}
+
+static ULONGLONG ZipReaderLookupJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    ZIP_READER_CONTEXT *lpCtx = (ZIP_READER_CONTEXT *)lpContext;
+    ULONG nSeed = 0x9E3779B9UL * (dwThreadIndex + 1);
+    ULONGLONG nOps = 0;
+
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        MX::CStringA &cStrNameA = lpCtx->lpNamesA[nSeed % lpCtx->dwFilesCount];
+
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+
+        if (lpCtx->lpReader->FindEntry((LPCSTR)cStrNameA, cStrNameA.GetLength()) == NULL)
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+        nOps++;
+    }
+    return nOps;
+}
+
+static ULONGLONG ZipFileReadJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    ZIP_READER_CONTEXT *lpCtx = (ZIP_READER_CONTEXT *)lpContext;
+    MX::TAutoFreePtr<BYTE> aBuffer;
+    ULONG nSeed = 0x9E3779B9UL * (dwThreadIndex + 1);
+    ULONGLONG nBytes = 0;
+
+    aBuffer.Attach((LPBYTE)MX_MALLOC(ZIP_READ_BUFFER_SIZE));
+    if (!aBuffer)
+    {
+        _InterlockedIncrement(&(lpCtx->nErrors));
+        return 0;
+    }
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        SIZE_T nRead;
+        HRESULT hRes;
+
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+
+        hRes = lpCtx->lpZipFile->OpenFile((LPCWSTR)(lpCtx->lpNamesW[nSeed % lpCtx->dwFilesCount]));
+        while (SUCCEEDED(hRes))
+        {
+            hRes = lpCtx->lpZipFile->Read(aBuffer.Get(), ZIP_READ_BUFFER_SIZE, &nRead);
+            if (SUCCEEDED(hRes))
+            {
+                nBytes += (ULONGLONG)nRead;
+                if (nRead < ZIP_READ_BUFFER_SIZE)
+                {
+                    break;
+                }
+            }
+        }
+        lpCtx->lpZipFile->CloseFile();
+        if (FAILED(hRes) && hRes != MX_E_EndOfFileReached)
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+    }
+    return nBytes;
+}
+
+static ULONGLONG ZipReaderReadJob(_In_opt_ LPVOID lpContext, _In_ DWORD dwThreadIndex, _In_ LONG volatile *lpnStop)
+{
+    ZIP_READER_CONTEXT *lpCtx = (ZIP_READER_CONTEXT *)lpContext;
+    MX::TAutoFreePtr<BYTE> aBuffer;
+    ULONG nSeed = 0x9E3779B9UL * (dwThreadIndex + 1);
+    ULONGLONG nBytes = 0;
+
+    aBuffer.Attach((LPBYTE)MX_MALLOC(ZIP_READ_BUFFER_SIZE));
+    if (!aBuffer)
+    {
+        _InterlockedIncrement(&(lpCtx->nErrors));
+        return 0;
+    }
+    while (__InterlockedRead(lpnStop) == 0)
+    {
+        MX::CStringA &cStrNameA = lpCtx->lpNamesA[nSeed % lpCtx->dwFilesCount];
+        MX::TAutoRefCounted<MX::CStream> cStream;
+        SIZE_T nRead;
+        HRESULT hRes;
+
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+
+        hRes = lpCtx->lpReader->OpenEntry(lpCtx->lpReader->FindEntry((LPCSTR)cStrNameA, cStrNameA.GetLength()), &cStream);
+        while (SUCCEEDED(hRes))
+        {
+            hRes = cStream->Read(aBuffer.Get(), ZIP_READ_BUFFER_SIZE, nRead);
+            if (SUCCEEDED(hRes))
+            {
+                nBytes += (ULONGLONG)nRead;
+            }
+        }
+        if (hRes != MX_E_EndOfFileReached)
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            break;
+        }
+    }
+    return nBytes;
+}
@@ -0,0 +1,572 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestHttpJson.h"
+#include <Http\HttpBodyParserJSON.h>
+#include <Http\HttpCommon.h>
+#include <float.h>
+
+ //-----------------------------------------------------------
+
+#define JSON_PARSE_FLAGS (rapidjson::kParseValidateEncodingFlag | rapidjson::kParseNanAndInfFlag |                   \
+                          rapidjson::kParseFullPrecisionFlag | rapidjson::kParseTrailingCommasFlag |                 \
+                          rapidjson::kParseEscapedApostropheFlag)
+
+#define JSON_TEST_MAX_DEPTH 128
+
+#define JSON_CASE(_x) { _x, sizeof(_x) - 1 }
+
+//-----------------------------------------------------------
+
+typedef struct tagJSON_CASE
+{
+    LPCSTR szJsonA;
+    SIZE_T nLength;
+} JSON_CASE;
+
+typedef rapidjson::Writer<rapidjson::StringBuffer, rapidjson::UTF8<>, rapidjson::UTF8<>, rapidjson::CrtAllocator,
+                          rapidjson::kWriteNanAndInfFlag> JsonWriter;
+
+//-----------------------------------------------------------
+
+static const JSON_CASE aJsonCases[] = {
+    // scalars at the root level
+    JSON_CASE("1"),
+    JSON_CASE("-12.5e+3"),
+    JSON_CASE(" true "),
+    JSON_CASE("null"),
+    JSON_CASE("-Infinity"),
+    JSON_CASE("NaN"),
+
+    // strings with UTF-8 sequences and escapes that end up split across chunks
+    JSON_CASE("\"h\\u00e9llo \\ud83d\\ude00 \\\" \\\\ \\/ \\b\\f\\n\\r\\t\""),
+    JSON_CASE("\"\xC3\xA1\xE2\x82\xAC\xF0\x9F\x98\x80\""),
+    JSON_CASE("[\"it\\'s\",\"a\\\\\",\"\"]"),
+
+    // containers
+    JSON_CASE("{\"a\":1,\"b\":[1,2,3,],\"c\":{\"d\":null},}"),
+    JSON_CASE("{ \"k\" : \"v\" , \"x\" :[ ] ,\"y\":{ }}"),
+    JSON_CASE("[[[[]],{\"a\":{\"b\":{\"c\":[{}]}}}]]"),
+    JSON_CASE("\r\n[true,false,null]\r\n"),
+
+    // large and exponent numbers
+    JSON_CASE("[18446744073709551615,18446744073709551616,-9223372036854775808,-9223372036854775809]"),
+    JSON_CASE("[123456789012345678901234567890,4294967295,4294967296,-2147483649]"),
+    JSON_CASE("[1e308,1.7976931348623157e308,2.2250738585072014e-308,4.9e-324,1e-400,0.1,123.456E-7,-0.0]"),
+    JSON_CASE("[3.14159265358979323846264338327950288,0.30000000000000004,9007199254740993]"),
+
+    // invalid documents must be rejected the same way
+    JSON_CASE("[1,2"),
+    JSON_CASE("{\"a\" 1}"),
+    JSON_CASE("[1 2]"),
+    JSON_CASE("tru"),
+    JSON_CASE("[nul]"),
+    JSON_CASE("1 2"),
+    JSON_CASE("[1,,2]"),
+    JSON_CASE("\"\\u12\""),
+    JSON_CASE("\"\\ud83d\""),
+    JSON_CASE("{\"a\":1}x"),
+    JSON_CASE("[\"\xC3\"]"),
+    JSON_CASE("01"),
+    JSON_CASE("[-]"),
+    JSON_CASE("   "),
+    JSON_CASE("[1,\0 2]"),
+    JSON_CASE("\"a\0b\"")
+};
+
+//-----------------------------------------------------------
+
+static HRESULT TestChunkedBodies();
+static HRESULT TestNestingLimit();
+static HRESULT TestNumbers();
+static HRESULT TestEventCallback();
+
+static HRESULT ParseOneShot(_In_ LPCSTR szJsonA, _In_ SIZE_T nLength, _Out_ MX::CStringA &cStrSerializedA,
+                            _Out_ HRESULT *lphrParse);
+static HRESULT ParseStreamed(_In_ LPCSTR szJsonA, _In_ SIZE_T nLength, _In_ SIZE_T nFirstChunk, _In_ SIZE_T nChunkSize,
+                             _Out_ MX::CStringA &cStrSerializedA, _Out_ HRESULT *lphrParse);
+static HRESULT FeedBody(_In_ MX::CHttpBodyParserJSON *lpBodyParser, _In_ LPCSTR szJsonA, _In_ SIZE_T nLength,
+                        _In_ SIZE_T nFirstChunk, _In_ SIZE_T nChunkSize);
+static HRESULT FeedParser(_In_ MX::Internals::CHttpParser &cParser, _In_ LPCVOID lpData, _In_ SIZE_T nDataSize,
+                          _In_ MX::CHttpBodyParserBase *lpBodyParser);
+static HRESULT Serialize(_In_ const rapidjson::Value &v, _Out_ MX::CStringA &cStrSerializedA);
+static HRESULT CompareWithOneShot(_In_ LPCSTR szJsonA, _In_ SIZE_T nLength, _In_ SIZE_T nFirstChunk,
+                                  _In_ SIZE_T nChunkSize);
+
+static HRESULT OnJsonEvent(_In_ const MX::CHttpBodyParserJSON::EVENT &sEvent, _In_opt_ LPVOID lpUserParam);
+
+//-----------------------------------------------------------
+
+int TestHttpJson()
+{
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe HttpJson\n\n");
+        wprintf_s(L"Compares the streamed JSON body parser against a one-shot parse of the same document.\n");
+        return 1;
+    }
+
+    wprintf_s(L"Running chunked body tests... ");
+    hRes = TestChunkedBodies();
+    if (FAILED(hRes))
+    {
+on_error:
+        wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running nesting limit tests... ");
+    hRes = TestNestingLimit();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running number tests... ");
+    hRes = TestNumbers();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running event callback tests... ");
+    hRes = TestEventCallback();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestChunkedBodies()
+{
+    SIZE_T nCase, nSize;
+    HRESULT hRes;
+
+    for (nCase = 0; nCase < _countof(aJsonCases); nCase++)
+    {
+        const JSON_CASE &sCase = aJsonCases[nCase];
+
+        // feed the body in fixed size chunks, including one byte at a time
+        for (nSize = 1; nSize <= sCase.nLength; nSize++)
+        {
+            hRes = CompareWithOneShot(sCase.szJsonA, sCase.nLength, nSize, nSize);
+            if (FAILED(hRes))
+            {
+                wprintf_s(L"\nError: Case #%Iu fed in chunks of %Iu bytes differs.", nCase, nSize);
+                return hRes;
+            }
+        }
+
+        // split the body in two at every position
+        for (nSize = 1; nSize < sCase.nLength; nSize++)
+        {
+            hRes = CompareWithOneShot(sCase.szJsonA, sCase.nLength, nSize, sCase.nLength);
+            if (FAILED(hRes))
+            {
+                wprintf_s(L"\nError: Case #%Iu split at offset %Iu differs.", nCase, nSize);
+                return hRes;
+            }
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestNestingLimit()
+{
+    MX::CStringA cStrJsonA, cStrSerializedA;
+    DWORD dwDepth;
+    HRESULT hRes, hResParse;
+
+    for (dwDepth = JSON_TEST_MAX_DEPTH; dwDepth <= JSON_TEST_MAX_DEPTH + 1; dwDepth++)
+    {
+        cStrJsonA.Empty();
+        for (DWORD i = 0; i < dwDepth; i++)
+        {
+            if (cStrJsonA.Concat(((i & 1) != 0) ? "{\"k\":" : "[") == FALSE)
+            {
+                return E_OUTOFMEMORY;
+            }
+        }
+        for (DWORD i = dwDepth; i > 0; i--)
+        {
+            if (cStrJsonA.Concat(((i & 1) == 0) ? "}" : "]") == FALSE)
+            {
+                return E_OUTOFMEMORY;
+            }
+        }
+
+        if (dwDepth <= JSON_TEST_MAX_DEPTH)
+        {
+            hRes = CompareWithOneShot((LPCSTR)cStrJsonA, cStrJsonA.GetLength(), 1, 1);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = CompareWithOneShot((LPCSTR)cStrJsonA, cStrJsonA.GetLength(), 5, 5);
+            }
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        else
+        {
+            // one level too deep must be rejected even if the document is valid
+            hRes = ParseStreamed((LPCSTR)cStrJsonA, cStrJsonA.GetLength(), 3, 3, cStrSerializedA, &hResParse);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+            if (hResParse != MX_E_BadLength)
+            {
+                return E_FAIL;
+            }
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestNumbers()
+{
+    static const CHAR szJsonA[] = "[18446744073709551615,-9223372036854775808,4294967296,1.7976931348623157e308,"
+                                  "4.9406564584124654e-324,0.1,1E+2,-2.5e-3]";
+    MX::TAutoRefCounted<MX::CHttpBodyParserJSON> cBodyParser;
+    HRESULT hRes;
+
+    cBodyParser.Attach(MX_DEBUG_NEW MX::CHttpBodyParserJSON(MX::NullCallback(), NULL, 65536, JSON_TEST_MAX_DEPTH));
+    if (!cBodyParser)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = FeedBody(cBodyParser.Get(), szJsonA, sizeof(szJsonA) - 1, 1, 1);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    RAPIDJSON_TRY
+    {
+        const rapidjson::Document &d = cBodyParser->GetDocument();
+
+        if (d.IsArray() == false || d.Size() != 8)
+        {
+            return E_FAIL;
+        }
+        if (d[0].IsUint64() == false || d[0].IsInt64() != false || d[0].GetUint64() != 0xFFFFFFFFFFFFFFFFui64)
+        {
+            return E_FAIL;
+        }
+        if (d[1].IsInt64() == false || d[1].GetInt64() != (-9223372036854775807i64 - 1))
+        {
+            return E_FAIL;
+        }
+        if (d[2].IsInt64() == false || d[2].IsInt() != false || d[2].GetInt64() != 4294967296i64)
+        {
+            return E_FAIL;
+        }
+        if (d[3].IsDouble() == false || d[3].GetDouble() != DBL_MAX)
+        {
+            return E_FAIL;
+        }
+        if (d[4].IsDouble() == false || d[4].GetDouble() != 4.9406564584124654e-324)
+        {
+            return E_FAIL;
+        }
+        if (d[5].GetDouble() != 0.1 || d[6].GetDouble() != 100.0 || d[7].GetDouble() != -2.5e-3)
+        {
+            return E_FAIL;
+        }
+    }
+    RAPIDJSON_CATCH_RETURN
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestEventCallback()
+{
+    static const CHAR szJsonA[] = "{\"k\\u00e9\":[18446744073709551615,-1,42,2.5,\"a\\\"\xC3\xA1\",true,null,{}],"
+                                  "\"z\":false}";
+    static const CHAR szExpectedA[] = "O K(k\xC3\xA9) A U(18446744073709551615) I(-1) I(42) D(2.5) S(a\"\xC3\xA1) "
+                                      "B(1) N O o(0) a(8) K(z) B(0) o(2) ";
+    MX::CStringA cStrEventsA;
+    SIZE_T nSize;
+    HRESULT hRes;
+
+    for (nSize = 1; nSize <= sizeof(szJsonA) - 1; nSize++)
+    {
+        MX::TAutoRefCounted<MX::CHttpBodyParserJSON> cBodyParser;
+
+        cStrEventsA.Empty();
+        cBodyParser.Attach(MX_DEBUG_NEW MX::CHttpBodyParserJSON(MX_BIND_CALLBACK(&OnJsonEvent), &cStrEventsA, 65536,
+                                                               JSON_TEST_MAX_DEPTH));
+        if (!cBodyParser)
+        {
+            return E_OUTOFMEMORY;
+        }
+        hRes = FeedBody(cBodyParser.Get(), szJsonA, sizeof(szJsonA) - 1, nSize, nSize);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (cStrEventsA.GetLength() != sizeof(szExpectedA) - 1 ||
+            ::memcmp((LPCSTR)cStrEventsA, szExpectedA, sizeof(szExpectedA) - 1) != 0)
+        {
+            wprintf_s(L"\nError: Unexpected events with chunks of %Iu bytes.", nSize);
+            return E_FAIL;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT ParseOneShot(_In_ LPCSTR szJsonA, _In_ SIZE_T nLength, _Out_ MX::CStringA &cStrSerializedA,
+                            _Out_ HRESULT *lphrParse)
+{
+    rapidjson::Document d;
+
+    cStrSerializedA.Empty();
+    *lphrParse = MX_E_InvalidData;
+
+    RAPIDJSON_TRY
+    {
+        d.Parse<JSON_PARSE_FLAGS>(szJsonA, nLength);
+        if (d.HasParseError() != false)
+        {
+            return S_OK;
+        }
+    }
+    RAPIDJSON_CATCH_RETURN
+
+    *lphrParse = S_OK;
+    return Serialize(d, cStrSerializedA);
+}
+
+static HRESULT ParseStreamed(_In_ LPCSTR szJsonA, _In_ SIZE_T nLength, _In_ SIZE_T nFirstChunk, _In_ SIZE_T nChunkSize,
+                             _Out_ MX::CStringA &cStrSerializedA, _Out_ HRESULT *lphrParse)
+{
+    MX::TAutoRefCounted<MX::CHttpBodyParserJSON> cBodyParser;
+
+    cStrSerializedA.Empty();
+    *lphrParse = MX_E_InvalidData;
+
+    cBodyParser.Attach(MX_DEBUG_NEW MX::CHttpBodyParserJSON(MX::NullCallback(), NULL, 65536, JSON_TEST_MAX_DEPTH));
+    if (!cBodyParser)
+    {
+        return E_OUTOFMEMORY;
+    }
+    *lphrParse = FeedBody(cBodyParser.Get(), szJsonA, nLength, nFirstChunk, nChunkSize);
+    if (*lphrParse == E_OUTOFMEMORY)
+    {
+        return E_OUTOFMEMORY;
+    }
+    return (SUCCEEDED(*lphrParse)) ? Serialize(cBodyParser->GetDocument(), cStrSerializedA) : S_OK;
+}
+
+static HRESULT FeedBody(_In_ MX::CHttpBodyParserJSON *lpBodyParser, _In_ LPCSTR szJsonA, _In_ SIZE_T nLength,
+                        _In_ SIZE_T nFirstChunk, _In_ SIZE_T nChunkSize)
+{
+    MX::Internals::CHttpParser cParser(TRUE, NULL);
+    MX::CStringA cStrHeadersA;
+    SIZE_T nOffset, nToFeed;
+    HRESULT hRes;
+
+    if (cStrHeadersA.Format("POST /api HTTP/1.1\r\n"
+                            "Host: localhost\r\n"
+                            "Content-Type: application/json\r\n"
+                            "Content-Length: %Iu\r\n\r\n", nLength) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = FeedParser(cParser, (LPCSTR)cStrHeadersA, cStrHeadersA.GetLength(), lpBodyParser);
+    for (nOffset = 0; SUCCEEDED(hRes) && nOffset < nLength; nOffset += nToFeed)
+    {
+        nToFeed = (nOffset == 0) ? nFirstChunk : nChunkSize;
+        if (nToFeed > nLength - nOffset)
+        {
+            nToFeed = nLength - nOffset;
+        }
+        hRes = FeedParser(cParser, szJsonA + nOffset, nToFeed, lpBodyParser);
+    }
+    if (SUCCEEDED(hRes) && cParser.GetState() != MX::Internals::CHttpParser::eState::Done)
+    {
+        hRes = MX_E_InvalidData;
+    }
+
+    // done
+    return hRes;
+}
+
+static HRESULT FeedParser(_In_ MX::Internals::CHttpParser &cParser, _In_ LPCVOID lpData, _In_ SIZE_T nDataSize,
+                          _In_ MX::CHttpBodyParserBase *lpBodyParser)
+{
+    SIZE_T nUsed;
+    HRESULT hRes;
+
+    while (nDataSize > 0)
+    {
+        hRes = cParser.Parse(lpData, nDataSize, nUsed);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (cParser.GetState() == MX::Internals::CHttpParser::eState::BodyStart && cParser.GetBodyParser() == NULL)
+        {
+            hRes = cParser.SetBodyParser(lpBodyParser);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+        else if (nUsed == 0)
+        {
+            return MX_E_InvalidData;
+        }
+        lpData = (LPBYTE)lpData + nUsed;
+        nDataSize -= nUsed;
+    }
+    return S_OK;
+}
+
+static HRESULT Serialize(_In_ const rapidjson::Value &v, _Out_ MX::CStringA &cStrSerializedA)
+{
+    RAPIDJSON_TRY
+    {
+        rapidjson::StringBuffer cBuffer;
+        JsonWriter cWriter(cBuffer);
+
+        if (v.Accept(cWriter) == false)
+        {
+            return MX_E_InvalidData;
+        }
+        if (cStrSerializedA.CopyN(cBuffer.GetString(), cBuffer.GetSize()) == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+    RAPIDJSON_CATCH_RETURN
+
+    // done
+    return S_OK;
+}
+
+static HRESULT CompareWithOneShot(_In_ LPCSTR szJsonA, _In_ SIZE_T nLength, _In_ SIZE_T nFirstChunk,
+                                  _In_ SIZE_T nChunkSize)
+{
+    MX::CStringA cStrExpectedA, cStrActualA;
+    HRESULT hRes, hResExpected, hResActual;
+
+    hRes = ParseOneShot(szJsonA, nLength, cStrExpectedA, &hResExpected);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = ParseStreamed(szJsonA, nLength, nFirstChunk, nChunkSize, cStrActualA, &hResActual);
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // both must agree on the validity of the document and produce the same values
+    if (SUCCEEDED(hResExpected) != SUCCEEDED(hResActual))
+    {
+        return E_FAIL;
+    }
+    if (cStrExpectedA.GetLength() != cStrActualA.GetLength() ||
+        ::memcmp((LPCSTR)cStrExpectedA, (LPCSTR)cStrActualA, cStrActualA.GetLength()) != 0)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT OnJsonEvent(_In_ const MX::CHttpBodyParserJSON::EVENT &sEvent, _In_opt_ LPVOID lpUserParam)
+{
+    MX::CStringA &cStrEventsA = *((MX::CStringA *)lpUserParam);
+    BOOL b;
+
+    switch (sEvent.nType)
+    {
+        case MX::CHttpBodyParserJSON::eEventType::Null:
+            b = cStrEventsA.Concat("N ");
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::Boolean:
+            b = cStrEventsA.AppendFormat("B(%d) ", ((sEvent.bValue != FALSE) ? 1 : 0));
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::Integer:
+            b = cStrEventsA.AppendFormat("I(%I64d) ", sEvent.llValue);
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::UnsignedInteger:
+            b = cStrEventsA.AppendFormat("U(%I64u) ", sEvent.ullValue);
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::Double:
+            b = cStrEventsA.AppendFormat("D(%g) ", sEvent.nDblValue);
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::String:
+        case MX::CHttpBodyParserJSON::eEventType::Key:
+            b = cStrEventsA.AppendFormat("%c(%.*s) ",
+                                         ((sEvent.nType == MX::CHttpBodyParserJSON::eEventType::Key) ? 'K' : 'S'),
+                                         (int)(sEvent.sString.nLength), sEvent.sString.szValueA);
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::StartObject:
+            b = cStrEventsA.Concat("O ");
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::EndObject:
+            b = cStrEventsA.AppendFormat("o(%lu) ", sEvent.nItemsCount);
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::StartArray:
+            b = cStrEventsA.Concat("A ");
+            break;
+
+        case MX::CHttpBodyParserJSON::eEventType::EndArray:
+            b = cStrEventsA.AppendFormat("a(%lu) ", sEvent.nItemsCount);
+            break;
+
+        default:
+            return E_FAIL;
+    }
+    return (b != FALSE) ? S_OK : E_OUTOFMEMORY;
+}
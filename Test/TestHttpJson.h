@@ -17,21 +17,11 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#include "InitOpenSSL.h"
+#pragma once
 
- //-----------------------------------------------------------
-
-namespace MX {
-
-namespace Internals {
-
-namespace OpenSSL {
+#include "Test.h"
+#include "Console.h"
 
-HRESULT InitializeCRC32Provider();
-VOID FinalizeCRC32Provider();
-
-} // namespace OpenSSL
-
-} // namespace Internals
+ //-----------------------------------------------------------
 
-} // namespace MX
+int TestHttpJson();
@@ -0,0 +1,543 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestHttpRange.h"
+#include "HttpTestClient.h"
+#include <Http\HttpServer.h>
+#include <MemoryStream.h>
+
+ //-----------------------------------------------------------
+
+#define RANGE_TEST_DEFAULT_PORT 8089
+#define RANGE_TEST_ENTITY_SIZE 1048576
+#define RANGE_TEST_BUFFER_SIZE (RANGE_TEST_ENTITY_SIZE + 65536)
+#define RANGE_TEST_SEEKS_COUNT 64
+#define RANGE_TEST_SEEK_WINDOW 32768
+
+#define RANGE_TEST_ETAG "mx-range-test"
+
+//-----------------------------------------------------------
+
+typedef HttpTestClient::RESPONSE RANGE_RESPONSE;
+
+using HttpTestClient::HasHeader;
+
+//-----------------------------------------------------------
+
+static HRESULT CreateEntity(_Out_ MX::CMemoryStream **lplpStream);
+static BYTE GetEntityByte(_In_ SIZE_T nOffset);
+static BOOL CheckEntityBytes(_In_ LPBYTE lpData, _In_ SIZE_T nOffset, _In_ SIZE_T nLength);
+
+static VOID OnRangeRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest);
+
+static HRESULT TestSimpleRanges(_In_ SOCKET sck, _In_ LPBYTE lpBuffer);
+static HRESULT TestSeekingClient(_In_ SOCKET sck, _In_ LPBYTE lpBuffer);
+static HRESULT TestMultipleRanges(_In_ SOCKET sck, _In_ LPBYTE lpBuffer);
+static HRESULT TestConditionalRanges(_In_ SOCKET sck, _In_ LPBYTE lpBuffer);
+
+static HRESULT DoRequest(_In_ SOCKET sck, _In_z_ LPCSTR szExtraHeadersA, _In_ LPBYTE lpBuffer,
+                         _Out_ RANGE_RESPONSE *lpResponse);
+
+//-----------------------------------------------------------
+
+static MX::CMemoryStream *lpEntityStream = NULL;
+
+//-----------------------------------------------------------
+
+int TestHttpRange()
+{
+    MX::CIoCompletionPortThreadPool cDispatcherPool;
+    MX::CSockets cSckMgr(cDispatcherPool);
+    MX::CHttpServer cHttpServer(cSckMgr);
+    MX::TAutoRefCounted<MX::CMemoryStream> cEntity;
+    MX::TAutoFreePtr<BYTE> aBuffer;
+    SOCKET sck = INVALID_SOCKET;
+    DWORD dwPort;
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe HttpRange [options]\n\n");
+        wprintf_s(L"Where 'options' can be:\n");
+        wprintf_s(L"    /port #: Port to use for the loopback server. Defaults to %lu.\n", RANGE_TEST_DEFAULT_PORT);
+        return 1;
+    }
+    if (FAILED(GetCmdLineParamUInt(L"port", &dwPort)) || dwPort < 1 || dwPort > 65535)
+    {
+        dwPort = RANGE_TEST_DEFAULT_PORT;
+    }
+
+    hRes = CreateEntity(&cEntity);
+    if (SUCCEEDED(hRes))
+    {
+        aBuffer.Attach((LPBYTE)MX_MALLOC(RANGE_TEST_BUFFER_SIZE));
+        if (!aBuffer)
+        {
+            hRes = E_OUTOFMEMORY;
+        }
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)hRes;
+    }
+    lpEntityStream = cEntity.Get();
+
+    hRes = cDispatcherPool.Initialize();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cSckMgr.Initialize();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        cHttpServer.SetRequestCompletedCallback(MX_BIND_CALLBACK(&OnRangeRequestCompleted));
+
+        hRes = cHttpServer.StartListening("127.0.0.1", MX::CSockets::eFamily::IPv4, (int)dwPort);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = HttpTestClient::Connect(dwPort, &sck);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Cannot start the HTTP server on port %lu [0x%08X].\n", dwPort, hRes);
+        lpEntityStream = NULL;
+        return (int)hRes;
+    }
+
+    wprintf_s(L"Running single range tests... ");
+    hRes = TestSimpleRanges(sck, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+on_error:
+        wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        ::closesocket(sck);
+        cHttpServer.StopListening();
+        lpEntityStream = NULL;
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running seeking client tests... ");
+    hRes = TestSeekingClient(sck, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running multiple ranges tests... ");
+    hRes = TestMultipleRanges(sck, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running conditional range tests... ");
+    hRes = TestConditionalRanges(sck, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    ::closesocket(sck);
+    cHttpServer.StopListening();
+    lpEntityStream = NULL;
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT CreateEntity(_Out_ MX::CMemoryStream **lplpStream)
+{
+    MX::TAutoRefCounted<MX::CMemoryStream> cStream;
+    LPBYTE p;
+    SIZE_T i, nWritten;
+    HRESULT hRes;
+
+    *lplpStream = NULL;
+
+    cStream.Attach(MX_DEBUG_NEW MX::CMemoryStream());
+    if (!cStream)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = cStream->Create(RANGE_TEST_ENTITY_SIZE, FALSE);
+    if (SUCCEEDED(hRes))
+    {
+        BYTE aChunk[4096];
+
+        for (i = 0; SUCCEEDED(hRes) && i < RANGE_TEST_ENTITY_SIZE; i += sizeof(aChunk))
+        {
+            for (p = aChunk; p < aChunk + sizeof(aChunk); p++)
+            {
+                *p = GetEntityByte(i + (SIZE_T)(p - aChunk));
+            }
+            hRes = cStream->Write(aChunk, sizeof(aChunk), nWritten);
+        }
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // done
+    *lplpStream = cStream.Detach();
+    return S_OK;
+}
+
+static BYTE GetEntityByte(_In_ SIZE_T nOffset)
+{
+    // NOTE: Mixing the upper bits makes a window read at the wrong offset easy to spot.
+    return (BYTE)((nOffset * 31) ^ (nOffset >> 9));
+}
+
+static BOOL CheckEntityBytes(_In_ LPBYTE lpData, _In_ SIZE_T nOffset, _In_ SIZE_T nLength)
+{
+    SIZE_T i;
+
+    for (i = 0; i < nLength; i++)
+    {
+        if (lpData[i] != GetEntityByte(nOffset + i))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+//-----------------------------------------------------------
+
+static VOID OnRangeRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    MX::CHttpHeaderRespETag *lpETagHeader;
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(lpHttp);
+
+    // validators must be set before so "If-Range" can be evaluated
+    hRes = lpRequest->AddResponseHeader<MX::CHttpHeaderRespETag>(&lpETagHeader);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpETagHeader->SetTag(RANGE_TEST_ETAG);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->AddResponseHeader("Content-Type", "video/mp4");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendStreamRange(lpEntityStream);
+    }
+    lpRequest->End(hRes);
+    return;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestSimpleRanges(_In_ SOCKET sck, _In_ LPBYTE lpBuffer)
+{
+    RANGE_RESPONSE sResponse;
+    HRESULT hRes;
+
+    // no range at all
+    hRes = DoRequest(sck, "", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || sResponse.nBodyLen != RANGE_TEST_ENTITY_SIZE ||
+        HasHeader(&sResponse, "\r\nAccept-Ranges: bytes\r\n") == FALSE ||
+        CheckEntityBytes(sResponse.lpBody, 0, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // open ended range from the start, the way players open a file
+    hRes = DoRequest(sck, "Range: bytes=0-\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || sResponse.nBodyLen != RANGE_TEST_ENTITY_SIZE ||
+        HasHeader(&sResponse, "\r\nContent-Range: bytes 0-1048575/1048576\r\n") == FALSE ||
+        CheckEntityBytes(sResponse.lpBody, 0, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // suffix range used to read a trailing index
+    hRes = DoRequest(sck, "Range: bytes=-1000\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || sResponse.nBodyLen != 1000 ||
+        HasHeader(&sResponse, "\r\nContent-Range: bytes 1047576-1048575/1048576\r\n") == FALSE ||
+        CheckEntityBytes(sResponse.lpBody, RANGE_TEST_ENTITY_SIZE - 1000, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // a range ending past the entity is clipped
+    hRes = DoRequest(sck, "Range: bytes=1048000-2000000\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || sResponse.nBodyLen != 576 ||
+        CheckEntityBytes(sResponse.lpBody, 1048000, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // unsatisfiable
+    hRes = DoRequest(sck, "Range: bytes=2000000-\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 416 || sResponse.nBodyLen != 0 ||
+        HasHeader(&sResponse, "\r\nContent-Range: bytes */1048576\r\n") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestSeekingClient(_In_ SOCKET sck, _In_ LPBYTE lpBuffer)
+{
+    RANGE_RESPONSE sResponse;
+    CHAR szHeaderA[128];
+    ULONG nSeed = 0x2545F491UL;
+    SIZE_T i, nOffset, nLength;
+    HRESULT hRes;
+
+    // jump around the entity like a player scrubbing through a video
+    for (i = 0; i < RANGE_TEST_SEEKS_COUNT; i++)
+    {
+        nSeed = nSeed * 1103515245UL + 12345UL;
+        nOffset = (SIZE_T)((nSeed >> 4) % RANGE_TEST_ENTITY_SIZE);
+        nLength = RANGE_TEST_SEEK_WINDOW;
+        if (nLength > RANGE_TEST_ENTITY_SIZE - nOffset)
+        {
+            nLength = RANGE_TEST_ENTITY_SIZE - nOffset;
+        }
+
+        _snprintf_s(szHeaderA, _countof(szHeaderA), _TRUNCATE, "Range: bytes=%Iu-%Iu\r\n", nOffset,
+                    nOffset + nLength - 1);
+        hRes = DoRequest(sck, szHeaderA, lpBuffer, &sResponse);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (sResponse.nStatus != 206 || sResponse.nBodyLen != nLength ||
+            CheckEntityBytes(sResponse.lpBody, nOffset, nLength) == FALSE)
+        {
+            return E_FAIL;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestMultipleRanges(_In_ SOCKET sck, _In_ LPBYTE lpBuffer)
+{
+    static const struct {
+        SIZE_T nStart, nEnd;
+    } aParts[2] = { { 100, 199 }, { 300, 399 } };
+    RANGE_RESPONSE sResponse;
+    CHAR szPartHeaderA[128];
+    LPCSTR szBoundaryA, szPartA;
+    SIZE_T i, nBoundaryLen;
+    HRESULT hRes;
+
+    // two disjoint ranges become a multipart response
+    hRes = DoRequest(sck, "Range: bytes=300-399,100-199\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || HasHeader(&sResponse, "\r\nContent-Range:") != FALSE)
+    {
+        return E_FAIL;
+    }
+    szBoundaryA = MX::StrFindA(sResponse.szHeadersA, "\r\nContent-Type: multipart/byteranges; boundary=", FALSE, TRUE);
+    if (szBoundaryA == NULL)
+    {
+        return E_FAIL;
+    }
+    szBoundaryA += 47;
+    if (*szBoundaryA == '"')
+    {
+        szBoundaryA++;
+    }
+    for (nBoundaryLen = 0; szBoundaryA[nBoundaryLen] != '"' && szBoundaryA[nBoundaryLen] != '\r' &&
+                           szBoundaryA[nBoundaryLen] != 0; nBoundaryLen++);
+    if (nBoundaryLen == 0)
+    {
+        return E_FAIL;
+    }
+
+    // NOTE: The body is NUL terminated by DoRequest so text searches stop at the end.
+    szPartA = (LPCSTR)(sResponse.lpBody);
+    for (i = 0; i < MX_ARRAYLEN(aParts); i++)
+    {
+        szPartA = MX::StrFindA(szPartA, "--");
+        if (szPartA == NULL || MX::StrNCompareA(szPartA + 2, szBoundaryA, nBoundaryLen) != 0)
+        {
+            return E_FAIL;
+        }
+        _snprintf_s(szPartHeaderA, _countof(szPartHeaderA), _TRUNCATE,
+                    "Content-Type: video/mp4\r\nContent-Range: bytes %Iu-%Iu/%lu\r\n\r\n", aParts[i].nStart,
+                    aParts[i].nEnd, RANGE_TEST_ENTITY_SIZE);
+        szPartA += 2 + nBoundaryLen + 2;
+        if (MX::StrNCompareA(szPartA, szPartHeaderA, MX::StrLenA(szPartHeaderA)) != 0)
+        {
+            return E_FAIL;
+        }
+        szPartA += MX::StrLenA(szPartHeaderA);
+        if (CheckEntityBytes((LPBYTE)szPartA, aParts[i].nStart, aParts[i].nEnd - aParts[i].nStart + 1) == FALSE)
+        {
+            return E_FAIL;
+        }
+        szPartA += aParts[i].nEnd - aParts[i].nStart + 1;
+        if (szPartA[0] != '\r' || szPartA[1] != '\n')
+        {
+            return E_FAIL;
+        }
+    }
+    if (MX::StrNCompareA(szPartA + 4, szBoundaryA, nBoundaryLen) != 0 ||
+        MX::StrCompareA(szPartA + 4 + nBoundaryLen, "--\r\n") != 0)
+    {
+        return E_FAIL;
+    }
+
+    // overlapping and adjacent ranges are coalesced into a single one
+    hRes = DoRequest(sck, "Range: bytes=50-149,0-99,150-199\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || sResponse.nBodyLen != 200 ||
+        HasHeader(&sResponse, "\r\nContent-Range: bytes 0-199/1048576\r\n") == FALSE ||
+        CheckEntityBytes(sResponse.lpBody, 0, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // unsatisfiable sets are dropped as long as one remains
+    hRes = DoRequest(sck, "Range: bytes=5000000-5000100,10-19\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || sResponse.nBodyLen != 10 ||
+        CheckEntityBytes(sResponse.lpBody, 10, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestConditionalRanges(_In_ SOCKET sck, _In_ LPBYTE lpBuffer)
+{
+    RANGE_RESPONSE sResponse;
+    HRESULT hRes;
+
+    // the client still has the same entity
+    hRes = DoRequest(sck, "Range: bytes=1000-1999\r\nIf-Range: \"" RANGE_TEST_ETAG "\"\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || sResponse.nBodyLen != 1000 ||
+        CheckEntityBytes(sResponse.lpBody, 1000, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // the entity changed so the whole of it must be sent
+    hRes = DoRequest(sck, "Range: bytes=1000-1999\r\nIf-Range: \"stale-tag\"\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || sResponse.nBodyLen != RANGE_TEST_ENTITY_SIZE ||
+        CheckEntityBytes(sResponse.lpBody, 0, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // same for multiple ranges, which must not be answered as "multipart/byteranges"
+    hRes = DoRequest(sck, "Range: bytes=100-199,5000-5999,70000-\r\nIf-Range: \"stale-tag\"\r\n", lpBuffer,
+                     &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || sResponse.nBodyLen != RANGE_TEST_ENTITY_SIZE ||
+        HasHeader(&sResponse, "\r\nContent-Type: video/mp4\r\n") == FALSE ||
+        CheckEntityBytes(sResponse.lpBody, 0, sResponse.nBodyLen) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    hRes = DoRequest(sck, "Range: bytes=100-199,5000-5999\r\nIf-Range: \"" RANGE_TEST_ETAG "\"\r\n", lpBuffer,
+                     &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 ||
+        HasHeader(&sResponse, "\r\nContent-Type: multipart/byteranges; boundary=") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // a date cannot match because there is no "Last-Modified" header
+    hRes = DoRequest(sck, "Range: bytes=1000-1999\r\nIf-Range: Fri, 31 Dec 2100 23:59:59 GMT\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || sResponse.nBodyLen != RANGE_TEST_ENTITY_SIZE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT DoRequest(_In_ SOCKET sck, _In_z_ LPCSTR szExtraHeadersA, _In_ LPBYTE lpBuffer,
+                         _Out_ RANGE_RESPONSE *lpResponse)
+{
+    return HttpTestClient::DoRequest(sck, "/movie.mp4", szExtraHeadersA, lpBuffer, RANGE_TEST_BUFFER_SIZE, lpResponse);
+}
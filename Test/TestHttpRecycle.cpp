@@ -0,0 +1,328 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestHttpRecycle.h"
+#include "HttpTestClient.h"
+#include <Http\HttpServer.h>
+
+ //-----------------------------------------------------------
+
+#define RECYCLE_TEST_DEFAULT_PORT 8092
+#define RECYCLE_TEST_BUFFER_SIZE (65536 + 4096)
+#define RECYCLE_TEST_MAX_ATTEMPTS 50
+#define RECYCLE_TEST_WAIT_MS 10000
+
+//-----------------------------------------------------------
+
+static VOID OnRecycleRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest);
+static VOID OnRecycleRequestDestroyed(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest);
+static HRESULT SendDirtyResponse(_In_ MX::CHttpServer::CClientRequest *lpRequest);
+static HRESULT SendCleanResponse(_In_ MX::CHttpServer::CClientRequest *lpRequest);
+
+static HRESULT TestRecycledRequest(_In_ MX::CHttpServer *lpHttp, _In_ DWORD dwPort, _In_ LPBYTE lpBuffer);
+
+static HRESULT DoRecycleRequest(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA,
+                                _In_ LPBYTE lpBuffer, _Out_ HttpTestClient::RESPONSE *lpResponse,
+                                _Out_ USHORT *lpnLocalPort);
+static BOOL IsPath(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_z_ LPCSTR szPathA);
+
+//-----------------------------------------------------------
+
+static MX::CHttpServer::CClientRequest *lpDirtyRequest = NULL;
+static LONG volatile nDestroyedCount = 0;
+
+//-----------------------------------------------------------
+
+int TestHttpRecycle()
+{
+    MX::CIoCompletionPortThreadPool cDispatcherPool;
+    MX::CSockets cSckMgr(cDispatcherPool);
+    MX::CHttpServer cHttpServer(cSckMgr);
+    MX::TAutoFreePtr<BYTE> aBuffer;
+    DWORD dwPort;
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe HttpRecycle [options]\n\n");
+        wprintf_s(L"Where 'options' can be:\n");
+        wprintf_s(L"    /port #: Port to use for the loopback server. Defaults to %lu.\n", RECYCLE_TEST_DEFAULT_PORT);
+        return 1;
+    }
+    if (FAILED(GetCmdLineParamUInt(L"port", &dwPort)) || dwPort < 1 || dwPort > 65535)
+    {
+        dwPort = RECYCLE_TEST_DEFAULT_PORT;
+    }
+
+    aBuffer.Attach((LPBYTE)MX_MALLOC(RECYCLE_TEST_BUFFER_SIZE));
+    if (!aBuffer)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+
+    hRes = cDispatcherPool.Initialize();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cSckMgr.Initialize();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        // NOTE: One connection per address so a limiter entry left behind by a recycled request rejects the next.
+        cHttpServer.SetOption_MaxRecycledRequests(4);
+        cHttpServer.SetOption_MaxConnectionsPerIp(1);
+        cHttpServer.SetRequestCompletedCallback(MX_BIND_CALLBACK(&OnRecycleRequestCompleted));
+        cHttpServer.SetRequestDestroyedCallback(MX_BIND_CALLBACK(&OnRecycleRequestDestroyed));
+
+        hRes = cHttpServer.StartListening("127.0.0.1", MX::CSockets::eFamily::IPv4, (int)dwPort);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Cannot start the HTTP server on port %lu [0x%08X].\n", dwPort, hRes);
+        return (int)hRes;
+    }
+
+    wprintf_s(L"Running recycled request tests... ");
+    hRes = TestRecycledRequest(&cHttpServer, dwPort, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        cHttpServer.StopListening();
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    cHttpServer.StopListening();
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static VOID OnRecycleRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(lpHttp);
+
+    if (IsPath(lpRequest, "/dirty") != FALSE)
+    {
+        hRes = SendDirtyResponse(lpRequest);
+    }
+    else if (IsPath(lpRequest, "/clean") != FALSE)
+    {
+        hRes = SendCleanResponse(lpRequest);
+    }
+    else
+    {
+        hRes = lpRequest->SendErrorPage(404, MX_E_NotFound);
+    }
+    lpRequest->End(hRes);
+    return;
+}
+
+static VOID OnRecycleRequestDestroyed(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    UNREFERENCED_PARAMETER(lpHttp);
+    UNREFERENCED_PARAMETER(lpRequest);
+
+    _InterlockedIncrement(&nDestroyedCount);
+    return;
+}
+
+static HRESULT SendDirtyResponse(_In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    HRESULT hRes;
+
+    // leave as much state behind as possible
+    lpDirtyRequest = lpRequest;
+    hRes = lpRequest->AddResponseHeader("X-Dirty", "yes");
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->AddResponseCookie("dirty", "yes");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->EnableChunkedResponse();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendResponse("dirty", 5);
+    }
+    return hRes;
+}
+
+static HRESULT SendCleanResponse(_In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    CHAR szBodyA[256];
+    SOCKADDR_INET sPeerAddr;
+    HRESULT hRes;
+    int r;
+
+    // NOTE: The body reports what the request inherited, the client checks it against what it sent.
+    hRes = lpRequest->GetPeerAddress(&sPeerAddr);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    r = _snprintf_s(szBodyA, _countof(szBodyA), _TRUNCATE,
+                    "headers=%Iu;carry=%d;cookies=%Iu;response-headers=%Iu;response-cookies=%Iu;port=%u",
+                    lpRequest->GetRequestHeadersCount(),
+                    (lpRequest->GetRequestHeaderByName("X-Carry") != NULL) ? 1 : 0,
+                    lpRequest->GetRequestCookiesCount(), lpRequest->GetResponseHeadersCount(),
+                    lpRequest->GetResponseCookiesCount(), (UINT)ntohs(sPeerAddr.Ipv4.sin_port));
+    if (r < 0)
+    {
+        return MX_E_BufferOverflow;
+    }
+
+    hRes = lpRequest->AddResponseHeader("X-Recycled", (lpRequest == lpDirtyRequest) ? "yes" : "no");
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendResponse(szBodyA, (SIZE_T)r);
+    }
+    return hRes;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestRecycledRequest(_In_ MX::CHttpServer *lpHttp, _In_ DWORD dwPort, _In_ LPBYTE lpBuffer)
+{
+    HttpTestClient::RESPONSE sResponse;
+    MX::CHttpRequestLimiter::STATS sStats;
+    CHAR szExpectedA[256];
+    USHORT nLocalPort;
+    LONG nExpectedDestroyed;
+    DWORD dwAttempt, dwStartTime;
+    BOOL bRecycled;
+    HRESULT hRes;
+
+    // a response with headers, cookies and a chunked body from a request with headers and cookies
+    hRes = DoRecycleRequest(dwPort, "/dirty", "X-Carry: yes\r\nCookie: a=1; b=2\r\n", lpBuffer, &sResponse,
+                            &nLocalPort);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 ||
+        HttpTestClient::HasHeader(&sResponse, "\r\nTransfer-Encoding: chunked\r\n") == FALSE ||
+        HttpTestClient::HasHeader(&sResponse, "\r\nX-Dirty: yes\r\n") == FALSE ||
+        HttpTestClient::HasHeader(&sResponse, "\r\nSet-Cookie: dirty=yes") == FALSE ||
+        HttpTestClient::HasBody(&sResponse, "dirty") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // NOTE: The socket layer releases its reference after the destroy callback so the first clean requests may
+    //       still get a new object.
+    nExpectedDestroyed = 1;
+    bRecycled = FALSE;
+    for (dwAttempt = 0; bRecycled == FALSE && dwAttempt < RECYCLE_TEST_MAX_ATTEMPTS; dwAttempt++)
+    {
+        dwStartTime = ::GetTickCount();
+        while (__InterlockedRead(&nDestroyedCount) < nExpectedDestroyed)
+        {
+            if (::GetTickCount() - dwStartTime > RECYCLE_TEST_WAIT_MS)
+            {
+                return MX_E_Timeout;
+            }
+            ::Sleep(5);
+        }
+        if (dwAttempt > 0)
+        {
+            ::Sleep(20);
+        }
+
+        hRes = DoRecycleRequest(dwPort, "/clean", "", lpBuffer, &sResponse, &nLocalPort);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        nExpectedDestroyed++;
+
+        // Host and Connection are the only request headers
+        _snprintf_s(szExpectedA, _countof(szExpectedA), _TRUNCATE,
+                    "headers=2;carry=0;cookies=0;response-headers=0;response-cookies=0;port=%u", (UINT)nLocalPort);
+        if (sResponse.nStatus != 200 || HttpTestClient::HasHeader(&sResponse, "\r\nTransfer-Encoding:") != FALSE ||
+            HttpTestClient::HasHeader(&sResponse, "\r\nContent-Length: ") == FALSE ||
+            HttpTestClient::HasHeader(&sResponse, "\r\nX-Dirty:") != FALSE ||
+            HttpTestClient::HasHeader(&sResponse, "\r\nSet-Cookie:") != FALSE ||
+            HttpTestClient::HasBody(&sResponse, szExpectedA) == FALSE)
+        {
+            return E_FAIL;
+        }
+        bRecycled = HttpTestClient::HasHeader(&sResponse, "\r\nX-Recycled: yes\r\n");
+    }
+    if (bRecycled == FALSE)
+    {
+        return MX_E_NotFound;
+    }
+
+    // every connection was accepted although only one per address is allowed
+    lpHttp->GetRequestLimiterStats(&sStats);
+    if (sStats.nConnectionsRejectedByIp != 0ui64)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT DoRecycleRequest(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA,
+                                _In_ LPBYTE lpBuffer, _Out_ HttpTestClient::RESPONSE *lpResponse,
+                                _Out_ USHORT *lpnLocalPort)
+{
+    SOCKADDR_IN sLocalAddr;
+    int nAddrLen = (int)sizeof(sLocalAddr);
+    SOCKET sck;
+    HRESULT hRes;
+
+    *lpnLocalPort = 0;
+
+    // NOTE: A new connection each time, closed by the client, so the request object goes back to the pool.
+    hRes = HttpTestClient::Connect(dwPort, &sck);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (::getsockname(sck, (sockaddr *)&sLocalAddr, &nAddrLen) == SOCKET_ERROR)
+    {
+        hRes = MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    }
+    if (SUCCEEDED(hRes))
+    {
+        *lpnLocalPort = ntohs(sLocalAddr.sin_port);
+
+        hRes = HttpTestClient::DoRequest(sck, szPathA, szExtraHeadersA, lpBuffer, RECYCLE_TEST_BUFFER_SIZE,
+                                         lpResponse);
+    }
+    ::closesocket(sck);
+    return hRes;
+}
+
+static BOOL IsPath(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_z_ LPCSTR szPathA)
+{
+    const MX::CUrlView::SLICE &sPath = lpRequest->GetUrlView().GetPath();
+    SIZE_T nLen = MX::StrLenA(szPathA);
+
+    return (sPath.nLength == nLen && MX::StrNCompareA(sPath.szStrA, szPathA, nLen) == 0) ? TRUE : FALSE;
+}
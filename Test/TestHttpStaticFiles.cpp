@@ -0,0 +1,824 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestHttpStaticFiles.h"
+#include "HttpTestClient.h"
+#include <Http\HttpServer.h>
+#include <Http\HttpStaticFileCache.h>
+#include <MemoryStream.h>
+
+ //-----------------------------------------------------------
+
+#define STATIC_TEST_DEFAULT_PORT 8090
+#define STATIC_TEST_BUFFER_SIZE 262144
+
+#define STATIC_TEST_INDEX_CONTENT "<html><body>static file cache test</body></html>"
+#define STATIC_TEST_SCRIPT_CONTENT "var identity = 'plain script';"
+#define STATIC_TEST_SCRIPT_BR_CONTENT "brotli variant bytes"
+#define STATIC_TEST_SCRIPT_GZ_CONTENT "gzip variant bytes"
+#define STATIC_TEST_SECRET_CONTENT "top secret, outside of the root folder"
+
+#define STATIC_TEST_MIXED_PATH "/mixed"
+
+//-----------------------------------------------------------
+
+typedef HttpTestClient::RESPONSE STATIC_RESPONSE;
+
+using HttpTestClient::HasHeader;
+using HttpTestClient::GetHeaderValue;
+using HttpTestClient::HasBody;
+
+//-----------------------------------------------------------
+
+static HRESULT CreateTestFiles(_In_ MX::CStringW &cStrFolderW);
+static VOID DeleteTestFiles(_In_ MX::CStringW &cStrFolderW);
+static HRESULT WriteTestFile(_In_ MX::CStringW &cStrFolderW, _In_z_ LPCWSTR szNameW, _In_ LPCVOID lpData,
+                             _In_ SIZE_T nDataLen);
+
+static VOID OnStaticRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest);
+static HRESULT SendMixedResponse(_In_ MX::CHttpServer::CClientRequest *lpRequest);
+static HRESULT SendMemoryStream(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_z_ LPCSTR szDataA);
+
+static HRESULT TestConditionalRequests(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer);
+static HRESULT TestPrecompressedVariants(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer);
+static HRESULT TestTraversal(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer);
+static HRESULT TestConditionalRanges(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer);
+static HRESULT TestMixedChunkedResponse(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer);
+
+static HRESULT DoRequest(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA,
+                         _In_ LPBYTE lpBuffer, _Out_ STATIC_RESPONSE *lpResponse);
+
+//-----------------------------------------------------------
+
+static MX::CHttpStaticFileCache *lpFileCache = NULL;
+static LPCWSTR szRootFolderW = NULL;
+
+//-----------------------------------------------------------
+
+int TestHttpStaticFiles()
+{
+    MX::CIoCompletionPortThreadPool cDispatcherPool;
+    MX::CSockets cSckMgr(cDispatcherPool);
+    MX::CHttpServer cHttpServer(cSckMgr);
+    MX::CHttpStaticFileCache cFileCache;
+    MX::TAutoFreePtr<BYTE> aBuffer;
+    MX::CStringW cStrFolderW, cStrRootW;
+    DWORD dwPort;
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe HttpStaticFiles [options]\n\n");
+        wprintf_s(L"Where 'options' can be:\n");
+        wprintf_s(L"    /port #: Port to use for the loopback server. Defaults to %lu.\n", STATIC_TEST_DEFAULT_PORT);
+        return 1;
+    }
+    if (FAILED(GetCmdLineParamUInt(L"port", &dwPort)) || dwPort < 1 || dwPort > 65535)
+    {
+        dwPort = STATIC_TEST_DEFAULT_PORT;
+    }
+
+    aBuffer.Attach((LPBYTE)MX_MALLOC(STATIC_TEST_BUFFER_SIZE));
+    if (!aBuffer)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+
+    // the secret file lives next to the root folder so a traversal can be detected
+    hRes = GetAppPath(cStrFolderW);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = (cStrFolderW.Concat(L"TestStaticFiles") != FALSE) ? S_OK : E_OUTOFMEMORY;
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = CreateTestFiles(cStrFolderW);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = (cStrRootW.Format(L"%s\\www", (LPCWSTR)cStrFolderW) != FALSE) ? S_OK : E_OUTOFMEMORY;
+    }
+    if (SUCCEEDED(hRes))
+    {
+        cFileCache.EnablePrecompressed(TRUE);
+        hRes = cFileCache.Initialize((LPCWSTR)cStrRootW);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Cannot create the test files [0x%08X].\n", hRes);
+        DeleteTestFiles(cStrFolderW);
+        return (int)hRes;
+    }
+    lpFileCache = &cFileCache;
+    szRootFolderW = (LPCWSTR)cStrRootW;
+
+    hRes = cDispatcherPool.Initialize();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cSckMgr.Initialize();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        cHttpServer.SetRequestCompletedCallback(MX_BIND_CALLBACK(&OnStaticRequestCompleted));
+
+        hRes = cHttpServer.StartListening("127.0.0.1", MX::CSockets::eFamily::IPv4, (int)dwPort);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Cannot start the HTTP server on port %lu [0x%08X].\n", dwPort, hRes);
+        lpFileCache = NULL;
+        szRootFolderW = NULL;
+        DeleteTestFiles(cStrFolderW);
+        return (int)hRes;
+    }
+
+    wprintf_s(L"Running conditional request tests... ");
+    hRes = TestConditionalRequests(dwPort, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+on_error:
+        wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        cHttpServer.StopListening();
+        lpFileCache = NULL;
+        szRootFolderW = NULL;
+        DeleteTestFiles(cStrFolderW);
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running precompressed variant tests... ");
+    hRes = TestPrecompressedVariants(dwPort, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running path traversal tests... ");
+    hRes = TestTraversal(dwPort, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running conditional range tests... ");
+    hRes = TestConditionalRanges(dwPort, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running mixed chunked response tests... ");
+    hRes = TestMixedChunkedResponse(dwPort, aBuffer.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    cHttpServer.StopListening();
+    lpFileCache = NULL;
+    szRootFolderW = NULL;
+    DeleteTestFiles(cStrFolderW);
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT CreateTestFiles(_In_ MX::CStringW &cStrFolderW)
+{
+    MX::CStringW cStrRootW;
+    HRESULT hRes;
+
+    if (::CreateDirectoryW((LPCWSTR)cStrFolderW, NULL) == FALSE && ::GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        return MX_HRESULT_FROM_LASTERROR();
+    }
+    if (cStrRootW.Format(L"%s\\www", (LPCWSTR)cStrFolderW) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    if (::CreateDirectoryW((LPCWSTR)cStrRootW, NULL) == FALSE && ::GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        return MX_HRESULT_FROM_LASTERROR();
+    }
+
+    hRes = WriteTestFile(cStrFolderW, L"secret.txt", STATIC_TEST_SECRET_CONTENT,
+                         sizeof(STATIC_TEST_SECRET_CONTENT) - 1);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = WriteTestFile(cStrRootW, L"index.html", STATIC_TEST_INDEX_CONTENT, sizeof(STATIC_TEST_INDEX_CONTENT) - 1);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = WriteTestFile(cStrRootW, L"app.js", STATIC_TEST_SCRIPT_CONTENT, sizeof(STATIC_TEST_SCRIPT_CONTENT) - 1);
+    }
+    // NOTE: The cache does not look inside the siblings so any content identifies the variant that was sent.
+    if (SUCCEEDED(hRes))
+    {
+        hRes = WriteTestFile(cStrRootW, L"app.js.br", STATIC_TEST_SCRIPT_BR_CONTENT,
+                             sizeof(STATIC_TEST_SCRIPT_BR_CONTENT) - 1);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = WriteTestFile(cStrRootW, L"app.js.gz", STATIC_TEST_SCRIPT_GZ_CONTENT,
+                             sizeof(STATIC_TEST_SCRIPT_GZ_CONTENT) - 1);
+    }
+
+    // done
+    return hRes;
+}
+
+static VOID DeleteTestFiles(_In_ MX::CStringW &cStrFolderW)
+{
+    static const LPCWSTR aFilesW[] = {
+        L"www\\index.html", L"www\\app.js", L"www\\app.js.br", L"www\\app.js.gz", L"secret.txt"
+    };
+    MX::CStringW cStrFileNameW;
+    SIZE_T i;
+
+    for (i = 0; i < MX_ARRAYLEN(aFilesW); i++)
+    {
+        if (cStrFileNameW.Format(L"%s\\%s", (LPCWSTR)cStrFolderW, aFilesW[i]) != FALSE)
+        {
+            ::DeleteFileW((LPCWSTR)cStrFileNameW);
+        }
+    }
+    if (cStrFileNameW.Format(L"%s\\www", (LPCWSTR)cStrFolderW) != FALSE)
+    {
+        ::RemoveDirectoryW((LPCWSTR)cStrFileNameW);
+    }
+    ::RemoveDirectoryW((LPCWSTR)cStrFolderW);
+    return;
+}
+
+static HRESULT WriteTestFile(_In_ MX::CStringW &cStrFolderW, _In_z_ LPCWSTR szNameW, _In_ LPCVOID lpData,
+                             _In_ SIZE_T nDataLen)
+{
+    MX::CStringW cStrFileNameW;
+    HANDLE hFile;
+    DWORD dwWritten;
+
+    if (cStrFileNameW.Format(L"%s\\%s", (LPCWSTR)cStrFolderW, szNameW) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hFile = ::CreateFileW((LPCWSTR)cStrFileNameW, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return MX_HRESULT_FROM_LASTERROR();
+    }
+    if (::WriteFile(hFile, lpData, (DWORD)nDataLen, &dwWritten, NULL) == FALSE || dwWritten != (DWORD)nDataLen)
+    {
+        HRESULT hRes = MX_HRESULT_FROM_LASTERROR();
+
+        ::CloseHandle(hFile);
+        return (FAILED(hRes)) ? hRes : MX_E_WriteFault;
+    }
+    ::CloseHandle(hFile);
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static VOID OnStaticRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    const MX::CUrlView::SLICE *lpPath;
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(lpHttp);
+
+    lpPath = &(lpRequest->GetUrlView().GetPath());
+    if (lpPath->nLength == sizeof(STATIC_TEST_MIXED_PATH) - 1 &&
+        MX::StrNCompareA(lpPath->szStrA, STATIC_TEST_MIXED_PATH, lpPath->nLength) == 0)
+    {
+        hRes = SendMixedResponse(lpRequest);
+    }
+    else
+    {
+        hRes = lpFileCache->Serve(lpRequest);
+        if (hRes == MX_E_NotFound)
+        {
+            hRes = lpRequest->SendErrorPage(404, hRes);
+        }
+    }
+    lpRequest->End(hRes);
+    return;
+}
+
+static HRESULT SendMixedResponse(_In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    MX::CStringW cStrFileNameW;
+    HRESULT hRes;
+
+    if (cStrFileNameW.Format(L"%s\\index.html", szRootFolderW) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // queued before the switch
+    hRes = lpRequest->SendResponse("queued-", 7);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SendMemoryStream(lpRequest, "queued-stream-");
+    }
+
+    // NOTE: Same sequence as "response.write()" but a stream goes first so the queued data must still precede it.
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->EnableChunkedResponse();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SendMemoryStream(lpRequest, "stream-");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendResponse("write-", 6);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->FlushResponse();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SendMemoryStream(lpRequest, "");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendFile((LPCWSTR)cStrFileNameW);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendResponse("-end", 4);
+    }
+
+    // done
+    return hRes;
+}
+
+static HRESULT SendMemoryStream(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_z_ LPCSTR szDataA)
+{
+    MX::TAutoRefCounted<MX::CMemoryStream> cStream;
+    SIZE_T nLen, nWritten;
+    HRESULT hRes;
+
+    nLen = MX::StrLenA(szDataA);
+    cStream.Attach(MX_DEBUG_NEW MX::CMemoryStream());
+    if (!cStream)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = cStream->Create(nLen, FALSE);
+    if (SUCCEEDED(hRes) && nLen > 0)
+    {
+        hRes = cStream->Write(szDataA, nLen, nWritten);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendStream(cStream.Get());
+    }
+    return hRes;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestConditionalRequests(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer)
+{
+    STATIC_RESPONSE sResponse;
+    MX::CStringA cStrETagA, cStrLastModifiedA, cStrValueA, cStrHeadersA;
+    HRESULT hRes;
+
+    // first request gets the entity and its validators
+    hRes = DoRequest(dwPort, "/index.html", "", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_INDEX_CONTENT) == FALSE ||
+        GetHeaderValue(&sResponse, "ETag", cStrETagA) == FALSE ||
+        GetHeaderValue(&sResponse, "Last-Modified", cStrLastModifiedA) == FALSE)
+    {
+        return E_FAIL;
+    }
+    // strong validator
+    if (((LPCSTR)cStrETagA)[0] != '"' || cStrETagA.GetLength() < 3)
+    {
+        return E_FAIL;
+    }
+
+    // the entity tag does not change while the file does not
+    hRes = DoRequest(dwPort, "/index.html", "", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || GetHeaderValue(&sResponse, "ETag", cStrValueA) == FALSE ||
+        MX::StrCompareA((LPCSTR)cStrValueA, (LPCSTR)cStrETagA) != 0)
+    {
+        return E_FAIL;
+    }
+
+    // matching tag, alone and in a list
+    if (cStrHeadersA.Format("If-None-Match: %s\r\n", (LPCSTR)cStrETagA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/index.html", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 304 || sResponse.nBodyLen != 0 ||
+        GetHeaderValue(&sResponse, "ETag", cStrValueA) == FALSE ||
+        MX::StrCompareA((LPCSTR)cStrValueA, (LPCSTR)cStrETagA) != 0)
+    {
+        return E_FAIL;
+    }
+
+    if (cStrHeadersA.Format("If-None-Match: \"not-this-one\", %s\r\n", (LPCSTR)cStrETagA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/index.html", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 304 || sResponse.nBodyLen != 0)
+    {
+        return E_FAIL;
+    }
+
+    hRes = DoRequest(dwPort, "/index.html", "If-None-Match: *\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 304 || sResponse.nBodyLen != 0)
+    {
+        return E_FAIL;
+    }
+
+    // a different tag gets the whole entity
+    hRes = DoRequest(dwPort, "/index.html", "If-None-Match: \"stale-tag\"\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_INDEX_CONTENT) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // "If-None-Match" takes precedence over "If-Modified-Since"
+    if (cStrHeadersA.Format("If-None-Match: \"stale-tag\"\r\nIf-Modified-Since: %s\r\n",
+                            (LPCSTR)cStrLastModifiedA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/index.html", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200)
+    {
+        return E_FAIL;
+    }
+
+    // dates
+    if (cStrHeadersA.Format("If-Modified-Since: %s\r\n", (LPCSTR)cStrLastModifiedA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/index.html", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 304 || sResponse.nBodyLen != 0)
+    {
+        return E_FAIL;
+    }
+
+    hRes = DoRequest(dwPort, "/index.html", "If-Modified-Since: Thu, 01 Jan 1998 00:00:00 GMT\r\n", lpBuffer,
+                     &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_INDEX_CONTENT) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestPrecompressedVariants(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer)
+{
+    STATIC_RESPONSE sResponse;
+    MX::CStringA cStrIdentityETagA, cStrBrotliETagA, cStrHeadersA;
+    HRESULT hRes;
+
+    // brotli is preferred when both are accepted
+    hRes = DoRequest(dwPort, "/app.js", "Accept-Encoding: gzip, deflate, br\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_SCRIPT_BR_CONTENT) == FALSE ||
+        HasHeader(&sResponse, "\r\nContent-Encoding: br\r\n") == FALSE ||
+        HasHeader(&sResponse, "\r\nVary: Accept-Encoding\r\n") == FALSE ||
+        GetHeaderValue(&sResponse, "ETag", cStrBrotliETagA) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    hRes = DoRequest(dwPort, "/app.js", "Accept-Encoding: gzip\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_SCRIPT_GZ_CONTENT) == FALSE ||
+        HasHeader(&sResponse, "\r\nContent-Encoding: gzip\r\n") == FALSE ||
+        HasHeader(&sResponse, "\r\nVary: Accept-Encoding\r\n") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // no usable encoding gets the original file, still marked as varying
+    hRes = DoRequest(dwPort, "/app.js", "", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_SCRIPT_CONTENT) == FALSE ||
+        HasHeader(&sResponse, "\r\nContent-Encoding:") != FALSE ||
+        HasHeader(&sResponse, "\r\nVary: Accept-Encoding\r\n") == FALSE ||
+        GetHeaderValue(&sResponse, "ETag", cStrIdentityETagA) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    hRes = DoRequest(dwPort, "/app.js", "Accept-Encoding: identity\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_SCRIPT_CONTENT) == FALSE ||
+        HasHeader(&sResponse, "\r\nContent-Encoding:") != FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // each representation has its own entity tag
+    if (MX::StrCompareA((LPCSTR)cStrIdentityETagA, (LPCSTR)cStrBrotliETagA) == 0)
+    {
+        return E_FAIL;
+    }
+    if (cStrHeadersA.Format("Accept-Encoding: br\r\nIf-None-Match: %s\r\n", (LPCSTR)cStrIdentityETagA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/app.js", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_SCRIPT_BR_CONTENT) == FALSE)
+    {
+        return E_FAIL;
+    }
+    if (cStrHeadersA.Format("Accept-Encoding: br\r\nIf-None-Match: %s\r\n", (LPCSTR)cStrBrotliETagA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/app.js", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 304)
+    {
+        return E_FAIL;
+    }
+
+    // files without siblings do not vary
+    hRes = DoRequest(dwPort, "/index.html", "Accept-Encoding: gzip, br\r\n", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_INDEX_CONTENT) == FALSE ||
+        HasHeader(&sResponse, "\r\nContent-Encoding:") != FALSE || HasHeader(&sResponse, "\r\nVary:") != FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestTraversal(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer)
+{
+    static const LPCSTR aPathsA[] = {
+        "/../secret.txt", "/%2e%2e/secret.txt", "/%2E%2E%2Fsecret.txt", "/..%2fsecret.txt", "/..%5csecret.txt",
+        "/%2e%2e%5csecret.txt", "/x/../../secret.txt", "/x/..%5c..%5csecret.txt", "/.%2e/secret.txt",
+        "/..\\secret.txt", "/index.html.", "/index.html%20", "/index.html::$DATA", "/index.html%3a%3a$DATA",
+        "//localhost/secret.txt", "/C:/Windows/win.ini", "/C%3a%5cWindows%5cwin.ini", "/app.js.br%00.txt"
+    };
+    STATIC_RESPONSE sResponse;
+    SIZE_T i;
+    HRESULT hRes;
+
+    // the control request must work so failures below are not caused by something else
+    hRes = DoRequest(dwPort, "/index.html", "", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200)
+    {
+        return E_FAIL;
+    }
+
+    // NOTE: The server may reject the request line itself or close the connection. Anything but the file is fine.
+    for (i = 0; i < MX_ARRAYLEN(aPathsA); i++)
+    {
+        hRes = DoRequest(dwPort, aPathsA[i], "", lpBuffer, &sResponse);
+        if (hRes == MX_E_BrokenPipe)
+        {
+            continue;
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (sResponse.nStatus == 200 || sResponse.nStatus == 206 ||
+            MX::StrFindA((LPCSTR)(sResponse.lpBody), "top secret") != NULL)
+        {
+            wprintf_s(L"\nError: '%S' was served.", aPathsA[i]);
+            return E_FAIL;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestConditionalRanges(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer)
+{
+    STATIC_RESPONSE sResponse;
+    MX::CStringA cStrETagA, cStrLastModifiedA, cStrHeadersA;
+    HRESULT hRes;
+
+    hRes = DoRequest(dwPort, "/index.html", "", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || GetHeaderValue(&sResponse, "ETag", cStrETagA) == FALSE ||
+        GetHeaderValue(&sResponse, "Last-Modified", cStrLastModifiedA) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // matching validators
+    if (cStrHeadersA.Format("Range: bytes=0-5\r\nIf-Range: %s\r\n", (LPCSTR)cStrETagA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/index.html", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || HasBody(&sResponse, "<html>") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    if (cStrHeadersA.Format("Range: bytes=0-5\r\nIf-Range: %s\r\n", (LPCSTR)cStrLastModifiedA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/index.html", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 || HasBody(&sResponse, "<html>") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    if (cStrHeadersA.Format("Range: bytes=0-5,12-15\r\nIf-Range: %s\r\n", (LPCSTR)cStrETagA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = DoRequest(dwPort, "/index.html", (LPCSTR)cStrHeadersA, lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 206 ||
+        HasHeader(&sResponse, "\r\nContent-Type: multipart/byteranges; boundary=") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // stale validators get the whole entity, for single and multiple ranges
+    hRes = DoRequest(dwPort, "/index.html", "Range: bytes=0-5\r\nIf-Range: \"stale-tag\"\r\n", lpBuffer,
+                     &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_INDEX_CONTENT) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    hRes = DoRequest(dwPort, "/index.html", "Range: bytes=0-5,12-15\r\nIf-Range: \"stale-tag\"\r\n", lpBuffer,
+                     &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_INDEX_CONTENT) == FALSE ||
+        HasHeader(&sResponse, "\r\nContent-Type: multipart/byteranges") != FALSE)
+    {
+        return E_FAIL;
+    }
+
+    hRes = DoRequest(dwPort, "/index.html", "Range: bytes=0-5,12-15\r\nIf-Range: Thu, 01 Jan 1998 00:00:00 GMT\r\n",
+                     lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasBody(&sResponse, STATIC_TEST_INDEX_CONTENT) == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestMixedChunkedResponse(_In_ DWORD dwPort, _In_ LPBYTE lpBuffer)
+{
+    STATIC_RESPONSE sResponse;
+    HRESULT hRes;
+
+    // NOTE: The client decodes the chunks so a missing chunk header or a lost queued stream breaks the body.
+    hRes = DoRequest(dwPort, STATIC_TEST_MIXED_PATH, "", lpBuffer, &sResponse);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (sResponse.nStatus != 200 || HasHeader(&sResponse, "\r\nTransfer-Encoding: chunked\r\n") == FALSE ||
+        HasHeader(&sResponse, "\r\nContent-Length:") != FALSE ||
+        HasBody(&sResponse, "queued-queued-stream-stream-write-" STATIC_TEST_INDEX_CONTENT "-end") == FALSE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT DoRequest(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_z_ LPCSTR szExtraHeadersA,
+                         _In_ LPBYTE lpBuffer, _Out_ STATIC_RESPONSE *lpResponse)
+{
+    // NOTE: One connection per request because rejected requests may close it.
+    return HttpTestClient::DoSingleRequest(dwPort, szPathA, szExtraHeadersA, lpBuffer, STATIC_TEST_BUFFER_SIZE,
+                                           lpResponse);
+}
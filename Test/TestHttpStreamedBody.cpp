@@ -0,0 +1,597 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestHttpStreamedBody.h"
+#include <Http\HttpServer.h>
+#include <Http\HttpClient.h>
+#include <Http\HttpBodyParserStream.h>
+#include <Crypto\MessageDigest.h>
+
+ //-----------------------------------------------------------
+
+#define STREAMED_TEST_DEFAULT_PORT 8091
+#define STREAMED_TEST_BODY_SIZE (4 * 1048576)
+#define STREAMED_TEST_PAUSE_EVERY 262144
+#define STREAMED_TEST_PAUSE_MS 20
+#define STREAMED_TEST_SEND_CHUNK 65536
+#define STREAMED_TEST_WAIT_MS 30000
+
+//-----------------------------------------------------------
+
+typedef struct tagSTREAMED_CONTEXT
+{
+    MX::CSockets *lpSckMgr;
+    DWORD dwPort;
+    BYTE aExpectedDigest[32];
+    //----
+    MX::CHttpServer::CClientRequest *lpPausedRequest;
+    MX::CMessageDigest cPausedDigest;
+    ULONGLONG nPausedReceived;
+    ULONGLONG nNextPauseAt;
+    LONG volatile nPaused;
+    LONG volatile nPausesCount;
+    LONG volatile nDataWhilePaused;
+    LONG volatile nErrors;
+    HANDLE hPausedEvent;
+    HANDLE hStopEvent;
+    //----
+    MX::TAutoRefCounted<MX::CHttpClient> cProxyClient;
+    MX::CMessageDigest cSinkDigest;
+    ULONGLONG nSinkReceived;
+    LONG volatile nSinkResult;
+} STREAMED_CONTEXT;
+
+//-----------------------------------------------------------
+
+static HRESULT OnStreamedHeadersReceived(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest,
+                                         _Outptr_result_maybenull_ MX::CHttpBodyParserBase **lplpBodyParser);
+static VOID OnStreamedRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest);
+static HRESULT OnPausedBodyData(_In_opt_ LPCVOID lpData, _In_ SIZE_T nDataSize, _In_opt_ LPVOID lpUserParam);
+static HRESULT OnSinkBodyData(_In_opt_ LPCVOID lpData, _In_ SIZE_T nDataSize, _In_opt_ LPVOID lpUserParam);
+static DWORD WINAPI ResumerThreadProc(_In_ LPVOID lpParameter);
+
+static HRESULT CreateProxyClient(_In_ MX::CHttpServer::CClientRequest *lpRequest, _Out_ MX::CHttpClient **lplpClient);
+static BOOL IsPath(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_z_ LPCWSTR szPathW);
+
+static HRESULT TestPauseAndResume(_In_ LPBYTE lpBody);
+static HRESULT TestPipeToClient(_In_ LPBYTE lpBody);
+
+static HRESULT PostBody(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_ LPBYTE lpBody, _In_ SIZE_T nBodySize,
+                        _Out_ LONG *lpnStatus);
+
+//-----------------------------------------------------------
+
+static STREAMED_CONTEXT *lpStreamedCtx = NULL;
+
+//-----------------------------------------------------------
+
+int TestHttpStreamedBody()
+{
+    MX::CIoCompletionPortThreadPool cDispatcherPool;
+    MX::CSockets cSckMgr(cDispatcherPool);
+    MX::CHttpServer cHttpServer(cSckMgr);
+    STREAMED_CONTEXT sCtx;
+    MX::TAutoFreePtr<BYTE> aBody;
+    HANDLE hResumerThread;
+    ULONG nSeed = 0x2545F491UL;
+    DWORD dwPort;
+    SIZE_T i;
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe HttpStreamedBody [options]\n\n");
+        wprintf_s(L"Where 'options' can be:\n");
+        wprintf_s(L"    /port #: Port to use for the loopback server. Defaults to %lu.\n", STREAMED_TEST_DEFAULT_PORT);
+        return 1;
+    }
+    if (FAILED(GetCmdLineParamUInt(L"port", &dwPort)) || dwPort < 1 || dwPort > 65535)
+    {
+        dwPort = STREAMED_TEST_DEFAULT_PORT;
+    }
+
+    aBody.Attach((LPBYTE)MX_MALLOC(STREAMED_TEST_BODY_SIZE));
+    if (!aBody)
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)E_OUTOFMEMORY;
+    }
+    for (i = 0; i < STREAMED_TEST_BODY_SIZE; i++)
+    {
+        // xorshift32
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+
+        aBody.Get()[i] = (BYTE)nSeed;
+    }
+
+    sCtx.lpSckMgr = &cSckMgr;
+    sCtx.dwPort = dwPort;
+    sCtx.lpPausedRequest = NULL;
+    sCtx.nPausedReceived = sCtx.nNextPauseAt = sCtx.nSinkReceived = 0ui64;
+    sCtx.nPaused = sCtx.nPausesCount = sCtx.nDataWhilePaused = sCtx.nErrors = sCtx.nSinkResult = 0;
+    sCtx.hPausedEvent = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+    sCtx.hStopEvent = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+    hResumerThread = NULL;
+    hRes = (sCtx.hPausedEvent != NULL && sCtx.hStopEvent != NULL) ? S_OK : MX_HRESULT_FROM_LASTERROR();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = MX::CMessageDigest::Hash(MX::CMessageDigest::eAlgorithm::SHA256, aBody.Get(), STREAMED_TEST_BODY_SIZE,
+                                        sCtx.aExpectedDigest, sizeof(sCtx.aExpectedDigest));
+    }
+    if (SUCCEEDED(hRes))
+    {
+        lpStreamedCtx = &sCtx;
+
+        // the resumer thread plays the role of a consumer that catches up later
+        hResumerThread = ::CreateThread(NULL, 0, &ResumerThreadProc, &sCtx, 0, NULL);
+        if (hResumerThread == NULL)
+        {
+            hRes = MX_HRESULT_FROM_LASTERROR();
+        }
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cDispatcherPool.Initialize();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cSckMgr.Initialize();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        cHttpServer.SetRequestHeadersReceivedCallback(MX_BIND_CALLBACK(&OnStreamedHeadersReceived));
+        cHttpServer.SetRequestCompletedCallback(MX_BIND_CALLBACK(&OnStreamedRequestCompleted));
+
+        hRes = cHttpServer.StartListening("127.0.0.1", MX::CSockets::eFamily::IPv4, (int)dwPort);
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Cannot start the HTTP server on port %lu [0x%08X].\n", dwPort, hRes);
+        goto done;
+    }
+
+    wprintf_s(L"Running pause and resume tests... ");
+    hRes = TestPauseAndResume(aBody.Get());
+    if (FAILED(hRes))
+    {
+on_error:
+        wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        cHttpServer.StopListening();
+        goto done;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running body to client upload tests... ");
+    hRes = TestPipeToClient(aBody.Get());
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    cHttpServer.StopListening();
+
+done:
+    if (hResumerThread != NULL)
+    {
+        ::SetEvent(sCtx.hStopEvent);
+        ::WaitForSingleObject(hResumerThread, INFINITE);
+        ::CloseHandle(hResumerThread);
+    }
+    if (sCtx.cProxyClient)
+    {
+        sCtx.cProxyClient->Close(FALSE);
+        sCtx.cProxyClient.Release();
+    }
+    lpStreamedCtx = NULL;
+    if (sCtx.hPausedEvent != NULL)
+    {
+        ::CloseHandle(sCtx.hPausedEvent);
+    }
+    if (sCtx.hStopEvent != NULL)
+    {
+        ::CloseHandle(sCtx.hStopEvent);
+    }
+    return (SUCCEEDED(hRes)) ? 0 : (int)hRes;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT OnStreamedHeadersReceived(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest,
+                                         _Outptr_result_maybenull_ MX::CHttpBodyParserBase **lplpBodyParser)
+{
+    MX::TAutoRefCounted<MX::CHttpClient> cClient;
+    HRESULT hRes;
+
+    UNREFERENCED_PARAMETER(lpHttp);
+
+    *lplpBodyParser = NULL;
+    if (IsPath(lpRequest, L"/pause") != FALSE)
+    {
+        hRes = lpStreamedCtx->cPausedDigest.BeginDigest(MX::CMessageDigest::eAlgorithm::SHA256);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        lpStreamedCtx->lpPausedRequest = lpRequest;
+        lpStreamedCtx->nPausedReceived = 0ui64;
+        lpStreamedCtx->nNextPauseAt = STREAMED_TEST_PAUSE_EVERY;
+
+        *lplpBodyParser = MX_DEBUG_NEW MX::CHttpBodyParserStream(MX_BIND_CALLBACK(&OnPausedBodyData), lpStreamedCtx,
+                                                                 STREAMED_TEST_BODY_SIZE);
+    }
+    else if (IsPath(lpRequest, L"/sink") != FALSE)
+    {
+        hRes = lpStreamedCtx->cSinkDigest.BeginDigest(MX::CMessageDigest::eAlgorithm::SHA256);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        lpStreamedCtx->nSinkReceived = 0ui64;
+
+        *lplpBodyParser = MX_DEBUG_NEW MX::CHttpBodyParserStream(MX_BIND_CALLBACK(&OnSinkBodyData), lpStreamedCtx,
+                                                                 STREAMED_TEST_BODY_SIZE);
+    }
+    else if (IsPath(lpRequest, L"/proxy") != FALSE)
+    {
+        hRes = CreateProxyClient(lpRequest, &cClient);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        lpStreamedCtx->cProxyClient = cClient.Get();
+
+        // the body goes straight into the upload, nothing is kept here
+        *lplpBodyParser = MX_DEBUG_NEW MX::CHttpBodyParserStream(cClient.Get(), STREAMED_TEST_BODY_SIZE);
+    }
+    else
+    {
+        return S_OK;
+    }
+    return (*lplpBodyParser != NULL) ? S_OK : E_OUTOFMEMORY;
+}
+
+static VOID OnStreamedRequestCompleted(_In_ MX::CHttpServer *lpHttp, _In_ MX::CHttpServer::CClientRequest *lpRequest)
+{
+    HRESULT hRes = S_OK;
+
+    UNREFERENCED_PARAMETER(lpHttp);
+
+    if (IsPath(lpRequest, L"/pause") != FALSE)
+    {
+        lpStreamedCtx->lpPausedRequest = NULL;
+        if (lpStreamedCtx->nPausedReceived != STREAMED_TEST_BODY_SIZE ||
+            __InterlockedRead(&(lpStreamedCtx->nErrors)) != 0 ||
+            lpStreamedCtx->cPausedDigest.GetResultSize() != sizeof(lpStreamedCtx->aExpectedDigest) ||
+            ::MxMemCompare(lpStreamedCtx->cPausedDigest.GetResult(), lpStreamedCtx->aExpectedDigest,
+                           sizeof(lpStreamedCtx->aExpectedDigest)) != 0)
+        {
+            hRes = MX_E_InvalidData;
+        }
+    }
+    else if (IsPath(lpRequest, L"/sink") != FALSE)
+    {
+        if (lpStreamedCtx->nSinkReceived != STREAMED_TEST_BODY_SIZE ||
+            lpStreamedCtx->cSinkDigest.GetResultSize() != sizeof(lpStreamedCtx->aExpectedDigest) ||
+            ::MxMemCompare(lpStreamedCtx->cSinkDigest.GetResult(), lpStreamedCtx->aExpectedDigest,
+                           sizeof(lpStreamedCtx->aExpectedDigest)) != 0)
+        {
+            hRes = MX_E_InvalidData;
+        }
+        _InterlockedExchange(&(lpStreamedCtx->nSinkResult), (SUCCEEDED(hRes)) ? 1 : -1);
+    }
+    else if (IsPath(lpRequest, L"/proxy") == FALSE)
+    {
+        hRes = MX_E_NotFound;
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = lpRequest->SendResponse("OK", 2);
+    }
+    lpRequest->End(hRes);
+    return;
+}
+
+// NOTE: Runs with the request locked. Pausing here is the way a consumer tells the server it cannot take more.
+static HRESULT OnPausedBodyData(_In_opt_ LPCVOID lpData, _In_ SIZE_T nDataSize, _In_opt_ LPVOID lpUserParam)
+{
+    STREAMED_CONTEXT *lpCtx = (STREAMED_CONTEXT *)lpUserParam;
+    HRESULT hRes;
+
+    if (lpData == NULL)
+    {
+        return lpCtx->cPausedDigest.EndDigest();
+    }
+    if (__InterlockedRead(&(lpCtx->nPaused)) != 0)
+    {
+        _InterlockedIncrement(&(lpCtx->nDataWhilePaused));
+    }
+
+    hRes = lpCtx->cPausedDigest.DigestStream(lpData, nDataSize);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    lpCtx->nPausedReceived += (ULONGLONG)nDataSize;
+
+    if (lpCtx->nPausedReceived >= lpCtx->nNextPauseAt && lpCtx->nPausedReceived < STREAMED_TEST_BODY_SIZE)
+    {
+        lpCtx->nNextPauseAt = lpCtx->nPausedReceived + STREAMED_TEST_PAUSE_EVERY;
+
+        hRes = lpCtx->lpPausedRequest->PauseRequestBody();
+        if (FAILED(hRes))
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+            return hRes;
+        }
+        _InterlockedExchange(&(lpCtx->nPaused), 1);
+        _InterlockedIncrement(&(lpCtx->nPausesCount));
+        ::SetEvent(lpCtx->hPausedEvent);
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT OnSinkBodyData(_In_opt_ LPCVOID lpData, _In_ SIZE_T nDataSize, _In_opt_ LPVOID lpUserParam)
+{
+    STREAMED_CONTEXT *lpCtx = (STREAMED_CONTEXT *)lpUserParam;
+
+    if (lpData == NULL)
+    {
+        return lpCtx->cSinkDigest.EndDigest();
+    }
+    lpCtx->nSinkReceived += (ULONGLONG)nDataSize;
+    return lpCtx->cSinkDigest.DigestStream(lpData, nDataSize);
+}
+
+static DWORD WINAPI ResumerThreadProc(_In_ LPVOID lpParameter)
+{
+    STREAMED_CONTEXT *lpCtx = (STREAMED_CONTEXT *)lpParameter;
+    HANDLE hEvents[2];
+    MX::CHttpServer::CClientRequest *lpRequest;
+
+    hEvents[0] = lpCtx->hStopEvent;
+    hEvents[1] = lpCtx->hPausedEvent;
+    while (::WaitForMultipleObjects(2, hEvents, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        // nothing must arrive while paused
+        ::Sleep(STREAMED_TEST_PAUSE_MS);
+
+        lpRequest = lpCtx->lpPausedRequest;
+        _InterlockedExchange(&(lpCtx->nPaused), 0);
+        if (lpRequest == NULL || FAILED(lpRequest->ResumeRequestBody()))
+        {
+            _InterlockedIncrement(&(lpCtx->nErrors));
+        }
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT CreateProxyClient(_In_ MX::CHttpServer::CClientRequest *lpRequest, _Out_ MX::CHttpClient **lplpClient)
+{
+    MX::TAutoRefCounted<MX::CHttpClient> cClient;
+    MX::CHttpHeaderEntContentLength *lpContentLengthHeader;
+    CHAR szBufA[64];
+    HRESULT hRes;
+
+    *lplpClient = NULL;
+
+    lpContentLengthHeader = lpRequest->GetRequestHeader<MX::CHttpHeaderEntContentLength>();
+    if (lpContentLengthHeader == NULL)
+    {
+        return MX_E_InvalidData;
+    }
+
+    cClient.Attach(MX_DEBUG_NEW MX::CHttpClient(*(lpStreamedCtx->lpSckMgr)));
+    if (!cClient)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // NOTE: The dynamic body needs its length up front and must be enabled before opening.
+    _snprintf_s(szBufA, _countof(szBufA), _TRUNCATE, "%I64u", lpContentLengthHeader->GetLength());
+    hRes = cClient->SetRequestMethod("POST");
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cClient->AddRequestHeader("Content-Length", szBufA);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cClient->AddRequestHeader("Content-Type", "application/octet-stream");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cClient->EnableDynamicPostData();
+    }
+    if (SUCCEEDED(hRes))
+    {
+        _snprintf_s(szBufA, _countof(szBufA), _TRUNCATE, "http://127.0.0.1:%lu/sink", lpStreamedCtx->dwPort);
+        hRes = cClient->Open(szBufA);
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // done
+    *lplpClient = cClient.Detach();
+    return S_OK;
+}
+
+static BOOL IsPath(_In_ MX::CHttpServer::CClientRequest *lpRequest, _In_z_ LPCWSTR szPathW)
+{
+    MX::CUrl *lpUrl = lpRequest->GetUrl();
+
+    return (lpUrl != NULL && MX::StrCompareW(lpUrl->GetPath(), szPathW) == 0) ? TRUE : FALSE;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestPauseAndResume(_In_ LPBYTE lpBody)
+{
+    LONG nStatus;
+    HRESULT hRes;
+
+    hRes = PostBody(lpStreamedCtx->dwPort, "/pause", lpBody, STREAMED_TEST_BODY_SIZE, &nStatus);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (nStatus != 200)
+    {
+        wprintf_s(L"\nError: Status %ld.", nStatus);
+        return E_FAIL;
+    }
+
+    // the body must have been paused a few times and nothing delivered while paused
+    if (__InterlockedRead(&(lpStreamedCtx->nPausesCount)) < STREAMED_TEST_BODY_SIZE / STREAMED_TEST_PAUSE_EVERY / 2 ||
+        __InterlockedRead(&(lpStreamedCtx->nDataWhilePaused)) != 0 || __InterlockedRead(&(lpStreamedCtx->nErrors)) != 0)
+    {
+        wprintf_s(L"\nError: %ld pauses, %ld blocks while paused and %ld errors.",
+                  __InterlockedRead(&(lpStreamedCtx->nPausesCount)), __InterlockedRead(&(lpStreamedCtx->nDataWhilePaused)),
+                  __InterlockedRead(&(lpStreamedCtx->nErrors)));
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestPipeToClient(_In_ LPBYTE lpBody)
+{
+    LONG nStatus;
+    DWORD dwWaitedMs;
+    HRESULT hRes;
+
+    hRes = PostBody(lpStreamedCtx->dwPort, "/proxy", lpBody, STREAMED_TEST_BODY_SIZE, &nStatus);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (nStatus != 200)
+    {
+        wprintf_s(L"\nError: Status %ld.", nStatus);
+        return E_FAIL;
+    }
+
+    // the upload may still be finishing
+    for (dwWaitedMs = 0; __InterlockedRead(&(lpStreamedCtx->nSinkResult)) == 0; dwWaitedMs += 10)
+    {
+        if (dwWaitedMs >= STREAMED_TEST_WAIT_MS)
+        {
+            return MX_E_Timeout;
+        }
+        ::Sleep(10);
+    }
+    if (__InterlockedRead(&(lpStreamedCtx->nSinkResult)) != 1)
+    {
+        wprintf_s(L"\nError: The uploaded body does not match (%I64u bytes).", lpStreamedCtx->nSinkReceived);
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT PostBody(_In_ DWORD dwPort, _In_z_ LPCSTR szPathA, _In_ LPBYTE lpBody, _In_ SIZE_T nBodySize,
+                        _Out_ LONG *lpnStatus)
+{
+    CHAR szBufA[1024];
+    SOCKADDR_IN sAddr;
+    SOCKET sck;
+    SIZE_T nOffset, nToSend, nReceived;
+    DWORD dwTimeoutMs = STREAMED_TEST_WAIT_MS;
+    HRESULT hRes;
+    int r;
+
+    *lpnStatus = 0;
+
+    r = _snprintf_s(szBufA, _countof(szBufA), _TRUNCATE,
+                    "POST %s HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/octet-stream\r\n"
+                    "Content-Length: %Iu\r\nConnection: close\r\n\r\n", szPathA, nBodySize);
+    if (r < 0)
+    {
+        return MX_E_BufferOverflow;
+    }
+
+    sck = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sck == INVALID_SOCKET)
+    {
+        return MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    }
+    ::setsockopt(sck, SOL_SOCKET, SO_RCVTIMEO, (const char *)&dwTimeoutMs, (int)sizeof(dwTimeoutMs));
+    ::setsockopt(sck, SOL_SOCKET, SO_SNDTIMEO, (const char *)&dwTimeoutMs, (int)sizeof(dwTimeoutMs));
+    ::MxMemSet(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_port = htons((u_short)dwPort);
+    sAddr.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(sck, (const sockaddr *)&sAddr, (int)sizeof(sAddr)) == SOCKET_ERROR ||
+        ::send(sck, szBufA, r, 0) == SOCKET_ERROR)
+    {
+        goto err_wsa;
+    }
+
+    // NOTE: Sends block while the server keeps the body paused.
+    for (nOffset = 0; nOffset < nBodySize; nOffset += nToSend)
+    {
+        nToSend = (nBodySize - nOffset > STREAMED_TEST_SEND_CHUNK) ? STREAMED_TEST_SEND_CHUNK : (nBodySize - nOffset);
+        r = ::send(sck, (const char *)(lpBody + nOffset), (int)nToSend, 0);
+        if (r == SOCKET_ERROR)
+        {
+            goto err_wsa;
+        }
+        nToSend = (SIZE_T)r;
+    }
+
+    // only the status line matters
+    nReceived = 0;
+    while (nReceived < 12)
+    {
+        r = ::recv(sck, szBufA + nReceived, (int)(sizeof(szBufA) - 1 - nReceived), 0);
+        if (r <= 0)
+        {
+            hRes = (r == 0) ? MX_E_BrokenPipe : MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+            ::closesocket(sck);
+            return hRes;
+        }
+        nReceived += (SIZE_T)r;
+    }
+    ::closesocket(sck);
+
+    if (MX::StrNCompareA(szBufA, "HTTP/1.1 ", 9) != 0)
+    {
+        return MX_E_InvalidData;
+    }
+    *lpnStatus = (LONG)(szBufA[9] - '0') * 100 + (LONG)(szBufA[10] - '0') * 10 + (LONG)(szBufA[11] - '0');
+
+    // done
+    return S_OK;
+
+err_wsa:
+    hRes = MX_HRESULT_FROM_WIN32(::WSAGetLastError());
+    ::closesocket(sck);
+    return hRes;
+}
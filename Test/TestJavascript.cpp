@@ -24,6 +24,8 @@
 
  //-----------------------------------------------------------
 
+static HRESULT TestNativeJson(_In_ MX::CJavascriptVM &cJvm);
+
 static HRESULT OnRequireModule(_In_ DukTape::duk_context *lpCtx, _In_ MX::CJavascriptVM::CRequireModuleContext *lpReqCtx,
                                _Inout_ MX::CStringA &cStrCodeA);
 
@@ -174,10 +176,94 @@ int TestJavascript()
         wprintf_s(L"%S\n", e.GetStackTrace());
     }
 
+    //--------
+
+    wprintf_s(L"Testing NativeJSON against JSON... ");
+    hRes = TestNativeJson(cJvm);
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: %08X\n", hRes);
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
     // done
     return (int)S_OK;
 }
 
+static HRESULT TestNativeJson(_In_ MX::CJavascriptVM &cJvm)
+{
+    HRESULT hRes;
+
+    hRes = cJvm.AddNativeJsonSupport();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // every value must encode to the same text as the built-in encoder and decode to the same value
+    try
+    {
+        cJvm.Run("(function () {\n"
+                 "  function check(what, actual, expected) {\n"
+                 "    if (actual !== expected) {\n"
+                 "      throw new Error(what + ': ' + actual + ' != ' + expected);\n"
+                 "    }\n"
+                 "  }\n"
+                 "  var values = [\n"
+                 "    null, true, false, 0, -0, -1, 1.25, 0.1, 1e20, 1e21, 1e-6, 1e-7, 123456789012,\n"
+                 "    -9007199254740993, NaN, Infinity, -Infinity, '', 'plain', 'User \\u00e1',\n"
+                 "    'quote \\\" backslash \\\\ slash /', 'ctrl \\u0001\\b\\f\\n\\r\\t\\u001f', 'sep \\u2028\\u2029',\n"
+                 "    [], {}, [1, 'a', null, [2, [3]]], { a: 1, b: { c: [true, false] }, d: 'x' },\n"
+                 "    [undefined, function () {}], { u: undefined, f: function () {}, n: null },\n"
+                 "    new Date(0), new Number(5), new String('s'), new Boolean(false),\n"
+                 "    { toJSON: function () { return 'custom'; } }, undefined\n"
+                 "  ];\n"
+                 "  for (var i = 0; i < values.length; i++) {\n"
+                 "    var text = JSON.stringify(values[i]);\n"
+                 "    check('stringify #' + i, NativeJSON.stringify(values[i]), text);\n"
+                 "    check('indented stringify #' + i, NativeJSON.stringify(values[i], null, 2),\n"
+                 "          JSON.stringify(values[i], null, 2));\n"
+                 "    if (text !== undefined) {\n"
+                 "      check('parse #' + i, JSON.stringify(NativeJSON.parse(text)),\n"
+                 "            JSON.stringify(JSON.parse(text)));\n"
+                 "    }\n"
+                 "  }\n"
+                 "  var texts = [\n"
+                 "    '{\"k\":\"\\\\ud83d\\\\ude00\",\"e\":\"\\\\u00e1\\\\n\",\"n\":[1e2,-0.5,18446744073709551615]}',\n"
+                 "    ' [ 1 , 2 ] ', '\"\\\\u2028\"', '{\"a\":{\"a\":{\"a\":[[[]]]}}}', '-1.5E-3'\n"
+                 "  ];\n"
+                 "  for (i = 0; i < texts.length; i++) {\n"
+                 "    check('text #' + i, JSON.stringify(NativeJSON.parse(texts[i])),\n"
+                 "          JSON.stringify(JSON.parse(texts[i])));\n"
+                 "  }\n"
+                 "  var invalid = [ '', '[1,', '{\"a\" 1}', 'tru', '[1]x', '\"\\\\u12\"' ];\n"
+                 "  for (i = 0; i < invalid.length; i++) {\n"
+                 "    var failed = false;\n"
+                 "    try {\n"
+                 "      NativeJSON.parse(invalid[i]);\n"
+                 "    }\n"
+                 "    catch (err) {\n"
+                 "      failed = true;\n"
+                 "    }\n"
+                 "    check('invalid #' + i, failed, true);\n"
+                 "  }\n"
+                 "})();\n");
+    }
+    catch (MX::CJsWindowsError &e)
+    {
+        return e.GetHResult();
+    }
+    catch (MX::CJsError &e)
+    {
+        wprintf_s(L"\n%S in %S(%lu)\n", e.GetDescription(), e.GetFileName(), e.GetLineNumber());
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
 static HRESULT OnRequireModule(_In_ DukTape::duk_context *lpCtx, _In_ MX::CJavascriptVM::CRequireModuleContext *lpReqCtx,
                                _Inout_ MX::CStringA &cStrCodeA)
 {
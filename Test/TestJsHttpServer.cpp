@@ -571,19 +571,13 @@ static HRESULT OnSessionPersistance(_In_ MX::CJsHttpServerSessionPlugin *lpPlugi
                                     _In_ MX::CJsHttpServerSessionPlugin::ePersistanceOption nPersistanceOption)
 {
     MX::CWindowsHandle cFileH;
-    MX::CStringA cStrNameA, cStrValueA;
     MX::CStringW cStrFileNameW;
     DWORD dw, dwWritten, dwReaded, dwOsErr, dwPass;
     MX::CDateTime cDt, cDtNow;
-    SIZE_T nLen, nIndex;
-    LPCSTR szNameA, szValueA;
-    union
-    {
-        BYTE aTempBuf[128];
-        CHAR szBufA[128];
-    };
-    double nDbl;
-    MX::CPropertyBag::eType nPropType;
+    LARGE_INTEGER liFileSize;
+    SIZE_T nLen;
+    CHAR szBufA[128];
+    LPBYTE lpData = NULL;
     BOOL bDelete;
     HRESULT hRes;
 
@@ -665,97 +659,23 @@ static HRESULT OnSessionPersistance(_In_ MX::CJsHttpServerSessionPlugin *lpPlugi
         if (cDtNow.GetDiff(cDt, MX::CDateTime::eUnits::Hours) >= 1)
             delete_and_exit(hRes = S_OK;);
 
-        // read fields
-        while (1)
-        {
-            if (::ReadFile(cFileH, szBufA, 1, &dwReaded, NULL) == FALSE)
-            {
-                return MX_HRESULT_FROM_LASTERROR();
-            }
-            if (dwReaded != 1)
-                delete_and_exit(hRes = MX_E_ReadFault;);
-            if (szBufA[0] == '*')
-            {
-                break;
-            }
+        // read the serialized bag
+        if (::GetFileSizeEx(cFileH, &liFileSize) == FALSE)
+            delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
+        if (liFileSize.QuadPart < 10 + 1 + 8 || liFileSize.QuadPart > 0x7FFFFFFFi64)
+            delete_and_exit(hRes = MX_E_InvalidData;);
+        dw = (DWORD)(liFileSize.QuadPart) - (10 + 1 + 8);
+        lpData = (LPBYTE)MX_MALLOC((dw > 0) ? (SIZE_T)dw : 1);
+        if (lpData == NULL)
+            delete_and_exit(hRes = E_OUTOFMEMORY;);
+        if (::ReadFile(cFileH, lpData, dw, &dwReaded, NULL) == FALSE)
+            delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
+        if (dwReaded != dw)
+            delete_and_exit(hRes = MX_E_ReadFault;);
 
-            // check type
-            if (szBufA[0] != 'N' && szBufA[0] != 'D' && szBufA[0] != 'S')
-                delete_and_exit(hRes = MX_E_InvalidData;);
-
-            // read name length
-            if (::ReadFile(cFileH, &dw, 4, &dwReaded, NULL) == FALSE)
-                delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-            if (dwReaded != 4)
-                delete_and_exit(hRes = MX_E_ReadFault;);
-
-            // check length
-            if (dw > 512)
-                delete_and_exit(hRes = MX_E_InvalidData;);
-
-            // read name
-            if (cStrNameA.EnsureBuffer((SIZE_T)(dw + 1)) == FALSE)
-                delete_and_exit(hRes = E_OUTOFMEMORY;);
-            if (::ReadFile(cFileH, (LPSTR)cStrNameA, dw, &dwReaded, NULL) == FALSE)
-                delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR());
-            if (dwReaded != dw)
-                delete_and_exit(hRes = MX_E_ReadFault;);
-            ((LPSTR)cStrNameA)[dw] = 0;
-            cStrNameA.Refresh();
-
-            // process value
-            switch (szBufA[0])
-            {
-                case 'N':
-                    // a null value
-                    // add property
-                    hRes = lpPlugin->GetBag()->SetNull((LPCSTR)cStrNameA);
-                    if (FAILED(hRes))
-                        delete_and_exit(;);
-                    break;
-
-                case 'D':
-                    // a double value
-                    if (::ReadFile(cFileH, &nDbl, (DWORD)sizeof(double), &dwReaded, NULL) == FALSE)
-                        delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR());
-                    if (dwReaded != (DWORD)sizeof(double))
-                        delete_and_exit(hRes = MX_E_ReadFault;);
-
-                    // add property
-                    hRes = lpPlugin->GetBag()->SetDouble((LPCSTR)cStrNameA, nDbl);
-                    if (FAILED(hRes))
-                        delete_and_exit(;);
-                    break;
-
-                case 'S':
-                    // a string value
-                    // read value length
-                    if (::ReadFile(cFileH, &dw, 4, &dwReaded, NULL) == FALSE)
-                        delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-                    if (dwReaded != 4)
-                        delete_and_exit(hRes = MX_E_ReadFault;);
-
-                    // check length
-                    if (dw > 0x7FFFFFFFUL)
-                        delete_and_exit(hRes = MX_E_InvalidData;);
-
-                    // read value
-                    if (cStrValueA.EnsureBuffer((SIZE_T)(dw + 1)) == FALSE)
-                        delete_and_exit(hRes = E_OUTOFMEMORY;);
-                    if (::ReadFile(cFileH, (LPSTR)cStrValueA, dw, &dwReaded, NULL) == FALSE)
-                        delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR());
-                    if (dwReaded != dw)
-                        delete_and_exit(hRes = MX_E_ReadFault;);
-                    ((LPSTR)cStrValueA)[dw] = 0;
-                    cStrValueA.Refresh();
-
-                    // add property
-                    hRes = lpPlugin->GetBag()->SetString((LPCSTR)cStrNameA, (LPCSTR)cStrValueA);
-                    if (FAILED(hRes))
-                        delete_and_exit(;);
-                    break;
-            }
-        }
+        hRes = lpPlugin->GetBag()->Deserialize(lpData, (SIZE_T)dw);
+        if (FAILED(hRes))
+            delete_and_exit(;);
     }
     else
     {
@@ -767,102 +687,25 @@ static HRESULT OnSessionPersistance(_In_ MX::CJsHttpServerSessionPlugin *lpPlugi
         if (dwWritten != 10 + 1 + 8)
             delete_and_exit(hRes = MX_E_WriteFault;);
 
-        // iterate each bag property
-        for (nIndex = 0; (szNameA = lpPlugin->GetBag()->GetAt(nIndex)) != NULL; nIndex++)
-        {
-            // get name length
-            nLen = MX::StrLenA(szNameA);
-            if (nLen >= 512)
-            {
-                continue; // ignore long names
-            }
-
-            // get property type
-            nPropType = lpPlugin->GetBag()->GetType(nIndex);
-            if (nPropType == MX::CPropertyBag::eType::Null)
-            {
-                szBufA[0] = 'N';
-            }
-            else if (nPropType == MX::CPropertyBag::eType::Double)
-            {
-                szBufA[0] = 'D';
-            }
-            else if (nPropType == MX::CPropertyBag::eType::AnsiString)
-            {
-                szBufA[0] = 'S';
-            }
-            else
-            {
-                continue;
-            }
-
-            // write type
-            if (::WriteFile(cFileH, szBufA, 1, &dwWritten, NULL) == FALSE)
-                delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-            if (dwWritten != 1)
-                delete_and_exit(hRes = MX_E_WriteFault;);
-
-            // write name length
-            dw = (DWORD)nLen;
-            if (::WriteFile(cFileH, &dw, 4, &dwWritten, NULL) == FALSE)
-                delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-            if (dwWritten != 4)
-                delete_and_exit(hRes = MX_E_WriteFault;);
-
-            // write name
-            if (::WriteFile(cFileH, szNameA, dw, &dwWritten, NULL) == FALSE)
-                delete_and_exit(MX_HRESULT_FROM_LASTERROR());
-            if (dwWritten != dw)
-                delete_and_exit(hRes = MX_E_WriteFault;);
-
-            // write data
-            switch (nPropType)
-            {
-                case MX::CPropertyBag::eType::Double:
-                    // get value
-                    hRes = lpPlugin->GetBag()->GetDouble(nIndex, nDbl);
-                    if (FAILED(hRes))
-                        delete_and_exit(;);
-
-                    // write value
-                    if (::WriteFile(cFileH, &nDbl, (DWORD)sizeof(nDbl), &dwWritten, NULL) == FALSE)
-                        delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-                    if (dwWritten != (DWORD)sizeof(nDbl))
-                        delete_and_exit(hRes = MX_E_WriteFault;);
-                    break;
-
-                case MX::CPropertyBag::eType::AnsiString:
-                    // get value
-                    hRes = lpPlugin->GetBag()->GetString(nIndex, szValueA);
-                    if (FAILED(hRes))
-                        delete_and_exit(;);
-
-                    // write value length
-                    nLen = MX::StrLenA(szValueA);
-                    dw = (nLen < 0x7FFFFFFFUL) ? (DWORD)nLen : 0x7FFFFFFFUL; // truncate long values
-                    if (::WriteFile(cFileH, &dw, 4, &dwWritten, NULL) == FALSE)
-                        delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-                    if (dwWritten != 4)
-                        delete_and_exit(hRes = MX_E_WriteFault;);
-
-                    // write value
-                    if (::WriteFile(cFileH, szValueA, dw, &dwWritten, NULL) == FALSE)
-                        delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-                    if (dwWritten != dw)
-                        delete_and_exit(hRes = MX_E_WriteFault;);
-                    break;
-            }
-        }
-
-        // write end of file mark
-        if (::WriteFile(cFileH, "*", 1, &dwWritten, NULL) == FALSE)
+        // write the serialized bag
+        nLen = lpPlugin->GetBag()->GetSerializedSize();
+        if (nLen > 0x7FFFFFFF)
+            delete_and_exit(hRes = MX_E_BufferOverflow;);
+        lpData = (LPBYTE)MX_MALLOC(nLen);
+        if (lpData == NULL)
+            delete_and_exit(hRes = E_OUTOFMEMORY;);
+        hRes = lpPlugin->GetBag()->Serialize(lpData, nLen);
+        if (FAILED(hRes))
+            delete_and_exit(;);
+        if (::WriteFile(cFileH, lpData, (DWORD)nLen, &dwWritten, NULL) == FALSE)
             delete_and_exit(hRes = MX_HRESULT_FROM_LASTERROR(););
-        if (dwWritten != 1)
+        if (dwWritten != (DWORD)nLen)
             delete_and_exit(hRes = MX_E_WriteFault;);
     }
     hRes = S_OK;
 
 done:
+    MX_FREE(lpData);
     if (bDelete != FALSE)
     {
         cFileH.Close();
@@ -0,0 +1,287 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestJsJwt.h"
+#include <JsLib\Plugins\JsonWebTokenPlugin.h>
+
+ //-----------------------------------------------------------
+
+#define JWT_DEFAULT_CACHE_SIZE 4096
+#define JWT_EVICTION_CACHE_SIZE 16
+#define JWT_EVICTION_TOKENS_COUNT 64
+
+//-----------------------------------------------------------
+
+static HRESULT TestCachedTokenExpiration(_In_ MX::CJavascriptVM &cJvm);
+static HRESULT TestSecretIsolation(_In_ MX::CJavascriptVM &cJvm);
+static HRESULT TestEviction(_In_ MX::CJavascriptVM &cJvm);
+
+static HRESULT RunCode(_In_ MX::CJavascriptVM &cJvm, _In_z_ LPCSTR szCodeA);
+
+//-----------------------------------------------------------
+
+int TestJsJwt()
+{
+    MX::CJavascriptVM cJvm;
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe JsJwt\n");
+        return 1;
+    }
+
+    hRes = cJvm.Initialize();
+    if (SUCCEEDED(hRes))
+    {
+        hRes = MX::CJsonWebTokenPlugin::Register(cJvm);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        // the expected failures are caught by the scripts themselves so any exception that reaches us is an error
+        hRes = RunCode(cJvm, "var secretA = 'test-secret-a';\n"
+                             "var secretB = 'test-secret-b';\n"
+                             "var options = { algorithm: 'HS256' };\n"
+                             "function mustFail(fn) {\n"
+                             "  var failed = false;\n"
+                             "  try { fn(); } catch (e) { failed = true; }\n"
+                             "  if (!failed) { throw new Error('Verification succeeded but it should fail'); }\n"
+                             "}\n");
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Unable to initialize the Javascript VM [0x%08X].\n", hRes);
+        return (int)hRes;
+    }
+
+    wprintf_s(L"Running Cached Token Expiration test... ");
+    hRes = TestCachedTokenExpiration(cJvm);
+    if (FAILED(hRes))
+    {
+on_error:
+        if (hRes == E_OUTOFMEMORY)
+        {
+            wprintf_s(L"\nError: Not enough memory.\n");
+        }
+        else
+        {
+            wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        }
+        MX::CJsonWebTokenPlugin::SetVerifyCacheSize(JWT_DEFAULT_CACHE_SIZE);
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Secret Isolation test... ");
+    hRes = TestSecretIsolation(cJvm);
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Cache Eviction test... ");
+    hRes = TestEviction(cJvm);
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    MX::CJsonWebTokenPlugin::SetVerifyCacheSize(JWT_DEFAULT_CACHE_SIZE);
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestCachedTokenExpiration(_In_ MX::CJavascriptVM &cJvm)
+{
+    MX::CJsonWebTokenPlugin::VERIFY_CACHE_STATS sStats[2];
+    HRESULT hRes;
+
+    MX::CJsonWebTokenPlugin::SetVerifyCacheSize(JWT_DEFAULT_CACHE_SIZE);
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[0]);
+
+    // the first verification caches the token and the second one must be served from the cache
+    hRes = RunCode(cJvm, "var token = JWT.create({ uid: 1 }, secretA, { algorithm: 'HS256', expiresAfter: '1h' });\n"
+                         "JWT.verify(token, secretA, options);\n"
+                         "JWT.verify(token, secretA, options);\n");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[1]);
+    if (sStats[1].nMisses != sStats[0].nMisses + 1 || sStats[1].nHits != sStats[0].nHits + 1 ||
+        sStats[1].nEntries != sStats[0].nEntries + 1)
+    {
+        return E_FAIL;
+    }
+
+    // once the token expires, the cached entry must be rejected even though its signature is known to be valid
+    // NOTE: The verification timestamp is moved forward instead of waiting for the real expiration.
+    hRes = RunCode(cJvm, "var later = new Date(Date.now() + 2 * 60 * 60 * 1000);\n"
+                         "mustFail(function () {\n"
+                         "  JWT.verify(token, secretA, { algorithm: 'HS256', timestamp: later });\n"
+                         "});\n");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[0]);
+    if (sStats[0].nHits != sStats[1].nHits + 1 || sStats[0].nMisses != sStats[1].nMisses)
+    {
+        return E_FAIL;
+    }
+
+    // the rejection must not poison the cached entry
+    hRes = RunCode(cJvm, "JWT.verify(token, secretA, { algorithm: 'HS256', timestamp: later, threshold: 3 * 60 * 60 });\n"
+                         "JWT.verify(token, secretA, options);\n");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[1]);
+    if (sStats[1].nHits != sStats[0].nHits + 2 || sStats[1].nMisses != sStats[0].nMisses)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestSecretIsolation(_In_ MX::CJavascriptVM &cJvm)
+{
+    MX::CJsonWebTokenPlugin::VERIFY_CACHE_STATS sStats[2];
+    HRESULT hRes;
+
+    MX::CJsonWebTokenPlugin::SetVerifyCacheSize(JWT_DEFAULT_CACHE_SIZE);
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[0]);
+
+    // cache the token with its own secret and then check none of the mismatching keys hits that entry
+    hRes = RunCode(cJvm, "var token = JWT.create({ uid: 2 }, secretA, { algorithm: 'HS256', expiresAfter: '1h' });\n"
+                         "var tokenB = JWT.create({ uid: 2 }, secretB, { algorithm: 'HS256', expiresAfter: '1h' });\n"
+                         "JWT.verify(token, secretA, options);\n"
+                         "mustFail(function () {\n"
+                         "  JWT.verify(token, secretB, options);\n"
+                         "});\n"
+                         "mustFail(function () {\n"
+                         "  JWT.verify(token, secretA, { algorithm: 'HS512' });\n"
+                         "});\n"
+                         "mustFail(function () {\n"
+                         "  JWT.verify(tokenB, secretA, options);\n"
+                         "});\n");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[1]);
+    if (sStats[1].nHits != sStats[0].nHits || sStats[1].nMisses != sStats[0].nMisses + 4 ||
+        sStats[1].nEntries != sStats[0].nEntries + 1)
+    {
+        return E_FAIL;
+    }
+
+    // the right secret must still hit the cached entry
+    hRes = RunCode(cJvm, "JWT.verify(token, secretA, options);\n");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[0]);
+    if (sStats[0].nHits != sStats[1].nHits + 1 || sStats[0].nMisses != sStats[1].nMisses)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestEviction(_In_ MX::CJavascriptVM &cJvm)
+{
+    MX::CJsonWebTokenPlugin::VERIFY_CACHE_STATS sStats[2];
+    CHAR szCodeA[512];
+    HRESULT hRes;
+
+    // a tiny cache leaves a single slot per shard so most of the tokens below must evict a previous one
+    MX::CJsonWebTokenPlugin::SetVerifyCacheSize(JWT_EVICTION_CACHE_SIZE);
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[0]);
+
+    _snprintf_s(szCodeA, _countof(szCodeA), _TRUNCATE,
+                "var tokens = [];\n"
+                "for (var i = 0; i < %lu; i++) {\n"
+                "  tokens.push(JWT.create({ uid: i }, secretA, { algorithm: 'HS256', expiresAfter: '1h' }));\n"
+                "}\n"
+                "for (var i = 0; i < tokens.length; i++) {\n"
+                "  JWT.verify(tokens[i], secretA, options);\n"
+                "}\n", JWT_EVICTION_TOKENS_COUNT);
+    hRes = RunCode(cJvm, szCodeA);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[1]);
+    if (sStats[1].nMisses != sStats[0].nMisses + JWT_EVICTION_TOKENS_COUNT ||
+        sStats[1].nEntries > JWT_EVICTION_CACHE_SIZE || sStats[1].nEvictions == sStats[0].nEvictions ||
+        (sStats[1].nEntries - sStats[0].nEntries) + (sStats[1].nEvictions - sStats[0].nEvictions) !=
+        JWT_EVICTION_TOKENS_COUNT)
+    {
+        return E_FAIL;
+    }
+
+    // evicted tokens must still verify and the cache must stay within its limit
+    hRes = RunCode(cJvm, "for (var i = 0; i < tokens.length; i++) {\n"
+                         "  JWT.verify(tokens[i], secretA, options);\n"
+                         "}\n");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    MX::CJsonWebTokenPlugin::GetVerifyCacheStats(&sStats[0]);
+    if (sStats[0].nHits + sStats[0].nMisses != sStats[1].nHits + sStats[1].nMisses + JWT_EVICTION_TOKENS_COUNT ||
+        sStats[0].nEntries > JWT_EVICTION_CACHE_SIZE)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT RunCode(_In_ MX::CJavascriptVM &cJvm, _In_z_ LPCSTR szCodeA)
+{
+    try
+    {
+        cJvm.Run(szCodeA);
+    }
+    catch (MX::CJsWindowsError &e)
+    {
+        return e.GetHResult();
+    }
+    catch (MX::CJsError &e)
+    {
+        wprintf_s(L"\n%S", e.GetDescription());
+        return E_FAIL;
+    }
+    return S_OK;
+}
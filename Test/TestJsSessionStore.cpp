@@ -0,0 +1,543 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestJsSessionStore.h"
+#include <JsHttpServer\Plugins\JsHttpServerSessionStore.h>
+
+ //-----------------------------------------------------------
+
+#define SESSION_ID_1 "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+#define SESSION_ID_2 "FFEEDDCCBBAA99887766554433221100FFEEDDCCBBAA99887766554433221100"
+#define SESSION_ID_3 "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+
+#define COMPACTION_TEST_SIZE 4096
+#define COMPACTION_TEST_SAVES_COUNT 2000
+#define COMPACTION_TEST_FLUSH_INTERVAL 100
+
+//-----------------------------------------------------------
+
+static HRESULT TestJournalReplay(_In_z_ LPCWSTR szJournalFileNameW);
+static HRESULT TestDirtyOnlySave(_In_z_ LPCWSTR szJournalFileNameW);
+static HRESULT TestExpiration(_In_z_ LPCWSTR szJournalFileNameW);
+static HRESULT TestJournalCompaction(_In_z_ LPCWSTR szJournalFileNameW);
+
+static HRESULT FillBag(_In_ MX::CPropertyBag &cBag);
+static HRESULT CheckBag(_In_ MX::CPropertyBag &cBag, _In_ DWORD dwExpectedDWord, _In_z_ LPCSTR szExpectedAnsiA,
+                        _In_ BOOL bExpectNull);
+static HRESULT FlushAndCheckJournal(_In_ MX::CJsHttpServerSessionStore &cStore);
+
+//-----------------------------------------------------------
+
+int TestJsSessionStore()
+{
+    MX::CStringW cStrJournalFileNameW;
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe JsSessionStore\n");
+        return 1;
+    }
+
+    hRes = GetAppPath(cStrJournalFileNameW);
+    if (SUCCEEDED(hRes))
+    {
+        if (cStrJournalFileNameW.Concat(L"TestSessions.journal") == FALSE)
+        {
+            hRes = E_OUTOFMEMORY;
+        }
+    }
+    if (FAILED(hRes))
+    {
+        wprintf_s(L"Error: Not enough memory.\n");
+        return (int)hRes;
+    }
+
+    wprintf_s(L"Running Journal Replay test... ");
+    hRes = TestJournalReplay((LPCWSTR)cStrJournalFileNameW);
+    if (FAILED(hRes))
+    {
+on_error:
+        if (hRes == E_OUTOFMEMORY)
+        {
+            wprintf_s(L"\nError: Not enough memory.\n");
+        }
+        else
+        {
+            wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        }
+        ::DeleteFileW((LPCWSTR)cStrJournalFileNameW);
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Dirty Only Save test... ");
+    hRes = TestDirtyOnlySave((LPCWSTR)cStrJournalFileNameW);
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Expiration test... ");
+    hRes = TestExpiration((LPCWSTR)cStrJournalFileNameW);
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Journal Compaction test... ");
+    hRes = TestJournalCompaction((LPCWSTR)cStrJournalFileNameW);
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    ::DeleteFileW((LPCWSTR)cStrJournalFileNameW);
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestJournalReplay(_In_z_ LPCWSTR szJournalFileNameW)
+{
+    MX::CPropertyBag cBag;
+    LPCSTR aszChangedNamesA[2] = { "dword", "null" };
+    HRESULT hRes;
+
+    ::DeleteFileW(szJournalFileNameW);
+
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(60 * 60, szJournalFileNameW);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FillBag(cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_1, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_2, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_3, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Delete(SESSION_ID_3);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+
+        // a changed name missing from the bag clears the stored property
+        hRes = cBag.SetDWord("dword", 2);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cBag.Clear("null");
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_1, cBag, aszChangedNamesA, MX_ARRAYLEN(aszChangedNamesA));
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FlushAndCheckJournal(cStore);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // restart from the journal
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(60 * 60, szJournalFileNameW);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Load(SESSION_ID_1, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = CheckBag(cBag, 2, "Hello World", FALSE);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Load(SESSION_ID_2, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = CheckBag(cBag, 1, "Hello World", TRUE);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (cStore.Load(SESSION_ID_3, cBag) != MX_E_NotFound)
+        {
+            return E_FAIL;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestDirtyOnlySave(_In_z_ LPCWSTR szJournalFileNameW)
+{
+    MX::CPropertyBag cBag, cLoadedBag;
+    MX::CJsHttpServerSessionStore::STATS sStats;
+    LPCSTR aszChangedNamesA[1] = { "dword" };
+    ULONGLONG nPropertiesSaved;
+    HRESULT hRes;
+
+    ::DeleteFileW(szJournalFileNameW);
+
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(60 * 60, szJournalFileNameW);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FillBag(cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_1, cBag);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        cStore.GetStats(&sStats);
+        nPropertiesSaved = sStats.nPropertiesSaved;
+
+        // only the reported property must be stored although the other one changed too
+        hRes = cBag.SetDWord("dword", 2);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cBag.SetString("ansi", "Not saved");
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_1, cBag, aszChangedNamesA, MX_ARRAYLEN(aszChangedNamesA));
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        cStore.GetStats(&sStats);
+        if (sStats.nPropertiesSaved != nPropertiesSaved + 1)
+        {
+            return E_FAIL;
+        }
+
+        hRes = cStore.Load(SESSION_ID_1, cLoadedBag);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = CheckBag(cLoadedBag, 2, "Hello World", TRUE);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FlushAndCheckJournal(cStore);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // the journal must not contain the unreported change either
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(60 * 60, szJournalFileNameW);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Load(SESSION_ID_1, cLoadedBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = CheckBag(cLoadedBag, 2, "Hello World", TRUE);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestExpiration(_In_z_ LPCWSTR szJournalFileNameW)
+{
+    MX::CPropertyBag cBag;
+    HRESULT hRes;
+
+    ::DeleteFileW(szJournalFileNameW);
+
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(1, szJournalFileNameW);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FillBag(cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_1, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Load(SESSION_ID_1, cBag);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+
+        ::Sleep(1500);
+        if (cStore.Load(SESSION_ID_1, cBag) != MX_E_NotFound)
+        {
+            return E_FAIL;
+        }
+
+        hRes = FillBag(cBag);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_2, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FlushAndCheckJournal(cStore);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // sessions that expired while the store was down must not be replayed
+    ::Sleep(1500);
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(1, szJournalFileNameW);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+        if (cStore.Load(SESSION_ID_1, cBag) != MX_E_NotFound || cStore.Load(SESSION_ID_2, cBag) != MX_E_NotFound)
+        {
+            return E_FAIL;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestJournalCompaction(_In_z_ LPCWSTR szJournalFileNameW)
+{
+    MX::CPropertyBag cBag;
+    MX::CJsHttpServerSessionStore::STATS sStats;
+    WIN32_FILE_ATTRIBUTE_DATA sFileAttrData;
+    LPCSTR aszChangedNamesA[1] = { "dword" };
+    HRESULT hRes;
+
+    ::DeleteFileW(szJournalFileNameW);
+
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(60 * 60, szJournalFileNameW, COMPACTION_TEST_SIZE);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FillBag(cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Save(SESSION_ID_1, cBag);
+        }
+        for (DWORD i = 1; SUCCEEDED(hRes) && i <= COMPACTION_TEST_SAVES_COUNT; i++)
+        {
+            hRes = cBag.SetDWord("dword", i);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cStore.Save(SESSION_ID_1, cBag, aszChangedNamesA, MX_ARRAYLEN(aszChangedNamesA));
+            }
+            if (SUCCEEDED(hRes) && (i % COMPACTION_TEST_FLUSH_INTERVAL) == 0)
+            {
+                hRes = FlushAndCheckJournal(cStore);
+            }
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = FlushAndCheckJournal(cStore);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+
+        // the rewritten journal only holds the live session plus the changes made after the last compaction
+        cStore.GetStats(&sStats);
+        if (sStats.nJournalCompactions == 0)
+        {
+            return E_FAIL;
+        }
+        if (::GetFileAttributesExW(szJournalFileNameW, GetFileExInfoStandard, &sFileAttrData) == FALSE)
+        {
+            return MX_HRESULT_FROM_LASTERROR();
+        }
+        if (sFileAttrData.nFileSizeHigh != 0 || (ULONGLONG)(sFileAttrData.nFileSizeLow) >= sStats.nJournalBytes)
+        {
+            return E_FAIL;
+        }
+    }
+
+    // restart from the compacted journal
+    {
+        MX::CJsHttpServerSessionStore cStore;
+
+        hRes = cStore.Initialize(60 * 60, szJournalFileNameW, COMPACTION_TEST_SIZE);
+        if (SUCCEEDED(hRes))
+        {
+            hRes = cStore.Load(SESSION_ID_1, cBag);
+        }
+        if (SUCCEEDED(hRes))
+        {
+            hRes = CheckBag(cBag, COMPACTION_TEST_SAVES_COUNT, "Hello World", TRUE);
+        }
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT FillBag(_In_ MX::CPropertyBag &cBag)
+{
+    HRESULT hRes;
+
+    cBag.Reset();
+    hRes = cBag.SetDWord("dword", 1);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetQWord("qword", 0x0123456789ABCDEFui64);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetDouble("double", -1.5);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetString("ansi", "Hello World");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetString("wide", L"Hello \x00E1\x00E9\x00ED");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetNull("null");
+    }
+    return hRes;
+}
+
+static HRESULT CheckBag(_In_ MX::CPropertyBag &cBag, _In_ DWORD dwExpectedDWord, _In_z_ LPCSTR szExpectedAnsiA,
+                        _In_ BOOL bExpectNull)
+{
+    DWORD dw;
+    ULONGLONG ull;
+    double nDbl;
+    LPCSTR szValueA;
+    LPCWSTR szValueW;
+
+    if (cBag.GetCount() != ((bExpectNull != FALSE) ? 6 : 5))
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetDWord("dword", dw)) || dw != dwExpectedDWord)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetQWord("qword", ull)) || ull != 0x0123456789ABCDEFui64)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetDouble("double", nDbl)) || nDbl != -1.5)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetString("ansi", szValueA)) || MX::StrCompareA(szValueA, szExpectedAnsiA) != 0)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetString("wide", szValueW)) || MX::StrCompareW(szValueW, L"Hello \x00E1\x00E9\x00ED") != 0)
+    {
+        return E_FAIL;
+    }
+    if (cBag.GetType("null") != ((bExpectNull != FALSE) ? MX::CPropertyBag::eType::Null
+                                                         : MX::CPropertyBag::eType::Undefined))
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT FlushAndCheckJournal(_In_ MX::CJsHttpServerSessionStore &cStore)
+{
+    MX::CJsHttpServerSessionStore::STATS sStats;
+    HRESULT hRes;
+
+    hRes = cStore.FlushJournal();
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    cStore.GetStats(&sStats);
+    if (sStats.nJournalBytes == 0 || sStats.nJournalWriteErrors != 0)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
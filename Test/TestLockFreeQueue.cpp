@@ -0,0 +1,433 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestLockFreeQueue.h"
+#include <LockFreeQueue.h>
+#include <Threads.h>
+
+ //-----------------------------------------------------------
+
+#define STRESS_THREADS_COUNT 8
+#define STRESS_ITEMS_COUNT 200000
+#define FREELIST_NODES_COUNT 1000
+
+//-----------------------------------------------------------
+
+typedef struct tagSTRESS_ITEM
+{
+    MX::CLockFreeNode cNode;
+    DWORD dwProducer;
+    DWORD dwSequence;
+    LONG volatile nInUse;
+} STRESS_ITEM;
+
+typedef struct tagSTRESS_CONTEXT
+{
+    DWORD dwThreadIndex;
+    STRESS_ITEM *lpItems;
+    MX::CLockFreeMpscQueue *lpMpscQueue;
+    MX::CLockFreeStack *lpStack;
+    MX::TLockFreeMpmcQueue<DWORD> *lpMpmcQueue;
+    LONG volatile *lpnConsumed;
+    LONGLONG volatile *lpnSum;
+    LONG volatile *lpnErrors;
+} STRESS_CONTEXT;
+
+typedef struct tagSTRESS_THREADS
+{
+    MX::CWorkerThread aThreads[STRESS_THREADS_COUNT];
+    STRESS_CONTEXT aContexts[STRESS_THREADS_COUNT];
+    DWORD dwStarted;
+} STRESS_THREADS;
+
+//-----------------------------------------------------------
+
+static HRESULT TestMpscQueue();
+static HRESULT TestStack();
+static HRESULT TestMpmcQueue();
+
+static HRESULT StartStressThreads(_In_ STRESS_THREADS *lpThreads, _In_ MX::CWorkerThread::lpfnWorkerThread lpfnRoutine,
+                                  _In_ STRESS_CONTEXT *lpCtx);
+static VOID WaitStressThreads(_In_ STRESS_THREADS *lpThreads);
+static VOID MpscProducerThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam);
+static VOID StackThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam);
+static VOID MpmcThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam);
+
+//-----------------------------------------------------------
+
+int TestLockFreeQueue()
+{
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe LockFreeQueue\n");
+        return 1;
+    }
+
+    wprintf_s(L"Running MPSC queue stress test... ");
+    hRes = TestMpscQueue();
+    if (FAILED(hRes))
+    {
+on_error:
+        if (hRes == E_OUTOFMEMORY)
+        {
+            wprintf_s(L"\nError: Not enough memory.\n");
+        }
+        else
+        {
+            wprintf_s(L"\nError: Failed.\n");
+        }
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running free list stress test... ");
+    hRes = TestStack();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running MPMC queue stress test... ");
+    hRes = TestMpmcQueue();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+// NOTE: Many producers push numbered items while this thread consumes them. Items of the same producer must come out
+//       in the order they were pushed and none can be lost.
+static HRESULT TestMpscQueue()
+{
+    MX::CLockFreeMpscQueue cQueue;
+    STRESS_THREADS sThreads;
+    STRESS_CONTEXT sCtx;
+    DWORD aNextSequence[STRESS_THREADS_COUNT];
+    STRESS_ITEM *lpItem;
+    MX::CLockFreeNode *lpNode;
+    DWORD dwConsumed;
+    HRESULT hRes;
+
+    ::MxMemSet(&sCtx, 0, sizeof(sCtx));
+    sCtx.lpItems = MX_DEBUG_NEW STRESS_ITEM[STRESS_THREADS_COUNT * STRESS_ITEMS_COUNT];
+    if (sCtx.lpItems == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    sCtx.lpMpscQueue = &cQueue;
+    sThreads.dwStarted = 0;
+    ::MxMemSet(aNextSequence, 0, sizeof(aNextSequence));
+
+    if (cQueue.IsEmpty() == FALSE || cQueue.Pop() != NULL)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+
+    hRes = StartStressThreads(&sThreads, &MpscProducerThreadProc, &sCtx);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+
+    dwConsumed = 0;
+    while (dwConsumed < STRESS_THREADS_COUNT * STRESS_ITEMS_COUNT)
+    {
+        lpNode = cQueue.Pop();
+        if (lpNode == NULL)
+        {
+            ::YieldProcessor();
+            continue;
+        }
+        lpItem = CONTAINING_RECORD(lpNode, STRESS_ITEM, cNode);
+        if (lpItem->dwProducer >= STRESS_THREADS_COUNT || lpItem->dwSequence != aNextSequence[lpItem->dwProducer])
+        {
+            hRes = E_FAIL;
+            break;
+        }
+        aNextSequence[lpItem->dwProducer]++;
+        dwConsumed++;
+    }
+
+    // wait for the producers before checking the queue is empty
+    WaitStressThreads(&sThreads);
+    if (SUCCEEDED(hRes) && (cQueue.Pop() != NULL || cQueue.IsEmpty() == FALSE))
+    {
+        hRes = E_FAIL;
+    }
+
+done:
+    WaitStressThreads(&sThreads);
+    delete[] sCtx.lpItems;
+    return hRes;
+}
+
+// NOTE: Threads continuously pop nodes from a shared free list and push them back, the pattern that triggers the ABA
+//       problem. A node handed out to two threads at the same time, or lost, means the tagged head failed.
+static HRESULT TestStack()
+{
+    MX::CLockFreeStack cStack;
+    STRESS_THREADS sThreads;
+    STRESS_CONTEXT sCtx;
+    LONG volatile nErrors = 0;
+    MX::CLockFreeNode *lpNode;
+    SIZE_T nCount;
+    HRESULT hRes;
+
+    ::MxMemSet(&sCtx, 0, sizeof(sCtx));
+    sCtx.lpItems = MX_DEBUG_NEW STRESS_ITEM[FREELIST_NODES_COUNT];
+    if (sCtx.lpItems == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    sCtx.lpStack = &cStack;
+    sCtx.lpnErrors = &nErrors;
+    sThreads.dwStarted = 0;
+
+    if (cStack.Pop() != NULL || cStack.PopAll() != NULL)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+    for (SIZE_T i = 0; i < FREELIST_NODES_COUNT; i++)
+    {
+        sCtx.lpItems[i].nInUse = 0;
+        cStack.Push(&(sCtx.lpItems[i].cNode));
+    }
+    if (cStack.GetCount() != FREELIST_NODES_COUNT)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+
+    hRes = StartStressThreads(&sThreads, &StackThreadProc, &sCtx);
+    WaitStressThreads(&sThreads);
+    if (FAILED(hRes))
+    {
+        goto done;
+    }
+    if (__InterlockedRead(&nErrors) != 0 || cStack.GetCount() != FREELIST_NODES_COUNT)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+
+    nCount = 0;
+    for (lpNode = cStack.PopAll(); lpNode != NULL; lpNode = lpNode->GetNext())
+    {
+        nCount++;
+    }
+    if (nCount != FREELIST_NODES_COUNT || cStack.GetCount() != 0)
+    {
+        hRes = E_FAIL;
+    }
+
+done:
+    delete[] sCtx.lpItems;
+    return hRes;
+}
+
+// NOTE: Half of the threads push numbers through a small queue while the other half pop them. The sum of the popped
+//       values must match the pushed ones.
+static HRESULT TestMpmcQueue()
+{
+    MX::TLockFreeMpmcQueue<DWORD> cQueue;
+    STRESS_THREADS sThreads;
+    STRESS_CONTEXT sCtx;
+    LONG volatile nConsumed = 0;
+    LONGLONG volatile nSum = 0;
+    LONGLONG nExpectedSum;
+    DWORD dw;
+    HRESULT hRes;
+
+    // bounds
+    hRes = cQueue.Initialize(3);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (cQueue.GetCapacity() != 4 || cQueue.Pop(dw) != FALSE)
+    {
+        return E_FAIL;
+    }
+    for (dw = 0; dw < 4; dw++)
+    {
+        if (cQueue.Push(dw) == FALSE)
+        {
+            return E_FAIL;
+        }
+    }
+    if (cQueue.Push(4) != FALSE || cQueue.GetCount() != 4)
+    {
+        return E_FAIL;
+    }
+    for (DWORD i = 0; i < 4; i++)
+    {
+        if (cQueue.Pop(dw) == FALSE || dw != i)
+        {
+            return E_FAIL;
+        }
+    }
+    if (cQueue.Pop(dw) != FALSE || cQueue.Initialize(16) != MX_E_AlreadyInitialized)
+    {
+        return E_FAIL;
+    }
+
+    // concurrency, the queue wraps around many times
+    ::MxMemSet(&sCtx, 0, sizeof(sCtx));
+    sCtx.lpMpmcQueue = &cQueue;
+    sCtx.lpnConsumed = &nConsumed;
+    sCtx.lpnSum = &nSum;
+    sThreads.dwStarted = 0;
+
+    hRes = StartStressThreads(&sThreads, &MpmcThreadProc, &sCtx);
+    WaitStressThreads(&sThreads);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    nExpectedSum = (LONGLONG)(STRESS_THREADS_COUNT / 2) * (LONGLONG)STRESS_ITEMS_COUNT *
+                   (LONGLONG)(STRESS_ITEMS_COUNT + 1) / 2;
+    if (__InterlockedRead64(&nSum) != nExpectedSum || cQueue.Pop(dw) != FALSE || cQueue.GetCount() != 0)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT StartStressThreads(_In_ STRESS_THREADS *lpThreads, _In_ MX::CWorkerThread::lpfnWorkerThread lpfnRoutine,
+                                  _In_ STRESS_CONTEXT *lpCtx)
+{
+    for (lpThreads->dwStarted = 0; lpThreads->dwStarted < STRESS_THREADS_COUNT; lpThreads->dwStarted++)
+    {
+        DWORD i = lpThreads->dwStarted;
+
+        lpThreads->aContexts[i] = *lpCtx;
+        lpThreads->aContexts[i].dwThreadIndex = i;
+        if (lpThreads->aThreads[i].SetRoutine(lpfnRoutine, &(lpThreads->aContexts[i])) == FALSE ||
+            lpThreads->aThreads[i].Start() == FALSE)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+    return S_OK;
+}
+
+static VOID WaitStressThreads(_In_ STRESS_THREADS *lpThreads)
+{
+    for (DWORD i = 0; i < lpThreads->dwStarted; i++)
+    {
+        lpThreads->aThreads[i].Wait(INFINITE);
+    }
+    lpThreads->dwStarted = 0;
+    return;
+}
+
+static VOID MpscProducerThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam)
+{
+    STRESS_CONTEXT *lpCtx = (STRESS_CONTEXT *)lpParam;
+    STRESS_ITEM *lpItem = lpCtx->lpItems + (SIZE_T)(lpCtx->dwThreadIndex) * STRESS_ITEMS_COUNT;
+
+    UNREFERENCED_PARAMETER(lpWrkThread);
+
+    for (DWORD i = 0; i < STRESS_ITEMS_COUNT; i++, lpItem++)
+    {
+        lpItem->dwProducer = lpCtx->dwThreadIndex;
+        lpItem->dwSequence = i;
+        lpCtx->lpMpscQueue->Push(&(lpItem->cNode));
+    }
+    return;
+}
+
+static VOID StackThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam)
+{
+    STRESS_CONTEXT *lpCtx = (STRESS_CONTEXT *)lpParam;
+    MX::CLockFreeNode *lpNode;
+    STRESS_ITEM *lpItem;
+
+    UNREFERENCED_PARAMETER(lpWrkThread);
+
+    for (DWORD i = 0; i < STRESS_ITEMS_COUNT; i++)
+    {
+        lpNode = lpCtx->lpStack->Pop();
+        if (lpNode == NULL)
+        {
+            ::YieldProcessor();
+            continue;
+        }
+        lpItem = CONTAINING_RECORD(lpNode, STRESS_ITEM, cNode);
+        if (_InterlockedExchange(&(lpItem->nInUse), 1) != 0)
+        {
+            _InterlockedIncrement(lpCtx->lpnErrors);
+        }
+        ::YieldProcessor();
+        _InterlockedExchange(&(lpItem->nInUse), 0);
+        lpCtx->lpStack->Push(lpNode);
+    }
+    return;
+}
+
+static VOID MpmcThreadProc(_In_ MX::CWorkerThread *lpWrkThread, _In_ LPVOID lpParam)
+{
+    STRESS_CONTEXT *lpCtx = (STRESS_CONTEXT *)lpParam;
+    DWORD dwValue;
+
+    UNREFERENCED_PARAMETER(lpWrkThread);
+
+    if ((lpCtx->dwThreadIndex & 1) == 0)
+    {
+        for (dwValue = 1; dwValue <= STRESS_ITEMS_COUNT; dwValue++)
+        {
+            while (lpCtx->lpMpmcQueue->Push(dwValue) == FALSE)
+            {
+                ::YieldProcessor();
+            }
+        }
+    }
+    else
+    {
+        while (__InterlockedRead(lpCtx->lpnConsumed) < (STRESS_THREADS_COUNT / 2) * STRESS_ITEMS_COUNT)
+        {
+            if (lpCtx->lpMpmcQueue->Pop(dwValue) != FALSE)
+            {
+                _InterlockedExchangeAdd64(lpCtx->lpnSum, (LONGLONG)dwValue);
+                _InterlockedIncrement(lpCtx->lpnConsumed);
+            }
+            else
+            {
+                ::YieldProcessor();
+            }
+        }
+    }
+    return;
+}
@@ -0,0 +1,557 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestPropertyBag.h"
+#include <PropertyBag.h>
+
+ //-----------------------------------------------------------
+
+#define MANY_PROPERTIES_COUNT 2000
+
+//-----------------------------------------------------------
+
+static HRESULT TestSetAndGet();
+static HRESULT TestManyProperties();
+static HRESULT TestSerializeRoundTrip();
+static HRESULT TestDeserializeInvalidData();
+
+static HRESULT FillBag(_In_ MX::CPropertyBag &cBag);
+static HRESULT CompareBags(_In_ MX::CPropertyBag &cBag1, _In_ MX::CPropertyBag &cBag2);
+static HRESULT SerializeBag(_In_ MX::CPropertyBag &cBag, _Out_ LPBYTE *lplpData, _Out_ SIZE_T *lpnDataLen);
+
+//-----------------------------------------------------------
+
+int TestPropertyBag()
+{
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe PropertyBag\n");
+        return 1;
+    }
+
+    wprintf_s(L"Running Set and Get test... ");
+    hRes = TestSetAndGet();
+    if (FAILED(hRes))
+    {
+on_error:
+        if (hRes == E_OUTOFMEMORY)
+        {
+            wprintf_s(L"\nError: Not enough memory.\n");
+        }
+        else
+        {
+            wprintf_s(L"\nError: Failed.\n");
+        }
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Many Properties test... ");
+    hRes = TestManyProperties();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Serialize Round Trip test... ");
+    hRes = TestSerializeRoundTrip();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running Deserialize Invalid Data test... ");
+    hRes = TestDeserializeInvalidData();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestSetAndGet()
+{
+    MX::CPropertyBag cBag;
+    DWORD dw;
+    ULONGLONG ull;
+    double nDbl;
+    LPCSTR szValueA;
+    LPCWSTR szValueW;
+    HRESULT hRes;
+
+    hRes = FillBag(cBag);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (cBag.GetCount() != 7)
+    {
+        return E_FAIL;
+    }
+
+    // names are case-insensitive
+    if (FAILED(cBag.GetDWord("DWORD", dw)) || dw != 0xDEADBEEFUL)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetQWord("qWord", ull)) || ull != 0x0123456789ABCDEFui64)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetDouble("double", nDbl)) || nDbl != -1.5)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetString("ansi", szValueA)) || MX::StrCompareA(szValueA, "Hello World") != 0)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetString("wide", szValueW)) || MX::StrCompareW(szValueW, L"Hello \x00E1\x00E9\x00ED") != 0)
+    {
+        return E_FAIL;
+    }
+    if (cBag.GetType("null") != MX::CPropertyBag::eType::Null)
+    {
+        return E_FAIL;
+    }
+
+    // type mismatches and missing properties return the default value
+    if (cBag.GetDWord("ansi", dw, 5) != E_FAIL || dw != 5)
+    {
+        return E_FAIL;
+    }
+    if (cBag.GetDWord("missing", dw, 7) != MX_E_NotFound || dw != 7)
+    {
+        return E_FAIL;
+    }
+
+    // overwriting keeps the position and may change the type
+    hRes = cBag.SetString("DWord", "now a string");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (cBag.GetCount() != 7 || MX::StrCompareA(cBag.GetAt(0), "dword") != 0 ||
+        cBag.GetType((SIZE_T)0) != MX::CPropertyBag::eType::AnsiString)
+    {
+        return E_FAIL;
+    }
+    hRes = cBag.SetDWord("ansi", 10);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (FAILED(cBag.GetDWord("ANSI", dw)) || dw != 10)
+    {
+        return E_FAIL;
+    }
+
+    // clear
+    if (FAILED(cBag.Clear("Null")) || cBag.Clear("null") != MX_E_NotFound)
+    {
+        return E_FAIL;
+    }
+    if (cBag.GetCount() != 6 || cBag.GetType("null") != MX::CPropertyBag::eType::Undefined)
+    {
+        return E_FAIL;
+    }
+
+    // only ASCII letters are folded, "\xC3\x81" (U+00C1) and "\xC3\xA1" (U+00E1) are different names
+    if (FAILED(cBag.SetDWord("\xC3\x81rbol", 1)) || FAILED(cBag.SetDWord("\xC3\xA1RBOL", 2)) || cBag.GetCount() != 8)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.GetDWord("\xC3\x81RBOL", dw)) || dw != 1 || FAILED(cBag.GetDWord("\xC3\xA1rbol", dw)) || dw != 2)
+    {
+        return E_FAIL;
+    }
+    if (FAILED(cBag.Clear("\xC3\x81rbol")) || FAILED(cBag.Clear("\xC3\xA1rbol")))
+    {
+        return E_FAIL;
+    }
+
+    // invalid names
+    if (cBag.SetDWord("", 1) != E_INVALIDARG || cBag.SetDWord(NULL, 1) != E_POINTER)
+    {
+        return E_FAIL;
+    }
+
+    cBag.Reset();
+    if (cBag.GetCount() != 0 || cBag.GetAt(0) != NULL)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestManyProperties()
+{
+    MX::CPropertyBag cBag;
+    CHAR szNameA[32];
+    DWORD dw;
+    HRESULT hRes;
+
+    for (DWORD i = 0; i < MANY_PROPERTIES_COUNT; i++)
+    {
+        _snprintf_s(szNameA, _countof(szNameA), _TRUNCATE, "property_%lu", i);
+        hRes = ((i & 1) != 0) ? cBag.SetDWord(szNameA, i) : cBag.SetString(szNameA, szNameA);
+        if (FAILED(hRes))
+        {
+            return hRes;
+        }
+    }
+
+    // enumeration follows the insertion order
+    for (DWORD i = 0; i < MANY_PROPERTIES_COUNT; i++)
+    {
+        _snprintf_s(szNameA, _countof(szNameA), _TRUNCATE, "property_%lu", i);
+        if (MX::StrCompareA(cBag.GetAt((SIZE_T)i), szNameA) != 0)
+        {
+            return E_FAIL;
+        }
+    }
+
+    // clear every property but one in three so probe sequences get shifted and the arena is compacted
+    for (DWORD i = 0; i < MANY_PROPERTIES_COUNT; i++)
+    {
+        if ((i % 3) != 0)
+        {
+            _snprintf_s(szNameA, _countof(szNameA), _TRUNCATE, "PROPERTY_%lu", i);
+            hRes = cBag.Clear(szNameA);
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+        }
+    }
+    if (cBag.GetCount() != (MANY_PROPERTIES_COUNT + 2) / 3)
+    {
+        return E_FAIL;
+    }
+    for (DWORD i = 0; i < MANY_PROPERTIES_COUNT; i++)
+    {
+        _snprintf_s(szNameA, _countof(szNameA), _TRUNCATE, "property_%lu", i);
+        if ((i % 3) != 0)
+        {
+            if (cBag.GetType(szNameA) != MX::CPropertyBag::eType::Undefined)
+            {
+                return E_FAIL;
+            }
+        }
+        else if ((i & 1) != 0)
+        {
+            if (FAILED(cBag.GetDWord(szNameA, dw)) || dw != i)
+            {
+                return E_FAIL;
+            }
+        }
+        else
+        {
+            LPCSTR szValueA;
+
+            if (FAILED(cBag.GetString(szNameA, szValueA)) || MX::StrCompareA(szValueA, szNameA) != 0)
+            {
+                return E_FAIL;
+            }
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestSerializeRoundTrip()
+{
+    MX::CPropertyBag cBag, cBag2;
+    LPBYTE lpData = NULL;
+    SIZE_T nDataLen;
+    HRESULT hRes;
+
+    // an empty bag
+    hRes = SerializeBag(cBag, &lpData, &nDataLen);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag2.Deserialize(lpData, nDataLen);
+    }
+    MX_FREE(lpData);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (cBag2.GetCount() != 0)
+    {
+        return E_FAIL;
+    }
+
+    // all the types
+    hRes = FillBag(cBag);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SerializeBag(cBag, &lpData, &nDataLen);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        // a small buffer must fail without writing past it
+        if (cBag.Serialize(lpData, nDataLen - 1) != MX_E_BufferOverflow)
+        {
+            hRes = E_FAIL;
+        }
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag2.Deserialize(lpData, nDataLen);
+    }
+    MX_FREE(lpData);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = CompareBags(cBag, cBag2);
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // deserializing replaces the previous contents
+    hRes = cBag2.SetDWord("extra", 1);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SerializeBag(cBag, &lpData, &nDataLen);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag2.Deserialize(lpData, nDataLen);
+    }
+    MX_FREE(lpData);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = CompareBags(cBag, cBag2);
+    }
+
+    // done
+    return hRes;
+}
+
+static HRESULT TestDeserializeInvalidData()
+{
+    MX::CPropertyBag cBag, cBag2;
+    LPBYTE lpData = NULL, lpNewData;
+    SIZE_T nDataLen;
+    HRESULT hRes;
+
+    hRes = FillBag(cBag);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SerializeBag(cBag, &lpData, &nDataLen);
+    }
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+
+    // every truncation must be rejected and leave the bag empty
+    for (SIZE_T nLen = 0; nLen < nDataLen; nLen++)
+    {
+        hRes = cBag2.SetDWord("stale", 1);
+        if (FAILED(hRes))
+        {
+            goto done;
+        }
+        if (cBag2.Deserialize(lpData, nLen) != MX_E_InvalidData || cBag2.GetCount() != 0)
+        {
+            hRes = E_FAIL;
+            goto done;
+        }
+    }
+
+    // trailing garbage
+    lpNewData = (LPBYTE)MX_REALLOC(lpData, nDataLen + 1);
+    if (lpNewData == NULL)
+    {
+        hRes = E_OUTOFMEMORY;
+        goto done;
+    }
+    lpData = lpNewData;
+    lpData[nDataLen] = 0;
+    if (cBag2.Deserialize(lpData, nDataLen + 1) != MX_E_InvalidData)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+
+    // bad magic and version
+    lpData[0] ^= 0xFF;
+    if (cBag2.Deserialize(lpData, nDataLen) != MX_E_InvalidData)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+    lpData[0] ^= 0xFF;
+    lpData[4] += 1;
+    if (cBag2.Deserialize(lpData, nDataLen) != MX_E_InvalidData)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+    lpData[4] -= 1;
+
+    // unknown type
+    lpData[12] = 0x7F;
+    if (cBag2.Deserialize(lpData, nDataLen) != MX_E_InvalidData)
+    {
+        hRes = E_FAIL;
+        goto done;
+    }
+    hRes = S_OK;
+
+done:
+    MX_FREE(lpData);
+    return hRes;
+}
+
+static HRESULT FillBag(_In_ MX::CPropertyBag &cBag)
+{
+    HRESULT hRes;
+
+    hRes = cBag.SetDWord("dword", 0xDEADBEEFUL);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetQWord("qword", 0x0123456789ABCDEFui64);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetDouble("double", -1.5);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetString("ansi", "Hello World");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetString("empty", "");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetString("wide", L"Hello \x00E1\x00E9\x00ED");
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cBag.SetNull("null");
+    }
+    return hRes;
+}
+
+static HRESULT CompareBags(_In_ MX::CPropertyBag &cBag1, _In_ MX::CPropertyBag &cBag2)
+{
+    LPCSTR szNameA, szValue1A, szValue2A;
+    LPCWSTR szValue1W, szValue2W;
+    DWORD dw1, dw2;
+    ULONGLONG ull1, ull2;
+    double nDbl1, nDbl2;
+
+    if (cBag1.GetCount() != cBag2.GetCount())
+    {
+        return E_FAIL;
+    }
+    for (SIZE_T i = 0; (szNameA = cBag1.GetAt(i)) != NULL; i++)
+    {
+        if (MX::StrCompareA(szNameA, cBag2.GetAt(i)) != 0 || cBag1.GetType(i) != cBag2.GetType(i))
+        {
+            return E_FAIL;
+        }
+        switch (cBag1.GetType(i))
+        {
+            case MX::CPropertyBag::eType::DWord:
+                cBag1.GetDWord(i, dw1);
+                cBag2.GetDWord(i, dw2);
+                if (dw1 != dw2)
+                {
+                    return E_FAIL;
+                }
+                break;
+
+            case MX::CPropertyBag::eType::QWord:
+                cBag1.GetQWord(i, ull1);
+                cBag2.GetQWord(i, ull2);
+                if (ull1 != ull2)
+                {
+                    return E_FAIL;
+                }
+                break;
+
+            case MX::CPropertyBag::eType::Double:
+                cBag1.GetDouble(i, nDbl1);
+                cBag2.GetDouble(i, nDbl2);
+                if (nDbl1 != nDbl2)
+                {
+                    return E_FAIL;
+                }
+                break;
+
+            case MX::CPropertyBag::eType::AnsiString:
+                cBag1.GetString(i, szValue1A);
+                cBag2.GetString(i, szValue2A);
+                if (MX::StrCompareA(szValue1A, szValue2A) != 0)
+                {
+                    return E_FAIL;
+                }
+                break;
+
+            case MX::CPropertyBag::eType::WideString:
+                cBag1.GetString(i, szValue1W);
+                cBag2.GetString(i, szValue2W);
+                if (MX::StrCompareW(szValue1W, szValue2W) != 0)
+                {
+                    return E_FAIL;
+                }
+                break;
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT SerializeBag(_In_ MX::CPropertyBag &cBag, _Out_ LPBYTE *lplpData, _Out_ SIZE_T *lpnDataLen)
+{
+    HRESULT hRes;
+
+    *lpnDataLen = cBag.GetSerializedSize();
+    *lplpData = (LPBYTE)MX_MALLOC(*lpnDataLen);
+    if (*lplpData == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hRes = cBag.Serialize(*lplpData, *lpnDataLen);
+    if (FAILED(hRes))
+    {
+        MX_FREE(*lplpData);
+    }
+    return hRes;
+}
@@ -0,0 +1,302 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the LICENSE file distributed with
+ * this work for additional information regarding copyright ownership.
+ *
+ * Also, if exists, check the Licenses directory for information about
+ * third-party modules.
+ *
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TestUrl.h"
+#include <Http\UrlView.h>
+#include <Http\HttpCommon.h>
+
+//-----------------------------------------------------------
+
+typedef struct tagHOST_CASE
+{
+    LPCSTR szHostA;
+    BOOL bValid;
+} HOST_CASE;
+
+//-----------------------------------------------------------
+
+static const LPCSTR aUrls[] = {
+    // valid
+    "/", "/index.html", "/a/b/../c?x=1&y=%20z#frag", "/path%20with%20spaces", "/%C3%A9t%C3%A9", "/a+b?c+d=e+f",
+    "/a%2fb", "/..%2fsecret.txt", "/x?q=%00", "http://example.com/x", "http://example.com:8080/x?q",
+    "https://user:pw@example.com/", "http://[::1]:80/", "http://example.com", "URL:http://example.com/a",
+
+    // invalid or suspicious
+    "/%00", "/a%2Fb", "/a%5Cb", "/%u0000", "/%u002F", "/%u005C", "/bad\x01" "char", "/\x80" "high", "/tab\there",
+    "/sp ace", "/%zz", "/%", "/%4", "/%C3", "/%C3%28", "/%FF%FE", "/%ED%A0%80", "/../../etc/passwd", "/a/../../b",
+    "http://exa mple.com/", "http://example.com:0/", "http://example.com:65536/", "http://example.com:99999999999/",
+    "http://example.com:/", "http://:80/", "http://@example.com/", "http://[::1/", "http://[::1]x/",
+    "http://example..com/", "http://-bad-.com/", "http://example.com:8a/", "http://exa%00mple.com/",
+    "http://user@@example.com/", "http:///x", "http://example.com\\x", "1http://example.com/", "ht tp://example.com/"
+};
+
+static const HOST_CASE aHosts[] = {
+    { "localhost", TRUE },
+    { "localhost:8080", TRUE },
+    { "127.0.0.1:65535", TRUE },
+    { "[::1]:80", TRUE },
+    { "local host", FALSE },
+    { "[::1", FALSE },
+    { "localhost:0", FALSE },
+    { "localhost:65536", FALSE },
+    { "localhost:http", FALSE }
+};
+
+//-----------------------------------------------------------
+
+static HRESULT TestViewAgainstUrl();
+static HRESULT TestRequestTargets();
+
+static HRESULT ParseWithView(_In_z_ LPCSTR szUrlA, _Inout_ MX::CUrl &cUrl);
+static HRESULT ValidateWithView(_In_z_ LPCSTR szUrlA);
+static HRESULT ParseRequest(_In_ MX::Internals::CHttpParser &cParser, _In_z_ LPCSTR szTargetA, _In_z_ LPCSTR szHostA);
+
+//-----------------------------------------------------------
+
+int TestUrl()
+{
+    HRESULT hRes;
+
+    if (DoesCmdLineParamExist(L"?") || DoesCmdLineParamExist(L"help"))
+    {
+        wprintf_s(L"Use: Test.exe Url\n\n");
+        wprintf_s(L"Checks CUrlView accepts and rejects the same URLs as CUrl and that the HTTP parser rejects\n");
+        wprintf_s(L"invalid request targets and hosts while parsing the headers.\n");
+        return 1;
+    }
+
+    wprintf_s(L"Comparing CUrlView with CUrl... ");
+    hRes = TestViewAgainstUrl();
+    if (FAILED(hRes))
+    {
+on_error:
+        wprintf_s(L"\nError: Failed [0x%08X].\n", hRes);
+        return (int)hRes;
+    }
+    wprintf_s(L"OK\n");
+
+    wprintf_s(L"Running request target tests... ");
+    hRes = TestRequestTargets();
+    if (FAILED(hRes))
+    {
+        goto on_error;
+    }
+    wprintf_s(L"OK\n");
+
+    // done
+    return 0;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT TestViewAgainstUrl()
+{
+    MX::CStringA cStrUrlA, cStrViewA;
+    SIZE_T i;
+    HRESULT hRes, hResUrl, hResView, hResValidate;
+
+    for (i = 0; i < MX_ARRAYLEN(aUrls); i++)
+    {
+        MX::CUrl cUrl, cViewUrl;
+
+        hResUrl = cUrl.ParseFromString(aUrls[i]);
+        if (hResUrl == E_OUTOFMEMORY)
+        {
+            return hResUrl;
+        }
+        hResView = ParseWithView(aUrls[i], cViewUrl);
+        if (hResView == E_OUTOFMEMORY)
+        {
+            return hResView;
+        }
+
+        // NOTE: The view alone may be more lenient than CUrl but never stricter, and once the CUrl is built
+        //       from it both must agree.
+        if (SUCCEEDED(hResUrl) != SUCCEEDED(hResView))
+        {
+            wprintf_s(L"\nError: '%S' gives 0x%08X with CUrl and 0x%08X with CUrlView.", aUrls[i], hResUrl,
+                      hResView);
+            return E_FAIL;
+        }
+
+        // the parser relies on the validation alone until someone asks for the CUrl
+        hResValidate = ValidateWithView(aUrls[i]);
+        if (SUCCEEDED(hResUrl) != SUCCEEDED(hResValidate))
+        {
+            wprintf_s(L"\nError: '%S' gives 0x%08X with CUrl and 0x%08X with CUrlView::Validate.", aUrls[i],
+                      hResUrl, hResValidate);
+            return E_FAIL;
+        }
+        if (SUCCEEDED(hResUrl))
+        {
+            hRes = cUrl.ToString(cStrUrlA);
+            if (SUCCEEDED(hRes))
+            {
+                hRes = cViewUrl.ToString(cStrViewA);
+            }
+            if (FAILED(hRes))
+            {
+                return hRes;
+            }
+            if (MX::StrCompareA((LPCSTR)cStrUrlA, (LPCSTR)cStrViewA) != 0)
+            {
+                wprintf_s(L"\nError: '%S' gives '%S' with CUrl and '%S' with CUrlView.", aUrls[i], (LPCSTR)cStrUrlA,
+                          (LPCSTR)cStrViewA);
+                return E_FAIL;
+            }
+        }
+    }
+
+    // done
+    return S_OK;
+}
+
+static HRESULT TestRequestTargets()
+{
+    MX::Internals::CHttpParser cParser(TRUE, NULL);
+    MX::CUrl *lpUrl;
+    SIZE_T i;
+    HRESULT hRes;
+
+    // whatever CUrl rejects must be rejected by the parser too
+    for (i = 0; i < MX_ARRAYLEN(aUrls); i++)
+    {
+        MX::CUrl cUrl;
+        LPCSTR sA;
+
+        // only targets that fit in a request line
+        if (aUrls[i][0] != '/' && MX::StrNCompareA(aUrls[i], "http://", 7) != 0 &&
+            MX::StrNCompareA(aUrls[i], "https://", 8) != 0)
+        {
+            continue;
+        }
+        for (sA = aUrls[i]; *sA > ' ' && *sA < 0x7F; sA++)
+        {
+            ;
+        }
+        if (*sA != 0)
+        {
+            continue;
+        }
+
+        hRes = cUrl.ParseFromString(aUrls[i]);
+        if (SUCCEEDED(hRes))
+        {
+            continue;
+        }
+        hRes = ParseRequest(cParser, aUrls[i], "localhost");
+        if (hRes == E_OUTOFMEMORY)
+        {
+            return hRes;
+        }
+        if (SUCCEEDED(hRes))
+        {
+            wprintf_s(L"\nError: Target '%S' was accepted.", aUrls[i]);
+            return E_FAIL;
+        }
+    }
+
+    for (i = 0; i < MX_ARRAYLEN(aHosts); i++)
+    {
+        hRes = ParseRequest(cParser, "/ok?a=1", aHosts[i].szHostA);
+        if (hRes == E_OUTOFMEMORY)
+        {
+            return hRes;
+        }
+        if (SUCCEEDED(hRes) != aHosts[i].bValid)
+        {
+            wprintf_s(L"\nError: Host '%S' gives 0x%08X.", aHosts[i].szHostA, hRes);
+            return E_FAIL;
+        }
+    }
+
+    // the "Host" header replaces the one in the target
+    hRes = ParseRequest(cParser, "http://example.com/a?b=1", "localhost:8080");
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    lpUrl = cParser.GetRequestUri();
+    if (MX::StrCompareW(lpUrl->GetHost(), L"localhost") != 0 || lpUrl->GetPort() != 8080 ||
+        MX::StrCompareW(lpUrl->GetPath(), L"/a") != 0 || lpUrl->GetQueryStringValue(L"b") == NULL ||
+        MX::StrCompareW(lpUrl->GetQueryStringValue(L"b"), L"1") != 0)
+    {
+        return E_FAIL;
+    }
+
+    // done
+    return S_OK;
+}
+
+//-----------------------------------------------------------
+
+static HRESULT ParseWithView(_In_z_ LPCSTR szUrlA, _Inout_ MX::CUrl &cUrl)
+{
+    MX::CUrlView cView;
+    HRESULT hRes;
+
+    hRes = cView.Parse(szUrlA);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cView.ToUrl(cUrl);
+    }
+    // done
+    return hRes;
+}
+
+static HRESULT ValidateWithView(_In_z_ LPCSTR szUrlA)
+{
+    MX::CUrlView cView;
+    HRESULT hRes;
+
+    hRes = cView.Parse(szUrlA);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = cView.Validate();
+    }
+    // done
+    return hRes;
+}
+
+static HRESULT ParseRequest(_In_ MX::Internals::CHttpParser &cParser, _In_z_ LPCSTR szTargetA, _In_z_ LPCSTR szHostA)
+{
+    MX::CStringA cStrRequestA;
+    SIZE_T nUsed;
+    HRESULT hRes;
+
+    cParser.Reset();
+    if (cStrRequestA.Format("GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", szTargetA, szHostA) == FALSE)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // NOTE: Failures must be reported while parsing, before the server sees the headers.
+    hRes = cParser.Parse((LPCSTR)cStrRequestA, cStrRequestA.GetLength(), nUsed);
+    if (FAILED(hRes))
+    {
+        return hRes;
+    }
+    if (cParser.GetState() != MX::Internals::CHttpParser::eState::Done || nUsed != cStrRequestA.GetLength())
+    {
+        return MX_E_InvalidData;
+    }
+
+    // done
+    return S_OK;
+}